@@ -22,13 +22,14 @@ limitations under the License.
 #include "frontends/common/resolveReferences/referenceMap.h"
 #include "frontends/p4/methodInstance.h"
 #include "frontends/p4/tableApply.h"
+#include "frontends/p4/parameterSubstitution.h"
 
 namespace BMV2 {
 
 unsigned CFG::Node::crtId = 0;
 
 void CFG::EdgeSet::dbprint(std::ostream& out) const {
-    for (auto s : edges)
+    for (auto& s : edges)
         out << " " << s;
 }
 
@@ -55,8 +56,8 @@ void CFG::Node::dbprint(std::ostream& out) const
 void CFG::dbprint(std::ostream& out, CFG::Node* node, std::set<CFG::Node*> &done) const {
     if (done.find(node) != done.end())
         return;
-    for (auto p : node->predecessors.edges)
-        dbprint(out, p->endpoint, done);
+    for (auto& p : node->predecessors.edges)
+        dbprint(out, p.endpoint, done);
     out << std::endl << node;
     done.emplace(node);
 }
@@ -69,8 +70,8 @@ void CFG::dbprint(std::ostream& out) const {
 }
 
 void CFG::Node::computeSuccessors() {
-    for (auto e : predecessors.edges)
-        e->getNode()->successors.emplace(e->clone(this));
+    for (auto& e : predecessors.edges)
+        e.getNode()->successors.emplace(e.clone(this));
 }
 
 bool CFG::dfs(Node* node, std::set<Node*> &visited,
@@ -88,8 +89,8 @@ bool CFG::dfs(Node* node, std::set<Node*> &visited,
         return true;
     if (table != nullptr)
         stack.emplace(table);
-    for (auto e : node->successors.edges) {
-        bool success = dfs(e->endpoint, visited, stack);
+    for (auto& e : node->successors.edges) {
+        bool success = dfs(e.endpoint, visited, stack);
         if (!success) return false;
     }
     if (table != nullptr)
@@ -161,7 +162,7 @@ class CFGBuilder : public Inspector {
         auto tc = am->object->to<IR::P4Table>();
         auto node = cfg->makeNode(tc, statement->methodCall);
         node->addPredecessors(current);
-        setAfter(statement, new CFG::EdgeSet(new CFG::Edge(node)));
+        setAfter(statement, new CFG::EdgeSet(CFG::Edge(node)));
         return false;
     }
     bool preorder(const IR::IfStatement* statement) override {
@@ -179,7 +180,7 @@ class CFGBuilder : public Inspector {
 
         node->addPredecessors(current);
         // If branch
-        current = new CFG::EdgeSet(new CFG::Edge(node, true));
+        current = new CFG::EdgeSet(CFG::Edge(node, true));
         visit(statement->ifTrue);
         auto ifTrue = get(statement->ifTrue);
         if (ifTrue == nullptr)
@@ -187,13 +188,13 @@ class CFGBuilder : public Inspector {
         auto result = new CFG::EdgeSet(ifTrue);
         // Else branch
         if (statement->ifFalse != nullptr) {
-            current = new CFG::EdgeSet(new CFG::Edge(node, false));
+            current = new CFG::EdgeSet(CFG::Edge(node, false));
             visit(statement->ifFalse);
             auto ifFalse = get(statement->ifFalse);
             result->mergeWith(ifFalse);
         } else {
             // no else branch
-            result->mergeWith(new CFG::EdgeSet(new CFG::Edge(node, false)));
+            result->emplace(CFG::Edge(node, false));
         }
         setAfter(statement, result);
         return false;
@@ -214,7 +215,7 @@ class CFGBuilder : public Inspector {
                   statement->expression);
         auto node = cfg->makeNode(tc, statement->expression);
         node->addPredecessors(current);
-        auto result = new CFG::EdgeSet(new CFG::Edge(node));  // In case no label matches
+        auto result = new CFG::EdgeSet(CFG::Edge(node));  // In case no label matches
         auto labels = new CFG::EdgeSet();
         for (auto sw : statement->cases) {
             cstring label;
@@ -225,7 +226,7 @@ class CFGBuilder : public Inspector {
                 CHECK_NULL(pe);
                 label = pe->path->name.name;
             }
-            labels->mergeWith(new CFG::EdgeSet(new CFG::Edge(node, label)));
+            labels->emplace(CFG::Edge(node, label));
             if (sw->statement != nullptr) {
                 current = labels;
                 visit(sw->statement);
@@ -256,7 +257,7 @@ void CFG::build(const IR::P4Control* cc,
     exitPoint = makeNode(cc->name + ".exit");
 
     CFGBuilder builder(this, refMap, typeMap);
-    auto startValue = new CFG::EdgeSet(new CFG::Edge(entryPoint));
+    auto startValue = new CFG::EdgeSet(CFG::Edge(entryPoint));
     auto last = builder.run(cc->body, startValue);
     LOG1("Before exit " << last);
     if (last != nullptr) {
@@ -298,4 +299,161 @@ void ProgramParts::analyze(IR::ToplevelBlock* toplevel) {
     toplevel->getProgram()->apply(disc);
 }
 
+namespace {
+// Collects the fields that expressions, statements and actions read and write
+class AccessCollector : public Inspector {
+    P4::ReferenceMap* refMap;
+    P4::TypeMap*      typeMap;
+    TableDependencies::Access* access;
+
+    // The field that the expression stands for, or null if it is not a field
+    cstring location(const IR::Expression* expression) const {
+        if (auto pe = expression->to<IR::PathExpression>())
+            return pe->path->name.name;
+        if (auto mem = expression->to<IR::Member>()) {
+            cstring base = location(mem->expr);
+            if (base.isNullOrEmpty())
+                return nullptr;
+            // next, last and lastIndex of a stack may be any of its elements
+            if (typeMap->getType(mem->expr, true)->is<IR::Type_Stack>())
+                return base;
+            return base + "." + mem->member.name;
+        }
+        if (auto ai = expression->to<IR::ArrayIndex>())
+            return location(ai->left);
+        if (auto slice = expression->to<IR::Slice>())
+            return location(slice->e0);
+        return nullptr;
+    }
+    void write(const IR::Expression* expression) {
+        cstring loc = location(expression);
+        if (loc.isNullOrEmpty()) {
+            access->unknown = true;
+            return;
+        }
+        access->writes.emplace(loc);
+        // the indexes of the left-hand side are read
+        if (auto ai = expression->to<IR::ArrayIndex>())
+            visit(ai->right);
+    }
+
+ public:
+    AccessCollector(P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
+                    TableDependencies::Access* access) :
+            refMap(refMap), typeMap(typeMap), access(access) {}
+
+    bool preorder(const IR::PathExpression* expression) override {
+        access->reads.emplace(location(expression));
+        return false;
+    }
+    bool preorder(const IR::Member* expression) override {
+        cstring loc = location(expression);
+        if (loc.isNullOrEmpty())
+            return true;
+        access->reads.emplace(loc);
+        return false;
+    }
+    bool preorder(const IR::ArrayIndex* expression) override {
+        visit(expression->left);
+        visit(expression->right);
+        return false;
+    }
+    bool preorder(const IR::AssignmentStatement* statement) override {
+        write(statement->left);
+        visit(statement->right);
+        return false;
+    }
+    bool preorder(const IR::MethodCallExpression* expression) override {
+        auto mi = P4::MethodInstance::resolve(expression, refMap, typeMap);
+        if (auto bim = mi->to<P4::BuiltInMethod>()) {
+            if (bim->name == IR::Type_Header::isValid)
+                visit(bim->appliedTo);
+            else
+                write(bim->appliedTo);  // setValid, setInvalid, push_front, pop_front
+            visit(expression->arguments);
+            return false;
+        }
+        if (auto ac = mi->to<P4::ActionCall>()) {
+            visit(ac->action->body);
+            return false;
+        }
+        if (auto em = mi->to<P4::ExternMethod>()) {
+            access->reads.emplace(em->object->getName().name);
+            access->writes.emplace(em->object->getName().name);
+        } else if (!mi->is<P4::ExternFunction>()) {
+            access->unknown = true;
+            return false;
+        }
+        P4::ParameterSubstitution binding;
+        binding.populate(mi->getActualParameters(), expression->arguments);
+        for (auto p : *mi->getActualParameters()->getEnumerator()) {
+            auto arg = binding.lookup(p);
+            if (arg == nullptr)
+                continue;
+            if (p->direction == IR::Direction::Out || p->direction == IR::Direction::InOut)
+                write(arg);
+            if (p->direction != IR::Direction::Out)
+                visit(arg);
+        }
+        return false;
+    }
+};
+}  // namespace
+
+void TableDependencies::analyze(const CFG* cfg) {
+    for (auto node : cfg->allNodes) {
+        auto& access = accesses[node];
+        AccessCollector collector(refMap, typeMap, &access);
+        if (auto tn = node->to<CFG::TableNode>()) {
+            auto key = tn->table->getKey();
+            if (key != nullptr) {
+                for (auto ke : *key->keyElements)
+                    ke->expression->apply(collector);
+            }
+            for (auto ale : *tn->table->getActionList()->actionList) {
+                auto decl = refMap->getDeclaration(ale->getPath(), true);
+                if (auto action = decl->getNode()->to<IR::P4Action>())
+                    action->body->apply(collector);
+                else
+                    access.unknown = true;
+            }
+        } else if (auto in = node->to<CFG::IfNode>()) {
+            in->statement->condition->apply(collector);
+        }
+    }
+}
+
+bool TableDependencies::overlap(const std::set<cstring>& a, const std::set<cstring>& b) {
+    for (auto x : a) {
+        // a field overlaps with itself, with what contains it, and with its parts; all of
+        // these sort right after the longest of their common prefixes
+        for (auto it = b.lower_bound(x); it != b.end() && it->startsWith(x); ++it) {
+            if (it->size() == x.size() || it->c_str()[x.size()] == '.')
+                return true;
+        }
+        for (auto dot = x.find('.'); dot != nullptr; dot = strchr(dot + 1, '.')) {
+            if (b.count(x.substr(0, dot - x.c_str())))
+                return true;
+        }
+    }
+    return false;
+}
+
+bool TableDependencies::readsWritesOf(const CFG::Node* reader, const CFG::Node* writer) const {
+    auto& r = access(reader);
+    auto& w = access(writer);
+    if (r.unknown || w.unknown)
+        return true;
+    return overlap(r.reads, w.writes);
+}
+
+bool TableDependencies::independent(const CFG::Node* a, const CFG::Node* b) const {
+    auto& x = access(a);
+    auto& y = access(b);
+    if (x.unknown || y.unknown)
+        return false;
+    return !overlap(x.reads, y.writes) && !overlap(x.writes, y.reads) &&
+           !overlap(x.writes, y.writes);
+}
+
 }  // namespace BMV2
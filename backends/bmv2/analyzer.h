@@ -17,6 +17,9 @@ limitations under the License.
 #ifndef _BACKENDS_BMV2_ANALYZER_H_
 #define _BACKENDS_BMV2_ANALYZER_H_
 
+#include <algorithm>
+#include <vector>
+
 #include "ir/ir.h"
 #include "frontends/p4/typeMap.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
@@ -27,20 +30,64 @@ namespace BMV2 {
 // This CFG is only good for BMV2, which only cares about some Nodes in the program
 class CFG final : public IHasDbPrint {
  public:
-    class Edge;
+    class Node;
+
+ protected:
+    enum class EdgeType {
+        Unconditional,
+        True,
+        False,
+        Label
+    };
+
+ public:
+    class Edge final {
+     protected:
+        EdgeType type;
+        Edge(Node* node, EdgeType type, cstring label) : type(type), endpoint(node), label(label) {}
 
+     public:
+        Node*    endpoint;
+        cstring  label;  // only present if type == Label
+
+        explicit Edge(Node* node) : type(EdgeType::Unconditional), endpoint(node)
+        { CHECK_NULL(node); }
+        Edge(Node* node, bool b) :
+                type(b ? EdgeType::True : EdgeType::False), endpoint(node)
+        { CHECK_NULL(node); }
+        Edge(Node* node, cstring label) :
+                type(EdgeType::Label), endpoint(node), label(label)
+        { CHECK_NULL(node); }
+        void dbprint(std::ostream& out) const;
+        Edge clone(Node* node) const
+        { return Edge(node, type, label); }
+        bool operator==(const Edge& other) const
+        { return type == other.type && endpoint == other.endpoint && label == other.label; }
+        Node* getNode() const { return endpoint; }
+        bool  getBool() const {
+            BUG_CHECK(isBool(), "Edge is not Boolean");
+            return type == EdgeType::True;
+        }
+        bool isBool() const { return type == EdgeType::True || type == EdgeType::False; }
+        bool isUnconditional() const { return type == EdgeType::Unconditional; }
+    };
+
+    // The edges are kept by value, in the order they were added; the sets are small,
+    // so a vector searched on insertion is the cheapest set.
     class EdgeSet final {
      public:
-        ordered_set<CFG::Edge*> edges;
+        std::vector<CFG::Edge> edges;
 
         EdgeSet() = default;
-        explicit EdgeSet(CFG::Edge* edge) { edges.emplace(edge); }
-        explicit EdgeSet(const EdgeSet* other) { mergeWith(other); }
+        explicit EdgeSet(const CFG::Edge& edge) { edges.push_back(edge); }
+        explicit EdgeSet(const EdgeSet* other) : edges(other->edges) {}
 
         void mergeWith(const EdgeSet* other)
-        { edges.insert(other->edges.begin(), other->edges.end()); }
+        { for (auto& e : other->edges) emplace(e); }
         void dbprint(std::ostream& out) const;
-        void emplace(CFG::Edge* edge) { edges.emplace(edge); }
+        void emplace(const CFG::Edge& edge) {
+            if (std::find(edges.begin(), edges.end(), edge) == edges.end())
+                edges.push_back(edge); }
         size_t size() const { return edges.size(); }
     };
 
@@ -88,44 +135,6 @@ class CFG final : public IHasDbPrint {
         explicit DummyNode(cstring name) : Node(name) {}
     };
 
- protected:
-    enum class EdgeType {
-        Unconditional,
-        True,
-        False,
-        Label
-    };
-
- public:
-    class Edge final {
-     protected:
-        EdgeType type;
-        Edge(Node* node, EdgeType type, cstring label) : type(type), endpoint(node), label(label) {}
-
-     public:
-        Node*    endpoint;
-        cstring  label;  // only present if type == Label
-
-        explicit Edge(Node* node) : type(EdgeType::Unconditional), endpoint(node)
-        { CHECK_NULL(node); }
-        Edge(Node* node, bool b) :
-                type(b ? EdgeType::True : EdgeType::False), endpoint(node)
-        { CHECK_NULL(node); }
-        Edge(Node* node, cstring label) :
-                type(EdgeType::Label), endpoint(node), label(label)
-        { CHECK_NULL(node); }
-        void dbprint(std::ostream& out) const;
-        Edge* clone(Node* node) const
-        { return new Edge(node, type, label); }
-        Node* getNode() { return endpoint; }
-        bool  getBool() {
-            BUG_CHECK(isBool(), "Edge is not Boolean");
-            return type == EdgeType::True;
-        }
-        bool isBool() const { return type == EdgeType::True || type == EdgeType::False; }
-        bool isUnconditional() const { return type == EdgeType::Unconditional; }
-    };
-
  public:
     Node* entryPoint;
     Node* exitPoint;
@@ -167,6 +176,37 @@ class CFG final : public IHasDbPrint {
              std::set<const IR::P4Table*> &stack) const;
 };
 
+// The fields that the tables and conditionals of a CFG read and write, and so which
+// of them depend on which.  A field is named by its path from a parameter or variable,
+// e.g. hdr.ipv4.ttl; a header, struct or stack stands for all of its fields, and
+// the state of an extern instance is a field named after the instance.
+class TableDependencies final {
+ public:
+    struct Access {
+        std::set<cstring> reads;
+        std::set<cstring> writes;
+        bool unknown = false;  // may read and write anything
+    };
+
+ private:
+    P4::ReferenceMap* refMap;
+    P4::TypeMap*      typeMap;
+    std::map<const CFG::Node*, Access> accesses;
+
+    static bool overlap(const std::set<cstring>& a, const std::set<cstring>& b);
+
+ public:
+    TableDependencies(P4::ReferenceMap* refMap, P4::TypeMap* typeMap) :
+            refMap(refMap), typeMap(typeMap) { CHECK_NULL(refMap); CHECK_NULL(typeMap); }
+    void analyze(const CFG* cfg);
+    const Access& access(const CFG::Node* node) const { return accesses.at(node); }
+    // True if 'reader' reads something that 'writer' writes
+    bool readsWritesOf(const CFG::Node* reader, const CFG::Node* writer) const;
+    // True if the nodes can run in either order, or at once: neither writes anything
+    // that the other reads or writes
+    bool independent(const CFG::Node* a, const CFG::Node* b) const;
+};
+
 // Represents global information about a P4 v1.2 program
 class ProgramParts {
  public:
@@ -24,16 +24,16 @@ limitations under the License.
 #include "lib/exceptions.h"
 #include "lib/gc.h"
 #include "lib/nullstream.h"
+#include "frontends/common/batch.h"
 #include "frontends/common/parseInput.h"
 #include "frontends/p4/frontend.h"
+#include "bmv2options.h"
 #include "midend.h"
 #include "jsonconverter.h"
 
-int main(int argc, char *const argv[]) {
-    setup_gc_logging();
-
-    CompilerOptions options;
-    options.langVersion = CompilerOptions::FrontendVersion::P4_16;
+// Compiles the program given by this command line; returns the exit status
+static int compileCommand(int argc, char *const argv[]) {
+    BMV2::BMV2Options options;
 
     if (options.process(argc, argv) != nullptr)
         options.setInputFile();
@@ -44,24 +44,31 @@ int main(int argc, char *const argv[]) {
 
     // BMV2 is required for compatibility with the previous compiler.
     options.preprocessor_options += " -D__TARGET_BMV2__";
-    auto program = parseP4File(options);
-    if (program == nullptr || ::errorCount() > 0)
-        return 1;
     P4::FrontEnd frontend;
     frontend.addDebugHook(hook);
-    program = frontend.run(options, program);
+    auto program = parseAndRunFrontEnd(options, frontend);
     if (program == nullptr || ::errorCount() > 0)
         return 1;
 
     BMV2::MidEnd midEnd(options);
     midEnd.addDebugHook(hook);
     auto toplevel = midEnd.process(program);
-    if (options.dumpJsonFile)
-        JSONGenerator(*openFile(options.dumpJsonFile, true)) << program << std::endl;
+    if (options.dumpJsonFile) {
+        auto out = openFile(options.dumpJsonFile, true);
+        JSONGenerator(*out, options.compactJson) << program << std::endl;
+        delete out;  // finishes a .gz file
+    }
     if (::errorCount() > 0 || toplevel == nullptr)
         return 1;
 
     BMV2::JsonConverter converter(options);
+    converter.emitDependencies = options.emitDependencies;
+    converter.keepScalarOrder = options.keepScalarOrder;
+    converter.internFields = options.internFields;
+    converter.ifChainTables = options.ifChainTables;
+    converter.packetProfile = options.packetProfile;
+    converter.jsonCacheDir = options.jsonCacheDir;
+    converter.nativeActionsFile = options.nativeActionsFile;
     converter.convert(&midEnd.refMap, &midEnd.typeMap, toplevel);
     if (::errorCount() > 0)
         return 1;
@@ -73,6 +80,14 @@ int main(int argc, char *const argv[]) {
             out->flush();
         }
     }
+    options.writePassStats();
 
     return ::errorCount() > 0;
 }
+
+int main(int argc, char *const argv[]) {
+    setup_gc_logging();
+
+    int status = runBatch(argc, argv, compileCommand);
+    return status >= 0 ? status : compileCommand(argc, argv);
+}
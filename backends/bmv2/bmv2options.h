@@ -0,0 +1,99 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_BMV2_BMV2OPTIONS_H_
+#define _BACKENDS_BMV2_BMV2OPTIONS_H_
+
+#include "frontends/common/options.h"
+
+namespace BMV2 {
+
+class BMV2Options : public CompilerOptions {
+ public:
+    // add to the tables and conditionals which others they depend on
+    bool emitDependencies = false;
+    // compute the expressions of actions one operation at a time, in temporaries
+    bool flattenExpressions = false;
+    // remove the metadata fields and variables that are written but never read
+    bool removeDeadMetadata = false;
+    // adjust the checksums where their fields change, rather than in the update control
+    bool incrementalChecksum = false;
+    // leave the scalars in the order of their declarations
+    bool keepScalarOrder = false;
+    // refer to fields by index in a table of their names
+    bool internFields = false;
+    // make tables of the chains of if statements that compare a field with constants
+    bool ifChainTables = false;
+    // counts of packets of a run of the switch, to lay out the parsers for
+    cstring packetProfile = nullptr;
+    // folder of the JSON of the controls of earlier compilations
+    cstring jsonCacheDir = nullptr;
+    // C++ file for the actions as native primitives
+    cstring nativeActionsFile = nullptr;
+
+    BMV2Options() {
+        langVersion = CompilerOptions::FrontendVersion::P4_16;
+        registerOption("--emitDependencies", nullptr,
+                       [this](const char*) { emitDependencies = true; return true; },
+                       "Add to each table in the JSON the tables of its pipeline that it\n"
+                       "is independent of, and to each conditional the tables whose\n"
+                       "results it reads, from the fields that they read and write");
+        registerOption("--flattenExpressions", nullptr,
+                       [this](const char*) { flattenExpressions = true; return true; },
+                       "Split the expressions assigned in actions into one primitive per\n"
+                       "operation on temporaries, computing each operation only once");
+        registerOption("--removeDeadMetadata", nullptr,
+                       [this](const char*) { removeDeadMetadata = true; return true; },
+                       "Remove the user metadata fields and the local variables that are\n"
+                       "written but never read, and the assignments to them");
+        registerOption("--incrementalChecksum", nullptr,
+                       [this](const char*) { incrementalChecksum = true; return true; },
+                       "Adjust each checksum of the update control where a field that it\n"
+                       "covers is assigned (RFC 1624), rather than computing it again over\n"
+                       "all its fields; keeps checksums that were wrong on arrival wrong");
+        registerOption("--keepScalarOrder", nullptr,
+                       [this](const char*) { keepScalarOrder = true; return true; },
+                       "Leave the fields of the scalars header in the order of their\n"
+                       "declarations, rather than grouped by width and use (for debugging)");
+        registerOption("--internFields", nullptr,
+                       [this](const char*) { internFields = true; return true; },
+                       "Put the names of the fields once in a \"field_ids\" table of the\n"
+                       "JSON, and refer to fields by their index in it (not read by\n"
+                       "simple_switch releases that predate it)");
+        registerOption("--ifChainTables", nullptr,
+                       [this](const char*) { ifChainTables = true; return true; },
+                       "Look up the chains of if statements that compare a field with\n"
+                       "constants in a table with const entries, one per comparison\n"
+                       "(needs a simple_switch that reads the \"entries\" of tables)");
+        registerOption("--packetProfile", "file",
+                       [this](const char* arg) { packetProfile = arg; return true; },
+                       "Try first the parser transitions to the states that parsed the\n"
+                       "most packets in 'file', with lines \"parse_state <name> <count>\"");
+        registerOption("--jsonCache", "dir",
+                       [this](const char* arg) { jsonCacheDir = arg; return true; },
+                       "Reuse the JSON made by earlier compilations for the controls\n"
+                       "that have not changed, and save that of the others, in 'dir'");
+        registerOption("--nativeActions", "file",
+                       [this](const char* arg) { nativeActionsFile = arg; return true; },
+                       "Write the actions that are only arithmetic assignments to 'file' as\n"
+                       "C++ primitives for simple_switch --load-modules, and call them from\n"
+                       "the JSON in place of the primitives that they replace");
+    }
+};
+
+}  // namespace BMV2
+
+#endif /* _BACKENDS_BMV2_BMV2OPTIONS_H_ */
@@ -54,6 +54,8 @@ class Options(object):
         self.verbose = False
         self.preserveTmp = False
         self.observationLog = None
+        self.throughput = 0             # packets to send in throughput mode
+        self.rate = 0                   # packets per second to send them at; 0 is at once
 
 def nextWord(text, sep = None):
     # Split a text at the indicated separator.
@@ -329,6 +331,10 @@ class RunBMV2(object):
         self.tables = []
         self.actions = []
         self.switchLogFile = "switch.log"  # .txt is added by BMv2
+        # In throughput mode, the packets of the stf file, with the interfaces on which
+        # each one is expected, which are sent over and over after the table commands
+        self.stream = []
+        self.streamStart = None
         self.readJson()
     def readJson(self):
         with open(self.jsonfile) as jf:
@@ -359,6 +365,9 @@ class RunBMV2(object):
             self.do_cli_command(self.parse_table_add(cmd))
         elif first == "setdefault":
             self.do_cli_command(self.parse_table_set_default(cmd))
+        elif first == "packet" and self.options.throughput:
+            interface, data = nextWord(cmd)
+            self.stream.append((interface, HexToByte(''.join(data.split())), []))
         elif first == "packet":
             interface, data = nextWord(cmd)
             data = ''.join(data.split())
@@ -370,6 +379,8 @@ class RunBMV2(object):
             interface, data = nextWord(cmd)
             data = ''.join(data.split())
             self.expected.setdefault(interface, []).append(data)
+            if self.stream:
+                self.stream[-1][2].append(interface)
         else:
             if self.options.verbose:
                 print("ignoring stf command:", first, cmd)
@@ -504,6 +515,10 @@ class RunBMV2(object):
                     line, comment = nextWord(line, "#")
                     self.do_command(line)
             cli.stdin.close()
+            if self.options.throughput:
+                # the tables must be written before the stream starts
+                cli.wait()
+                self.sendStream()
             for interface, fp in self.interfaces.iteritems():
                 fp.close()
             cli.wait()
@@ -511,7 +526,10 @@ class RunBMV2(object):
                 reportError("CLI process failed with exit code", cli.returncode)
                 return FAILURE
             # Give time to the model to execute
-            time.sleep(2)
+            if self.options.throughput:
+                self.waitForOutputs()
+            else:
+                time.sleep(2)
             sw.terminate()
             sw.wait()
             # This only works on Unix: negative returncode is
@@ -525,6 +543,68 @@ class RunBMV2(object):
         if self.options.verbose:
             print("Execution completed")
         return SUCCESS
+    def sendStream(self):
+        # Sends options.throughput packets, cycling through the packets of the stf
+        # file, all at once or options.rate per second.  bmv2 replays a pcap file
+        # at the pace of its timestamps, so these are the times to send them at.
+        if len(self.stream) == 0:
+            return
+        gap = 1.0 / self.options.rate if self.options.rate else 0
+        self.streamStart = time.time()
+        for i in range(self.options.throughput):
+            interface, data, _ = self.stream[i % len(self.stream)]
+            when = self.streamStart + i * gap
+            self.interfaces[interface]._write_packet(
+                data, sec=int(when), usec=int((when - int(when)) * 1000000))
+        for interface, fp in self.interfaces.iteritems():
+            fp.flush()
+    def waitForOutputs(self):
+        # Waits until the model has not written any output for a second
+        sizes = None
+        while True:
+            time.sleep(1)
+            files = glob.glob(self.filename('*', "out"))
+            current = [os.stat(f).st_size for f in sorted(files)]
+            if current == sizes:
+                return
+            sizes = current
+    def percentile(self, values, p):
+        return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+    def reportThroughput(self):
+        # The packets per second that came out, and the latency of the packets, from
+        # the time each one was due to be read to the timestamp bmv2 wrote it with.
+        # The n-th packet out of an interface is taken to be the n-th one sent that
+        # the stf file expects there.
+        gap = 1.0 / self.options.rate if self.options.rate else 0
+        due = {}
+        for i in range(self.options.throughput if self.stream else 0):
+            for interface in self.stream[i % len(self.stream)][2]:
+                due.setdefault(interface, []).append(self.streamStart + i * gap)
+        received = 0
+        last = self.streamStart
+        latencies = []
+        for file in glob.glob(self.filename('*', "out")):
+            interface = self.interface_of_filename(file)
+            packets = rdpcap(file) if os.stat(file).st_size else []
+            received += len(packets)
+            times = due.get(interface, [])
+            for i in range(len(packets)):
+                last = max(last, float(packets[i].time))
+                if i < len(times):
+                    latencies.append(float(packets[i].time) - times[i])
+        elapsed = last - self.streamStart if self.streamStart else 0
+        report = OrderedDict()
+        report["sent"] = self.options.throughput if self.stream else 0
+        report["received"] = received
+        report["seconds"] = round(elapsed, 6)
+        report["packets_per_second"] = round(received / elapsed, 1) if elapsed > 0 else 0
+        if latencies:
+            latencies.sort()
+            for p in [50, 90, 99]:
+                report["latency_p%d_usec" % p] = round(self.percentile(latencies, p) * 1e6, 1)
+            report["latency_max_usec"] = round(latencies[-1] * 1e6, 1)
+        print("Throughput:", json.dumps(report))
+        return SUCCESS
     def comparePacket(self, expected, received):
         received = ''.join(ByteToHex(str(received)).split()).upper()
         expected = ''.join(expected.split()).upper()
@@ -544,6 +624,8 @@ class RunBMV2(object):
             print("Log file:")
             print(log)
     def checkOutputs(self):
+        if self.options.throughput:
+            return self.reportThroughput()
         if self.options.verbose:
             print("Comparing outputs")
         direction = "out"
@@ -598,7 +680,11 @@ def run_model(options, tmpdir, jsonfile, testfile):
 ######################### main
 
 def usage(options):
-    print("usage:", options.binary, "[-v] [-observation-log <file>] <json file> <stf file>");
+    print("usage:", options.binary, "[-v] [-observation-log <file>] [-throughput <count>]",
+          "[-rate <pps>] <json file> <stf file>");
+    print("  -throughput <count>: instead of checking the outputs, send the packets of the",
+          "stf file <count> times in all and report the throughput and latency")
+    print("  -rate <pps>: send them at this rate, rather than all at once")
 
 def main(argv):
     options = Options()
@@ -616,6 +702,16 @@ def main(argv):
                 sys.exit(1)
             options.observationLog = argv[1]
             argv = argv[1:]
+        elif argv[0] == '-throughput' or argv[0] == '-rate':
+            if len(argv) == 1:
+                reportError("Missing argument", argv[0])
+                usage(options)
+                sys.exit(1)
+            if argv[0] == '-throughput':
+                options.throughput = int(argv[1])
+            else:
+                options.rate = float(argv[1])
+            argv = argv[1:]
         else:
             reportError("Unknown option ", argv[0])
             usage(options)
@@ -0,0 +1,224 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "deadMetadata.h"
+#include "lib/log.h"
+#include "midend/has_side_effects.h"
+
+namespace BMV2 {
+
+cstring DeadMetadata::path(const IR::Expression* expression) const {
+    if (auto member = expression->to<IR::Member>()) {
+        cstring base = path(member->expr);
+        if (base.isNull())
+            return base;
+        return base.isNullOrEmpty() ? member->member.name : base + "." + member->member;
+    }
+    if (metadataType.isNull() || !expression->is<IR::PathExpression>())
+        return nullptr;
+    auto decl = refMap->getDeclaration(expression->to<IR::PathExpression>()->path);
+    if (decl == nullptr || !decl->is<IR::Parameter>())
+        return nullptr;
+    auto type = typeMap->getTypeType(decl->to<IR::Parameter>()->type, true);
+    if (type->is<IR::Type_Struct>() && type->to<IR::Type_Struct>()->name == metadataType)
+        return "";
+    return nullptr;
+}
+
+const IR::Declaration_Variable* DeadMetadata::variable(const IR::Expression* expression) const {
+    if (!expression->is<IR::PathExpression>())
+        return nullptr;
+    auto decl = refMap->getDeclaration(expression->to<IR::PathExpression>()->path);
+    if (decl == nullptr || !decl->is<IR::Declaration_Variable>())
+        return nullptr;
+    auto var = decl->to<IR::Declaration_Variable>();
+    if (!isScalar(typeMap->getTypeType(var->type, true)))
+        return nullptr;
+    return var;
+}
+
+Visitor::profile_t FindDeadMetadata::init_apply(const IR::Node* node) {
+    reads.clear();
+    readVariables.clear();
+    variables.clear();
+    uses.clear();
+    dead->fields.clear();
+    dead->variables.clear();
+    dead->structs.clear();
+    dead->metadataType = nullptr;
+
+    // In v1model the metadata is the third parameter of the parser
+    program = node->to<IR::P4Program>();
+    if (program != nullptr) {
+        bool found = false;
+        for (auto decl : *program->declarations) {
+            auto parser = decl->to<IR::P4Parser>();
+            if (parser == nullptr || parser->type->applyParams->parameters->size() < 3)
+                continue;
+            auto param = parser->type->applyParams->parameters->at(2);
+            auto type = dead->typeMap->getTypeType(param->type, true);
+            cstring name = type->is<IR::Type_Struct>() ?
+                    type->to<IR::Type_Struct>()->name.name : cstring();
+            if (found && name != dead->metadataType)
+                name = nullptr;  // not sure which is the metadata
+            dead->metadataType = name;
+            found = true;
+        }
+    }
+    return Inspector::init_apply(node);
+}
+
+bool FindDeadMetadata::isRead(cstring field) const {
+    for (auto r : reads) {
+        if (r.isNullOrEmpty() || r == field || field.startsWith(r + ".") ||
+            r.startsWith(field + "."))
+            return true;
+    }
+    return false;
+}
+
+void FindDeadMetadata::addFields(const IR::Type_Struct* type, cstring prefix,
+                                 unsigned& width) {
+    for (auto f : *type->fields) {
+        // BMv2 reads these itself
+        if (prefix.isNullOrEmpty() &&
+            (f->name == "intrinsic_metadata" || f->name == "queueing_metadata"))
+            continue;
+        cstring path = prefix.isNullOrEmpty() ? f->name.name : prefix + "." + f->name;
+        auto ftype = dead->typeMap->getTypeType(f->type, true);
+        if (auto st = ftype->to<IR::Type_Struct>()) {
+            // the fields of a struct used elsewhere too stay
+            if (uses[st->name] != 1)
+                continue;
+            dead->structs.emplace(st->name, path);
+            addFields(st, path, width);
+        } else if (DeadMetadata::isScalar(ftype) && !isRead(path)) {
+            LOG1("Metadata field " << path << " is never read");
+            dead->fields.emplace(path);
+            width += ftype->width_bits();
+        }
+    }
+}
+
+void FindDeadMetadata::end_apply() {
+    unsigned width = 0;
+    if (!dead->metadataType.isNull() && program != nullptr) {
+        auto decl = program->getDeclByName(dead->metadataType);
+        if (decl != nullptr && decl->is<IR::Type_Struct>()) {
+            dead->structs.emplace(dead->metadataType, "");
+            addFields(decl->to<IR::Type_Struct>(), "", width);
+        }
+    }
+    for (auto v : variables) {
+        if (readVariables.count(v) != 0)
+            continue;
+        LOG1("Variable " << v << " is never read");
+        dead->variables.emplace(v);
+        width += dead->typeMap->getTypeType(v->type, true)->width_bits();
+    }
+    if (Log::verbose() && width != 0)
+        std::cerr << "Removing " << dead->fields.size() << " metadata fields and "
+                  << dead->variables.size() << " variables that are never read ("
+                  << width << " bits)" << std::endl;
+}
+
+bool FindDeadMetadata::removable(const IR::Expression* left) const {
+    if (!DeadMetadata::isScalar(dead->typeMap->getType(left, true)))
+        return false;
+    return !dead->path(left).isNull() || dead->variable(left) != nullptr;
+}
+
+bool FindDeadMetadata::preorder(const IR::AssignmentStatement* statement) {
+    auto left = statement->left;
+    if (auto slice = left->to<IR::Slice>())
+        left = slice->e0;
+    // a write that stays, e.g. of a whole struct, counts as a read
+    if (!removable(left) || hasSideEffects(statement->right))
+        return true;
+    visit(statement->right);
+    return false;
+}
+
+bool FindDeadMetadata::preorder(const IR::Member* expression) {
+    cstring path = dead->path(expression);
+    if (path.isNull())
+        return true;
+    reads.emplace(path);
+    return false;
+}
+
+bool FindDeadMetadata::preorder(const IR::PathExpression* expression) {
+    if (!dead->path(expression).isNull())
+        reads.emplace("");
+    if (auto var = dead->variable(expression))
+        readVariables.emplace(var);
+    return false;
+}
+
+bool FindDeadMetadata::preorder(const IR::Declaration_Variable* decl) {
+    if (DeadMetadata::isScalar(dead->typeMap->getTypeType(decl->type, true)) &&
+        (decl->initializer == nullptr || !hasSideEffects(decl->initializer)))
+        variables.push_back(decl);
+    return true;
+}
+
+bool FindDeadMetadata::preorder(const IR::Type_Name* type) {
+    auto decl = dead->refMap->getDeclaration(type->path);
+    if (decl != nullptr && decl->is<IR::Type_Struct>())
+        uses[decl->getName()]++;
+    return false;
+}
+
+const IR::Node* DoRemoveDeadMetadata::preorder(IR::AssignmentStatement* statement) {
+    prune();
+    auto left = statement->left;
+    if (auto slice = left->to<IR::Slice>())
+        left = slice->e0;
+    cstring path = dead->path(left);
+    auto var = dead->variable(left);
+    if ((path.isNull() || dead->fields.count(path) == 0) &&
+        (var == nullptr || dead->variables.count(var) == 0))
+        return statement;
+    LOG1("Removing " << statement);
+    if (getParent<IR::IfStatement>() != nullptr)
+        return new IR::EmptyStatement(statement->srcInfo);
+    return nullptr;
+}
+
+const IR::Node* DoRemoveDeadMetadata::postorder(IR::Declaration_Variable* decl) {
+    if (dead->variables.count(getOriginal<IR::Declaration_Variable>()) != 0)
+        return nullptr;
+    return decl;
+}
+
+const IR::Node* DoRemoveDeadMetadata::postorder(IR::Type_Struct* type) {
+    auto it = dead->structs.find(type->name);
+    if (it == dead->structs.end())
+        return type;
+    cstring prefix = it->second;
+    auto fields = new IR::IndexedVector<IR::StructField>();
+    for (auto f : *type->fields) {
+        cstring path = prefix.isNullOrEmpty() ? f->name.name : prefix + "." + f->name;
+        if (dead->fields.count(path) == 0)
+            fields->push_back(f);
+    }
+    if (fields->size() == type->fields->size())
+        return type;
+    type->fields = fields;
+    return type;
+}
+
+}  // namespace BMV2
@@ -0,0 +1,109 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_BMV2_DEADMETADATA_H_
+#define _BACKENDS_BMV2_DEADMETADATA_H_
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+#include "frontends/p4/typeMap.h"
+
+namespace BMV2 {
+
+// The user metadata fields and the scalar variables that the program writes but
+// never reads.  The metadata is the same struct in the parser and all the controls,
+// so unlike the def-use analysis of the front end, which follows one block, this one
+// is flow-insensitive: a field is live if any part of the program reads it.  A field
+// is named by its path in the metadata, e.g. "m.f1".
+class DeadMetadata {
+ public:
+    const P4::ReferenceMap* refMap;
+    const P4::TypeMap*      typeMap;
+    cstring                 metadataType;  // the name of the user metadata struct
+    std::set<cstring>       fields;
+    std::set<const IR::Declaration_Variable*> variables;
+    // the structs whose fields can be removed, and their path in the metadata
+    std::map<cstring, cstring> structs;
+
+    DeadMetadata(const P4::ReferenceMap* refMap, const P4::TypeMap* typeMap) :
+            refMap(refMap), typeMap(typeMap) { CHECK_NULL(refMap); CHECK_NULL(typeMap); }
+    // The path in the metadata of an expression: "" for the metadata itself, and
+    // a null cstring if the expression is not in the metadata
+    cstring path(const IR::Expression* expression) const;
+    // The variable that an expression is, if it is a scalar local
+    const IR::Declaration_Variable* variable(const IR::Expression* expression) const;
+    static bool isScalar(const IR::Type* type)
+    { return type->is<IR::Type_Bits>() || type->is<IR::Type_Boolean>(); }
+};
+
+class FindDeadMetadata : public Inspector {
+    DeadMetadata* dead;
+    const IR::P4Program* program = nullptr;
+    // the metadata paths that are read, and the scalar variables
+    std::set<cstring> reads;
+    std::set<const IR::Declaration_Variable*> readVariables;
+    std::vector<const IR::Declaration_Variable*> variables;
+    // how many times each struct is named
+    std::map<cstring, unsigned> uses;
+
+    bool isRead(cstring field) const;
+    void addFields(const IR::Type_Struct* type, cstring prefix, unsigned& width);
+    // An assignment to this expression is a write that can be removed
+    bool removable(const IR::Expression* left) const;
+
+ public:
+    explicit FindDeadMetadata(DeadMetadata* dead) : dead(dead)
+    { CHECK_NULL(dead); setName("FindDeadMetadata"); }
+    Visitor::profile_t init_apply(const IR::Node* node) override;
+    void end_apply() override;
+    bool preorder(const IR::AssignmentStatement* statement) override;
+    bool preorder(const IR::Member* expression) override;
+    bool preorder(const IR::PathExpression* expression) override;
+    bool preorder(const IR::Declaration_Variable* decl) override;
+    bool preorder(const IR::Type_Name* type) override;
+};
+
+// Removes the dead fields from the metadata structs, the dead variables, and all
+// the assignments to them.
+class DoRemoveDeadMetadata : public Transform {
+    const DeadMetadata* dead;
+
+ public:
+    explicit DoRemoveDeadMetadata(const DeadMetadata* dead) : dead(dead)
+    { CHECK_NULL(dead); setName("DoRemoveDeadMetadata"); }
+    const IR::Node* preorder(IR::AssignmentStatement* statement) override;
+    const IR::Node* postorder(IR::Declaration_Variable* decl) override;
+    const IR::Node* postorder(IR::Type_Struct* type) override;
+};
+
+class RemoveDeadMetadata : public PassManager {
+    DeadMetadata dead;
+
+ public:
+    RemoveDeadMetadata(P4::ReferenceMap* refMap, P4::TypeMap* typeMap) :
+            dead(refMap, typeMap) {
+        passes.push_back(new P4::TypeChecking(refMap, typeMap));
+        passes.push_back(new FindDeadMetadata(&dead));
+        passes.push_back(new DoRemoveDeadMetadata(&dead));
+        passes.push_back(new P4::TypeChecking(refMap, typeMap));
+        setName("RemoveDeadMetadata");
+    }
+};
+
+}  // namespace BMV2
+
+#endif /* _BACKENDS_BMV2_DEADMETADATA_H_ */
@@ -0,0 +1,391 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "incrementalChecksum.h"
+#include "lib/log.h"
+#include "frontends/p4/coreLibrary.h"
+#include "frontends/p4/fromv1.0/v1model.h"
+#include "frontends/p4/methodInstance.h"
+
+namespace BMV2 {
+
+namespace {
+// Whether inner is outer or a part of it
+bool within(cstring inner, cstring outer) {
+    return inner == outer ||
+            (inner.startsWith(outer) && (outer.endsWith(":") || inner.startsWith(outer + ".")));
+}
+
+bool related(cstring a, cstring b) {
+    return within(a, b) || within(b, a);
+}
+
+// The control passed to the V1Switch main for its parameter name
+const IR::P4Control* switchArgument(const IR::P4Program* program, P4::ReferenceMap* refMap,
+                                    cstring name) {
+    auto main = program->getDeclByName(IR::P4Program::main);
+    auto package = program->getDeclByName(P4V1::V1Model::instance.sw.name);
+    if (main == nullptr || !main->is<IR::Declaration_Instance>() ||
+        package == nullptr || !package->is<IR::Type_Package>())
+        return nullptr;
+    auto params = package->to<IR::Type_Package>()->constructorParams->parameters;
+    auto args = main->to<IR::Declaration_Instance>()->arguments;
+    for (size_t i = 0; i < params->size() && i < args->size(); i++) {
+        if (params->at(i)->name != name)
+            continue;
+        auto cce = args->at(i)->to<IR::ConstructorCallExpression>();
+        if (cce == nullptr)
+            return nullptr;
+        auto type = cce->constructedType;
+        if (auto ts = type->to<IR::Type_Specialized>())
+            type = ts->baseType;
+        auto decl = refMap->getDeclaration(type->to<IR::Type_Name>()->path);
+        return decl == nullptr ? nullptr : decl->to<IR::P4Control>();
+    }
+    return nullptr;
+}
+}  // namespace
+
+cstring IncrementalChecksums::path(const IR::Expression* expression) const {
+    if (auto member = expression->to<IR::Member>()) {
+        cstring base = path(member->expr);
+        if (base.isNull())
+            return base;
+        return base.endsWith(":") ? base + member->member : base + "." + member->member;
+    }
+    if (!expression->is<IR::PathExpression>())
+        return nullptr;
+    auto decl = refMap->getDeclaration(expression->to<IR::PathExpression>()->path);
+    if (decl == nullptr || !decl->is<IR::Parameter>())
+        return nullptr;
+    auto type = typeMap->getTypeType(decl->to<IR::Parameter>()->type, true);
+    if (!type->is<IR::Type_Struct>())
+        return nullptr;
+    return type->to<IR::Type_Struct>()->name + ":";
+}
+
+bool IncrementalChecksums::overlaps(cstring path, const Checksum& c) {
+    if (related(path, c.target))
+        return true;
+    for (auto f : c.fields) {
+        if (related(path, f))
+            return true;
+    }
+    return false;
+}
+
+const IncrementalChecksums::Checksum*
+IncrementalChecksums::find(const IR::AssignmentStatement* update) const {
+    for (auto& c : checksums) {
+        if (c.update == update)
+            return &c;
+    }
+    return nullptr;
+}
+
+Visitor::profile_t FindIncrementalChecksums::init_apply(const IR::Node* node) {
+    ck->checksums.clear();
+    ck->writes.clear();
+    assignments.clear();
+    changes.clear();
+    reads.clear();
+    ck->verify = ck->update = ck->deparser = nullptr;
+    if (auto program = node->to<IR::P4Program>()) {
+        auto& sw = P4V1::V1Model::instance.sw;
+        ck->verify = switchArgument(program, ck->refMap, sw.verify.name);
+        ck->update = switchArgument(program, ck->refMap, sw.update.name);
+        ck->deparser = switchArgument(program, ck->refMap, sw.deparser.name);
+    }
+    return Inspector::init_apply(node);
+}
+
+bool FindIncrementalChecksums::adjustable() const {
+    auto control = findContext<IR::P4Control>();
+    return control != nullptr && control != ck->verify && control != ck->update &&
+            control != ck->deparser;
+}
+
+void FindIncrementalChecksums::addChecksum(const IR::AssignmentStatement* statement,
+                                           const IR::ListExpression* list) {
+    IncrementalChecksums::Checksum c;
+    c.update = statement;
+    c.target = ck->path(statement->left);
+    auto type = ck->typeMap->getType(statement->left, true);
+    if (c.target.isNull() || !type->is<IR::Type_Bits>() || type->width_bits() != 16)
+        c.incremental = false;
+    unsigned offset = 0;
+    for (auto e : *list->components) {
+        cstring path = ck->path(e);
+        auto ftype = ck->typeMap->getType(e, true);
+        if (path.isNull() || !ftype->is<IR::Type_Bits>()) {
+            c.incremental = false;
+            break;
+        }
+        if (!c.target.isNull() && related(path, c.target))
+            c.incremental = false;
+        c.fields.push_back(path);
+        c.widths.push_back(ftype->width_bits());
+        c.offsets.push_back(offset);
+        offset += ftype->width_bits();
+    }
+    if (offset % 16 != 0)
+        c.incremental = false;
+    ck->checksums.push_back(c);
+}
+
+bool FindIncrementalChecksums::preorder(const IR::AssignmentStatement* statement) {
+    auto control = findContext<IR::P4Control>();
+    if (control != nullptr && control == ck->update) {
+        if (auto mc = statement->right->to<IR::MethodCallExpression>()) {
+            auto mi = P4::MethodInstance::resolve(mc, ck->refMap, ck->typeMap);
+            auto& ck16 = P4V1::V1Model::instance.ck16;
+            if (auto em = mi->to<P4::ExternMethod>()) {
+                if (em->method->name.name == ck16.get.name &&
+                    em->originalExternType->name.name == ck16.name &&
+                    mc->arguments->size() == 1 &&
+                    mc->arguments->at(0)->is<IR::ListExpression>()) {
+                    addChecksum(statement, mc->arguments->at(0)->to<IR::ListExpression>());
+                    return true;
+                }
+            }
+        }
+    }
+
+    auto left = statement->left;
+    cstring path = ck->path(left);
+    if (!path.isNull() && adjustable()) {
+        assignments.emplace(statement, path);
+        return true;
+    }
+    // a slice of a field changes it too
+    if (auto slice = left->to<IR::Slice>())
+        path = ck->path(slice->e0);
+    if (!path.isNull())
+        changes.emplace(path);
+    return true;
+}
+
+bool FindIncrementalChecksums::preorder(const IR::MethodCallExpression* expression) {
+    auto mi = P4::MethodInstance::resolve(expression, ck->refMap, ck->typeMap);
+    if (auto bim = mi->to<P4::BuiltInMethod>()) {
+        cstring path = ck->path(bim->appliedTo);
+        if (bim->name.name != IR::Type_Header::isValid && !path.isNull())
+            changes.emplace(path);
+        return true;
+    }
+    if (auto em = mi->to<P4::ExternMethod>()) {
+        // the parser fills the headers that the incoming checksums cover
+        auto& packetIn = P4::P4CoreLibrary::instance.packetIn;
+        if (em->originalExternType->name.name == packetIn.name &&
+            em->method->name.name == packetIn.extract.name)
+            return true;
+    }
+    auto params = mi->getActualParameters();
+    for (size_t i = 0; i < params->size() && i < expression->arguments->size(); i++) {
+        auto param = params->parameters->at(i);
+        if (param->direction != IR::Direction::Out && param->direction != IR::Direction::InOut)
+            continue;
+        auto arg = expression->arguments->at(i);
+        if (auto slice = arg->to<IR::Slice>())
+            arg = slice->e0;
+        cstring path = ck->path(arg);
+        if (!path.isNull())
+            changes.emplace(path);
+    }
+    return true;
+}
+
+bool FindIncrementalChecksums::preorder(const IR::Member* expression) {
+    // until the update control a checksum reads as it was when the packet came in
+    if (!adjustable())
+        return true;
+    cstring path = ck->path(expression);
+    if (path.isNull())
+        return true;
+    reads.emplace(path);
+    return false;
+}
+
+void FindIncrementalChecksums::end_apply() {
+    auto& checksums = ck->checksums;
+    for (auto& c : checksums) {
+        for (auto path : changes) {
+            if (c.incremental && IncrementalChecksums::overlaps(path, c)) {
+                LOG1("Checksum " << c.target << " changes with " << path);
+                c.incremental = false;
+            }
+        }
+        for (auto path : reads) {
+            if (c.incremental && related(path, c.target)) {
+                LOG1("Checksum " << c.target << " is read");
+                c.incremental = false;
+            }
+        }
+        for (auto& a : assignments) {
+            bool field = std::find(c.fields.begin(), c.fields.end(), a.second) != c.fields.end();
+            if (c.incremental && !field && IncrementalChecksums::overlaps(a.second, c)) {
+                LOG1("Checksum " << c.target << " changes with " << a.first);
+                c.incremental = false;
+            }
+        }
+    }
+    for (size_t i = 0; i < checksums.size(); i++) {
+        for (size_t j = 0; j < checksums.size(); j++) {
+            // an update writes what another one sums, or the same checksum
+            if (i != j && IncrementalChecksums::overlaps(checksums[i].target, checksums[j]))
+                checksums[i].incremental = checksums[j].incremental = false;
+        }
+    }
+    for (size_t i = 0; i < checksums.size(); i++) {
+        auto& c = checksums[i];
+        if (!c.incremental)
+            continue;
+        LOG1("Checksum " << c.target << " is updated incrementally");
+        for (auto& a : assignments) {
+            if (std::find(c.fields.begin(), c.fields.end(), a.second) != c.fields.end())
+                ck->writes[a.first].push_back(i);
+        }
+    }
+}
+
+const IR::Expression*
+DoIncrementalChecksums::member(const IR::PathExpression* root, cstring path) const {
+    const IR::Expression* result = new IR::PathExpression(root->path);
+    std::string rest = path.c_str();
+    rest = rest.substr(rest.find(':') + 1);
+    while (!rest.empty()) {
+        size_t dot = rest.find('.');
+        result = new IR::Member(Util::SourceInfo(), result, IR::ID(cstring(rest.substr(0, dot))));
+        rest = dot == std::string::npos ? "" : rest.substr(dot + 1);
+    }
+    return result;
+}
+
+const IR::Expression* DoIncrementalChecksums::word(const IncrementalChecksums::Checksum& c,
+                                                   const IR::PathExpression* root,
+                                                   unsigned offset) const {
+    const IR::Expression* result = nullptr;
+    for (size_t i = 0; i < c.fields.size(); i++) {
+        unsigned first = c.offsets[i], width = c.widths[i];
+        unsigned a = std::max(first, offset), b = std::min(first + width, offset + 16);
+        if (a >= b)
+            continue;
+        auto field = member(root, c.fields[i]);
+        const IR::Expression* part = field;
+        if (b - a != width)
+            part = new IR::Slice(Util::SourceInfo(), field,
+                                 width - 1 - (a - first), width - (b - first));
+        result = result == nullptr ? part : new IR::Concat(Util::SourceInfo(), result, part);
+    }
+    return result;
+}
+
+const IR::Node* DoIncrementalChecksums::preorder(IR::P4Control* control) {
+    variables = new IR::IndexedVector<IR::Declaration>();
+    sum = nullptr;
+    return control;
+}
+
+const IR::Node* DoIncrementalChecksums::postorder(IR::P4Control* control) {
+    if (!variables->empty()) {
+        auto locals = control->controlLocals->clone();
+        for (auto v : *variables)
+            locals->push_back(v);
+        control->controlLocals = locals;
+    }
+    variables = nullptr;
+    return control;
+}
+
+const IR::Node* DoIncrementalChecksums::postorder(IR::AssignmentStatement* statement) {
+    auto original = getOriginal<IR::AssignmentStatement>();
+    auto c = ck->find(original);
+    if (c != nullptr) {
+        if (!c->incremental)
+            return statement;
+        LOG1("Removing " << statement);
+        if (getParent<IR::IfStatement>() != nullptr)
+            return new IR::EmptyStatement(statement->srcInfo);
+        return nullptr;
+    }
+    auto it = ck->writes.find(original);
+    if (it == ck->writes.end() || variables == nullptr)
+        return statement;
+
+    auto refMap = ck->refMap;
+    auto u16 = IR::Type_Bits::get(16), u32 = IR::Type_Bits::get(32);
+    cstring path = ck->path(original->left);
+    auto base = statement->left;
+    while (base->is<IR::Member>())
+        base = base->to<IR::Member>()->expr;
+    auto root = base->to<IR::PathExpression>();
+    auto before = new IR::IndexedVector<IR::StatOrDecl>();
+    auto after = new IR::IndexedVector<IR::StatOrDecl>();
+    if (sum.isNull()) {
+        sum = refMap->newName("ck_sum");
+        variables->push_back(new IR::Declaration_Variable(
+            Util::SourceInfo(), IR::ID(sum, nullptr), IR::Annotations::empty, u32, nullptr));
+    }
+    auto var = [](cstring name) { return new IR::PathExpression(IR::ID(name, nullptr)); };
+
+    for (auto i : it->second) {
+        auto& cs = ck->checksums[i];
+        auto target = member(root, cs.target);
+        // ~HC, then ~m + m' for each word of the field
+        const IR::Expression* total = new IR::Cast(Util::SourceInfo(), u32,
+                                                   new IR::Cmpl(Util::SourceInfo(), target));
+        for (size_t f = 0; f < cs.fields.size(); f++) {
+            if (cs.fields[f] != path)
+                continue;
+            unsigned first = cs.offsets[f] / 16 * 16;
+            for (unsigned w = first; w < cs.offsets[f] + cs.widths[f]; w += 16) {
+                cstring old = refMap->newName("ck_old");
+                variables->push_back(new IR::Declaration_Variable(
+                    Util::SourceInfo(), IR::ID(old, nullptr), IR::Annotations::empty,
+                    u16, nullptr));
+                before->push_back(new IR::AssignmentStatement(
+                    Util::SourceInfo(), var(old), word(cs, root, w)));
+                total = new IR::Add(Util::SourceInfo(), total,
+                                    new IR::Cast(Util::SourceInfo(), u32,
+                                                 new IR::Cmpl(Util::SourceInfo(), var(old))));
+                total = new IR::Add(Util::SourceInfo(), total,
+                                    new IR::Cast(Util::SourceInfo(), u32, word(cs, root, w)));
+            }
+        }
+        after->push_back(new IR::AssignmentStatement(Util::SourceInfo(), var(sum), total));
+        // the carries go back in, twice: the first fold can carry again
+        for (int fold = 0; fold < 2; fold++) {
+            auto low = new IR::BAnd(Util::SourceInfo(), var(sum),
+                                    new IR::Constant(Util::SourceInfo(), u32, 0xFFFF, 16));
+            auto high = new IR::Shr(Util::SourceInfo(), var(sum), new IR::Constant(16));
+            after->push_back(new IR::AssignmentStatement(
+                Util::SourceInfo(), var(sum), new IR::Add(Util::SourceInfo(), low, high)));
+        }
+        after->push_back(new IR::AssignmentStatement(
+            Util::SourceInfo(), member(root, cs.target),
+            new IR::Cmpl(Util::SourceInfo(), new IR::Cast(Util::SourceInfo(), u16, var(sum)))));
+    }
+
+    LOG1("Adjusting checksums after " << statement);
+    before->push_back(statement);
+    for (auto s : *after)
+        before->push_back(s);
+    return new IR::BlockStatement(statement->srcInfo, IR::Annotations::empty, before);
+}
+
+}  // namespace BMV2
@@ -0,0 +1,134 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_BMV2_INCREMENTALCHECKSUM_H_
+#define _BACKENDS_BMV2_INCREMENTALCHECKSUM_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+#include "frontends/p4/typeMap.h"
+
+namespace BMV2 {
+
+// The checksums that the update control computes with Checksum16.get over fields
+// that the rest of the program only changes with plain assignments.  Such a checksum
+// can be adjusted where each field changes, as in RFC 1624: HC' = ~(~HC + ~m + m'),
+// in one's complement arithmetic over the 16-bit words m of the fields that change,
+// rather than computed again over the whole header for every packet.  Like any
+// incremental update, this keeps a checksum that was wrong when the packet arrived
+// wrong.  A field is named by the name of the struct type of the parameter it is in
+// and its path in it, e.g. "headers:ipv4.ttl", so that it is the same field in all
+// the controls.
+class IncrementalChecksums {
+ public:
+    struct Checksum {
+        const IR::AssignmentStatement* update;  // in the update control
+        cstring target;
+        // the fields summed, in order, with their widths and offsets in bits
+        std::vector<cstring> fields;
+        std::vector<unsigned> widths, offsets;
+        bool incremental = true;
+    };
+
+    P4::ReferenceMap*  refMap;
+    P4::TypeMap*       typeMap;
+    // the controls of V1Switch that run before and after the ones that change fields
+    const IR::P4Control* verify = nullptr;
+    const IR::P4Control* update = nullptr;
+    const IR::P4Control* deparser = nullptr;
+    std::vector<Checksum> checksums;
+    // the assignments elsewhere to the fields of incremental checksums, and which
+    std::map<const IR::AssignmentStatement*, std::vector<size_t>> writes;
+
+    IncrementalChecksums(P4::ReferenceMap* refMap, P4::TypeMap* typeMap) :
+            refMap(refMap), typeMap(typeMap) { CHECK_NULL(refMap); CHECK_NULL(typeMap); }
+    // The name of a field as above; the struct type alone for a parameter, and a null
+    // cstring for what is not in a parameter of struct type
+    cstring path(const IR::Expression* expression) const;
+    // Whether a change of what path names changes checksum c other than with an
+    // assignment to one of its fields
+    static bool overlaps(cstring path, const Checksum& c);
+    const Checksum* find(const IR::AssignmentStatement* update) const;
+};
+
+// Finds the checksums, and where their fields are written
+class FindIncrementalChecksums : public Inspector {
+    IncrementalChecksums* ck;
+    // The update control comes after the others, so what they do is found first:
+    // the assignments where a checksum could be adjusted, with what they assign,
+    std::map<const IR::AssignmentStatement*, cstring> assignments;
+    // the other changes, and the reads where a checksum must not have been adjusted
+    std::set<cstring> changes, reads;
+
+    // Whether the checksums can be adjusted here: in the ingress and egress controls
+    bool adjustable() const;
+    void addChecksum(const IR::AssignmentStatement* statement,
+                     const IR::ListExpression* list);
+
+ public:
+    explicit FindIncrementalChecksums(IncrementalChecksums* ck) : ck(ck)
+    { CHECK_NULL(ck); setName("FindIncrementalChecksums"); }
+    Visitor::profile_t init_apply(const IR::Node* node) override;
+    void end_apply() override;
+    bool preorder(const IR::AssignmentStatement* statement) override;
+    bool preorder(const IR::MethodCallExpression* expression) override;
+    bool preorder(const IR::Member* expression) override;
+};
+
+// Adds the adjustment of the checksums after each assignment of one of their fields,
+// and removes their computation from the update control
+class DoIncrementalChecksums : public Transform {
+    IncrementalChecksums* ck;
+    // the variables that hold the words before a change, in the current control
+    IR::IndexedVector<IR::Declaration>* variables = nullptr;
+    cstring sum;  // a bit<32> variable of the current control, for the sums
+
+    // The 16-bit word at bit offset of the fields of c in the parameter that root
+    // names
+    const IR::Expression* word(const IncrementalChecksums::Checksum& c,
+                               const IR::PathExpression* root, unsigned offset) const;
+    const IR::Expression* member(const IR::PathExpression* root, cstring path) const;
+
+ public:
+    explicit DoIncrementalChecksums(IncrementalChecksums* ck) : ck(ck)
+    { CHECK_NULL(ck); setName("DoIncrementalChecksums"); }
+    const IR::Node* preorder(IR::P4Control* control) override;
+    const IR::Node* postorder(IR::P4Control* control) override;
+    const IR::Node* postorder(IR::AssignmentStatement* statement) override;
+};
+
+class IncrementalChecksum : public PassManager {
+    IncrementalChecksums ck;
+
+ public:
+    IncrementalChecksum(P4::ReferenceMap* refMap, P4::TypeMap* typeMap) :
+            ck(refMap, typeMap) {
+        passes.push_back(new P4::TypeChecking(refMap, typeMap));
+        passes.push_back(new FindIncrementalChecksums(&ck));
+        passes.push_back(new DoIncrementalChecksums(&ck));
+        passes.push_back(new P4::TypeChecking(refMap, typeMap));
+        setName("IncrementalChecksum");
+    }
+};
+
+}  // namespace BMV2
+
+#endif /* _BACKENDS_BMV2_INCREMENTALCHECKSUM_H_ */
@@ -0,0 +1,139 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include "jsonCache.h"
+#include "frontends/common/frontendCache.h"
+#include "ir/json_parser.h"
+#include "lib/log.h"
+
+namespace BMV2 {
+
+namespace {
+
+// The Util::IJson of parsed JSON; nullptr if it was not parsed
+Util::IJson* fromJsonData(const JsonData* data) {
+    if (data == nullptr)
+        return nullptr;
+    if (auto n = data->to<JsonNumber>())
+        return new Util::JsonValue(n->value());
+    if (auto b = data->to<JsonBoolean>())
+        return new Util::JsonValue(b->val);
+    if (auto s = data->to<JsonString>())
+        return new Util::JsonValue(s->toString());
+    if (data->is<JsonNull>())
+        return new Util::JsonValue();
+    if (auto v = data->to<JsonVector>()) {
+        auto result = new Util::JsonArray();
+        for (auto e : *v) {
+            auto value = fromJsonData(e);
+            if (value == nullptr)
+                return nullptr;
+            result->append(value);
+        }
+        return result;
+    }
+    if (auto o = data->to<JsonObject>()) {
+        auto result = new Util::JsonObject();
+        for (auto& e : *o) {
+            auto value = fromJsonData(e.second);
+            if (value == nullptr)
+                return nullptr;
+            result->emplace(e.first.toString(), value);
+        }
+        return result;
+    }
+    return nullptr;
+}
+
+Util::JsonArray* getArray(const Util::JsonObject* object, cstring label) {
+    auto value = object->get(label);
+    return value == nullptr ? nullptr : value->to<Util::JsonArray>();
+}
+
+Util::IJson* parse(std::string& text) {
+    return fromJsonData(parseJson(&text[0], &text[0] + text.size()));
+}
+
+std::string serialize(const Util::IJson* json) {
+    std::stringstream text;
+    json->serialize(text, true);
+    return text.str();
+}
+
+}  // namespace
+
+bool JsonCache::load(uint64_t key, Entry& entry) const {
+    std::string data;
+    if (!CacheEntry::readEntry(CacheEntry::entryPath(dir, key, "json"), data))
+        return false;
+    auto json = parse(data);
+    auto object = json == nullptr ? nullptr : json->to<Util::JsonObject>();
+    if (object == nullptr)
+        return false;
+    auto pipeline = object->get("pipeline");
+    auto names = getArray(object, "names");
+    entry.pipeline = pipeline == nullptr ? nullptr : pipeline->to<Util::JsonObject>();
+    entry.counters = getArray(object, "counters");
+    entry.meters = getArray(object, "meters");
+    entry.registers = getArray(object, "registers");
+    if (entry.pipeline == nullptr || entry.counters == nullptr || entry.meters == nullptr ||
+        entry.registers == nullptr || names == nullptr)
+        return false;
+    entry.names.clear();
+    for (auto n : *names) {
+        auto pair = n->to<Util::JsonArray>();
+        if (pair == nullptr || pair->size() != 2)
+            return false;
+        auto base = pair->at(0)->to<Util::JsonValue>();
+        auto name = pair->at(1)->to<Util::JsonValue>();
+        if (base == nullptr || name == nullptr || !name->isString() ||
+            !(base->isNull() || base->isString()))
+            return false;
+        entry.names.push_back({ base->isNull() ? cstring() : base->getString(),
+                                name->getString() });
+    }
+    return true;
+}
+
+void JsonCache::store(uint64_t key, const Entry& entry) const {
+    auto names = new Util::JsonArray();
+    for (auto& n : entry.names) {
+        auto pair = new Util::JsonArray();
+        pair->append(n.base.isNull() ? new Util::JsonValue() : new Util::JsonValue(n.base));
+        pair->append(n.name);
+        names->append(pair);
+    }
+    Util::JsonObject object;
+    object.emplace("names", names);
+    object.emplace("pipeline", entry.pipeline);
+    object.emplace("counters", entry.counters);
+    object.emplace("meters", entry.meters);
+    object.emplace("registers", entry.registers);
+
+    // The writer does not escape strings, so an entry that would not read back the
+    // same, e.g. with a quote in an annotation, is not stored
+    std::string text = serialize(&object);
+    std::string copy = text;
+    auto back = parse(copy);
+    if (back == nullptr || serialize(back) != text) {
+        LOG1("Not caching the JSON of control " << serialize(entry.pipeline->get("name")));
+        return;
+    }
+    CacheEntry::writeEntry(CacheEntry::entryPath(dir, key, "json"), text);
+}
+
+}  // namespace BMV2
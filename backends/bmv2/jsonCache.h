@@ -0,0 +1,50 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_BMV2_JSONCACHE_H_
+#define _BACKENDS_BMV2_JSONCACHE_H_
+
+#include <vector>
+#include "lib/json.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+
+namespace BMV2 {
+
+// A directory of the JSON made for the controls of earlier compilations (see
+// --jsonCache), in the files of the front end cache.  The key of an entry is chosen
+// by the converter; it names everything the JSON of a control is made from.
+class JsonCache {
+    cstring dir;
+
+ public:
+    // The JSON of a control, with the ids that it had, and the names it took from
+    // the ReferenceMap
+    struct Entry {
+        Util::JsonObject* pipeline = nullptr;
+        Util::JsonArray* counters = nullptr;
+        Util::JsonArray* meters = nullptr;
+        Util::JsonArray* registers = nullptr;
+        std::vector<P4::ReferenceMap::NameReservation::request_t> names;
+    };
+
+    explicit JsonCache(cstring dir) : dir(dir) {}
+    bool load(uint64_t key, Entry& entry) const;
+    void store(uint64_t key, const Entry& entry) const;
+};
+
+}  // namespace BMV2
+
+#endif /* _BACKENDS_BMV2_JSONCACHE_H_ */
@@ -14,14 +14,23 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+#include <exception>
+#include <sstream>
 #include "jsonconverter.h"
+#include "jsonCache.h"
 #include "lib/gmputil.h"
+#include "lib/nullstream.h"
+#include "lib/parallel.h"
 #include "frontends/p4/coreLibrary.h"
+#include "frontends/p4/toP4/toP4.h"
+#include "frontends/common/frontendCache.h"
 #include "ir/ir.h"
 #include "frontends/p4/methodInstance.h"
 #include "frontends/p4/enumInstance.h"
 #include "analyzer.h"
 #include "lower.h"
+#include "nativeActions.h"
 
 namespace BMV2 {
 
@@ -159,26 +168,25 @@ void DirectMeterMap::setSize(const IR::IDeclaration* meter, unsigned size) {
     info->tableSize = size;
 }
 
-static cstring stringRepr(mpz_class value, unsigned bytes = 0) {
-    cstring sign = "";
-    const char* r;
-    cstring filler = "";
-    if (value < 0) {
-        value =- value;
-        r = mpz_get_str(nullptr, 16, value.get_mpz_t());
-        sign = "-";
-    } else {
-        r = mpz_get_str(nullptr, 16, value.get_mpz_t());
-    }
-
-    if (bytes > 0) {
-        int digits = bytes * 2 - strlen(r);
-        BUG_CHECK(digits >= 0, "Cannot represent %1% on %2% bytes", value, bytes);
-        filler = std::string(digits, '0');
-    }
-    return sign + "0x" + filler + r;
+static cstring stringRepr(const mpz_class& value, unsigned bytes = 0) {
+    std::string result;
+    Util::appendHex(result, value, bytes * 2);
+    size_t digits = result.size() - (sgn(value) < 0 ? 3 : 2);
+    BUG_CHECK(bytes == 0 || digits <= bytes * 2,
+              "Cannot represent %1% on %2% bytes", value, bytes);
+    return result;
 }
 
+// A chain of if statements becomes a table when it has at least ifChainMinArms arms,
+// and a table has at most ifChainMaxArms of them
+static const unsigned ifChainMinArms = 3;
+static const unsigned ifChainMaxArms = 16;
+
+// The action that the table made of an if chain selects its arm with; the arm after
+// the last one is the else branch
+static cstring ifChainAction(unsigned arm)
+{ return cstring(".if_chain_") + Util::toString(arm); }
+
 static Util::JsonObject* mkPrimitive(cstring name, Util::JsonArray* appendTo) {
     auto result = new Util::JsonObject();
     result->emplace("op", name);
@@ -343,18 +351,18 @@ class ExpressionConverter : public Inspector {
     void postorder(const IR::ArrayIndex* expression) override {
         auto result = new Util::JsonObject();
         result->emplace("type", "header");
-        cstring elementAccess;
+        cstring_builder elementAccess;
 
         // This is can be either a header, which is part of the "headers" parameter
         // or a temporary array.
         if (expression->left->is<IR::Member>()) {
             // This is a header part of the parameters
             auto mem = expression->left->to<IR::Member>();
-            elementAccess = mem->member.name;
+            elementAccess += mem->member.name;
         } else if (expression->left->is<IR::PathExpression>()) {
             // This is a temporary variable with type stack.
             auto path = expression->left->to<IR::PathExpression>();
-            elementAccess = path->path->name;
+            elementAccess += path->path->name.name;
         }
 
         if (!expression->right->is<IR::Constant>()) {
@@ -362,9 +370,11 @@ class ExpressionConverter : public Inspector {
                     expression->right);
         } else {
             int index = expression->right->to<IR::Constant>()->asInt();
-            elementAccess += "[" + Util::toString(index) + "]";
+            elementAccess += '[';
+            elementAccess += index;
+            elementAccess += ']';
         }
-        result->emplace("value", elementAccess);
+        result->emplace("value", elementAccess.str());
         map.emplace(expression, result);
     }
 
@@ -453,9 +463,11 @@ class ExpressionConverter : public Inspector {
                         auto second = array->at(1);
                         BUG_CHECK(second->is<Util::JsonValue>(), "expected a value");
                         e->append(first);
-                        cstring nestedField = second->to<Util::JsonValue>()->getString();
-                        nestedField += "." + expression->member.name;
-                        e->append(nestedField);
+                        cstring_builder nestedField(
+                            second->to<Util::JsonValue>()->getString());
+                        nestedField += '.';
+                        nestedField += expression->member.name;
+                        e->append(nestedField.str());
                     } else if (lv->is<Util::JsonValue>()) {
                         e->append(lv);
                         e->append(expression->member.name);
@@ -718,11 +730,6 @@ JsonConverter::JsonConverter(const CompilerOptions& options) :
 // return calculation name
 cstring JsonConverter::createCalculation(cstring algo, const IR::Expression* fields,
                                          Util::JsonArray* calculations) {
-    cstring calcName = refMap->newName("calc_");
-    auto calc = new Util::JsonObject();
-    calc->emplace("name", calcName);
-    calc->emplace("id", nextId("calculations"));
-    calc->emplace("algo", algo);
     if (!fields->is<IR::ListExpression>()) {
         // expand it into a list
         auto vec = new IR::Vector<IR::Expression>();
@@ -738,8 +745,21 @@ cstring JsonConverter::createCalculation(cstring algo, const IR::Expression* fie
         typeMap->setType(fields, type);
     }
     auto jright = conv->convert(fields);
+    std::stringstream key;
+    key << algo << " ";
+    jright->serialize(key, true);
+    auto it = calculationNames.find(key.str());
+    if (it != calculationNames.end())
+        return it->second;
+
+    cstring calcName = refMap->newName("calc_");
+    auto calc = new Util::JsonObject();
+    calc->emplace("name", calcName);
+    calc->emplace("id", nextId("calculations"));
+    calc->emplace("algo", algo);
     calc->emplace("input", jright);
     calculations->append(calc);
+    calculationNames.emplace(key.str(), calcName);
     return calcName;
 }
 
@@ -1049,13 +1069,23 @@ void JsonConverter::addToFieldList(const IR::Expression* expr, Util::JsonArray*
 // returns id of created field list
 int JsonConverter::createFieldList(const IR::Expression* expr, cstring group, cstring listName,
                                    Util::JsonArray* fieldLists) {
+    auto elements = new Util::JsonArray();
+    addToFieldList(expr, elements);
+    // the control plane knows the learn lists by their names
+    std::stringstream key;
+    key << group << " " << (group == "learn_lists" ? listName : cstring("")) << " ";
+    elements->serialize(key, true);
+    auto it = fieldListIds.find(key.str());
+    if (it != fieldListIds.end())
+        return it->second;
+
     auto fl = new Util::JsonObject();
     fieldLists->append(fl);
     int id = nextId(group);
     fl->emplace("id", id);
     fl->emplace("name", listName);
-    auto elements = mkArrayField(fl, "elements");
-    addToFieldList(expr, elements);
+    fl->emplace("elements", elements);
+    fieldListIds.emplace(key.str(), id);
     return id;
 }
 
@@ -1120,15 +1150,175 @@ Util::IJson* JsonConverter::convertIf(const CFG::IfNode* node, cstring) {
     auto j = conv->convert(node->statement->condition, true, false);
     CHECK_NULL(j);
     result->emplace("expression", j);
-    for (auto e : node->successors.edges) {
-        Util::IJson* dest = nodeName(e->endpoint);
-        cstring label = Util::toString(e->getBool());
-        label += "_next";
-        result->emplace(label, dest);
+    for (auto& e : node->successors.edges) {
+        Util::IJson* dest = nodeName(e.endpoint);
+        result->emplace(e.getBool() ? "true_next" : "false_next", dest);
     }
     return result;
 }
 
+std::map<const CFG::Node*, JsonConverter::IfChain>
+JsonConverter::findIfChains(const CFG* cfg) {
+    // the if statements that compare a field with a constant, and the number of edges
+    // to each node
+    struct Comparison {
+        const Util::IJson* field;
+        cstring text;  // of the JSON of the field
+        unsigned width;
+        mpz_class value;
+    };
+    std::map<const CFG::Node*, Comparison> comparisons;
+    std::map<const CFG::Node*, unsigned> edgesTo;
+    for (auto node : cfg->allNodes) {
+        for (auto& e : node->successors.edges)
+            edgesTo[e.endpoint]++;
+        auto ifNode = node->to<CFG::IfNode>();
+        auto equ = ifNode == nullptr ? nullptr : ifNode->statement->condition->to<IR::Equ>();
+        if (equ == nullptr)
+            continue;
+        auto field = equ->left;
+        auto value = equ->right->to<IR::Constant>();
+        if (value == nullptr) {
+            field = equ->right;
+            value = equ->left->to<IR::Constant>();
+        }
+        if (value == nullptr || !(field->is<IR::Member>() || field->is<IR::PathExpression>()))
+            continue;
+        auto type = typeMap->getType(field, true)->to<IR::Type_Bits>();
+        if (type == nullptr || type->isSigned)
+            continue;
+        auto json = conv->convert(field)->to<Util::JsonObject>();
+        auto kind = json == nullptr ? nullptr : json->get("type")->to<Util::JsonValue>();
+        if (kind == nullptr || !kind->isString() || kind->getString() != "field")
+            continue;
+        auto target = json->get("value");
+        comparisons.emplace(node, Comparison{
+            target, target->toString(), static_cast<unsigned>(type->size), value->value });
+    }
+
+    // the next arm of a chain: the else branch of an arm, if nothing else goes to it
+    auto nextArm = [&](const CFG::Node* node) -> const CFG::Node* {
+        for (auto& e : node->successors.edges) {
+            if (e.isBool() && !e.getBool() && edgesTo[e.endpoint] == 1) {
+                auto next = comparisons.find(e.endpoint);
+                if (next != comparisons.end() &&
+                    next->second.text == comparisons.at(node).text)
+                    return e.endpoint;
+            }
+        }
+        return nullptr;
+    };
+    std::set<const CFG::Node*> continued;  // not the first arm of their chain
+    for (auto& c : comparisons) {
+        if (auto next = nextArm(c.first))
+            continued.emplace(next);
+    }
+
+    std::map<const CFG::Node*, IfChain> chains;
+    for (auto& c : comparisons) {
+        if (continued.count(c.first))
+            continue;
+        // a value compared again is never equal there, so the chain stops before it
+        std::vector<const CFG::Node*> arms;
+        std::set<mpz_class> values;
+        for (auto node = c.first; node != nullptr; node = nextArm(node)) {
+            if (!values.emplace(comparisons.at(node).value).second)
+                break;
+            arms.push_back(node);
+        }
+        for (size_t first = 0; first + ifChainMinArms <= arms.size(); first += ifChainMaxArms) {
+            auto& chain = chains[arms[first]];
+            chain.field = c.second.field;
+            chain.width = c.second.width;
+            for (size_t i = first; i < arms.size() && i < first + ifChainMaxArms; i++) {
+                chain.arms.push_back(arms[i]);
+                chain.values.push_back(comparisons.at(arms[i]).value);
+            }
+        }
+    }
+    return chains;
+}
+
+Util::IJson* JsonConverter::convertIfChain(const IfChain& chain) {
+    auto result = new Util::JsonObject();
+    result->emplace("name", chain.arms.front()->name);
+    result->emplace("id", nextId("tables"));
+    auto key = mkArrayField(result, "key");
+    auto keyelement = new Util::JsonObject();
+    keyelement->emplace("match_type", "exact");
+    keyelement->emplace("target", chain.field);
+    keyelement->emplace("mask", Util::JsonValue::null);
+    key->append(keyelement);
+    result->emplace("match_type", "exact");
+    result->emplace("type", "simple");
+    result->emplace("max_size", static_cast<unsigned>(chain.arms.size()));
+    result->emplace("with_counters", false);
+    result->emplace("support_timeout", false);
+    result->emplace("direct_meters", Util::JsonValue::null);
+
+    auto action_ids = mkArrayField(result, "action_ids");
+    auto actions = mkArrayField(result, "actions");
+    auto next_tables = new Util::JsonObject();
+    auto entries = new Util::JsonArray();
+    const CFG::Node* last = nullptr;  // the else branch of the last arm
+    for (size_t i = 0; i < chain.arms.size(); i++) {
+        for (auto& e : chain.arms[i]->successors.edges) {
+            if (e.getBool())
+                next_tables->emplace(ifChainAction(i), nodeName(e.endpoint));
+            else
+                last = e.endpoint;
+        }
+        action_ids->append(ifChainActionIds.at(i));
+        actions->append(ifChainAction(i));
+
+        auto entry = new Util::JsonObject();
+        auto match_key = mkArrayField(entry, "match_key");
+        auto match = new Util::JsonObject();
+        match->emplace("match_type", "exact");
+        match->emplace("key", stringRepr(chain.values[i], ROUNDUP(chain.width, 8)));
+        match_key->append(match);
+        auto action_entry = new Util::JsonObject();
+        action_entry->emplace("action_id", ifChainActionIds.at(i));
+        action_entry->emplace("action_data", new Util::JsonArray());
+        entry->emplace("action_entry", action_entry);
+        entry->emplace("priority", static_cast<unsigned>(i + 1));
+        entries->append(entry);
+    }
+    unsigned miss = chain.arms.size();
+    CHECK_NULL(last);
+    action_ids->append(ifChainActionIds.at(miss));
+    actions->append(ifChainAction(miss));
+    next_tables->emplace(ifChainAction(miss), nodeName(last));
+    result->emplace("base_default_next", nodeName(last));
+    result->emplace("next_tables", next_tables);
+
+    auto entry = new Util::JsonObject();
+    entry->emplace("action_id", ifChainActionIds.at(miss));
+    entry->emplace("action_const", true);
+    entry->emplace("action_data", new Util::JsonArray());
+    entry->emplace("action_entry_const", true);
+    result->emplace("default_entry", entry);
+    result->emplace("entries", entries);
+    return result;
+}
+
+// A table gets "independent_tables": the other tables of the pipeline that read and
+// write none of what it writes, and write none of what it reads, so that the two can
+// be looked up at once or in either order.  A conditional gets "depends_on_tables":
+// the tables that write something that its condition reads; without them it can be
+// evaluated as soon as the pipeline starts.
+void JsonConverter::addDependencies(const CFG* cfg, const TableDependencies* deps,
+                                    const CFG::Node* node, Util::JsonObject* json) {
+    bool isTable = node->is<CFG::TableNode>();
+    auto tables = mkArrayField(json, isTable ? "independent_tables" : "depends_on_tables");
+    for (auto other : cfg->allNodes) {
+        if (other == node || !other->is<CFG::TableNode>())
+            continue;
+        if (isTable ? deps->independent(node, other) : deps->readsWritesOf(node, other))
+            tables->append(other->name);
+    }
+}
+
 bool JsonConverter::handleTableImplementation(const IR::Property* implementation,
                                               const IR::Key* key,
                                               Util::JsonObject* table,
@@ -1413,13 +1603,13 @@ JsonConverter::convertTable(const CFG::TableNode* node,
     CFG::Node* defaultLabelDestination = nullptr;  // if the "default" label is executed
     // Note: the "default" label is not the default_action.
     bool hitMiss = false;
-    for (auto s : node->successors.edges) {
-        if (s->isUnconditional())
-            nextDestination = s->endpoint;
-        else if (s->isBool())
+    for (auto& s : node->successors.edges) {
+        if (s.isUnconditional())
+            nextDestination = s.endpoint;
+        else if (s.isBool())
             hitMiss = true;
-        else if (s->label == "default")
-            defaultLabelDestination = s->endpoint;
+        else if (s.label == "default")
+            defaultLabelDestination = s.endpoint;
     }
 
     Util::IJson* nextLabel = nullptr;
@@ -1436,19 +1626,19 @@ JsonConverter::convertTable(const CFG::TableNode* node,
     }
 
     std::set<cstring> labelsDone;
-    for (auto s : node->successors.edges) {
+    for (auto& s : node->successors.edges) {
         cstring label;
-        if (s->isBool()) {
-            label = s->getBool() ? "__HIT__" : "__MISS__";
-        } else if (s->isUnconditional()) {
+        if (s.isBool()) {
+            label = s.getBool() ? "__HIT__" : "__MISS__";
+        } else if (s.isUnconditional()) {
             continue;
         } else {
-            label = s->label;
+            label = s.label;
             if (label == "default")
                 continue;
             label = ::get(useActionName, label);
         }
-        next_tables->emplace(label, nodeName(s->endpoint));
+        next_tables->emplace(label, nodeName(s.endpoint));
         labelsDone.emplace(label);
     }
 
@@ -1539,9 +1729,23 @@ Util::IJson* JsonConverter::convertControl(const IR::ControlBlock* block, cstrin
         result->emplace("init_table", Util::JsonValue::null);
     } else {
         BUG_CHECK(cfg->entryPoint->successors.size() == 1, "Expected 1 start node for %1%", cont);
-        auto start = (*(cfg->entryPoint->successors.edges.begin()))->endpoint;
+        auto start = cfg->entryPoint->successors.edges.front().endpoint;
         result->emplace("init_table", start->name);
     }
+    TableDependencies* deps = nullptr;
+    if (emitDependencies) {
+        deps = new TableDependencies(refMap, typeMap);
+        deps->analyze(cfg);
+    }
+
+    std::map<const CFG::Node*, IfChain> chains;
+    std::set<const CFG::Node*> inChains;  // the arms of the chains after the first
+    if (ifChainTables) {
+        chains = findIfChains(cfg);
+        for (auto& c : chains)
+            inChains.insert(c.second.arms.begin() + 1, c.second.arms.end());
+    }
+
     auto tables = mkArrayField(result, "tables");
     auto action_profiles = mkArrayField(result, "action_profiles");
     auto conditionals = mkArrayField(result, "conditionals");
@@ -1549,9 +1753,17 @@ Util::IJson* JsonConverter::convertControl(const IR::ControlBlock* block, cstrin
     for (auto node : cfg->allNodes) {
         if (node->is<CFG::TableNode>()) {
             auto j = convertTable(node->to<CFG::TableNode>(), counters, action_profiles);
+            if (deps != nullptr)
+                addDependencies(cfg, deps, node, j->to<Util::JsonObject>());
             tables->append(j);
+        } else if (inChains.count(node)) {
+            continue;
+        } else if (chains.count(node)) {
+            tables->append(convertIfChain(chains.at(node)));
         } else if (node->is<CFG::IfNode>()) {
             auto j = convertIf(node->to<CFG::IfNode>(), cont->name);
+            if (deps != nullptr)
+                addDependencies(cfg, deps, node, j->to<Util::JsonObject>());
             conditionals->append(j);
         }
     }
@@ -1689,8 +1901,126 @@ Util::IJson* JsonConverter::convertControl(const IR::ControlBlock* block, cstrin
 }
 
 unsigned JsonConverter::nextId(cstring group) {
-    static std::map<cstring, unsigned> counters;
-    return counters[group]++;
+    return ids[group]++;
+}
+
+void JsonConverter::renumber(Util::JsonArray* objects, cstring group) {
+    for (auto o : *objects)
+        (*o->to<Util::JsonObject>())["id"] = new Util::JsonValue(nextId(group));
+}
+
+bool JsonConverter::convertPipelines(
+        const std::vector<std::pair<const IR::ControlBlock*, cstring>>& controls,
+        Util::JsonArray* pipelines, Util::JsonArray* counters,
+        Util::JsonArray* meters, Util::JsonArray* registers) {
+    // Each control is converted by a copy of this converter, into arrays of its own,
+    // with the names that it makes reserved rather than added to refMap.  The results
+    // are then put together in order, with their ids renumbered, and their names added
+    // to refMap; a control whose names come out different is converted again.
+    struct task_t {
+        Util::IJson* result = nullptr;
+        Util::JsonArray* counters = nullptr;
+        Util::JsonArray* meters = nullptr;
+        Util::JsonArray* registers = nullptr;
+        P4::ReferenceMap::NameReservation* names = nullptr;
+        std::exception_ptr error;
+    };
+    std::vector<task_t> tasks(controls.size());
+    auto convertOne = [&](size_t i, bool reserve) {
+        auto& task = tasks[i];
+        auto copy = new JsonConverter(*this);
+        copy->conv = new ExpressionConverter(copy);
+        task.counters = new Util::JsonArray();
+        task.meters = new Util::JsonArray();
+        task.registers = new Util::JsonArray();
+        if (reserve) {
+            task.names = new P4::ReferenceMap::NameReservation(refMap);
+            task.names->activate();
+        }
+        try {
+            task.result = copy->convertControl(controls[i].first, controls[i].second,
+                                               task.counters, task.meters, task.registers);
+        } catch (...) {
+            task.error = std::current_exception(); }
+        if (reserve)
+            task.names->deactivate();
+    };
+    // With a cache, a control gets the JSON saved by an earlier compilation if it
+    // was the same then, and so was all the JSON made before it
+    std::vector<uint64_t> keys(controls.size());
+    std::vector<bool> cached(controls.size(), false);
+    JsonCache* cache = jsonCacheDir.isNullOrEmpty() ? nullptr : new JsonCache(jsonCacheDir);
+    if (cache != nullptr) {
+        std::stringstream before;
+        toplevel.serialize(before, true);
+        for (auto& id : ids)
+            before << id.first << " " << id.second << " ";
+        for (size_t i = 0; i < controls.size(); ++i) {
+            std::stringstream control;
+            P4::ToP4 toP4(&control, false);
+            controls[i].first->container->apply(toP4);
+            CacheEntry::Hash key;
+            CacheEntry::addCompiler(key);
+            std::string text = before.str() + control.str();
+            key.add(text.data(), text.size()).add(controls[i].second).add(emitDependencies)
+                .add(ifChainTables);
+            keys[i] = key.value();
+
+            JsonCache::Entry entry;
+            if (!cache->load(keys[i], entry))
+                continue;
+            LOG1("Reusing the JSON of " << controls[i].second);
+            auto& task = tasks[i];
+            task.result = entry.pipeline;
+            task.counters = entry.counters;
+            task.meters = entry.meters;
+            task.registers = entry.registers;
+            task.names = new P4::ReferenceMap::NameReservation(refMap);
+            for (auto& request : entry.names)
+                task.names->addRequest(request);
+            cached[i] = true;
+        }
+    }
+    Util::parallel_for(controls.size(), 0, [&](size_t i) {
+        if (!cached[i])
+            convertOne(i, true);
+    });
+
+    for (size_t i = 0; i < controls.size(); ++i) {
+        auto& task = tasks[i];
+        if (task.error)
+            std::rethrow_exception(task.error);
+        if (::errorCount() > 0)
+            return false;
+        auto names = task.names->getRequests();
+        if (!task.names->commit()) {
+            convertOne(i, false);
+            if (task.error)
+                std::rethrow_exception(task.error);
+        } else if (cache != nullptr && !cached[i] && ::errorCount() == 0) {
+            // saved before the ids are renumbered, as they are part of the key
+            JsonCache::Entry entry;
+            entry.pipeline = task.result->to<Util::JsonObject>();
+            entry.counters = task.counters;
+            entry.meters = task.meters;
+            entry.registers = task.registers;
+            entry.names = names;
+            cache->store(keys[i], entry);
+        }
+        auto pipeline = task.result->to<Util::JsonObject>();
+        (*pipeline)["id"] = new Util::JsonValue(nextId("control"));
+        renumber(pipeline->get("tables")->to<Util::JsonArray>(), "tables");
+        renumber(pipeline->get("action_profiles")->to<Util::JsonArray>(), "action_profiles");
+        renumber(pipeline->get("conditionals")->to<Util::JsonArray>(), "conditionals");
+        renumber(task.counters, "counter_arrays");
+        renumber(task.meters, "meter_arrays");
+        renumber(task.registers, "register_arrays");
+        pipelines->append(pipeline);
+        counters->insert(counters->end(), task.counters->begin(), task.counters->end());
+        meters->insert(meters->end(), task.meters->begin(), task.meters->end());
+        registers->insert(registers->end(), task.registers->begin(), task.registers->end());
+    }
+    return ::errorCount() == 0;
 }
 
 void JsonConverter::addHeaderStacks(const IR::Type_Struct* headersStruct) {
@@ -1717,8 +2047,11 @@ void JsonConverter::addHeaderStacks(const IR::Type_Struct* headersStruct) {
             unsigned id = nextId("headers");
             stackMembers->append(id);
             auto header = new Util::JsonObject();
-            cstring name = f->externalName() + "[" + Util::toString(i) + "]";
-            header->emplace("name", name);
+            cstring_builder name(f->externalName());
+            name += '[';
+            name += i;
+            name += ']';
+            header->emplace("name", name.str());
             header->emplace("id", id);
             header->emplace("header_type", header_type);
             header->emplace("metadata", false);
@@ -1767,8 +2100,11 @@ void JsonConverter::addLocals() {
                 unsigned id = nextId("headers");
                 stackMembers->append(id);
                 auto header = new Util::JsonObject();
-                cstring name = v->name + "[" + Util::toString(i) + "]";
-                header->emplace("name", name);
+                cstring_builder name(v->name.name);
+                name += '[';
+                name += i;
+                name += ']';
+                header->emplace("name", name.str());
                 header->emplace("id", id);
                 header->emplace("header_type", header_type);
                 header->emplace("metadata", false);
@@ -1811,8 +2147,10 @@ void JsonConverter::addLocals() {
 void JsonConverter::padScalars() {
     unsigned padding = scalars_width % 8;
     auto scalarFields = (*scalarsStruct)["fields"]->to<Util::JsonArray>();
+    scalarsPadding = nullptr;
     if (padding != 0) {
         cstring name = refMap->newName("_padding");
+        scalarsPadding = name;
         auto field = pushNewArray(scalarFields);
         field->append(name);
         field->append(8 - padding);
@@ -1820,6 +2158,120 @@ void JsonConverter::padScalars() {
     }
 }
 
+namespace {
+
+// Counts the references to each field of the header in the json
+void countFields(const Util::IJson* json, cstring header, std::map<cstring, unsigned>& count) {
+    if (auto array = json->to<Util::JsonArray>()) {
+        if (array->size() == 2 && array->at(0)->is<Util::JsonValue>() &&
+            array->at(1)->is<Util::JsonValue>()) {
+            auto h = array->at(0)->to<Util::JsonValue>();
+            auto f = array->at(1)->to<Util::JsonValue>();
+            if (h->isString() && f->isString() && h->getString() == header) {
+                count[f->getString()]++;
+                return;
+            }
+        }
+        for (auto e : *array)
+            countFields(e, header, count);
+    } else if (auto object = json->to<Util::JsonObject>()) {
+        for (auto e : *object)
+            countFields(e.second, header, count);
+    }
+}
+
+}  // namespace
+
+void JsonConverter::layoutScalars() {
+    std::map<cstring, unsigned> accesses;
+    countFields(&toplevel, scalarsName, accesses);
+    auto fields = (*scalarsStruct)["fields"]->to<Util::JsonArray>();
+    auto end = fields->end();
+    if (!scalarsPadding.isNull())
+        --end;  // the padding stays last
+    // Each field of whole bytes then starts on a byte, and the fields of a few bits,
+    // such as booleans, are together next to the padding.
+    std::stable_sort(fields->begin(), end, [&accesses](Util::IJson* a, Util::IJson* b) {
+        auto fa = a->to<Util::JsonArray>(), fb = b->to<Util::JsonArray>();
+        int wa = fa->at(1)->to<Util::JsonValue>()->getInt();
+        int wb = fb->at(1)->to<Util::JsonValue>()->getInt();
+        if ((wa % 8 == 0) != (wb % 8 == 0))
+            return wa % 8 == 0;
+        unsigned ca = accesses[fa->at(0)->to<Util::JsonValue>()->getString()];
+        unsigned cb = accesses[fb->at(0)->to<Util::JsonValue>()->getString()];
+        if (ca != cb)
+            return ca > cb;
+        return wa > wb;
+    });
+}
+
+namespace {
+
+// The [header, field] pair that 'json' is, if it is one
+bool isFieldName(const Util::IJson* json) {
+    auto array = json->to<Util::JsonArray>();
+    if (array == nullptr || array->size() != 2)
+        return false;
+    for (auto e : *array) {
+        auto v = e->to<Util::JsonValue>();
+        if (v == nullptr || !v->isString())
+            return false;
+    }
+    return true;
+}
+
+using FieldIndex = std::map<std::pair<cstring, cstring>, unsigned>;
+
+// The index in 'table' of a field name, added if it is new
+Util::IJson* internField(Util::IJson* name, Util::JsonArray* table, FieldIndex& index) {
+    auto pair = name->to<Util::JsonArray>();
+    auto key = std::make_pair(pair->at(0)->to<Util::JsonValue>()->getString(),
+                              pair->at(1)->to<Util::JsonValue>()->getString());
+    auto it = index.find(key);
+    if (it == index.end()) {
+        it = index.emplace(key, table->size()).first;
+        table->append(name);
+    }
+    return new Util::JsonValue(it->second);
+}
+
+// Replaces the field names in the json, i.e. the values of the "field" expressions
+// and the targets of keys and checksums, by their index
+void internNames(Util::IJson* json, Util::JsonArray* table, FieldIndex& index) {
+    if (auto array = json->to<Util::JsonArray>()) {
+        for (auto e : *array)
+            internNames(e, table, index);
+    } else if (auto object = json->to<Util::JsonObject>()) {
+        auto type = object->get("type");
+        bool field = type != nullptr && type->is<Util::JsonValue>() &&
+                *type->to<Util::JsonValue>() == "field";
+        for (auto& e : *object) {
+            if ((e.first == "target" || (field && e.first == "value")) && isFieldName(e.second))
+                e.second = internField(e.second, table, index);
+            else
+                internNames(e.second, table, index);
+        }
+    }
+}
+
+}  // namespace
+
+void JsonConverter::internFieldNames() {
+    auto table = new Util::JsonArray();
+    FieldIndex index;
+    for (auto& e : toplevel) {
+        if (e.first != "force_arith") {
+            internNames(e.second, table, index);
+            continue;
+        }
+        for (auto& f : *e.second->to<Util::JsonArray>()) {
+            if (isFieldName(f))
+                f = internField(f, table, index);
+        }
+    }
+    toplevel.emplace("field_ids", table);
+}
+
 void JsonConverter::addMetaInformation() {
   auto meta = new Util::JsonObject();
 
@@ -1845,6 +2297,11 @@ void JsonConverter::convert(P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
         ::error("No output to generate");
         return;
     }
+    if (!packetProfile.isNullOrEmpty()) {
+        readProfile();
+        if (::errorCount() > 0)
+            return;
+    }
 
     if (package->type->name != v1model.sw.name) {
         ::error("This back-end requires the program to be compiled for the %1% model",
@@ -1938,21 +2395,27 @@ void JsonConverter::convert(P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
         body->append(call);
         acts->append(drop);
     }
+    if (ifChainTables) {
+        // synthesize the actions that select the arms of if chains, which do nothing
+        for (unsigned i = 0; i <= ifChainMaxArms; i++) {
+            auto action = new Util::JsonObject();
+            action->emplace("name", ifChainAction(i));
+            ifChainActionIds.push_back(nextId("actions"));
+            action->emplace("id", ifChainActionIds.back());
+            action->emplace("runtime_data", new Util::JsonArray());
+            action->emplace("primitives", new Util::JsonArray());
+            acts->append(action);
+        }
+    }
 
     auto pipelines = mkArrayField(&toplevel, "pipelines");
     auto ingressBlock = package->getParameterValue(v1model.sw.ingress.name);
     auto ingressControl = ingressBlock->to<IR::ControlBlock>();
-    auto ingress = convertControl(ingressControl, v1model.ingress.name,
-                                  counters, meters, registers);
-    if (::errorCount() > 0)
-        return;
-    pipelines->append(ingress);
     auto egressBlock = package->getParameterValue(v1model.sw.egress.name);
-    auto egress = convertControl(egressBlock->to<IR::ControlBlock>(),
-                                 v1model.egress.name, counters, meters, registers);
-    if (::errorCount() > 0)
+    if (!convertPipelines({ { ingressControl, v1model.ingress.name },
+                            { egressBlock->to<IR::ControlBlock>(), v1model.egress.name } },
+                          pipelines, counters, meters, registers))
         return;
-    pipelines->append(egress);
 
     // standard metadata type and instance
     stdMetadataParameter = ingressControl->container->type->applyParams->getParameter(
@@ -1988,6 +2451,23 @@ void JsonConverter::convert(P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
             createForceArith(type, metaname, fa);
         }
     }
+
+    if (!keepScalarOrder)
+        layoutScalars();
+    // with the final layout, and before the field names are replaced
+    if (!nativeActionsFile.isNullOrEmpty()) {
+        std::ostream* out = openFile(nativeActionsFile, false);
+        if (out != nullptr) {
+            NativeActions native(&toplevel);
+            unsigned count = native.emit(*out);
+            delete out;
+            if (Log::verbose())
+                std::cerr << count << " of " << acts->size()
+                          << " actions written as native primitives" << std::endl;
+        }
+    }
+    if (internFields)
+        internFieldNames();
 }
 
 void JsonConverter::createForceArith(const IR::Type* meta, cstring name,
@@ -2179,9 +2659,12 @@ void JsonConverter::convertDeparserBody(const IR::Vector<IR::StatOrDecl>* body,
                                 auto e = j->to<Util::JsonObject>()->get("value");
                                 BUG_CHECK(e->is<Util::JsonValue>(),
                                           "%1%: Expected a Json value", e->toString());
-                                cstring ref = e->to<Util::JsonValue>()->getString();
-                                ref += "[" + Util::toString(i) + "]";
-                                result->append(ref);
+                                cstring_builder ref(
+                                    e->to<Util::JsonValue>()->getString());
+                                ref += '[';
+                                ref += i;
+                                ref += ']';
+                                result->append(ref.str());
                             }
                         } else if (type->is<IR::Type_Header>()) {
                             auto j = conv->convert(arg);
@@ -2217,7 +2700,7 @@ Util::IJson* JsonConverter::toJson(const IR::P4Parser* parser) {
     auto states = mkArrayField(result, "parse_states");
 
     for (auto state : *parser->states) {
-        auto json = toJson(state);
+        auto json = toJson(parser, state);
         if (json != nullptr)
             states->append(json);
     }
@@ -2387,6 +2870,106 @@ unsigned JsonConverter::combine(const IR::Expression* keySet,
     }
 }
 
+void JsonConverter::readProfile() {
+    auto in = openInputFile(packetProfile);
+    if (in == nullptr)
+        return;
+    // lines "parse_state <name> <count>"; the other lines are ignored
+    std::string line;
+    unsigned lineNumber = 0;
+    while (std::getline(*in, line)) {
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string kind, name;
+        int64_t count;
+        if (!(fields >> kind) || kind != "parse_state")
+            continue;
+        if (!(fields >> name >> count) || count < 0) {
+            ::error("%1%:%2%: expected parse_state <name> <count>", packetProfile, lineNumber);
+            break;
+        }
+        stateCounts[name] += count;
+    }
+    delete in;
+}
+
+int64_t JsonConverter::stateFrequency(const IR::P4Parser* parser, cstring name) const {
+    auto state = parser->states->getDeclaration<IR::ParserState>(name);
+    if (state == nullptr)
+        return 0;
+    // the counts of a profile and the annotations are not on the same scale, so
+    // with a profile the annotations are ignored
+    if (!packetProfile.isNullOrEmpty()) {
+        auto count = stateCounts.find(state->externalName());
+        return count != stateCounts.end() ? count->second : 0;
+    }
+    auto annotation = state->annotations->getSingle("frequency");
+    if (annotation == nullptr)
+        return 0;
+    if (annotation->expr.size() != 1 || !annotation->expr.at(0)->is<IR::Constant>()) {
+        ::error("%1%: expected a constant frequency", annotation);
+        return 0;
+    }
+    return annotation->expr.at(0)->to<IR::Constant>()->asInt();
+}
+
+namespace {
+
+// Whether a key can match both transitions
+bool overlap(const JsonConverter::Transition& a, const JsonConverter::Transition& b) {
+    mpz_class common = a.mask & b.mask;
+    return ((a.value ^ b.value) & common) == 0;
+}
+
+}  // namespace
+
+void JsonConverter::compactTransitions(std::vector<Transition>& cases) const {
+    // BMv2 tries the transitions in order, so a transition can only be moved before
+    // the ones it does not overlap, or that go to the same state.
+    auto canMove = [&cases](size_t from, size_t to) {
+        for (size_t k = to; k < from; k++)
+            if (cases[k].next != cases[from].next && overlap(cases[k], cases[from]))
+                return false;
+        return true;
+    };
+
+    // Two transitions to the same state, with the same mask, and values that differ
+    // in one bit of the mask, are the same as one without that bit in the mask; so
+    // consecutive values and aligned ranges become one masked transition.
+    bool changes = true;
+    while (changes) {
+        changes = false;
+        for (size_t i = 0; i < cases.size(); i++) {
+            auto& a = cases[i];
+            for (size_t j = i + 1; j < cases.size(); j++) {
+                auto& b = cases[j];
+                if (a.mask == 0 || a.next != b.next || a.mask != b.mask)
+                    continue;
+                mpz_class diff = a.value ^ b.value;
+                if ((a.value & ~a.mask) != 0 || (b.value & ~b.mask) != 0 ||
+                    (diff & a.mask) != diff || mpz_popcount(diff.get_mpz_t()) != 1 ||
+                    !canMove(j, i))
+                    continue;
+                LOG1("Merging transitions to " << a.next << " with values " <<
+                     a.value << " and " << b.value);
+                a.mask &= ~diff;
+                a.value &= ~diff;
+                a.frequency = std::max(a.frequency, b.frequency);
+                cases.erase(cases.begin() + j);
+                changes = true;
+                break;
+            }
+        }
+    }
+
+    // Try the transitions to the states with a higher frequency first
+    for (size_t j = 1; j < cases.size(); j++) {
+        for (size_t k = j; k > 0 && cases[k - 1].frequency < cases[k].frequency &&
+                 canMove(k, k - 1); k--)
+            std::swap(cases[k - 1], cases[k]);
+    }
+}
+
 static Util::IJson* stateName(IR::ID state) {
     if (state.name == IR::ParserState::accept) {
         return Util::JsonValue::null;
@@ -2398,7 +2981,7 @@ static Util::IJson* stateName(IR::ID state) {
     }
 }
 
-Util::IJson* JsonConverter::toJson(const IR::ParserState* state) {
+Util::IJson* JsonConverter::toJson(const IR::P4Parser* parser, const IR::ParserState* state) {
     if (state->name == IR::ParserState::reject || state->name == IR::ParserState::accept)
         return nullptr;
 
@@ -2417,22 +3000,34 @@ Util::IJson* JsonConverter::toJson(const IR::ParserState* state) {
         if (state->selectExpression->is<IR::SelectExpression>()) {
             auto se = state->selectExpression->to<IR::SelectExpression>();
             key = conv->convert(se->select, false);
+            std::vector<Transition> cases;
+            unsigned bytes = 0;
             for (auto sc : se->selectCases) {
+                Transition t;
+                t.next = sc->state->path->name;
+                unsigned b = combine(sc->keyset, se->select, t.value, t.mask);
+                if (t.mask != 0)
+                    bytes = b;
+                if (t.mask == -1)
+                    t.mask = Util::mask(8 * b);
+                t.frequency = stateFrequency(parser, t.next);
+                cases.push_back(t);
+            }
+            compactTransitions(cases);
+            mpz_class exact = Util::mask(8 * bytes);
+            for (auto& t : cases) {
                 auto trans = new Util::JsonObject();
-                mpz_class value, mask;
-                unsigned bytes = combine(sc->keyset, se->select, value, mask);
-                if (mask == 0) {
+                if (t.mask == 0) {
                     trans->emplace("value", "default");
                     trans->emplace("mask", Util::JsonValue::null);
-                    trans->emplace("next_state", stateName(sc->state->path->name));
                 } else {
-                    trans->emplace("value", stringRepr(value, bytes));
-                    if (mask == -1)
+                    trans->emplace("value", stringRepr(t.value, bytes));
+                    if (t.mask == exact)
                         trans->emplace("mask", Util::JsonValue::null);
                     else
-                        trans->emplace("mask", stringRepr(mask, bytes));
-                    trans->emplace("next_state", stateName(sc->state->path->name));
+                        trans->emplace("mask", stringRepr(t.mask, bytes));
                 }
+                trans->emplace("next_state", stateName(t.next));
                 transitions->append(trans);
             }
         } else if (state->selectExpression->is<IR::PathExpression>()) {
@@ -17,6 +17,7 @@ limitations under the License.
 #ifndef _BACKENDS_BMV2_JSONCONVERTER_H_
 #define _BACKENDS_BMV2_JSONCONVERTER_H_
 
+#include "lib/gmputil.h"
 #include "lib/json.h"
 #include "frontends/common/options.h"
 #include "frontends/p4/fromv1.0/v1model.h"
@@ -79,6 +80,36 @@ class JsonConverter final {
     using ErrorValue = unsigned int;
     using ErrorCodesMap = std::unordered_map<const IR::IDeclaration *, ErrorValue>;
     ErrorCodesMap errorCodesMap{};
+    // add the dependencies between the tables and conditionals of each pipeline
+    bool emitDependencies = false;
+    // leave the fields of the scalars header in the order of their declarations
+    bool keepScalarOrder = false;
+    // refer to fields by their index in a table of field names
+    bool internFields = false;
+    // make a table of each chain of if statements that compare a field with constants
+    bool ifChainTables = false;
+    // where to find and save the JSON of the controls, if anywhere
+    cstring jsonCacheDir = nullptr;
+    // where to write the actions as native primitives, if anywhere
+    cstring nativeActionsFile = nullptr;
+    // the counts of packets per parser state (see README.md), if any
+    cstring packetProfile = nullptr;
+    // A chain of if statements, each in the else branch of the one before, that
+    // compare the same field with different constants: if (f == c1) ... else if
+    // (f == c2) ... else ...
+    struct IfChain {
+        const Util::IJson* field;  // JSON of the field
+        unsigned width;
+        std::vector<const CFG::Node*> arms;
+        std::vector<mpz_class> values;
+    };
+    // A transition of a parser state: keys k with (k & mask) == value go to next;
+    // the default transition has a mask of 0.
+    struct Transition {
+        mpz_class value, mask;
+        IR::ID    next;
+        int64_t   frequency = 0;
+    };
 
  private:
     Util::JsonArray *headerTypes;
@@ -87,6 +118,16 @@ class JsonConverter final {
     Util::JsonArray *headerStacks;
     Util::JsonObject *scalarsStruct;
     unsigned scalars_width = 0;
+    cstring scalarsPadding;  // the last field of the scalars, if it needs padding
+    std::map<cstring, unsigned> ids;  // the next id of each group
+    // The field lists and calculations made so far, by their group or algorithm and
+    // the text of their JSON, so that each is made once
+    std::map<cstring, int> fieldListIds;
+    std::map<cstring, cstring> calculationNames;
+    // the number of packets that each parser state parsed, by its external name
+    std::map<cstring, int64_t> stateCounts;
+    // the ids of the actions that the tables made of if chains select each arm with
+    std::vector<unsigned> ifChainActionIds;
     friend class ExpressionConverter;
 
  protected:
@@ -96,6 +137,11 @@ class JsonConverter final {
     void addHeaderStacks(const IR::Type_Struct* headersStruct);
     void addLocals();
     void padScalars();
+    // Puts the fields of whole bytes first in the scalars, and the more used first
+    void layoutScalars();
+    // Puts the names of all the fields in a "field_ids" table, and refers to each
+    // field by its index in it
+    void internFieldNames();
     void addTypesAndInstances(const IR::Type_StructLike* type, bool meta);
     void convertActionBody(const IR::Vector<IR::StatOrDecl>* body,
                            Util::JsonArray* result, Util::JsonArray* fieldLists,
@@ -104,16 +150,32 @@ class JsonConverter final {
                               Util::JsonArray* counters,
                               Util::JsonArray* action_profiles);
     Util::IJson* convertIf(const CFG::IfNode* node, cstring parent);
+    // The chains of if statements of a control that are worth a table, by their first
+    // node; a long chain is split into several
+    std::map<const CFG::Node*, IfChain> findIfChains(const CFG* cfg);
+    // An exact table with an entry for each arm of the chain, that goes where the arm
+    // goes, and goes where the last else goes on a miss
+    Util::IJson* convertIfChain(const IfChain& chain);
+    void addDependencies(const CFG* cfg, const TableDependencies* deps,
+                         const CFG::Node* node, Util::JsonObject* json);
     Util::JsonArray* createActions(Util::JsonArray* fieldLists, Util::JsonArray* calculations,
                                    Util::JsonArray* learn_lists);
     Util::IJson* toJson(const IR::P4Parser* cont);
-    Util::IJson* toJson(const IR::ParserState* state);
+    Util::IJson* toJson(const IR::P4Parser* parser, const IR::ParserState* state);
     void convertDeparserBody(const IR::Vector<IR::StatOrDecl>* body, Util::JsonArray* result);
     Util::IJson* convertDeparser(const IR::P4Control* state);
     Util::IJson* convertParserStatement(const IR::StatOrDecl* stat);
     Util::IJson* convertControl(const IR::ControlBlock* block, cstring name,
                                 Util::JsonArray* counters, Util::JsonArray* meters,
                                 Util::JsonArray* registers);
+    // Converts the controls, each named by its pair, into pipelines, on several threads
+    // when built with MULTITHREAD; the output is the same as that of convertControl
+    // called on each in turn.  Returns false on errors.
+    bool convertPipelines(const std::vector<std::pair<const IR::ControlBlock*, cstring>>& controls,
+                          Util::JsonArray* pipelines, Util::JsonArray* counters,
+                          Util::JsonArray* meters, Util::JsonArray* registers);
+    // Gives the objects the next ids of the group, in order
+    void renumber(Util::JsonArray* objects, cstring group);
     cstring createCalculation(cstring algo, const IR::Expression* fields,
                               Util::JsonArray* calculations);
     Util::IJson* nodeName(const CFG::Node* node) const;
@@ -126,7 +188,7 @@ class JsonConverter final {
                                    Util::JsonObject* table,
                                    Util::JsonArray* action_profiles);
     void addToFieldList(const IR::Expression* expr, Util::JsonArray* fl);
-    // returns id of created field list
+    // returns id of created field list, or of the same one created before
     int createFieldList(const IR::Expression* expr, cstring group,
                         cstring listName, Util::JsonArray* fieldLists);
     void generateUpdate(const IR::BlockStatement *block,
@@ -140,6 +202,14 @@ class JsonConverter final {
     unsigned combine(const IR::Expression* keySet,
                      const IR::ListExpression* select,
                      mpz_class& value, mpz_class& mask) const;
+    // The number of packets that a state of the parser parsed in the profile if there
+    // is one, else its @frequency annotation; 0 if there is neither
+    int64_t stateFrequency(const IR::P4Parser* parser, cstring name) const;
+    // Reads the counts of packetProfile
+    void readProfile();
+    // Merges the transitions that can be one masked transition, and reorders them
+    // by the frequency of their states, without changing where a key goes
+    void compactTransitions(std::vector<Transition>& cases) const;
     void buildCfg(IR::P4Control* cont);
 
     // Adds meta information (such as version) to the json
@@ -153,8 +223,9 @@ class JsonConverter final {
  public:
     explicit JsonConverter(const CompilerOptions& options);
     void convert(P4::ReferenceMap* refMap, P4::TypeMap* typeMap, IR::ToplevelBlock *toplevel);
-    void serialize(std::ostream& out) const
-    { toplevel.serialize(out); }
+    // Writes the output through a Util::JsonWriter; compact output has no whitespace
+    void serialize(std::ostream& out, bool compact = false) const
+    { toplevel.serialize(out, compact); }
 };
 
 }  // namespace BMV2
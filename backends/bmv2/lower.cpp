@@ -14,7 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <sstream>
 #include "lower.h"
+#include "frontends/p4/toP4/toP4.h"
 #include "lib/gmputil.h"
 
 namespace BMV2 {
@@ -125,4 +127,175 @@ const IR::Node* LowerExpressions::postorder(IR::Concat* expression) {
     return result;
 }
 
+namespace {
+
+// The variables that an expression reads
+class ReadVariables : public Inspector {
+ public:
+    std::set<cstring> variables;
+    void postorder(const IR::PathExpression* expression) override
+    { variables.emplace(expression->path->name); }
+};
+
+// The variable that an assignment to this expression writes part of
+cstring writtenVariable(const IR::Expression* expression) {
+    while (true) {
+        if (auto member = expression->to<IR::Member>())
+            expression = member->expr;
+        else if (auto index = expression->to<IR::ArrayIndex>())
+            expression = index->left;
+        else if (auto slice = expression->to<IR::Slice>())
+            expression = slice->e0;
+        else
+            break;
+    }
+    if (auto path = expression->to<IR::PathExpression>())
+        return path->path->name;
+    return nullptr;
+}
+
+}  // namespace
+
+bool FlattenExpressions::isOperation(const IR::Expression* expression) const {
+    if (expression->is<IR::Member>() || expression->is<IR::ArrayIndex>() ||
+        expression->is<IR::Slice>())
+        return false;
+    if (!expression->is<IR::Operation_Unary>() && !expression->is<IR::Operation_Binary>() &&
+        !expression->is<IR::Operation_Ternary>())
+        return false;
+    // boolean temporaries are not worth it: BMv2 compares in conditions anyway
+    return typeMap->getType(expression, true)->is<IR::Type_Bits>();
+}
+
+const IR::PathExpression* FlattenExpressions::variable(cstring name, const IR::Type* type) {
+    auto result = new IR::PathExpression(IR::ID(name, nullptr));
+    typeMap->setType(result, type);
+    typeMap->setLeftValue(result);
+    return result;
+}
+
+const IR::Expression* FlattenExpressions::flatten(const IR::Expression* expression) {
+    if (expression->is<IR::Member>() || expression->is<IR::ArrayIndex>() ||
+        expression->is<IR::Slice>())
+        return expression;
+    auto type = typeMap->getType(expression, true);
+    if (auto u = expression->to<IR::Operation_Unary>()) {
+        auto e = operand(u->expr);
+        if (e == u->expr)
+            return expression;
+        auto result = u->clone();
+        result->expr = e;
+        typeMap->setType(result, type);
+        return result;
+    } else if (auto b = expression->to<IR::Operation_Binary>()) {
+        auto left = operand(b->left);
+        auto right = operand(b->right);
+        if (left == b->left && right == b->right)
+            return expression;
+        auto result = b->clone();
+        result->left = left;
+        result->right = right;
+        typeMap->setType(result, type);
+        return result;
+    } else if (auto t = expression->to<IR::Operation_Ternary>()) {
+        auto e0 = operand(t->e0);
+        auto e1 = operand(t->e1);
+        auto e2 = operand(t->e2);
+        if (e0 == t->e0 && e1 == t->e1 && e2 == t->e2)
+            return expression;
+        auto result = t->clone();
+        result->e0 = e0;
+        result->e1 = e1;
+        result->e2 = e2;
+        typeMap->setType(result, type);
+        return result;
+    }
+    return expression;
+}
+
+const IR::Expression* FlattenExpressions::temporary(const IR::Expression* expression) {
+    auto type = typeMap->getType(expression, true);
+    auto flat = flatten(expression);
+    std::stringstream text;
+    text << type->toString() << " ";
+    P4::ToP4 toP4(&text, false);
+    flat->apply(toP4);
+    cstring key = text.str();
+
+    auto it = available.find(key);
+    if (it != available.end())
+        return variable(it->second, type);
+
+    cstring typeName = type->toString();
+    auto& temps = temporaries[typeName];
+    unsigned index = used[typeName]++;
+    if (index == temps.size())
+        temps.push_back(new IR::Declaration_Variable(
+            Util::SourceInfo(), IR::ID(refMap->newName("tmp"), nullptr),
+            IR::Annotations::empty, type, nullptr));
+    cstring name = temps.at(index)->name;
+    statements->push_back(new IR::AssignmentStatement(
+        expression->srcInfo, variable(name, type), flat));
+    ReadVariables read;
+    flat->apply(read);
+    available.emplace(key, name);
+    reads.emplace(key, read.variables);
+    LOG1("Computing " << flat << " in " << name);
+    return variable(name, type);
+}
+
+void FlattenExpressions::invalidate(cstring variable) {
+    for (auto it = available.begin(); it != available.end();) {
+        if (variable.isNullOrEmpty() || reads[it->first].count(variable) != 0) {
+            reads.erase(it->first);
+            it = available.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+const IR::Node* FlattenExpressions::preorder(IR::P4Action* action) {
+    prune();
+    used.clear();
+    available.clear();
+    reads.clear();
+    statements = new IR::IndexedVector<IR::StatOrDecl>();
+    bool changes = false;
+    for (auto s : *action->body->components) {
+        auto assign = s->to<IR::AssignmentStatement>();
+        if (assign == nullptr) {
+            // e.g. a call that may write anything
+            statements->push_back(s);
+            invalidate(nullptr);
+            continue;
+        }
+        auto right = flatten(assign->right);
+        if (right != assign->right) {
+            statements->push_back(new IR::AssignmentStatement(
+                assign->srcInfo, assign->left, right));
+            changes = true;
+        } else {
+            statements->push_back(s);
+        }
+        invalidate(writtenVariable(assign->left));
+    }
+    if (changes)
+        action->body = new IR::BlockStatement(action->body->srcInfo,
+                                              action->body->annotations, statements);
+    statements = nullptr;
+    return action;
+}
+
+const IR::Node* FlattenExpressions::postorder(IR::P4Control* control) {
+    if (temporaries.empty())
+        return control;
+    auto locals = new IR::IndexedVector<IR::Declaration>(*control->controlLocals);
+    for (auto& t : temporaries)
+        for (auto d : t.second)
+            locals->push_back(d);
+    control->controlLocals = locals;
+    return control;
+}
+
 }  // namespace BMV2
@@ -18,6 +18,7 @@ limitations under the License.
 #define _BACKENDS_BMV2_LOWER_H_
 
 #include "ir/ir.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
 #include "frontends/p4/typeMap.h"
 
 namespace BMV2 {
@@ -45,6 +46,51 @@ class LowerExpressions : public Transform {
     { prune(); return table; }  // don't simplify expressions in table
 };
 
+// Splits the expressions assigned in actions into one operation each, so that BMv2
+// does not evaluate a tree of operations for each packet:
+// x = (a + b) * (a + b) ^ c;
+// turns into
+// tmp = a + b;
+// tmp_0 = tmp * tmp;
+// x = tmp_0 ^ c;
+// The temporaries are variables of the control, shared by its actions.  An operation
+// that an action already computed, with none of its operands written since, is not
+// computed again.  Only the top-level statements of the actions are split.
+class FlattenExpressions : public Transform {
+    P4::ReferenceMap* refMap;
+    P4::TypeMap* typeMap;
+    // the temporaries of the current control, by type
+    std::map<cstring, std::vector<const IR::Declaration_Variable*>> temporaries;
+    // how many temporaries of each type the current action uses
+    std::map<cstring, unsigned> used;
+    // the operations in temporaries, by their text, and the variables that they read
+    std::map<cstring, cstring> available;
+    std::map<cstring, std::set<cstring>> reads;
+    // the assignments to temporaries before the current statement
+    IR::IndexedVector<IR::StatOrDecl>* statements = nullptr;
+
+    bool isOperation(const IR::Expression* expression) const;
+    const IR::Expression* flatten(const IR::Expression* expression);
+    const IR::Expression* operand(const IR::Expression* expression)
+    { return isOperation(expression) ? temporary(expression) : flatten(expression); }
+    const IR::Expression* temporary(const IR::Expression* expression);
+    const IR::PathExpression* variable(cstring name, const IR::Type* type);
+    void invalidate(cstring variable);
+
+ public:
+    FlattenExpressions(P4::ReferenceMap* refMap, P4::TypeMap* typeMap) :
+            refMap(refMap), typeMap(typeMap)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("FlattenExpressions"); }
+    const IR::Node* preorder(IR::P4Parser* parser) override
+    { prune(); return parser; }
+    const IR::Node* preorder(IR::P4Control* control) override
+    { temporaries.clear(); return control; }
+    const IR::Node* postorder(IR::P4Control* control) override;
+    const IR::Node* preorder(IR::P4Table* table) override
+    { prune(); return table; }
+    const IR::Node* preorder(IR::P4Action* action) override;
+};
+
 }  // namespace BMV2
 
 #endif /* _BACKENDS_BMV2_LOWER_H_ */
@@ -15,6 +15,8 @@ limitations under the License.
 */
 
 #include "midend.h"
+#include "deadMetadata.h"
+#include "incrementalChecksum.h"
 #include "lower.h"
 #include "inlining.h"
 #include "frontends/common/constantFolding.h"
@@ -23,6 +25,7 @@ limitations under the License.
 #include "frontends/p4/fromv1.0/v1model.h"
 #include "frontends/p4/moveDeclarations.h"
 #include "frontends/p4/simplify.h"
+#include "frontends/p4/simplifyDefUse.h"
 #include "frontends/p4/simplifyParsers.h"
 #include "frontends/p4/strengthReduction.h"
 #include "frontends/p4/typeChecking/typeChecker.h"
@@ -31,11 +34,13 @@ limitations under the License.
 #include "frontends/p4/unusedDeclarations.h"
 #include "midend/actionsInlining.h"
 #include "midend/actionSynthesis.h"
+#include "midend/commonSubexpressions.h"
 #include "midend/convertEnums.h"
 #include "midend/copyStructures.h"
 #include "midend/eliminateTuples.h"
 #include "midend/local_copyprop.h"
 #include "midend/localizeActions.h"
+#include "midend/mergeActions.h"
 #include "midend/moveConstructors.h"
 #include "midend/nestedStructs.h"
 #include "midend/removeLeftSlices.h"
@@ -43,6 +48,8 @@ limitations under the License.
 #include "midend/removeReturns.h"
 #include "midend/simplifyKey.h"
 #include "midend/simplifySelect.h"
+#include "midend/specializeActions.h"
+#include "midend/stackIndices.h"
 #include "midend/validateProperties.h"
 #include "midend/compileTimeOps.h"
 #include "midend/predication.h"
@@ -68,29 +75,36 @@ void MidEnd::setup_for_P4_14(CompilerOptions&) {
 }
 #endif
 
-class EnumOn32Bits : public P4::ChooseEnumRepresentation {
+// Each enum gets as few bits as its values need, which keeps the metadata that holds
+// them narrow
+class EnumOnMinimalBits : public P4::ChooseEnumRepresentation {
+    // whether each enum is one of the standard ones, which are not converted
+    mutable std::map<const IR::Type_Enum*, bool> standard;
+
     bool convert(const IR::Type_Enum* type) const override {
-        if (type->srcInfo.isValid()) {
-            unsigned line = type->srcInfo.getStart().getLineNumber();
-            auto sfl = Util::InputSources::instance->getSourceLine(line);
-            cstring sourceFile = sfl.fileName;
-            if (sourceFile.endsWith(P4V1::V1Model::instance.file.name))
-                // Don't convert any of the standard enums
-                return false;
+        auto it = standard.find(type);
+        if (it == standard.end()) {
+            bool isStandard = false;
+            if (type->srcInfo.isValid()) {
+                unsigned line = type->srcInfo.getStart().getLineNumber();
+                auto sfl = Util::InputSources::instance->getSourceLine(line);
+                cstring sourceFile = sfl.fileName;
+                isStandard = sourceFile.endsWith(P4V1::V1Model::instance.file.name);
+            }
+            it = standard.emplace(type, isStandard).first;
         }
-        return true;
+        return !it->second;
     }
-    unsigned enumSize(unsigned) const override
-    { return 32; }
+    unsigned enumSize(unsigned count) const override
+    { return minimalSize(count); }
 };
 
 
-void MidEnd::setup_for_P4_16(CompilerOptions&) {
+void MidEnd::setup_for_P4_16(CompilerOptions& options, P4::EvaluatorPass* evaluator) {
     // we may come through this path even if the program is actually a P4 v1.0 program
-    auto evaluator = new P4::EvaluatorPass(&refMap, &typeMap);
     addPasses({
         new P4::ConvertEnums(&refMap, &typeMap,
-                             new EnumOn32Bits()),
+                             new EnumOnMinimalBits()),
         new P4::RemoveReturns(&refMap),
         new P4::MoveConstructors(&refMap),
         new P4::RemoveAllUnusedDeclarations(&refMap),
@@ -110,20 +124,26 @@ void MidEnd::setup_for_P4_16(CompilerOptions&) {
         new P4::SimplifyControlFlow(&refMap, &typeMap),
         new P4::RemoveTableParameters(&refMap, &typeMap),
         new P4::RemoveActionParameters(&refMap, &typeMap),
+        options.optimize(2) ? new P4::SpecializeActions(&refMap, &typeMap) : nullptr,
         new P4::SimplifyKey(&refMap, &typeMap,
                             new P4::NonLeftValue(&refMap, &typeMap)),
         new P4::ConstantFolding(&refMap, &typeMap),
-        new P4::StrengthReduction(),
+        // the JSON gives an error for the indices that stay dynamic
+        new P4::ConstantStackIndices(&refMap, &typeMap, false),
+        options.optimize(1) ? new P4::StrengthReduction() : nullptr,
         new P4::SimplifySelect(&refMap, &typeMap, true),  // require constant keysets
         new P4::SimplifyParsers(&refMap),
-        new P4::StrengthReduction(),
+        options.optimize(1) ? new P4::StrengthReduction() : nullptr,
         new P4::EliminateTuples(&refMap, &typeMap),
         new P4::CopyStructures(&refMap, &typeMap),
         new P4::NestedStructs(&refMap, &typeMap),
-        new P4::Predication(&refMap),
-        new P4::ConstantFolding(&refMap, &typeMap),
-        new P4::LocalCopyPropagation(&refMap, &typeMap),
+        new P4::TypeChecking(&refMap, &typeMap),
+        new P4::Predication(&refMap, &typeMap, new P4::PredicationPolicy()),
         new P4::ConstantFolding(&refMap, &typeMap),
+        options.optimize(1) ? new P4::LocalCopyPropagation(&refMap, &typeMap) : nullptr,
+        options.optimize(1) ? new P4::ConstantFolding(&refMap, &typeMap) : nullptr,
+        options.optimize(2) ? new P4::RemoveDeadStores(&refMap, &typeMap) : nullptr,
+        options.optimize(2) ? new P4::CommonSubexpressions(&refMap, &typeMap) : nullptr,
         new P4::MoveDeclarations(),
         new P4::ValidateTableProperties({ "implementation", "size", "counters",
                                           "meters", "size", "support_timeout" }),
@@ -131,30 +151,37 @@ void MidEnd::setup_for_P4_16(CompilerOptions&) {
         new P4::CompileTimeOperations(),
         new P4::SynthesizeActions(&refMap, &typeMap),
         new P4::MoveActionsToTables(&refMap, &typeMap),
+        options.optimize(2) ? new P4::MergeActions(&refMap) : nullptr,
      });
 }
 
 
-MidEnd::MidEnd(CompilerOptions& options) {
+MidEnd::MidEnd(BMV2Options& options) {
     bool isv1 = options.isv1();
     setName("MidEnd");
     refMap.setIsV1(isv1);  // must be done BEFORE creating passes
+    // The same evaluator runs before inlining and at the end, so that its
+    // second run reuses the blocks of the parts of the program left unchanged.
+    auto evaluator = new P4::EvaluatorPass(&refMap, &typeMap);
 #if 0
     if (isv1)
         // TODO: This path should be eventually deprecated
         setup_for_P4_14(options);
     else
 #endif
-        setup_for_P4_16(options);
+        setup_for_P4_16(options, evaluator);
 
     // BMv2-specific passes
-    auto evaluator = new P4::EvaluatorPass(&refMap, &typeMap);
     addPasses({
         new P4::TypeChecking(&refMap, &typeMap),
+        options.removeDeadMetadata ? new RemoveDeadMetadata(&refMap, &typeMap) : nullptr,
+        options.incrementalChecksum ? new IncrementalChecksum(&refMap, &typeMap) : nullptr,
         new P4::SimplifyControlFlow(&refMap, &typeMap),
         new P4::RemoveLeftSlices(&refMap, &typeMap),
         new P4::TypeChecking(&refMap, &typeMap),
         new LowerExpressions(&typeMap),
+        options.flattenExpressions ? new FlattenExpressions(&refMap, &typeMap) : nullptr,
+        options.flattenExpressions ? new P4::TypeChecking(&refMap, &typeMap) : nullptr,
         new P4::ConstantFolding(&refMap, &typeMap, false),
         evaluator,
         new VisitFunctor([this, evaluator]() { toplevel = evaluator->getToplevelBlock(); })
@@ -19,6 +19,7 @@ limitations under the License.
 
 #include "ir/ir.h"
 #include "frontends/common/options.h"
+#include "bmv2options.h"
 #include "frontends/p4/evaluator/evaluator.h"
 #include "midend/actionsInlining.h"
 #include "midend/inlining.h"
@@ -29,7 +30,7 @@ class MidEnd : public PassManager {
 #if 0
     void setup_for_P4_14(CompilerOptions& options);
 #endif
-    void setup_for_P4_16(CompilerOptions& options);
+    void setup_for_P4_16(CompilerOptions& options, P4::EvaluatorPass* evaluator);
     P4::InlineWorkList controlsToInline;
     P4::ActionsInlineList actionsToInline;
 
@@ -39,7 +40,7 @@ class MidEnd : public PassManager {
     P4::TypeMap         typeMap;
     IR::ToplevelBlock   *toplevel = nullptr;  // Should this be const?
 
-    explicit MidEnd(CompilerOptions& options);
+    explicit MidEnd(BMV2Options& options);
     IR::ToplevelBlock* process(const IR::P4Program *&program) {
         program = program->apply(*this);
         return toplevel; }
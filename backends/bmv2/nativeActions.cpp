@@ -0,0 +1,238 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "nativeActions.h"
+#include "lib/map.h"
+#include "lib/stringify.h"
+
+namespace BMV2 {
+
+namespace {
+// The string that a member of a JSON object is, or a null cstring
+cstring getString(const Util::JsonObject* object, cstring label) {
+    auto value = object == nullptr ? nullptr : object->get(label);
+    if (value == nullptr || !value->is<Util::JsonValue>() ||
+        !value->to<Util::JsonValue>()->isString())
+        return nullptr;
+    return value->to<Util::JsonValue>()->getString();
+}
+
+const Util::JsonArray* getArray(const Util::JsonObject* object, cstring label) {
+    auto value = object == nullptr ? nullptr : object->get(label);
+    return value == nullptr ? nullptr : value->to<Util::JsonArray>();
+}
+
+// The methods of bm::Data for the operators of the JSON
+const std::map<cstring, cstring> binaryMethods = {
+    { "+", "add" }, { "-", "sub" }, { "*", "multiply" },
+    { "&", "bit_and" }, { "|", "bit_or" }, { "^", "bit_xor" },
+    { "<<", "shift_left" }, { ">>", "shift_right" }, { "two_comp_mod", "two_comp_mod" },
+};
+}  // namespace
+
+NativeActions::NativeActions(Util::JsonObject* toplevel) : toplevel(toplevel) {
+    std::map<cstring, const Util::JsonArray*> typeFields;
+    if (auto types = getArray(toplevel, "header_types")) {
+        for (auto t : *types) {
+            auto type = t->to<Util::JsonObject>();
+            cstring name = getString(type, "name");
+            auto fields = getArray(type, "fields");
+            if (!name.isNull() && fields != nullptr)
+                typeFields.emplace(name, fields);
+        }
+    }
+    if (auto headers = getArray(toplevel, "headers")) {
+        for (auto h : *headers) {
+            auto header = h->to<Util::JsonObject>();
+            cstring name = getString(header, "name");
+            auto id = header == nullptr ? nullptr : header->get("id");
+            auto fields = ::get(typeFields, getString(header, "header_type"));
+            if (name.isNull() || id == nullptr || !id->is<Util::JsonValue>() ||
+                fields == nullptr)
+                continue;
+            headerIds.emplace(name, id->to<Util::JsonValue>()->getInt());
+            auto& offsets = fieldOffsets[name];
+            int offset = 0;
+            for (auto f : *fields) {
+                auto field = f->to<Util::JsonArray>();
+                if (field != nullptr && !field->empty() && field->at(0)->is<Util::JsonValue>())
+                    offsets.emplace(field->at(0)->to<Util::JsonValue>()->getString(), offset);
+                offset++;
+            }
+        }
+    }
+}
+
+cstring NativeActions::field(const Util::IJson* json) {
+    auto name = json->to<Util::JsonArray>();
+    if (name == nullptr || name->size() != 2)
+        return nullptr;
+    auto header = name->at(0)->to<Util::JsonValue>();
+    auto member = name->at(1)->to<Util::JsonValue>();
+    if (header == nullptr || member == nullptr || !header->isString() || !member->isString())
+        return nullptr;
+    auto id = headerIds.find(header->getString());
+    if (id == headerIds.end())
+        return nullptr;
+    auto& offsets = fieldOffsets[header->getString()];
+    auto offset = offsets.find(member->getString());
+    if (offset == offsets.end())
+        return nullptr;
+    actionArith.emplace(header->getString(), member->getString());
+    return cstring("phv->get_field(") + Util::toString(id->second) + ", " +
+            Util::toString(offset->second) + ")";
+}
+
+cstring NativeActions::expression(const Util::IJson* json, std::stringstream& body) {
+    auto object = json->to<Util::JsonObject>();
+    cstring type = getString(object, "type");
+    auto value = type.isNull() ? nullptr : object->get("value");
+    if (value == nullptr)
+        return nullptr;
+    if (type == "field")
+        return field(value);
+    if (type == "runtime_data") {
+        if (!value->is<Util::JsonValue>() || !value->to<Util::JsonValue>()->isNumber())
+            return nullptr;
+        return cstring("p") + Util::toString(value->to<Util::JsonValue>()->getInt());
+    }
+    if (type == "hexstr") {
+        cstring hex = getString(object, "value");
+        if (hex.isNull() || !hex.startsWith("0x") || hex.size() > 18)
+            return nullptr;
+        cstring name = cstring("t") + Util::toString(temporaries++);
+        body << "        const Data " << name << "(UINT64_C(" << hex << "));\n";
+        return name;
+    }
+    if (type != "expression" || !value->is<Util::JsonObject>())
+        return nullptr;
+
+    auto e = value->to<Util::JsonObject>();
+    cstring op = getString(e, "op");
+    auto left = e->get("left"), right = e->get("right");
+    if (op.isNull() || left == nullptr || right == nullptr)
+        return nullptr;
+    cstring r = expression(right, body);
+    if (r.isNull())
+        return nullptr;
+    cstring name = cstring("t") + Util::toString(temporaries++);
+    if (left->is<Util::JsonValue>() && left->to<Util::JsonValue>()->isNull()) {
+        if (op != "~")
+            return nullptr;
+        body << "        Data " << name << ";\n";
+        body << "        " << name << ".bit_neg(" << r << ");\n";
+        return name;
+    }
+    auto method = binaryMethods.find(op);
+    cstring l = method == binaryMethods.end() ? cstring() : expression(left, body);
+    if (l.isNull())
+        return nullptr;
+    body << "        Data " << name << ";\n";
+    body << "        " << name << "." << method->second << "(" << l << ", " << r << ");\n";
+    return name;
+}
+
+bool NativeActions::action(Util::JsonObject* action, std::ostream& out) {
+    auto params = getArray(action, "runtime_data");
+    auto primitives = getArray(action, "primitives");
+    auto id = action->get("id");
+    if (params == nullptr || primitives == nullptr || primitives->empty() ||
+        id == nullptr || !id->is<Util::JsonValue>())
+        return false;
+
+    std::stringstream body;
+    temporaries = 0;
+    actionArith.clear();
+    for (auto p : *primitives) {
+        auto primitive = p->to<Util::JsonObject>();
+        auto parameters = getArray(primitive, "parameters");
+        if (getString(primitive, "op") != "modify_field" || parameters == nullptr ||
+            parameters->size() != 2)
+            return false;
+        auto left = parameters->at(0)->to<Util::JsonObject>();
+        if (getString(left, "type") != "field")
+            return false;
+        cstring dest = field(left->get("value"));
+        cstring source = expression(parameters->at(1), body);
+        if (dest.isNull() || source.isNull())
+            return false;
+        body << "        " << dest << ".set(" << source << ");\n";
+    }
+
+    cstring name = cstring("p4c_native_") + Util::toString(id->to<Util::JsonValue>()->getInt());
+    std::stringstream types, args;
+    for (size_t i = 0; i < params->size(); i++) {
+        types << (i == 0 ? "" : ", ") << "const Data &";
+        args << (i == 0 ? "" : ", ") << "const Data &p" << i;
+    }
+    out << "// " << getString(action, "name") << "\n"
+        << "class " << name << " : public ActionPrimitive<" << types.str() << "> {\n"
+        << "    void operator ()(" << args.str() << ") {\n"
+        << "        PHV *phv = get_packet().get_phv();\n"
+        << body.str()
+        << "    }\n"
+        << "};\n\n"
+        << "REGISTER_PRIMITIVE_W_NAME(" << name << ", " << name << ");\n\n";
+
+    auto call = new Util::JsonObject();
+    call->emplace("op", name);
+    auto callParams = new Util::JsonArray();
+    for (size_t i = 0; i < params->size(); i++) {
+        auto param = new Util::JsonObject();
+        param->emplace("type", "runtime_data");
+        param->emplace("value", static_cast<unsigned>(i));
+        callParams->append(param);
+    }
+    call->emplace("parameters", callParams);
+    auto replacement = new Util::JsonArray();
+    replacement->append(call);
+    (*action)["primitives"] = replacement;
+    arith.insert(actionArith.begin(), actionArith.end());
+    return true;
+}
+
+unsigned NativeActions::emit(std::ostream& out) {
+    out << "// The actions of " << getString(toplevel, "program") << " as primitives for\n"
+        << "// simple_switch --load-modules; generated by p4c-bm2-ss --nativeActions\n\n"
+        << "#include <bm/bm_sim/actions.h>\n\n"
+        << "using bm::ActionPrimitive;\n"
+        << "using bm::Data;\n"
+        << "using bm::PHV;\n\n";
+
+    unsigned count = 0;
+    auto actions = toplevel->get("actions");
+    if (actions != nullptr && actions->is<Util::JsonArray>()) {
+        for (auto a : *actions->to<Util::JsonArray>()) {
+            if (a->is<Util::JsonObject>() && action(a->to<Util::JsonObject>(), out))
+                count++;
+        }
+    }
+
+    // A field that no expression of the JSON uses would not be a number in the switch
+    auto force = toplevel->get("force_arith");
+    if (force != nullptr && force->is<Util::JsonArray>()) {
+        auto forceArray = force->to<Util::JsonArray>();
+        for (auto& f : arith) {
+            auto pair = new Util::JsonArray();
+            pair->append(f.first);
+            pair->append(f.second);
+            forceArray->append(pair);
+        }
+    }
+    return count;
+}
+
+}  // namespace BMV2
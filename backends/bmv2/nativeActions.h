@@ -0,0 +1,65 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_BMV2_NATIVEACTIONS_H_
+#define _BACKENDS_BMV2_NATIVEACTIONS_H_
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
+
+#include "lib/cstring.h"
+#include "lib/json.h"
+
+namespace BMV2 {
+
+// With --nativeActions, the actions of the JSON are written as C++ primitives for
+// the switch to load (simple_switch --load-modules), and the primitives of each
+// action are replaced by one call of its native primitive, with the parameters of
+// the action.  An action is made native when all its primitives are modify_field
+// of arithmetic expressions (+, -, *, &, |, ^, ~, <<, >>) of fields, parameters and
+// constants of up to 64 bits; the field of each header is found by its index in
+// the PHV, which the JSON fixes, rather than by name, and each operation is a call
+// of what the switch would call to interpret it.  The other actions stay as they
+// are.  The JSON is still what the switch loads, for everything but those actions.
+class NativeActions {
+    Util::JsonObject* toplevel;
+    // the ids of the header instances, and the offsets of their fields
+    std::map<cstring, int> headerIds;
+    std::map<cstring, std::map<cstring, int>> fieldOffsets;
+    // the fields that native actions use, which the switch must keep as numbers
+    std::set<std::pair<cstring, cstring>> arith, actionArith;
+    unsigned temporaries = 0;
+
+    // The C++ for a field of the JSON, or a null cstring
+    cstring field(const Util::IJson* json);
+    // The C++ for the value of an expression of the JSON, computed by the code added
+    // to body; a null cstring if something in it is not translated
+    cstring expression(const Util::IJson* json, std::stringstream& body);
+    // Writes the primitive of an action, if it can be made native, and replaces its
+    // primitives in the JSON
+    bool action(Util::JsonObject* action, std::ostream& out);
+
+ public:
+    explicit NativeActions(Util::JsonObject* toplevel);
+    // Writes the C++ to out; the number of actions made native
+    unsigned emit(std::ostream& out);
+};
+
+}  // namespace BMV2
+
+#endif /* _BACKENDS_BMV2_NATIVEACTIONS_H_ */
@@ -32,6 +32,10 @@ import time
 import random
 import errno
 from string import maketrans
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools"))
+import compile_perf
+
 try:
     from scapy.layers.all import *
     from scapy.utils import *
@@ -53,6 +57,9 @@ class Options(object):
         self.compilerOptions = []
         self.hasBMv2 = False            # Is the behavioral model installed?
         self.runDebugger = False
+        self.perfDir = None             # directory for compile time records
+        self.throughput = 0             # packets to send in throughput mode
+        self.rate = 0                   # packets per second to send them at
         self.observationLog = None           # Log packets produced by the BMV2 model if path to log is supplied
 
 def nextWord(text, sep = " "):
@@ -110,6 +117,10 @@ def usage(options):
     print("          -v: verbose operation")
     print("          -f: replace reference outputs with newly generated ones")
     print("          -observation-log <file>: save packet output to <file>")
+    print("          -perf <dir>: record the compile time and memory in <dir>")
+    print("          -throughput <count>: send the stf packets <count> times and report")
+    print("                               the throughput and latency of the model")
+    print("          -rate <pps>: send them at this rate rather than all at once")
 
 def ByteToHex(byteStr):
     return ''.join( [ "%02X " % ord( x ) for x in byteStr ] ).strip()
@@ -288,7 +299,14 @@ def process_file(options, argv):
     if options.runDebugger:
         args[0:0] = options.runDebugger.split()
         os.execvp(args[0], args)
+    if options.perfDir:
+        args[1:1] = compile_perf.capture_args(options.perfDir, "bmv2",
+                                              options.compilerSrcDir, options.p4filename)
+    start = time.time()
     result = run_timeout(options, args, timeout, stderr)
+    if options.perfDir:
+        compile_perf.record(options.perfDir, "bmv2", options.compilerSrcDir,
+                            options.p4filename, time.time() - start)
     if result != SUCCESS:
         print("Error compiling")
         print("".join(open(stderr).readlines()))
@@ -352,6 +370,23 @@ def main(argv):
             options.compilerOptions.append(argv[0])
         elif argv[0] == "-gdb":
             options.runDebugger = "gdb --args"
+        elif argv[0] == "-perf":
+            if len(argv) == 1:
+                reportError("Missing argument for -perf option")
+                usage(options)
+                sys.exit(1)
+            options.perfDir = argv[1]
+            argv = argv[1:]
+        elif argv[0] == '-throughput' or argv[0] == '-rate':
+            if len(argv) == 1:
+                reportError("Missing argument for", argv[0], "option")
+                usage(options)
+                sys.exit(1)
+            if argv[0] == '-throughput':
+                options.throughput = int(argv[1])
+            else:
+                options.rate = float(argv[1])
+            argv = argv[1:]
         elif argv[0] == '-observation-log':
             if len(argv) == 0:
                 reportError("Missing argument for -observation-log option")
@@ -369,6 +404,8 @@ def main(argv):
             usage(options)
         argv = argv[1:]
 
+    options.perfDir = compile_perf.perf_dir(options.perfDir)
+
     config = ConfigH("config.h")
     if not config.ok:
         print("Error parsing config.h")
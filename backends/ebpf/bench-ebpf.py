@@ -0,0 +1,252 @@
+#!/usr/bin/env python
+# Copyright 2013-present Barefoot Networks, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures the packet processing cost of the EBPF programs generated for
+# sample P4 programs.  Each sample is compiled with p4c-ebpf for the bcc
+# target, loaded by bcc as a TC classifier, and run on each packet through
+# BPF_PROG_TEST_RUN, which runs the program a given number of times on a
+# packet and returns the average time of a run.  Reports, for each sample,
+# the number of EBPF instructions and the time per packet.  Needs bcc, root
+# and Linux 4.12 or newer.
+
+from __future__ import print_function
+import ctypes
+import json
+import os
+import platform
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+SUCCESS = 0
+FAILURE = 1
+
+BPF_PROG_TEST_RUN = 10
+BPF_SYSCALL = {"x86_64": 321, "aarch64": 280, "armv7l": 386, "ppc64le": 361, "s390x": 351}
+
+class Options(object):
+    def __init__(self):
+        self.binary = ""                # this program's name
+        self.cleanupTmp = True          # if false do not remove tmp folder created
+        self.compilerSrcDir = ""        # path to compiler source tree
+        self.verbose = False
+        self.repeat = 100000            # runs of the program on each packet
+        self.pcap = None                # packets to run the programs on
+        self.output = None              # file for the results as JSON
+        self.compilerOptions = []
+
+def usage(options):
+    name = options.binary
+    print(name, "usage:")
+    print(name, "rootdir [options] file.p4 ...")
+    print("Compiles each file with p4c-ebpf and measures the time the program takes per packet")
+    print("`rootdir` is the root directory of the compiler source tree")
+    print("options:")
+    print("          -b: do not remove temporary results")
+    print("          -v: verbose operation")
+    print("          -r count: run the program count times on each packet (default 100000)")
+    print("          -pcap file: run on the packets of file (default: synthetic TCP/IPv4)")
+    print("          -o file: write the results as JSON to file")
+    print("          -a \"args\": pass args to the compiler")
+
+######################### packets
+
+def checksum(data):
+    if len(data) % 2:
+        data += b"\0"
+    total = sum(struct.unpack("!%dH" % (len(data) // 2), data))
+    while total >> 16:
+        total = (total & 0xffff) + (total >> 16)
+    return ~total & 0xffff
+
+def synthetic_packets():
+    """TCP/IPv4 packets of a few sizes and addresses"""
+    packets = []
+    for size, host in [(64, 1), (64, 2), (512, 3), (1500, 4)]:
+        ethernet = struct.pack("!6s6sH", b"\x00\x01\x02\x03\x04\x05",
+                               b"\x00\x0a\x0b\x0c\x0d\x0e", 0x0800)
+        tcp = struct.pack("!HHIIBBHHH", 1024 + host, 80, host, 0, 5 << 4, 0x10, 8192, 0, 0)
+        payload = b"\0" * (size - len(ethernet) - 20 - len(tcp))
+        length = 20 + len(tcp) + len(payload)
+        ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, length, host, 0, 64, 6, 0,
+                         b"\x0a\x00\x00" + struct.pack("B", host), b"\x0a\x00\x01\x01")
+        ip = ip[:10] + struct.pack("!H", checksum(ip)) + ip[12:]
+        packets.append(ethernet + ip + tcp + payload)
+    return packets
+
+def read_pcap(filename):
+    with open(filename, "rb") as pcap:
+        data = pcap.read()
+    if len(data) < 24:
+        return []
+    magic = struct.unpack("<I", data[:4])[0]
+    if magic in (0xa1b2c3d4, 0xa1b23c4d):
+        order = "<"
+    elif magic in (0xd4c3b2a1, 0x4d3cb2a1):
+        order = ">"
+    else:
+        raise Exception(filename + " is not a pcap file")
+    packets = []
+    offset = 24
+    while offset + 16 <= len(data):
+        length = struct.unpack(order + "IIII", data[offset:offset + 16])[2]
+        offset += 16
+        packets.append(data[offset:offset + length])
+        offset += length
+    return packets
+
+######################### running
+
+class TestRunAttr(ctypes.Structure):
+    # the test member of union bpf_attr
+    _fields_ = [("prog_fd", ctypes.c_uint32),
+                ("retval", ctypes.c_uint32),
+                ("data_size_in", ctypes.c_uint32),
+                ("data_size_out", ctypes.c_uint32),
+                ("data_in", ctypes.c_uint64),
+                ("data_out", ctypes.c_uint64),
+                ("repeat", ctypes.c_uint32),
+                ("duration", ctypes.c_uint32)]
+
+libc = ctypes.CDLL(None, use_errno=True)
+
+def test_run(fd, packet, repeat):
+    """Runs program fd repeat times on packet; returns the average ns per run"""
+    data_in = ctypes.create_string_buffer(packet, len(packet))
+    data_out = ctypes.create_string_buffer(len(packet) + 256)
+    attr = TestRunAttr(prog_fd=fd, data_size_in=len(packet), data_size_out=len(data_out),
+                       data_in=ctypes.addressof(data_in), data_out=ctypes.addressof(data_out),
+                       repeat=repeat)
+    if libc.syscall(BPF_SYSCALL[platform.machine()], BPF_PROG_TEST_RUN,
+                    ctypes.byref(attr), ctypes.sizeof(attr)) != 0:
+        error = ctypes.get_errno()
+        raise OSError(error, "BPF_PROG_TEST_RUN: " + os.strerror(error))
+    return attr.duration
+
+def measure(options, cfile, packets):
+    from bcc import BPF
+    source = open(cfile).read()
+    bpf = BPF(text=source)
+    main = bpf.load_func("ebpf_filter", BPF.SCHED_CLS)
+    instructions = len(bpf.dump_func("ebpf_filter")) // 8
+    # the stages of a program split by --maxInstructions
+    stages = sorted(set(int(k) for k in re.findall(r"ebpf_filter_stage(\d+)", source)))
+    for k in stages:
+        name = "ebpf_filter_stage%d" % k
+        fn = bpf.load_func(name, BPF.SCHED_CLS)
+        bpf.get_table("ebpf_stages")[ctypes.c_int(k)] = ctypes.c_int(fn.fd)
+        instructions += len(bpf.dump_func(name)) // 8
+    times = [test_run(main.fd, packet, options.repeat) for packet in packets]
+    bpf.cleanup()
+    return {"instructions": instructions, "stages": len(stages) + 1,
+            "ns_per_packet": float(sum(times)) / len(times),
+            "ns_per_packet_max": max(times)}
+
+def process_file(options, p4filename, packets):
+    tmpdir = tempfile.mkdtemp(dir=".")
+    base = os.path.splitext(os.path.basename(p4filename))[0]
+    cfile = tmpdir + "/" + base + ".c"
+    args = ["./p4c-ebpf", "--target", "bcc", "-o", cfile] + options.compilerOptions + \
+           [p4filename]
+    if options.verbose:
+        print(" ".join(args))
+    result = None
+    if subprocess.call(args) != 0:
+        print("Error compiling", p4filename, file=sys.stderr)
+    else:
+        try:
+            result = measure(options, cfile, packets)
+            result["sample"] = p4filename
+        except Exception as e:
+            print("Error running", p4filename + ":", e, file=sys.stderr)
+    if options.cleanupTmp:
+        shutil.rmtree(tmpdir)
+    elif options.verbose:
+        print("Keeping", tmpdir)
+    return result
+
+######################### main
+
+def main(argv):
+    options = Options()
+
+    options.binary = argv[0]
+    if len(argv) <= 2:
+        usage(options)
+        return FAILURE
+
+    options.compilerSrcDir = argv[1]
+    argv = argv[2:]
+    if not os.path.isdir(options.compilerSrcDir):
+        print(options.compilerSrcDir + " is not a folder", file=sys.stderr)
+        usage(options)
+        return FAILURE
+
+    while argv and argv[0][0] == '-':
+        if argv[0] == "-b":
+            options.cleanupTmp = False
+        elif argv[0] == "-v":
+            options.verbose = True
+        elif argv[0] in ("-r", "-pcap", "-o", "-a"):
+            if len(argv) == 1:
+                print("Missing argument for", argv[0], "option", file=sys.stderr)
+                usage(options)
+                return FAILURE
+            if argv[0] == "-r":
+                options.repeat = int(argv[1])
+            elif argv[0] == "-pcap":
+                options.pcap = argv[1]
+            elif argv[0] == "-o":
+                options.output = argv[1]
+            else:
+                options.compilerOptions += argv[1].split()
+            argv = argv[1:]
+        else:
+            print("Unknown option ", argv[0], file=sys.stderr)
+            usage(options)
+            return FAILURE
+        argv = argv[1:]
+
+    if platform.machine() not in BPF_SYSCALL:
+        print("Unknown bpf system call number on", platform.machine(), file=sys.stderr)
+        return FAILURE
+    packets = read_pcap(options.pcap) if options.pcap else []
+    if not packets:
+        packets = synthetic_packets()
+
+    results = []
+    status = SUCCESS
+    for p4filename in argv:
+        result = process_file(options, p4filename, packets)
+        if result is None:
+            status = FAILURE
+            continue
+        results.append(result)
+        print("%-50s %6d instructions %3d stages %9.1f ns/packet" %
+              (os.path.basename(p4filename), result["instructions"], result["stages"],
+               result["ns_per_packet"]))
+
+    if options.output:
+        with open(options.output, "w") as out:
+            json.dump({"repeat": options.repeat, "packets": len(packets),
+                       "samples": results}, out, indent=2, sort_keys=True)
+            out.write("\n")
+    return status
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
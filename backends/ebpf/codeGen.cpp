@@ -48,6 +48,21 @@ bool CodeGenInspector::preorder(const IR::Operation_Binary* b) {
     return false;
 }
 
+// unsigned values are zero-extended, so the right operand can be or-ed in
+bool CodeGenInspector::preorder(const IR::Concat* c) {
+    auto width = typeMap->getType(c, true)->width_bits();
+    if (width > 64) {
+        ::error("%1%: concatenations of more than 64 bits are not supported", c);
+        return false;
+    }
+    builder->append("(((u64)");
+    visit(c->left);
+    builder->appendFormat(" << %d) | ", typeMap->getType(c->right, true)->width_bits());
+    visit(c->right);
+    builder->append(")");
+    return false;
+}
+
 bool CodeGenInspector::comparison(const IR::Operation_Relation* b) {
     auto type = typeMap->getType(b->left);
     auto et = EBPFTypeFactory::instance->create(type);
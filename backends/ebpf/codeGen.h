@@ -28,6 +28,8 @@ class CodeBuilder : public Util::SourceCodeBuilder {
  public:
     const Target* target;
     explicit CodeBuilder(const Target* target) : target(target) {}
+    CodeBuilder(const Target* target, std::ostream* stream) :
+            Util::SourceCodeBuilder(stream), target(target) {}
 };
 
 // Visitor for generating C for EBPF
@@ -48,6 +50,7 @@ class CodeGenInspector : public Inspector {
     bool preorder(const IR::BoolLiteral* b) override;
     bool preorder(const IR::Cast* c) override;
     bool preorder(const IR::Operation_Binary* b) override;
+    bool preorder(const IR::Concat* c) override;
     bool preorder(const IR::Operation_Unary* u) override;
     bool preorder(const IR::ArrayIndex* a) override;
     bool preorder(const IR::Mux* a) override;
@@ -19,6 +19,9 @@ limitations under the License.
 #include "frontends/p4/evaluator/evaluator.h"
 
 #include "ebpfBackend.h"
+#include "ebpfBudget.h"
+#include "ebpfBytecode.h"
+#include "ebpfControl.h"
 #include "target.h"
 #include "ebpfType.h"
 
@@ -39,27 +42,72 @@ void run_ebpf_backend(const EbpfOptions& options, const IR::ToplevelBlock* tople
 
     Target* target;
     if (options.target.isNullOrEmpty() || options.target == "bcc") {
-        target = new BccTarget();
+        target = new BccTarget(options.directPacketAccess);
     } else if (options.target == "kernel") {
+        if (options.directPacketAccess) {
+            ::error("--directPacketAccess is not available to socket filters (target kernel)");
+            return;
+        }
         target = new KernelSamplesTarget();
+    } else if (options.target == "xdp") {
+        target = new XdpTarget();
     } else {
-        ::error("Unknown target %s; legal choices are 'bcc' and 'kernel'", options.target);
+        ::error("Unknown target %s; legal choices are 'bcc', 'kernel' and 'xdp'", options.target);
+        return;
+    }
+    if (options.emitObject && options.target != "kernel") {
+        ::error("--emitObject is only available for target kernel");
         return;
     }
     auto ebpfprog = new EBPFProgram(toplevel->getProgram(), refMap, typeMap, toplevel);
+    ebpfprog->tableStats = options.tableStats;
+    ebpfprog->tableTime = options.tableTime;
+    ebpfprog->validityMask = options.validityMask;
+    ebpfprog->parseOnlyNeeded = options.parseOnlyNeeded;
+    ebpfprog->flowCacheSize = options.flowCache;
+    if (options.flowCache != 0 && options.emitObject) {
+        ::error("--flowCache is not supported with --emitObject");
+        return;
+    }
     if (!ebpfprog->build())
         return;
+    EBPFBudget budget(ebpfprog, target, options.maxInstructions);
+    budget.check();
+    if (ebpfprog->flowCache != nullptr && ebpfprog->control->stages.size() > 1) {
+        ::error("--flowCache is not supported when the control is split into stages");
+        return;
+    }
 
     if (options.outputFile.isNullOrEmpty())
         return;
-    auto stream = openFile(options.outputFile, false);
-    if (stream == nullptr)
-        return;
+    if (options.emitObject) {
+        ElfObject object;
+        EBPFBytecode bytecode(ebpfprog);
+        if (!bytecode.build(&object))
+            return;
+        auto stream = openFile(options.outputFile, false);
+        if (stream == nullptr)
+            return;
+        object.write(*stream);
+        stream->flush();
+    } else {
+        auto stream = openFile(options.outputFile, false);
+        if (stream == nullptr)
+            return;
+        CodeBuilder builder(target, stream);
+        ebpfprog->emit(&builder);
+        builder.flush();
+    }
 
-    CodeBuilder builder(target);
-    ebpfprog->emit(&builder);
-    *stream << builder.toString();
-    stream->flush();
+    // the tables have reported their errors already
+    if (options.controlPlaneFile.isNullOrEmpty() || ::errorCount() > 0)
+        return;
+    auto cpStream = openFile(options.controlPlaneFile, false);
+    if (cpStream == nullptr)
+        return;
+    CodeBuilder cpBuilder(target, cpStream);
+    ebpfprog->emitControlPlane(&cpBuilder);
+    cpBuilder.flush();
 }
 
 }  // namespace EBPF
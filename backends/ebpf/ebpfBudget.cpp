@@ -0,0 +1,265 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <utility>
+
+#include "ebpfBudget.h"
+#include "ebpfControl.h"
+#include "ebpfFlowCache.h"
+#include "ebpfParser.h"
+#include "ebpfTable.h"
+#include "frontends/p4/coreLibrary.h"
+#include "frontends/p4/methodInstance.h"
+#include "lib/log.h"
+
+namespace EBPF {
+
+namespace {
+// Rough numbers of eBPF instructions in the code generated for each construct
+const unsigned headerCheck = 5;   // the check of the packet length before a header
+const unsigned fieldLoad = 4;     // a load_ helper call, a shift, a mask and a store
+const unsigned wordLoad = 3;      // a direct load of a word, and its byte swap
+const unsigned fieldCut = 3;      // a shift, a mask and a store
+const unsigned mapLookup = 6;     // the map and key pointers, the call and the test
+const unsigned mapUpdate = 7;
+const unsigned operation = 2;     // an operation, and a load or a store
+// the locals of a stage after the first, copying its state in and out, and the tail call
+const unsigned stageCost = 20 + 2 * mapLookup + 10;
+// the kernel runs at most 33 programs for a packet: the first one, and 32 tail calls
+const unsigned maxStages = 33;
+
+// Counts the instructions of the code generated for parser states and control
+// bodies; the tables and counters that they apply take stack for their keys too.
+class InstructionCounter : public Inspector {
+    EBPFBudget*         budget;
+    const EBPFProgram*  program;
+    const Target*       target;
+
+    unsigned extractCost(const IR::Type_Header* header) const;
+
+ public:
+    unsigned count = 0;
+
+    InstructionCounter(EBPFBudget* budget, const EBPFProgram* program, const Target* target) :
+            budget(budget), program(program), target(target) {}
+    bool preorder(const IR::Expression*) override { count += operation; return true; }
+    bool preorder(const IR::SelectCase*) override { count += operation; return true; }
+    bool preorder(const IR::MethodCallExpression* expression) override;
+};
+
+unsigned InstructionCounter::extractCost(const IR::Type_Header* header) const {
+    unsigned cost = headerCheck + 2 * operation;  // and the valid bit and the offset
+    if (target->directPacketAccess())
+        cost += ROUNDUP(header->width_bits(), 64) * wordLoad;
+    for (auto f : *header->fields) {
+        unsigned width = f->type->width_bits();
+        unsigned pieces = EBPFScalarType::generatesScalar(width) ? 1 : ROUNDUP(width, 8);
+        cost += pieces * (target->directPacketAccess() ? fieldCut : fieldLoad);
+    }
+    return cost;
+}
+
+bool InstructionCounter::preorder(const IR::MethodCallExpression* expression) {
+    auto mi = P4::MethodInstance::resolve(expression, program->refMap, program->typeMap);
+    if (auto em = mi->to<P4::ExternMethod>()) {
+        if (em->method->name.name == P4::P4CoreLibrary::instance.packetIn.extract.name &&
+            expression->arguments->size() == 1) {
+            auto type = program->typeMap->getType(expression->arguments->at(0));
+            if (auto header = type->to<IR::Type_Header>()) {
+                count += extractCost(header);
+                return false;
+            }
+        } else if (em->method->name.name == program->model.counterArray.increment.name) {
+            visit(expression->arguments);
+            count += mapLookup + mapUpdate + 2 * operation;
+            // the index, the value pointer and the initial value
+            budget->addStack(cstring("counter ") + em->object->getName().name, 16);
+            return false;
+        }
+    } else if (auto am = mi->to<P4::ApplyMethod>()) {
+        if (am->isTableApply()) {
+            auto table = program->control->getTable(am->object->getName().name);
+            budget->addCode(cstring("table ") + table->dataMapName, budget->tableCost(table));
+            return false;
+        }
+    } else if (auto ac = mi->to<P4::ActionCall>()) {
+        visit(ac->action->body);
+        return false;
+    }
+    count += operation;
+    return true;
+}
+}  // namespace
+
+unsigned EBPFBudget::tableCost(const EBPFTable* table) {
+    unsigned cost = 0;
+    unsigned keyBytes = 4;  // a prefix length or mask number, if any
+    unsigned fields = 0;
+    auto keys = table->keyGenerator != nullptr ? table->keyGenerator->keyElements : nullptr;
+    for (auto c : keys != nullptr ? *keys : IR::Vector<IR::KeyElement>()) {
+        InstructionCounter key(this, program, target);
+        c->expression->apply(key);
+        cost += key.count + operation;
+        auto type = EBPFTypeFactory::instance->create(program->typeMap->getType(c->expression));
+        keyBytes += type->sizeInBytes();
+        fields++;
+    }
+
+    cost += mapLookup;
+    unsigned stack = keyBytes + 8;  // the key and the value pointer
+    if (table->lookup == EBPFTable::Lookup::Ternary) {
+        cost += table->masks * (2 * mapLookup + fields * fieldCut + 2 * operation);
+        stack += keyBytes + 2 * 8 + 4;  // the masked key, two pointers and the mask number
+    } else if (table->lookup == EBPFTable::Lookup::Direct) {
+        cost += 2 * operation;  // the test of the action of the entry
+    }
+
+    // the default action, and then all the actions of the table
+    cost += mapLookup + 2 * operation;
+    // a hit or a miss, and an action; and the time
+    if (program->tableStats)
+        cost += 2 * (mapLookup + 2 * operation);
+    if (program->tableTime)
+        cost += mapLookup + 4 * operation;
+    unsigned valueBytes = 0;
+    for (auto a : *table->actionList->actionList) {
+        auto adecl = program->refMap->getDeclaration(a->getPath(), true);
+        auto action = adecl->getNode()->to<IR::P4Action>();
+        InstructionCounter body(this, program, target);
+        action->body->apply(body);
+        cost += body.count + operation;
+        unsigned params = 0;
+        for (auto p : *action->parameters->getEnumerator())
+            params += EBPFTypeFactory::instance->create(p->type)->sizeInBytes();
+        valueBytes = std::max(valueBytes, params + 8);  // and the action and priority
+    }
+    if (table->constDefaultAction != nullptr)
+        stack += valueBytes;
+    addStack(cstring("table ") + table->dataMapName, stack);
+    return cost;
+}
+
+void EBPFBudget::addStack(cstring user, unsigned bytes) {
+    stack += bytes;
+    stackUsers[user] += bytes;
+}
+
+void EBPFBudget::addCode(cstring user, unsigned count) {
+    instructions += count;
+    codeUsers[user] += count;
+}
+
+static std::pair<cstring, unsigned> largest(const std::map<cstring, unsigned>& users) {
+    std::pair<cstring, unsigned> result("", 0);
+    for (auto u : users)
+        if (u.second > result.second)
+            result = u;
+    return result;
+}
+
+unsigned EBPFBudget::split(unsigned firstStage) {
+    auto control = program->control;
+    auto body = control->controlBlock->container->body;
+    // the first stage also runs the parser
+    std::vector<unsigned> costs(1, firstStage);
+    std::vector<const IR::BlockStatement*> stages;
+    auto components = new IR::IndexedVector<IR::StatOrDecl>();
+    for (auto c : *body->components) {
+        if (c->is<IR::Declaration>())
+            // a stage cannot see the declarations of the previous ones
+            return instructions;
+        // counted again, without adding to the estimate of the whole program
+        EBPFBudget scratch(program, target, maxInstructions);
+        InstructionCounter counter(&scratch, program, target);
+        c->apply(counter);
+        unsigned cost = counter.count + scratch.instructions;
+        if (!components->empty() && costs.back() + cost > maxInstructions) {
+            stages.push_back(new IR::BlockStatement(body->srcInfo, IR::Annotations::empty,
+                                                    components));
+            components = new IR::IndexedVector<IR::StatOrDecl>();
+            costs.push_back(stageCost);
+        }
+        components->push_back(c);
+        costs.back() += cost;
+    }
+    stages.push_back(new IR::BlockStatement(body->srcInfo, IR::Annotations::empty,
+                                            components));
+    control->setStages(stages);
+    LOG1("Control split into " << stages.size() << " stages");
+    return *std::max_element(costs.begin(), costs.end());
+}
+
+void EBPFBudget::check() {
+    auto parser = program->parser;
+    auto control = program->control;
+
+    addStack(cstring("headers ") + parser->headers->name.name, parser->headerType->sizeInBytes());
+    // the packet offset, the error code, the packet pointers, accept, the zero key,
+    // hit and the pointer to the default actions
+    addStack("the local variables", 4 + 4 + 2 * 8 + 1 + 4 + 1 + 8);
+    for (auto d : *control->controlBlock->container->controlLocals) {
+        if (auto v = d->to<IR::Declaration_Variable>())
+            addStack(cstring("variable ") + v->name.name,
+                     EBPFTypeFactory::instance->create(v->type)->sizeInBytes());
+    }
+    // the initialization of the headers and the locals, and the return
+    addCode("the filter function", 20);
+    if (auto cache = program->flowCache) {
+        // the key, the verdict to record and two pointers; the key is written with a
+        // load and a store for each field
+        addStack("the flow cache", cache->keySize() + 8 + 2 * 8);
+        addCode("the flow cache", 2 * mapLookup + mapUpdate + 10 * operation +
+                2 * operation * cache->fieldCount());
+    }
+
+    for (auto s : parser->states) {
+        InstructionCounter counter(this, program, target);
+        s->state->apply(counter);
+        addCode(cstring("parser state ") + s->state->name.name, counter.count + 1);
+    }
+    unsigned firstStage = instructions;
+    InstructionCounter counter(this, program, target);
+    control->controlBlock->container->body->apply(counter);
+    addCode(cstring("control ") + control->controlBlock->container->name.name, counter.count);
+
+    LOG1("eBPF program estimate: " << stack << " bytes of stack, " <<
+         instructions << " instructions");
+    if (instructions > maxInstructions) {
+        unsigned largestStage = split(firstStage);
+        if (largestStage <= maxInstructions)
+            codeUsers.clear();
+        else
+            instructions = largestStage;
+    }
+    if (stack > maxStack) {
+        auto most = largest(stackUsers);
+        ::warning("The generated program may need up to %1% bytes of stack, more than the "
+                  "%2% that the kernel verifier allows; %3% takes %4%",
+                  stack, maxStack, most.first, most.second);
+    }
+    if (control->stages.size() > maxStages)
+        ::warning("The control is split into %1% programs, more than the %2% that the "
+                  "kernel runs for a packet", control->stages.size(), maxStages);
+    if (!codeUsers.empty() && instructions > maxInstructions) {
+        auto most = largest(codeUsers);
+        ::warning("The generated program may have up to %1% instructions, more than the "
+                  "%2% that the kernel verifier allows (see --maxInstructions); %3% "
+                  "takes %4%", instructions, maxInstructions, most.first, most.second);
+    }
+}
+
+}  // namespace EBPF
@@ -0,0 +1,64 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_EBPF_EBPFBUDGET_H_
+#define _BACKENDS_EBPF_EBPFBUDGET_H_
+
+#include <map>
+#include "ebpfObject.h"
+#include "ebpfType.h"
+
+namespace EBPF {
+
+// Estimates, from the object model and before any C is generated, whether the program
+// fits in what the kernel verifier accepts: 512 bytes of stack, and a number of
+// instructions (4096 for unprivileged programs, and for all programs before Linux 5.2).
+// Both are upper bounds: locals of different blocks count as if they were all live
+// at once, and the instruction count is that of the whole program, which is more
+// than any one packet goes through.  Programs over either limit get a warning that
+// says where most of the budget goes.  A control with too many instructions is split
+// between its top-level statements into stages, which tail-call each other.
+class EBPFBudget {
+    const EBPFProgram*  program;
+    const Target*       target;
+
+ public:
+    static const unsigned maxStack = 512;
+    unsigned    maxInstructions;
+    unsigned    stack = 0;          // bytes
+    unsigned    instructions = 0;
+    // what each part of the program takes, to say in the warnings which part takes most
+    std::map<cstring, unsigned> stackUsers;
+    std::map<cstring, unsigned> codeUsers;
+
+    EBPFBudget(const EBPFProgram* program, const Target* target, unsigned maxInstructions) :
+            program(program), target(target), maxInstructions(maxInstructions) {}
+    // Estimates the stack and the instructions, and warns when they are over the limits
+    void check();
+    // Splits the control into stages that each fit in maxInstructions if possible, given
+    // the instructions of the parser; returns the instructions of the largest stage
+    unsigned split(unsigned firstStage);
+
+    // The instructions of an apply of this table; its key and value take stack too
+    unsigned tableCost(const EBPFTable* table);
+
+    void addStack(cstring user, unsigned bytes);
+    void addCode(cstring user, unsigned count);
+};
+
+}  // namespace EBPF
+
+#endif /* _BACKENDS_EBPF_EBPFBUDGET_H_ */
@@ -0,0 +1,1193 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <limits.h>
+#include <algorithm>
+
+#include "ebpfBytecode.h"
+#include "ebpfBudget.h"
+#include "ebpfControl.h"
+#include "ebpfParser.h"
+#include "ebpfType.h"
+#include "frontends/p4/coreLibrary.h"
+#include "frontends/p4/methodInstance.h"
+#include "frontends/p4/tableApply.h"
+
+namespace EBPF {
+
+namespace {
+// The encodings of <linux/bpf.h>
+enum : uint8_t {
+    LD = 0x00, LDX = 0x01, ST = 0x02, STX = 0x03, ALU = 0x04, JMP = 0x05, ALU64 = 0x07,
+    W = 0x00, H = 0x08, B = 0x10, DW = 0x18,
+    IMM = 0x00, IND = 0x40, MEM = 0x60,
+    K = 0x00, X = 0x08,
+    ADD = 0x00, SUB = 0x10, MUL = 0x20, OR = 0x40, AND = 0x50, LSH = 0x60, RSH = 0x70,
+    NEG = 0x80, XOR = 0xa0, MOV = 0xb0,
+    // JLT and JLE need Linux 4.14
+    JA = 0x00, JEQ = 0x10, JGT = 0x20, JGE = 0x30, JNE = 0x50, JLT = 0xa0, JLE = 0xb0,
+    CALL = 0x80, EXIT = 0x90,
+};
+enum { R0, R1, R2, R3, R4, R5, R6, R7, R8, R9, R10 };
+const int32_t mapLookupElem = 1;  // BPF_FUNC_map_lookup_elem
+// KernelSamplesTarget::forwardReturnCode and dropReturnCode
+const int32_t forwardCode = 1, dropCode = 0;
+// the registers of expressions, by depth; R0 last, as it holds what the calls return
+const unsigned temporaries[] = { R1, R2, R3, R4, R5, R0 };
+
+unsigned alignUp(unsigned value, unsigned to) { return (value + to - 1) / to * to; }
+
+// The size and the alignment of the C type of a value of this width, as
+// EBPFScalarType declares it: u8, u16, u32, or else an array of bytes
+unsigned cSize(unsigned width) {
+    return width <= 8 ? 1 : width <= 16 ? 2 : width <= 32 ? 4 : ROUNDUP(width, 8); }
+unsigned cAlign(unsigned width) { return width <= 32 ? cSize(width) : 1; }
+
+uint8_t sizeCode(unsigned bytes) {
+    return bytes == 1 ? B : bytes == 2 ? H : bytes == 4 ? W : DW; }
+
+// The jump that is taken when the one of op is not
+uint8_t invert(uint8_t op) {
+    switch (op) {
+        case JEQ: return JNE;
+        case JNE: return JEQ;
+        case JGT: return JLE;
+        case JLE: return JGT;
+        case JGE: return JLT;
+        case JLT: return JGE;
+    }
+    BUG("Unexpected jump %1%", unsigned(op));
+}
+
+uint32_t mapType(TableKind kind) {
+    switch (kind) {
+        case TableHash: return 1;         // BPF_MAP_TYPE_HASH
+        case TableArray: return 2;        // BPF_MAP_TYPE_ARRAY
+        case TableProgArray: return 3;    // BPF_MAP_TYPE_PROG_ARRAY
+        case TablePerCpuHash: return 5;   // BPF_MAP_TYPE_PERCPU_HASH
+        case TablePerCpuArray: return 6;  // BPF_MAP_TYPE_PERCPU_ARRAY
+        case TableLRUHash: return 9;      // BPF_MAP_TYPE_LRU_HASH
+        case TablePerCpuLRUHash: return 10;  // BPF_MAP_TYPE_LRU_PERCPU_HASH
+        case TableLPMTrie: return 11;     // BPF_MAP_TYPE_LPM_TRIE
+    }
+    BUG("Unexpected table kind %1%", unsigned(kind));
+}
+
+// A constant that fits in the immediate of an instruction, without sign extension
+// the number of consecutive constant cases of a select from which they are searched
+// as a binary tree, rather than tested one after the other
+const size_t selectTreeCases = 4;
+
+bool smallConstant(const IR::Expression* expression, int32_t* imm) {
+    auto c = expression->to<IR::Constant>();
+    if (c == nullptr || c->value < 0 || c->value >= 0x80000000L)
+        return false;
+    *imm = c->asInt();
+    return true;
+}
+
+cstring join(cstring path, cstring name) {
+    return path.isNullOrEmpty() ? name : path + "." + name; }
+}  // namespace
+
+//////////////////////////////////////////////////////////////////////////
+// instructions
+
+void EBPFBytecode::emit(uint8_t code, unsigned dst, unsigned src, int off, int32_t imm) {
+    object->code.emplace_back(code, dst, src, int16_t(off), imm);
+}
+
+void EBPFBytecode::alu(uint8_t op, unsigned dst, int32_t imm) {
+    emit(ALU64 | op | K, dst, 0, 0, imm);
+}
+
+void EBPFBytecode::aluReg(uint8_t op, unsigned dst, unsigned src) {
+    emit(ALU64 | op | X, dst, src, 0, 0);
+}
+
+void EBPFBytecode::load(unsigned dst, unsigned base, int offset, unsigned bytes) {
+    emit(LDX | MEM | sizeCode(bytes), dst, base, offset, 0);
+}
+
+void EBPFBytecode::store(unsigned base, int offset, unsigned src, unsigned bytes) {
+    emit(STX | MEM | sizeCode(bytes), base, src, offset, 0);
+}
+
+void EBPFBytecode::storeImm(int offset, int32_t imm, unsigned bytes) {
+    emit(ST | MEM | sizeCode(bytes), R10, 0, offset, imm);
+}
+
+// a value of at most 32 bits; the 32-bit move clears the upper half of the register
+void EBPFBytecode::constant(unsigned dst, uint64_t value) {
+    emit(ALU | MOV | K, dst, 0, 0, int32_t(uint32_t(value)));
+}
+
+void EBPFBytecode::truncate(unsigned reg, unsigned width) {
+    if (width >= 32)
+        emit(ALU | MOV | X, reg, reg, 0, 0);
+    else
+        alu(AND, reg, int32_t((1u << width) - 1));
+}
+
+void EBPFBytecode::loadMap(unsigned dst, cstring map) {
+    auto it = mapIndex.find(map);
+    BUG_CHECK(it != mapIndex.end(), "No map named %1%", map);
+    object->relocations.emplace_back(object->code.size(), it->second);
+    emit(LD | DW | IMM, dst, 0, 0, 0);
+    emit(0, 0, 0, 0, 0);
+}
+
+unsigned EBPFBytecode::newLabel() {
+    labels.push_back(-1);
+    return labels.size() - 1;
+}
+
+void EBPFBytecode::bind(unsigned label) {
+    labels.at(label) = object->code.size();
+}
+
+void EBPFBytecode::jump(uint8_t op, unsigned reg, int32_t imm, unsigned label) {
+    jumps.emplace_back(object->code.size(), label);
+    emit(JMP | op | K, reg, 0, 0, imm);
+}
+
+void EBPFBytecode::jumpReg(uint8_t op, unsigned reg, unsigned src, unsigned label) {
+    jumps.emplace_back(object->code.size(), label);
+    emit(JMP | op | X, reg, src, 0, 0);
+}
+
+void EBPFBytecode::jumpTo(unsigned label) {
+    jump(JA, 0, 0, label);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// storage
+
+void EBPFBytecode::unsupported(const IR::Node* node, const char* what) {
+    ::error("%1%: %2% not supported with --emitObject", node, what);
+    ok = false;
+}
+
+int EBPFBytecode::allocate(unsigned bytes, unsigned align) {
+    stackSize = alignUp(stackSize + bytes, align);
+    if (stackSize > EBPFBudget::maxStack && ok) {
+        ::error("The program needs more than %1% bytes of stack with --emitObject",
+                unsigned(EBPFBudget::maxStack));
+        ok = false;
+    }
+    return -static_cast<int>(stackSize);
+}
+
+EBPFBytecode::Slot EBPFBytecode::allocate(const IR::Type* type) {
+    type = canonical(type);
+    if (type->is<IR::Type_Boolean>())
+        return Slot{ allocate(4, 4), 1, false };
+    if (auto bits = type->to<IR::Type_Bits>()) {
+        unsigned width = bits->size;
+        if (EBPFScalarType::generatesScalar(width))
+            return Slot{ allocate(4, 4), width, false };
+        return Slot{ allocate(ROUNDUP(width, 8), 1), width, true };
+    }
+    unsupported(type, "values of this type are");
+    return Slot{ allocate(4, 4), 32, false };
+}
+
+// Gives each field of the headers a slot; a header gets one for its valid bit too,
+// which is named as in the C of EBPFStructType
+void EBPFBytecode::layout(cstring path, const IR::Type* type) {
+    type = canonical(type);
+    if (auto st = type->to<IR::Type_StructLike>()) {
+        if (st->is<IR::Type_Header>())
+            fields.emplace(join(path, "ebpf_valid"), Slot{ allocate(4, 4), 1, false });
+        else if (!st->is<IR::Type_Struct>())
+            unsupported(type, "header unions are");
+        for (auto f : *st->fields)
+            layout(join(path, f->name.name), f->type);
+        return;
+    }
+    fields.emplace(path, allocate(type));
+}
+
+const IR::Type* EBPFBytecode::canonical(const IR::Type* type) const {
+    if (type->is<IR::Type_Name>() || type->is<IR::Type_Typedef>())
+        return program->typeMap->getTypeType(type, true);
+    return type;
+}
+
+// The path of a member of the headers, "" for the headers themselves, or null for
+// anything else
+cstring EBPFBytecode::pathOf(const IR::Expression* expression) const {
+    if (auto pe = expression->to<IR::PathExpression>()) {
+        auto decl = program->refMap->getDeclaration(pe->path, true);
+        if (decl == program->parser->headers || decl == program->control->headers)
+            return "";
+        return nullptr;
+    }
+    if (auto member = expression->to<IR::Member>()) {
+        cstring path = pathOf(member->expr);
+        if (path.isNull())
+            return nullptr;
+        return join(path, member->member.name);
+    }
+    return nullptr;
+}
+
+const EBPFBytecode::Slot* EBPFBytecode::slotOf(const IR::Expression* expression) {
+    if (auto pe = expression->to<IR::PathExpression>()) {
+        auto it = locals.find(program->refMap->getDeclaration(pe->path, true));
+        return it != locals.end() ? &it->second : nullptr;
+    }
+    cstring path = pathOf(expression);
+    if (path.isNullOrEmpty())
+        return nullptr;
+    auto it = fields.find(path);
+    return it != fields.end() ? &it->second : nullptr;
+}
+
+unsigned EBPFBytecode::widthOf(const IR::Expression* expression) {
+    auto type = canonical(program->typeMap->getType(expression, true));
+    if (type->is<IR::Type_Boolean>())
+        return 1;
+    if (type->is<IR::Type_InfInt>())
+        return 32;
+    if (auto bits = type->to<IR::Type_Bits>()) {
+        if (bits->isSigned)
+            unsupported(expression, "signed values are");
+        return bits->size;
+    }
+    unsupported(expression, "values of this type are");
+    return 32;
+}
+
+unsigned EBPFBytecode::reg(unsigned depth) {
+    const unsigned count = sizeof(temporaries) / sizeof(temporaries[0]);
+    if (depth < count)
+        return temporaries[depth];
+    if (ok)
+        ::error("An expression needs more than %1% registers, which --emitObject does not "
+                "spill to the stack", count);
+    ok = false;
+    return R0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// expressions
+
+void EBPFBytecode::value(const IR::Expression* expression, unsigned depth) {
+    unsigned r = reg(depth);
+    if (auto c = expression->to<IR::Constant>()) {
+        if (c->value < 0 || c->value > 0xffffffffUL)
+            unsupported(c, "constants wider than 32 bits are");
+        constant(r, c->value.get_ui());
+        return;
+    }
+    if (auto b = expression->to<IR::BoolLiteral>()) {
+        constant(r, b->value ? 1 : 0);
+        return;
+    }
+    if (auto slot = slotOf(expression)) {
+        if (slot->bytes)
+            unsupported(expression, "operations on fields wider than 32 bits are");
+        load(r, R10, slot->offset, 4);
+        return;
+    }
+    if (auto pe = expression->to<IR::PathExpression>()) {
+        auto decl = program->refMap->getDeclaration(pe->path, true);
+        auto it = params.find(decl->getNode()->to<IR::Parameter>());
+        if (it != params.end()) {
+            auto &binding = it->second;
+            if (binding.argument != nullptr)
+                value(binding.argument, depth);
+            else if (binding.width > 32)
+                unsupported(expression, "operations on fields wider than 32 bits are");
+            else
+                load(r, R8, binding.offset, cSize(binding.width));
+            return;
+        }
+    }
+    if (auto mc = expression->to<IR::MethodCallExpression>()) {
+        auto mi = P4::MethodInstance::resolve(mc, program->refMap, program->typeMap);
+        auto bim = mi->to<P4::BuiltInMethod>();
+        cstring path = bim != nullptr ? pathOf(bim->appliedTo) : nullptr;
+        if (bim != nullptr && bim->name == IR::Type_Header::isValid && !path.isNull() &&
+            fields.count(join(path, "ebpf_valid"))) {
+            load(r, R10, fields.at(join(path, "ebpf_valid")).offset, 4);
+            return;
+        }
+        unsupported(expression, "calls like this are");
+        return;
+    }
+
+    unsigned width = widthOf(expression);
+    if (width > 32) {
+        unsupported(expression, "operations on values wider than 32 bits are");
+        return;
+    }
+    if (expression->is<IR::Operation_Relation>() || expression->is<IR::LAnd>() ||
+        expression->is<IR::LOr>() || expression->is<IR::LNot>()) {
+        unsigned done = newLabel();
+        constant(r, 1);
+        branch(expression, true, done, depth + 1);
+        constant(r, 0);
+        bind(done);
+        return;
+    }
+    if (auto cmpl = expression->to<IR::Cmpl>()) {
+        value(cmpl->expr, depth);
+        alu(XOR, r, -1);
+        truncate(r, width);
+        return;
+    }
+    if (auto neg = expression->to<IR::Neg>()) {
+        value(neg->expr, depth);
+        emit(ALU64 | NEG, r, 0, 0, 0);
+        truncate(r, width);
+        return;
+    }
+    if (auto cast = expression->to<IR::Cast>()) {
+        unsigned from = widthOf(cast->expr);
+        value(cast->expr, depth);
+        if (width < from)
+            truncate(r, width);
+        return;
+    }
+    if (auto slice = expression->to<IR::Slice>()) {
+        value(slice->e0, depth);
+        if (slice->getL() > 0)
+            alu(RSH, r, slice->getL());
+        truncate(r, width);
+        return;
+    }
+    if (auto mux = expression->to<IR::Mux>()) {
+        unsigned otherwise = newLabel(), done = newLabel();
+        branch(mux->e0, false, otherwise, depth);
+        value(mux->e1, depth);
+        jumpTo(done);
+        bind(otherwise);
+        value(mux->e2, depth);
+        bind(done);
+        return;
+    }
+    if (auto concat = expression->to<IR::Concat>()) {
+        value(concat->left, depth);
+        alu(LSH, r, widthOf(concat->right));
+        value(concat->right, depth + 1);
+        aluReg(OR, r, reg(depth + 1));
+        return;
+    }
+    if (auto bin = expression->to<IR::Operation_Binary>()) {
+        uint8_t op;
+        bool wraps = true;  // the result may need to be cut to the width
+        if (bin->is<IR::Add>()) {
+            op = ADD;
+        } else if (bin->is<IR::Sub>()) {
+            op = SUB;
+        } else if (bin->is<IR::Mul>()) {
+            op = MUL;
+        } else if (bin->is<IR::Shl>()) {
+            op = LSH;
+        } else if (bin->is<IR::Shr>()) {
+            op = RSH;
+            wraps = false;
+        } else if (bin->is<IR::BAnd>() || bin->is<IR::BOr>() || bin->is<IR::BXor>()) {
+            op = bin->is<IR::BAnd>() ? AND : bin->is<IR::BOr>() ? OR : XOR;
+            wraps = false;
+        } else {
+            unsupported(expression, "operations like this are");
+            return;
+        }
+        int32_t imm;
+        bool shift = op == LSH || op == RSH;
+        if (shift && !smallConstant(bin->right, &imm)) {
+            unsupported(expression, "shifts by a variable amount are");
+            return;
+        }
+        if (shift && unsigned(imm) >= width) {
+            // all the bits are shifted out
+            constant(r, 0);
+            return;
+        }
+        value(bin->left, depth);
+        if (smallConstant(bin->right, &imm)) {
+            alu(op, r, imm);
+        } else {
+            value(bin->right, depth + 1);
+            aluReg(op, r, reg(depth + 1));
+        }
+        if (wraps)
+            truncate(r, width);
+        return;
+    }
+    unsupported(expression, "expressions like this are");
+}
+
+void EBPFBytecode::branch(const IR::Expression* condition, bool whenTrue, unsigned label,
+                          unsigned depth) {
+    if (auto lnot = condition->to<IR::LNot>()) {
+        branch(lnot->expr, !whenTrue, label, depth);
+        return;
+    }
+    if (condition->is<IR::LAnd>() || condition->is<IR::LOr>()) {
+        auto bin = condition->to<IR::Operation_Binary>();
+        if (whenTrue == condition->is<IR::LAnd>()) {
+            // a && b is true, and a || b false, only if both sides are
+            unsigned skip = newLabel();
+            branch(bin->left, !whenTrue, skip, depth);
+            branch(bin->right, whenTrue, label, depth);
+            bind(skip);
+        } else {
+            branch(bin->left, whenTrue, label, depth);
+            branch(bin->right, whenTrue, label, depth);
+        }
+        return;
+    }
+    if (auto b = condition->to<IR::BoolLiteral>()) {
+        if (b->value == whenTrue)
+            jumpTo(label);
+        return;
+    }
+
+    uint8_t op = condition->is<IR::Equ>() ? JEQ : condition->is<IR::Neq>() ? JNE :
+            condition->is<IR::Grt>() ? JGT : condition->is<IR::Geq>() ? JGE :
+            condition->is<IR::Lss>() ? JLT : condition->is<IR::Leq>() ? JLE : JA;
+    if (op == JA) {
+        value(condition, depth);
+        jump(whenTrue ? JNE : JEQ, reg(depth), 0, label);
+        return;
+    }
+    auto bin = condition->to<IR::Operation_Binary>();
+    if (!whenTrue)
+        op = invert(op);
+    value(bin->left, depth);
+    int32_t imm;
+    if (smallConstant(bin->right, &imm)) {
+        jump(op, reg(depth), imm, label);
+    } else {
+        value(bin->right, depth + 1);
+        jumpReg(op, reg(depth), reg(depth + 1), label);
+    }
+}
+
+void EBPFBytecode::copyBytes(const IR::Expression* from, int offset, unsigned bytes) {
+    if (auto slot = slotOf(from)) {
+        if (!slot->bytes || ROUNDUP(slot->width, 8) != bytes) {
+            unsupported(from, "conversions of fields wider than 32 bits are");
+            return;
+        }
+        for (unsigned i = 0; i < bytes; i++) {
+            load(R0, R10, slot->offset + i, 1);
+            store(R10, offset + i, R0, 1);
+        }
+        return;
+    }
+    if (auto pe = from->to<IR::PathExpression>()) {
+        auto decl = program->refMap->getDeclaration(pe->path, true);
+        auto it = params.find(decl->getNode()->to<IR::Parameter>());
+        if (it != params.end() && it->second.argument == nullptr) {
+            for (unsigned i = 0; i < bytes; i++) {
+                load(R0, R8, it->second.offset + i, 1);
+                store(R10, offset + i, R0, 1);
+            }
+            return;
+        }
+        if (it != params.end())
+            from = it->second.argument;
+    }
+    if (auto c = from->to<IR::Constant>()) {
+        // in network order, as the parser extracts them
+        for (unsigned i = 0; i < bytes; i++) {
+            mpz_class shifted = c->value >> (8 * (bytes - 1 - i));
+            storeImm(offset + i, shifted.get_ui() & 0xff, 1);
+        }
+        return;
+    }
+    unsupported(from, "expressions wider than 32 bits are");
+}
+
+//////////////////////////////////////////////////////////////////////////
+// statements
+
+void EBPFBytecode::statement(const IR::StatOrDecl* statement) {
+    if (auto block = statement->to<IR::BlockStatement>()) {
+        for (auto c : *block->components)
+            this->statement(c);
+    } else if (auto decl = statement->to<IR::Declaration>()) {
+        declare(decl);
+    } else if (statement->is<IR::EmptyStatement>()) {
+        return;
+    } else if (auto assign = statement->to<IR::AssignmentStatement>()) {
+        auto type = canonical(program->typeMap->getType(assign->left, true));
+        auto slot = slotOf(assign->left);
+        if (type->is<IR::Type_Header>())
+            copyHeader(assign);
+        else if (slot == nullptr)
+            unsupported(assign->left, "assignments to this are");
+        else
+            store(*slot, assign->right);
+    } else if (statement->is<IR::ReturnStatement>() || statement->is<IR::ExitStatement>()) {
+        jumpTo(endLabel);
+    } else if (auto mcs = statement->to<IR::MethodCallStatement>()) {
+        call(mcs->methodCall, nullptr, nullptr);
+    } else if (auto ifs = statement->to<IR::IfStatement>()) {
+        unsigned otherwise = newLabel();
+        if (program->control->applies->isHit(ifs->condition)) {
+            // apply the table, and then test whether it hit
+            auto member = ifs->condition->to<IR::Member>();
+            CHECK_NULL(member);
+            call(member->expr->to<IR::MethodCallExpression>(), &result, nullptr);
+            load(R1, R10, result.offset, 4);
+            jump(JEQ, R1, 0, otherwise);
+        } else {
+            branch(ifs->condition, false, otherwise, 0);
+        }
+        this->statement(ifs->ifTrue);
+        if (ifs->ifFalse != nullptr) {
+            unsigned done = newLabel();
+            jumpTo(done);
+            bind(otherwise);
+            this->statement(ifs->ifFalse);
+            bind(done);
+        } else {
+            bind(otherwise);
+        }
+    } else if (auto sw = statement->to<IR::SwitchStatement>()) {
+        // This must be a table.apply().action_run
+        auto member = sw->expression->to<IR::Member>();
+        BUG_CHECK(member != nullptr,
+                  "%1%: Unexpected expression in switch statement", sw->expression);
+        auto mce = member->expr->to<IR::MethodCallExpression>();
+        CHECK_NULL(mce);
+        auto am = P4::MethodInstance::resolve(mce, program->refMap, program->typeMap)
+                ->to<P4::ApplyMethod>();
+        CHECK_NULL(am);
+        auto table = program->control->getTable(am->object->getName().name);
+        call(mce, nullptr, &result);
+
+        unsigned done = newLabel(), otherwise = done;
+        std::vector<unsigned> cases;
+        load(R1, R10, result.offset, 4);
+        for (auto c : sw->cases) {
+            cases.push_back(newLabel());
+            if (c->label->is<IR::DefaultExpression>()) {
+                otherwise = cases.back();
+                continue;
+            }
+            auto pe = c->label->to<IR::PathExpression>();
+            auto decl = program->refMap->getDeclaration(pe->path, true);
+            BUG_CHECK(decl->getNode()->is<IR::P4Action>(), "%1%: expected an action", pe);
+            jump(JEQ, R1, actionIndex(table, decl->getNode()->to<IR::P4Action>()), cases.back());
+        }
+        jumpTo(otherwise);
+        for (unsigned i = 0; i < cases.size(); i++) {
+            bind(cases[i]);
+            // a case without a statement falls through to the next one
+            if (sw->cases.at(i)->statement != nullptr) {
+                this->statement(sw->cases.at(i)->statement);
+                jumpTo(done);
+            }
+        }
+        bind(done);
+    } else {
+        unsupported(statement, "statements like this are");
+    }
+}
+
+void EBPFBytecode::declare(const IR::Declaration* declaration) {
+    if (auto var = declaration->to<IR::Declaration_Variable>()) {
+        auto slot = allocate(var->type);
+        locals.emplace(var, slot);
+        if (var->initializer != nullptr)
+            store(slot, var->initializer);
+    } else if (!declaration->is<IR::P4Table>() && !declaration->is<IR::P4Action>() &&
+               !declaration->is<IR::Declaration_Instance>() &&
+               !declaration->is<IR::Declaration_Constant>()) {
+        unsupported(declaration, "declarations like this are");
+    }
+}
+
+void EBPFBytecode::store(const Slot &slot, const IR::Expression* value) {
+    if (slot.bytes) {
+        copyBytes(value, slot.offset, ROUNDUP(slot.width, 8));
+    } else {
+        this->value(value, 0);
+        store(R10, slot.offset, reg(0), 4);
+    }
+}
+
+// Copies a header of the headers parameter, valid bit included, to another.  Headers
+// of the same type almost always have the same layout on the stack, and then their
+// bytes are copied at once, in words as wide as the alignment of both allows, rather
+// than field by field: the padding between the fields is copied too, which the
+// prologue zeroed.
+void EBPFBytecode::copyHeader(const IR::AssignmentStatement* assign) {
+    cstring left = pathOf(assign->left), right = pathOf(assign->right);
+    if (left.isNullOrEmpty() || right.isNullOrEmpty()) {
+        unsupported(assign, "assignments of headers outside the headers parameter are");
+        return;
+    }
+    auto type = canonical(program->typeMap->getType(assign->left, true))->to<IR::Type_Header>();
+    std::vector<cstring> names = { "ebpf_valid" };
+    for (auto f : *type->fields)
+        names.push_back(f->name.name);
+
+    std::vector<std::pair<const Slot*, const Slot*>> slots;
+    int leftLow = INT_MAX, leftHigh = INT_MIN, rightLow = INT_MAX, rightHigh = INT_MIN;
+    for (auto name : names) {
+        auto &l = fields.at(join(left, name));
+        auto &r = fields.at(join(right, name));
+        int size = l.bytes ? ROUNDUP(l.width, 8) : 4;
+        leftLow = std::min(leftLow, l.offset);
+        leftHigh = std::max(leftHigh, l.offset + size);
+        rightLow = std::min(rightLow, r.offset);
+        rightHigh = std::max(rightHigh, r.offset + size);
+        slots.emplace_back(&l, &r);
+    }
+    bool sameLayout = true;
+    for (auto &s : slots)
+        sameLayout &= s.first->offset - leftLow == s.second->offset - rightLow;
+
+    if (!sameLayout) {
+        for (auto &s : slots) {
+            unsigned size = s.first->bytes ? ROUNDUP(s.first->width, 8) : 4;
+            for (unsigned i = 0; i < size; i += s.first->bytes ? 1 : 4) {
+                load(R0, R10, s.second->offset + i, s.first->bytes ? 1 : 4);
+                store(R10, s.first->offset + i, R0, s.first->bytes ? 1 : 4);
+            }
+        }
+        return;
+    }
+    int length = leftHigh - leftLow, done = 0;
+    for (int size : { 8, 4, 1 }) {
+        if (leftLow % size != 0 || rightLow % size != 0)
+            continue;
+        for (; done + size <= length; done += size) {
+            load(R0, R10, rightLow + done, size);
+            store(R10, leftLow + done, R0, size);
+        }
+    }
+}
+
+void EBPFBytecode::call(const IR::MethodCallExpression* expression,
+                        const Slot* hit, const Slot* action) {
+    auto mi = P4::MethodInstance::resolve(expression, program->refMap, program->typeMap);
+    if (auto am = mi->to<P4::ApplyMethod>()) {
+        if (am->isTableApply()) {
+            apply(program->control->getTable(am->object->getName().name), hit, action);
+            return;
+        }
+    } else if (auto ac = mi->to<P4::ActionCall>()) {
+        // Action arguments have been eliminated by the mid-end.
+        if (expression->arguments->size() == 0) {
+            statement(ac->action->body);
+            return;
+        }
+    } else if (auto bim = mi->to<P4::BuiltInMethod>()) {
+        cstring path = pathOf(bim->appliedTo);
+        if ((bim->name == IR::Type_Header::setValid ||
+             bim->name == IR::Type_Header::setInvalid) &&
+            !path.isNull() && fields.count(join(path, "ebpf_valid"))) {
+            storeImm(fields.at(join(path, "ebpf_valid")).offset,
+                     bim->name == IR::Type_Header::setValid, 4);
+            return;
+        }
+    } else if (auto ef = mi->to<P4::ExternFunction>()) {
+        if (ef->method->name.name == IR::ParserState::verify &&
+            expression->arguments->size() == 2) {
+            branch(expression->arguments->at(0), false, rejectLabel, 0);
+            return;
+        }
+    } else if (auto em = mi->to<P4::ExternMethod>()) {
+        if (em->object == program->parser->packet &&
+            em->method->name.name == P4::P4CoreLibrary::instance.packetIn.extract.name &&
+            expression->arguments->size() == 1) {
+            extract(expression->arguments->at(0));
+            return;
+        }
+    }
+    unsupported(expression, "calls like this are");
+}
+
+unsigned EBPFBytecode::actionIndex(const EBPFTable* table, const IR::P4Action* action) const {
+    unsigned index = table->firstAction();
+    for (auto a : *table->actionList->actionList) {
+        if (program->refMap->getDeclaration(a->getPath(), true) == action)
+            return index;
+        index++;
+    }
+    BUG("%1%: not an action of %2%", action, table->dataMapName);
+}
+
+// Looks the key up, and runs the action of the entry that it finds, or the default
+// action, as EBPFControl does; sets hit, and action to the index of the action, if given
+void EBPFBytecode::apply(const EBPFTable* table, const Slot* hit, const Slot* action) {
+    if (!table->implemented)
+        return;
+    std::vector<unsigned> offsets;
+    unsigned keySize = keyLayout(table, &offsets);
+    int key = allocate(alignUp(keySize, 8), 8);
+    // the padding, which the hash covers, if the fields leave any
+    if (table->keyPadding) {
+        for (unsigned i = 0; i < keySize; i += 8)
+            storeImm(key + i, 0, 8);
+    }
+    unsigned field = 0;
+    for (auto c : *table->keyGenerator->keyElements) {
+        unsigned width = widthOf(c->expression);
+        if (width > 32) {
+            copyBytes(c->expression, key + offsets.at(field), cSize(width));
+        } else {
+            value(c->expression, 0);
+            store(R10, key + offsets.at(field), reg(0), cSize(width));
+        }
+        field++;
+    }
+
+    unsigned miss = newLabel(), run = newLabel(), done = newLabel();
+    loadMap(R1, table->dataMapName);
+    aluReg(MOV, R2, R10);
+    alu(ADD, R2, key);
+    emit(JMP | CALL, 0, 0, 0, mapLookupElem);
+    jump(JEQ, R0, 0, miss);
+    if (table->lookup == EBPFTable::Lookup::Direct) {
+        // an entry of the array that has no action
+        load(R1, R0, 0, 4);
+        jump(JEQ, R1, 0, miss);
+    }
+    aluReg(MOV, R8, R0);
+    if (hit != nullptr)
+        storeImm(hit->offset, 1, 4);
+    jumpTo(run);
+
+    bind(miss);
+    if (hit != nullptr)
+        storeImm(hit->offset, 0, 4);
+    if (table->constDefaultAction != nullptr) {
+        auto mi = P4::MethodInstance::resolve(table->constDefaultAction, program->refMap,
+                                              program->typeMap);
+        auto ac = mi->to<P4::ActionCall>();
+        BUG_CHECK(ac != nullptr, "%1%: expected an action call", table->constDefaultAction);
+        if (action != nullptr)
+            storeImm(action->offset, actionIndex(table, ac->action), 4);
+        runAction(table, ac->action, table->constDefaultAction->arguments);
+        jumpTo(done);
+    } else {
+        // the field of the table in the entry of the default actions
+        loadMap(R1, program->control->defaultActionsMapName);
+        aluReg(MOV, R2, R10);
+        alu(ADD, R2, zeroKey);
+        emit(JMP | CALL, 0, 0, 0, mapLookupElem);
+        jump(JEQ, R0, 0, done);
+        aluReg(MOV, R8, R0);
+        alu(ADD, R8, defaultsOffset(table));
+    }
+
+    bind(run);
+    load(R1, R8, 0, 4);
+    if (action != nullptr)
+        store(R10, action->offset, R1, 4);
+    std::vector<unsigned> actions;
+    for (auto a : *table->actionList->actionList) {
+        (void)a;
+        actions.push_back(newLabel());
+        jump(JEQ, R1, table->firstAction() + actions.size() - 1, actions.back());
+    }
+    jumpTo(done);
+    unsigned index = 0;
+    for (auto a : *table->actionList->actionList) {
+        auto decl = program->refMap->getDeclaration(a->getPath(), true);
+        bind(actions.at(index++));
+        runAction(table, decl->getNode()->to<IR::P4Action>(), nullptr);
+        jumpTo(done);
+    }
+    bind(done);
+}
+
+// Runs the action with the parameters in the entry that R8 points to, or bound to the
+// arguments if there are any
+void EBPFBytecode::runAction(const EBPFTable* table, const IR::P4Action* action,
+                             const IR::Vector<IR::Expression>* arguments) {
+    std::vector<unsigned> offsets;
+    valueLayout(table, action, &offsets);
+    params.clear();
+    unsigned index = 0;
+    for (auto p : *action->parameters->getEnumerator()) {
+        auto type = canonical(p->type);
+        unsigned width = type->is<IR::Type_Bits>() ? type->to<IR::Type_Bits>()->size : 1;
+        const IR::Expression* argument = nullptr;
+        if (arguments != nullptr && index < arguments->size())
+            argument = arguments->at(index);
+        params.emplace(p, Binding{ static_cast<int>(offsets.at(index)), width, argument });
+        index++;
+    }
+    statement(action->body);
+    params.clear();
+}
+
+// The offset of each field of the key struct of EBPFTable::emitKeyType, and its size
+unsigned EBPFBytecode::keyLayout(const EBPFTable* table, std::vector<unsigned>* offsets) {
+    if (table->lookup == EBPFTable::Lookup::Direct) {
+        offsets->push_back(0);
+        return 4;  // the u32 index of the array
+    }
+    unsigned size = 0, align = 1;
+    offsets->resize(table->keyOrder.size());
+    for (auto index : table->keyOrder) {
+        unsigned width = widthOf(table->keyGenerator->keyElements->at(index)->expression);
+        size = alignUp(size, cAlign(width));
+        offsets->at(index) = size;
+        size += cSize(width);
+        align = std::max(align, cAlign(width));
+    }
+    return alignUp(size, align);
+}
+
+// The size of the value struct of EBPFTable::emitValueType: the action, and then the
+// union of the parameters of all the actions; with the offset of each parameter of
+// action, if given, from the start of the struct
+unsigned EBPFBytecode::valueLayout(const EBPFTable* table, const IR::P4Action* action,
+                                   std::vector<unsigned>* offsets) {
+    unsigned unionSize = 0, unionAlign = 1;
+    std::vector<unsigned> found;
+    for (auto a : *table->actionList->actionList) {
+        auto decl = program->refMap->getDeclaration(a->getPath(), true);
+        auto act = decl->getNode()->to<IR::P4Action>();
+        unsigned size = 0, align = 1;
+        for (auto p : *act->parameters->getEnumerator()) {
+            auto type = canonical(p->type);
+            unsigned width = 1;
+            if (auto bits = type->to<IR::Type_Bits>())
+                width = bits->size;
+            else if (!type->is<IR::Type_Boolean>())
+                unsupported(p, "action parameters of this type are");
+            size = alignUp(size, cAlign(width));
+            if (act == action)
+                found.push_back(size);
+            size += cSize(width);
+            align = std::max(align, cAlign(width));
+        }
+        unionSize = std::max(unionSize, alignUp(size, align));
+        unionAlign = std::max(unionAlign, align);
+    }
+    // the enum of the action is an int
+    unsigned unionOffset = alignUp(4, unionAlign);
+    if (offsets != nullptr) {
+        for (auto o : found)
+            offsets->push_back(unionOffset + o);
+    }
+    return alignUp(unionOffset + unionSize, std::max(4u, unionAlign));
+}
+
+// The offset of the entry of the table in the value of the default actions map, a
+// struct of the entries of the tables whose default action is not const
+unsigned EBPFBytecode::defaultsOffset(const EBPFTable* table) {
+    unsigned offset = 0;
+    for (auto it : program->control->tables) {
+        if (it.second->constDefaultAction != nullptr || !it.second->implemented)
+            continue;
+        if (it.second == table)
+            return offset;
+        offset += valueLayout(it.second, nullptr, nullptr);
+    }
+    return offset;
+}
+
+void EBPFBytecode::addMap(cstring name, TableKind kind, unsigned keySize,
+                          unsigned valueSize, unsigned maxEntries) {
+    mapIndex.emplace(name, object->maps.size());
+    // LPM tries cannot be preallocated: BPF_F_NO_PREALLOC
+    object->maps.push_back(BpfMapDef{ name, mapType(kind), keySize, valueSize, maxEntries,
+                                      kind == TableLPMTrie ? 1u : 0u });
+}
+
+//////////////////////////////////////////////////////////////////////////
+// the parser
+
+void EBPFBytecode::parserState(const IR::ParserState* state) {
+    if (state->isBuiltin())
+        return;
+    bind(states.at(state->name.name));
+    for (auto c : *state->components)
+        statement(c);
+    auto next = state->selectExpression;
+    if (next == nullptr) {
+        jumpTo(rejectLabel);
+    } else if (auto select = next->to<IR::SelectExpression>()) {
+        this->select(select);
+    } else {
+        // must be a PathExpression which is a state name
+        auto pe = next->to<IR::PathExpression>();
+        BUG_CHECK(pe != nullptr, "Expected a PathExpression, got a %1%", next);
+        jumpTo(states.at(pe->path->name.name));
+    }
+}
+
+// Reads the header as EBPFParser does with the load_ helpers, with the packet loads
+// that they compile to, each of which reads 1, 2 or 4 bytes in network order
+void EBPFBytecode::extract(const IR::Expression* expression) {
+    auto type = canonical(program->typeMap->getType(expression, true));
+    auto ht = type->to<IR::Type_Header>();
+    cstring path = pathOf(expression);
+    if (ht == nullptr || path.isNull()) {
+        unsupported(expression, "extracts like this are");
+        return;
+    }
+
+    // reject the packet if it is too short for the header
+    unsigned width = ht->width_bits();
+    aluReg(MOV, R1, R7);
+    alu(ADD, R1, width + 7);
+    alu(RSH, R1, 3);
+    jumpReg(JGT, R1, R9, rejectLabel);
+    aluReg(MOV, R8, R7);
+    alu(RSH, R8, 3);
+
+    unsigned start = 0;
+    for (auto f : *ht->fields) {
+        auto slot = fields.at(join(path, f->name.name));
+        unsigned byte = start / 8, alignment = start % 8;
+        if (!slot.bytes) {
+            unsigned bits = alignment + slot.width;
+            unsigned loadSize = bits <= 8 ? 8 : bits <= 16 ? 16 : 32;
+            if (bits > 32) {
+                unsupported(f, "fields of up to 32 bits that span 5 bytes are");
+                break;
+            }
+            emit(LD | IND | sizeCode(loadSize / 8), 0, R8, 0, byte);
+            if (loadSize - bits != 0)
+                alu(RSH, R0, loadSize - bits);
+            if (slot.width < loadSize)
+                truncate(R0, slot.width);
+            store(R10, slot.offset, R0, 4);
+        } else {
+            // byte by byte
+            unsigned bytes = ROUNDUP(slot.width, 8);
+            for (unsigned i = 0; i < bytes; i++) {
+                emit(LD | IND | (alignment == 0 ? B : H), 0, R8, 0, byte + i);
+                if (alignment != 0)
+                    alu(RSH, R0, 8 - alignment);
+                if (i == bytes - 1 && slot.width % 8 != 0)
+                    truncate(R0, slot.width % 8);
+                store(R10, slot.offset + i, R0, 1);
+            }
+        }
+        start += slot.width;
+    }
+
+    alu(ADD, R7, width);
+    storeImm(fields.at(join(path, "ebpf_valid")).offset, 1, 4);
+}
+
+void EBPFBytecode::select(const IR::SelectExpression* expression) {
+    const IR::Expression* key = expression->select;
+    if (auto list = key->to<IR::ListExpression>()) {
+        if (list->components->size() != 1) {
+            unsupported(key, "selects on several values are");
+            return;
+        }
+        key = list->components->at(0);
+    }
+    value(key, 0);
+    unsigned r = reg(0);
+
+    // Consecutive cases with constant values, such as the EtherTypes of a dispatch on
+    // them, are tested with a binary search when there are enough of them: eBPF has no
+    // indirect jumps for a jump table.  A value that an earlier case of the run already
+    // has can never match, as the first case that matches wins.
+    std::vector<std::pair<int32_t, unsigned>> run;
+    auto endRun = [&]() {
+        if (run.size() < selectTreeCases) {
+            for (auto &c : run)
+                jump(JEQ, r, c.first, c.second);
+        } else {
+            std::stable_sort(run.begin(), run.end(),
+                             [](const std::pair<int32_t, unsigned> &a,
+                                const std::pair<int32_t, unsigned> &b) {
+                                 return a.first < b.first; });
+            run.erase(std::unique(run.begin(), run.end(),
+                                  [](const std::pair<int32_t, unsigned> &a,
+                                     const std::pair<int32_t, unsigned> &b) {
+                                      return a.first == b.first; }),
+                      run.end());
+            unsigned miss = newLabel();
+            selectTree(r, run, 0, run.size(), miss);
+            bind(miss);
+        }
+        run.clear(); };
+
+    for (auto c : expression->selectCases) {
+        unsigned state = states.at(c->state->path->name.name);
+        const IR::Expression* keyset = c->keyset;
+        if (auto list = keyset->to<IR::ListExpression>()) {
+            if (list->components->size() == 1)
+                keyset = list->components->at(0);
+        }
+        int32_t imm;
+        if (smallConstant(keyset, &imm)) {
+            run.emplace_back(imm, state);
+            continue;
+        }
+        endRun();
+        if (keyset->is<IR::DefaultExpression>()) {
+            jumpTo(state);
+            return;
+        } else if (auto mask = keyset->to<IR::Mask>()) {
+            value(mask->right, 1);
+            value(mask->left, 2);
+            aluReg(AND, reg(2), reg(1));
+            aluReg(AND, reg(1), r);
+            jumpReg(JEQ, reg(1), reg(2), state);
+        } else if (auto range = keyset->to<IR::Range>()) {
+            unsigned skip = newLabel();
+            value(range->left, 1);
+            jumpReg(JLT, r, reg(1), skip);
+            value(range->right, 1);
+            jumpReg(JLE, r, reg(1), state);
+            bind(skip);
+        } else {
+            value(keyset, 1);
+            jumpReg(JEQ, r, reg(1), state);
+        }
+    }
+    endRun();
+    jumpTo(rejectLabel);
+}
+
+void EBPFBytecode::selectTree(unsigned reg, const std::vector<std::pair<int32_t, unsigned>> &cases,
+                              size_t begin, size_t end, unsigned miss) {
+    if (end - begin < selectTreeCases) {
+        for (size_t i = begin; i < end; i++)
+            jump(JEQ, reg, cases[i].first, cases[i].second);
+        jumpTo(miss);
+        return;
+    }
+    // the values are positive 32-bit constants, so the unsigned compare is the right one
+    size_t middle = begin + (end - begin) / 2;
+    unsigned upper = newLabel();
+    jump(JGE, reg, cases[middle].first, upper);
+    selectTree(reg, cases, begin, middle, miss);
+    bind(upper);
+    selectTree(reg, cases, middle, end, miss);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool EBPFBytecode::build(ElfObject* object) {
+    this->object = object;
+    auto parser = program->parser;
+    auto control = program->control;
+    object->section = object->function = program->functionName;
+    object->license = program->license;
+
+    if (control->stages.size() > 1)
+        ::error("The control needs more than %1% instructions; stages are not supported "
+                "with --emitObject", program->functionName);
+    if (program->tableStats)
+        ::error("--tableStats and --tableTime are not supported with --emitObject");
+    for (auto it : control->counters)
+        ::error("%1%: counters are not supported with --emitObject", it.first);
+
+    // the maps, as EBPFControl::emitTables declares them
+    unsigned defaults = 0;
+    for (auto it : control->tables) {
+        auto table = it.second;
+        if (!table->implemented)
+            continue;
+        if (table->lookup != EBPFTable::Lookup::Exact &&
+            table->lookup != EBPFTable::Lookup::Direct)
+            unsupported(table->table->container, "tables with lpm or ternary keys are");
+        if (table->keyGenerator == nullptr || table->keyGenerator->keyElements->empty()) {
+            unsupported(table->table->container, "tables without a key are");
+            continue;
+        }
+        std::vector<unsigned> offsets;
+        unsigned valueSize = valueLayout(table, nullptr, nullptr);
+        addMap(table->dataMapName, table->kind, keyLayout(table, &offsets), valueSize,
+               table->size);
+        if (table->constDefaultAction == nullptr)
+            defaults += valueSize;
+    }
+    if (!control->defaultActionsMapName.isNullOrEmpty())
+        addMap(control->defaultActionsMapName, TableArray, 4, defaults, 1);
+    if (::errorCount() > 0)
+        return false;
+
+    // the headers and the locals that the parser and the control share
+    layout("", program->typeMap->getType(parser->headers, true));
+    locals.emplace(control->accept, Slot{ allocate(4, 4), 1, false });
+    zeroKey = allocate(4, 4);
+    result = Slot{ allocate(4, 4), 32, false };
+
+    rejectLabel = newLabel();
+    endLabel = newLabel();
+    for (auto s : parser->states)
+        states.emplace(s->state->name.name, newLabel());
+    unsigned acceptLabel = newLabel();
+    states[IR::ParserState::accept] = acceptLabel;
+    states[IR::ParserState::reject] = rejectLabel;
+
+    for (auto d : *parser->parserBlock->container->parserLocals)
+        declare(d);
+    jumpTo(states.at(IR::ParserState::start));
+    for (auto s : parser->states)
+        parserState(s->state);
+    // the packets that the parser rejects are let through
+    bind(rejectLabel);
+    constant(R0, forwardCode);
+    emit(JMP | EXIT, 0, 0, 0, 0);
+
+    bind(acceptLabel);
+    for (auto d : *control->controlBlock->container->controlLocals)
+        declare(d);
+    statement(control->controlBlock->container->body);
+    bind(endLabel);
+    unsigned out = newLabel();
+    load(R1, R10, locals.at(control->accept).offset, 4);
+    constant(R0, dropCode);
+    jump(JEQ, R1, 0, out);
+    constant(R0, forwardCode);
+    bind(out);
+    emit(JMP | EXIT, 0, 0, 0, 0);
+    if (!ok)
+        return false;
+
+    for (auto j : jumps) {
+        int offset = labels.at(j.second) - static_cast<int>(j.first) - 1;
+        BUG_CHECK(labels.at(j.second) >= 0, "Jump to a label that is not bound");
+        if (offset < INT16_MIN || offset > INT16_MAX) {
+            ::error("%1%: the program is too large for the jumps of eBPF", program->functionName);
+            return false;
+        }
+        object->code.at(j.first).off = offset;
+    }
+
+    // The prologue, which needs the size of the stack: the context for the packet loads,
+    // the length of the packet (the first field of struct __sk_buff), the offset, and
+    // zeros in all the stack, which the verifier wants written before it is read
+    std::vector<BpfInsn> body;
+    body.swap(object->code);
+    aluReg(MOV, R6, R1);
+    load(R9, R6, 0, 4);
+    constant(R7, 0);
+    for (unsigned i = 8; i <= alignUp(stackSize, 8); i += 8)
+        storeImm(-static_cast<int>(i), 0, 8);
+    unsigned prologue = object->code.size();
+    object->code.insert(object->code.end(), body.begin(), body.end());
+    for (auto &r : object->relocations)
+        r.first += prologue;
+    return true;
+}
+
+}  // namespace EBPF
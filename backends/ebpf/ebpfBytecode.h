@@ -0,0 +1,151 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_EBPF_EBPFBYTECODE_H_
+#define _BACKENDS_EBPF_EBPFBYTECODE_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "ebpfElf.h"
+#include "ebpfObject.h"
+#include "ebpfTable.h"
+
+namespace EBPF {
+
+// Lowers the object model of a program for the kernel target (a socket filter) straight
+// to eBPF bytecode, for --emitObject, with the same maps and the same behavior as the C
+// that EBPFProgram::emit writes, so that the object can be produced without clang.
+// Only a subset of what the C generator handles is supported: scalar fields and
+// expressions of at most 32 bits (wider fields may only be extracted, copied and used
+// as table keys), assignments of whole headers of the headers parameter, tables with
+// exact keys, and no counters, statistics or stages.  Other programs get an error that
+// points at what is not supported.
+//
+// All the state of the program is on the stack: 4 bytes for each scalar field, local
+// and valid bit, and the bytes of each wider field.  R6 holds the context, which the
+// packet loads need; R7 the offset in the packet in bits; R8 the byte offset of the
+// header being extracted, or the value of the table entry whose action runs; and R9
+// the length of the packet.  Expressions are evaluated in R0-R5.
+class EBPFBytecode {
+    const EBPFProgram* program;
+    ElfObject*         object = nullptr;
+    bool               ok = true;
+
+    // Where a value is on the stack: a u32 for a scalar of up to 32 bits, or else as
+    // many bytes as the width takes, in network order
+    struct Slot {
+        int      offset;
+        unsigned width;
+        bool     bytes;
+    };
+    // the fields of the headers, by their path from the headers parameter, such as
+    // "ipv4.srcAddr"; the path of a header is that of its valid bit
+    std::map<cstring, Slot> fields;
+    // the locals, and the accept parameter of the control
+    std::map<const IR::IDeclaration*, Slot> locals;
+    unsigned stackSize = 0;
+
+    // What a parameter of the action being emitted is: at an offset in the table entry
+    // that R8 points to, or an argument of a const default action
+    struct Binding {
+        int offset;
+        unsigned width;
+        const IR::Expression* argument;
+    };
+    std::map<const IR::Parameter*, Binding> params;
+
+    std::vector<int> labels;                            // the position of each label
+    std::vector<std::pair<unsigned, unsigned>> jumps;   // instruction and label
+    std::map<cstring, unsigned> states;                 // the labels of parser states
+    unsigned rejectLabel = 0, endLabel = 0;
+    // a u32 0, the key of the default actions; and where hit or the action run is kept
+    int zeroKey = 0;
+    Slot result;
+    std::map<cstring, unsigned> mapIndex;               // in object->maps
+
+    // instructions
+    void emit(uint8_t code, unsigned dst, unsigned src, int off, int32_t imm);
+    void alu(uint8_t op, unsigned dst, int32_t imm);
+    void aluReg(uint8_t op, unsigned dst, unsigned src);
+    void load(unsigned dst, unsigned base, int offset, unsigned bytes);
+    void store(unsigned base, int offset, unsigned src, unsigned bytes);
+    void storeImm(int offset, int32_t imm, unsigned bytes);
+    void constant(unsigned dst, uint64_t value);
+    void truncate(unsigned reg, unsigned width);
+    void loadMap(unsigned dst, cstring map);
+    unsigned newLabel();
+    void bind(unsigned label);
+    void jump(uint8_t op, unsigned reg, int32_t imm, unsigned label);
+    void jumpReg(uint8_t op, unsigned reg, unsigned src, unsigned label);
+    void jumpTo(unsigned label);
+
+    // storage
+    void unsupported(const IR::Node* node, const char* what);
+    int allocate(unsigned bytes, unsigned align);
+    Slot allocate(const IR::Type* type);
+    void layout(cstring path, const IR::Type* type);
+    const IR::Type* canonical(const IR::Type* type) const;
+    cstring pathOf(const IR::Expression* expression) const;
+    const Slot* slotOf(const IR::Expression* expression);
+    unsigned widthOf(const IR::Expression* expression);
+    unsigned reg(unsigned depth);
+
+    // expressions, in the register of depth, with the ones above it as temporaries
+    void value(const IR::Expression* expression, unsigned depth);
+    // jumps to label if condition is whenTrue
+    void branch(const IR::Expression* condition, bool whenTrue, unsigned label,
+                unsigned depth);
+    // copies the bytes of a field wider than 32 bits, or of a parameter bound to one
+    void copyBytes(const IR::Expression* from, int offset, unsigned bytes);
+
+    // statements
+    void statement(const IR::StatOrDecl* statement);
+    void declare(const IR::Declaration* declaration);
+    void store(const Slot &slot, const IR::Expression* value);
+    void copyHeader(const IR::AssignmentStatement* assign);
+    void call(const IR::MethodCallExpression* expression, const Slot* hit, const Slot* action);
+    void apply(const EBPFTable* table, const Slot* hit, const Slot* action);
+    void runAction(const EBPFTable* table, const IR::P4Action* action,
+                   const IR::Vector<IR::Expression>* arguments);
+    void parserState(const IR::ParserState* state);
+    void extract(const IR::Expression* header);
+    void select(const IR::SelectExpression* select);
+    // jumps to the label of the case, of those in [begin, end) sorted by value, whose
+    // value reg holds, or else to miss
+    void selectTree(unsigned reg, const std::vector<std::pair<int32_t, unsigned>> &cases,
+                    size_t begin, size_t end, unsigned miss);
+
+    // the layouts of the C types of a table, with the padding of the C structs
+    unsigned keyLayout(const EBPFTable* table, std::vector<unsigned>* offsets);
+    unsigned valueLayout(const EBPFTable* table, const IR::P4Action* action,
+                         std::vector<unsigned>* offsets);
+    unsigned defaultsOffset(const EBPFTable* table);
+    unsigned actionIndex(const EBPFTable* table, const IR::P4Action* action) const;
+    void addMap(cstring name, TableKind kind, unsigned keySize, unsigned valueSize,
+                unsigned maxEntries);
+
+ public:
+    explicit EBPFBytecode(const EBPFProgram* program) : program(program) {}
+    // Fills in the code, the maps and the license of object; false if the program is
+    // outside the subset, after reporting errors
+    bool build(ElfObject* object);
+};
+
+}  // namespace EBPF
+
+#endif /* _BACKENDS_EBPF_EBPFBYTECODE_H_ */
@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include "ebpfControl.h"
+#include "ebpfParser.h"
 #include "ebpfType.h"
 #include "ebpfTable.h"
 #include "frontends/p4/tableApply.h"
@@ -25,6 +26,16 @@ limitations under the License.
 namespace EBPF {
 
 namespace {
+// The terms of a chain of &&, in order
+void conjuncts(const IR::Expression* expression, std::vector<const IR::Expression*>* terms) {
+    if (auto land = expression->to<IR::LAnd>()) {
+        conjuncts(land->left, terms);
+        conjuncts(land->right, terms);
+    } else {
+        terms->push_back(expression);
+    }
+}
+
 class ControlBodyTranslationVisitor : public CodeGenInspector {
     const EBPFControl* control;
     std::set<const IR::Parameter*> toDereference;
@@ -40,10 +51,96 @@ class ControlBodyTranslationVisitor : public CodeGenInspector {
     bool preorder(const IR::MethodCallExpression* expression) override;
     bool preorder(const IR::ReturnStatement* stat) override;
     bool preorder(const IR::ExitStatement* stat) override;
+    bool preorder(const IR::LAnd* expression) override;
+    bool preorder(const IR::AssignmentStatement* a) override;
     void processMethod(const P4::ExternMethod* method);
     void processApply(const P4::ApplyMethod* method);
+    // With --validityMask, whether expression is the isValid() of a header in the
+    // headers, and its bit
+    bool isValidTest(const IR::Expression* expression, const IR::PathExpression** headers,
+                     unsigned* bit) const;
+    void emitValidTest(const IR::PathExpression* headers, uint64_t mask);
 };
 
+bool ControlBodyTranslationVisitor::isValidTest(const IR::Expression* expression,
+                                                const IR::PathExpression** headers,
+                                                unsigned* bit) const {
+    auto program = control->program;
+    auto mce = expression->to<IR::MethodCallExpression>();
+    if (!program->validityMask || mce == nullptr)
+        return false;
+    auto mi = P4::MethodInstance::resolve(mce, program->refMap, program->typeMap);
+    auto bim = mi->to<P4::BuiltInMethod>();
+    return bim != nullptr && bim->name == IR::Type_Header::isValid &&
+           program->getValidBit(bim->appliedTo, headers, bit);
+}
+
+// whether all the headers of mask are valid
+void ControlBodyTranslationVisitor::emitValidTest(const IR::PathExpression* headers,
+                                                  uint64_t mask) {
+    cstring constant = control->program->validMaskConstant(mask);
+    builder->append("((");
+    visit(headers);
+    builder->appendFormat(".ebpf_valid_mask & %s) == %s)", constant.c_str(),
+                          constant.c_str());
+}
+
+// With --validityMask, the isValid() tests next to each other in a chain of && on the
+// same headers become one test of their mask
+bool ControlBodyTranslationVisitor::preorder(const IR::LAnd* expression) {
+    if (!control->program->validityMask)
+        return CodeGenInspector::preorder(expression->to<IR::Operation_Binary>());
+    std::vector<const IR::Expression*> terms;
+    conjuncts(expression, &terms);
+    builder->append("(");
+    for (size_t i = 0; i < terms.size(); ) {
+        if (i > 0)
+            builder->append(" && ");
+        const IR::PathExpression *headers, *next;
+        unsigned bit;
+        if (!isValidTest(terms[i], &headers, &bit)) {
+            visit(terms[i++]);
+            continue;
+        }
+        uint64_t mask = 1ull << bit;
+        for (i++; i < terms.size() && isValidTest(terms[i], &next, &bit) &&
+                  next->path->name == headers->path->name; i++)
+            mask |= 1ull << bit;
+        emitValidTest(headers, mask);
+    }
+    builder->append(")");
+    return false;
+}
+
+// With --validityMask the valid bit of a header is not in its struct, so an assignment
+// of a header copies it on its own
+bool ControlBodyTranslationVisitor::preorder(const IR::AssignmentStatement* a) {
+    auto program = control->program;
+    auto type = program->typeMap->getType(a->left, true);
+    if (!program->validityMask || !type->is<IR::Type_Header>())
+        return CodeGenInspector::preorder(a);
+    const IR::PathExpression *left, *right;
+    unsigned leftBit, rightBit;
+    if (!program->getValidBit(a->left, &left, &leftBit) ||
+        !program->getValidBit(a->right, &right, &rightBit)) {
+        ::error("%1%: --validityMask supports assignments of headers only between headers "
+                "in the headers parameter", a);
+        return false;
+    }
+    CodeGenInspector::preorder(a);
+    builder->newline();
+    builder->emitIndent();
+    visit(left);
+    builder->append(".ebpf_valid_mask = (");
+    visit(left);
+    builder->appendFormat(".ebpf_valid_mask & ~%s) | ((",
+                          program->validMaskConstant(1ull << leftBit).c_str());
+    visit(right);
+    builder->appendFormat(".ebpf_valid_mask >> %u & 1) << %u)", rightBit, leftBit);
+    builder->endOfStatement();
+    return false;
+}
+
 bool ControlBodyTranslationVisitor::preorder(const IR::PathExpression* expression) {
     auto decl = control->program->refMap->getDeclaration(expression->path, true);
     auto param = decl->getNode()->to<IR::Parameter>();
@@ -68,7 +165,18 @@ bool ControlBodyTranslationVisitor::preorder(const IR::MethodCallExpression* exp
         return false;
     }
     auto bim = mi->to<P4::BuiltInMethod>();
+    const IR::PathExpression* headers;
+    unsigned bit;
+    if (isValidTest(expression, &headers, &bit)) {
+        emitValidTest(headers, 1ull << bit);
+        return false;
+    }
     if (bim != nullptr && bim->name == IR::Type_Header::isValid) {
+        if (control->program->validityMask) {
+            ::error("%1%: --validityMask needs the header to be in the headers parameter",
+                    bim->appliedTo);
+            return false;
+        }
         visit(bim->appliedTo);
         builder->append(".ebpf_valid");
         return false;
@@ -121,6 +229,11 @@ void ControlBodyTranslationVisitor::processApply(const P4::ApplyMethod* method)
     }
     builder->blockStart();
 
+    if (control->program->tableTime) {
+        builder->emitIndent();
+        builder->appendLine("u64 ebpf_start = bpf_ktime_get_ns();");
+    }
+
     if (!binding.empty()) {
         builder->emitIndent();
         builder->appendLine("/* bind parameters */");
@@ -157,11 +270,12 @@ void ControlBodyTranslationVisitor::processApply(const P4::ApplyMethod* method)
     builder->appendFormat("struct %s *%s", table->valueTypeName, valueName);
     builder->endOfStatement(true);
 
+    if (table->constDefaultAction != nullptr)
+        table->emitConstDefault(builder, "ebpf_defaultAction");
+
     builder->emitIndent();
     builder->appendLine("/* perform lookup */");
-    builder->emitIndent();
-    builder->target->emitTableLookup(builder, table->dataMapName, keyname, valueName);
-    builder->endOfStatement(true);
+    table->emitLookup(builder, keyname, valueName);
 
     builder->emitIndent();
     builder->appendFormat("if (%s == NULL) ", valueName);
@@ -172,17 +286,42 @@ void ControlBodyTranslationVisitor::processApply(const P4::ApplyMethod* method)
     builder->emitIndent();
     builder->appendFormat("%s = 0", control->hitVariable);
     builder->endOfStatement(true);
+    if (control->program->tableStats)
+        control->emitStatAdd(builder, Util::toString(table->statsIndex + 1), "1");
 
-    builder->emitIndent();
-    builder->target->emitTableLookup(builder, table->defaultActionMapName,
-                                     control->program->zeroKey, valueName);
-    builder->endOfStatement(true);
+    if (table->constDefaultAction != nullptr) {
+        builder->emitIndent();
+        builder->appendFormat("%s = &ebpf_defaultAction", valueName.c_str());
+        builder->endOfStatement(true);
+    } else {
+        cstring defaults = control->defaultActionsVariable;
+        builder->emitIndent();
+        builder->appendFormat("if (%s == NULL)", defaults.c_str());
+        builder->newline();
+        builder->increaseIndent();
+        builder->emitIndent();
+        builder->target->emitTableLookup(builder, control->defaultActionsMapName,
+                                         control->program->zeroKey, defaults);
+        builder->endOfStatement(true);
+        builder->decreaseIndent();
+        builder->emitIndent();
+        builder->appendFormat("if (%s != NULL)", defaults.c_str());
+        builder->newline();
+        builder->increaseIndent();
+        builder->emitIndent();
+        builder->appendFormat("%s = &%s->%s", valueName.c_str(), defaults.c_str(),
+                              table->dataMapName.c_str());
+        builder->endOfStatement(true);
+        builder->decreaseIndent();
+    }
     builder->blockEnd(false);
     builder->append(" else ");
     builder->blockStart();
     builder->emitIndent();
     builder->appendFormat("%s = 1", control->hitVariable);
     builder->endOfStatement(true);
+    if (control->program->tableStats)
+        control->emitStatAdd(builder, Util::toString(table->statsIndex), "1");
     builder->blockEnd(true);
 
     builder->emitIndent();
@@ -195,9 +334,16 @@ void ControlBodyTranslationVisitor::processApply(const P4::ApplyMethod* method)
         builder->emitIndent();
         builder->appendFormat("%s = %s->action;\n", actionVariableName, valueName);
     }
+    if (control->program->tableStats)
+        control->emitStatAdd(builder,
+                             Util::toString(table->statsIndex + EBPFTable::statsPerTable) +
+                             " + " + valueName + "->action", "1");
     toDereference.clear();
 
     builder->blockEnd(true);
+    if (control->program->tableTime)
+        control->emitStatAdd(builder, Util::toString(table->statsIndex + 2),
+                             "bpf_ktime_get_ns() - ebpf_start");
     builder->blockEnd(true);
 }
 
@@ -212,8 +358,7 @@ bool ControlBodyTranslationVisitor::preorder(const IR::ReturnStatement*) {
 }
 
 bool ControlBodyTranslationVisitor::preorder(const IR::IfStatement* statement) {
-    bool isHit = P4::TableApplySolver::isHit(statement->condition, control->program->refMap,
-                                             control->program->typeMap);
+    bool isHit = control->applies->isHit(statement->condition) != nullptr;
     if (isHit) {
         // visit first the table, and then the conditional
         auto member = statement->condition->to<IR::Member>();
@@ -293,10 +438,128 @@ bool ControlBodyTranslationVisitor::preorder(const IR::SwitchStatement* statemen
     saveAction.pop_back();
     return false;
 }
+
+class HasCall : public Inspector {
+ public:
+    bool found = false;
+    bool preorder(const IR::MethodCallExpression*) override { found = true; return false; }
+};
+
+// Runs the apply block of the control as far as the valid headers alone decide it: the
+// conditions may only test which headers are valid, and no tables are applied and
+// nothing is called before the verdict
+class VerdictEvaluator {
+    const EBPFControl* control;
+    const std::set<cstring>& valid;
+
+    static bool hasCall(const IR::Node* node) {
+        HasCall calls;
+        node->apply(calls);
+        return calls.found; }
+
+ public:
+    bool accept = false;  // as EBPFProgram initializes it
+    bool finished = false;
+
+    VerdictEvaluator(const EBPFControl* control, const std::set<cstring>& valid) :
+            control(control), valid(valid) {}
+
+    // 1 or 0 if the valid headers decide the condition, else -1
+    int evaluate(const IR::Expression* condition) const {
+        if (auto b = condition->to<IR::BoolLiteral>())
+            return b->value;
+        if (auto lnot = condition->to<IR::LNot>()) {
+            int value = evaluate(lnot->expr);
+            return value < 0 ? value : !value;
+        }
+        if (condition->is<IR::LAnd>() || condition->is<IR::LOr>()) {
+            auto bin = condition->to<IR::Operation_Binary>();
+            int shortCircuit = condition->is<IR::LOr>();
+            int left = evaluate(bin->left);
+            if (left == shortCircuit)
+                return left;
+            int right = evaluate(bin->right);
+            if (left >= 0 || right == shortCircuit)
+                return right;
+            return -1;
+        }
+        if (auto mce = condition->to<IR::MethodCallExpression>()) {
+            auto program = control->program;
+            auto mi = P4::MethodInstance::resolve(mce, program->refMap, program->typeMap);
+            auto bim = mi->to<P4::BuiltInMethod>();
+            if (bim != nullptr && bim->name == IR::Type_Header::isValid) {
+                cstring path = program->headerPath(bim->appliedTo);
+                if (!path.isNullOrEmpty())
+                    return valid.count(path) > 0;
+            }
+        }
+        return -1;
+    }
+
+    // false if statement needs more than the valid headers
+    bool run(const IR::StatOrDecl* statement) {
+        if (finished)
+            return true;
+        if (auto block = statement->to<IR::BlockStatement>()) {
+            for (auto c : *block->components) {
+                if (!run(c))
+                    return false;
+            }
+            return true;
+        }
+        if (auto var = statement->to<IR::Declaration_Variable>())
+            return var->initializer == nullptr || !hasCall(var->initializer);
+        if (statement->is<IR::Declaration>() || statement->is<IR::EmptyStatement>())
+            return true;
+        if (statement->is<IR::ReturnStatement>() || statement->is<IR::ExitStatement>()) {
+            finished = true;
+            return true;
+        }
+        if (auto assign = statement->to<IR::AssignmentStatement>()) {
+            auto program = control->program;
+            if (auto pe = assign->left->to<IR::PathExpression>()) {
+                if (program->refMap->getDeclaration(pe->path, true) == control->accept) {
+                    auto b = assign->right->to<IR::BoolLiteral>();
+                    if (b == nullptr)
+                        return false;
+                    accept = b->value;
+                    return true;
+                }
+            }
+            // the other assignments only matter when a header is copied with its valid bit
+            return !program->typeMap->getType(assign->left, true)->is<IR::Type_Header>() &&
+                   !hasCall(assign->right);
+        }
+        if (auto ifs = statement->to<IR::IfStatement>()) {
+            int condition = evaluate(ifs->condition);
+            if (condition < 0)
+                return false;
+            auto next = condition ? ifs->ifTrue : ifs->ifFalse;
+            return next == nullptr || run(next);
+        }
+        if (auto mcs = statement->to<IR::MethodCallStatement>()) {
+            auto program = control->program;
+            auto mi = P4::MethodInstance::resolve(mcs->methodCall, program->refMap,
+                                                  program->typeMap);
+            // Action arguments have been eliminated by the mid-end.
+            if (auto ac = mi->to<P4::ActionCall>())
+                return mcs->methodCall->arguments->size() == 0 && run(ac->action->body);
+        }
+        return false;
+    }
+};
 }  // namespace
 
 /////////////////////////////////////////////////
 
+bool EBPFControl::verdict(const std::set<cstring>& valid, bool* pass) const {
+    VerdictEvaluator evaluator(this, valid);
+    if (!evaluator.run(controlBlock->container->body))
+        return false;
+    *pass = evaluator.accept;
+    return true;
+}
+
 EBPFControl::EBPFControl(const EBPFProgram* program,
                          const IR::ControlBlock* block) :
         program(program), controlBlock(block), headers(nullptr), accept(nullptr) {}
@@ -313,6 +576,13 @@ bool EBPFControl::build() {
     headers = *it;
     ++it;
     accept = *it;
+    stages.push_back(controlBlock->container->body);
+    applies = new P4::TableApplyIndex(program->refMap, program->typeMap);
+    controlBlock->container->body->apply(*applies);
+    if (program->tableStats) {
+        statsMapName = program->refMap->newName("ebpf_tableStats");
+        statsEnumName = program->refMap->newName("ebpf_tableStats_index");
+    }
 
     for (auto c : controlBlock->constantValue) {
         auto b = c.second;
@@ -321,6 +591,13 @@ bool EBPFControl::build() {
             auto tblblk = b->to<IR::TableBlock>();
             auto tbl = new EBPFTable(program, tblblk);
             tables.emplace(tblblk->container->name, tbl);
+            if (tbl->constDefaultAction == nullptr && defaultActionsMapName.isNullOrEmpty()) {
+                defaultActionsMapName = program->refMap->newName("ebpf_defaultActions");
+                defaultActionsTypeName = program->refMap->newName("ebpf_defaultActions_value");
+                defaultActionsVariable = program->refMap->newName("ebpf_defaults");
+            }
+            tbl->statsIndex = statsSize;
+            statsSize += tbl->statsCount();
         } else if (b->is<IR::ExternBlock>()) {
             auto ctrblk = b->to<IR::ExternBlock>();
             auto node = ctrblk->node;
@@ -356,23 +633,210 @@ void EBPFControl::emitDeclaration(const IR::Declaration* decl, CodeBuilder* buil
 }
 
 void EBPFControl::emit(CodeBuilder* builder) {
+    emitLocals(builder);
+    emitStage(builder, 0);
+}
+
+void EBPFControl::emitLocals(CodeBuilder* builder) {
     auto hitType = EBPFTypeFactory::instance->create(IR::Type_Boolean::get());
     builder->emitIndent();
     hitType->declare(builder, hitVariable, false);
     builder->endOfStatement(true);
+    if (!defaultActionsVariable.isNullOrEmpty()) {
+        builder->emitIndent();
+        builder->appendFormat("struct %s *%s = NULL", defaultActionsTypeName.c_str(),
+                              defaultActionsVariable.c_str());
+        builder->endOfStatement(true);
+    }
     for (auto a : *controlBlock->container->controlLocals)
         emitDeclaration(a, builder);
+}
+
+void EBPFControl::setStages(const std::vector<const IR::BlockStatement*>& split) {
+    stages = split;
+    if (stages.size() < 2)
+        return;
+    stagesMapName = program->refMap->newName("ebpf_stages");
+    scratchMapName = program->refMap->newName("ebpf_scratch");
+    scratchTypeName = program->refMap->newName("ebpf_scratch_value");
+    scratchVariable = program->refMap->newName("ebpf_saved");
+}
+
+void EBPFControl::emitStage(CodeBuilder* builder, unsigned stage) {
     builder->emitIndent();
     ControlBodyTranslationVisitor psi(this, builder);
-    controlBlock->container->body->apply(psi);
+    stages.at(stage)->apply(psi);
+    builder->newline();
+    if (stage + 1 == stages.size())
+        return;
+
+    cstring headersName = program->parser->headers->name.name;
+    builder->emitIndent();
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendFormat("struct %s *%s", scratchTypeName.c_str(), scratchVariable.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->target->emitTableLookup(builder, scratchMapName, program->zeroKey,
+                                     scratchVariable);
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("if (%s != NULL) ", scratchVariable.c_str());
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendFormat("%s->%s = %s", scratchVariable.c_str(), headersName.c_str(),
+                          headersName.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("%s->%s = %s", scratchVariable.c_str(),
+                          accept->name.name.c_str(), accept->name.name.c_str());
+    builder->endOfStatement(true);
+    for (auto d : *controlBlock->container->controlLocals) {
+        if (!d->is<IR::Declaration_Variable>())
+            continue;
+        builder->emitIndent();
+        builder->appendFormat("%s->%s = %s", scratchVariable.c_str(),
+                              d->getName().name.c_str(), d->getName().name.c_str());
+        builder->endOfStatement(true);
+    }
+    builder->emitIndent();
+    builder->target->emitTailCall(builder, stagesMapName, program->model.CPacketName.str(),
+                                  stage + 1);
+    builder->newline();
+    builder->blockEnd(true);
+    builder->blockEnd(true);
+    // only reached if the tail call fails: the packet gets the verdict of this stage
+}
+
+void EBPFControl::emitRestore(CodeBuilder* builder) {
+    cstring headersName = program->parser->headers->name.name;
+    builder->emitIndent();
+    builder->appendFormat("struct %s *%s", scratchTypeName.c_str(), scratchVariable.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->target->emitTableLookup(builder, scratchMapName, program->zeroKey,
+                                     scratchVariable);
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("if (%s == NULL)", scratchVariable.c_str());
+    builder->newline();
+    builder->increaseIndent();
+    builder->emitIndent();
+    builder->appendFormat("goto %s;", program->endLabel.c_str());
+    builder->newline();
+    builder->decreaseIndent();
+    builder->emitIndent();
+    builder->appendFormat("%s = %s->%s", headersName.c_str(), scratchVariable.c_str(),
+                          headersName.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("%s = %s->%s", accept->name.name.c_str(),
+                          scratchVariable.c_str(), accept->name.name.c_str());
+    builder->endOfStatement(true);
+    for (auto d : *controlBlock->container->controlLocals) {
+        if (!d->is<IR::Declaration_Variable>())
+            continue;
+        builder->emitIndent();
+        builder->appendFormat("%s = %s->%s", d->getName().name.c_str(),
+                              scratchVariable.c_str(), d->getName().name.c_str());
+        builder->endOfStatement(true);
+    }
+}
+
+void EBPFControl::emitStatsLegend(CodeBuilder* builder) {
+    builder->emitIndent();
+    builder->appendFormat("/* The indexes of the counters in %s */", statsMapName.c_str());
     builder->newline();
+    builder->emitIndent();
+    builder->appendFormat("enum %s ", statsEnumName.c_str());
+    builder->blockStart();
+    for (auto it : tables)
+        it.second->emitStatsLegend(builder);
+    builder->blockEnd(false);
+    builder->endOfStatement(true);
+}
+
+void EBPFControl::emitStatAdd(CodeBuilder* builder, cstring index, cstring amount) const {
+    builder->emitIndent();
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendFormat("u32 ebpf_statIndex = %s", index.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendLine("u64 *ebpf_stat;");
+    builder->emitIndent();
+    builder->target->emitTableLookup(builder, statsMapName, "ebpf_statIndex", "ebpf_stat");
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendLine("if (ebpf_stat != NULL)");
+    builder->increaseIndent();
+    builder->emitIndent();
+    builder->appendFormat("*ebpf_stat += %s", amount.c_str());
+    builder->endOfStatement(true);
+    builder->decreaseIndent();
+    builder->blockEnd(true);
 }
 
 void EBPFControl::emitTables(CodeBuilder* builder) {
     for (auto it : tables)
         it.second->emit(builder);
+
+    if (!defaultActionsMapName.isNullOrEmpty()) {
+        builder->emitIndent();
+        builder->appendFormat("struct %s ", defaultActionsTypeName.c_str());
+        builder->blockStart();
+        for (auto it : tables) {
+            auto table = it.second;
+            if (table->constDefaultAction != nullptr)
+                continue;
+            builder->emitIndent();
+            builder->appendFormat("struct %s %s", table->valueTypeName.c_str(),
+                                  table->dataMapName.c_str());
+            builder->endOfStatement(true);
+        }
+        builder->blockEnd(false);
+        builder->endOfStatement(true);
+        builder->emitIndent();
+        builder->target->emitTableDecl(builder, defaultActionsMapName, TableArray,
+                                       program->arrayIndexType,
+                                       cstring("struct ") + defaultActionsTypeName, 1);
+    }
     for (auto it : counters)
         it.second->emit(builder);
+
+    if (program->tableStats) {
+        emitStatsLegend(builder);
+        builder->emitIndent();
+        builder->target->emitTableDecl(builder, statsMapName, TablePerCpuArray,
+                                       program->arrayIndexType, "u64", statsSize);
+    }
+
+    if (stages.size() > 1) {
+        builder->emitIndent();
+        builder->appendFormat("struct %s ", scratchTypeName.c_str());
+        builder->blockStart();
+        builder->emitIndent();
+        program->parser->headerType->declare(builder, program->parser->headers->name.name,
+                                              false);
+        builder->endOfStatement(true);
+        builder->emitIndent();
+        builder->appendFormat("u8 %s", accept->name.name.c_str());
+        builder->endOfStatement(true);
+        for (auto d : *controlBlock->container->controlLocals) {
+            if (d->is<IR::Declaration_Variable>())
+                emitDeclaration(d, builder);
+        }
+        builder->blockEnd(false);
+        builder->endOfStatement(true);
+        builder->emitIndent();
+        builder->target->emitTableDecl(builder, scratchMapName, TablePerCpuArray,
+                                       program->arrayIndexType,
+                                       cstring("struct ") + scratchTypeName, 1);
+        builder->emitIndent();
+        builder->target->emitTableDecl(builder, stagesMapName, TableProgArray,
+                                       program->arrayIndexType, program->arrayIndexType,
+                                       stages.size());
+    }
 }
 
 }  // namespace EBPF
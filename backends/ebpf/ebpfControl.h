@@ -19,6 +19,7 @@ limitations under the License.
 
 #include "ebpfObject.h"
 #include "ebpfTable.h"
+#include "frontends/p4/tableApply.h"
 
 namespace EBPF {
 
@@ -29,17 +30,53 @@ class EBPFControl : public EBPFObject {
     const IR::Parameter*    headers;
     const IR::Parameter*    accept;
     cstring                 hitVariable;
+    // An array with one entry, holding the default actions of all the tables whose
+    // default action is not const, in a struct with a field for each, which the
+    // program looks up at most once for each packet, when a table first misses.
+    cstring                 defaultActionsMapName;
+    cstring                 defaultActionsTypeName;
+    cstring                 defaultActionsVariable;
+    // The apply block, in stages that are separate eBPF programs: each stage saves the
+    // headers, accept and the control locals in a per-CPU array with one entry, and
+    // tail-calls the next one through the program array stagesMapName.  There is a
+    // single stage unless EBPFBudget splits a control that has too many instructions.
+    std::vector<const IR::BlockStatement*> stages;
+    cstring                 stagesMapName;
+    cstring                 scratchMapName;
+    cstring                 scratchTypeName;
+    cstring                 scratchVariable;
+    // With --tableStats, a per-CPU array of u64 counters for all the tables, whose
+    // indexes are named by the enum statsEnumName
+    cstring                 statsMapName;
+    cstring                 statsEnumName;
+    unsigned                statsSize = 0;
 
     std::set<const IR::Parameter*> toDereference;
     std::map<cstring, EBPFTable*>  tables;
+    // where the body applies the tables, found once for the code generators
+    P4::TableApplyIndex*           applies = nullptr;
     std::map<cstring, EBPFCounterTable*>  counters;
 
     explicit EBPFControl(const EBPFProgram* program, const IR::ControlBlock* block);
     virtual ~EBPFControl() {}
+    // The locals of the control, and its first stage
     void emit(CodeBuilder* builder);
+    void emitLocals(CodeBuilder* builder);
+    // The statements of a stage, and the tail call to the next one if there is one
+    void emitStage(CodeBuilder* builder, unsigned stage);
+    // Copies the headers, accept and the locals from the array that the previous stage
+    // saved them in; jumps to the end of the program if the array cannot be read
+    void emitRestore(CodeBuilder* builder);
+    void setStages(const std::vector<const IR::BlockStatement*>& split);
+    void emitStatsLegend(CodeBuilder* builder);
+    // Adds amount to the counter at index of the stats map
+    void emitStatAdd(CodeBuilder* builder, cstring index, cstring amount) const;
     void emitDeclaration(const IR::Declaration* decl, CodeBuilder *builder);
     void emitTables(CodeBuilder* builder);
     bool build();
+    // Whether the control passes the packet when exactly the headers in valid are valid,
+    // as paths in the headers, if that alone decides it; false if it does not
+    bool verdict(const std::set<cstring>& valid, bool* pass) const;
     EBPFTable* getTable(cstring name) const {
         auto result = get(tables, name);
         BUG_CHECK(result != nullptr, "No table named %1%", name);
@@ -0,0 +1,165 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "ebpfElf.h"
+
+namespace EBPF {
+
+namespace {
+// The constants of the ELF specification that an eBPF object uses
+enum {
+    ET_REL = 1, EM_BPF = 247,
+    SHT_PROGBITS = 1, SHT_SYMTAB = 2, SHT_STRTAB = 3, SHT_REL = 9,
+    SHF_WRITE = 1, SHF_ALLOC = 2, SHF_EXECINSTR = 4,
+    STB_GLOBAL = 1, STT_OBJECT = 1, STT_FUNC = 2,
+    R_BPF_64_64 = 1,
+};
+// The fields of KernelSamplesTarget's struct bpf_map_def: type, key_size, value_size,
+// max_entries, map_flags, id and pinning
+const unsigned mapDefSize = 7 * 4;
+
+// Appends little-endian integers, whatever the byte order of the host
+class Bytes {
+ public:
+    std::vector<char> data;
+    void u8(uint64_t v) { data.push_back(static_cast<char>(v)); }
+    void u16(uint64_t v) { u8(v); u8(v >> 8); }
+    void u32(uint64_t v) { u16(v); u16(v >> 16); }
+    void u64(uint64_t v) { u32(v); u32(v >> 32); }
+    void align(unsigned to) { while (data.size() % to) u8(0); }
+    // a NUL-terminated string; returns its offset, as in a string table
+    uint32_t str(cstring s) {
+        uint32_t at = data.size();
+        data.insert(data.end(), s.c_str(), s.c_str() + s.size() + 1);
+        return at; }
+};
+
+struct Section {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    const Bytes* bytes;
+    uint32_t link, info;
+    uint64_t align, entsize;
+    uint64_t offset;
+};
+}  // namespace
+
+void ElfObject::write(std::ostream &out) const {
+    enum { TEXT = 1, MAPS, LICENSE, REL, SYMTAB, STRTAB, SHSTRTAB, SECTIONS };
+
+    Bytes text, mapDefs, licenseText, rel, symtab, strtab, shstrtab;
+    for (auto &i : code) {
+        text.u8(i.code);
+        text.u8(i.regs);
+        text.u16(uint16_t(i.off));
+        text.u32(uint32_t(i.imm));
+    }
+    for (auto &m : maps) {
+        mapDefs.u32(m.type);
+        mapDefs.u32(m.keySize);
+        mapDefs.u32(m.valueSize);
+        mapDefs.u32(m.maxEntries);
+        mapDefs.u32(m.flags);
+        mapDefs.u32(0);
+        mapDefs.u32(0);
+    }
+    licenseText.str(license);
+
+    // all the symbols are global: the maps, then the license and the function
+    strtab.str("");
+    auto symbol = [&](cstring name, unsigned type, unsigned shndx,
+                      uint64_t value, uint64_t size) {
+        symtab.u32(strtab.str(name));
+        symtab.u8((STB_GLOBAL << 4) | type);
+        symtab.u8(0);
+        symtab.u16(shndx);
+        symtab.u64(value);
+        symtab.u64(size); };
+    symtab.data.resize(24);  // the null symbol
+    for (unsigned i = 0; i < maps.size(); i++)
+        symbol(maps[i].name, STT_OBJECT, MAPS, i * mapDefSize, mapDefSize);
+    symbol("_license", STT_OBJECT, LICENSE, 0, licenseText.data.size());
+    symbol(function, STT_FUNC, TEXT, 0, text.data.size());
+
+    for (auto &r : relocations) {
+        rel.u64(uint64_t(r.first) * 8);
+        rel.u64((uint64_t(r.second + 1) << 32) | R_BPF_64_64);
+    }
+
+    shstrtab.str("");
+    Section sections[SECTIONS] = {
+        { 0, 0, 0, nullptr, 0, 0, 0, 0, 0 },
+        { shstrtab.str(section), SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, &text,
+          0, 0, 8, 0, 0 },
+        { shstrtab.str("maps"), SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, &mapDefs, 0, 0, 4, 0, 0 },
+        { shstrtab.str("license"), SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, &licenseText,
+          0, 0, 1, 0, 0 },
+        { shstrtab.str(cstring(".rel") + section), SHT_REL, 0, &rel, SYMTAB, TEXT, 8, 16, 0 },
+        { shstrtab.str(".symtab"), SHT_SYMTAB, 0, &symtab, STRTAB, 1, 8, 24, 0 },
+        { shstrtab.str(".strtab"), SHT_STRTAB, 0, &strtab, 0, 0, 1, 0, 0 },
+        { shstrtab.str(".shstrtab"), SHT_STRTAB, 0, &shstrtab, 0, 0, 1, 0, 0 },
+    };
+
+    // the header, the contents of the sections, and the section headers
+    Bytes file;
+    file.data.resize(64);
+    for (unsigned i = 1; i < SECTIONS; i++) {
+        file.align(sections[i].align);
+        sections[i].offset = file.data.size();
+        file.data.insert(file.data.end(), sections[i].bytes->data.begin(),
+                         sections[i].bytes->data.end());
+    }
+    file.align(8);
+    uint64_t sectionHeaders = file.data.size();
+    for (auto &s : sections) {
+        file.u32(s.name);
+        file.u32(s.type);
+        file.u64(s.flags);
+        file.u64(0);
+        file.u64(s.offset);
+        file.u64(s.bytes != nullptr ? s.bytes->data.size() : 0);
+        file.u32(s.link);
+        file.u32(s.info);
+        file.u64(s.align);
+        file.u64(s.entsize);
+    }
+
+    Bytes header;
+    const char ident[16] = { 0x7f, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* little-endian */,
+                             1 /* version */ };
+    header.data.assign(ident, ident + sizeof(ident));
+    header.u16(ET_REL);
+    header.u16(EM_BPF);
+    header.u32(1);
+    header.u64(0);                // entry
+    header.u64(0);                // program headers
+    header.u64(sectionHeaders);
+    header.u32(0);                // flags
+    header.u16(64);               // size of this header
+    header.u16(0);
+    header.u16(0);
+    header.u16(64);               // size of a section header
+    header.u16(SECTIONS);
+    header.u16(SHSTRTAB);
+    std::copy(header.data.begin(), header.data.end(), file.data.begin());
+
+    out.write(file.data.data(), file.data.size());
+}
+
+}  // namespace EBPF
@@ -0,0 +1,72 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_EBPF_EBPFELF_H_
+#define _BACKENDS_EBPF_EBPFELF_H_
+
+#include <stdint.h>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "lib/cstring.h"
+
+namespace EBPF {
+
+// An eBPF instruction, as the kernel reads it
+struct BpfInsn {
+    uint8_t  code;
+    uint8_t  regs;  // the destination register in the low 4 bits, the source in the high
+    int16_t  off;
+    int32_t  imm;
+
+    BpfInsn(uint8_t code, unsigned dst, unsigned src, int16_t off, int32_t imm) :
+            code(code), regs(uint8_t(dst | (src << 4))), off(off), imm(imm) {}
+};
+
+// A map, as the struct bpf_map_def that KernelSamplesTarget declares in section "maps"
+struct BpfMapDef {
+    cstring  name;
+    uint32_t type;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t maxEntries;
+    uint32_t flags;
+};
+
+// A relocatable 64-bit little-endian ELF object with one eBPF program, in the layout
+// that clang gives the C of the kernel target: the program in a section of its own,
+// with a symbol for the function; the map definitions in "maps", each with a symbol;
+// the license in "license"; and a relocation against the symbol of the map for each
+// instruction that loads the address of a map.  Loaders such as bpf_load.c of the
+// kernel samples create the maps and patch these instructions with their descriptors.
+class ElfObject {
+ public:
+    cstring section;
+    cstring function;
+    cstring license;
+    std::vector<BpfInsn> code;
+    std::vector<BpfMapDef> maps;
+    // the index in code of a 16-byte map address load, and the index of the map
+    std::vector<std::pair<unsigned, unsigned>> relocations;
+
+    // The same bytes for the same program
+    void write(std::ostream &out) const;
+};
+
+}  // namespace EBPF
+
+#endif /* _BACKENDS_EBPF_EBPFELF_H_ */
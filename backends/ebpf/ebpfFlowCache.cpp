@@ -0,0 +1,319 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <set>
+
+#include "ebpfFlowCache.h"
+#include "ebpfControl.h"
+#include "ebpfParser.h"
+
+namespace EBPF {
+
+namespace {
+// The header fields and the headers whose valid bits the control reads, by their
+// paths in the headers; a header or a struct of headers that it uses whole stands
+// for all its fields
+class FieldReads : public Inspector {
+    const EBPFProgram* program;
+    std::vector<std::pair<cstring, const IR::Type*>>* fields;
+    std::vector<cstring>* valid;
+
+    bool use(const IR::Expression* expression) {
+        cstring path = program->headerPath(expression);
+        if (path.isNull())
+            return true;
+        auto type = program->typeMap->getType(expression, true);
+        if (type->is<IR::Type_Bits>() || type->is<IR::Type_Boolean>()) {
+            fields->emplace_back(path, type);
+            return false;
+        }
+        if (!type->is<IR::Type_StructLike>())
+            return true;  // such as the method of isValid()
+        if (getParent<IR::Member>() != nullptr) {
+            // isValid(), setValid() or setInvalid(); the members that are fields are
+            // scalars, found above
+            if (type->is<IR::Type_Header>())
+                valid->push_back(path);
+            return false;
+        }
+        fields->emplace_back(path, type);
+        return false;
+    }
+
+ public:
+    FieldReads(const EBPFProgram* program,
+               std::vector<std::pair<cstring, const IR::Type*>>* fields,
+               std::vector<cstring>* valid) :
+            program(program), fields(fields), valid(valid) {}
+    bool preorder(const IR::Member* expression) override { return use(expression); }
+    bool preorder(const IR::PathExpression* expression) override {
+        use(expression);
+        return false; }
+};
+
+// path.member, or member for the headers themselves
+cstring join(cstring path, cstring member) {
+    return path.isNullOrEmpty() ? member : path + "." + member;
+}
+}  // namespace
+
+EBPFFlowCache::EBPFFlowCache(const EBPFProgram* program, unsigned size) :
+        program(program), size(size) {
+    auto refMap = program->refMap;
+    mapName = refMap->newName("ebpf_flowCache");
+    generationMapName = refMap->newName("ebpf_flowGeneration");
+    keyTypeName = refMap->newName("ebpf_flowCache_key");
+    valueTypeName = refMap->newName("ebpf_flowCache_value");
+    keyVariable = refMap->newName("ebpf_flow");
+    missVariable = refMap->newName("ebpf_flowMiss");
+    generationVariable = refMap->newName("ebpf_generation");
+}
+
+void EBPFFlowCache::addField(cstring path, const IR::Type* type) {
+    cstring name = program->parser->headers->name.name + "." + path;
+    for (auto& f : fields) {
+        if (f.first == name)
+            return;
+    }
+    fields.emplace_back(name, EBPFTypeFactory::instance->create(type));
+}
+
+void EBPFFlowCache::addValid(cstring path) {
+    if (program->validityMask)
+        addField("ebpf_valid_mask",
+                 IR::Type_Bits::get(program->validBits.size() <= 32 ? 32 : 64));
+    else
+        addField(path + ".ebpf_valid", IR::Type_Boolean::get());
+}
+
+void EBPFFlowCache::addAll(cstring path, const IR::Type* type) {
+    if (type->is<IR::Type_Name>())
+        type = program->typeMap->getTypeType(type, true);
+    if (type->is<IR::Type_Bits>() || type->is<IR::Type_Boolean>()) {
+        addField(path, type);
+    } else if (auto st = type->to<IR::Type_StructLike>()) {
+        if (st->is<IR::Type_Header>())
+            addValid(path);
+        for (auto f : *st->fields)
+            addAll(join(path, f->name.name), f->type);
+    } else {
+        ::error("%1%: --flowCache does not support reading headers of this type", type);
+    }
+}
+
+bool EBPFFlowCache::build() {
+    auto control = program->control;
+    if (!control->counters.empty()) {
+        ::error("%1%: --flowCache is not supported with counters, which a cached verdict "
+                "would not count", control->counters.begin()->first);
+        return false;
+    }
+    if (program->tableStats) {
+        ::error("--flowCache is not supported with --tableStats or --tableTime");
+        return false;
+    }
+
+    std::vector<std::pair<cstring, const IR::Type*>> reads;
+    std::vector<cstring> valid;
+    FieldReads visitor(program, &reads, &valid);
+    control->controlBlock->container->apply(visitor);
+    for (auto& r : reads)
+        addAll(r.first, r.second);
+    for (auto v : valid)
+        addValid(v);
+    return ::errorCount() == 0;
+}
+
+unsigned EBPFFlowCache::keySize() const {
+    unsigned bytes = 0, align = 1;
+    for (auto& f : fields) {
+        unsigned fieldAlign = f.second->alignInBytes();
+        bytes = ROUNDUP(bytes, fieldAlign) * fieldAlign + f.second->sizeInBytes();
+        align = std::max(align, fieldAlign);
+    }
+    return std::max(1U, ROUNDUP(bytes, align) * align);
+}
+
+void EBPFFlowCache::emit(CodeBuilder* builder) {
+    builder->emitIndent();
+    builder->appendFormat("struct %s ", keyTypeName.c_str());
+    builder->blockStart();
+    unsigned number = 0;
+    for (auto& f : fields) {
+        builder->emitIndent();
+        builder->appendFormat("/* %s */", f.first.c_str());
+        builder->newline();
+        builder->emitIndent();
+        f.second->declare(builder, cstring("field") + Util::toString(number++), false);
+        builder->endOfStatement(true);
+    }
+    if (fields.empty()) {
+        // the control reads nothing from the packet
+        builder->emitIndent();
+        builder->appendLine("u8 none;");
+    }
+    builder->blockEnd(false);
+    builder->endOfStatement(true);
+
+    builder->emitIndent();
+    builder->appendFormat("struct %s ", valueTypeName.c_str());
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendLine("u32 generation;");
+    builder->emitIndent();
+    builder->appendFormat("u8 %s;", program->control->accept->name.name.c_str());
+    builder->newline();
+    builder->blockEnd(false);
+    builder->endOfStatement(true);
+
+    builder->emitIndent();
+    builder->target->emitTableDecl(builder, mapName, TablePerCpuLRUHash,
+                                   cstring("struct ") + keyTypeName,
+                                   cstring("struct ") + valueTypeName, size);
+    builder->emitIndent();
+    builder->target->emitTableDecl(builder, generationMapName, TableArray,
+                                   program->arrayIndexType, "u32", 1);
+}
+
+void EBPFFlowCache::emitLocals(CodeBuilder* builder) {
+    builder->emitIndent();
+    builder->appendFormat("struct %s %s", keyTypeName.c_str(), keyVariable.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("u8 %s = 0", missVariable.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("u32 %s = 0", generationVariable.c_str());
+    builder->endOfStatement(true);
+}
+
+void EBPFFlowCache::emitLookup(CodeBuilder* builder) {
+    cstring key = keyVariable;
+    builder->emitIndent();
+    builder->appendLine("/* the flow cache */");
+    // the padding too, which the hash covers
+    builder->emitIndent();
+    builder->appendFormat("__builtin_memset(&%s, 0, sizeof(%s))", key.c_str(), key.c_str());
+    builder->endOfStatement(true);
+    unsigned number = 0;
+    for (auto& f : fields) {
+        builder->emitIndent();
+        auto st = dynamic_cast<EBPFScalarType*>(f.second);
+        if (st != nullptr && !EBPFScalarType::generatesScalar(st->width))
+            builder->appendFormat("__builtin_memcpy(%s.field%d, %s, %d)", key.c_str(), number,
+                                  f.first.c_str(), st->bytesRequired());
+        else
+            builder->appendFormat("%s.field%d = %s", key.c_str(), number, f.first.c_str());
+        builder->endOfStatement(true);
+        number++;
+    }
+
+    builder->emitIndent();
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendLine("u32 *ebpf_generation_entry;");
+    builder->emitIndent();
+    builder->appendFormat("struct %s *ebpf_cached", valueTypeName.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->target->emitTableLookup(builder, generationMapName, program->zeroKey,
+                                     "ebpf_generation_entry");
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->append("if (ebpf_generation_entry != NULL) ");
+    builder->blockStart();
+    builder->emitIndent();
+    builder->target->emitTableLookup(builder, mapName, key, "ebpf_cached");
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->append("if (ebpf_cached != NULL && "
+                    "ebpf_cached->generation == *ebpf_generation_entry) ");
+    builder->blockStart();
+    cstring accept = program->control->accept->name.name;
+    builder->emitIndent();
+    builder->appendFormat("%s = ebpf_cached->%s", accept.c_str(), accept.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("goto %s;", program->endLabel.c_str());
+    builder->newline();
+    builder->blockEnd(true);
+    builder->emitIndent();
+    builder->appendFormat("%s = 1", missVariable.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("%s = *ebpf_generation_entry", generationVariable.c_str());
+    builder->endOfStatement(true);
+    builder->blockEnd(true);
+    builder->blockEnd(true);
+}
+
+void EBPFFlowCache::emitRecord(CodeBuilder* builder) {
+    builder->emitIndent();
+    builder->appendFormat("if (%s) ", missVariable.c_str());
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendFormat("struct %s ebpf_verdict", valueTypeName.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->appendFormat("ebpf_verdict.generation = %s", generationVariable.c_str());
+    builder->endOfStatement(true);
+    cstring accept = program->control->accept->name.name;
+    builder->emitIndent();
+    builder->appendFormat("ebpf_verdict.%s = %s", accept.c_str(), accept.c_str());
+    builder->endOfStatement(true);
+    builder->emitIndent();
+    builder->target->emitTableUpdate(builder, mapName, keyVariable, "ebpf_verdict");
+    builder->newline();
+    builder->blockEnd(true);
+}
+
+void EBPFFlowCache::emitControlPlane(CodeBuilder* builder) {
+    const char* name = generationMapName.c_str();
+    builder->appendFormat("#define %s_MAP \"%s\"", name, name);
+    builder->newline();
+    builder->appendLine("/* Makes the verdicts in the flow cache stale; call it after writing "
+                        "the tables */");
+    builder->appendFormat("static inline int %s_increment(int fd)", name);
+    builder->newline();
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendLine("union bpf_attr attr;");
+    builder->emitIndent();
+    builder->appendLine("u32 key = 0, generation;");
+    builder->newline();
+    builder->emitIndent();
+    builder->appendLine("memset(&attr, 0, sizeof(attr));");
+    builder->emitIndent();
+    builder->appendLine("attr.map_fd = fd;");
+    builder->emitIndent();
+    builder->appendLine("attr.key = (uintptr_t)&key;");
+    builder->emitIndent();
+    builder->appendLine("attr.value = (uintptr_t)&generation;");
+    builder->emitIndent();
+    builder->appendLine("if (syscall(__NR_bpf, BPF_MAP_LOOKUP_ELEM, &attr, sizeof(attr)) != 0)");
+    builder->emitIndent();
+    builder->appendLine("    return -1;");
+    builder->emitIndent();
+    builder->appendLine("generation++;");
+    builder->emitIndent();
+    builder->appendLine("return syscall(__NR_bpf, BPF_MAP_UPDATE_ELEM, &attr, sizeof(attr)) "
+                        "== 0 ? 0 : -1;");
+    builder->blockEnd(true);
+    builder->newline();
+}
+
+}  // namespace EBPF
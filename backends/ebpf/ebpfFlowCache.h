@@ -0,0 +1,69 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _BACKENDS_EBPF_EBPFFLOWCACHE_H_
+#define _BACKENDS_EBPF_EBPFFLOWCACHE_H_
+
+#include <utility>
+#include <vector>
+#include "ebpfObject.h"
+#include "ebpfType.h"
+
+namespace EBPF {
+
+// With --flowCache, a cache of the verdicts of the control, in front of it: the
+// verdict is all that the control decides, and it only depends on the header fields
+// that the control reads (in its keys, conditions and actions), the valid bits of
+// the headers, and the entries of the tables.  So the program looks up the values of
+// those fields in a per-CPU LRU hash; on a hit it takes the verdict found, and on a
+// miss it runs the control and records its verdict.  Each entry holds the generation
+// of the tables when it was recorded, in an array with one entry, which the control
+// plane increments after writing the tables, so that older entries are misses.
+class EBPFFlowCache : public EBPFObject {
+    const EBPFProgram* program;
+    unsigned size;
+    // the fields of the key, as C expressions in the headers, and their types
+    std::vector<std::pair<cstring, EBPFType*>> fields;
+
+    void addField(cstring path, const IR::Type* type);
+    void addValid(cstring path);
+    void addAll(cstring path, const IR::Type* type);
+
+ public:
+    cstring mapName, generationMapName;
+    cstring keyTypeName, valueTypeName;
+    cstring keyVariable, missVariable, generationVariable;
+
+    EBPFFlowCache(const EBPFProgram* program, unsigned size);
+    // Finds the fields that the control reads; false if it does something that the
+    // cache would skip, such as incrementing a counter
+    bool build();
+    // The types and the maps
+    void emit(CodeBuilder* builder) override;
+    void emitLocals(CodeBuilder* builder);
+    // Before the control: goes to the end of the program with the cached verdict
+    void emitLookup(CodeBuilder* builder);
+    // At the end of the program: records the verdict of the control after a miss
+    void emitRecord(CodeBuilder* builder);
+    void emitControlPlane(CodeBuilder* builder);
+    // The bytes of the key, with padding
+    unsigned keySize() const;
+    size_t fieldCount() const { return fields.size(); }
+};
+
+}  // namespace EBPF
+
+#endif /* _BACKENDS_EBPF_EBPFFLOWCACHE_H_ */
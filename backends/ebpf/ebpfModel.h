@@ -31,13 +31,24 @@ struct TableImpl_Model : public ::Model::Extern_Model {
     ::Model::Elem size;
 };
 
+struct TernaryTableImpl_Model : public TableImpl_Model {
+    TernaryTableImpl_Model() : TableImpl_Model("ternary_table"), masks("masks") {}
+    ::Model::Elem masks;
+};
+
+struct LruTableImpl_Model : public TableImpl_Model {
+    LruTableImpl_Model() : TableImpl_Model("lru_hash_table"), perCpu("percpu") {}
+    ::Model::Elem perCpu;  // annotation on a table, for a per-CPU table
+};
+
 struct CounterArray_Model : public ::Model::Extern_Model {
     CounterArray_Model() : Extern_Model("CounterArray"),
                            increment("increment"),
-                           size("max_index"), sparse("sparse")  {}
+                           size("max_index"), sparse("sparse"), perCpu("percpu")  {}
     ::Model::Elem increment;
     ::Model::Elem size;
     ::Model::Elem sparse;
+    ::Model::Elem perCpu;  // annotation on an instance, for a per-CPU table
 };
 
 struct Filter_Model : public ::Model::Elem {
@@ -54,6 +65,9 @@ class EBPFModel : public ::Model::Model {
                   counterArray(),
                   array_table("array_table"),
                   hash_table("hash_table"),
+                  lru_hash_table(),
+                  lpm_table("lpm_table"),
+                  ternary_table(),
                   tableImplProperty("implementation"),
                   CPacketName("skb"),
                   packet("packet", P4::P4CoreLibrary::instance.packetIn, 0),
@@ -67,6 +81,9 @@ class EBPFModel : public ::Model::Model {
     CounterArray_Model     counterArray;
     TableImpl_Model        array_table;
     TableImpl_Model        hash_table;
+    LruTableImpl_Model     lru_hash_table;
+    TableImpl_Model        lpm_table;
+    TernaryTableImpl_Model ternary_table;
     ::Model::Elem          tableImplProperty;
     ::Model::Elem          CPacketName;
     ::Model::Param_Model   packet;
@@ -17,6 +17,7 @@ limitations under the License.
 #include "ebpfObject.h"
 #include "ebpfType.h"
 #include "ebpfControl.h"
+#include "ebpfFlowCache.h"
 #include "ebpfParser.h"
 #include "ebpfTable.h"
 #include "frontends/p4/coreLibrary.h"
@@ -38,6 +39,19 @@ bool EBPFProgram::build() {
     if (!success)
         return success;
 
+    if (validityMask) {
+        auto headersType = typeMap->getType(parser->headers, true);
+        cstring_builder path;
+        if (!assignValidBits(path, headersType))
+            return false;
+        // the struct of the headers gets the word of the valid bits, and the headers
+        // lose their valid bytes
+        auto factory = EBPFTypeFactory::instance;
+        factory->setValidityMask(headersType->to<IR::Type_StructLike>()->name,
+                                 validBits.size() <= 32 ? 32 : 64);
+        parser->headerType = factory->create(headersType);
+    }
+
     auto cb = pack->getParameterValue(model.filter.filter.name)
                       ->to<IR::ControlBlock>();
     BUG_CHECK(cb != nullptr, "No control block found");
@@ -46,6 +60,13 @@ bool EBPFProgram::build() {
     if (!success)
         return success;
 
+    if (flowCacheSize != 0) {
+        flowCache = new EBPFFlowCache(this, flowCacheSize);
+        if (!flowCache->build())
+            return false;
+    }
+
+    parser->analyze();
     return true;
 }
 
@@ -54,6 +75,8 @@ void EBPFProgram::emit(CodeBuilder *builder) {
     emitPreamble(builder);
     emitTypes(builder);
     control->emitTables(builder);
+    if (flowCache != nullptr)
+        flowCache->emit(builder);
 
     builder->newline();
     builder->emitIndent();
@@ -68,6 +91,8 @@ void EBPFProgram::emit(CodeBuilder *builder) {
     builder->endOfStatement(true);
 
     createLocalVariables(builder);
+    if (flowCache != nullptr)
+        flowCache->emitLocals(builder);
     builder->newline();
     builder->emitIndent();
     builder->appendFormat("goto %s;", IR::ParserState::start.c_str());
@@ -75,17 +100,131 @@ void EBPFProgram::emit(CodeBuilder *builder) {
 
     parser->emit(builder);
     emitPipeline(builder);
+    emitReturn(builder);
+
+    for (unsigned stage = 1; stage < control->stages.size(); stage++)
+        emitStage(builder, stage);
+
+    builder->target->emitLicense(builder, license);
+}
+
+void EBPFProgram::emitControlPlane(CodeBuilder* builder) {
+    builder->append(
+        "/* User-space access to the tables of an eBPF program, generated by p4c-ebpf */\n"
+        "#ifndef EBPF_TABLES_H\n"
+        "#define EBPF_TABLES_H\n"
+        "\n"
+        "#include <errno.h>\n"
+        "#include <stddef.h>\n"
+        "#include <stdint.h>\n"
+        "#include <string.h>\n"
+        "#include <unistd.h>\n"
+        "#include <sys/syscall.h>\n"
+        "#include <linux/bpf.h>\n"
+        "\n"
+        "typedef uint8_t u8;\n"
+        "typedef uint16_t u16;\n"
+        "typedef uint32_t u32;\n"
+        "typedef uint64_t u64;\n"
+        "\n"
+        "/* The batched map commands of Linux 5.6, which older <linux/bpf.h> lack */\n"
+        "enum { EBPF_MAP_UPDATE_BATCH = 26, EBPF_MAP_DELETE_BATCH = 27 };\n"
+        "struct ebpf_batch_attr {\n"
+        "    u64 in_batch;\n"
+        "    u64 out_batch;\n"
+        "    u64 keys;\n"
+        "    u64 values;\n"
+        "    u32 count;\n"
+        "    u32 map_fd;\n"
+        "    u64 elem_flags;\n"
+        "    u64 flags;\n"
+        "};\n"
+        "\n"
+        "/* Writes count entries of the map fd, or deletes them if values is NULL: in one\n"
+        "   system call if the kernel has batched commands for the map, otherwise in one\n"
+        "   for each entry.  Returns 0, or -1 with errno set. */\n"
+        "static inline int ebpf_batch(int fd, const void *keys, const void *values,\n"
+        "                             u32 count, size_t keySize, size_t valueSize)\n"
+        "{\n"
+        "    struct ebpf_batch_attr batch;\n"
+        "    union bpf_attr attr;\n"
+        "    u32 i;\n"
+        "\n"
+        "    memset(&batch, 0, sizeof(batch));\n"
+        "    batch.keys = (uintptr_t)keys;\n"
+        "    batch.values = (uintptr_t)values;\n"
+        "    batch.count = count;\n"
+        "    batch.map_fd = fd;\n"
+        "    if (syscall(__NR_bpf,\n"
+        "                values != NULL ? EBPF_MAP_UPDATE_BATCH : EBPF_MAP_DELETE_BATCH,\n"
+        "                &batch, sizeof(batch)) == 0)\n"
+        "        return 0;\n"
+        "    if (errno != EINVAL && errno != EOPNOTSUPP && errno != 524 /* ENOTSUPP */)\n"
+        "        return -1;\n"
+        "    /* a batch that failed part way says how many entries it did; a command that\n"
+        "       the kernel does not know leaves count as it was */\n"
+        "    for (i = batch.count < count ? batch.count : 0; i < count; i++) {\n"
+        "        memset(&attr, 0, sizeof(attr));\n"
+        "        attr.map_fd = fd;\n"
+        "        attr.key = (uintptr_t)((const char *)keys + i * keySize);\n"
+        "        if (values != NULL)\n"
+        "            attr.value = (uintptr_t)((const char *)values + i * valueSize);\n"
+        "        if (syscall(__NR_bpf,\n"
+        "                    values != NULL ? BPF_MAP_UPDATE_ELEM : BPF_MAP_DELETE_ELEM,\n"
+        "                    &attr, sizeof(attr)) != 0)\n"
+        "            return -1;\n"
+        "    }\n"
+        "    return 0;\n"
+        "}\n"
+        "\n");
+    emitTypes(builder);
+    for (auto it : control->tables)
+        it.second->emitControlPlane(builder);
+    if (flowCache != nullptr)
+        flowCache->emitControlPlane(builder);
+    if (tableStats)
+        control->emitStatsLegend(builder);
+    builder->appendLine("#endif  /* EBPF_TABLES_H */");
+}
 
+void EBPFProgram::emitReturn(CodeBuilder* builder) {
     builder->emitIndent();
     builder->append(endLabel);
     builder->appendLine(":");
+    // there is a single stage with a flow cache
+    if (flowCache != nullptr)
+        flowCache->emitRecord(builder);
     builder->emitIndent();
-    builder->append("return ");
-    builder->append(control->accept->name.name);
-    builder->appendLine(";");
+    builder->appendFormat("return %s ? %s : %s;", control->accept->name.name,
+                          builder->target->forwardReturnCode(),
+                          builder->target->dropReturnCode());
+    builder->newline();
     builder->blockEnd(true);  // end of function
+}
 
-    builder->target->emitLicense(builder, license);
+// A stage after the first one of the control is a program of its own, which the
+// previous stage tail-calls
+void EBPFProgram::emitStage(CodeBuilder* builder, unsigned stage) {
+    cstring_builder stageName(functionName);
+    stageName += "_stage";
+    stageName += stage;
+    cstring name = stageName.str();
+    builder->newline();
+    builder->emitIndent();
+    builder->target->emitCodeSection(builder, name);
+    builder->emitIndent();
+    builder->target->emitMain(builder, name, model.CPacketName.str());
+    builder->blockStart();
+
+    emitHeaderInstances(builder);
+    builder->endOfStatement(true);
+    createLocalVariables(builder);
+    control->emitLocals(builder);
+    control->emitRestore(builder);
+    builder->newline();
+
+    control->emitStage(builder, stage);
+    emitReturn(builder);
 }
 
 void EBPFProgram::emitTypes(CodeBuilder* builder) {
@@ -131,6 +270,27 @@ void EBPFProgram::emitPreamble(CodeBuilder* builder) {
     builder->newline();
     builder->appendLine("#define EBPF_MASK(t, w) ((((t)(1)) << (w)) - (t)1)");
     builder->appendLine("#define BYTES(w) ((w + 7) / 8)");
+    // the fields loaded straight from the packet, and LPM keys, are in network order
+    builder->appendLine("#ifndef bpf_ntohs");
+    builder->appendLine("#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__");
+    builder->appendLine("#define bpf_ntohs(x) __builtin_bswap16(x)");
+    builder->appendLine("#define bpf_ntohl(x) __builtin_bswap32(x)");
+    builder->appendLine("#else");
+    builder->appendLine("#define bpf_ntohs(x) (x)");
+    builder->appendLine("#define bpf_ntohl(x) (x)");
+    builder->appendLine("#endif");
+    builder->appendLine("#endif");
+    builder->appendLine("#ifndef bpf_be64toh");
+    builder->appendLine("#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__");
+    builder->appendLine("#define bpf_be64toh(x) __builtin_bswap64(x)");
+    builder->appendLine("#else");
+    builder->appendLine("#define bpf_be64toh(x) (x)");
+    builder->appendLine("#endif");
+    builder->appendLine("#endif");
+    builder->appendLine("#ifndef bpf_htons");
+    builder->appendLine("#define bpf_htons(x) bpf_ntohs(x)");
+    builder->appendLine("#define bpf_htonl(x) bpf_ntohl(x)");
+    builder->appendLine("#endif");
     builder->newline();
 }
 
@@ -161,6 +321,81 @@ void EBPFProgram::createLocalVariables(CodeBuilder* builder) {
     builder->newline();
 }
 
+bool EBPFProgram::assignValidBits(cstring_builder& path, const IR::Type* type) {
+    if (type->is<IR::Type_Name>())
+        type = typeMap->getTypeType(type, true);
+    if (type->is<IR::Type_Header>()) {
+        if (validBits.size() == 64) {
+            ::error("%1%: --validityMask supports at most 64 headers", parser->headers);
+            return false;
+        }
+        unsigned bit = validBits.size();
+        validBits.emplace(path.str(), bit);
+        return true;
+    }
+    if (auto st = type->to<IR::Type_Struct>()) {
+        size_t pathSize = path.size();
+        for (auto f : *st->fields) {
+            path.truncate(pathSize);
+            if (pathSize != 0)
+                path += '.';
+            path += f->name.name;
+            if (!assignValidBits(path, f->type))
+                return false;
+        }
+        path.truncate(pathSize);
+        return true;
+    }
+    if (type->is<IR::Type_StructLike>()) {
+        ::error("%1%: --validityMask does not support header unions", type);
+        return false;
+    }
+    return true;
+}
+
+cstring EBPFProgram::headerPath(const IR::Expression* expression,
+                                const IR::PathExpression** headers) const {
+    // the members from the last one back, joined only once the path is found
+    std::vector<cstring> members;
+    while (auto member = expression->to<IR::Member>()) {
+        members.push_back(member->member.name);
+        expression = member->expr;
+    }
+    auto pe = expression->to<IR::PathExpression>();
+    if (pe == nullptr)
+        return nullptr;
+    auto decl = refMap->getDeclaration(pe->path, true);
+    if (decl != parser->headers && (control == nullptr || decl != control->headers))
+        return nullptr;
+    if (headers != nullptr)
+        *headers = pe;
+    cstring_builder path;
+    for (auto it = members.rbegin(); it != members.rend(); ++it) {
+        if (!path.empty())
+            path += '.';
+        path += *it;
+    }
+    return path.str();
+}
+
+bool EBPFProgram::getValidBit(const IR::Expression* expression,
+                              const IR::PathExpression** headers, unsigned* bit) const {
+    cstring path = headerPath(expression, headers);
+    if (path.isNull())
+        return false;
+    auto it = validBits.find(path);
+    if (it == validBits.end())
+        return false;
+    *bit = it->second;
+    return true;
+}
+
+cstring EBPFProgram::validMaskConstant(uint64_t mask) const {
+    if (validBits.size() <= 32)
+        return Util::printf_format("0x%llxu", (unsigned long long)mask);
+    return Util::printf_format("0x%llxull", (unsigned long long)mask);
+}
+
 void EBPFProgram::emitHeaderInstances(CodeBuilder* builder) {
     builder->emitIndent();
     parser->headerType->declare(builder, parser->headers->name.name, false);
@@ -173,6 +408,8 @@ void EBPFProgram::emitPipeline(CodeBuilder* builder) {
     builder->newline();
     builder->emitIndent();
     builder->blockStart();
+    if (flowCache != nullptr)
+        flowCache->emitLookup(builder);
     control->emit(builder);
     builder->blockEnd(true);
 }
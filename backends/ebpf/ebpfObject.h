@@ -31,6 +31,7 @@ class EBPFParser;
 class EBPFControl;
 class EBPFTable;
 class EBPFType;
+class EBPFFlowCache;
 
 // Base class for EBPF objects
 class EBPFObject {
@@ -60,10 +61,37 @@ class EBPFProgram : public EBPFObject {
     cstring errorEnum;
     cstring license = "GPL";  // TODO: this should be a compiler option probably
     cstring arrayIndexType = "u32";
+    // count the hits, misses and actions of the tables; and time their applies
+    bool tableStats = false;
+    bool tableTime = false;
+    // keep the valid bits of all the headers in one word of the headers struct
+    bool validityMask = false;
+    // with validityMask, the bit of each header, by its path in the headers, such as
+    // "outer.ipv4"
+    std::map<cstring, unsigned> validBits;
+    // extract only the headers whose fields are read
+    bool parseOnlyNeeded = false;
+    // the entries of the cache of verdicts in front of the control, or 0 for none
+    unsigned flowCacheSize = 0;
+    EBPFFlowCache*       flowCache = nullptr;
 
     // write program as C source code
     void emit(CodeBuilder *builder) override;
+    // write a C header for user space, with the types of the tables, and functions
+    // that write and delete many entries of a table at once
+    void emitControlPlane(CodeBuilder *builder);
     bool build();  // return 'true' on success
+    // The path of expression in the headers parameter of the parser or the control,
+    // such as "outer.ipv4", and that parameter; "" for the parameter itself, and null
+    // for what is not in the headers
+    cstring headerPath(const IR::Expression* expression,
+                       const IR::PathExpression** headers = nullptr) const;
+    // With validityMask, the bit of the header that expression names, and the headers
+    // parameter that it is in; false if it is not a header in the headers
+    bool getValidBit(const IR::Expression* expression, const IR::PathExpression** headers,
+                     unsigned* bit) const;
+    // The C constant of a mask of valid bits
+    cstring validMaskConstant(uint64_t mask) const;
 
     EBPFProgram(const IR::P4Program* program, P4::ReferenceMap* refMap,
                 P4::TypeMap* typeMap, const IR::ToplevelBlock* toplevel) :
@@ -89,7 +117,10 @@ class EBPFProgram : public EBPFObject {
     void emitIninitailizeHeaders(CodeBuilder* builder);
     void createLocalVariables(CodeBuilder* builder);
     void emitPipeline(CodeBuilder* builder);
+    void emitReturn(CodeBuilder* builder);
+    void emitStage(CodeBuilder* builder, unsigned stage);
     void emitLicense(CodeBuilder* builder);
+    bool assignValidBits(cstring_builder& path, const IR::Type* type);
 };
 
 }  // namespace EBPF
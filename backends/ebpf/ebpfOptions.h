@@ -18,12 +18,91 @@ limitations under the License.
 #define _BACKENDS_EBPF_EBPFOPTIONS_H_
 
 #include <getopt.h>
+#include <stdlib.h>
 #include "frontends/common/options.h"
 
 class EbpfOptions : public CompilerOptions {
  public:
+    // read packets through pointers rather than with the load_ helpers
+    bool directPacketAccess = false;
+    // above which the program gets a warning; the verifier's limit for unprivileged
+    // programs, and for all before Linux 5.2
+    unsigned maxInstructions = 4096;
+    // a C header for the control plane in user space
+    cstring controlPlaneFile = nullptr;
+    // count the hits, misses and actions of each table, and the time it takes
+    bool tableStats = false;
+    bool tableTime = false;
+    // write an ELF object with eBPF bytecode rather than C
+    bool emitObject = false;
+    // one word of valid bits in the headers struct, rather than a byte in each header
+    bool validityMask = false;
+    // skip the loads of the headers whose fields are never read
+    bool parseOnlyNeeded = false;
+    // group, merge and deduplicate the keys of the tables
+    bool optimizeKeys = false;
+    // the entries of the cache of the verdicts of the control, or 0 for none
+    unsigned flowCache = 0;
+
     EbpfOptions() {
         langVersion = CompilerOptions::FrontendVersion::P4_16;
+        registerOption("--directPacketAccess", nullptr,
+                       [this](const char*) { directPacketAccess = true; return true; },
+                       "Read header fields directly from the packet, with one bounds check\n"
+                       "for each header, rather than through the load_byte/half/word helpers\n"
+                       "(target bcc; always done for target xdp)");
+        registerOption("--maxInstructions", "count",
+                       [this](const char* arg) {
+                           char* end;
+                           maxInstructions = strtoul(arg, &end, 10);
+                           if (*end != '\0' || maxInstructions == 0) {
+                               ::error("%1%: expected a positive number of instructions", arg);
+                               return false; }
+                           return true; },
+                       "Warn when the program may have more eBPF instructions than this\n"
+                       "(default 4096; privileged programs may have 1000000 since Linux 5.2)");
+        registerOption("--controlPlane", "file",
+                       [this](const char* arg) { controlPlaneFile = arg; return true; },
+                       "Write a C header for user space, with the key and value types of\n"
+                       "each table, and functions that write or delete many entries at once");
+        registerOption("--tableStats", nullptr,
+                       [this](const char*) { tableStats = true; return true; },
+                       "Count the hits and misses of each table, and the actions it runs,\n"
+                       "in a per-CPU array ebpf_tableStats");
+        registerOption("--tableTime", nullptr,
+                       [this](const char*) { tableStats = tableTime = true; return true; },
+                       "As --tableStats, and also add up the nanoseconds that each table\n"
+                       "apply takes (two bpf_ktime_get_ns calls for each)");
+        registerOption("--emitObject", nullptr,
+                       [this](const char*) { emitObject = true; return true; },
+                       "Write an ELF object with the eBPF bytecode of the program to the\n"
+                       "output file, rather than C for clang (target kernel only; some P4\n"
+                       "constructs are not supported this way)");
+        registerOption("--validityMask", nullptr,
+                       [this](const char*) { validityMask = true; return true; },
+                       "Keep the valid bits of all the headers in one word of the headers\n"
+                       "struct, so that a chain of isValid() tests is one mask test");
+        registerOption("--parseOnlyNeeded", nullptr,
+                       [this](const char*) { parseOnlyNeeded = true; return true; },
+                       "Do not load the fields of the headers that the program never reads;\n"
+                       "they are still checked against the length of the packet and valid");
+        registerOption("--optimizeKeys", nullptr,
+                       [this](const char*) { optimizeKeys = true; return true; },
+                       "Put the exact keys of each table before the ternary and lpm ones,\n"
+                       "merge adjacent exact fields of a header, and drop duplicate keys;\n"
+                       "this changes the key types that the control plane uses");
+        registerOption("--flowCache", "entries",
+                       [this](const char* arg) {
+                           char* end;
+                           flowCache = strtoul(arg, &end, 10);
+                           if (*end != '\0' || flowCache == 0) {
+                               ::error("%1%: expected a positive number of entries", arg);
+                               return false; }
+                           return true; },
+                       "Cache the verdict of the control for the values of the header fields\n"
+                       "that it reads, in a per-CPU LRU hash of this many entries, and look\n"
+                       "it up before running the control (the control plane increments\n"
+                       "ebpf_flowGeneration after writing the tables)");
     }
 };
 
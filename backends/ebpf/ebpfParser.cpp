@@ -14,6 +14,11 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "ebpfControl.h"
 #include "ebpfModel.h"
 #include "ebpfParser.h"
 #include "ebpfType.h"
@@ -28,9 +33,16 @@ class StateTranslationVisitor : public CodeGenInspector {
     P4::P4CoreLibrary& p4lib;
     const EBPFParserState* state;
 
+    void emitLoad(unsigned loadSize, int byte);
     void compileExtractField(const IR::Expression* expr, cstring name,
                              unsigned alignment, EBPFType* type);
+    void emitBits(const std::vector<unsigned>& words, unsigned start, unsigned width);
+    void compileExtractWords(const IR::Expression* expr, unsigned width,
+                             const std::vector<std::pair<cstring, EBPFType*>>& fields);
+    bool compileExtractFields(const IR::Expression* expr, const IR::Type_Header* ht,
+                              unsigned width);
     void compileExtract(const IR::Vector<IR::Expression>* args);
+    void emitGoto(const IR::PathExpression* next);
 
  public:
     StateTranslationVisitor(const EBPFParserState* state, CodeBuilder* builder) :
@@ -72,15 +84,30 @@ bool StateTranslationVisitor::preorder(const IR::ParserState* parserState) {
         if (!parserState->selectExpression->is<IR::PathExpression>())
             BUG("Expected a PathExpression, got a %1%", parserState->selectExpression);
         builder->emitIndent();
-        builder->append("goto ");
-        visit(parserState->selectExpression);
-        builder->endOfStatement(true);
+        emitGoto(parserState->selectExpression->to<IR::PathExpression>());
+        builder->newline();
     }
 
     builder->blockEnd(true);
     return false;
 }
 
+// A jump to the next state; or, when the next state is accept and the headers that are
+// valid decide what the control does, the verdict of the control right away
+void StateTranslationVisitor::emitGoto(const IR::PathExpression* next) {
+    auto verdict = state->parser->acceptVerdicts.find(state->state->name.name);
+    if (next->path->name.name == IR::ParserState::accept &&
+        verdict != state->parser->acceptVerdicts.end()) {
+        builder->appendFormat("return %s;", verdict->second ?
+                              builder->target->forwardReturnCode() :
+                              builder->target->dropReturnCode());
+        return;
+    }
+    builder->append("goto ");
+    visit(next);
+    builder->endOfStatement();
+}
+
 bool StateTranslationVisitor::preorder(const IR::SelectExpression* expression) {
     hasDefault = false;
     // TODO: this does not handle correctly tuples
@@ -113,12 +140,24 @@ bool StateTranslationVisitor::preorder(const IR::SelectCase* selectCase) {
         visit(selectCase->keyset);
         builder->append(": ");
     }
-    builder->append("goto ");
-    visit(selectCase->state);
-    builder->endOfStatement(true);
+    emitGoto(selectCase->state);
+    builder->newline();
     return false;
 }
 
+// Emits a call to the load_ helper that reads the 'loadSize' bits (8, 16 or 32) that
+// start 'byte' bytes after the current offset in the packet, in host order
+void StateTranslationVisitor::emitLoad(unsigned loadSize, int byte) {
+    auto program = state->parser->program;
+    const char* helper = loadSize == 8 ? "load_byte" : loadSize == 16 ? "load_half" : "load_word";
+    builder->appendFormat("%s(%s, BYTES(%s)", helper,
+                          builder->target->dataOffset(program->model.CPacketName.str()),
+                          program->offsetVar.c_str());
+    if (byte != 0)
+        builder->appendFormat(" + %d", byte);
+    builder->append(")");
+}
+
 void
 StateTranslationVisitor::compileExtractField(
     const IR::Expression* expr, cstring field, unsigned alignment, EBPFType* type) {
@@ -131,31 +170,20 @@ StateTranslationVisitor::compileExtractField(
         unsigned wordsToRead = lastWordIndex + 1;
         unsigned loadSize;
 
-        const char* helper = nullptr;
-        if (wordsToRead <= 1) {
-            helper = "load_byte";
+        if (wordsToRead <= 1)
             loadSize = 8;
-        } else if (widthToExtract <= 16)  {
-            helper = "load_half";
+        else if (widthToExtract <= 16)
             loadSize = 16;
-        } else if (widthToExtract <= 32) {
-            helper = "load_word";
+        else
             loadSize = 32;
-        } else {
-            if (widthToExtract > 64) BUG("Unexpected width %d", widthToExtract);
-            helper = "load_dword";
-            loadSize = 64;
-        }
 
         unsigned shift = loadSize - alignment - widthToExtract;
         builder->emitIndent();
         visit(expr);
         builder->appendFormat(".%s = (", field.c_str());
         type->emit(builder);
-        builder->appendFormat(")((%s(%s, BYTES(%s))",
-                              helper,
-                              builder->target->dataOffset(program->model.CPacketName.str()),
-                              program->offsetVar.c_str());
+        builder->append(")((");
+        emitLoad(loadSize, 0);
         if (shift != 0)
             builder->appendFormat(" >> %d", shift);
         builder->append(")");
@@ -176,11 +204,6 @@ StateTranslationVisitor::compileExtractField(
         else
             shift = 8 - alignment;
 
-        const char* helper;
-        if (shift == 0)
-            helper = "load_byte";
-        else
-            helper = "load_half";
         auto bt = EBPFTypeFactory::instance->create(IR::Type_Bits::get(8));
         unsigned bytes = ROUNDUP(widthToExtract, 8);
         for (unsigned i=0; i < bytes; i++) {
@@ -188,10 +211,9 @@ StateTranslationVisitor::compileExtractField(
             visit(expr);
             builder->appendFormat(".%s[%d] = (", field.c_str(), i);
             bt->emit(builder);
-            builder->appendFormat(")((%s(%s, BYTES(%s) + %d) >> %d)",
-                                  helper,
-                                  builder->target->dataOffset(program->model.CPacketName.str()),
-                                  program->offsetVar.c_str(), i, shift);
+            builder->append(")((");
+            emitLoad(shift == 0 ? 8 : 16, i);
+            builder->appendFormat(" >> %d)", shift);
 
             if ((i == bytes - 1) && (widthToExtract % 8 != 0)) {
                 builder->append(" & EBPF_MASK(");
@@ -210,6 +232,128 @@ StateTranslationVisitor::compileExtractField(
     builder->newline();
 }
 
+// Emits an expression for 'width' (at most 32) bits of the header, starting 'start'
+// bits into it, out of the words loaded by compileExtractWords, which are 'words'
+// bytes long.
+void StateTranslationVisitor::emitBits(const std::vector<unsigned>& words,
+                                       unsigned start, unsigned width) {
+    unsigned end = start + width;
+    unsigned wordStart = 0;
+    bool first = true;
+    for (unsigned i = 0; i < words.size(); i++) {
+        unsigned wordEnd = wordStart + words[i] * 8;
+        unsigned from = std::max(start, wordStart);
+        unsigned to = std::min(end, wordEnd);
+        if (from < to) {
+            // code, which need not be interned
+            std::string bits = "ebpf_word" + std::to_string(i);
+            if (wordEnd > to)
+                bits = "(" + bits + " >> " + std::to_string(wordEnd - to) + ")";
+            if (words[i] > 4)
+                bits = "(u32)" + bits;
+            if (from > wordStart && to - from < 32)
+                bits = "(" + bits + " & EBPF_MASK(u32, " + std::to_string(to - from) + "))";
+            if (end > to)
+                bits = "(" + bits + " << " + std::to_string(end - to) + ")";
+            if (!first)
+                builder->append(" | ");
+            builder->append(bits);
+            first = false;
+        }
+        wordStart = wordEnd;
+    }
+}
+
+// With direct packet access the header is loaded in as few words as possible (of 8, 4,
+// 2 and 1 bytes), and the fields are cut out of these words with shifts and masks
+// worked out here, instead of being loaded one by one.
+void StateTranslationVisitor::compileExtractWords(
+    const IR::Expression* expr, unsigned width,
+    const std::vector<std::pair<cstring, EBPFType*>>& fields) {
+    auto program = state->parser->program;
+    builder->emitIndent();
+    builder->blockStart();
+
+    std::vector<unsigned> words;
+    unsigned byte = 0;
+    for (unsigned left = ROUNDUP(width, 8); left > 0; ) {
+        unsigned size = left >= 8 ? 8 : left >= 4 ? 4 : left >= 2 ? 2 : 1;
+        builder->emitIndent();
+        builder->appendFormat("u%d ebpf_word%d = ", size * 8, unsigned(words.size()));
+        std::string address = "(u8*)" + program->packetStartVar + " + BYTES(" +
+                program->offsetVar + ") + " + std::to_string(byte);
+        if (size == 1)
+            builder->appendFormat("*(%s)", address.c_str());
+        else
+            builder->appendFormat("%s(*(u%d*)(%s))",
+                                  size == 8 ? "bpf_be64toh" : size == 4 ? "bpf_ntohl" : "bpf_ntohs",
+                                  size * 8, address.c_str());
+        builder->endOfStatement(true);
+        words.push_back(size);
+        byte += size;
+        left -= size;
+    }
+
+    unsigned start = 0;
+    for (auto f : fields) {
+        unsigned fieldWidth = dynamic_cast<IHasWidth*>(f.second)->widthInBits();
+        if (EBPFScalarType::generatesScalar(fieldWidth)) {
+            builder->emitIndent();
+            visit(expr);
+            builder->appendFormat(".%s = (", f.first.c_str());
+            f.second->emit(builder);
+            builder->append(")(");
+            emitBits(words, start, fieldWidth);
+            builder->append(")");
+            builder->endOfStatement(true);
+        } else {
+            // bigger than 4 bytes; an array of bytes
+            for (unsigned i = 0; i < ROUNDUP(fieldWidth, 8); i++) {
+                builder->emitIndent();
+                visit(expr);
+                builder->appendFormat(".%s[%d] = (u8)(", f.first.c_str(), i);
+                emitBits(words, start + i * 8, std::min(8u, fieldWidth - i * 8));
+                builder->append(")");
+                builder->endOfStatement(true);
+            }
+        }
+        start += fieldWidth;
+    }
+
+    builder->emitIndent();
+    builder->appendFormat("%s += %d", program->offsetVar.c_str(), width);
+    builder->endOfStatement(true);
+    builder->blockEnd(true);
+    builder->newline();
+}
+
+// Loads the fields of the header; false after an error
+bool StateTranslationVisitor::compileExtractFields(const IR::Expression* expr,
+                                                   const IR::Type_Header* ht, unsigned width) {
+    std::vector<std::pair<cstring, EBPFType*>> fields;
+    for (auto f : *ht->fields) {
+        auto ftype = state->parser->typeMap->getType(f);
+        auto etype = EBPFTypeFactory::instance->create(ftype);
+        if (dynamic_cast<IHasWidth*>(etype) == nullptr) {
+            ::error("Only headers with fixed widths supported %1%", f);
+            return false;
+        }
+        fields.emplace_back(f->name.name, etype);
+    }
+
+    if (builder->target->directPacketAccess()) {
+        compileExtractWords(expr, width, fields);
+    } else {
+        unsigned alignment = 0;
+        for (auto f : fields) {
+            compileExtractField(expr, f.first, alignment, f.second);
+            alignment += dynamic_cast<IHasWidth*>(f.second)->widthInBits();
+            alignment %= 8;
+        }
+    }
+    return true;
+}
+
 void
 StateTranslationVisitor::compileExtract(const IR::Vector<IR::Expression>* args) {
     if (args->size() != 1) {
@@ -244,21 +388,30 @@ StateTranslationVisitor::compileExtract(const IR::Vector<IR::Expression>* args)
     builder->newline();
     builder->blockEnd(true);
 
-    unsigned alignment = 0;
-    for (auto f : *ht->fields) {
-        auto ftype = state->parser->typeMap->getType(f);
-        auto etype = EBPFTypeFactory::instance->create(ftype);
-        auto et = dynamic_cast<IHasWidth*>(etype);
-        if (et == nullptr) {
-            ::error("Only headers with fixed widths supported %1%", f);
-            return;
-        }
-        compileExtractField(expr, f->name, alignment, etype);
-        alignment += et->widthInBits();
-        alignment %= 8;
+    if (program->parseOnlyNeeded && !state->parser->isRead(program->headerPath(expr))) {
+        // nothing reads the fields
+        builder->emitIndent();
+        builder->appendFormat("%s += %d", program->offsetVar.c_str(), width);
+        builder->endOfStatement(true);
+    } else if (!compileExtractFields(expr, ht, width)) {
+        return;
     }
 
     builder->emitIndent();
+    if (program->validityMask) {
+        const IR::PathExpression* headers;
+        unsigned bit;
+        if (!program->getValidBit(expr, &headers, &bit)) {
+            ::error("%1%: --validityMask needs the extracted headers to be in the "
+                    "headers parameter", expr);
+            return;
+        }
+        visit(headers);
+        builder->appendFormat(".ebpf_valid_mask |= %s;",
+                              program->validMaskConstant(1ull << bit).c_str());
+        builder->newline();
+        return;
+    }
     visit(expr);
     builder->appendLine(".ebpf_valid = 1;");
     return;
@@ -333,9 +486,10 @@ void EBPFParser::emit(CodeBuilder *builder) {
         s->emit(builder);
     builder->newline();
 
-    // Create a synthetic reject state
+    // Create a synthetic reject state; the packets it rejects are let through
     builder->emitIndent();
-    builder->appendFormat("%s: { return 1; }", IR::ParserState::reject.c_str());
+    builder->appendFormat("%s: { return %s; }", IR::ParserState::reject.c_str(),
+                          builder->target->forwardReturnCode());
     builder->newline();
     builder->newline();
 }
@@ -363,4 +517,157 @@ bool EBPFParser::build() {
     return true;
 }
 
+namespace {
+// The headers and the structs of headers that the control and the parser read, apart
+// from the arguments of extract
+class HeaderReads : public Inspector {
+    const EBPFParser* parser;
+    std::set<cstring>* headers;
+    std::set<cstring>* structs;
+
+    void use(const IR::Expression* expression) {
+        auto program = parser->program;
+        cstring path = program->headerPath(expression);
+        if (path.isNull())
+            return;
+        auto type = program->typeMap->getType(expression, true);
+        auto parent = getParent<IR::Member>();
+        if (type->is<IR::Type_Header>()) {
+            // isValid() does not need the fields
+            if (parent == nullptr || parent->member != IR::Type_Header::isValid)
+                headers->insert(path);
+        } else if (type->is<IR::Type_StructLike>() && parent == nullptr) {
+            structs->insert(path);
+        }
+    }
+
+ public:
+    HeaderReads(const EBPFParser* parser, std::set<cstring>* headers,
+                std::set<cstring>* structs) :
+            parser(parser), headers(headers), structs(structs) {}
+    bool preorder(const IR::Member* expression) override { use(expression); return true; }
+    bool preorder(const IR::PathExpression* expression) override {
+        use(expression);
+        return false; }
+    bool preorder(const IR::MethodCallExpression* expression) override {
+        auto program = parser->program;
+        auto mi = P4::MethodInstance::resolve(expression, program->refMap, program->typeMap);
+        auto em = mi->to<P4::ExternMethod>();
+        if (em != nullptr && em->object == parser->packet &&
+            em->method->name.name == P4::P4CoreLibrary::instance.packetIn.extract.name) {
+            visit(expression->method);
+            return false;
+        }
+        return true;
+    }
+};
+}  // namespace
+
+std::set<cstring> EBPFParser::extracts(const IR::ParserState* state) const {
+    std::set<cstring> result;
+    for (auto c : *state->components) {
+        auto mcs = c->to<IR::MethodCallStatement>();
+        if (mcs == nullptr || mcs->methodCall->arguments->size() != 1)
+            continue;
+        auto mi = P4::MethodInstance::resolve(mcs->methodCall, program->refMap,
+                                              program->typeMap);
+        auto em = mi->to<P4::ExternMethod>();
+        if (em != nullptr && em->object == packet &&
+            em->method->name.name == P4::P4CoreLibrary::instance.packetIn.extract.name) {
+            cstring path = program->headerPath(mcs->methodCall->arguments->at(0));
+            if (!path.isNull())
+                result.insert(path);
+        }
+    }
+    return result;
+}
+
+namespace {
+// The states that state goes to
+std::vector<cstring> successors(const IR::ParserState* state) {
+    std::vector<cstring> result;
+    auto next = state->selectExpression;
+    if (next == nullptr)
+        return result;
+    if (auto pe = next->to<IR::PathExpression>())
+        result.push_back(pe->path->name.name);
+    else if (auto select = next->to<IR::SelectExpression>())
+        for (auto c : select->selectCases)
+            result.push_back(c->state->path->name.name);
+    return result;
+}
+}  // namespace
+
+void EBPFParser::analyze() {
+    // The headers that are valid when each state starts, if that does not depend on the
+    // path to it; all the headers are invalid at the start
+    std::map<cstring, const IR::ParserState*> byName;
+    for (auto s : states)
+        byName.emplace(s->state->name.name, s->state);
+    std::map<cstring, std::set<cstring>> validAt;
+    std::set<cstring> unknown;
+    std::vector<cstring> work;
+    validAt[IR::ParserState::start] = {};
+    work.push_back(IR::ParserState::start);
+    while (!work.empty()) {
+        cstring name = work.back();
+        work.pop_back();
+        auto state = get(byName, name);
+        if (state == nullptr || state->isBuiltin())
+            continue;
+        std::set<cstring> out;
+        bool known = unknown.count(name) == 0;
+        if (known) {
+            out = validAt.at(name);
+            auto extracted = extracts(state);
+            out.insert(extracted.begin(), extracted.end());
+        }
+        for (auto next : successors(state)) {
+            if (unknown.count(next))
+                continue;
+            auto it = validAt.find(next);
+            if (known && it == validAt.end()) {
+                validAt.emplace(next, out);
+            } else if (!known || it->second != out) {
+                validAt.erase(next);
+                unknown.insert(next);
+            } else {
+                continue;
+            }
+            work.push_back(next);
+        }
+    }
+
+    for (auto s : states) {
+        cstring name = s->state->name.name;
+        auto next = successors(s->state);
+        if (unknown.count(name) || !validAt.count(name) ||
+            std::find(next.begin(), next.end(), IR::ParserState::accept) == next.end())
+            continue;
+        auto valid = validAt.at(name);
+        auto extracted = extracts(s->state);
+        valid.insert(extracted.begin(), extracted.end());
+        bool pass;
+        if (program->control->verdict(valid, &pass))
+            acceptVerdicts.emplace(name, pass);
+    }
+
+    if (program->parseOnlyNeeded) {
+        HeaderReads reads(this, &headersRead, &structsRead);
+        program->control->controlBlock->container->apply(reads);
+        parserBlock->container->apply(reads);
+    }
+}
+
+bool EBPFParser::isRead(cstring header) const {
+    if (header.isNull() || headersRead.count(header))
+        return true;
+    // a struct of headers that is read whole, or that the header is in
+    for (auto s : structsRead) {
+        if (s.isNullOrEmpty() || header.startsWith(s + "."))
+            return true;
+    }
+    return false;
+}
+
 }  // namespace EBPF
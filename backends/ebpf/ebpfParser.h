@@ -17,6 +17,9 @@ limitations under the License.
 #ifndef _BACKENDS_EBPF_EBPFPARSER_H_
 #define _BACKENDS_EBPF_EBPFPARSER_H_
 
+#include <map>
+#include <set>
+
 #include "ir/ir.h"
 #include "ebpfObject.h"
 
@@ -41,11 +44,24 @@ class EBPFParser : public EBPFObject {
     const IR::Parameter*          packet;
     const IR::Parameter*          headers;
     EBPFType*                     headerType;
+    // The states that go to accept with the same headers valid on every path to them,
+    // and whose valid headers decide the verdict of the control: whether it passes
+    std::map<cstring, bool>       acceptVerdicts;
+    // With --parseOnlyNeeded, the headers whose fields the program reads, and the
+    // structs of headers that it uses whole, by their paths in the headers; the other
+    // headers are only checked against the length of the packet, and marked valid
+    std::set<cstring>             headersRead;
+    std::set<cstring>             structsRead;
 
     explicit EBPFParser(const EBPFProgram* program, const IR::ParserBlock* block,
                         const P4::TypeMap* typeMap);
     void emit(CodeBuilder* builder) override;
     bool build();
+    // Fills in acceptVerdicts, and headersRead; after the control is built
+    void analyze();
+    bool isRead(cstring header) const;
+    // the paths of the headers that state extracts
+    std::set<cstring> extracts(const IR::ParserState* state) const;
 };
 
 }  // namespace EBPF
@@ -14,6 +14,8 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+
 #include "ebpfTable.h"
 #include "ebpfType.h"
 #include "ir/ir.h"
@@ -62,15 +64,61 @@ class ActionTranslationVisitor : public CodeGenInspector {
 ////////////////////////////////////////////////////////////////
 
 EBPFTable::EBPFTable(const EBPFProgram* program, const IR::TableBlock* table) :
-        EBPFTableBase(program, table->container->externalName()), table(table) {
-    cstring base = instanceName + "_defaultAction";
-    defaultActionMapName = program->refMap->newName(base);
-
-    base = table->container->name.name + "_actions";
+        EBPFTableBase(program, table->container->externalName()), table(table),
+        constDefaultAction(nullptr) {
+    cstring base = table->container->name.name + "_actions";
     actionEnumName = program->refMap->newName(base);
 
     keyGenerator = table->container->getKey();
     actionList = table->container->getActionList();
+
+    auto dap = table->container->properties->getProperty(
+        IR::TableProperties::defaultActionPropertyName);
+    if (dap != nullptr && dap->isConstant) {
+        // always a call, even without arguments
+        constDefaultAction = table->container->getDefaultAction()->to<IR::MethodCallExpression>();
+    }
+    implemented = getImplementation();
+    layoutKey();
+}
+
+// The bits that a key field of this type takes in the key struct
+static unsigned keyFieldBits(EBPFType* type) {
+    auto st = dynamic_cast<EBPFScalarType*>(type);
+    if (st == nullptr)
+        return 8;  // a bool
+    if (!EBPFScalarType::generatesScalar(st->width))
+        return st->bytesRequired() * 8;
+    return st->width <= 8 ? 8 : st->width <= 16 ? 16 : 32;
+}
+
+static cstring matchTypeName(const EBPFProgram* program, const IR::KeyElement* c) {
+    auto mtdecl = program->refMap->getDeclaration(c->matchType->path, true);
+    return mtdecl->getNode()->to<IR::Declaration_ID>()->name.name;
+}
+
+void EBPFTable::layoutKey() {
+    keyOrder.clear();
+    keyPadding = false;
+    if (keyGenerator == nullptr || lookup == Lookup::Direct)
+        return;
+    std::vector<unsigned> align;
+    unsigned size = 0, maxAlign = 1;
+    for (auto c : *keyGenerator->keyElements) {
+        auto type = program->typeMap->getType(c->expression);
+        unsigned bits = keyFieldBits(EBPFTypeFactory::instance->create(type));
+        align.push_back(bits > 32 ? 1 : bits / 8);
+        keyOrder.push_back(keyOrder.size());
+        size += bits / 8;
+        maxAlign = std::max(maxAlign, align.back());
+    }
+    // the trie and the masks match the fields in the order of the key, and their
+    // structs are packed
+    if (lookup != Lookup::Exact)
+        return;
+    std::stable_sort(keyOrder.begin(), keyOrder.end(),
+                     [&align](unsigned a, unsigned b) { return align[a] > align[b]; });
+    keyPadding = size % maxAlign != 0;
 }
 
 void EBPFTable::emitKeyType(CodeBuilder* builder) {
@@ -78,21 +126,61 @@ void EBPFTable::emitKeyType(CodeBuilder* builder) {
     builder->appendFormat("struct %s ", keyTypeName);
     builder->blockStart();
 
-    unsigned fieldNumber = 0;
-    for (auto c : *keyGenerator->keyElements) {
+    if (lookup == Lookup::LPM) {
+        builder->emitIndent();
+        builder->appendLine("u32 prefixlen;");
+    } else if (lookup == Lookup::Ternary) {
+        builder->emitIndent();
+        builder->appendLine("u32 tuple;");
+    }
+
+    if (lookup == Lookup::Direct) {
+        // the index of the array
+        builder->emitIndent();
+        builder->appendLine("u32 field0;");
+        builder->blockEnd(false);
+        builder->endOfStatement(true);
+        return;
+    }
+
+    for (auto index : keyOrder) {
+        auto c = keyGenerator->keyElements->at(index);
         auto type = program->typeMap->getType(c->expression);
         builder->emitIndent();
         auto ebpfType = EBPFTypeFactory::instance->create(type);
-        ebpfType->declare(builder, cstring("field") + Util::toString(fieldNumber), false);
+        ebpfType->declare(builder, cstring("field") + Util::toString(index), false);
         builder->endOfStatement(true);
+    }
 
-        auto mtdecl = program->refMap->getDeclaration(c->matchType->path, true);
-        auto matchType = mtdecl->getNode()->to<IR::Declaration_ID>();
-        if (matchType->name.name != P4::P4CoreLibrary::instance.exactMatch.name)
+    auto& core = P4::P4CoreLibrary::instance;
+    unsigned fieldNumber = 0;
+    for (auto c : *keyGenerator->keyElements) {
+        fieldNumber++;
+
+        cstring match = matchTypeName(program, c);
+        bool last = fieldNumber == keyGenerator->keyElements->size();
+        if (match == core.exactMatch.name) {
+            if (lookup == Lookup::LPM && last)
+                ::error("%1%: the last key field of an %2% must have match kind %3%",
+                        c, program->model.lpm_table.name, core.lpmMatch.name);
+        } else if (match == core.lpmMatch.name) {
+            if (lookup == Lookup::Exact || (lookup == Lookup::LPM && !last))
+                ::error("%1%: match kind %2% is only supported for the last key field of "
+                        "an %3%, or in a %4%", c, c->matchType,
+                        program->model.lpm_table.name, program->model.ternary_table.name);
+        } else if (match == core.ternaryMatch.name) {
+            if (lookup != Lookup::Ternary)
+                ::error("%1%: match kind %2% is only supported in a %3%",
+                        c, c->matchType, program->model.ternary_table.name);
+        } else {
             ::error("Match of type %1% not supported", c->matchType);
+        }
     }
 
     builder->blockEnd(false);
+    // the fields that the trie or the masks match must follow each other
+    if (lookup != Lookup::Exact)
+        builder->append(" __attribute__((packed))");
     builder->endOfStatement(true);
 }
 
@@ -129,6 +217,9 @@ void EBPFTable::emitValueType(CodeBuilder* builder) {
         cstring name = action->externalName();
         builder->emitIndent();
         builder->append(name);
+        // the entries of an array that were never written are 0
+        if (a == actionList->actionList->at(0) && firstAction() != 0)
+            builder->appendFormat(" = %d", firstAction());
         builder->append(",");
         builder->newline();
     }
@@ -145,6 +236,12 @@ void EBPFTable::emitValueType(CodeBuilder* builder) {
     builder->appendFormat("enum %s action;", actionEnumName);
     builder->newline();
 
+    if (lookup == Lookup::Ternary) {
+        // of the entries matching several masks, the one with the highest priority wins
+        builder->emitIndent();
+        builder->appendLine("u32 priority;");
+    }
+
     builder->emitIndent();
     builder->append("union ");
     builder->blockStart();
@@ -163,88 +260,388 @@ void EBPFTable::emitValueType(CodeBuilder* builder) {
     builder->endOfStatement(true);
 }
 
-void EBPFTable::emit(CodeBuilder* builder) {
-    emitKeyType(builder);
-    emitValueType(builder);
-
+bool EBPFTable::getImplementation() {
     auto impl = table->container->properties->getProperty(program->model.tableImplProperty.name);
     if (impl == nullptr) {
         ::error("Table %1% does not have an %2% property",
                 table->container, program->model.tableImplProperty.name);
-        return;
+        return false;
     }
 
     // Some type checking...
     if (!impl->value->is<IR::ExpressionValue>()) {
         ::error("%1%: Expected property to be an `extern` block", impl);
-        return;
+        return false;
     }
 
     auto expr = impl->value->to<IR::ExpressionValue>()->expression;
     if (!expr->is<IR::ConstructorCallExpression>()) {
         ::error("%1%: Expected property to be an `extern` block", impl);
-        return;
+        return false;
     }
 
     auto block = table->getValue(expr);
     if (block == nullptr || !block->is<IR::ExternBlock>()) {
         ::error("%1%: Expected property to be an `extern` block", impl);
-        return;
+        return false;
     }
 
-    bool isHash;
     auto extBlock = block->to<IR::ExternBlock>();
-    if (extBlock->type->name.name == program->model.array_table.name) {
-        isHash = false;
-    } else if (extBlock->type->name.name == program->model.hash_table.name) {
-        isHash = true;
+    cstring implName = extBlock->type->name.name;
+    if (implName == program->model.array_table.name) {
+        lookup = Lookup::Exact;
+        kind = TableArray;
+    } else if (implName == program->model.hash_table.name) {
+        lookup = Lookup::Exact;
+        kind = TableHash;
+    } else if (implName == program->model.lru_hash_table.name) {
+        lookup = Lookup::Exact;
+        bool perCpu = table->container->annotations->getSingle(
+            program->model.lru_hash_table.perCpu.name) != nullptr;
+        kind = perCpu ? TablePerCpuLRUHash : TableLRUHash;
+    } else if (implName == program->model.lpm_table.name) {
+        lookup = Lookup::LPM;
+        kind = TableLPMTrie;
+    } else if (implName == program->model.ternary_table.name) {
+        lookup = Lookup::Ternary;
+        kind = TableHash;
     } else {
-        ::error("%1%: implementation must be one of %2% or %3%",
-                impl, program->model.array_table.name, program->model.hash_table.name);
-        return;
+        ::error("%1%: implementation must be one of %2%, %3%, %4%, %5% or %6%",
+                impl, program->model.array_table.name, program->model.hash_table.name,
+                program->model.lru_hash_table.name, program->model.lpm_table.name,
+                program->model.ternary_table.name);
+        return false;
     }
 
     auto sz = extBlock->getParameterValue(program->model.array_table.size.name);
     if (sz == nullptr || !sz->is<IR::Constant>()) {
         ::error("Expected an integer argument for %1%; is the model corrupted?", expr);
-        return;
+        return false;
     }
     auto cst = sz->to<IR::Constant>();
     if (!cst->fitsInt()) {
         ::error("%1%: size too large", cst);
-        return;
+        return false;
     }
-    int size = cst->asInt();
-    if (size <= 0) {
+    if (cst->asInt() <= 0) {
         ::error("%1%: negative size", cst);
-        return;
+        return false;
+    }
+    size = cst->asInt();
+
+    if (kind == TableHash && lookup == Lookup::Exact && keyGenerator != nullptr &&
+        keyGenerator->keyElements->size() == 1) {
+        auto c = keyGenerator->keyElements->at(0);
+        auto type = program->typeMap->getType(c->expression, true);
+        int width = type->is<IR::Type_Boolean>() ? 1 :
+                type->is<IR::Type_Bits>() ? type->to<IR::Type_Bits>()->size : 0;
+        if (width > 0 && width <= directKeyBits &&
+            matchTypeName(program, c) == P4::P4CoreLibrary::instance.exactMatch.name) {
+            lookup = Lookup::Direct;
+            kind = TableArray;
+            size = 1U << width;
+        }
+    }
+
+    if (lookup == Lookup::Ternary) {
+        auto m = extBlock->getParameterValue(program->model.ternary_table.masks.name);
+        if (m == nullptr || !m->is<IR::Constant>()) {
+            ::error("Expected an integer argument for %1%; is the model corrupted?", expr);
+            return false;
+        }
+        auto mc = m->to<IR::Constant>();
+        if (!mc->fitsInt() || mc->asInt() <= 0) {
+            ::error("%1%: expected a positive number of masks", mc);
+            return false;
+        }
+        masks = mc->asInt();
+        masksMapName = program->refMap->newName(instanceName + "_masks");
     }
+    return true;
+}
+
+void EBPFTable::emit(CodeBuilder* builder) {
+    if (!implemented)
+        return;
+    emitKeyType(builder);
+    emitValueType(builder);
 
     builder->emitIndent();
     cstring name = table->container->externalName();
-    builder->target->emitTableDecl(builder, name, isHash,
+    builder->target->emitTableDecl(builder, name, kind,
                                    cstring("struct ") + keyTypeName,
                                    cstring("struct ") + valueTypeName, size);
-    builder->target->emitTableDecl(builder, defaultActionMapName, false,
-                                   program->arrayIndexType,
-                                   cstring("struct ") + valueTypeName, 1);
+    if (lookup == Lookup::Ternary)
+        builder->target->emitTableDecl(builder, masksMapName, TableArray,
+                                       program->arrayIndexType,
+                                       cstring("struct ") + keyTypeName, masks);
+}
+
+void EBPFTable::emitControlPlane(CodeBuilder* builder) {
+    if (!implemented)
+        return;
+    emitKeyType(builder);
+    emitValueType(builder);
+
+    cstring name = table->container->externalName();
+    builder->appendFormat("#define %s_MAP \"%s\"", name.c_str(), name.c_str());
+    builder->newline();
+    builder->appendFormat("static inline int %s_update(int fd, const struct %s *keys,",
+                          name.c_str(), keyTypeName.c_str());
+    builder->newline();
+    if (kind == TablePerCpuLRUHash) {
+        // the value of each entry for each CPU, each padded to 8 bytes
+        builder->append("    const void *values, u32 count, u32 cpus)");
+        builder->newline();
+        builder->blockStart();
+        builder->emitIndent();
+        builder->appendFormat("return ebpf_batch(fd, keys, values, count, sizeof(*keys), "
+                              "cpus * ((sizeof(struct %s) + 7) & ~7));", valueTypeName.c_str());
+        builder->newline();
+    } else {
+        builder->appendFormat("    const struct %s *values, u32 count)", valueTypeName.c_str());
+        builder->newline();
+        builder->blockStart();
+        builder->emitIndent();
+        builder->appendLine("return ebpf_batch(fd, keys, values, count, sizeof(*keys), "
+                            "sizeof(*values));");
+    }
+    builder->blockEnd(true);
+    builder->appendFormat("static inline int %s_delete(int fd, const struct %s *keys, "
+                          "u32 count)", name.c_str(), keyTypeName.c_str());
+    builder->newline();
+    builder->blockStart();
+    if (lookup == Lookup::Direct) {
+        // the entries of an array cannot be deleted, but one with action 0 is a miss
+        builder->emitIndent();
+        builder->appendFormat("struct %s none;", valueTypeName.c_str());
+        builder->newline();
+        builder->emitIndent();
+        builder->appendLine("u32 i;");
+        builder->newline();
+        builder->emitIndent();
+        builder->appendLine("memset(&none, 0, sizeof(none));");
+        builder->emitIndent();
+        builder->appendLine("for (i = 0; i < count; i++)");
+        builder->emitIndent();
+        builder->appendLine("    if (ebpf_batch(fd, &keys[i], &none, 1, sizeof(*keys), "
+                            "sizeof(none)) != 0)");
+        builder->emitIndent();
+        builder->appendLine("        return -1;");
+        builder->emitIndent();
+        builder->appendLine("return 0;");
+    } else {
+        builder->emitIndent();
+        builder->appendLine("return ebpf_batch(fd, keys, NULL, count, sizeof(*keys), 0);");
+    }
+    builder->blockEnd(true);
+    if (lookup == Lookup::Ternary) {
+        builder->appendFormat("static inline int %s_update(int fd, const u32 *indexes,",
+                              masksMapName.c_str());
+        builder->newline();
+        builder->appendFormat("    const struct %s *masks, u32 count)", keyTypeName.c_str());
+        builder->newline();
+        builder->blockStart();
+        builder->emitIndent();
+        builder->appendLine("return ebpf_batch(fd, indexes, masks, count, sizeof(*indexes), "
+                            "sizeof(*masks));");
+        builder->blockEnd(true);
+    }
+    builder->newline();
+}
+
+void EBPFTable::emitStatsLegend(CodeBuilder* builder) {
+    cstring name = table->container->externalName();
+    builder->emitIndent();
+    builder->appendFormat("ebpf_stats_%s_hits = %d,", name.c_str(), statsIndex);
+    builder->newline();
+    builder->emitIndent();
+    builder->appendFormat("ebpf_stats_%s_misses,", name.c_str());
+    builder->newline();
+    builder->emitIndent();
+    builder->appendFormat("ebpf_stats_%s_ns,", name.c_str());
+    builder->newline();
+    for (auto a : *actionList->actionList) {
+        auto adecl = program->refMap->getDeclaration(a->getPath(), true);
+        auto action = adecl->getNode()->to<IR::P4Action>();
+        builder->emitIndent();
+        builder->appendFormat("ebpf_stats_%s_action_%s,", name.c_str(),
+                              action->externalName().c_str());
+        builder->newline();
+    }
 }
 
 void EBPFTable::createKey(CodeBuilder* builder, cstring keyName) {
+    if (keyPadding) {
+        builder->emitIndent();
+        builder->appendFormat("__builtin_memset(&%s, 0, sizeof(%s))",
+                              keyName.c_str(), keyName.c_str());
+        builder->endOfStatement(true);
+    }
     unsigned fieldNumber = 0;
+    unsigned keyBits = 0;
     for (auto c : *keyGenerator->keyElements) {
+        auto type = program->typeMap->getType(c->expression);
+        auto ebpfType = EBPFTypeFactory::instance->create(type);
+        unsigned bits = keyFieldBits(ebpfType);
+        CodeGenInspector visitor(builder, program->typeMap);
+
         builder->emitIndent();
-        builder->append(keyName);
-        builder->append(".field");
-        builder->append(fieldNumber);
-        builder->append(" = ");
+        if (bits > 32) {
+            // an array of bytes
+            builder->appendFormat("__builtin_memcpy(%s.field%d, ", keyName.c_str(), fieldNumber);
+            c->expression->apply(visitor);
+            builder->appendFormat(", %d)", bits / 8);
+        } else if (lookup == Lookup::LPM &&
+                   matchTypeName(program, c) == P4::P4CoreLibrary::instance.lpmMatch.name) {
+            // the trie matches the prefix from the most significant bit, in network order
+            unsigned width = dynamic_cast<EBPFScalarType*>(ebpfType)->width;
+            builder->appendFormat("%s.field%d = ", keyName.c_str(), fieldNumber);
+            if (bits > 8)
+                builder->append(bits == 16 ? "bpf_htons(" : "bpf_htonl(");
+            builder->append("(");
+            c->expression->apply(visitor);
+            builder->append(")");
+            if (width < bits)
+                builder->appendFormat(" << %d", bits - width);
+            if (bits > 8)
+                builder->append(")");
+        } else {
+            builder->appendFormat("%s.field%d = ", keyName.c_str(), fieldNumber);
+            c->expression->apply(visitor);
+        }
+        builder->endOfStatement(true);
+        keyBits += bits;
+        fieldNumber++;
+    }
 
-        CodeGenInspector visitor(builder, program->typeMap);
-        c->expression->apply(visitor);
+    if (lookup == Lookup::LPM) {
+        builder->emitIndent();
+        builder->appendFormat("%s.prefixlen = %d", keyName.c_str(), keyBits);
         builder->endOfStatement(true);
     }
 }
 
+void EBPFTable::emitLookup(CodeBuilder* builder, cstring keyName, cstring valueName) {
+    if (lookup != Lookup::Ternary) {
+        builder->emitIndent();
+        builder->target->emitTableLookup(builder, dataMapName, keyName, valueName);
+        builder->endOfStatement(true);
+        if (lookup == Lookup::Direct) {
+            // an array has every entry; the ones never written have no action
+            builder->emitIndent();
+            builder->appendFormat("if (%s != NULL && %s->action == 0)",
+                                  valueName.c_str(), valueName.c_str());
+            builder->newline();
+            builder->emitIndent();
+            builder->appendFormat("    %s = NULL", valueName.c_str());
+            builder->endOfStatement(true);
+        }
+        return;
+    }
+
+    builder->emitIndent();
+    builder->appendFormat("%s = NULL", valueName.c_str());
+    builder->endOfStatement(true);
+    for (unsigned i = 0; i < masks; i++) {
+        builder->emitIndent();
+        builder->blockStart();
+        builder->emitIndent();
+        builder->appendFormat("u32 ebpf_tuple = %d;", i);
+        builder->newline();
+        builder->emitIndent();
+        builder->appendFormat("struct %s *ebpf_mask", keyTypeName.c_str());
+        builder->endOfStatement(true);
+        builder->emitIndent();
+        builder->target->emitTableLookup(builder, masksMapName, "ebpf_tuple", "ebpf_mask");
+        builder->endOfStatement(true);
+
+        // masks with a zero tuple field are not in use
+        builder->emitIndent();
+        builder->append("if (ebpf_mask != NULL && ebpf_mask->tuple != 0) ");
+        builder->blockStart();
+        builder->emitIndent();
+        builder->appendFormat("struct %s ebpf_masked", keyTypeName.c_str());
+        builder->endOfStatement(true);
+        builder->emitIndent();
+        builder->appendFormat("ebpf_masked.tuple = %d;", i);
+        builder->newline();
+
+        unsigned fieldNumber = 0;
+        for (auto c : *keyGenerator->keyElements) {
+            auto type = program->typeMap->getType(c->expression);
+            unsigned bits = keyFieldBits(EBPFTypeFactory::instance->create(type));
+            if (bits > 32) {
+                for (unsigned b = 0; b < bits / 8; b++) {
+                    builder->emitIndent();
+                    builder->appendFormat("ebpf_masked.field%d[%d] = %s.field%d[%d] & "
+                                          "ebpf_mask->field%d[%d];", fieldNumber, b,
+                                          keyName.c_str(), fieldNumber, b, fieldNumber, b);
+                    builder->newline();
+                }
+            } else {
+                builder->emitIndent();
+                builder->appendFormat("ebpf_masked.field%d = %s.field%d & ebpf_mask->field%d;",
+                                      fieldNumber, keyName.c_str(), fieldNumber, fieldNumber);
+                builder->newline();
+            }
+            fieldNumber++;
+        }
+
+        builder->emitIndent();
+        builder->appendFormat("struct %s *ebpf_entry", valueTypeName.c_str());
+        builder->endOfStatement(true);
+        builder->emitIndent();
+        builder->target->emitTableLookup(builder, dataMapName, "ebpf_masked", "ebpf_entry");
+        builder->endOfStatement(true);
+        builder->emitIndent();
+        builder->appendFormat("if (ebpf_entry != NULL && (%s == NULL || "
+                              "ebpf_entry->priority > %s->priority))",
+                              valueName.c_str(), valueName.c_str());
+        builder->newline();
+        builder->increaseIndent();
+        builder->emitIndent();
+        builder->appendFormat("%s = ebpf_entry;", valueName.c_str());
+        builder->newline();
+        builder->decreaseIndent();
+        builder->blockEnd(true);
+        builder->blockEnd(true);
+    }
+}
+
+void EBPFTable::emitConstDefault(CodeBuilder* builder, cstring valueName) {
+    auto path = constDefaultAction->method->to<IR::PathExpression>();
+    BUG_CHECK(path != nullptr, "%1%: unexpected default action", constDefaultAction);
+    auto adecl = program->refMap->getDeclaration(path->path, true);
+    auto action = adecl->getNode()->to<IR::P4Action>();
+    BUG_CHECK(action != nullptr, "%1%: not an action", constDefaultAction);
+    cstring name = action->externalName();
+
+    builder->emitIndent();
+    builder->appendFormat("struct %s %s = ", valueTypeName.c_str(), valueName.c_str());
+    builder->blockStart();
+    builder->emitIndent();
+    builder->appendFormat(".action = %s,", name.c_str());
+    builder->newline();
+    builder->emitIndent();
+    builder->appendFormat(".u.%s = ", name.c_str());
+    builder->blockStart();
+    auto args = constDefaultAction->arguments->begin();
+    for (auto p : *action->parameters->getEnumerator()) {
+        if (args == constDefaultAction->arguments->end())
+            break;
+        builder->emitIndent();
+        builder->appendFormat(".%s = ", p->name.name.c_str());
+        CodeGenInspector visitor(builder, program->typeMap);
+        (*args++)->apply(visitor);
+        builder->append(",");
+        builder->newline();
+    }
+    builder->blockEnd(true);
+    builder->blockEnd(false);
+    builder->endOfStatement(true);
+}
+
 void EBPFTable::runAction(CodeBuilder* builder, cstring valueName) {
     builder->emitIndent();
     builder->appendFormat("switch (%s->action) ", valueName);
@@ -299,6 +696,10 @@ EBPFCounterTable::EBPFCounterTable(const EBPFProgram* program,
     }
 
     isHash = sprs->to<IR::BoolLiteral>()->value;
+
+    auto di = block->node->to<IR::Declaration_Instance>();
+    perCpu = di != nullptr &&
+            di->annotations->getSingle(program->model.counterArray.perCpu.name) != nullptr;
 }
 
 void EBPFCounterTable::emit(CodeBuilder* builder) {
@@ -306,7 +707,12 @@ void EBPFCounterTable::emit(CodeBuilder* builder) {
     auto valueType = EBPFTypeFactory::instance->create(EBPFModel::counterValueType);
     keyTypeName = indexType->toString(builder->target);
     valueTypeName = valueType->toString(builder->target);
-    builder->target->emitTableDecl(builder, dataMapName, isHash,
+    TableKind kind;
+    if (perCpu)
+        kind = isHash ? TablePerCpuHash : TablePerCpuArray;
+    else
+        kind = isHash ? TableHash : TableArray;
+    builder->target->emitTableDecl(builder, dataMapName, kind,
                                    keyTypeName, valueTypeName, size);
 }
 
@@ -349,7 +755,11 @@ void EBPFCounterTable::emitCounterIncrement(CodeBuilder* builder,
     builder->newline();
     builder->increaseIndent();
     builder->emitIndent();
-    builder->appendFormat("__sync_fetch_and_add(%s, 1);", valueName.c_str());
+    // no other CPU writes this CPU's copy of a per-CPU counter
+    if (perCpu)
+        builder->appendFormat("*%s += 1;", valueName.c_str());
+    else
+        builder->appendFormat("__sync_fetch_and_add(%s, 1);", valueName.c_str());
     builder->newline();
     builder->decreaseIndent();
 
@@ -41,20 +41,66 @@ class EBPFTableBase : public EBPFObject {
 };
 
 class EBPFTable final : public EBPFTableBase {
+    friend class EBPFBudget;
+    friend class EBPFBytecode;
+
  protected:
     const IR::Key*            keyGenerator;
     const IR::ActionList*     actionList;
 
+    // How entries are found: by the whole key; by the longest prefix, in an LPM trie
+    // whose key starts with a prefix length; by tuple-space search for ternary
+    // keys, in a hash table whose key starts with the number of a mask, with one
+    // lookup for each of the masks in masksMapName; or, for a hash_table with a single
+    // exact key of up to directKeyBits, in an array indexed by the key, without
+    // hashing, where an entry whose action is 0 is a miss.
+    enum class Lookup { Exact, LPM, Ternary, Direct };
+    static const int directKeyBits = 16;
+    Lookup                    lookup = Lookup::Exact;
+    TableKind                 kind = TableHash;
+    unsigned                  size = 0;
+    unsigned                  masks = 0;
+    cstring                   masksMapName;
+
+    // The indexes of the key elements in the order of the fields of the key struct.
+    // For an exact lookup the fields are sorted by decreasing alignment, so that there
+    // is no padding between them; there may still be some at the end, which the hash
+    // covers, so then keyPadding is set and the key is zeroed before it is filled.
+    std::vector<unsigned>     keyOrder;
+    bool                      keyPadding = false;
+
+    bool getImplementation();
+    bool implemented;  // the implementation property is valid
+    void layoutKey();
+
  public:
     const IR::TableBlock*    table;
-    cstring               defaultActionMapName;
     cstring               actionEnumName;
+    // The default action when it is declared const, which the program runs without
+    // looking it up; other default actions are in the map of EBPFControl.
+    const IR::MethodCallExpression* constDefaultAction;
+    // With --tableStats, the index of the first of the counters of the table: hits,
+    // misses, nanoseconds, and then one for each action
+    unsigned              statsIndex = 0;
+    static const unsigned statsPerTable = 3;
 
     EBPFTable(const EBPFProgram* program, const IR::TableBlock* table);
     void emit(CodeBuilder* builder) override;
+    // Sets valueName to the entry for keyName, or NULL
+    void emitLookup(CodeBuilder* builder, cstring keyName, cstring valueName);
+    // Declares valueName, a value holding the const default action
+    void emitConstDefault(CodeBuilder* builder, cstring valueName);
     void emitActionArguments(CodeBuilder* builder, const IR::P4Action* action,
                              cstring name);
+    // The types of the table, and the functions of the user-space header that write and
+    // delete its entries
+    void emitControlPlane(CodeBuilder* builder);
     void emitKeyType(CodeBuilder* builder);
+    // The names of the counters of the table, in the enum of EBPFControl::emitStatsLegend
+    void emitStatsLegend(CodeBuilder* builder);
+    unsigned statsCount() const { return statsPerTable + actionList->size(); }
+    // The value of the first action in the enum of the actions
+    unsigned firstAction() const { return lookup == Lookup::Direct ? 1 : 0; }
     void emitValueType(CodeBuilder* builder);
     void createKey(CodeBuilder* builder, cstring keyName);
     void runAction(CodeBuilder* builder, cstring valueName);
@@ -63,6 +109,7 @@ class EBPFTable final : public EBPFTableBase {
 class EBPFCounterTable final : public EBPFTableBase {
     size_t    size;
     bool      isHash;
+    bool      perCpu;  // annotated with @percpu
  public:
     EBPFCounterTable(const EBPFProgram* program, const IR::ExternBlock* block, cstring name);
     void emit(CodeBuilder* builder) override;
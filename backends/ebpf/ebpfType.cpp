@@ -23,6 +23,14 @@ EBPFTypeFactory* EBPFTypeFactory::instance;
 EBPFType* EBPFTypeFactory::create(const IR::Type* type) {
     CHECK_NULL(type);
     CHECK_NULL(typeMap);
+    // bits of a width are the same type, however many nodes stand for them
+    if (auto bits = type->to<IR::Type_Bits>())
+        type = IR::Type_Bits::get(bits->size, bits->isSigned);
+    else if (type->is<IR::Type_Boolean>())
+        type = IR::Type_Boolean::get();
+    auto known = types.find(type);
+    if (known != types.end())
+        return known->second;
     EBPFType* result = nullptr;
     if (type->is<IR::Type_Boolean>()) {
         result = new EBPFBoolType();
@@ -43,9 +51,17 @@ EBPFType* EBPFTypeFactory::create(const IR::Type* type) {
         ::error("Type %1% unsupported by EBPF", type);
     }
 
+    if (result != nullptr)
+        types.emplace(type, result);
     return result;
 }
 
+void EBPFTypeFactory::setValidityMask(cstring owner, unsigned width) {
+    validityMaskOwner = owner;
+    validityMaskWidth = width;
+    types.clear();
+}
+
 void
 EBPFBoolType::declare(CodeBuilder* builder, cstring id, bool asPointer) {
     emit(builder);
@@ -118,7 +134,12 @@ EBPFStructType::EBPFStructType(const IR::Type_StructLike* strct) :
     name = strct->name.name;
     width = 0;
     implWidth = 0;
+    auto factory = EBPFTypeFactory::instance;
+    validByte = strct->is<IR::Type_Header>() && factory->validityMaskOwner.isNullOrEmpty();
+    maskWidth = name == factory->validityMaskOwner ? factory->validityMaskWidth : 0;
 
+    bytes = 0;
+    align = std::max(1U, maskWidth / 8);
     for (auto f : *strct->fields) {
         auto type = EBPFTypeFactory::instance->create(f->type);
         auto wt = dynamic_cast<IHasWidth*>(type);
@@ -128,8 +149,26 @@ EBPFStructType::EBPFStructType(const IR::Type_StructLike* strct) :
             width += wt->widthInBits();
             implWidth += wt->implementationWidthInBits();
         }
-        fields.push_back(new EBPFField(type, f));
+        auto field = new EBPFField(type, f);
+        fields.push_back(field);
+        if (type == nullptr)
+            continue;
+        unsigned fieldAlign = type->alignInBytes();
+        align = std::max(align, fieldAlign);
+        if (kind == "union") {
+            bytes = std::max(bytes, type->sizeInBytes());
+        } else {
+            field->offset = ROUNDUP(bytes, fieldAlign) * fieldAlign;
+            bytes = field->offset + type->sizeInBytes();
+        }
+    }
+    if (maskWidth != 0) {
+        unsigned maskSize = maskWidth / 8;
+        bytes = ROUNDUP(bytes, maskSize) * maskSize + maskSize;  // ebpf_valid_mask
     }
+    if (validByte)
+        bytes++;  // ebpf_valid
+    bytes = ROUNDUP(bytes, align) * align;
 }
 
 void
@@ -143,7 +182,11 @@ EBPFStructType::declare(CodeBuilder* builder, cstring id, bool asPointer) {
 
 void EBPFStructType::emitInitializer(CodeBuilder* builder) {
     builder->blockStart();
-    if (type->is<IR::Type_Struct>() || type->is<IR::Type_Union>()) {
+    if (maskWidth != 0) {
+        // all the headers are invalid; C zeroes the rest
+        builder->emitIndent();
+        builder->appendLine(".ebpf_valid_mask = 0");
+    } else if (type->is<IR::Type_Struct>() || type->is<IR::Type_Union>()) {
         for (auto f : fields) {
             builder->emitIndent();
             builder->appendFormat(".%s = ", f->field->name.name);
@@ -152,8 +195,10 @@ void EBPFStructType::emitInitializer(CodeBuilder* builder) {
             builder->newline();
         }
     } else if (type->is<IR::Type_Header>()) {
-        builder->emitIndent();
-        builder->appendLine(".ebpf_valid = 0");
+        if (validByte) {
+            builder->emitIndent();
+            builder->appendLine(".ebpf_valid = 0");
+        }
     } else {
         BUG("Unexpected type %1%", type);
     }
@@ -180,7 +225,13 @@ void EBPFStructType::emit(CodeBuilder* builder) {
         builder->newline();
     }
 
-    if (type->is<IR::Type_Header>()) {
+    if (maskWidth != 0) {
+        builder->emitIndent();
+        builder->appendFormat("u%d ebpf_valid_mask", maskWidth);
+        builder->endOfStatement(true);
+    }
+
+    if (validByte) {
         builder->emitIndent();
         auto type = EBPFTypeFactory::instance->create(IR::Type_Boolean::get());
         if (type != nullptr) {
@@ -17,6 +17,8 @@ limitations under the License.
 #ifndef _BACKENDS_EBPF_EBPFTYPE_H_
 #define _BACKENDS_EBPF_EBPFTYPE_H_
 
+#include <unordered_map>
+
 #include "lib/algorithm.h"
 #include "lib/sourceCodeBuilder.h"
 #include "ebpfObject.h"
@@ -38,6 +40,9 @@ class EBPFType : public EBPFObject {
                               const char* /*id*/, unsigned /*size*/)
     { BUG("Arrays of %1% not supported", type); }
     cstring toString(const Target* target);
+    // The bytes that a C variable of this type takes, with padding, and its alignment
+    virtual unsigned sizeInBytes() const { return 1; }
+    virtual unsigned alignInBytes() const { return 1; }
 };
 
 class IHasWidth {
@@ -50,15 +55,27 @@ class IHasWidth {
     virtual unsigned implementationWidthInBits() = 0;
 };
 
+// Makes the EBPF type of each P4 type once: the types are not changed once made, so
+// each call for the same type (or for bits of the same width) returns the same object,
+// with the layout of a struct worked out when it was made.
 class EBPFTypeFactory {
  private:
     const P4::TypeMap* typeMap;
+    std::unordered_map<const IR::Type*, EBPFType*> types;
     explicit EBPFTypeFactory(const P4::TypeMap* typeMap) : typeMap(typeMap) {}
  public:
     static EBPFTypeFactory* instance;
+    // With --validityMask, the name of the struct of the headers, which keeps the valid
+    // bits of all the headers in a word of this width rather than a byte in each header
+    cstring validityMaskOwner;
+    unsigned validityMaskWidth = 0;
+
     static void createFactory(const P4::TypeMap* typeMap)
     { EBPFTypeFactory::instance = new EBPFTypeFactory(typeMap); }
     EBPFType* create(const IR::Type* type);
+    // Sets validityMaskOwner and validityMaskWidth; the types made before are made
+    // again, as the headers and their struct change
+    void setValidityMask(cstring owner, unsigned width);
 };
 
 class EBPFBoolType : public EBPFType, IHasWidth {
@@ -90,6 +107,9 @@ class EBPFScalarType : public EBPFType, public IHasWidth {
     { builder->append("0"); }
     unsigned widthInBits() override { return width; }
     unsigned implementationWidthInBits() override { return bytesRequired() * 8; }
+    unsigned sizeInBytes() const override
+    { return generatesScalar(width) ? alignment() : bytesRequired(); }
+    unsigned alignInBytes() const override { return alignment(); }
     // True if this width is small enough to store in a machine scalar
     static bool generatesScalar(unsigned width)
     { return width <= 32; }
@@ -107,6 +127,10 @@ class EBPFTypeName : public EBPFType, public IHasWidth {
     void emitInitializer(CodeBuilder* builder) override;
     unsigned widthInBits() override;
     unsigned implementationWidthInBits() override;
+    unsigned sizeInBytes() const override
+    { return canonical != nullptr ? canonical->sizeInBytes() : 1; }
+    unsigned alignInBytes() const override
+    { return canonical != nullptr ? canonical->alignInBytes() : 1; }
 };
 
 // Also represents headers and unions
@@ -115,6 +139,7 @@ class EBPFStructType : public EBPFType, public IHasWidth {
      public:
         EBPFType* type;
         const IR::StructField* field;
+        unsigned offset = 0;  // in bytes, in the C struct
 
         EBPFField(EBPFType* type, const IR::StructField* field) :
                 type(type), field(field) {}
@@ -126,12 +151,18 @@ class EBPFStructType : public EBPFType, public IHasWidth {
     std::vector<EBPFField*>  fields;
     unsigned width;
     unsigned implWidth;
+    bool     validByte;  // ebpf_valid, in a header
+    unsigned maskWidth;  // of ebpf_valid_mask, in the struct of the headers, or 0
+    unsigned bytes;      // the C layout
+    unsigned align;
 
     explicit EBPFStructType(const IR::Type_StructLike* strct);
     void declare(CodeBuilder* builder, cstring id, bool asPointer) override;
     void emitInitializer(CodeBuilder* builder) override;
     unsigned widthInBits() override { return width; }
     unsigned implementationWidthInBits() override { return implWidth; }
+    unsigned sizeInBytes() const override { return bytes; }
+    unsigned alignInBytes() const override { return align; }
     void emit(CodeBuilder* builder) override;
 };
 
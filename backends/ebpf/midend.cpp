@@ -16,15 +16,18 @@ limitations under the License.
 
 #include "midend.h"
 #include "midend/actionsInlining.h"
+#include "midend/actionSynthesis.h"
 #include "midend/inlining.h"
 #include "midend/removeReturns.h"
 #include "midend/moveConstructors.h"
-#include "midend/actionSynthesis.h"
+#include "midend/commonSubexpressions.h"
 #include "midend/localizeActions.h"
 #include "midend/removeParameters.h"
 #include "midend/local_copyprop.h"
 #include "midend/simplifyKey.h"
 #include "midend/simplifySelect.h"
+#include "midend/specializeActions.h"
+#include "midend/stackIndices.h"
 #include "midend/validateProperties.h"
 #include "midend/eliminateTuples.h"
 #include "midend/noMatch.h"
@@ -81,17 +84,22 @@ const IR::ToplevelBlock* MidEnd::run(EbpfOptions& options, const IR::P4Program*
         new P4::ClearTypeMap(&typeMap),
         new P4::SimplifyControlFlow(&refMap, &typeMap),
         new P4::RemoveTableParameters(&refMap, &typeMap),
+        options.optimize(2) ? new P4::InlineFixedTables(&refMap, &typeMap) : nullptr,
         new P4::RemoveActionParameters(&refMap, &typeMap),
+        options.optimize(2) ? new P4::SpecializeActions(&refMap, &typeMap) : nullptr,
         new P4::SimplifyKey(&refMap, &typeMap,
                             new P4::NonLeftValue(&refMap, &typeMap)),
+        options.optimizeKeys ? new P4::OptimizeKey(&refMap, &typeMap, &keyPolicy) : nullptr,
         new P4::RemoveExits(&refMap, &typeMap),
         new P4::ConstantFolding(&refMap, &typeMap),
+        new P4::ConstantStackIndices(&refMap, &typeMap, true),
         new P4::SimplifySelect(&refMap, &typeMap, false),  // accept non-constant keysets
         new P4::HandleNoMatch(&refMap),
         new P4::SimplifyParsers(&refMap),
-        new P4::StrengthReduction(),
+        options.optimize(1) ? new P4::StrengthReduction() : nullptr,
         new P4::EliminateTuples(&refMap, &typeMap),
-        new P4::LocalCopyPropagation(&refMap, &typeMap),
+        options.optimize(1) ? new P4::LocalCopyPropagation(&refMap, &typeMap) : nullptr,
+        options.optimize(2) ? new P4::CommonSubexpressions(&refMap, &typeMap) : nullptr,
         new P4::MoveDeclarations(),  // more may have been introduced
         new P4::SimplifyControlFlow(&refMap, &typeMap),
         new P4::ValidateTableProperties({"implementation"}),
@@ -21,14 +21,27 @@ limitations under the License.
 #include "ebpfOptions.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
 #include "frontends/p4/typeMap.h"
+#include "midend/optimizeKey.h"
 
 namespace EBPF {
 
+// What --optimizeKeys may do to the keys of the tables: the key fields of the maps
+// wider than 32 bits are byte arrays, which a concatenation is not copied into.
+class KeyPolicy : public P4::KeyLayoutPolicy {
+ public:
+    // the keys that were changed, by the name of their table
+    std::map<cstring, P4::KeyLayout> layouts;
+    unsigned maxMergedWidth() const override { return 32; }
+    void keyChanged(const IR::P4Table* table, const P4::KeyLayout& layout) override
+    { layouts[table->externalName()] = layout; }
+};
+
 class MidEnd {
     std::vector<DebugHook> hooks;
  public:
     P4::ReferenceMap       refMap;
     P4::TypeMap            typeMap;
+    KeyPolicy              keyPolicy;
 
     void addDebugHook(DebugHook hook) { hooks.push_back(hook); }
     const IR::ToplevelBlock* run(EbpfOptions& options, const IR::P4Program* program);
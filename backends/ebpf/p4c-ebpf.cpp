@@ -28,6 +28,7 @@ limitations under the License.
 #include "midend.h"
 #include "ebpfOptions.h"
 #include "ebpfBackend.h"
+#include "frontends/common/batch.h"
 #include "frontends/common/parseInput.h"
 #include "frontends/p4/frontend.h"
 
@@ -38,39 +39,46 @@ void compile(EbpfOptions& options) {
         ::error("This compiler only handles P4-16");
         return;
     }
-    auto program = parseP4File(options);
-    if (::errorCount() > 0)
-        return;
     P4::FrontEnd frontend;
     frontend.addDebugHook(hook);
-    program = frontend.run(options, program);
+    auto program = parseAndRunFrontEnd(options, frontend);
     if (::errorCount() > 0)
         return;
 
     EBPF::MidEnd midend;
     midend.addDebugHook(hook);
     auto toplevel = midend.run(options, program);
-    if (options.dumpJsonFile)
-        JSONGenerator(*openFile(options.dumpJsonFile, true)) << program << std::endl;
+    if (options.dumpJsonFile) {
+        auto out = openFile(options.dumpJsonFile, true);
+        JSONGenerator(*out, options.compactJson) << program << std::endl;
+        delete out;  // finishes a .gz file
+    }
     if (::errorCount() > 0)
         return;
 
     EBPF::run_ebpf_backend(options, toplevel, &midend.refMap, &midend.typeMap);
 }
 
-int main(int argc, char *const argv[]) {
-    setup_gc_logging();
-    setup_signals();
-
+// Compiles the program given by this command line; returns the exit status
+static int compileCommand(int argc, char *const argv[]) {
     EbpfOptions options;
     if (options.process(argc, argv) != nullptr)
         options.setInputFile();
     if (::errorCount() > 0)
-        exit(1);
+        return 1;
 
     compile(options);
+    options.writePassStats();
 
     if (Log::verbose())
         std::cerr << "Done." << std::endl;
     return ::errorCount() > 0;
 }
+
+int main(int argc, char *const argv[]) {
+    setup_gc_logging();
+    setup_signals();
+
+    int status = runBatch(argc, argv, compileCommand);
+    return status >= 0 ? status : compileCommand(argc, argv);
+}
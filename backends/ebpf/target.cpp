@@ -34,6 +34,10 @@ void KernelSamplesTarget::emitIncludes(Util::SourceCodeBuilder* builder) const {
         "static int (*bpf_map_update_elem)(void *map, void *key, void *value\n"
         "                                  unsigned long long flags) =\n"
         "       (void *) BPF_FUNC_map_update_elem;\n"
+        "static void (*bpf_tail_call)(void *ctx, void *map, int index) =\n"
+        "       (void *) BPF_FUNC_tail_call;\n"
+        "static unsigned long long (*bpf_ktime_get_ns)(void) =\n"
+        "       (void *) BPF_FUNC_ktime_get_ns;\n"
         "unsigned long long load_byte(void *skb,\n"
         "                             unsigned long long off) asm(\"llvm.bpf.load.byte\");\n"
         "unsigned long long load_half(void *skb,\n"
@@ -45,7 +49,7 @@ void KernelSamplesTarget::emitIncludes(Util::SourceCodeBuilder* builder) const {
         "        __u32 key_size;\n"
         "        __u32 value_size;\n"
         "        __u32 max_entries;\n"
-        "        __u32 flags;\n"
+        "        __u32 map_flags;\n"
         "        __u32 id;\n"
         "        __u32 pinning;\n"
         "};\n");
@@ -64,7 +68,7 @@ void KernelSamplesTarget::emitTableUpdate(Util::SourceCodeBuilder* builder, cstr
 }
 
 void KernelSamplesTarget::emitTableDecl(Util::SourceCodeBuilder* builder,
-                                        cstring tblName, bool isHash,
+                                        cstring tblName, TableKind kind,
                                         cstring keyType, cstring valueType,
                                         unsigned size) const {
     builder->emitIndent();
@@ -72,10 +76,32 @@ void KernelSamplesTarget::emitTableDecl(Util::SourceCodeBuilder* builder,
     builder->blockStart();
     builder->emitIndent();
     builder->append(".type = ");
-    if (isHash)
-        builder->appendLine("BPF_MAP_TYPE_HASH,");
-    else
-        builder->appendLine("BPF_MAP_TYPE_ARRAY,");
+    switch (kind) {
+        case TableHash:
+            builder->appendLine("BPF_MAP_TYPE_HASH,");
+            break;
+        case TableArray:
+            builder->appendLine("BPF_MAP_TYPE_ARRAY,");
+            break;
+        case TablePerCpuHash:
+            builder->appendLine("BPF_MAP_TYPE_PERCPU_HASH,");
+            break;
+        case TablePerCpuArray:
+            builder->appendLine("BPF_MAP_TYPE_PERCPU_ARRAY,");
+            break;
+        case TableLRUHash:
+            builder->appendLine("BPF_MAP_TYPE_LRU_HASH,");
+            break;
+        case TablePerCpuLRUHash:
+            builder->appendLine("BPF_MAP_TYPE_LRU_PERCPU_HASH,");
+            break;
+        case TableLPMTrie:
+            builder->appendLine("BPF_MAP_TYPE_LPM_TRIE,");
+            break;
+        case TableProgArray:
+            builder->appendLine("BPF_MAP_TYPE_PROG_ARRAY,");
+            break;
+    }
 
     builder->emitIndent();
     builder->appendFormat(".key_size = sizeof(%s), ", keyType);
@@ -89,10 +115,21 @@ void KernelSamplesTarget::emitTableDecl(Util::SourceCodeBuilder* builder,
     builder->appendFormat(".max_entries = %d, ", size);
     builder->newline();
 
+    if (kind == TableLPMTrie) {
+        // LPM tries cannot be preallocated
+        builder->emitIndent();
+        builder->appendLine(".map_flags = BPF_F_NO_PREALLOC, ");
+    }
+
     builder->blockEnd(false);
     builder->endOfStatement(true);
 }
 
+void KernelSamplesTarget::emitTailCall(Util::SourceCodeBuilder* builder, cstring progArray,
+                                       cstring context, unsigned index) const {
+    builder->appendFormat("bpf_tail_call(%s, &%s, %d);", context, progArray, index);
+}
+
 void KernelSamplesTarget::emitLicense(Util::SourceCodeBuilder* builder, cstring license) const {
     builder->emitIndent();
     builder->appendFormat("char _license[] SEC(\"license\") = \"%s\";", license);
@@ -134,14 +171,34 @@ void BccTarget::emitIncludes(Util::SourceCodeBuilder* builder) const {
 }
 
 void BccTarget::emitTableDecl(Util::SourceCodeBuilder* builder,
-                              cstring tblName, bool isHash,
+                              cstring tblName, TableKind kind,
                               cstring keyType, cstring valueType, unsigned size) const {
-    cstring kind = isHash ? "hash" : "array";
+    if (kind == TableProgArray) {
+        builder->appendFormat("BPF_PROG_ARRAY(%s, %d);", tblName, size);
+        builder->newline();
+        return;
+    }
+    if (kind == TableLPMTrie) {
+        builder->appendFormat("BPF_F_TABLE(\"lpm_trie\", %s, %s, %s, %d, BPF_F_NO_PREALLOC);",
+                              keyType, valueType, tblName, size);
+        builder->newline();
+        return;
+    }
+    const char* type = kind == TableHash ? "hash" :
+            kind == TableArray ? "array" :
+            kind == TablePerCpuHash ? "percpu_hash" :
+            kind == TableLRUHash ? "lru_hash" :
+            kind == TablePerCpuLRUHash ? "lru_percpu_hash" : "percpu_array";
     builder->appendFormat("BPF_TABLE(\"%s\", %s, %s, %s, %d);",
-                          kind, keyType, valueType, tblName, size);
+                          type, keyType, valueType, tblName, size);
     builder->newline();
 }
 
+void BccTarget::emitTailCall(Util::SourceCodeBuilder* builder, cstring progArray,
+                             cstring context, unsigned index) const {
+    builder->appendFormat("%s.call(%s, %d);", progArray, context, index);
+}
+
 void BccTarget::emitLicense(Util::SourceCodeBuilder*, cstring) const {}
 
 void BccTarget::emitMain(Util::SourceCodeBuilder* builder,
@@ -150,4 +207,43 @@ void BccTarget::emitMain(Util::SourceCodeBuilder* builder,
     builder->appendFormat("int %s(struct __sk_buff* %s)", functionName, argName);
 }
 
+//////////////////////////////////////////////////////////////
+
+void XdpTarget::emitIncludes(Util::SourceCodeBuilder* builder) const {
+    builder->append(
+        "#include <linux/types.h>\n"
+        "#include <linux/version.h>\n"
+        "#include <uapi/linux/bpf.h>\n"
+        "#define SEC(NAME) __attribute__((section(NAME), used))\n"
+        "static void *(*bpf_map_lookup_elem)(void *map, void *key) =\n"
+        "       (void *) BPF_FUNC_map_lookup_elem;\n"
+        "static int (*bpf_map_update_elem)(void *map, void *key, void *value,\n"
+        "                                  unsigned long long flags) =\n"
+        "       (void *) BPF_FUNC_map_update_elem;\n"
+        "static void (*bpf_tail_call)(void *ctx, void *map, int index) =\n"
+        "       (void *) BPF_FUNC_tail_call;\n"
+        "static unsigned long long (*bpf_ktime_get_ns)(void) =\n"
+        "       (void *) BPF_FUNC_ktime_get_ns;\n"
+        "struct bpf_map_def {\n"
+        "        __u32 type;\n"
+        "        __u32 key_size;\n"
+        "        __u32 value_size;\n"
+        "        __u32 max_entries;\n"
+        "        __u32 map_flags;\n"
+        "        __u32 id;\n"
+        "        __u32 pinning;\n"
+        "};\n");
+}
+
+// Loaders tell the program type by the section name
+void XdpTarget::emitCodeSection(Util::SourceCodeBuilder* builder, cstring sectionName) const {
+    builder->appendFormat("SEC(\"xdp/%s\")\n", sectionName);
+}
+
+void XdpTarget::emitMain(Util::SourceCodeBuilder* builder,
+                         cstring functionName,
+                         cstring argName) const {
+    builder->appendFormat("int %s(struct xdp_md* %s)", functionName, argName);
+}
+
 }  // namespace EBPF
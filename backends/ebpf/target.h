@@ -26,6 +26,19 @@ limitations under the License.
 
 namespace EBPF {
 
+// The kinds of EBPF tables.  The per-CPU kinds keep a separate value for each CPU,
+// so that updates from different CPUs do not contend; readers add the values up.
+enum TableKind {
+    TableHash,
+    TableArray,
+    TablePerCpuHash,
+    TablePerCpuArray,
+    TableLRUHash,         // drops the least recently used entry when full
+    TablePerCpuLRUHash,
+    TableLPMTrie,
+    TableProgArray  // of programs to tail-call
+};
+
 class Target {
  protected:
     cstring name;
@@ -42,13 +55,23 @@ class Target {
     virtual void emitTableUpdate(Util::SourceCodeBuilder* builder, cstring tblName,
                                  cstring key, cstring value) const = 0;
     virtual void emitTableDecl(Util::SourceCodeBuilder* builder,
-                               cstring tblName, bool isHash,
+                               cstring tblName, TableKind kind,
                                cstring keyType, cstring valueType, unsigned size) const = 0;
+    // Jumps to the program at 'index' of the TableProgArray 'progArray'; falls through
+    // if there is none
+    virtual void emitTailCall(Util::SourceCodeBuilder* builder, cstring progArray,
+                              cstring context, unsigned index) const = 0;
     virtual void emitMain(Util::SourceCodeBuilder* builder,
                           cstring functionName,
                           cstring argName) const = 0;
     virtual cstring dataOffset(cstring base) const = 0;
     virtual cstring dataEnd(cstring base) const = 0;
+    // What the program returns for a packet that it lets through, or drops
+    virtual cstring forwardReturnCode() const { return "1"; }
+    virtual cstring dropReturnCode() const { return "0"; }
+    // True if the packet is read through the pointers given by dataOffset and dataEnd,
+    // rather than with the load_ helpers given the context
+    virtual bool directPacketAccess() const { return false; }
 };
 
 // Represents a target that is compiled within the kernel
@@ -64,8 +87,10 @@ class KernelSamplesTarget : public Target {
     void emitTableUpdate(Util::SourceCodeBuilder* builder, cstring tblName,
                          cstring key, cstring value) const override;
     void emitTableDecl(Util::SourceCodeBuilder* builder,
-                       cstring tblName, bool isHash,
+                       cstring tblName, TableKind kind,
                        cstring keyType, cstring valueType, unsigned size) const override;
+    void emitTailCall(Util::SourceCodeBuilder* builder, cstring progArray,
+                      cstring context, unsigned index) const override;
     void emitMain(Util::SourceCodeBuilder* builder,
                   cstring functionName,
                   cstring argName) const override;
@@ -76,8 +101,10 @@ class KernelSamplesTarget : public Target {
 
 // Represents a target compiled by bcc that uses the TC
 class BccTarget : public Target {
+    bool direct;
+
  public:
-    BccTarget() : Target("BCC") {}
+    explicit BccTarget(bool direct = false) : Target("BCC"), direct(direct) {}
     void emitLicense(Util::SourceCodeBuilder* builder, cstring license) const override;
     void emitCodeSection(Util::SourceCodeBuilder*, cstring) const override {}
     void emitIncludes(Util::SourceCodeBuilder* builder) const override;
@@ -86,14 +113,41 @@ class BccTarget : public Target {
     void emitTableUpdate(Util::SourceCodeBuilder* builder, cstring tblName,
                          cstring key, cstring value) const override;
     void emitTableDecl(Util::SourceCodeBuilder* builder,
-                       cstring tblName, bool isHash,
+                       cstring tblName, TableKind kind,
                        cstring keyType, cstring valueType, unsigned size) const override;
+    void emitTailCall(Util::SourceCodeBuilder* builder, cstring progArray,
+                      cstring context, unsigned index) const override;
     void emitMain(Util::SourceCodeBuilder* builder,
                   cstring functionName,
                   cstring argName) const override;
-    cstring dataOffset(cstring base) const override { return base; }
+    cstring dataOffset(cstring base) const override {
+        if (direct) return cstring("((void*)(long)") + base + "->data)";
+        return base; }
+    cstring dataEnd(cstring base) const override {
+        if (direct) return cstring("((void*)(long)") + base + "->data_end)";
+        return cstring("(") + base + " + " + base + "->len)"; }
+    bool directPacketAccess() const override { return direct; }
+};
+
+// Represents a target compiled within the kernel source tree samples folder, like
+// KernelSamplesTarget, but which attaches to the XDP hook of a network driver, so that
+// packets are filtered before the kernel allocates an skb for them.  The packet is
+// read directly, between the data and data_end pointers of the xdp_md context.
+class XdpTarget : public KernelSamplesTarget {
+ public:
+    XdpTarget() { name = "XDP"; }
+    void emitCodeSection(Util::SourceCodeBuilder* builder, cstring sectionName) const override;
+    void emitIncludes(Util::SourceCodeBuilder* builder) const override;
+    void emitMain(Util::SourceCodeBuilder* builder,
+                  cstring functionName,
+                  cstring argName) const override;
+    cstring dataOffset(cstring base) const override
+    { return cstring("((void*)(long)") + base + "->data)"; }
     cstring dataEnd(cstring base) const override
-    { return cstring("(") + base + " + " + base + "->len)"; }
+    { return cstring("((void*)(long)") + base + "->data_end)"; }
+    cstring forwardReturnCode() const override { return "XDP_PASS"; }
+    cstring dropReturnCode() const override { return "XDP_DROP"; }
+    bool directPacketAccess() const override { return true; }
 };
 
 }  // namespace EBPF
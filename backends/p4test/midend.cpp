@@ -50,6 +50,10 @@ MidEnd::MidEnd(CompilerOptions& options) {
     bool isv1 = options.langVersion == CompilerOptions::FrontendVersion::P4_14;
     refMap.setIsV1(isv1);
     auto evaluator = new P4::EvaluatorPass(&refMap, &typeMap);
+    // The output is P4 again, which can invoke the instances left alone
+    const P4::InlinePolicy* inlinePolicy = nullptr;
+    if (options.inlineBudget >= 0)
+        inlinePolicy = new P4::InlineWithinBudget(options.inlineBudget);
     setName("MidEnd");
 
     // TODO: parser loop unrolling
@@ -69,10 +73,10 @@ MidEnd::MidEnd(CompilerOptions& options) {
                 // nothing further to do
                 return nullptr;
             return root; }),
-        new P4::Inline(&refMap, &typeMap, evaluator),
+        new P4::Inline(&refMap, &typeMap, evaluator, inlinePolicy),
         new P4::InlineActions(&refMap, &typeMap),
         // Parser loop unrolling: TODO
-        // new P4::ParsersUnroll(true, &refMap, &typeMap),
+        // new P4::ParsersUnroll(true, &refMap, &typeMap, options.maxParserStates),
         new P4::LocalizeAllActions(&refMap),
         new P4::UniqueNames(&refMap),
         new P4::UniqueParameters(&refMap, &typeMap),
@@ -86,14 +90,14 @@ MidEnd::MidEnd(CompilerOptions& options) {
         new P4::SimplifySelect(&refMap, &typeMap, false),  // non-constant keysets
         new P4::HandleNoMatch(&refMap),
         new P4::SimplifyParsers(&refMap),
-        new P4::StrengthReduction(),
+        options.optimize(1) ? new P4::StrengthReduction() : nullptr,
         new P4::EliminateTuples(&refMap, &typeMap),
         new P4::CopyStructures(&refMap, &typeMap),
         new P4::NestedStructs(&refMap, &typeMap),
         new P4::Predication(&refMap),
         new P4::ConstantFolding(&refMap, &typeMap),
-        new P4::LocalCopyPropagation(&refMap, &typeMap),
-        new P4::ConstantFolding(&refMap, &typeMap),
+        options.optimize(1) ? new P4::LocalCopyPropagation(&refMap, &typeMap) : nullptr,
+        options.optimize(1) ? new P4::ConstantFolding(&refMap, &typeMap) : nullptr,
         new P4::MoveDeclarations(),  // more may have been introduced
         new P4::SimplifyControlFlow(&refMap, &typeMap),
         new P4::CompileTimeOperations(),
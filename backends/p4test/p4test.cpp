@@ -15,22 +15,22 @@ limitations under the License.
 */
 
 #include "ir/ir.h"
+#include "ir/binary_index.h"
 #include "lib/log.h"
 #include "lib/error.h"
 #include "lib/exceptions.h"
 #include "lib/gc.h"
 #include "lib/crash.h"
 #include "lib/nullstream.h"
+#include "frontends/common/batch.h"
 #include "frontends/common/parseInput.h"
 #include "frontends/p4/evaluator/evaluator.h"
 #include "frontends/p4/frontend.h"
 #include "frontends/p4/toP4/toP4.h"
 #include "midend.h"
 
-int main(int argc, char *const argv[]) {
-    setup_gc_logging();
-    setup_signals();
-
+// Compiles the program given by this command line; returns the exit status
+static int compileCommand(int argc, char *const argv[]) {
     CompilerOptions options;
     options.langVersion = CompilerOptions::FrontendVersion::P4_16;
 
@@ -39,50 +39,66 @@ int main(int argc, char *const argv[]) {
     if (::errorCount() > 0)
         return 1;
 
-    auto program = parseP4File(options);
     auto hook = options.getDebugHook();
+    P4::FrontEnd fe;
+    fe.addDebugHook(hook);
+    auto program = parseAndRunFrontEnd(options, fe);
 
     if (program != nullptr && ::errorCount() == 0) {
-        P4::FrontEnd fe;
-        fe.addDebugHook(hook);
-        program = fe.run(options, program);
-        if (program != nullptr && ::errorCount() == 0) {
-            P4Test::MidEnd midEnd(options);
-            midEnd.addDebugHook(hook);
+        if (options.dumpBinaryFile) {
+            auto out = openFile(options.dumpBinaryFile, true);
+            if (options.indexedBinary)
+                IndexedSnapshot::write(*out, program);
+            else
+                BinaryGenerator(*out) << program;
+            out->flush(); }
+        P4Test::MidEnd midEnd(options);
+        midEnd.addDebugHook(hook);
 #if 0
-            /* doing this breaks the output until we get dump/undump of srcInfo */
-            if (options.debugJson) {
-                std::stringstream tmp;
-                JSONGenerator gen(tmp);
-                gen << program;
-                JSONLoader loader(tmp);
-                loader >> program;
-            }
+        /* doing this breaks the output until we get dump/undump of srcInfo */
+        if (options.debugJson) {
+            std::stringstream tmp;
+            JSONGenerator gen(tmp);
+            gen << program;
+            JSONLoader loader(tmp);
+            loader >> program;
+        }
 #endif
-            (void)midEnd.process(program);
-            if (options.dumpJsonFile)
-                JSONGenerator(*openFile(options.dumpJsonFile, true)) << program << std::endl;
-            if (options.debugJson) {
-                std::stringstream ss1, ss2;
-                JSONGenerator gen1(ss1), gen2(ss2);
-                gen1 << program;
+        (void)midEnd.process(program);
+        if (options.dumpJsonFile) {
+            auto out = openFile(options.dumpJsonFile, true);
+            JSONGenerator(*out, options.compactJson) << program << std::endl;
+            delete out;  // finishes a .gz file
+        }
+        if (options.debugJson) {
+            std::stringstream ss1, ss2;
+            JSONGenerator gen1(ss1), gen2(ss2);
+            gen1 << program;
 
-                const IR::Node* node = nullptr;
-                JSONLoader loader(ss1);
-                loader >> node;
+            const IR::Node* node = nullptr;
+            JSONLoader loader(ss1);
+            loader >> node;
 
-                gen2 << node;
-                if (ss1.str() != ss2.str()) {
-                    error("json mismatch");
-                    std::ofstream t1("t1.json"), t2("t2.json");
-                    t1 << ss1.str() << std::flush;
-                    t2 << ss2.str() << std::flush;
-                    system("json_diff t1.json t2.json");
-                }
+            gen2 << node;
+            if (ss1.str() != ss2.str()) {
+                error("json mismatch");
+                std::ofstream t1("t1.json"), t2("t2.json");
+                t1 << ss1.str() << std::flush;
+                t2 << ss2.str() << std::flush;
+                system("json_diff t1.json t2.json");
             }
         }
     }
+    options.writePassStats();
     if (Log::verbose())
         std::cerr << "Done." << std::endl;
     return ::errorCount() > 0;
 }
+
+int main(int argc, char *const argv[]) {
+    setup_gc_logging();
+    setup_signals();
+
+    int status = runBatch(argc, argv, compileCommand);
+    return status >= 0 ? status : compileCommand(argc, argv);
+}
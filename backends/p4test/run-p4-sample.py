@@ -26,6 +26,10 @@ import tempfile
 import shutil
 import difflib
 import subprocess
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "tools"))
+import compile_perf
 
 SUCCESS = 0
 FAILURE = 1
@@ -41,6 +45,7 @@ class Options(object):
         self.dumpToJson = False
         self.compilerOptions = []
         self.runDebugger = False
+        self.perfDir = None             # directory for compile time records
 
 def usage(options):
     name = options.binary
@@ -53,6 +58,7 @@ def usage(options):
     print("          -v: verbose operation")
     print("          -f: replace reference outputs with newly generated ones")
     print("          -a \"args\": pass args to the compiler")
+    print("          -perf <dir>: record the compile time and memory in <dir>")
 
 def isError(p4filename):
     # True if the filename represents a p4 program that should fail
@@ -210,7 +216,14 @@ def process_file(options, argv):
     if options.runDebugger:
         args[0:0] = options.runDebugger.split()
         os.execvp(args[0], args)
+    if options.perfDir:
+        args[1:1] = compile_perf.capture_args(options.perfDir, "p4test",
+                                              options.compilerSrcdir, options.p4filename)
+    start = time.time()
     result = run_timeout(options, args, timeout, stderr)
+    if options.perfDir:
+        compile_perf.record(options.perfDir, "p4test", options.compilerSrcdir,
+                            options.p4filename, time.time() - start)
     if result != SUCCESS:
         print("Error compiling")
         print("".join(open(stderr).readlines()))
@@ -293,12 +306,20 @@ def main(argv):
             options.compilerOptions.append(argv[0])
         elif argv[0] == "-gdb":
             options.runDebugger = "gdb --args"
+        elif argv[0] == "-perf":
+            if len(argv) == 1:
+                print("Missing argument for -perf option", file=sys.stderr)
+                usage(options)
+                sys.exit(1)
+            options.perfDir = argv[1]
+            argv = argv[1:]
         else:
             print("Uknown option ", argv[0], file=sys.stderr)
             usage(options)
             sys.exit(1)
         argv = argv[1:]
 
+    options.perfDir = compile_perf.perf_dir(options.perfDir)
     options.p4filename=argv[-1]
     options.testName = None
     if options.p4filename.startswith(options.compilerSrcdir):
@@ -0,0 +1,266 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "batch.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#ifdef MULTITHREAD
+#include <deque>
+#include <mutex>
+#endif  // MULTITHREAD
+#include <thread>
+
+#include "ir/ir.h"
+#include "lib/error.h"
+#include "lib/exceptions.h"
+#include "lib/gc.h"
+#include "lib/log.h"
+#include "lib/parallel.h"
+#include "lib/source_file.h"
+
+bool splitArguments(const std::string &line, std::vector<std::string> &args) {
+    args.clear();
+    std::string arg;
+    bool inArg = false;
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quote == '\'') {
+            if (c == '\'')
+                quote = 0;
+            else
+                arg += c;
+        } else if (quote == '"') {
+            if (c == '"') {
+                quote = 0;
+            } else if (c == '\\' && i + 1 < line.size() && strchr("\"\\$`", line[i + 1])) {
+                arg += line[++i];
+            } else {
+                arg += c; }
+        } else if (isspace(static_cast<unsigned char>(c))) {
+            if (inArg) args.push_back(arg);
+            arg.clear();
+            inArg = false;
+        } else {
+            inArg = true;
+            if (c == '\'' || c == '"')
+                quote = c;
+            else if (c == '\\' && i + 1 < line.size())
+                arg += line[++i];
+            else
+                arg += c; } }
+    if (inArg) args.push_back(arg);
+    return quote == 0;
+}
+
+void resetCompilation() {
+    ErrorReporter::instance.reset();
+    Util::InputSources::reset();
+    PassManager::setBoundedMemory(false);
+    Log::resetLogLevels();
+}
+
+namespace {
+
+// A request, and its reply once it is compiled
+struct Request {
+    std::string         line;
+    std::stringstream   messages;  // from the ErrorReporter
+    int                 status = 1;
+    double              seconds = 0;
+    size_t              bytes = 0;
+    bool                done = false;  // compiled, when compiling on several threads
+
+    explicit Request(std::string line) : line(line) {}
+
+    // Compiles it on this thread; 'shared' when other threads compile at the same time
+    void process(const char *compiler, CompileFunction compile, bool shared) {
+        auto start = std::chrono::steady_clock::now();
+        size_t allocated = gc_thread_bytes_allocated();
+        if (shared) {
+            // but not the log levels, which the other threads use too
+            ErrorReporter::instance.reset();
+            Util::InputSources::reset();
+            PassManager::setBoundedMemory(false);
+        } else {
+            resetCompilation(); }
+        ErrorReporter::instance.setOutputStream(&messages);
+        status = run(compiler, compile);
+        ErrorReporter::instance.setOutputStream(&std::cerr);
+        bytes = gc_thread_bytes_allocated() - allocated;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+
+    int run(const char *compiler, CompileFunction compile) {
+        std::vector<std::string> args;
+        if (!splitArguments(line, args)) {
+            messages << "Unbalanced quotes in batch request: " << line << std::endl;
+            return 1; }
+        std::vector<char *> argv;
+        argv.push_back(const_cast<char *>(compiler));
+        for (auto &arg : args)
+            argv.push_back(&arg[0]);
+        argv.push_back(nullptr);
+        try {
+            return compile(argv.size() - 1, argv.data());
+        } catch (const Util::P4CExceptionBase &ex) {
+            messages << ex.what() << std::endl;
+        } catch (const std::exception &ex) {
+            messages << "Internal error: " << ex.what() << std::endl; }
+        return 1; }
+
+    void reply(FILE *out) const {
+        std::cout.flush();
+        std::cerr << messages.str();
+        std::cerr.flush();
+        fprintf(out, "done %d %.3fs %zukB\n", status, seconds, (bytes + 1023) / 1024);
+        fflush(out); }
+};
+
+// The next request, skipping blank lines; false at the end of the input
+bool readRequest(FILE *in, std::string &line) {
+    char *buffer = nullptr;
+    size_t size = 0;
+    ssize_t len;
+    bool found = false;
+    while (!found && (len = getline(&buffer, &size, in)) >= 0) {
+        line.assign(buffer, len);
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+            line.pop_back();
+        found = line.find_first_not_of(" \t") != std::string::npos; }
+    free(buffer);
+    return found;
+}
+
+#ifdef MULTITHREAD
+// Compiles the requests on 'jobs' threads of the pool, and replies to them in order
+void serveParallel(FILE *in, FILE *out, const char *compiler, CompileFunction compile,
+                   unsigned jobs) {
+    std::mutex lock;
+    std::deque<Request *> replies;  // to be replied to, in order
+
+    Util::TaskGroup group(jobs, true);
+    std::string line;
+    while (readRequest(in, line)) {
+        auto request = new Request(line);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            replies.push_back(request);
+        }
+        group.spawn([&, request]() {
+            request->process(compiler, compile, true);
+            std::lock_guard<std::mutex> guard(lock);
+            request->done = true;
+            while (!replies.empty() && replies.front()->done) {
+                replies.front()->reply(out);
+                delete replies.front();
+                replies.pop_front(); } }); }
+    group.wait();
+}
+#endif  // MULTITHREAD
+
+}  // namespace
+
+void serveBatch(FILE *in, FILE *out, const char *compiler, CompileFunction compile,
+                unsigned jobs) {
+#ifdef MULTITHREAD
+    if (jobs > 1) {
+        serveParallel(in, out, compiler, compile, jobs);
+        return; }
+#else
+    if (jobs > 1)
+        std::cerr << "Compiling one program at a time: not built with MULTITHREAD" << std::endl;
+#endif  // MULTITHREAD
+    std::string line;
+    while (readRequest(in, line)) {
+        Request request(line);
+        request.process(compiler, compile, false);
+        request.reply(out); }
+}
+
+// Serves the clients of a Unix socket one after the other
+static int serveSocket(const char *path, const char *compiler, CompileFunction compile,
+                       unsigned jobs) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        ::error("%1%: socket path too long", path);
+        return 1; }
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (server < 0 ||
+        bind(server, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0 ||
+        listen(server, 16) < 0) {
+        ::error("%1%: cannot listen on the socket: %2%", path, strerror(errno));
+        return 1; }
+
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            ::error("%1%: accept failed: %2%", path, strerror(errno));
+            break; }
+        FILE *in = fdopen(client, "r");
+        FILE *out = fdopen(dup(client), "w");
+        if (in && out)
+            serveBatch(in, out, compiler, compile, jobs);
+        if (in) fclose(in);
+        else
+            close(client);
+        if (out) fclose(out); }
+    close(server);
+    unlink(path);
+    return 1;
+}
+
+int runBatch(int argc, char *const argv[], CompileFunction compile) {
+    if (argc < 2 || argc > 4 || strncmp(argv[1], "--batch", 7) != 0)
+        return -1;
+    const char *path = argv[1] + 7;
+    if (*path == '=' && path[1] != 0)
+        ++path;
+    else if (*path != 0)
+        return -1;
+
+    unsigned jobs = 1;
+    if (argc > 2) {
+        const char *count = argv[2];
+        if (strncmp(count, "-j", 2) != 0 || (count[2] != 0) == (argc == 4))
+            return -1;
+        count = argc == 4 ? argv[3] : count + 2;
+        char *end;
+        jobs = strtoul(count, &end, 10);
+        if (*end != 0 || end == count)
+            return -1;
+        if (jobs == 0)
+            jobs = std::thread::hardware_concurrency(); }
+
+    if (*path == 0) {
+        serveBatch(stdin, stdout, argv[0], compile, jobs);
+        return 0; }
+    return serveSocket(path, argv[0], compile, jobs);
+}
@@ -0,0 +1,69 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _FRONTENDS_COMMON_BATCH_H_
+#define _FRONTENDS_COMMON_BATCH_H_
+
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Batch mode, in which a compiler driver compiles many programs in one process, so
+// that each compilation after the first finds the interned strings, the source files
+// read by the preprocessor and the other caches of the process warm, and does not
+// pay for starting the process again.
+//
+// Each request is a line with the arguments that the compiler would be run with, quoted
+// as in a shell ('...', "..." and \), which are compiled as though the compiler had been
+// run with them.  When it is done, its error messages are written to stderr, and
+// "done N Ts KkB" on a line of its own, N being the exit status the compiler would have
+// had, T the seconds the compilation took and K the memory it allocated.  Other output
+// goes where it would otherwise go (stdout, or the files named by the arguments).
+//
+// With -jN, N requests are compiled at a time, each on a thread of its own, when built
+// with MULTITHREAD; the replies still come in the order of the requests.  P4-16 programs
+// are parsed at the same time, but P4-14 ones one at a time, as that parser keeps its
+// state in globals; the debug options (-v, -T) apply to all the programs being
+// compiled at the time.
+//
+// What is global to a compilation (the error counts, the program text and its line
+// mapping, the debug levels, the parser state, --boundedMemory) is reset before each
+// request.
+// Node ids are not reset, as IR kept from an earlier compilation may still be in use.
+
+// Compiles the program given by these arguments; argv[0] is the name of the compiler
+typedef std::function<int(int argc, char *const argv[])> CompileFunction;
+
+// The arguments of a request, or false if it has unbalanced quotes
+bool splitArguments(const std::string &line, std::vector<std::string> &args);
+
+// Clears the state of the process left by a compilation
+void resetCompilation();
+
+// Compiles the requests read from 'in', 'jobs' at a time, until it ends, writing
+// the replies to 'out'
+void serveBatch(FILE *in, FILE *out, const char *compiler, CompileFunction compile,
+                unsigned jobs = 1);
+
+// Runs the compiler in batch mode if the command line asks for it: "--batch" to read
+// the requests from stdin and reply on stdout, or "--batch=PATH" to listen for clients
+// on a Unix socket at PATH, each connection being served as stdin would be, until the
+// process is killed; either may be followed by -jN.  The result is the exit status of
+// the process, or -1 if the command line is for compiling a single program.
+int runBatch(int argc, char *const argv[], CompileFunction compile);
+
+#endif /* _FRONTENDS_COMMON_BATCH_H_ */
@@ -162,27 +162,27 @@ DoConstantFolding::cast(const IR::Constant* node, unsigned base, const IR::Type_
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Add* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a + b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a + b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Sub* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a - b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a - b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Mul* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a * b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a * b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::BXor* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a ^ b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a ^ b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::BAnd* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a & b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a & b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::BOr* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a | b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a | b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Equ* e) {
@@ -194,23 +194,23 @@ const IR::Node* DoConstantFolding::postorder(IR::Neq* e) {
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Lss* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a < b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a < b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Grt* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a > b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a > b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Leq* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a <= b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a <= b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Geq* e) {
-    return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a >= b; });
+    return binary(e, [](const mpz_class& a, const mpz_class& b) -> mpz_class { return a >= b; });
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Div* e) {
-    return binary(e, [e](mpz_class a, mpz_class b) -> mpz_class {
+    return binary(e, [e](const mpz_class& a, const mpz_class& b) -> mpz_class {
             if (sgn(a) < 0 || sgn(b) < 0) {
                 ::error("%1%: Division is not defined for negative numbers", e);
                 return 0;
@@ -224,7 +224,7 @@ const IR::Node* DoConstantFolding::postorder(IR::Div* e) {
 }
 
 const IR::Node* DoConstantFolding::postorder(IR::Mod* e) {
-    return binary(e, [e](mpz_class a, mpz_class b) -> mpz_class {
+    return binary(e, [e](const mpz_class& a, const mpz_class& b) -> mpz_class {
             if (sgn(a) < 0 || sgn(b) < 0) {
                 ::error("%1%: Modulo is not defined for negative numbers", e);
                 return 0;
@@ -276,15 +276,13 @@ DoConstantFolding::compare(const IR::Operation_Binary* e) {
         }
     }
 
-    if (eqTest)
-        return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a == b; });
-    else
-        return binary(e, [](mpz_class a, mpz_class b) -> mpz_class { return a != b; });
+    return binary(e, [eqTest](const mpz_class& a, const mpz_class& b) -> mpz_class {
+        return (a == b) == eqTest; });
 }
 
 const IR::Node*
 DoConstantFolding::binary(const IR::Operation_Binary* e,
-                          std::function<mpz_class(mpz_class, mpz_class)> func) {
+                          std::function<mpz_class(const mpz_class&, const mpz_class&)> func) {
     auto eleft = getConstant(e->left);
     auto eright = getConstant(e->right);
     if (eleft == nullptr || eright == nullptr)
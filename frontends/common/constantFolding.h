@@ -42,7 +42,7 @@ class DoConstantFolding : public Transform {
     const IR::Constant* cast(
         const IR::Constant* node, unsigned base, const IR::Type_Bits* type) const;
     const IR::Node* binary(const IR::Operation_Binary* op,
-                           std::function<mpz_class(mpz_class, mpz_class)> func);
+                           std::function<mpz_class(const mpz_class&, const mpz_class&)> func);
     // for == and != only
     const IR::Node* compare(const IR::Operation_Binary* op);
     const IR::Node* shift(const IR::Operation_Binary* op);
@@ -60,6 +60,11 @@ class DoConstantFolding : public Transform {
             refMap(refMap), typeMap(typeMap), typesKnown(typeMap != nullptr), warnings(warnings) {
         visitDagOnce = true; setName("DoConstantFolding");
     }
+    // Folds the operands first, so nothing is left to fold in its result
+    cstring fixpointKey() const override {
+        return cstring(name()) + (refMap ? "" : " unresolved") +
+                (typesKnown ? "" : " untyped") + (warnings ? "" : " quiet"); }
+    bool idempotent() const override { return true; }
 
     const IR::Node* postorder(IR::Declaration_Constant* d) override;
     const IR::Node* postorder(IR::PathExpression* e) override;
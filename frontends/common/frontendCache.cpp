@@ -0,0 +1,254 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "frontendCache.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include "ir/binary_generator.h"
+#include "ir/binary_loader.h"
+#include "lib/log.h"
+#include "lib/error.h"
+#include "lib/path.h"
+#include "lib/stringify.h"
+#include "setup.h"
+
+namespace CacheEntry {
+
+void addCompiler(Hash &key) {
+    key.add(cstring(CompilerOptions::version)).add(IR::binary_schema_hash);
+    // a rebuilt compiler may run the passes differently even with the same version
+    struct stat exe;
+    if (stat("/proc/self/exe", &exe) == 0)
+        key.add(exe.st_size).add(exe.st_mtime);
+}
+
+cstring entryPath(cstring dir, uint64_t key, const char *suffix) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.%s", static_cast<unsigned long long>(key), suffix);
+    return Util::PathName(dir).join(name).toString();
+}
+
+// An entry is the snapshot followed by a hash of it, which is checked before loading,
+// so that a damaged entry gives a miss rather than errors.  Returns the snapshot.
+bool readEntry(cstring path, std::string &data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    uint64_t sum;
+    if (data.size() < sizeof(sum))
+        return false;
+    size_t size = data.size() - sizeof(sum);
+    memcpy(&sum, data.data() + size, sizeof(sum));
+    if (sum != Hash().add(data.data(), size).value()) {
+        LOG1("Ignoring damaged cache entry " << path);
+        return false; }
+    data.resize(size);
+    return true;
+}
+
+void writeEntry(cstring path, std::string data) {
+    uint64_t sum = Hash().add(data.data(), data.size()).value();
+    data.append(reinterpret_cast<const char *>(&sum), sizeof(sum));
+
+    // written under a temporary name and renamed, so that compilations running at the
+    // same time, in this process or others, never see a partial entry
+    static std::atomic<unsigned> written(0);
+    mkdir(Util::PathName(path).getFolder().toString(), 0777);
+    cstring tmp = path + "." + Util::toString(getpid()) + "." + Util::toString(written++);
+    std::ofstream out(tmp, std::ios::binary);
+    out.write(data.data(), data.size());
+    out.close();
+    if (!out || rename(tmp, path) != 0) {
+        ::warning("Could not write cache entry %1%", path);
+        unlink(tmp); }
+}
+
+}  // namespace CacheEntry
+
+namespace {
+
+// A line marker of the preprocessor, as recognized by the lexer: # line "file" flags
+struct LineMarker {
+    unsigned    line = 0;
+    cstring     file;
+    bool        enter = false, leave = false;  // flags 1 and 2
+
+    // Reads the marker on the line [p, eol), if it is one
+    bool read(const char *p, const char *eol) {
+        if (eol - p >= 5 && !strncmp(p, "#line", 5))
+            p += 5;
+        else if (eol - p >= 2 && !strncmp(p, "# ", 2))
+            p += 2;
+        else
+            return false;
+        while (p < eol && (*p == ' ' || *p == '\t')) ++p;
+        if (p == eol || !isdigit(*p)) return false;
+        for (; p < eol && isdigit(*p); ++p)
+            line = line * 10 + (*p - '0');
+        while (p < eol && (*p == ' ' || *p == '\t')) ++p;
+        if (p == eol || *p != '"') return false;
+        const char *name = ++p;
+        while (p < eol && *p != '"') ++p;
+        file = cstring(std::string(name, p - name));
+        for (p += p < eol; p < eol; ++p) {
+            unsigned flag = 0;
+            for (; p < eol && isdigit(*p); ++p)
+                flag = flag * 10 + (*p - '0');
+            enter |= flag == 1;
+            leave |= flag == 2; }
+        return true; }
+};
+
+}  // namespace
+
+FrontendCache::FrontendCache(const CompilerOptions &options, const std::string &preprocessed) {
+    CacheEntry::Hash key;
+    key.add(preprocessed.data(), preprocessed.size())
+       .add(options.file)
+       .add(options.isv1());
+    CacheEntry::addCompiler(key);
+    path = CacheEntry::entryPath(options.frontendCacheDir, key.value(), "p4ir");
+}
+
+const IR::P4Program *FrontendCache::load() const {
+    std::string data;
+    if (!CacheEntry::readEntry(path, data))
+        return nullptr;
+
+    BinaryLoader bin(data.data(), data.data() + data.size());
+    const IR::P4Program *program = nullptr;
+    std::string text;
+    Util::InputSources::LineMap lineMap;
+    bin >> program >> text;
+    for (size_t n = bin.varint(); n > 0 && bin; --n) {
+        unsigned line, sourceLine;
+        cstring file;
+        bin >> line >> file >> sourceLine;
+        if (!lineMap.empty() && line <= lineMap.back().first)
+            return nullptr;
+        lineMap.emplace_back(line, Util::SourceFileLine(file, sourceLine)); }
+    if (!bin || !program || lineMap.empty() || lineMap.front().first != 0)
+        return nullptr;
+    Util::InputSources::instance->restore(text, lineMap);
+    LOG1("Loaded the front end result from " << path);
+    return program;
+}
+
+void FrontendCache::store(const IR::P4Program *program) const {
+    std::stringstream snapshot;
+    {
+        BinaryGenerator bin(snapshot);
+        auto sources = Util::InputSources::instance;
+        bin << program << sources->getText();
+        bin.varint(sources->getLineMap().size());
+        for (auto &l : sources->getLineMap())
+            bin << l.first << l.second.fileName << l.second.sourceLine;
+    }
+    CacheEntry::writeEntry(path, snapshot.str());
+}
+
+IncludeCache::IncludeCache(const CompilerOptions &options) : dir(options.frontendCacheDir) {
+    CacheEntry::Hash start;
+    CacheEntry::addCompiler(start);
+    key = start.value();
+}
+
+std::vector<std::pair<size_t, size_t>> IncludeCache::leadingIncludes(const std::string &text) {
+    std::vector<std::pair<size_t, size_t>> result;
+    unsigned depth = 0;  // of the include files entered
+    size_t start = 0;
+    for (size_t at = 0, eol; at < text.size(); at = eol + 1) {
+        eol = text.find('\n', at);
+        if (eol == std::string::npos)
+            eol = text.size();
+        LineMarker marker;
+        bool isMarker = marker.read(text.data() + at, text.data() + eol);
+        if (depth > 0) {
+            if (isMarker && marker.enter)
+                ++depth;
+            else if (isMarker && marker.leave && --depth == 0)
+                result.emplace_back(start, at);
+        } else if (isMarker && marker.enter && marker.file.startsWith(p4includePath)) {
+            depth = 1;
+            start = at;
+        } else {
+            size_t first = text.find_first_not_of(" \t\r", at);
+            if (first < eol && text[first] != '#')
+                break;
+        }
+    }
+    return result;
+}
+
+void IncludeCache::appendSource(const char *begin, const char *end) {
+    auto sources = Util::InputSources::instance;
+    for (const char *eol; begin < end; begin = eol + 1) {
+        eol = std::find(begin, end, '\n');
+        LineMarker marker;
+        if (marker.read(begin, eol))
+            sources->mapLine(marker.file, marker.line);
+        if (eol > begin)
+            sources->appendText(std::string(begin, eol).c_str());
+        if (eol < end)
+            sources->appendText("\n");
+        else
+            break;
+    }
+}
+
+void IncludeCache::next(const char *begin, const char *end) {
+    key = CacheEntry::Hash(key).add(begin, end - begin).value();
+}
+
+bool IncludeCache::load(uint64_t partKey, unsigned firstLine, Fragment &fragment) const {
+    std::string data;
+    if (!CacheEntry::readEntry(CacheEntry::entryPath(dir, partKey, "p4inc"), data))
+        return false;
+
+    BinaryLoader bin(data.data(), data.data() + data.size());
+    unsigned savedLine = 0;
+    bin >> savedLine;
+    bin.shiftLines(static_cast<int>(firstLine) - static_cast<int>(savedLine));
+    fragment.firstLine = firstLine;
+    bin >> fragment.declarations;
+    fragment.symbols.clear();
+    for (size_t n = bin.varint(); n > 0 && bin; --n) {
+        Util::ProgramStructure::TopLevelSymbol symbol;
+        bin >> symbol.name >> symbol.srcInfo >> symbol.kind;
+        fragment.symbols.push_back(symbol); }
+    return bin && fragment.declarations != nullptr;
+}
+
+void IncludeCache::store(uint64_t partKey, const Fragment &fragment) const {
+    std::stringstream snapshot;
+    {
+        BinaryGenerator bin(snapshot);
+        bin << fragment.firstLine << fragment.declarations;
+        bin.varint(fragment.symbols.size());
+        for (auto &symbol : fragment.symbols)
+            bin << symbol.name << symbol.srcInfo << symbol.kind;
+    }
+    CacheEntry::writeEntry(CacheEntry::entryPath(dir, partKey, "p4inc"), snapshot.str());
+}
@@ -0,0 +1,117 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _FRONTENDS_COMMON_FRONTENDCACHE_H_
+#define _FRONTENDS_COMMON_FRONTENDCACHE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "ir/ir.h"
+#include "frontends/p4/symbol_table.h"
+#include "options.h"
+
+// The files of the caches of the compiler (see --frontendCache), which a back end can
+// use as well.
+namespace CacheEntry {
+
+// FNV-1a
+class Hash {
+    uint64_t h = 14695981039346656037ULL;
+
+ public:
+    Hash() {}
+    explicit Hash(uint64_t from) : h(from) {}
+    Hash &add(const void *data, size_t len) {
+        auto p = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < len; ++i)
+            h = (h ^ p[i]) * 1099511628211ULL;
+        return *this; }
+    template<typename T> Hash &add(const T &v) { return add(&v, sizeof(v)); }
+    Hash &add(cstring s) { return s ? add(s.c_str(), s.size() + 1) : add<char>(0); }
+    uint64_t value() const { return h; }
+};
+
+// Adds the version, IR definitions and executable of this compiler
+void addCompiler(Hash &key);
+// The file in 'dir' of the entry with this key
+cstring entryPath(cstring dir, uint64_t key, const char *suffix);
+// Reads an entry written by writeEntry; false if it is missing or damaged
+bool readEntry(cstring path, std::string &data);
+// Writes an entry atomically, with a checksum
+void writeEntry(cstring path, std::string data);
+
+}  // namespace CacheEntry
+
+// A directory of binary snapshots of the IR produced by the front end, together with
+// the source text its positions refer to (see --frontendCache).  Each entry is named
+// by a hash of the preprocessed program, the language version, and the compiler that
+// wrote it: its version, IR definitions and executable.  So an entry is only ever read
+// back for the same input to the same compiler, and stale entries are never read.
+// A damaged entry is treated as missing.
+class FrontendCache {
+    cstring path;  // of the entry for this program
+
+ public:
+    FrontendCache(const CompilerOptions &options, const std::string &preprocessed);
+    // The program saved for this input, or nullptr
+    const IR::P4Program *load() const;
+    void store(const IR::P4Program *program) const;
+};
+
+// Entries in the same folder for the system include files that a P4-16 program starts
+// with (core.p4, then the architecture), as they were parsed by an earlier compilation,
+// so that programs for the same architecture only have their own code parsed.
+// An include file is parsed in the scope of those before it, so each entry is named by
+// a hash of the compiler and of the text of all the include files up to its own.
+class IncludeCache {
+    cstring dir;
+    uint64_t key;  // of the include file at hand
+
+ public:
+    // What an include file adds to the program when it is parsed
+    struct Fragment {
+        unsigned firstLine = 0;  // of its text in the InputSources
+        const IR::IndexedVector<IR::Node> *declarations = nullptr;
+        std::vector<Util::ProgramStructure::TopLevelSymbol> symbols;
+    };
+
+    explicit IncludeCache(const CompilerOptions &options);
+    // The ranges of the preprocessed 'text' which are system include files, up to the
+    // first line outside of them that is neither blank nor a preprocessor line
+    static std::vector<std::pair<size_t, size_t>> leadingIncludes(const std::string &text);
+    // Adds preprocessed text that has no tokens to the InputSources, with its line
+    // markers, as the lexer would have
+    static void appendSource(const char *begin, const char *end);
+
+    // Moves on to the next include file, whose text is [begin, end)
+    void next(const char *begin, const char *end);
+    // Reads the fragment saved for the include file at hand, with its source
+    // positions moved to start at 'firstLine'
+    bool load(unsigned firstLine, Fragment &fragment) const
+    { return load(key, firstLine, fragment); }
+    void store(const Fragment &fragment) const { store(key, fragment); }
+
+    // The declarations of the program after its include files are kept in the same way,
+    // in parts of whole top-level declarations, each named by a hash of the key of the
+    // last include file, of the types declared before the part, and of its text: a
+    // program that was edited then only has the parts that changed parsed again.
+    uint64_t lastIncludeKey() const { return key; }
+    bool load(uint64_t partKey, unsigned firstLine, Fragment &fragment) const;
+    void store(uint64_t partKey, const Fragment &fragment) const;
+};
+
+#endif /* _FRONTENDS_COMMON_FRONTENDCACHE_H_ */
@@ -15,17 +15,25 @@ limitations under the License.
 */
 
 #include <getopt.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unordered_set>
 
 #include "setup.h"
 #include "options.h"
+#include "lib/crash.h"
 #include "lib/log.h"
 #include "lib/exceptions.h"
+#include "lib/gc.h"
 #include "lib/nullstream.h"
 #include "lib/path.h"
+#include "lib/preprocessor.h"
 #include "frontends/p4/toP4/toP4.h"
 #include "ir/json_generator.h"
+#include "ir/memory_census.h"
+#include "ir/pass_manager.h"
 
-static cstring version = "0.0.5";
+const char* CompilerOptions::version = "0.0.5";
 const char* CompilerOptions::defaultMessage = "Compile a P4 program";
 
 CompilerOptions::CompilerOptions() : Util::Options(defaultMessage) {
@@ -52,6 +60,9 @@ CompilerOptions::CompilerOptions() : Util::Options(defaultMessage) {
                    [this](const char* arg) {
                        preprocessor_options += std::string(" -U") + arg; return true; },
                    "Undefine macro (passed to preprocessor)");
+    registerOption("--externalCpp", nullptr,
+                   [this](const char*) { externalPreprocessor = true; return true; },
+                   "Run the C preprocessor (cpp) rather than the built-in one");
     registerOption("-E", nullptr,
                    [this](const char*) { doNotCompile = true; return true; },
                    "Preprocess only, do not compile (prints program on stdout)");
@@ -85,16 +96,156 @@ CompilerOptions::CompilerOptions() : Util::Options(defaultMessage) {
                    "Pretty-print the program in the specified file.");
     registerOption("--toJSON", "file",
                    [this](const char* arg) { dumpJsonFile = arg; return true; },
-                   "Dump IR to JSON in the specified file.");
+                   "Dump IR to JSON in the specified file; a name ending in .gz\n"
+                   "gives a file compressed with gzip.");
+    registerOption("--compactJSON", nullptr,
+                   [this](const char*) { compactJson = true; return true; },
+                   "Write the JSON of --toJSON without newlines and indentation.");
+    registerOption("--toBinary", "file",
+                   [this](const char* arg) { dumpBinaryFile = arg; return true; },
+                   "Write a binary snapshot of the IR after the front end\n"
+                   "to the specified file.");
+    registerOption("--indexedBinary", nullptr,
+                   [this](const char*) { indexedBinary = true; return true; },
+                   "Write the snapshot of --toBinary with an index of the top-level\n"
+                   "declarations, so that tools can read just the ones they look at.");
+    registerOption("--frontendCache", "dir",
+                   [this](const char* arg) { frontendCacheDir = arg; return true; },
+                   "Keep the result of the front end for each program in this folder,\n"
+                   "and reuse it when the same program is compiled again; also keep the\n"
+                   "parsed system include files, for all programs that start with them,\n"
+                   "and the parsed declarations of a large program, so that after an\n"
+                   "edit only those around the change are parsed again.");
+    // handled by runBatch before the options are processed
+    registerOption("--batch", nullptr,
+                   [](const char*) {
+                       ::error("--batch must be the first argument, followed only by -jN");
+                       return false; },
+                   "Compile many programs in this process: read the arguments for each\n"
+                   "from a line of stdin, and write 'done', the exit status, the time\n"
+                   "and the memory after it.  --batch=socket accepts the lines from\n"
+                   "clients of this Unix socket.  Add -jN to compile N at a time.");
     registerOption("--testJson", nullptr,
                     [this](const char*) { debugJson = true; return true; },
                     "Dump and undump the IR");
+    registerOption("--passStats", "file",
+                   [this](const char* arg) {
+                       passStatsFile = arg;
+                       Visitor::profile_t::collect = true;
+                       return true; },
+                   "[Compiler debugging] Write the time and memory used by each pass\n"
+                   "to the specified file (CSV if it ends in .csv, otherwise JSON)");
+    registerOption("--passTiming", "file",
+                   [this](const char* arg) {
+                       passTimingFile = arg;
+                       Visitor::profile_t::collect = true;
+                       return true; },
+                   "[Compiler debugging] Write a trace of the nested pass timings to the\n"
+                   "specified file, in Chrome trace event (JSON) format");
+    registerOption("--sampleProfile", "file",
+                   [this](const char* arg) {
+                       sampleProfileFile = arg;
+                       start_sampling();
+                       return true; },
+                   "[Compiler debugging] Sample where the compiler spends its CPU time,\n"
+                   "and write the samples of each pass and function to the specified\n"
+                   "file as collapsed stacks, the input of flame graph tools");
+    registerOption("--heapSamples", "file",
+                   [](const char* arg) {
+                       if (!gc_start_heap_sampler(arg, 10))
+                           ::warning("--heapSamples needs a multithreaded build with the "
+                                     "garbage collector, and a file it can write");
+                       return true; },
+                   "[Compiler debugging] Write the size of the heap, the heap in use and\n"
+                   "the bytes allocated every 10 msec to the specified file, from a\n"
+                   "thread that does not stop the compiler to collect");
+    registerOption("--irMemory", "file",
+                   [this](const char* arg) { irMemoryFile = arg; return true; },
+                   "[Compiler debugging] Write the number of IR nodes and the bytes they\n"
+                   "take, by class, after each pass to the specified file");
+    registerOption("--maxParserStates", "count",
+                   [this](const char* arg) {
+                       char* end;
+                       maxParserStates = strtoul(arg, &end, 10);
+                       if (*end != '\0' || maxParserStates == 0) {
+                           ::error("%1%: expected a positive number of states", arg);
+                           return false; }
+                       return true; },
+                   "Maximum number of states produced when unrolling a parser\n"
+                   "(default 1000)");
+    registerOption("--parseThreads", "N",
+                   [this](const char* arg) {
+                       char* end;
+                       parseThreads = strtoul(arg, &end, 10);
+                       if (*end != '\0') {
+                           ::error("%1%: expected a number of threads", arg);
+                           return false; }
+                       return true; },
+                   "Parse a large P4-16 program in parts on N threads, 0 for one per\n"
+                   "hardware thread (default 1)");
+    registerOption("--typeCheckThreads", "N",
+                   [this](const char* arg) {
+                       char* end;
+                       typeCheckThreads = strtoul(arg, &end, 10);
+                       if (*end != '\0') {
+                           ::error("%1%: expected a number of threads", arg);
+                           return false; }
+                       return true; },
+                   "Type check the controls, parsers, actions and functions of a P4-16\n"
+                   "program on N threads, 0 for one per hardware thread (default 1)");
+    registerOption("--inlineBudget", "nodes",
+                   [this](const char* arg) {
+                       char* end;
+                       long nodes = strtol(arg, &end, 10);
+                       if (*end != '\0' || nodes < 0 || nodes > INT_MAX) {
+                           ::error("%1%: expected a number of IR nodes", arg);
+                           return false; }
+                       inlineBudget = nodes;
+                       return true; },
+                   "On a target that can invoke controls and parsers as such, inline\n"
+                   "their instances, cheapest first, only while they add at most this\n"
+                   "many IR nodes (default: inline all of them)");
+    registerOption("--boundedMemory", nullptr,
+                   [](const char*) { PassManager::setBoundedMemory(true); return true; },
+                   "Use less memory on very large programs, at some cost in time: run\n"
+                   "the passes that only look at one control or parser at a time on\n"
+                   "each in turn, collecting in between, and keep no earlier versions\n"
+                   "of the program to skip passes that would not change it");
+    registerOption("--maxWarnings", "count",
+                   [](const char* arg) {
+                       char* end;
+                       unsigned long limit = strtoul(arg, &end, 10);
+                       if (*end != '\0' || limit == 0) {
+                           ::error("%1%: expected a positive number of warnings", arg);
+                           return false; }
+                       ErrorReporter::instance.setWarningLimit(limit);
+                       return true; },
+                   "Show at most this many warnings of each kind (default: all)");
+    registerOption("--uniqueWarnings", nullptr,
+                   [](const char*) { ErrorReporter::instance.setDeduplicate(true); return true; },
+                   "Show a warning reported several times only once");
     registerOption("-o", "outfile",
                    [this](const char* arg) { outputFile = arg; return true; },
                    "Write output to outfile");
+    registerOption("-O", "level",
+                   [this](const char* arg) {
+                       char* end;
+                       optimizationLevel = strtoul(arg, &end, 10);
+                       if (*arg == '\0' || *end != '\0' || optimizationLevel > 2) {
+                           ::error("%1%: expected an optimization level of 0, 1 or 2", arg);
+                           return false; }
+                       return true; },
+                   "Optimization level: 0 runs only the passes needed to compile, for\n"
+                   "the fastest compiles, 1 adds the cheap optimizations, and 2 (the\n"
+                   "default) the expensive ones too; the warnings are the same at\n"
+                   "each level");
     registerOption("-T", "loglevel",
                    [](const char* arg) { Log::addDebugSpec(arg); return true; },
                    "[Compiler debugging] Adjust logging level per file (see below)");
+    registerOption("--logTiming", nullptr,
+                   [](const char*) { Log::enableTiming(); return true; },
+                   "[Compiler debugging] Log the time taken by each pass, without the\n"
+                   "other log messages");
     registerOption("-v", nullptr,
                    [this](const char*) { Log::increaseVerbosity(); return true; },
                    "[Compiler debugging] Increase verbosity level (can be repeated)");
@@ -108,6 +259,11 @@ CompilerOptions::CompilerOptions() : Util::Options(defaultMessage) {
                    "[Compiler debugging] Dump the P4 representation after\n"
                    "passes whose name contains one of `passX' substrings.\n"
                    "When '-v' is used this will include the compiler IR.\n");
+    registerOption("--top4Changes", nullptr,
+                   [this](const char*) { top4Changes = true; return true; },
+                   "[Compiler debugging] After the first dump of --top4, write only\n"
+                   "the top-level declarations that changed since the previous one,\n"
+                   "and the names of the others.\n");
     registerOption("--dump", "folder",
                    [this](const char* arg) { dumpFolder = arg; return true; },
                    "[Compiler debugging] Folder where P4 programs are dumped\n");
@@ -136,7 +292,7 @@ FILE* CompilerOptions::preprocess() {
     if (file == "-") {
         file = "<stdin>";
         in = stdin;
-    } else {
+    } else if (externalPreprocessor) {
 #ifdef __clang__
         /* FIXME -- while clang has a 'cpp' executable, its broken and doesn't work right, so
          * we need to run clang -E instead.  This should be managed by autoconf (figure out how
@@ -156,6 +312,21 @@ FILE* CompilerOptions::preprocess() {
             return nullptr;
         }
         close_input = true;
+    } else {
+        unsigned errors = ::errorCount();
+        Util::Preprocessor cpp;
+        cpp.addIncludePath(p4includePath);
+        cpp.addOptions(preprocessor_options);
+        preprocessed = cpp.run(file);
+        if (::errorCount() > errors)
+            return nullptr;
+        // never empty, as it starts with a line marker
+        in = fmemopen(&preprocessed[0], preprocessed.size(), "r");
+        if (in == nullptr) {
+            ::error("Could not read the preprocessed program");
+            return nullptr;
+        }
+        close_memory = true;
     }
 
     if (doNotCompile) {
@@ -178,6 +349,8 @@ void CompilerOptions::closeInput(FILE* inputStream) const {
             ::error("input file %s does not exist", file);
         else if (exitCode != 0)
             ::error("Preprocessor returned exit code %d; aborting compilation", exitCode);
+    } else if (close_memory) {
+        fclose(inputStream);
     }
 }
 
@@ -206,6 +379,16 @@ void CompilerOptions::dumpPass(const char* manager, unsigned seq, const char* pa
     if (Log::verbose())
         std::cerr << name << std::endl;
 
+    if (!irMemoryFile.isNullOrEmpty()) {
+        if (irMemoryStream == nullptr)
+            irMemoryStream = openFile(irMemoryFile, false);
+        if (irMemoryStream != nullptr) {
+            MemoryCensus census;
+            node->apply(census);
+            *irMemoryStream << name << ": ";
+            census.report(*irMemoryStream);
+            irMemoryStream->flush(); } }
+
     for (auto s : top4) {
         if (strstr(name.c_str(), s.c_str()) != nullptr) {
             cstring suffix = cstring("-") + name;
@@ -218,16 +401,63 @@ void CompilerOptions::dumpPass(const char* manager, unsigned seq, const char* pa
             if (stream != nullptr) {
                 if (Log::verbose())
                     std::cerr << "Writing program to " << fileName << std::endl;
-                P4::ToP4 toP4(stream, Log::verbose(), file);
-                node->apply(toP4);
+                auto program = node->to<IR::P4Program>();
+                if (top4Changes && program != nullptr && lastDumped != nullptr) {
+                    dumpChanges(stream, program);
+                } else {
+                    P4::ToP4 toP4(stream, Log::verbose(), file);
+                    node->apply(toP4);
+                }
+                if (top4Changes && program != nullptr) {
+                    lastDumped = program;
+                    lastDumpFile = fileName;
+                }
             }
         }
     }
 }
 
+void CompilerOptions::dumpChanges(std::ostream* stream, const IR::P4Program* program) const {
+    // a pass that changes a declaration makes a new node for it
+    std::unordered_set<const IR::Node*> previous(lastDumped->declarations->begin(),
+                                                 lastDumped->declarations->end());
+    Util::SourceCodeBuilder builder(stream);
+    builder.appendLine(cstring("// Changes since ") + lastDumpFile);
+    for (auto decl : *program->declarations) {
+        builder.newline();
+        if (previous.count(decl)) {
+            auto named = decl->to<IR::IDeclaration>();
+            builder.append("// unchanged: ");
+            builder.appendLine(named ? named->getName().name : decl->node_type_name());
+            continue;
+        }
+        P4::ToP4 toP4(builder, Log::verbose(), file);
+        decl->apply(toP4);
+    }
+    builder.flush();
+}
+
 DebugHook CompilerOptions::getDebugHook() const {
     auto dp = std::bind(&CompilerOptions::dumpPass, this,
                         std::placeholders::_1, std::placeholders::_2,
                         std::placeholders::_3, std::placeholders::_4);
     return dp;
 }
+
+void CompilerOptions::writePassStats() const {
+    if (!passStatsFile.isNullOrEmpty()) {
+        if (auto stream = openFile(passStatsFile, false)) {
+            if (passStatsFile.endsWith(".csv"))
+                Visitor::profile_t::write_stats_csv(*stream);
+            else
+                Visitor::profile_t::write_stats_json(*stream);
+            stream->flush(); } }
+    if (!passTimingFile.isNullOrEmpty()) {
+        if (auto stream = openFile(passTimingFile, false)) {
+            Visitor::profile_t::write_stats_trace(*stream);
+            stream->flush(); } }
+    if (!sampleProfileFile.isNullOrEmpty()) {
+        if (auto stream = openFile(sampleProfileFile, false)) {
+            write_samples(*stream);
+            stream->flush(); } }
+}
@@ -20,6 +20,7 @@ limitations under the License.
 #define FRONTENDS_COMMON_OPTIONS_H_
 
 #include <regex>
+#include <string>
 #include "lib/cstring.h"
 #include "lib/options.h"
 #include "ir/ir.h"  // for DebugHook definition
@@ -29,15 +30,30 @@ limitations under the License.
 // Each back-end should subclass this file.
 class CompilerOptions : public Util::Options {
     bool close_input = false;
+    // the output of the built-in preprocessor, which the input stream reads
+    std::string preprocessed;
+    bool close_memory = false;
     static const char* defaultMessage;
 
  protected:
+    // The program of the last --top4 dump, which keeps its declarations alive for
+    // telling those that did not change since, and the file it was written to
+    mutable const IR::P4Program* lastDumped = nullptr;
+    mutable cstring lastDumpFile = nullptr;
+    // where the IR memory report is written, once opened
+    mutable std::ostream* irMemoryStream = nullptr;
+
     // Function that is returned by getDebugHook.
     void dumpPass(const char* manager, unsigned seq, const char* pass, const IR::Node* node) const;
+    // Writes the top-level declarations of the program that are not those of the last
+    // dump, and only the names of the others
+    void dumpChanges(std::ostream* stream, const IR::P4Program* program) const;
 
  public:
     CompilerOptions();
 
+    static const char* version;
+
     enum class FrontendVersion {
         P4_14,
         P4_16
@@ -49,6 +65,8 @@ class CompilerOptions : public Util::Options {
     FrontendVersion langVersion = FrontendVersion::P4_14;
     // options to pass to preprocessor
     cstring preprocessor_options = "";
+    // run cpp rather than the built-in preprocessor
+    bool externalPreprocessor = false;
     // file to compile (- for stdin)
     cstring file = nullptr;
     // if true preprocess only
@@ -62,14 +80,49 @@ class CompilerOptions : public Util::Options {
 
     // Dump a JSON representation of the IR in the file
     cstring dumpJsonFile = nullptr;
+    // without newlines and indentation
+    bool compactJson = false;
+    // Write a binary snapshot of the IR after the front end in the file
+    cstring dumpBinaryFile = nullptr;
+    // with an index of the top-level declarations, to read them one at a time
+    bool indexedBinary = false;
+    // Folder of cached front end results, if any
+    cstring frontendCacheDir = nullptr;
 
     // Dump and undump the IR tree
     bool debugJson = false;
 
+    // Write per-pass time and memory statistics to this file
+    // (CSV if the name ends in .csv, otherwise JSON)
+    cstring passStatsFile = nullptr;
+    // Write a Chrome trace (JSON) of the nested pass timings to this file
+    cstring passTimingFile = nullptr;
+    // Write the nodes and bytes of the IR by class after each pass to this file
+    cstring irMemoryFile = nullptr;
+    // Write the CPU time samples of each stack of passes and function to this file
+    cstring sampleProfileFile = nullptr;
+
+    // 0 runs only the passes needed to compile the program, 1 also the cheap
+    // optimizations, and 2 also the expensive ones; the warnings and errors are the
+    // same at each level
+    unsigned optimizationLevel = 2;
+    // Maximum number of states produced when unrolling a parser
+    unsigned maxParserStates = 1000;
+    // Threads that parse a large P4-16 program in parts; 0 for one per hardware thread
+    unsigned parseThreads = 1;
+    // Threads that type check the bodies of the top-level declarations of a P4-16
+    // program; 0 for one per hardware thread
+    unsigned typeCheckThreads = 1;
+    // IR nodes that inlining the instances of controls and parsers may add, on the
+    // targets that can invoke them as such; -1 inlines all of them
+    int inlineBudget = -1;
+
     // Compiler target architecture
     cstring target = nullptr;
     // substrings matched agains pass names
     std::vector<cstring> top4;
+    // After the first, --top4 dumps only the declarations that changed since the last
+    bool top4Changes = false;
 
     // Expect that the only remaining argument is the input file.
     void setInputFile();
@@ -81,9 +134,15 @@ class CompilerOptions : public Util::Options {
 
     // True if we are compiling a P4 v1.0 or v1.1 program
     bool isv1() const;
+    // True if the optimizations of this level run; pass lists add those that do not
+    // as nullptr, which PassManager skips
+    bool optimize(unsigned level) const { return optimizationLevel >= level; }
     // Get a debug hook function suitable for insertion
     // in the pass managers that are executed.
     DebugHook getDebugHook() const;
+    // Write the statistics collected for passStatsFile and passTimingFile, and the
+    // samples for sampleProfileFile, if requested.
+    void writePassStats() const;
 };
 
 #endif /* FRONTENDS_COMMON_OPTIONS_H_ */
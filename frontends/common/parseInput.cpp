@@ -15,20 +15,42 @@ limitations under the License.
 */
 
 #include "parseInput.h"
+#include <stdio.h>
+#include <string>
+#ifdef MULTITHREAD
+#include <mutex>
+#endif  // MULTITHREAD
+#include "frontendCache.h"
 #include "lib/error.h"
 #include "frontends/p4-14/p4-14-parse.h"
 #include "frontends/p4/fromv1.0/converters.h"
 #include "frontends/p4/frontend.h"
 #include "frontends/p4/p4-parse.h"
 
-const IR::P4Program* parseP4File(CompilerOptions& options) {
-    FILE* in = options.preprocess();
-    if (::errorCount() > 0 || in == nullptr)
-        return nullptr;
+#ifdef MULTITHREAD
+// The P4-14 parser keeps its state in globals, so P4-14 programs compiled on several
+// threads are parsed one at a time; the P4-16 parser is reentrant
+static std::mutex parserLock;
+#endif  // MULTITHREAD
 
+// Reads all of the output of the preprocessor
+static std::string readInput(FILE* in) {
+    std::string text;
+    char chunk[1 << 16];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), in)) > 0)
+        text.append(chunk, len);
+    return text;
+}
+
+// Parses the output of the preprocessor
+static const IR::P4Program* parseP4Input(CompilerOptions& options, FILE* in) {
     const IR::P4Program* result = nullptr;
     bool compiling10 = options.isv1();
     if (compiling10) {
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> parsing(parserLock);
+#endif  // MULTITHREAD
         P4V1::Converter converter;
         converter.loadModel();
         // Model is loaded before parsing the input file.
@@ -46,9 +68,21 @@ const IR::P4Program* parseP4File(CompilerOptions& options) {
                 return result;
             }
         }
+    } else if (options.parseThreads != 1) {
+        // the parts are parsed from the text in memory
+        result = parse_P4_16_text(options.file, readInput(in), nullptr, options.parseThreads);
     } else {
         result = parse_P4_16_file(options.file, in);
     }
+    return result;
+}
+
+const IR::P4Program* parseP4File(CompilerOptions& options) {
+    FILE* in = options.preprocess();
+    if (::errorCount() > 0 || in == nullptr)
+        return nullptr;
+
+    auto result = parseP4Input(options, in);
     options.closeInput(in);
     if (::errorCount() > 0) {
         ::error("%1% errors encountered, aborting compilation", ::errorCount());
@@ -56,3 +90,47 @@ const IR::P4Program* parseP4File(CompilerOptions& options) {
     }
     return result;
 }
+
+const IR::P4Program* parseAndRunFrontEnd(CompilerOptions& options, P4::FrontEnd& frontend) {
+    // A cached result would not produce the pretty-printed program or the dumps
+    if (!options.frontendCacheDir || options.prettyPrintFile || !options.top4.empty())
+        return frontend.run(options, parseP4File(options));
+
+    FILE* in = options.preprocess();
+    if (::errorCount() > 0 || in == nullptr)
+        return nullptr;
+    std::string text = readInput(in);
+    options.closeInput(in);
+    if (::errorCount() > 0)
+        return nullptr;
+
+    FrontendCache cache(options, text);
+    if (auto program = cache.load())
+        return program;
+
+    unsigned warnings = ErrorReporter::instance.getWarningCount();
+    const IR::P4Program* program;
+    if (options.isv1()) {
+        in = fmemopen(&text[0], text.size(), "r");
+        if (in == nullptr) {
+            ::error("Could not read the preprocessed program");
+            return nullptr;
+        }
+        program = parseP4Input(options, in);
+        fclose(in);
+    } else {
+        // The include files the program starts with are parsed once for all programs
+        IncludeCache includes(options);
+        program = parse_P4_16_text(options.file, text, &includes, options.parseThreads);
+    }
+    if (::errorCount() > 0) {
+        ::error("%1% errors encountered, aborting compilation", ::errorCount());
+        return nullptr;
+    }
+    program = frontend.run(options, program);
+    // a cached result would not repeat the warnings
+    if (program != nullptr && ::errorCount() == 0 &&
+        ErrorReporter::instance.getWarningCount() == warnings)
+        cache.store(program);
+    return program;
+}
@@ -19,9 +19,14 @@ limitations under the License.
 
 #include "ir/ir.h"
 #include "options.h"
+#include "frontends/p4/frontend.h"
 
 // Parse a P4-14 or P4-16 file (as specified by the options)
 // and return it in a P4-16 representation
 const IR::P4Program* parseP4File(CompilerOptions& options);
 
+// Parse the program and run the front end on it, or, with --frontendCache, reload
+// the result of doing that from an earlier compilation of the same program.
+const IR::P4Program* parseAndRunFrontEnd(CompilerOptions& options, P4::FrontEnd& frontend);
+
 #endif /* _FRONTENDS_COMMON_PARSEINPUT_H_ */
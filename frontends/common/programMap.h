@@ -17,6 +17,8 @@ limitations under the License.
 #ifndef _FRONTENDS_COMMON_PROGRAMMAP_H_
 #define _FRONTENDS_COMMON_PROGRAMMAP_H_
 
+#include <cstdint>
+
 #include "ir/ir.h"
 
 namespace P4 {
@@ -24,38 +26,56 @@ namespace P4 {
 // Base class for various maps.
 // A map is computed on a certain P4Program.
 // If the program has not changed, the map is up-to-date.
+// The map does not keep the program it was computed on alive: once a pass
+// replaces the program, the old one can be collected, so the map only remembers
+// its address, with the bits inverted so that the garbage collector does not take
+// it for a pointer, and its id, since a new program may be allocated at the same
+// address.  Checking a map is then comparing two words, and never reads the old
+// program.
 class ProgramMap : public IHasDbPrint {
+    uintptr_t programAddress = 0;  // hidden, 0 if none
+    int programId = -1;
+
  protected:
-    const IR::P4Program* program = nullptr;
     cstring mapKind;
     explicit ProgramMap(cstring kind) : mapKind(kind) {}
     virtual ~ProgramMap() {}
 
+    // the id of the program that the map was computed on, -1 if none
+    int mapProgramId() const { return programAddress == 0 ? -1 : programId; }
+    void resetMap() { programAddress = 0; programId = -1; }
+
  public:
+    // True if the map was computed on 'node', which is a program
+    bool isValidFor(const IR::Node* node) const {
+        return programAddress != 0 && node->id == programId &&
+                programAddress == ~reinterpret_cast<uintptr_t>(node) && node->is<IR::P4Program>();
+    }
     // Check if map is up-to-date for the specified node; return true if it is
     bool checkMap(const IR::Node* node) const {
-        if (!node->is<IR::P4Program>() || program == nullptr)
+        if (!node->is<IR::P4Program>() || programAddress == 0)
             return false;
-        if (node->to<IR::P4Program>() == program) {
+        if (isValidFor(node)) {
             // program has not changed
             LOG2(mapKind << " is up-to-date");
             return true;
         } else {
-            LOG2("Program has changed from " << dbp(program) << " to " << dbp(node));
+            LOG2("Program has changed from P4Program(" << programId << ") to " << dbp(node));
         }
         return false;
     }
     void validateMap(const IR::Node* node) const {
-        if (!node->is<IR::P4Program>() || program == nullptr)
+        if (!node->is<IR::P4Program>() || programAddress == 0)
             return;
-        if (program != node->to<IR::P4Program>())
-            BUG("Invalid map %1%: computed for %2%, used for %3%",
-                mapKind, dbp(program), dbp(node));
+        if (!isValidFor(node))
+            BUG("Invalid map %1%: computed for P4Program(%2%), used for %3%",
+                mapKind, programId, dbp(node));
     }
     void updateMap(const IR::Node* node) {
         if (!node->is<IR::P4Program>())
             return;
-        program = node->to<IR::P4Program>();
+        programAddress = ~reinterpret_cast<uintptr_t>(node);
+        programId = node->id;
         LOG2(mapKind << " updated to " << dbp(node));
     }
 };
@@ -20,21 +20,56 @@ limitations under the License.
 
 namespace P4 {
 
+const std::vector<const IR::IDeclaration*>&
+NamespaceIndex::lookup(const IR::INamespace* ns, cstring name) {
+    auto &scope = scopes[ns];
+    scope.lastRun = run;
+    auto it = scope.byName.find(name);
+    if (it != scope.byName.end())
+        return it->second;
+
+    auto &decls = scope.byName[name];
+    if (auto gen = ns->to<IR::IGeneralNamespace>()) {
+        for (auto d : *gen->getDeclsByName(name))
+            decls.push_back(d);
+    } else if (auto decl = ns->to<IR::ISimpleNamespace>()->getDeclByName(name)) {
+        decls.push_back(decl);
+    }
+    return decls;
+}
+
+void NamespaceIndex::endRun() {
+    for (auto it = scopes.begin(); it != scopes.end();) {
+        if (it->second.lastRun != run)
+            it = scopes.erase(it);
+        else
+            ++it;
+    }
+    ++run;
+}
+
 ReferenceMap::ReferenceMap() : ProgramMap("ReferenceMap"), isv1(false) { clear(); }
 
 void ReferenceMap::clear() {
     pathToDeclaration.clear();
     usedNames.clear();
+    nextSuffix.clear();
     used.clear();
     thisToDeclaration.clear();
     usedNames.insert(P4::reservedWords.begin(), P4::reservedWords.end());
+    ++generation;
+}
+
+const ReferenceMap::DeclarationRecord* ReferenceMap::getRecord(const IR::Node* decl) const {
+    auto it = records.find(decl);
+    return it == records.end() ? nullptr : &it->second;
 }
 
 void ReferenceMap::setDeclaration(const IR::Path* path, const IR::IDeclaration* decl) {
     CHECK_NULL(path);
     CHECK_NULL(decl);
     LOG1("Resolved " << path << " to " << decl);
-    auto previous = get(pathToDeclaration, path);
+    auto previous = pathToDeclaration.get(path);
     if (previous != nullptr && previous != decl)
         BUG("%1% already resolved to %2% instead of %3%",
                                 path, previous, decl);
@@ -65,7 +100,7 @@ const IR::IDeclaration* ReferenceMap::getDeclaration(const IR::This* pointer, bo
 
 const IR::IDeclaration* ReferenceMap::getDeclaration(const IR::Path* path, bool notNull) const {
     CHECK_NULL(path);
-    auto result = get(pathToDeclaration, path);
+    auto result = pathToDeclaration.get(path);
     LOG1("Looking up " << path << " found " << result->getNode());
     if (notNull)
         BUG_CHECK(result != nullptr, "Cannot find declaration for %1%", path);
@@ -75,13 +110,49 @@ const IR::IDeclaration* ReferenceMap::getDeclaration(const IR::Path* path, bool
 void ReferenceMap::dbprint(std::ostream &out) const {
     if (pathToDeclaration.empty())
         out << "Empty" << std::endl;
-    for (auto e : pathToDeclaration)
-        out << dbp(e.first) << "->" << dbp(e.second) << std::endl;
+    pathToDeclaration.for_each([&out](const IR::Node* path, const IR::IDeclaration* decl) {
+        out << dbp(path) << "->" << dbp(decl) << std::endl; });
+}
+
+// The reservation active on this thread, if any
+static thread_local ReferenceMap::NameReservation* activeReservation = nullptr;
+
+namespace {
+// The names used by a map together with those of a reservation against it
+struct ReservedNames {
+    const std::unordered_set<cstring> &used;
+    const std::set<cstring> &reserved;
+    size_t count(cstring name) const { return used.count(name) + reserved.count(name); }
+};
+
+// The first of base, base_<start>, base_<start+1>, ... that is not in use, as
+// cstring::make_unique would find if the suffixes below 'start' are all in use;
+// 'counter' is set to that of its suffix, or -1 for base itself.  Only the name
+// returned is interned.
+template<class T>
+cstring firstUnused(const T& inuse, cstring base, int start, int& counter) {
+    counter = -1;
+    if (!inuse.count(base))
+        return base;
+    cstring_builder name(base);
+    name += '_';
+    size_t prefix = name.size();
+    for (counter = start; ; ++counter) {
+        name.truncate(prefix);
+        name += counter;
+        cstring used = name.existing();
+        if (!used)
+            return name.str();
+        if (!inuse.count(used))
+            return used;
+    }
 }
+}  // namespace
 
 cstring ReferenceMap::newName(cstring base) {
     // Maybe in the future we'll maintain information with per-scope identifiers,
     // but today we are content to generate globally-unique identifiers.
+    cstring request = base;
 
     // If base has a suffix of the form _(\d+), then we discard the suffix.
     // under the assumption that it is probably a generated suffix.
@@ -93,9 +164,63 @@ cstring ReferenceMap::newName(cstring base) {
     if (len > 0 && base[len - 1] == '_')
         base = base.substr(0, len - 1);
 
-    cstring name = cstring::make_unique(usedNames, base, '_');
+    int counter;
+    auto next = nextSuffix.find(base);
+    int start = next == nextSuffix.end() ? 0 : next->second;
+    if (activeReservation && activeReservation->map == this) {
+        // other threads may be reading nextSuffix, so it is not updated
+        auto r = activeReservation;
+        cstring name = firstUnused(ReservedNames{usedNames, r->names}, base, start, counter);
+        r->names.insert(name);
+        r->requests.push_back({request, name});
+        return name; }
+    cstring name = firstUnused(usedNames, base, start, counter);
+    if (counter >= 0)
+        nextSuffix[base] = counter + 1;
     usedNames.insert(name);
     return name;
 }
 
+void ReferenceMap::usedName(cstring name) {
+    if (activeReservation && activeReservation->map == this) {
+        activeReservation->names.insert(name);
+        activeReservation->requests.push_back({cstring(), name});
+        return; }
+    usedNames.insert(name);
+}
+
+void ReferenceMap::NameReservation::activate() {
+    BUG_CHECK(!activeReservation, "name reservations cannot be nested");
+    activeReservation = this;
+}
+
+void ReferenceMap::NameReservation::deactivate() {
+    BUG_CHECK(activeReservation == this, "deactivating a name reservation that is not active");
+    activeReservation = nullptr;
+}
+
+bool ReferenceMap::NameReservation::commit() {
+    BUG_CHECK(!activeReservation, "committing names with a reservation active");
+    std::vector<cstring> added;
+    bool same = true;
+    for (auto &r : requests) {
+        if (r.base.isNull()) {
+            if (map->usedNames.insert(r.name).second)
+                added.push_back(r.name);
+            continue; }
+        cstring name = map->newName(r.base);
+        added.push_back(name);
+        if (name != r.name) {
+            same = false;
+            break; } }
+    if (!same) {
+        for (auto name : added)
+            map->usedNames.erase(name);
+        map->nextSuffix.clear();
+    }
+    requests.clear();
+    names.clear();
+    return same;
+}
+
 }  // namespace P4
@@ -17,7 +17,11 @@ limitations under the License.
 #ifndef _COMMON_RESOLVEREFERENCES_REFERENCEMAP_H_
 #define _COMMON_RESOLVEREFERENCES_REFERENCEMAP_H_
 
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "ir/ir.h"
+#include "ir/node_id_map.h"
 #include "lib/cstring.h"
 #include "lib/map.h"
 #include "frontends/common/programMap.h"
@@ -29,15 +33,72 @@ class NameGenerator {
     virtual cstring newName(cstring base) = 0;
 };
 
+/*
+ * Caches the result of looking up names in namespaces.  IR nodes do not
+ * change, so a lookup in a namespace gives the same declarations in every
+ * run of ResolveReferences over a program containing it: the index is kept
+ * when a ReferenceMap is cleared, and only namespaces which were not
+ * searched by the last run are dropped.
+ */
+class NamespaceIndex {
+    struct scope_t {
+        std::unordered_map<cstring, std::vector<const IR::IDeclaration*>> byName;
+        unsigned lastRun;
+    };
+    std::unordered_map<const IR::INamespace*, scope_t> scopes;
+    unsigned run = 0;
+
+ public:
+    // Declarations called 'name' in 'ns', as returned by getDeclsByName
+    // for an IGeneralNamespace and by getDeclByName otherwise.
+    const std::vector<const IR::IDeclaration*>& lookup(const IR::INamespace* ns, cstring name);
+    // Called at the end of a run; forgets the namespaces it did not search.
+    void endRun();
+    size_t size() const { return scopes.size(); }
+};
+
 class ReferenceMap final : public ProgramMap, public NameGenerator {
     bool isv1;  // if true this is a map for a P4 v1.0 program (P4-14)
     // Maps each path in the program to the corresponding declaration
-    std::map<const IR::Path*, const IR::IDeclaration*> pathToDeclaration;
+    NodeIdMap<const IR::IDeclaration*> pathToDeclaration;
     std::set<const IR::IDeclaration*> used;
     std::map<const IR::This*, const IR::IDeclaration*> thisToDeclaration;
 
     // All names used within the program
-    std::set<cstring> usedNames;
+    std::unordered_set<cstring> usedNames;
+    // For each base given to newName the first suffix counter that may be free:
+    // names are only added to usedNames, so the suffixes below it are all used.
+    // Reset when names are removed.
+    std::unordered_map<cstring, int> nextSuffix;
+    // Not cleared by clear()
+    NamespaceIndex namespaces;
+    // Counts the calls of clear(), so that results derived from the map can tell
+    // whether it still holds the declarations they were computed from
+    unsigned generation = 0;
+
+ public:
+    /*
+     * What a run of ResolveReferences did in one top-level declaration of the
+     * program.  A later run over a program that still contains the same node
+     * replays it instead of visiting the declaration again, provided the paths it
+     * resolved in the program's namespace still resolve to the same declarations:
+     * nodes do not change, so the namespaces within the declaration are the same.
+     */
+    struct DeclarationRecord {
+        struct path_t {
+            const IR::Path* path;
+            const IR::IDeclaration* decl;
+            bool global;  // resolved in the program's namespace or a global one
+            bool isType, previousOnly;
+        };
+        std::vector<path_t> paths;
+        std::vector<std::pair<const IR::This*, const IR::IDeclaration*>> pointers;
+        std::vector<cstring> names;  // passed to usedName
+    };
+
+ private:
+    // Records of the last run, and of the run in progress; not cleared by clear()
+    std::unordered_map<const IR::Node*, DeclarationRecord> records, nextRecords;
 
  public:
     ReferenceMap();
@@ -50,8 +111,48 @@ class ReferenceMap final : public ProgramMap, public NameGenerator {
     cstring newName(cstring base);
     void clear();
     bool isV1() const { return isv1; }
+    unsigned getGeneration() const { return generation; }
     bool isUsed(const IR::IDeclaration* decl) const { return used.count(decl) > 0; }
-    void usedName(cstring name) { usedNames.insert(name); }
+    void usedName(cstring name);
+    NamespaceIndex* namespaceIndex() { return &namespaces; }
+    // The record of the last run for a top-level declaration, if any
+    const DeclarationRecord* getRecord(const IR::Node* decl) const;
+    // Starts the record of the run in progress for a top-level declaration
+    DeclarationRecord* newRecord(const IR::Node* decl) { return &nextRecords[decl]; }
+    void dropRecord(const IR::Node* decl) { nextRecords.erase(decl); }
+    // Called at the end of a run; its records replace those of the last one
+    void endRecording() { records.swap(nextRecords); nextRecords.clear(); }
+
+    /*
+     * Lets the clones of a ParallelTransform generate names on several threads
+     * and still get the names a serial run would.  While a reservation is active
+     * on a thread, newName and usedName there leave the map alone: names are made
+     * unique against the map and the reservation's own names, and recorded.
+     * commit() then replays the requests against the map; it keeps them if each
+     * name comes out the same, and otherwise undoes them and returns false, so the
+     * work that produced them can be redone.
+     */
+    class NameReservation {
+     public:
+        struct request_t { cstring base, name; };  // 'base' is null for usedName
+
+     private:
+        ReferenceMap* map;
+        std::vector<request_t> requests;
+        std::set<cstring> names;
+        friend class ReferenceMap;
+
+     public:
+        explicit NameReservation(ReferenceMap* map) : map(map) { CHECK_NULL(map); }
+        void activate();
+        void deactivate();
+        bool commit();
+        // The requests so far, e.g. to save them, and to add saved ones back
+        const std::vector<request_t>& getRequests() const { return requests; }
+        void addRequest(const request_t& request) {
+            names.insert(request.name);
+            requests.push_back(request); }
+    };
 };
 
 }  // namespace P4
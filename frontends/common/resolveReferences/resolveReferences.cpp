@@ -19,100 +19,62 @@ limitations under the License.
 
 namespace P4 {
 
-std::vector<const IR::IDeclaration*>*
-ResolutionContext::resolve(IR::ID name, P4::ResolutionType type, bool previousOnly) const {
-    static std::vector<const IR::IDeclaration*> empty;
-
-    std::vector<const IR::INamespace*> toTry(stack);
-    toTry.insert(toTry.end(), globals.begin(), globals.end());
-
-    for (auto it = toTry.rbegin(); it != toTry.rend(); ++it) {
-        const IR::INamespace* current = *it;
-        LOG2("Trying to resolve in " << current->toString());
-
-        if (current->is<IR::IGeneralNamespace>()) {
-            auto gen = current->to<IR::IGeneralNamespace>();
-            Util::Enumerator<const IR::IDeclaration*>* decls = gen->getDeclsByName(name);
-            switch (type) {
-                case P4::ResolutionType::Any:
-                    break;
-                case P4::ResolutionType::Type: {
-                    std::function<bool(const IR::IDeclaration*)> kindFilter =
-                            [](const IR::IDeclaration* d) {
-                        return d->is<IR::Type>();
-                    };
-                    decls = decls->where(kindFilter);
-                    break;
-                }
-                case P4::ResolutionType::TypeVariable: {
-                    std::function<bool(const IR::IDeclaration*)> kindFilter =
-                            [](const IR::IDeclaration* d) {
-                    return d->is<IR::Type_Var>(); };
-                    decls = decls->where(kindFilter);
-                    break;
-                }
-            default:
-                BUG("Unexpected enumeration value %1%", static_cast<int>(type));
+bool ResolutionContext::lookup(const IR::INamespace* ns, IR::ID name, ResolutionType type,
+                               bool previousOnly,
+                               std::vector<const IR::IDeclaration*>* result) const {
+    LOG2("Trying to resolve in " << ns->toString());
+    for (auto decl : index->lookup(ns, name.name)) {
+        switch (type) {
+            case P4::ResolutionType::Any:
+                break;
+            case P4::ResolutionType::Type: {
+                if (!decl->is<IR::Type>())
+                    continue;
+                break;
             }
-
-            if (previousOnly) {
-                std::function<bool(const IR::IDeclaration*)> locationFilter =
-                        [name](const IR::IDeclaration* d) {
-                    Util::SourceInfo nsi = name.srcInfo;
-                    Util::SourceInfo dsi = d->getNode()->srcInfo;
-                    bool before = dsi <= nsi;
-                    LOG2("\tPosition test:" << dsi << "<=" << nsi << "=" << before);
-                    return before;
-                };
-                decls = decls->where(locationFilter);
+            case P4::ResolutionType::TypeVariable: {
+                if (!decl->is<IR::Type_Var>())
+                    continue;
+                break;
             }
+        default:
+            BUG("Unexpected enumeration value %1%", static_cast<int>(type));
+        }
 
-            auto vector = decls->toVector();
-            if (!vector->empty()) {
-                LOG2("Resolved in " << dbp(current->getNode()));
-                return vector;
-            } else {
+        if (previousOnly) {
+            Util::SourceInfo nsi = name.srcInfo;
+            Util::SourceInfo dsi = decl->getNode()->srcInfo;
+            bool before = dsi <= nsi;
+            LOG2("\tPosition test:" << dsi << "<=" << nsi << "=" << before);
+            if (!before)
                 continue;
-            }
-        } else {
-            auto simple = current->to<IR::ISimpleNamespace>();
-            auto decl = simple->getDeclByName(name);
-            if (decl == nullptr)
-                continue;
-            switch (type) {
-                case P4::ResolutionType::Any:
-                    break;
-                case P4::ResolutionType::Type: {
-                    if (!decl->is<IR::Type>())
-                        continue;
-                    break;
-                }
-                case P4::ResolutionType::TypeVariable: {
-                    if (!decl->is<IR::Type_Var>())
-                        continue;
-                    break;
-                }
-            default:
-                BUG("Unexpected enumeration value %1%", static_cast<int>(type));
-            }
-
-            if (previousOnly) {
-                Util::SourceInfo nsi = name.srcInfo;
-                Util::SourceInfo dsi = decl->getNode()->srcInfo;
-                bool before = dsi <= nsi;
-                LOG2("\tPosition test:" << dsi << "<=" << nsi << "=" << before);
-                if (!before)
-                    continue;
-            }
+        }
+        result->push_back(decl);
+    }
+    if (result->empty())
+        return false;
+    LOG2("Resolved in " << dbp(ns->getNode()));
+    return true;
+}
 
-            LOG2("Resolved in " << dbp(current->getNode()));
-            auto result = new std::vector<const IR::IDeclaration*>();
-            result->push_back(decl);
+std::vector<const IR::IDeclaration*>*
+ResolutionContext::resolve(IR::ID name, P4::ResolutionType type, bool previousOnly,
+                           bool* global) const {
+    auto result = new std::vector<const IR::IDeclaration*>();
+    if (global != nullptr)
+        *global = true;
+    // Globals are searched first, then the stack from the innermost namespace
+    for (auto it = globals.rbegin(); it != globals.rend(); ++it)
+        if (lookup(*it, name, type, previousOnly, result))
+            return result;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+        if (lookup(*it, name, type, previousOnly, result)) {
+            if (global != nullptr)
+                *global = *it == rootNamespace;
             return result;
         }
     }
-
-    return &empty;
+    return result;
 }
 
 void ResolutionContext::done() {
@@ -123,8 +85,9 @@ void ResolutionContext::done() {
 const IR::IDeclaration*
 ResolutionContext::resolveUnique(IR::ID name,
                                  P4::ResolutionType type,
-                                 bool previousOnly) const {
-    auto decls = resolve(name, type, previousOnly);
+                                 bool previousOnly,
+                                 bool* global) const {
+    auto decls = resolve(name, type, previousOnly, global);
     if (decls->empty()) {
         ::error("Could not find declaration for %1%", name);
         return nullptr;
@@ -191,19 +154,76 @@ void ResolveReferences::resolvePath(const IR::Path* path, bool isType) const {
     LOG1("Resolving " << path << " " << (isType ? "as type" : "as identifier"));
     ResolutionContext* ctx = context;
     if (path->absolute)
-        ctx = new ResolutionContext(rootNamespace);
+        ctx = new ResolutionContext(rootNamespace, refMap->namespaceIndex());
     ResolutionType k = isType ? ResolutionType::Type : ResolutionType::Any;
 
     BUG_CHECK(!resolveForward.empty(), "Empty resolveForward");
     bool allowForward = resolveForward.back();
 
-    const IR::IDeclaration* decl = ctx->resolveUnique(path->name, k, !allowForward);
+    bool global;
+    const IR::IDeclaration* decl = ctx->resolveUnique(path->name, k, !allowForward, &global);
     if (decl == nullptr) {
-        refMap->usedName(path->name.name);
+        usedName(path->name.name);
         return;
     }
 
     refMap->setDeclaration(path, decl);
+    if (recording != nullptr)
+        recording->paths.push_back({ path, decl, global, isType, !allowForward });
+}
+
+void ResolveReferences::usedName(cstring name) const {
+    refMap->usedName(name);
+    if (recording != nullptr)
+        recording->names.push_back(name);
+}
+
+bool ResolveReferences::replay(const IR::Node* decl) {
+    auto record = refMap->getRecord(decl);
+    if (record == nullptr)
+        return false;
+    for (auto& p : record->paths) {
+        if (!p.global) {
+            if (context->declaredGlobally(p.path->name.name))
+                return false;
+            continue;
+        }
+        ResolutionContext* ctx = context;
+        if (p.path->absolute)
+            ctx = new ResolutionContext(rootNamespace, refMap->namespaceIndex());
+        auto decls = ctx->resolve(p.path->name, p.isType ? ResolutionType::Type :
+                                  ResolutionType::Any, p.previousOnly);
+        if (decls->size() != 1 || decls->at(0) != p.decl) {
+            LOG2("Resolving " << dbp(decl) << " again: " << p.path << " has changed");
+            return false;
+        }
+    }
+    for (auto& p : record->paths)
+        refMap->setDeclaration(p.path, p.decl);
+    for (auto& p : record->pointers)
+        refMap->setDeclaration(p.first, p.second);
+    for (auto name : record->names)
+        refMap->usedName(name);
+    // copied before the records are replaced
+    *refMap->newRecord(decl) = *record;
+    return true;
+}
+
+void ResolveReferences::visitDeclaration(const IR::Node* decl) {
+    // Shadowing warnings and match_kind globals come from visiting declarations
+    if (checkShadow || decl->is<IR::Declaration_MatchKind>()) {
+        visit(decl, "declarations");
+        return;
+    }
+    if (replay(decl))
+        return;
+    int errors = ErrorReporter::instance.getErrorCount();
+    recording = refMap->newRecord(decl);
+    *recording = ReferenceMap::DeclarationRecord();
+    visit(decl, "declarations");
+    recording = nullptr;
+    if (ErrorReporter::instance.getErrorCount() > errors)
+        refMap->dropRecord(decl);
 }
 
 void ResolveReferences::checkShadowing(const IR::INamespace*ns) const {
@@ -251,16 +271,23 @@ bool ResolveReferences::preorder(const IR::P4Program* program) {
     resolveForward.push_back(anyOrder);
     BUG_CHECK(rootNamespace == nullptr, "Root namespace already set");
     rootNamespace = program;
-    context = new ResolutionContext(rootNamespace);
-    return true;
+    context = new ResolutionContext(rootNamespace, refMap->namespaceIndex());
+    // The declarations are visited here, so that those that the last run
+    // recorded can be replayed instead
+    for (auto decl : *program->declarations)
+        visitDeclaration(decl);
+    postorder(program);
+    return false;
 }
 
 void ResolveReferences::postorder(const IR::P4Program*) {
+    refMap->endRecording();
     rootNamespace = nullptr;
     context->done();
     resolveForward.pop_back();
     BUG_CHECK(resolveForward.empty(), "Expected empty resolvePath");
     context = nullptr;
+    refMap->namespaceIndex()->endRun();
     LOG1("Reference map " << refMap);
 }
 
@@ -269,6 +296,8 @@ bool ResolveReferences::preorder(const IR::This* pointer) {
     if (findContext<IR::Function>() == nullptr || decl == nullptr)
         ::error("%1%: can only be used in the definition of an abstract method", pointer);
     refMap->setDeclaration(pointer, decl);
+    if (recording != nullptr)
+        recording->pointers.emplace_back(pointer, decl);
     return true;
 }
 
@@ -279,7 +308,7 @@ bool ResolveReferences::preorder(const IR::Type_Name* type) {
     resolvePath(type->path, true); return true; }
 
 bool ResolveReferences::preorder(const IR::P4Control *c) {
-    refMap->usedName(c->name.name);
+    usedName(c->name.name);
     addToContext(c);
     addToContext(c->type->typeParameters);
     addToContext(c->type->applyParams);
@@ -296,7 +325,7 @@ void ResolveReferences::postorder(const IR::P4Control *c) {
 }
 
 bool ResolveReferences::preorder(const IR::P4Parser *c) {
-    refMap->usedName(c->name.name);
+    usedName(c->name.name);
     addToContext(c);
     addToContext(c->type->typeParameters);
     addToContext(c->type->applyParams);
@@ -313,7 +342,7 @@ void ResolveReferences::postorder(const IR::P4Parser *c) {
 }
 
 bool ResolveReferences::preorder(const IR::Function* function) {
-    refMap->usedName(function->name.name);
+    usedName(function->name.name);
     addToContext(function->type->parameters);
     return true;
 }
@@ -323,7 +352,7 @@ void ResolveReferences::postorder(const IR::Function* function) {
 }
 
 bool ResolveReferences::preorder(const IR::P4Table* t) {
-    refMap->usedName(t->name.name);
+    usedName(t->name.name);
     addToContext(t->parameters);
     return true;
 }
@@ -342,7 +371,7 @@ void ResolveReferences::postorder(const IR::TableProperties *p) {
 }
 
 bool ResolveReferences::preorder(const IR::P4Action *c) {
-    refMap->usedName(c->name.name);
+    usedName(c->name.name);
     addToContext(c);
     addToContext(c->parameters);
     return true;
@@ -373,14 +402,14 @@ void ResolveReferences::postorder(const IR::Type_Method *t) {
 }
 
 bool ResolveReferences::preorder(const IR::Type_Extern *t) {
-    refMap->usedName(t->name.name);
+    usedName(t->name.name);
     addToContext(t->typeParameters); return true; }
 
 void ResolveReferences::postorder(const IR::Type_Extern *t) {
     removeFromContext(t->typeParameters); }
 
 bool ResolveReferences::preorder(const IR::ParserState *s) {
-    refMap->usedName(s->name.name);
+    usedName(s->name.name);
     // State references may be resolved forward
     resolveForward.push_back(true);
     addToContext(s);
@@ -403,13 +432,13 @@ bool ResolveReferences::preorder(const IR::Type_ArchBlock *t) {
 }
 
 void ResolveReferences::postorder(const IR::Type_ArchBlock *t) {
-    refMap->usedName(t->name.name);
+    usedName(t->name.name);
     removeFromContext(t->typeParameters);
     resolveForward.pop_back();
 }
 
 bool ResolveReferences::preorder(const IR::Type_StructLike *t)
-{ refMap->usedName(t->name.name); addToContext(t); return true; }
+{ usedName(t->name.name); addToContext(t); return true; }
 
 void ResolveReferences::postorder(const IR::Type_StructLike *t)
 { removeFromContext(t); }
@@ -421,7 +450,7 @@ void ResolveReferences::postorder(const IR::BlockStatement *b)
 { removeFromContext(b); checkShadowing(b); }
 
 bool ResolveReferences::preorder(const IR::Declaration_Instance *decl) {
-    refMap->usedName(decl->name.name);
+    usedName(decl->name.name);
     if (decl->initializer != nullptr)
         addToContext(decl->initializer);
     return true;
@@ -33,11 +33,16 @@ class ResolutionContext : public IHasDbPrint {
     std::vector<const IR::INamespace*> stack;
     const IR::INamespace* rootNamespace;
     std::vector<const IR::INamespace*> globals;  // match_kind
+    NamespaceIndex* index;  // declarations of each namespace by name
+
+    // Declarations in 'ns' matching 'name' and the restrictions of resolve().
+    bool lookup(const IR::INamespace* ns, IR::ID name, ResolutionType type, bool previousOnly,
+                std::vector<const IR::IDeclaration*>* result) const;
 
  public:
-    explicit ResolutionContext(const IR::INamespace* rootNamespace) :
-            rootNamespace(rootNamespace)
-    { push(rootNamespace); }
+    ResolutionContext(const IR::INamespace* rootNamespace, NamespaceIndex* index) :
+            rootNamespace(rootNamespace), index(index)
+    { CHECK_NULL(index); push(rootNamespace); }
 
     void dbprint(std::ostream& out) const;
     void addGlobal(const IR::INamespace* e) {
@@ -56,16 +61,26 @@ class ResolutionContext : public IHasDbPrint {
         stack.pop_back();
     }
     void done();
+    // Whether a global namespace declares 'name'; globals are searched first
+    bool declaredGlobally(cstring name) const {
+        for (auto ns : globals)
+            if (!index->lookup(ns, name).empty())
+                return true;
+        return false;
+    }
 
     // Resolve a reference for the specified name.
     // The reference is restricted to be to an object of the specified type
     // If previousOnly is true, the reference must precede the point of the 'name' in the program
+    // If 'global' is not null it is set to whether the declarations are in the root
+    // namespace or a global one.
     std::vector<const IR::IDeclaration*>*
-    resolve(IR::ID name, ResolutionType type, bool previousOnly) const;
+    resolve(IR::ID name, ResolutionType type, bool previousOnly, bool* global = nullptr) const;
 
     // Resolve a reference for the specified name; expect a single result
     const IR::IDeclaration*
-    resolveUnique(IR::ID name, ResolutionType type, bool previousOnly) const;
+    resolveUnique(IR::ID name, ResolutionType type, bool previousOnly,
+                  bool* global = nullptr) const;
 };
 
 // No prerequisites, but it usually must be run over the whole program.
@@ -80,8 +95,15 @@ class ResolveReferences : public Inspector {
     std::vector<bool> resolveForward;  // if true allow resolution with declarations that follow use
     bool anyOrder;
     bool checkShadow;
+    // The record of the top-level declaration being visited, if it is recorded
+    ReferenceMap::DeclarationRecord* recording = nullptr;
 
  private:
+    void usedName(cstring name) const;
+    // Replays the record of a top-level declaration; false if there is none or it
+    // is no longer valid.
+    bool replay(const IR::Node* decl);
+    void visitDeclaration(const IR::Node* decl);
     void addToContext(const IR::INamespace* ns);
     void removeFromContext(const IR::INamespace* ns);
     void addToGlobals(const IR::INamespace* ns);
@@ -122,9 +144,9 @@ class ResolveReferences : public Inspector {
 
     bool preorder(const IR::Declaration_MatchKind* d) override;
     bool preorder(const IR::Declaration* d) override
-    { refMap->usedName(d->getName().name); return true; }
+    { usedName(d->getName().name); return true; }
     bool preorder(const IR::Type_Declaration* d) override
-    { refMap->usedName(d->getName().name); return true; }
+    { usedName(d->getName().name); return true; }
 
     void checkShadowing(const IR::INamespace*ns) const;
 };
@@ -14,8 +14,46 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include "typecheck.h"
 
+// The global objects that the passes look up for each reference, indexed by name once
+// for each pass, rather than searched for in the scope of the program each time.  As
+// with V1Program::get, the first object of the right kind with a name is the one found.
+class TypeCheck::GlobalIndex {
+    std::unordered_map<cstring, const IR::HeaderOrMetadata *>  headers;
+    std::unordered_map<cstring, const IR::IInstance *>         instances;
+    std::unordered_map<cstring, const IR::Type *>              types;
+    std::unordered_map<cstring, const IR::ActionFunction *>    actions;
+    std::unordered_set<cstring>                                names;
+
+    template<class T>
+    static void add(std::unordered_map<cstring, const T *> &map, cstring name,
+                    const IR::Node *node) {
+        if (auto t = dynamic_cast<const T *>(node))
+            map.emplace(name, t); }
+    template<class T>
+    static const T *find(const std::unordered_map<cstring, const T *> &map, cstring name) {
+        auto it = map.find(name);
+        return it == map.end() ? nullptr : it->second; }
+
+ public:
+    explicit GlobalIndex(const IR::V1Program *global) {
+        for (auto &sym : global->scope) {
+            add(headers, sym.first, sym.second);
+            add(instances, sym.first, sym.second);
+            add(types, sym.first, sym.second);
+            add(actions, sym.first, sym.second);
+            names.insert(sym.first); } }
+    const IR::HeaderOrMetadata *header(cstring name) const { return find(headers, name); }
+    const IR::IInstance *instance(cstring name) const { return find(instances, name); }
+    const IR::Type *type(cstring name) const { return find(types, name); }
+    const IR::ActionFunction *action(cstring name) const { return find(actions, name); }
+    bool contains(cstring name) const { return names.count(name) != 0; }
+};
+
 // P4 v1.0 and v1.1 type checking algorithm
 // Initial type setting based on immediate context:
 // - replace named reference to ActionParams in the bodies of ActionFunctions with the
@@ -26,7 +64,11 @@ limitations under the License.
 // - set type for Member and HeaderStackItemRefs
 class TypeCheck::Pass1 : public Transform {
     const IR::V1Program   *global = nullptr;
-    const IR::Node *preorder(IR::V1Program *glob) override { global = glob; return glob; }
+    const GlobalIndex     *index = nullptr;
+    const IR::Node *preorder(IR::V1Program *glob) override {
+        global = glob;
+        index = new GlobalIndex(glob);
+        return glob; }
     const IR::Node *preorder(IR::PathExpression *ref) override {
         if (auto af = findContext<IR::ActionFunction>())
             if (auto arg = af->arg(ref->path->name))
@@ -92,15 +134,15 @@ class TypeCheck::Pass1 : public Transform {
                     /* ref to local of property -- do something with it? */
                     return ref; } } }
         IR::Node *new_node = ref;
-        if (auto hdr = global->get<IR::HeaderOrMetadata>(ref->path->name)) {
+        if (auto hdr = index->header(ref->path->name)) {
             visit(hdr);
             new_node = new IR::ConcreteHeaderRef(ref->srcInfo, hdr);
-        } else if (auto obj = global->get<IR::IInstance>(ref->path->name)) {
+        } else if (auto obj = index->instance(ref->path->name)) {
             const IR::Node *tmp = obj->getNode();  // FIXME -- can't visit an interface directly
             visit(tmp);
             obj = tmp->to<IR::IInstance>();
             new_node = new IR::GlobalRef(ref->srcInfo, obj->getType(), tmp);
-        } else if (/*auto obj = */global->get<IR::Node>(ref->path->name)) {
+        } else if (index->contains(ref->path->name)) {
             /* FIXME -- is something, should probably be typechecked */
         } else if (getParent<IR::Member>()) {
             if (ref->path->name != "latest")
@@ -119,7 +161,7 @@ class TypeCheck::Pass1 : public Transform {
         return new_node; }
     const IR::Node *postorder(IR::Type_Name *ref) override {
         if (!global) return ref;
-        if (auto t = global->get<IR::Type>(ref->path->name)) {
+        if (auto t = index->type(ref->path->name)) {
             visit(t);
             return t;
         } else {
@@ -166,11 +208,15 @@ static const IR::Type *combine(const Util::SourceInfo &loc, const IR::Type *a, c
 class TypeCheck::Pass2 : public Modifier {
     TypeCheck           &self;
     const IR::V1Program *global = nullptr;
+    const GlobalIndex   *index = nullptr;
     profile_t init_apply(const IR::Node *root) override {
         global = root->to<IR::V1Program>();
+        index = global ? new GlobalIndex(global) : nullptr;
         self.actionArgUseTypes.clear();
         self.iterCounter++;
         return Modifier::init_apply(root); }
+    // types hold no expressions to infer
+    bool preorder(IR::Type *) override { return false; }
     void postorder(IR::Member *) override {}
     void postorder(IR::Operation_Unary *op) override {
         op->type = op->expr->type; }
@@ -186,7 +232,7 @@ class TypeCheck::Pass2 : public Modifier {
     void postorder(IR::Primitive *prim) override {
         if (!global || !findContext<IR::ActionFunction>())
             return;
-        if (auto af = global->get<IR::ActionFunction>(prim->name)) {
+        if (auto af = index->action(prim->name)) {
             auto arg = af->args.begin();
             for (auto op : prim->operands) {
                 if (arg == af->args.end()) {
@@ -210,8 +256,10 @@ class TypeCheck::Pass2 : public Modifier {
 class TypeCheck::Pass3 : public Modifier {
     TypeCheck           &self;
     const IR::V1Program *global = nullptr;
+    const GlobalIndex   *index = nullptr;
     profile_t init_apply(const IR::Node *root) override {
         global = root->to<IR::V1Program>();
+        index = global ? new GlobalIndex(global) : nullptr;
         return Modifier::init_apply(root); }
     const IR::Type *ctxtType() {
         const IR::Type *rv = IR::Type::Unknown::get();
@@ -228,7 +276,7 @@ class TypeCheck::Pass3 : public Modifier {
                 rv = parent->type;
             } else if (!global) {
             } else if (auto prim = parent->to<IR::Primitive>()) {
-                if (auto af = global->get<IR::ActionFunction>(prim->name)) {
+                if (auto af = index->action(prim->name)) {
                     if (size_t(ctxt->child_index) < af->args.size())
                         rv = af->args[ctxt->child_index]->type;
                 } else if (auto infer = prim->inferOperandTypes()) {
@@ -241,6 +289,7 @@ class TypeCheck::Pass3 : public Modifier {
                 } else if (auto infer = prim->inferOperandType(ctxt->child_index)) {
                     rv = infer; } } }
         return rv; }
+    bool preorder(IR::Type *) override { return false; }
     bool preorder(IR::Expression *op) override {
         if (op->type == IR::Type::Unknown::get() || op->type->is<IR::Type_InfInt>()) {
             auto *type = ctxtType();
@@ -252,7 +301,7 @@ class TypeCheck::Pass3 : public Modifier {
         // calls of action functions (it treats all IR::Primitive as primitive calls)
         const Context *ctxt = getContext();
         if (auto *prim = ctxt->node->to<IR::Primitive>()) {
-            if (auto af = global ? global->get<IR::ActionFunction>(prim->name) : nullptr) {
+            if (auto af = global ? index->action(prim->name) : nullptr) {
                 if (size_t(ctxt->child_index) < af->args.size()) {
                     if (af->args[ctxt->child_index]->write) arg->write = true;
                     if (af->args[ctxt->child_index]->read) arg->read = true; }
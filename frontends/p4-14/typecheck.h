@@ -23,6 +23,7 @@ limitations under the License.
 class TypeCheck : public PassManager {
     std::map<const IR::Node *, const IR::Type *>        actionArgUseTypes;
     int                                                 iterCounter = 0;
+    class GlobalIndex;
     class Pass1;
     class Pass2;
     class Pass3;
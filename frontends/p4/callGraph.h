@@ -44,6 +44,10 @@ class CallGraph {
     ordered_map<T, std::vector<T>*> out_edges;  // map caller to list of callees
     ordered_map<T, std::vector<T>*> in_edges;
     ordered_set<T> nodes;    // all nodes; do not modify this directly
+    // Result of the last sort(out) over the whole graph, until the graph changes
+    std::vector<T> sorted;
+    bool sortedCycles = false;
+    bool sortedValid = false;
 
  public:
     typedef typename ordered_map<T, std::vector<T>*>::const_iterator const_iterator;
@@ -60,6 +64,7 @@ class CallGraph {
         out_edges[caller] = new std::vector<T>();
         in_edges[caller] = new std::vector<T>();
         nodes.emplace(caller);
+        sortedValid = false;
     }
     void calls(T caller, T callee) {
         LOG1(name << ": " << cgMakeString(callee) << " is called by " << cgMakeString(caller));
@@ -67,11 +72,26 @@ class CallGraph {
         add(callee);
         out_edges[caller]->push_back(callee);
         in_edges[callee]->push_back(caller);
+        sortedValid = false;
+    }
+    // Removes one edge added by calls(caller, callee); the nodes stay in the graph.
+    void removeCall(T caller, T callee) {
+        LOG1(name << ": " << cgMakeString(callee) << " no longer called by "
+             << cgMakeString(caller));
+        auto out = ::get(out_edges, caller);
+        auto in = ::get(in_edges, callee);
+        BUG_CHECK(out != nullptr && in != nullptr, "%1%: edge not in graph", cgMakeString(caller));
+        auto oe = std::find(out->begin(), out->end(), callee);
+        BUG_CHECK(oe != out->end(), "%1%: edge not in graph", cgMakeString(caller));
+        out->erase(oe);
+        in->erase(std::find(in->begin(), in->end(), caller));
+        sortedValid = false;
     }
     void remove(T node) {
         auto n = nodes.find(node);
         BUG_CHECK(n != nodes.end(), "%1%: Node not in graph", node);
         nodes.erase(n);
+        sortedValid = false;
         auto in = in_edges.find(node);
         if (in != in_edges.end()) {
             // remove all edges pointing to this node
@@ -137,6 +157,30 @@ class CallGraph {
                 work.emplace(c);
         }
     }
+    // out will contain all nodes reachable from start, in reverse postorder:
+    // each node precedes its successors, except along back edges.
+    void reversePostOrder(T start, std::vector<T> &out) const {
+        std::set<T> visited;
+        // depth-first search; each entry is a node and its next successor to visit
+        std::vector<std::pair<T, size_t>> stack;
+        std::vector<T> postorder;
+        visited.emplace(start);
+        stack.emplace_back(start, 0);
+        while (!stack.empty()) {
+            T node = stack.back().first;
+            auto edges = ::get(out_edges, node);
+            size_t index = stack.back().second++;
+            if (edges != nullptr && index < edges->size()) {
+                T next = edges->at(index);
+                if (visited.emplace(next).second)
+                    stack.emplace_back(next, 0);
+                continue;
+            }
+            postorder.push_back(node);
+            stack.pop_back();
+        }
+        out.insert(out.end(), postorder.rbegin(), postorder.rend());
+    }
     // remove all nodes not in 'to'
     void restrict(const std::set<T> &to) {
         std::vector<T> toRemove;
@@ -298,43 +342,75 @@ class CallGraph {
         }
     };
 
-    // helper for scSort
-    bool strongConnect(T node, sccInfo& helper, std::vector<T>& out) {
-        bool loop = false;
+    // Helper for sort: sorts the nodes reachable from 'start',
+    // skipping the ones already in 'out'.
+    template <class C>
+    bool sortFrom(const C &start, std::vector<T> &out) {
+        sccInfo helper;
+        bool cycles = false;
+        auto given = out.size();
+        for (auto n : start) {
+            if (helper.unknown(n) &&
+                std::find(out.begin(), out.begin() + given, n) == out.begin() + given) {
+                bool c = strongConnect(n, helper, out);
+                cycles = cycles || c;
+            }
+        }
+        return cycles;
+    }
 
-        LOG1("scc " << cgMakeString(node));
-        helper.index.emplace(node, helper.crtIndex);
-        helper.setLowLink(node, helper.crtIndex);
-        helper.crtIndex++;
-        helper.push(node);
-        auto oe = out_edges[node];
-        if (oe != nullptr) {
-            for (auto next : *oe) {
+    // Helper for sccSort: visits all nodes reachable from 'root' that have
+    // not been visited yet, and appends their strongly-connected components
+    // to 'out'.  The depth-first search uses an explicit stack, since the
+    // graphs can be deep.  Returns true if a cycle was found.
+    bool strongConnect(T root, sccInfo& helper, std::vector<T>& out) {
+        bool loop = false;
+        // each entry is a node and the index of its next out-edge to follow
+        std::vector<std::pair<T, size_t>> work;
+        auto start = [&](T node) {
+            LOG1("scc " << cgMakeString(node));
+            helper.index.emplace(node, helper.crtIndex);
+            helper.setLowLink(node, helper.crtIndex);
+            helper.crtIndex++;
+            helper.push(node);
+            work.emplace_back(node, 0);
+        };
+
+        start(root);
+        while (!work.empty()) {
+            T node = work.back().first;
+            auto oe = ::get(out_edges, node);
+            size_t edge = work.back().second++;
+            if (oe != nullptr && edge < oe->size()) {
+                T next = oe->at(edge);
                 LOG1(cgMakeString(node) << " => " << cgMakeString(next));
                 if (helper.unknown(next)) {
-                    bool l = strongConnect(next, helper, out);
-                    loop = loop | l;
-                    helper.setLowLink(node, next);
+                    start(next);
                 } else if (helper.isOnStack(next)) {
                     helper.setLowLink(node, next);
                     if (next == node)
                         // the check below does not find self-loops
                         loop = true;
                 }
+                continue;
             }
-        }
 
-        if (get(helper.lowlink, node) == get(helper.index, node)) {
-            LOG1(cgMakeString(node) << " index=" << get(helper.index, node)
-                      << " lowlink=" << get(helper.lowlink, node));
-            while (true) {
-                T sccMember = helper.pop();
-                LOG1("Scc order " << cgMakeString(sccMember) << "[" << cgMakeString(node) << "]");
-                out.push_back(sccMember);
-                if (sccMember == node)
-                    break;
-                loop = true;
+            if (get(helper.lowlink, node) == get(helper.index, node)) {
+                LOG1(cgMakeString(node) << " index=" << get(helper.index, node)
+                          << " lowlink=" << get(helper.lowlink, node));
+                while (true) {
+                    T sccMember = helper.pop();
+                    LOG1("Scc order " << cgMakeString(sccMember) << "["
+                         << cgMakeString(node) << "]");
+                    out.push_back(sccMember);
+                    if (sccMember == node)
+                        break;
+                    loop = true;
+                }
             }
+            work.pop_back();
+            if (!work.empty())
+                helper.setLowLink(work.back().first, node);
         }
 
         return loop;
@@ -349,27 +425,54 @@ class CallGraph {
         sccInfo helper;
         return strongConnect(start, helper, out);
     }
-    bool sort(std::vector<T> &start, std::vector<T> &out) {
-        sccInfo helper;
-        bool cycles = false;
-        for (auto n : start) {
-            if (std::find(out.begin(), out.end(), n) == out.end()) {
-                bool c = strongConnect(n, helper, out);
-                cycles = cycles || c;
-            }
-        }
-        return cycles;
-    }
+    bool sort(std::vector<T> &start, std::vector<T> &out)
+    { return sortFrom(start, out); }
+    // Sorts the whole graph; the result is kept until the graph changes.
     bool sort(std::vector<T> &out) {
-        sccInfo helper;
-        bool cycles = false;
-        for (auto n : nodes) {
-            if (std::find(out.begin(), out.end(), n) == out.end()) {
-                bool c = strongConnect(n, helper, out);
-                cycles = cycles || c;
-            }
+        if (!out.empty())
+            return sortFrom(nodes, out);
+        if (!sortedValid) {
+            sorted.clear();
+            sortedCycles = sortFrom(nodes, sorted);
+            sortedValid = true;
         }
-        return cycles;
+        out = sorted;
+        return sortedCycles;
+    }
+};
+
+/*
+ * Worklist for forward dataflow analyses over a CallGraph, such as
+ * the transitions between the states of a parser.  Nodes are taken out
+ * in reverse postorder from the start node, so a node is normally
+ * processed after all its predecessors, and a loop is iterated again
+ * only when the values flowing into it have changed.
+ */
+template <class T>
+class DataflowWorklist {
+    std::map<T, unsigned> order;  // position in reverse postorder
+    std::map<unsigned, T> pending;
+
+ public:
+    DataflowWorklist(const CallGraph<T> &graph, T start) {
+        std::vector<T> rpo;
+        graph.reversePostOrder(start, rpo);
+        for (auto n : rpo)
+            order.emplace(n, order.size());
+        push(start);
+    }
+    // Adds a node reachable from the start node, if not already pending.
+    void push(T node) {
+        auto it = order.find(node);
+        BUG_CHECK(it != order.end(), "%1%: not reachable", cgMakeString(node));
+        pending.emplace(it->second, node);
+    }
+    bool empty() const { return pending.empty(); }
+    T pop() {
+        auto it = pending.begin();
+        T result = it->second;
+        pending.erase(it);
+        return result;
     }
 };
 
@@ -43,7 +43,7 @@ void CreateBuiltins::postorder(IR::ActionListElement* element) {
     if (element->expression->is<IR::PathExpression>())
         element->expression = new IR::MethodCallExpression(
             element->expression->srcInfo, element->expression,
-            new IR::Vector<IR::Type>(), new IR::Vector<IR::Expression>());
+            IR::Vector<IR::Type>::emptyInstance(), new IR::Vector<IR::Expression>());
 }
 
 void CreateBuiltins::postorder(IR::ExpressionValue* expression) {
@@ -55,7 +55,7 @@ void CreateBuiltins::postorder(IR::ExpressionValue* expression) {
         expression->expression->is<IR::PathExpression>())
         expression->expression = new IR::MethodCallExpression(
             expression->expression->srcInfo, expression->expression,
-            new IR::Vector<IR::Type>(), new IR::Vector<IR::Expression>());
+            IR::Vector<IR::Type>::emptyInstance(), new IR::Vector<IR::Expression>());
 }
 
 void CreateBuiltins::postorder(IR::ParserState* state) {
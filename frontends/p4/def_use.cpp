@@ -15,6 +15,9 @@ limitations under the License.
 */
 
 #include <boost/functional/hash.hpp>
+#ifdef MULTITHREAD
+#include <mutex>
+#endif  // MULTITHREAD
 #include "def_use.h"
 #include "frontends/p4/methodInstance.h"
 #include "frontends/p4/tableApply.h"
@@ -27,7 +30,14 @@ const cstring StorageFactory::validFieldName = "$valid";
 const LocationSet* LocationSet::empty = new LocationSet();
 ProgramPoint ProgramPoint::beforeStart;
 
-StorageLocation* StorageFactory::create(const IR::Type* type, cstring name) const {
+StorageLocation* StorageFactory::number(StorageLocation* location) {
+    location->factory = this;
+    location->id = locations.size();
+    locations.push_back(location);
+    return location;
+}
+
+StorageLocation* StorageFactory::create(const IR::Type* type, cstring name) {
     if (type->is<IR::Type_Bits>() ||
         type->is<IR::Type_Boolean>() ||
         type->is<IR::Type_Varbits>() ||
@@ -39,11 +49,12 @@ StorageLocation* StorageFactory::create(const IR::Type* type, cstring name) cons
         // Similarly for tuples.  This may need to be revisited if we
         // add tuple field accessors.
         type->is<IR::Type_Tuple>())
-        return new BaseLocation(type, name);
+        return number(new BaseLocation(type, name));
     if (type->is<IR::Type_StructLike>()) {
         type = typeMap->getTypeType(type, true);  // get the canonical version
         auto st = type->to<IR::Type_StructLike>();
         auto result = new StructLocation(type, name);
+        number(result);
         for (auto f : *st->fields) {
             auto sl = create(f->type, name + "." + f->name);
             result->addField(f->name, sl);
@@ -58,6 +69,7 @@ StorageLocation* StorageFactory::create(const IR::Type* type, cstring name) cons
         type = typeMap->getTypeType(type, true);  // get the canonical version
         auto st = type->to<IR::Type_Stack>();
         auto result = new ArrayLocation(st, name);
+        number(result);
         for (unsigned i = 0; i < st->getSize(); i++) {
             auto sl = create(st->elementType, name + "[" + Util::toString(i) + "]");
             result->addElement(i, sl);
@@ -119,15 +131,15 @@ const LocationSet* LocationSet::join(const LocationSet* other) const {
         return other;
     if (other == LocationSet::empty)
         return this;
-    auto result = new LocationSet(locations);
-    for (auto e : other->locations)
-        result->add(e);
+    checkFactory(other->factory);
+    auto result = new LocationSet(*this);
+    result->locations |= other->locations;
     return result;
 }
 
 const LocationSet* LocationSet::getField(cstring field) const {
     auto result = new LocationSet();
-    for (auto l : locations) {
+    for (auto l : *this) {
         if (l->is<StructLocation>()) {
             auto strct = l->to<StructLocation>();
             strct->addField(field, result);
@@ -146,7 +158,7 @@ const LocationSet* LocationSet::getValidField() const
 
 const LocationSet* LocationSet::getIndex(unsigned index) const {
     auto result = new LocationSet();
-    for (auto l : locations) {
+    for (auto l : *this) {
         auto array = l->to<ArrayLocation>();
         array->addElement(index, result);
     }
@@ -155,7 +167,7 @@ const LocationSet* LocationSet::getIndex(unsigned index) const {
 
 const LocationSet* LocationSet::allElements() const {
     auto result = new LocationSet();
-    for (auto l : locations) {
+    for (auto l : *this) {
         auto array = l->to<ArrayLocation>();
         for (auto e : *array)
             result->add(e);
@@ -165,7 +177,7 @@ const LocationSet* LocationSet::allElements() const {
 
 const LocationSet* LocationSet::canonicalize() const {
     LocationSet* result = new LocationSet();
-    for (auto e : locations)
+    for (auto e : *this)
         result->addCanonical(e);
     return result;
 }
@@ -185,11 +197,8 @@ void LocationSet::addCanonical(const StorageLocation* location) {
 }
 
 bool LocationSet::overlaps(const LocationSet* other) const {
-    for (auto s : locations) {
-        if (other->locations.find(s) != other->locations.end())
-            return true;
-    }
-    return false;
+    checkFactory(other->factory);
+    return locations.intersects(other->locations);
 }
 
 const ProgramPoints* ProgramPoints::merge(const ProgramPoints* with) const {
@@ -199,25 +208,79 @@ const ProgramPoints* ProgramPoints::merge(const ProgramPoints* with) const {
     return result;
 }
 
-ProgramPoint::ProgramPoint(const ProgramPoint &context, const IR::Node* node) {
-    for (auto e : context.stack)
-        stack.push_back(e);
-    stack.push_back(node);
-}
+namespace {
+// The trie of program point stacks.  Entry 0 is the empty stack.
+class ProgramPointTrie {
+    struct entry_t {
+        unsigned        parent;
+        const IR::Node* node;
+    };
+    std::vector<entry_t> entries;
+    std::unordered_map<std::pair<unsigned, const IR::Node*>, unsigned,
+                       boost::hash<std::pair<unsigned, const IR::Node*>>> index;
 
-bool ProgramPoint::operator==(const ProgramPoint& other) const {
-    if (stack.size() != other.stack.size())
-        return false;
-    for (unsigned i=0; i < stack.size(); i++)
-        if (stack.at(i) != other.stack.at(i))
-            return false;
-    return true;
+ public:
+#ifdef MULTITHREAD
+    std::mutex lock;
+#endif  // MULTITHREAD
+    ProgramPointTrie() { entries.push_back(entry_t{0, nullptr}); }
+    unsigned intern(unsigned parent, const IR::Node* node) {
+        auto rv = index.emplace(std::make_pair(parent, node), entries.size());
+        if (rv.second)
+            entries.push_back(entry_t{parent, node});
+        return rv.first->second;
+    }
+    const entry_t& at(unsigned handle) const { return entries.at(handle); }
+};
+
+ProgramPointTrie& programPoints() {
+    static ProgramPointTrie* trie = new ProgramPointTrie();
+    return *trie;
 }
+}  // namespace
 
-std::size_t ProgramPoint::hash() const {
-    std::size_t result = 0;
-    boost::hash_range(result, stack.begin(), stack.end());
-    return result;
+unsigned ProgramPoint::intern(unsigned parent, const IR::Node* node) {
+    CHECK_NULL(node);
+    auto& trie = programPoints();
+#ifdef MULTITHREAD
+    std::lock_guard<std::mutex> acquire(trie.lock);
+#endif  // MULTITHREAD
+    return trie.intern(parent, node);
+}
+
+const IR::Node* ProgramPoint::last() const {
+    auto& trie = programPoints();
+#ifdef MULTITHREAD
+    std::lock_guard<std::mutex> acquire(trie.lock);
+#endif  // MULTITHREAD
+    return trie.at(handle).node;
+}
+
+void ProgramPoint::dbprint(std::ostream& out) const {
+    if (isBeforeStart()) {
+        out << "<BeforeStart>";
+        return;
+    }
+    std::vector<const IR::Node*> stack;
+    {
+        auto& trie = programPoints();
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> acquire(trie.lock);
+#endif  // MULTITHREAD
+        for (unsigned h = handle; h != 0; h = trie.at(h).parent)
+            stack.push_back(trie.at(h).node);
+    }
+    bool first = true;
+    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+        if (!first)
+            out << "//";
+        out << dbp(*it);
+        first = false;
+    }
+    auto l = stack.front();
+    if (l->is<IR::AssignmentStatement>() ||
+        l->is<IR::MethodCallStatement>())
+        out << "[[" << l << "]]";
 }
 
 bool ProgramPoints::operator==(const ProgramPoints& other) const {
@@ -230,26 +293,18 @@ bool ProgramPoints::operator==(const ProgramPoints& other) const {
 }
 
 Definitions* Definitions::join(const Definitions* other) const {
-    auto result = new Definitions();
-    for (auto d : other->definitions) {
-        auto loc = d.first;
-        auto defs = d.second;
-        auto current = ::get(definitions, loc);
-        if (current != nullptr) {
-            auto merged = current->merge(defs);
-            result->definitions.emplace(loc, merged);
-        } else {
-            result->definitions.emplace(loc, defs);
-        }
-    }
-    for (auto d : definitions) {
-        auto loc = d.first;
-        auto defs = d.second;
-        auto current = ::get(other->definitions, loc);
-        if (current == nullptr)
-            result->definitions.emplace(loc, defs);
-        // otherwise have have already done it in the loop above
-    }
+    auto result = new Definitions(*this);
+    if (other->definitions.size() > result->definitions.size())
+        result->definitions.resize(other->definitions.size());
+    for (auto loc : other->defined) {
+        auto defs = other->definitions[loc->id];
+        auto& current = result->definitions[loc->id];
+        current = current != nullptr ? current->merge(defs) : defs;
+    }
+    result->defined.checkFactory(other->defined.factory);
+    if (result->defined.factory == nullptr)
+        result->defined.factory = other->defined.factory;
+    result->defined.locations |= other->defined.locations;
     return result;
 }
 
@@ -257,22 +312,21 @@ void Definitions::set(const StorageLocation* location, const ProgramPoints* poin
     LocationSet locset;
     locset.addCanonical(location);
     for (auto sl : locset)
-        definitions[sl->to<BaseLocation>()] = point;
+        set(sl->to<BaseLocation>(), point);
 }
 
 void Definitions::set(const LocationSet* locations, const ProgramPoints* point) {
     for (auto sl : *locations->canonicalize())
-        definitions[sl->to<BaseLocation>()] = point;
+        set(sl->to<BaseLocation>(), point);
 }
 
 void Definitions::remove(const StorageLocation* location) {
-    auto loc = new LocationSet();
-    loc->addCanonical(location);
-    for (auto sl : *loc) {
-        auto bl = sl->to<BaseLocation>();
-        auto it = definitions.find(bl);
-        if (it != definitions.end())
-            definitions.erase(it);
+    LocationSet loc;
+    loc.addCanonical(location);
+    for (auto sl : loc) {
+        if (sl->id < definitions.size())
+            definitions[sl->id] = nullptr;
+        defined.remove(sl);
     }
 }
 
@@ -296,13 +350,11 @@ Definitions* Definitions::writes(ProgramPoint point, const LocationSet* location
 }
 
 bool Definitions::operator==(const Definitions& other) const {
-    if (definitions.size() != other.definitions.size())
+    if (defined.locations != other.defined.locations)
         return false;
-    for (auto d : definitions) {
-        auto od = ::get(other.definitions, d.first);
-        if (od == nullptr)
-            return false;
-        if (!d.second->operator==(*od))
+    for (auto d : defined) {
+        auto od = other.definitions[d->id];
+        if (od != definitions[d->id] && !definitions[d->id]->operator==(*od))
             return false;
     }
     return true;
@@ -653,12 +705,10 @@ bool ComputeWriteSet::preorder(const IR::P4Parser* parser) {
     ComputeParserCG pcg(storageMap->refMap, &transitions);
 
     (void)parser->apply(pcg);
-    std::set<const IR::ParserState*> toRun;  // worklist
-    toRun.emplace(startState);
+    DataflowWorklist<const IR::ParserState*> toRun(transitions, startState);
 
     while (!toRun.empty()) {
-        auto state = *toRun.begin();
-        toRun.erase(state);
+        auto state = toRun.pop();
         LOG1("Traversing " << dbp(state));
 
         // We need a new visitor to visit the state,
@@ -678,7 +728,7 @@ bool ComputeWriteSet::preorder(const IR::P4Parser* parser) {
             if (!(*defs == *newdefs)) {
                 // Only run once more if there are any changes
                 setDefinitions(newdefs, n);
-                toRun.emplace(n);
+                toRun.push(n);
             }
         }
     }
@@ -18,6 +18,7 @@ limitations under the License.
 #define _FRONTENDS_P4_DEF_USE_H_
 
 #include "ir/ir.h"
+#include "lib/bitvec.h"
 #include "frontends/p4/typeChecking/typeChecker.h"
 
 namespace P4 {
@@ -31,7 +32,12 @@ class StorageLocation : public IHasDbPrint {
     virtual ~StorageLocation() {}
     const IR::Type* type;
     const cstring name;
-    StorageLocation(const IR::Type* type, cstring name) : type(type), name(name)
+    // Set by the StorageFactory which creates the location:
+    // locations created by a factory are numbered densely from 0.
+    const StorageFactory* factory;
+    unsigned id;
+    StorageLocation(const IR::Type* type, cstring name) :
+            type(type), name(name), factory(nullptr), id(0)
     { CHECK_NULL(type); }
     template <class T>
     const T* to() const {
@@ -123,42 +129,79 @@ class ArrayLocation : public StorageLocation {
 
 class StorageFactory {
     TypeMap* typeMap;
+    // all locations created, indexed by id
+    std::vector<const StorageLocation*> locations;
+
+    StorageLocation* number(StorageLocation* location);
+
  public:
     explicit StorageFactory(TypeMap* typeMap) : typeMap(typeMap)
     { CHECK_NULL(typeMap); }
-    StorageLocation* create(const IR::Type* type, cstring name) const;
+    StorageFactory(const StorageFactory&) = delete;
+    StorageLocation* create(const IR::Type* type, cstring name);
+    const StorageLocation* get(unsigned id) const { return locations.at(id); }
+    size_t size() const { return locations.size(); }
 
     static const cstring validFieldName;
 };
 
 // A set of locations that may be read or written by a computation.
 // In general this is a conservative approximation of the actual location set.
+// Represented as a bit vector of location ids, so set operations are word-parallel;
+// all locations in a set must come from the same StorageFactory.
 class LocationSet : public IHasDbPrint {
-    std::set<const StorageLocation*> locations;
+    const StorageFactory* factory;  // nullptr while the set is empty
+    bitvec locations;
+
+    friend class Definitions;
+
+    void checkFactory(const StorageFactory* other) const
+    { BUG_CHECK(factory == nullptr || other == nullptr || factory == other,
+                "Joining locations from different storage maps"); }
 
  public:
-    LocationSet() = default;
-    explicit LocationSet(const std::set<const StorageLocation*> &other) : locations(other) {}
-    explicit LocationSet(const StorageLocation* location) { locations.emplace(location); }
+    // Iterates over the locations in order of their ids.
+    class const_iterator {
+        const StorageFactory* factory;
+        bitvec::const_iterator it;
+        friend class LocationSet;
+        const_iterator(const StorageFactory* factory, bitvec::const_iterator it) :
+                factory(factory), it(it) {}
+
+     public:
+        const StorageLocation* operator*() const { return factory->get(*it); }
+        const_iterator& operator++() { ++it; return *this; }
+        bool operator!=(const const_iterator& other) const { return it != other.it; }
+        bool operator==(const const_iterator& other) const { return it == other.it; }
+    };
+
+    LocationSet() : factory(nullptr) {}
+    explicit LocationSet(const StorageLocation* location) : factory(nullptr) { add(location); }
     static const LocationSet* empty;
 
     const LocationSet* getField(cstring field) const;
     const LocationSet* getValidField() const;
     const LocationSet* getIndex(unsigned index) const;
     const LocationSet* allElements() const;
-    void add(const StorageLocation* location)
-    { locations.emplace(location); }
+    void add(const StorageLocation* location) {
+        CHECK_NULL(location->factory);
+        checkFactory(location->factory);
+        factory = location->factory;
+        locations.setbit(location->id); }
+    void remove(const StorageLocation* location) {
+        if (location->factory == factory)
+            locations.clrbit(location->id); }
     const LocationSet* join(const LocationSet* other) const;
     // express this location set only in terms of BaseLocation;
     // e.g., a StructLocation is expanded in all its fields.
     const LocationSet* canonicalize() const;
     void addCanonical(const StorageLocation* location);
-    std::set<const StorageLocation*>::const_iterator begin() const { return locations.cbegin(); }
-    std::set<const StorageLocation*>::const_iterator end()   const { return locations.cend(); }
+    const_iterator begin() const { return const_iterator(factory, locations.begin()); }
+    const_iterator end()   const { return const_iterator(factory, locations.end()); }
     virtual void dbprint(std::ostream& out) const {
         if (locations.empty())
             out << "LocationSet::empty";
-        for (auto l : locations) {
+        for (auto l : *this) {
             l->dbprint(out);
             out << " ";
         }
@@ -166,6 +209,7 @@ class LocationSet : public IHasDbPrint {
     // only defined for canonical representations
     bool overlaps(const LocationSet* other) const;
     bool isEmpty() const { return locations.empty(); }
+    size_t size() const { return locations.popcount(); }
 };
 
 // For each declaration we keep the associated storage
@@ -204,39 +248,28 @@ class StorageMap {
 // Indicates a statement in the program.
 // The stack is for representing calls: i.e.,
 // table.apply() -> table -> action
+// Stacks are interned in a trie of (parent, node) pairs shared by all
+// program points, so a ProgramPoint is a single index, and copying,
+// hashing and comparing program points is constant time.
 class ProgramPoint : public IHasDbPrint {
-    // empty stack represents "beforeStart" (see below)
-    std::vector<const IR::Node*> stack;
+    // 0 is the empty stack, which represents "beforeStart" (see below)
+    unsigned handle;
+    static unsigned intern(unsigned parent, const IR::Node* node);
 
  public:
-    ProgramPoint() = default;
-    ProgramPoint(const ProgramPoint& other) : stack(other.stack) {}
-    explicit ProgramPoint(const IR::Node* node) { stack.push_back(node); }
-    ProgramPoint(const ProgramPoint& context, const IR::Node* node);
+    ProgramPoint() : handle(0) {}
+    ProgramPoint(const ProgramPoint& other) = default;
+    ProgramPoint& operator=(const ProgramPoint& other) = default;
+    explicit ProgramPoint(const IR::Node* node) : handle(intern(0, node)) {}
+    ProgramPoint(const ProgramPoint& context, const IR::Node* node) :
+            handle(intern(context.handle, node)) {}
     static ProgramPoint beforeStart;  // a point logically before the program start
-    bool operator==(const ProgramPoint& other) const;
-    std::size_t hash() const;
-    void dbprint(std::ostream& out) const {
-        if (isBeforeStart()) {
-            out << "<BeforeStart>";
-        } else {
-            bool first = true;
-            for (auto n : stack) {
-                if (!first)
-                    out << "//";
-                out << dbp(n);
-                first = false;
-            }
-            auto l = stack.back();
-            if (l->is<IR::AssignmentStatement>() ||
-                l->is<IR::MethodCallStatement>())
-                out << "[[" << l << "]]";
-        }
-    }
-    const IR::Node* last() const
-    { return stack.empty() ? nullptr : stack.back(); }
+    bool operator==(const ProgramPoint& other) const { return handle == other.handle; }
+    std::size_t hash() const { return handle; }
+    void dbprint(std::ostream& out) const;
+    const IR::Node* last() const;
     bool isBeforeStart() const
-    { return stack.empty(); }
+    { return handle == 0; }
 };
 }  // namespace P4
 
@@ -280,39 +313,46 @@ class ProgramPoints : public IHasDbPrint {
 // List of definers for each base storage (at a specific program point)
 class Definitions : public IHasDbPrint {
     // which program points have written last to each location
-    // (conservative approximation)
-    std::map<const BaseLocation*, const ProgramPoints*> definitions;
+    // (conservative approximation); indexed by location id, and
+    // nullptr for locations which have no definitions.
+    std::vector<const ProgramPoints*> definitions;
+    // locations which have definitions
+    LocationSet defined;
 
  public:
     Definitions() = default;
-    Definitions(const Definitions& other) : definitions(other.definitions) {}
+    Definitions(const Definitions& other) = default;
     Definitions* join(const Definitions* other) const;
     // point writes the specified LocationSet
     Definitions* writes(ProgramPoint point, const LocationSet* locations) const;
-    void set(const BaseLocation* loc, const ProgramPoints* point)
-    { CHECK_NULL(loc); CHECK_NULL(point); definitions[loc] = point; }
+    void set(const BaseLocation* loc, const ProgramPoints* point) {
+        CHECK_NULL(loc); CHECK_NULL(point);
+        if (loc->id >= definitions.size())
+            definitions.resize(loc->id + 1);
+        definitions[loc->id] = point;
+        defined.add(loc); }
     void set(const StorageLocation* loc, const ProgramPoints* point);
     void set(const LocationSet* loc, const ProgramPoints* point);
     const ProgramPoints* get(const BaseLocation* location) const {
-        auto r = ::get(definitions, location);
+        auto r = location->id < definitions.size() ? definitions[location->id] : nullptr;
         BUG_CHECK(r != nullptr, "%1%: no definitions", location);
         return r; }
     const ProgramPoints* get(const LocationSet* locations) const;
     bool operator==(const Definitions& other) const;
     void dbprint(std::ostream& out) const {
-        if (definitions.empty())
+        if (defined.isEmpty())
             out << "  Empty definitions";
         bool first = true;
-        for (auto d : definitions) {
+        for (auto d : defined) {
             if (!first)
                 out << std::endl;
-            out << "  " << *d.first << "=>" << *d.second;
+            out << "  " << *d << "=>" << *definitions[d->id];
             first = false;
         }
     }
     Definitions* clone() const { return new Definitions(*this); }
     void remove(const StorageLocation* loc);
-    bool empty() const { return definitions.empty(); }
+    bool empty() const { return defined.isEmpty(); }
 };
 
 class AllDefinitions : public IHasDbPrint {
@@ -20,6 +20,54 @@ limitations under the License.
 
 namespace P4 {
 
+namespace {
+
+// True if the two programs have the same top-level declarations, except for the
+// controls, parsers and instances; everything else a block depends on (types,
+// constants folded into the arguments) is among those.
+bool sameEnvironment(const IR::P4Program* before, const IR::P4Program* after) {
+    auto inEnvironment = [](const IR::Node* node) {
+        return !node->is<IR::P4Control>() && !node->is<IR::P4Parser>() &&
+                !node->is<IR::Declaration_Instance>(); };
+    std::set<const IR::Node*> environment;
+    for (auto d : *before->declarations)
+        if (inEnvironment(d))
+            environment.emplace(d);
+    for (auto d : *after->declarations)
+        if (inEnvironment(d) && environment.erase(d) == 0)
+            return false;
+    return environment.empty();
+}
+
+bool sameValue(const IR::CompileTimeValue* left, const IR::CompileTimeValue* right) {
+    if (left == right)
+        return true;
+    if (left == nullptr || right == nullptr)
+        return false;
+    if (left->is<IR::Constant>() && right->is<IR::Constant>()) {
+        auto lc = left->to<IR::Constant>(), rc = right->to<IR::Constant>();
+        return lc->value == rc->value && TypeMap::equivalent(lc->type, rc->type);
+    }
+    if (left->is<IR::BoolLiteral>() && right->is<IR::BoolLiteral>())
+        return left->to<IR::BoolLiteral>()->value == right->to<IR::BoolLiteral>()->value;
+    return false;
+}
+
+// The declaration of the type of the instance a block represents
+const IR::Node* blockDeclaration(const IR::InstantiatedBlock* block) {
+    if (block->is<IR::ControlBlock>())
+        return block->to<IR::ControlBlock>()->container;
+    if (block->is<IR::ParserBlock>())
+        return block->to<IR::ParserBlock>()->container;
+    if (block->is<IR::PackageBlock>())
+        return block->to<IR::PackageBlock>()->type;
+    if (block->is<IR::ExternBlock>())
+        return block->to<IR::ExternBlock>()->type;
+    return nullptr;
+}
+
+}  // namespace
+
 Visitor::profile_t Evaluator::init_apply(const IR::Node* node) {
     BUG_CHECK(node->is<IR::P4Program>(),
               "Evaluation should be invoked on a program, not a %1%", node);
@@ -63,10 +111,70 @@ const IR::CompileTimeValue* Evaluator::getValue(const IR::Node* node) const {
     return result;
 }
 
+void Evaluator::indexBlocks(const IR::Block* block) {
+    for (auto it : block->constantValue) {
+        auto nested = it.second->to<IR::InstantiatedBlock>();
+        // skip the blocks that are only the values of parameters
+        if (nested == nullptr || nested->node != it.first)
+            continue;
+        previous.emplace(it.first, nested);
+        indexBlocks(nested);
+    }
+}
+
+// True if evaluating the node of 'block' again, with the same arguments, would
+// give the same block: the declaration and the type of the instance, and those of
+// all the instances inside it, are unchanged.
+bool Evaluator::unchanged(const IR::InstantiatedBlock* block, const IR::IDeclaration* decl,
+                          const IR::Type* instanceType) const {
+    if (blockDeclaration(block) != decl->getNode() ||
+        !TypeMap::equivalent(block->instanceType, instanceType))
+        return false;
+    for (auto it : block->constantValue) {
+        auto nested = it.second->to<IR::InstantiatedBlock>();
+        if (nested == nullptr || nested->node != it.first)
+            continue;
+        auto type = it.first->is<IR::Declaration_Instance>() ?
+                it.first->to<IR::Declaration_Instance>()->type :
+                it.first->to<IR::ConstructorCallExpression>()->constructedType;
+        if (!unchanged(nested, getDeclaration(type), typeMap->getType(it.first)))
+            return false;
+    }
+    return true;
+}
+
+const IR::Block* Evaluator::reuse(const IR::Node* node, const IR::IDeclaration* decl,
+                                  const IR::Type* instanceType,
+                                  const std::vector<const IR::CompileTimeValue*>* values) const {
+    auto it = previous.find(node);
+    if (it == previous.end())
+        return nullptr;
+    auto block = it->second;
+    auto params = block->getConstructorParameters();
+    if (params->size() != values->size())
+        return nullptr;
+    auto value = values->begin();
+    for (auto p : *params->getEnumerator())
+        if (!sameValue(block->getValue(p), *value++))
+            return nullptr;
+    if (!unchanged(block, decl, instanceType))
+        return nullptr;
+    LOG1("Reusing " << block << " for " << node);
+    Visitor::profile_t::count("blocks reused", 1);
+    return block;
+}
+
 ////////////////////////////// visitor methods ////////////////////////////////////
 
 bool Evaluator::preorder(const IR::P4Program* program) {
     LOG1("Evaluating " << program);
+    if (isUpToDate(program)) {
+        LOG1("Program unchanged since it was last evaluated");
+        return false;
+    }
+    previous.clear();
+    if (toplevelBlock != nullptr && sameEnvironment(toplevelBlock->getProgram(), program))
+        indexBlocks(toplevelBlock);
     toplevelBlock = new IR::ToplevelBlock(program->srcInfo, program);
 
     pushBlock(toplevelBlock);
@@ -77,6 +185,7 @@ bool Evaluator::preorder(const IR::P4Program* program) {
         visit(d);
     }
     popBlock(toplevelBlock);
+    previous.clear();
     std::stringstream str;
     toplevelBlock->dbprint_recursive(str);
     LOG1(str.str());
@@ -114,6 +223,17 @@ Evaluator::evaluateArguments(const IR::Vector<IR::Expression>* arguments, IR::Bl
     return values;
 }
 
+const IR::IDeclaration* Evaluator::getDeclaration(const IR::Type* type) const {
+    if (type->is<IR::Type_Specialized>())
+        type = type->to<IR::Type_Specialized>()->baseType;
+    if (type->is<IR::Type_Name>()) {
+        auto tn = type->to<IR::Type_Name>();
+        return refMap->getDeclaration(tn->path, true);
+    }
+    BUG_CHECK(type->is<IR::IDeclaration>(), "%1%: expected a type declaration", type);
+    return type->to<IR::IDeclaration>();
+}
+
 const IR::Block*
 Evaluator::processConstructor(
     const IR::Node* node,  // Node that invokes constructor:
@@ -122,18 +242,15 @@ Evaluator::processConstructor(
     const IR::Type* instanceType,  // Actual canonical type of generated instance.
     const IR::Vector<IR::Expression>* arguments) {  // Constructor arguments
     LOG1("Evaluating constructor " << type);
-    if (type->is<IR::Type_Specialized>())
-        type = type->to<IR::Type_Specialized>()->baseType;
-    const IR::IDeclaration* decl;
-    if (type->is<IR::Type_Name>()) {
-        auto tn = type->to<IR::Type_Name>();
-        decl = refMap->getDeclaration(tn->path, true);
-    } else {
-        BUG_CHECK(type->is<IR::IDeclaration>(), "%1%: expected a type declaration", type);
-        decl = type->to<IR::IDeclaration>();
-    }
+    auto decl = getDeclaration(type);
 
     auto current = currentBlock();
+    auto values = evaluateArguments(arguments, current);
+    if (values != nullptr) {
+        if (auto block = reuse(node, decl, instanceType, values))
+            return block;
+    }
+
     if (decl->is<IR::Type_Extern>()) {
         auto exttype = decl->to<IR::Type_Extern>();
         // We lookup the method in the instanceType, because it may contain compiler-synthesized
@@ -148,17 +265,13 @@ Evaluator::processConstructor(
                   "Type %1% has no constructor with %2% arguments",
                   exttype, arguments->size());
         auto block = new IR::ExternBlock(node->srcInfo, node, instanceType, exttype, constructor);
-        pushBlock(block);
-        auto values = evaluateArguments(arguments, current);
         if (values != nullptr)
             block->instantiate(values);
-        popBlock(block);
         return block;
     } else if (decl->is<IR::P4Control>()) {
         auto cont = decl->to<IR::P4Control>();
         auto block = new IR::ControlBlock(node->srcInfo, node, instanceType, cont);
         pushBlock(block);
-        auto values = evaluateArguments(arguments, current);
         if (values != nullptr) {
             block->instantiate(values);
             for (auto a : *cont->controlLocals)
@@ -170,7 +283,6 @@ Evaluator::processConstructor(
         auto cont = decl->to<IR::P4Parser>();
         auto block = new IR::ParserBlock(node->srcInfo, node, instanceType, cont);
         pushBlock(block);
-        auto values = evaluateArguments(arguments, current);
         if (values != nullptr) {
             block->instantiate(values);
             for (auto a : *cont->parserLocals)
@@ -183,11 +295,8 @@ Evaluator::processConstructor(
     } else if (decl->is<IR::Type_Package>()) {
         auto block = new IR::PackageBlock(node->srcInfo, node, instanceType,
                                           decl->to<IR::Type_Package>());
-        pushBlock(block);
-        auto values = evaluateArguments(arguments, current);
         if (values != nullptr)
             block->instantiate(values);
-        popBlock(block);
         return block;
     }
 
@@ -33,6 +33,17 @@ class Evaluator final : public Inspector, public IHasBlock {
     const TypeMap*           typeMap;
     std::vector<IR::Block*>  blockStack;
     IR::ToplevelBlock*       toplevelBlock;
+    // Blocks of the previous evaluation, by the node that instantiated them;
+    // a block is reused if the node, its declaration and its arguments have not changed.
+    std::map<const IR::Node*, const IR::InstantiatedBlock*> previous;
+
+    void indexBlocks(const IR::Block* block);
+    const IR::IDeclaration* getDeclaration(const IR::Type* type) const;
+    bool unchanged(const IR::InstantiatedBlock* block, const IR::IDeclaration* decl,
+                   const IR::Type* instanceType) const;
+    const IR::Block* reuse(const IR::Node* node, const IR::IDeclaration* decl,
+                           const IR::Type* instanceType,
+                           const std::vector<const IR::CompileTimeValue*>* values) const;
 
  protected:
     void pushBlock(IR::Block* block);
@@ -43,6 +54,10 @@ class Evaluator final : public Inspector, public IHasBlock {
             refMap(refMap), typeMap(typeMap), toplevelBlock(nullptr)
     { CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("Evaluator"); }
     IR::ToplevelBlock* getToplevelBlock() override { return toplevelBlock; }
+    // True if the blocks are those of 'program', i.e., it has not changed since it
+    // was evaluated.
+    bool isUpToDate(const IR::P4Program* program) const
+    { return toplevelBlock != nullptr && toplevelBlock->getProgram() == program; }
 
     IR::Block* currentBlock() const;
     void setValue(const IR::Node* node, const IR::CompileTimeValue* constant);
@@ -75,11 +90,14 @@ class Evaluator final : public Inspector, public IHasBlock {
                                         const IR::Vector<IR::Expression>* arguments);
 };
 
-// A pass which "evaluates" the program
+// A pass which "evaluates" the program.  Running the same pass again only
+// builds the blocks of the parts of the program that have changed since.
 class EvaluatorPass final : public PassManager, public IHasBlock {
     P4::Evaluator* evaluator;
  public:
     IR::ToplevelBlock* getToplevelBlock() override { return evaluator->getToplevelBlock(); }
+    bool isUpToDate(const IR::P4Program* program) const
+    { return evaluator->isUpToDate(program); }
     EvaluatorPass(ReferenceMap* refMap, TypeMap* typeMap);
 };
 
@@ -56,8 +56,8 @@ const IR::Node* ExpressionConverter::postorder(IR::Constant* expression) {
     // The P4-14 front-end may have constants that overflow their declared type,
     // since the v1 type inference sets types to constants without any checks.
     // We fix this here.
-    return new IR::Constant(expression->srcInfo, expression->type,
-                            expression->value, expression->base);
+    return structure->nodes.constant(expression->srcInfo, expression->type,
+                                     expression->value, expression->base);
 }
 
 const IR::Node* ExpressionConverter::postorder(IR::FieldList* fl) {
@@ -112,7 +112,7 @@ const IR::Node* ExpressionConverter::postorder(IR::Primitive* primitive) {
         auto base = primitive->operands.at(0);
         auto method = new IR::Member(primitive->srcInfo, base, IR::ID(IR::Type_Header::isValid));
         auto result = new IR::MethodCallExpression(
-            primitive->srcInfo, method, new IR::Vector<IR::Type>(),
+            primitive->srcInfo, method, IR::Vector<IR::Type>::emptyInstance(),
             new IR::Vector<IR::Expression>());
         return result;
     }
@@ -253,8 +253,8 @@ const IR::Node* StatementConverter::preorder(IR::Primitive* primitive) {
         auto stat = new IR::MethodCallStatement(primitive->srcInfo, call);
         return stat;
     }
-    // FIXME -- always a noop as ExpressionConverter has only postorder methods?
-    return ExpressionConverter::preorder(primitive);
+    // ExpressionConverter has only postorder methods, so there is nothing to call
+    return primitive;
 }
 
 const IR::Node* StatementConverter::preorder(IR::If* cond) {
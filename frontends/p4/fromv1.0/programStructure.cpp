@@ -1499,20 +1499,15 @@ ProgramStructure::convertControl(const IR::V1Control* control, cstring newName)
     std::set<cstring> countersToDo;
     for (auto a : actionsToDo)
         calledCounters.getCallees(a, countersToDo);
-    for (auto c : counters) {
-        if (c.first->direct) {
-            if (c.first->table.name.isNullOrEmpty()) {
-                ::error("%1%: Direct counter with no table", c.first);
-                return nullptr;
-            }
-            auto tbl = tables.get(c.first->table.name);
-            if (tbl == nullptr) {
-                ::error("Cannot locate table %1%", c.first->table.name);
-                return nullptr;
-            }
-            if (std::find(usedTables.begin(), usedTables.end(), tbl) != usedTables.end())
-                directCounters.emplace(c.first->table.name, c.first->name);
-        }
+    std::vector<const IR::Meter*> directMetersToDo;
+    for (auto t : usedTables) {
+        auto ctrs = tableCounters.find(t->name.name);
+        if (ctrs != tableCounters.end())
+            directCounters.emplace(t->name.name, ctrs->second.front()->name);
+        auto mtrs = tableMeters.find(t->name.name);
+        if (mtrs != tableMeters.end())
+            directMetersToDo.insert(directMetersToDo.end(),
+                                    mtrs->second.begin(), mtrs->second.end());
     }
     for (auto c : countersToDo) {
         auto ctr = counters.get(c);
@@ -1520,26 +1515,16 @@ ProgramStructure::convertControl(const IR::V1Control* control, cstring newName)
         stateful->push_back(counter);
     }
 
-    for (auto m : meters) {
-        if (m.first->direct) {
-            if (m.first->table.name.isNullOrEmpty()) {
-                ::error("%1%: Direct meter with no table", m.first);
-                return nullptr;
-            }
-            auto tbl = tables.get(m.first->table.name);
-            if (tbl == nullptr) {
-                ::error("Cannot locate table %1%", m.first->table.name);
-                return nullptr;
-            }
-            if (std::find(usedTables.begin(), usedTables.end(), tbl) != usedTables.end()) {
-                auto meter = meters.get(m.second);
-                auto extmeter = convertDirectMeter(meter, m.second);
-                if (extmeter != nullptr) {
-                    stateful->push_back(extmeter);
-                    directMeters.emplace(m.first->table.name, meter);
-                    meterMap.emplace(meter, extmeter);
-                }
-            }
+    // in the order of their names, as for all the other declarations
+    std::sort(directMetersToDo.begin(), directMetersToDo.end(),
+              [](const IR::Meter* left, const IR::Meter* right) {
+                  return left->name.name < right->name.name; });
+    for (auto meter : directMetersToDo) {
+        auto extmeter = convertDirectMeter(meter, meters.get(meter));
+        if (extmeter != nullptr) {
+            stateful->push_back(extmeter);
+            directMeters.emplace(meter->table.name, meter);
+            meterMap.emplace(meter, extmeter);
         }
     }
 
@@ -1621,7 +1606,48 @@ ProgramStructure::convertControl(const IR::V1Control* control, cstring newName)
     return result;
 }
 
+void ProgramStructure::indexTables() {
+    for (auto it : tableMapping)
+        controlTables[it.second].push_back(it.first);
+    // sort alphabetically to have a deterministic order
+    for (auto &it : controlTables)
+        std::sort(it.second.begin(), it.second.end(),
+                  [](const IR::V1Table* left, const IR::V1Table* right) {
+                      return left->name.name < right->name.name; });
+
+    for (auto c : counters) {
+        if (!c.first->direct)
+            continue;
+        if (c.first->table.name.isNullOrEmpty()) {
+            ::error("%1%: Direct counter with no table", c.first);
+            continue;
+        }
+        if (tables.get(c.first->table.name) == nullptr) {
+            ::error("Cannot locate table %1%", c.first->table.name);
+            continue;
+        }
+        tableCounters[c.first->table.name].push_back(c.first);
+    }
+    for (auto m : meters) {
+        if (!m.first->direct)
+            continue;
+        if (m.first->table.name.isNullOrEmpty()) {
+            ::error("%1%: Direct meter with no table", m.first);
+            continue;
+        }
+        if (tables.get(m.first->table.name) == nullptr) {
+            ::error("Cannot locate table %1%", m.first->table.name);
+            continue;
+        }
+        tableMeters[m.first->table.name].push_back(m.first);
+    }
+}
+
 void ProgramStructure::createControls() {
+    indexTables();
+    if (::errorCount())
+        return;
+
     std::vector<cstring> controlsToDo;
     std::vector<cstring> knownControls;
 
@@ -1947,14 +1973,9 @@ void
 ProgramStructure::tablesReferred(const IR::V1Control* control,
                                  std::vector<const IR::V1Table*> &out) {
     LOG1("Inspecting " << control->name);
-    for (auto it : tableMapping) {
-        if (it.second == control)
-            out.push_back(it.first);
-    }
-    // sort alphabetically to have a deterministic order
-    std::sort(out.begin(), out.end(),
-              [](const IR::V1Table* left, const IR::V1Table* right) {
-                  return left->name.name < right->name.name; });
+    auto it = controlTables.find(control);
+    if (it != controlTables.end())
+        out.insert(out.end(), it->second.begin(), it->second.end());
 }
 
 }  // namespace P4V1
@@ -18,12 +18,14 @@ limitations under the License.
 #define _FRONTENDS_P4_FROMV1_0_PROGRAMSTRUCTURE_H_
 
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "lib/map.h"
 #include "lib/cstring.h"
 #include "frontends/p4/coreLibrary.h"
 #include "ir/ir.h"
+#include "ir/node_factory.h"
 #include "frontends/p4/callGraph.h"
 #include "v1model.h"
 
@@ -38,17 +40,19 @@ class ProgramStructure {
     class NamedObjectInfo {
         // If allNames is nullptr we don't check for duplicate names
         std::unordered_set<cstring> *allNames;
+        // ordered for iteration; the lookups go through the hash tables
         std::map<cstring, T> nameToObject;
-        std::map<T, cstring> objectToNewName;
+        std::unordered_map<cstring, T> nameIndex;
+        std::unordered_map<T, cstring> objectToNewName;
 
         // Iterate in order of name, but return pair<T, newname>
         class iterator {
             friend class NamedObjectInfo;
          private:
             typename std::map<cstring, T>::iterator it;
-            typename std::map<T, cstring> &objToName;
+            typename std::unordered_map<T, cstring> &objToName;
             iterator(typename std::map<cstring, T>::iterator it,
-                     typename std::map<T, cstring> &objToName) :
+                     typename std::unordered_map<T, cstring> &objToName) :
                     it(it), objToName(objToName) {}
          public:
             const iterator& operator++() { ++it; return *this; }
@@ -67,6 +71,7 @@ class ProgramStructure {
 
             LOG1("Discovered " << obj);
             nameToObject.emplace(obj->name, obj);
+            nameIndex.emplace(obj->name, obj);
             cstring newName;
 
             if (allNames == nullptr ||
@@ -82,10 +87,10 @@ class ProgramStructure {
             objectToNewName.emplace(obj, newName);
         }
         // Lookup using the original name
-        T get(cstring name) const { return ::get(nameToObject, name); }
+        T get(cstring name) const { return ::get(nameIndex, name); }
         // Get the new name
         cstring get(T object) const { return ::get(objectToNewName, object); }
-        bool contains(cstring name) const { return nameToObject.find(name) != nameToObject.end(); }
+        bool contains(cstring name) const { return nameIndex.find(name) != nameIndex.end(); }
         iterator begin() { return iterator(nameToObject.begin(), objectToNewName); }
         iterator end() { return iterator(nameToObject.end(), objectToNewName); }
     };
@@ -130,6 +135,13 @@ class ProgramStructure {
 
     std::map<const IR::V1Table*, const IR::V1Control*> tableMapping;
     std::map<const IR::V1Table*, const IR::Apply*> tableInvocation;
+    // Built by indexTables from the maps above and the declarations, so that each
+    // control looks up what it needs instead of scanning all the tables, counters
+    // and meters of the program: the tables each control applies, sorted by name,
+    // and the direct counters and meters of each table, in the order of their names
+    std::unordered_map<const IR::V1Control*, std::vector<const IR::V1Table*>> controlTables;
+    std::unordered_map<cstring, std::vector<const IR::Counter*>> tableCounters;
+    std::unordered_map<cstring, std::vector<const IR::Meter*>> tableMeters;
 
     struct ConversionContext {
         const IR::Expression* header;
@@ -144,6 +156,8 @@ class ProgramStructure {
 
     ConversionContext conversionContext;
     IR::Vector<IR::Type>* emptyTypeArguments;
+    // shares identical typed constants in the converted program
+    IR::NodeFactory nodes;
     const IR::Parameter* parserPacketIn;
     const IR::Parameter* parserHeadersOut;
 
@@ -185,6 +199,7 @@ class ProgramStructure {
     void createExterns();
     void createTypes();
     void createParser();
+    void indexTables();
     void createControls();
     void createDeparser();
     void createMain();
@@ -39,6 +39,7 @@ limitations under the License.
 #include "resetHeaders.h"
 #include "uniqueNames.h"
 #include "moveDeclarations.h"
+#include "normalizeDeclarations.h"
 #include "sideEffects.h"
 #include "simplifyDefUse.h"
 #include "simplifyParsers.h"
@@ -84,6 +85,8 @@ FrontEnd::run(const CompilerOptions &options, const IR::P4Program* program) {
     ReferenceMap  refMap;
     TypeMap       typeMap;
     refMap.setIsV1(isv1);
+    auto typeInference = new TypeInference(&refMap, &typeMap);
+    typeInference->threads = options.typeCheckThreads;
 
     PassManager passes = {
         new PrettyPrint(options),
@@ -98,23 +101,22 @@ FrontEnd::run(const CompilerOptions &options, const IR::P4Program* program) {
         // Type checking and type inference.  Also inserts
         // explicit casts where implicit casts exist.
         new ResolveReferences(&refMap),
-        new TypeInference(&refMap, &typeMap),
+        typeInference,
         new BindTypeVariables(&typeMap),
         // Another round of constant folding, using type information.
         new ClearTypeMap(&typeMap),
-        new ConstantFolding(&refMap, &typeMap),
-        new StrengthReduction(),
-        new SimplifyControlFlow(&refMap, &typeMap),
+        new SimplifyAll(&refMap, &typeMap),
         new RemoveAllUnusedDeclarations(&refMap),
         new SimplifyParsers(&refMap),
         new ResetHeaders(&refMap, &typeMap),
-        new UniqueNames(&refMap),  // Give each local declaration a unique internal name
-        new MoveDeclarations(),  // Move all local declarations to the beginning
-        new MoveInitializers(),
+        // Give each local declaration a unique internal name, and move all local
+        // declarations to the beginning, in one pass
+        new NormalizeDeclarations(&refMap),
         new SideEffectOrdering(&refMap, &typeMap),
         new SimplifyControlFlow(&refMap, &typeMap),
         new MoveDeclarations(),  // Move all local declarations to the beginning
-        new SimplifyDefUse(&refMap, &typeMap),
+        // at -O0 too, for its warnings
+        new SimplifyDefUse(&refMap, &typeMap, options.optimize(1)),
         new SimplifyControlFlow(&refMap, &typeMap),
         new SpecializeAll(&refMap, &typeMap),
         new RemoveParserControlFlow(&refMap, &typeMap),
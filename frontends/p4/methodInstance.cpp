@@ -24,6 +24,20 @@ namespace P4 {
 MethodInstance*
 MethodInstance::resolve(const IR::MethodCallExpression* mce, ReferenceMap* refMap,
                         TypeMap* typeMap, bool useExpressionType) {
+    if (auto cached = typeMap->getMethodInstance(mce, refMap)) {
+        Visitor::profile_t::count("method instances cached", 1);
+        return cached; }
+    auto result = resolveUncached(mce, refMap, typeMap, useExpressionType);
+    Visitor::profile_t::count("method instances resolved", 1);
+    // with useExpressionType the result may rest on types that are not in the typeMap
+    if (!useExpressionType)
+        typeMap->setMethodInstance(mce, refMap, result);
+    return result;
+}
+
+MethodInstance*
+MethodInstance::resolveUncached(const IR::MethodCallExpression* mce, ReferenceMap* refMap,
+                                TypeMap* typeMap, bool useExpressionType) {
     auto mt = typeMap->getType(mce->method);
     if (mt == nullptr && useExpressionType)
         mt = mce->method->type;
@@ -35,6 +35,9 @@ class MethodInstance {
             expr(mce), object(decl), originalMethodType(originalMethodType),
             actualMethodType(actualMethodType)
     { CHECK_NULL(mce); CHECK_NULL(originalMethodType); CHECK_NULL(actualMethodType); }
+    static MethodInstance* resolveUncached(const IR::MethodCallExpression* mce,
+                                           ReferenceMap* refMap, TypeMap* typeMap,
+                                           bool useExpressionType);
 
  public:
     const IR::MethodCallExpression* expr;
@@ -48,6 +51,8 @@ class MethodInstance {
     virtual bool isApply() const { return false; }
     virtual ~MethodInstance() {}
 
+    // The result is cached in the typeMap, until it or the refMap is cleared,
+    // so it is shared by all the calls for the same mce.
     static MethodInstance* resolve(const IR::MethodCallExpression* mce,
                                    ReferenceMap* refMap, TypeMap* typeMap,
                                    bool useExpressionType = false);
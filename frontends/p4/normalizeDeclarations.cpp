@@ -0,0 +1,92 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "normalizeDeclarations.h"
+
+namespace P4 {
+
+NormalizeDeclarations::NormalizeDeclarations(ReferenceMap* refMap) : renameMap(new RenameMap) {
+    setStopOnError(true);
+    setName("NormalizeDeclarations");
+    CHECK_NULL(refMap);
+    passes.emplace_back(new ResolveReferences(refMap));
+    passes.emplace_back(new FindSymbols(refMap, renameMap));
+    passes.emplace_back(new RenameAndMoveDeclarations(refMap, renameMap));
+}
+
+/**************************************************************************/
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::Declaration_Variable* decl) {
+    rename(getOriginal<IR::IDeclaration>(), decl);
+    // MoveDeclarations keeps the initializers of the local variables of a control
+    // or parser, which MoveInitializers then moves to its body or start state.
+    if (decl->initializer != nullptr &&
+        getContext()->node->is<IR::IndexedVector<IR::Declaration>>() &&
+        (findContext<IR::P4Control>() != nullptr || findContext<IR::P4Parser>() != nullptr)) {
+        auto varRef = new IR::PathExpression(decl->name);
+        initializers->push_back(
+            new IR::AssignmentStatement(decl->srcInfo, varRef, decl->initializer));
+        decl->initializer = nullptr;
+    }
+    return MoveDeclarations::postorder(decl);
+}
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::Declaration_Constant* decl) {
+    rename(getOriginal<IR::IDeclaration>(), decl);
+    return MoveDeclarations::postorder(decl);
+}
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::PathExpression* expression) {
+    return renamePath(expression);
+}
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::Declaration_Instance* decl) {
+    renameAnnotated(getOriginal<IR::IDeclaration>(), decl);
+    return decl;
+}
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::P4Table* decl) {
+    renameAnnotated(getOriginal<IR::IDeclaration>(), decl);
+    return decl;
+}
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::P4Action* action) {
+    renameAnnotated(getOriginal<IR::IDeclaration>(), action);
+    return MoveDeclarations::postorder(action);
+}
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::ParserState* state) {
+    // The parser locals are visited before the states
+    if (state->name != IR::ParserState::start || initializers->empty())
+        return state;
+    initializers->append(*state->components);
+    state->components = initializers;
+    initializers = new IR::IndexedVector<IR::StatOrDecl>();
+    return state;
+}
+
+const IR::Node* RenameAndMoveDeclarations::postorder(IR::P4Control* control) {
+    MoveDeclarations::postorder(control);
+    if (initializers->empty())
+        return control;
+    initializers->append(*control->body->components);
+    control->body = new IR::BlockStatement(
+        Util::SourceInfo(), control->body->annotations, initializers);
+    initializers = new IR::IndexedVector<IR::StatOrDecl>();
+    return control;
+}
+
+}  // namespace P4
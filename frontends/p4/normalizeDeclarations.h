@@ -0,0 +1,60 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _FRONTENDS_P4_NORMALIZEDECLARATIONS_H_
+#define _FRONTENDS_P4_NORMALIZEDECLARATIONS_H_
+
+#include "ir/ir.h"
+#include "frontends/p4/uniqueNames.h"
+#include "frontends/p4/moveDeclarations.h"
+
+namespace P4 {
+
+// UniqueNames, MoveDeclarations and MoveInitializers, in this order, with a
+// single Transform of the program rather than three.  The result is the same
+// as running the three passes one after the other.
+class NormalizeDeclarations : public PassManager {
+ private:
+    RenameMap    *renameMap;
+ public:
+    explicit NormalizeDeclarations(ReferenceMap* refMap);
+};
+
+// RenameSymbols followed by MoveDeclarations and MoveInitializers: each
+// declaration is renamed in its postorder, before it is moved, and the
+// initializers of the local variables of a control or parser are moved to the
+// beginning of its body or start state.
+class RenameAndMoveDeclarations : public MoveDeclarations, private SymbolRenamer {
+    IR::IndexedVector<IR::StatOrDecl> *initializers;  // as MoveInitializers::toMove
+
+ public:
+    RenameAndMoveDeclarations(ReferenceMap *refMap, RenameMap *renameMap) :
+            SymbolRenamer(refMap, renameMap),
+            initializers(new IR::IndexedVector<IR::StatOrDecl>())
+    { setName("RenameAndMoveDeclarations"); }
+    const IR::Node* postorder(IR::Declaration_Variable* decl) override;
+    const IR::Node* postorder(IR::Declaration_Constant* decl) override;
+    const IR::Node* postorder(IR::PathExpression* expression) override;
+    const IR::Node* postorder(IR::Declaration_Instance* decl) override;
+    const IR::Node* postorder(IR::P4Table* decl) override;
+    const IR::Node* postorder(IR::P4Action* action) override;
+    const IR::Node* postorder(IR::ParserState* state) override;
+    const IR::Node* postorder(IR::P4Control* control) override;
+};
+
+}  // namespace P4
+
+#endif /* _FRONTENDS_P4_NORMALIZEDECLARATIONS_H_ */
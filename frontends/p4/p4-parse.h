@@ -18,9 +18,25 @@ limitations under the License.
 #define _P4_P4_PARSE_H_
 
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace IR { class Global; }
+class IncludeCache;
 
 const IR::P4Program *parse_P4_16_file(const char *name, FILE *in);
+// Parses the preprocessed program in 'text', reusing the declarations of the system
+// include files it starts with from 'includes' unless it is null, and adding those not
+// found there; the rest of a large program is then kept there in parts, of which only
+// those that changed are parsed again.  With 'threads' other than 1 (0 for one per
+// hardware thread), a large program is parsed in parts at once, when they parse the
+// same as the whole would.
+const IR::P4Program *parse_P4_16_text(const char *name, const std::string &text,
+                                      IncludeCache *includes, unsigned threads = 1);
+// Where [begin, end) may be cut into parts of at least 'size' characters that hold whole
+// top-level declarations, as offsets of the starts of the lines that begin the parts; and
+// in 'ends', if given, the offsets just after the declaration that ends before each cut
+std::vector<size_t> splitDeclarations(const char *begin, const char *end, size_t size,
+                                      std::vector<size_t> *ends = nullptr);
 
 #endif /* _P4_P4_PARSE_H_ */
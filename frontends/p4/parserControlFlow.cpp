@@ -56,79 +56,102 @@ state s_join {
    transition selectExpression;
 }
 
+Statements nested in the branches are converted the same way, into
+states named after s_true or s_false, with the join state of the if
+statement as the state that their last state transitions to.
 */
 
+IR::ParserState* DoRemoveParserControlFlow::startState(
+    cstring name, const IR::Expression* select) {
+    components = new IR::IndexedVector<IR::StatOrDecl>();
+    current = new IR::ParserState(
+        Util::SourceInfo(), name, IR::Annotations::empty, components, select);
+    return current;
+}
+
+void DoRemoveParserControlFlow::add(const IR::StatOrDecl* statement) {
+    if (auto block = statement->to<IR::BlockStatement>()) {
+        // blocks without declarations are flattened, as SimplifyControlFlow would
+        bool flatten = block->annotations->size() == 0;
+        for (auto c : *block->components)
+            if (!c->is<IR::Statement>())
+                flatten = false;
+        if (flatten) {
+            for (auto c : *block->components)
+                add(c);
+            return;
+        }
+    }
+    auto ifstat = statement->to<IR::IfStatement>();
+    if (ifstat == nullptr) {
+        components->push_back(statement);
+        return;
+    }
+    LOG1("Converting " << statement << " into states");
+
+    cstring joinName = refMap->newName(stateName + "_join");
+    cstring trueName = refMap->newName(stateName + "_true");
+    cstring falseName = joinName;
+    if (ifstat->ifFalse != nullptr)
+        falseName = refMap->newName(stateName + "_false");
+
+    // the current state selects on the condition, and s_join takes its transition
+    auto vec = new IR::Vector<IR::Expression>();
+    vec->push_back(ifstat->condition);
+    auto trueCase = new IR::SelectCase(
+        Util::SourceInfo(), new IR::BoolLiteral(true),
+        new IR::PathExpression(IR::ID(trueName, nullptr)));
+    auto falseCase = new IR::SelectCase(
+        Util::SourceInfo(), new IR::BoolLiteral(false),
+        new IR::PathExpression(IR::ID(falseName, nullptr)));
+    auto cases = new IR::Vector<IR::SelectCase>();
+    cases->push_back(trueCase);
+    cases->push_back(falseCase);
+    auto joinSelect = current->selectExpression;
+    current->selectExpression = new IR::SelectExpression(
+        Util::SourceInfo(), new IR::ListExpression(vec), std::move(*cases));
+
+    // s_true; the states made for the if statements in a branch are named
+    // after the state of the branch
+    cstring outerName = stateName;
+    stateName = trueName;
+    states->push_back(startState(trueName, new IR::PathExpression(IR::ID(joinName, nullptr))));
+    add(ifstat->ifTrue);
+
+    // s_false
+    if (ifstat->ifFalse != nullptr) {
+        stateName = falseName;
+        states->push_back(
+            startState(falseName, new IR::PathExpression(IR::ID(joinName, nullptr))));
+        add(ifstat->ifFalse);
+    }
+    stateName = outerName;
+
+    // s_join, where the next statements go
+    states->push_back(startState(joinName, joinSelect));
+}
+
 const IR::Node* DoRemoveParserControlFlow::postorder(IR::ParserState* state) {
     LOG1("Visiting " << dbp(state));
     // TODO: we keep annotations on the first state,
     // but this may be wrong for something like @atomic
 
     // Set of newly created states
-    auto states = new IR::IndexedVector<IR::ParserState>();
-    IR::ParserState* currentState = state;
-    // components of the currentState
-    auto currentComponents = new IR::IndexedVector<IR::StatOrDecl>();
+    states = new IR::IndexedVector<IR::ParserState>();
+    states->push_back(state);
+    stateName = state->name.name;
+    current = state;
+    components = new IR::IndexedVector<IR::StatOrDecl>();
     auto origComponents = state->components;
-    auto origSelect = state->selectExpression;
-
-    cstring joinName;  // non-empty if we split the state
-    for (auto c : *origComponents) {
-        if (c->is<IR::IfStatement>()) {
-            LOG1("Converting " << c << " into states");
-
-            states->push_back(currentState);
-            auto ifstat = c->to<IR::IfStatement>();
-            cstring joinName = refMap->newName(state->name.name + "_join");
-
-            // s_true
-            cstring trueName = refMap->newName(state->name.name + "_true");
-            auto trueComponents = new IR::IndexedVector<IR::StatOrDecl>();
-            trueComponents->push_back(ifstat->ifTrue);
-            auto trueState = new IR::ParserState(
-                Util::SourceInfo(), trueName, IR::Annotations::empty, trueComponents,
-                new IR::PathExpression(IR::ID(joinName, nullptr)));
-            states->push_back(trueState);
-
-            // s_false
-            cstring falseName = joinName;
-            if (ifstat->ifFalse != nullptr) {
-                falseName = refMap->newName(state->name.name + "_false");
-                auto falseComponents = new IR::IndexedVector<IR::StatOrDecl>();
-                falseComponents->push_back(ifstat->ifFalse);
-                auto falseState = new IR::ParserState(
-                    Util::SourceInfo(), falseName, IR::Annotations::empty, falseComponents,
-                    new IR::PathExpression(IR::ID(joinName, nullptr)));
-                states->push_back(falseState);
-            }
-
-            // left-over
-            auto vec = new IR::Vector<IR::Expression>();
-            vec->push_back(ifstat->condition);
-            auto trueCase = new IR::SelectCase(
-                Util::SourceInfo(), new IR::BoolLiteral(true),
-                new IR::PathExpression(IR::ID(trueName, nullptr)));
-            auto falseCase = new IR::SelectCase(
-                Util::SourceInfo(), new IR::BoolLiteral(false),
-                new IR::PathExpression(IR::ID(falseName, nullptr)));
-            auto cases = new IR::Vector<IR::SelectCase>();
-            cases->push_back(trueCase);
-            cases->push_back(falseCase);
-            currentState->selectExpression = new IR::SelectExpression(
-                Util::SourceInfo(), new IR::ListExpression(vec), std::move(*cases));
-
-            currentState->components = currentComponents;
-            currentComponents = new IR::IndexedVector<IR::StatOrDecl>();
-            currentState = new IR::ParserState(
-                Util::SourceInfo(), joinName, IR::Annotations::empty,
-                currentComponents, origSelect);  // may be overriten
-        } else {
-            currentComponents->push_back(c);
-        }
-    }
+    state->components = components;
+    for (auto c : *origComponents)
+        add(c);
 
-    if (states->empty())
+    if (states->size() == 1) {
+        if (*components == *origComponents)
+            state->components = origComponents;
         return state;
-    states->push_back(currentState);
+    }
     return states;
 }
 
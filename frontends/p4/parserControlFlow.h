@@ -25,9 +25,25 @@ namespace P4 {
 
 // Converts if statements in parsers into transitions.
 // This should be run after variables have been moved to the "top" of
-// the parser.
+// the parser.  The if statements nested in others, or in blocks, are
+// converted together with them, so a single pass converts a whole state.
 class DoRemoveParserControlFlow : public Transform {
     ReferenceMap* refMap;
+    // The name of the states made for the next if statement: that of the state
+    // being converted, or of the branch that the statement is in
+    cstring stateName;
+    // The states made from the state being converted
+    IR::IndexedVector<IR::ParserState>* states = nullptr;
+    // The state that the next statement goes to, and its components
+    IR::ParserState* current = nullptr;
+    IR::IndexedVector<IR::StatOrDecl>* components = nullptr;
+
+    // Adds a statement to the current state, starting a new state after
+    // each if statement that it contains
+    void add(const IR::StatOrDecl* statement);
+    // Makes a state, with no components yet, the current one
+    IR::ParserState* startState(cstring name, const IR::Expression* select);
+
  public:
     explicit DoRemoveParserControlFlow(ReferenceMap* refMap) : refMap(refMap)
     { CHECK_NULL(refMap); setName("DoRemoveParserControlFlow"); }
@@ -35,9 +51,9 @@ class DoRemoveParserControlFlow : public Transform {
     Visitor::profile_t init_apply(const IR::Node* node) override;
 };
 
-class RemoveParserControlFlow : public PassRepeated {
+class RemoveParserControlFlow : public PassManager {
  public:
-    RemoveParserControlFlow(ReferenceMap* refMap, TypeMap* typeMap) : PassRepeated({}) {
+    RemoveParserControlFlow(ReferenceMap* refMap, TypeMap* typeMap) {
         passes.emplace_back(new DoRemoveParserControlFlow(refMap));
         passes.emplace_back(new SimplifyControlFlow(refMap, typeMap));
         setName("RemoveParserControlFlow");
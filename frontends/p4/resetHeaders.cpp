@@ -31,7 +31,7 @@ void DoResetHeaders::generateResets(const TypeMap* typeMap, const IR::Type* type
         auto method = new IR::Member(expr->srcInfo, expr, IR::Type_Header::setInvalid);
         auto args = new IR::Vector<IR::Expression>();
         auto mc = new IR::MethodCallExpression(expr->srcInfo, method,
-                                               new IR::Vector<IR::Type>(), args);
+                                               IR::Vector<IR::Type>::emptyInstance(), args);
         auto stat = new IR::MethodCallStatement(mc->srcInfo, mc);
         resets->push_back(stat);
     } else if (type->is<IR::Type_Stack>()) {
@@ -20,6 +20,45 @@ limitations under the License.
 
 namespace P4 {
 
+bool SideEffectSummary::hasOwnSideEffects(const IR::Expression* expression) const {
+    if (expression->is<IR::ConstructorCallExpression>())
+        return true;
+    auto mce = expression->to<IR::MethodCallExpression>();
+    if (mce == nullptr)
+        return false;
+    auto mi = MethodInstance::resolve(mce, refMap, typeMap);
+    auto bim = mi->to<BuiltInMethod>();
+    return bim == nullptr || bim->name.name != IR::Type_Header::isValid;
+}
+
+bool SideEffectSummary::preorder(const IR::Expression* expression) {
+    if (auto known = summary->find(expression)) {
+        if (*known && !effects.empty())
+            effects.back() = true;
+        return false;
+    }
+    effects.push_back(false);
+    return true;
+}
+
+void SideEffectSummary::postorder(const IR::Expression* expression) {
+    bool result = effects.back() || hasOwnSideEffects(expression);
+    effects.pop_back();
+    summary->emplace(expression, result);
+    if (result && !effects.empty())
+        effects.back() = true;
+}
+
+bool SideEffectSummary::check(const IR::Expression* expression, ReferenceMap* refMap,
+                              TypeMap* typeMap, NodeIdMap<bool>* summary) {
+    CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(summary);
+    if (auto known = summary->find(expression))
+        return *known;
+    SideEffectSummary ses(refMap, typeMap, summary);
+    expression->apply(ses);
+    return summary->get(expression);
+}
+
 namespace {
 
 // Data structure used for making explicit the order of evaluation of
@@ -67,6 +106,7 @@ class DismantleExpression : public Transform {
     bool leftValue;  // true when we are dismantling a left-value.
     bool resultNotUsed;  // true when the caller does not want the result (i.e.,
                          // we are invoked from a MethodCallStatement).
+    NodeIdMap<bool>* sideEffects;  // see SideEffectSummary
 
     // catch-all case
     const IR::Node* postorder(IR::Expression* expression) override {
@@ -275,7 +315,7 @@ class DismantleExpression : public Transform {
         LOG1("Visiting " << dbp(mce));
         auto orig = getOriginal<IR::MethodCallExpression>();
         auto type = typeMap->getType(orig, true);
-        if (!SideEffects::check(orig, refMap, typeMap)) {
+        if (!SideEffectSummary::check(orig, refMap, typeMap, sideEffects)) {
             result->final = mce;
             return mce;
         }
@@ -289,7 +329,7 @@ class DismantleExpression : public Transform {
         resultNotUsed = false;
         if (mce->arguments->size() > 1) {
             for (auto a : *mce->arguments) {
-                if (SideEffects::check(a, refMap, typeMap)) {
+                if (SideEffectSummary::check(a, refMap, typeMap, sideEffects)) {
                     useTemporaries = true;
                     break;
                 }
@@ -405,9 +445,9 @@ class DismantleExpression : public Transform {
     }
 
  public:
-    DismantleExpression(ReferenceMap* refMap, TypeMap* typeMap) :
-            refMap(refMap), typeMap(typeMap), leftValue(false) {
-        CHECK_NULL(refMap); CHECK_NULL(typeMap);
+    DismantleExpression(ReferenceMap* refMap, TypeMap* typeMap, NodeIdMap<bool>* sideEffects) :
+            refMap(refMap), typeMap(typeMap), leftValue(false), sideEffects(sideEffects) {
+        CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(sideEffects);
         result = new EvaluationOrder(refMap);
         setName("DismantleExpressions");
     }
@@ -473,7 +513,7 @@ const IR::Node* DoSimplifyExpressions::postorder(IR::P4Action* action) {
 const IR::Node* DoSimplifyExpressions::postorder(IR::ParserState* state) {
     if (state->selectExpression == nullptr)
         return state;
-    DismantleExpression dm(refMap, typeMap);
+    DismantleExpression dm(refMap, typeMap, &sideEffects);
     auto parts = dm.dismantle(state->selectExpression, false);
     CHECK_NULL(parts);
     if (parts->simple())
@@ -487,7 +527,7 @@ const IR::Node* DoSimplifyExpressions::postorder(IR::ParserState* state) {
 }
 
 const IR::Node* DoSimplifyExpressions::postorder(IR::AssignmentStatement* statement) {
-    DismantleExpression dm(refMap, typeMap);
+    DismantleExpression dm(refMap, typeMap, &sideEffects);
     auto left = dm.dismantle(statement->left, true)->final;
     CHECK_NULL(left);
     auto parts = dm.dismantle(statement->right, false);
@@ -502,7 +542,7 @@ const IR::Node* DoSimplifyExpressions::postorder(IR::AssignmentStatement* statem
 }
 
 const IR::Node* DoSimplifyExpressions::postorder(IR::MethodCallStatement* statement) {
-    DismantleExpression dm(refMap, typeMap);
+    DismantleExpression dm(refMap, typeMap, &sideEffects);
     auto parts = dm.dismantle(statement->methodCall, false, true);
     CHECK_NULL(parts);
     if (parts->simple())
@@ -516,7 +556,7 @@ const IR::Node* DoSimplifyExpressions::postorder(IR::MethodCallStatement* statem
 const IR::Node* DoSimplifyExpressions::postorder(IR::ReturnStatement* statement) {
     if (statement->expression == nullptr)
         return statement;
-    DismantleExpression dm(refMap, typeMap);
+    DismantleExpression dm(refMap, typeMap, &sideEffects);
     auto parts = dm.dismantle(statement->expression, false);
     CHECK_NULL(parts);
     if (parts->simple())
@@ -530,7 +570,7 @@ const IR::Node* DoSimplifyExpressions::postorder(IR::ReturnStatement* statement)
 }
 
 const IR::Node* DoSimplifyExpressions::postorder(IR::IfStatement* statement) {
-    DismantleExpression dm(refMap, typeMap);
+    DismantleExpression dm(refMap, typeMap, &sideEffects);
     auto parts = dm.dismantle(statement->condition, false);
     CHECK_NULL(parts);
     if (parts->simple())
@@ -545,7 +585,7 @@ const IR::Node* DoSimplifyExpressions::postorder(IR::IfStatement* statement) {
 }
 
 const IR::Node* DoSimplifyExpressions::postorder(IR::SwitchStatement* statement) {
-    DismantleExpression dm(refMap, typeMap);
+    DismantleExpression dm(refMap, typeMap, &sideEffects);
     auto parts = dm.dismantle(statement->expression, false);
     CHECK_NULL(parts);
     if (parts->simple())
@@ -20,6 +20,7 @@ limitations under the License.
 /* makes explicit side effect ordering */
 
 #include "ir/ir.h"
+#include "ir/node_id_map.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
 #include "frontends/p4/typeChecking/typeChecker.h"
 #include "frontends/p4/methodInstance.h"
@@ -67,6 +68,33 @@ class SideEffects : public Inspector {
     }
 };
 
+// Finds, in one bottom-up traversal of an expression, which of its subexpressions
+// may have side-effects, as SideEffects::check would, and records them all in a
+// summary; checking an expression that is already in the summary is a lookup.
+// This keeps passes that check an expression and then each of its operands, at
+// every level, linear in the size of the expression.
+class SideEffectSummary : public Inspector {
+    ReferenceMap*    refMap;
+    TypeMap*         typeMap;
+    NodeIdMap<bool>* summary;
+    std::vector<bool> effects;  // of the expressions being visited, the innermost last
+
+    // true if the expression itself, not counting its subexpressions, has side-effects
+    bool hasOwnSideEffects(const IR::Expression* expression) const;
+    SideEffectSummary(ReferenceMap* refMap, TypeMap* typeMap, NodeIdMap<bool>* summary) :
+            refMap(refMap), typeMap(typeMap), summary(summary)
+    { visitDagOnce = false; setName("SideEffectSummary"); }
+
+ public:
+    bool preorder(const IR::Expression* expression) override;
+    void postorder(const IR::Expression* expression) override;
+
+    // Returns true if the expression may have side-effects, adding it and its
+    // subexpressions to 'summary' if it is not there yet.
+    static bool check(const IR::Expression* expression, ReferenceMap* refMap,
+                      TypeMap* typeMap, NodeIdMap<bool>* summary);
+};
+
 // convert expresions so that each expression contains at most one side-effect
 // left-values are converted to contain no side-effects
 // i.e. a[f(x)] = b
@@ -100,6 +128,8 @@ class DoSimplifyExpressions : public Transform {
     TypeMap*             typeMap;
 
     IR::IndexedVector<IR::Declaration> toInsert;
+    // SideEffectSummary of the expressions of the program
+    NodeIdMap<bool> sideEffects;
 
  public:
     // Currently this only works correctly only if initializers
@@ -110,6 +140,8 @@ class DoSimplifyExpressions : public Transform {
         setName("DoSimplifyExpressions");
     }
 
+    Visitor::profile_t init_apply(const IR::Node* node) override
+    { sideEffects.clear(); return Transform::init_apply(node); }
     const IR::Node* preorder(IR::P4Program* program) override {
         if (refMap->isV1()) prune();  // skip for P4 v1
         return program;
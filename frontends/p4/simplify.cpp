@@ -19,8 +19,48 @@ limitations under the License.
 
 namespace P4 {
 
+// The parent of a statement as far as its children care: their own grandparent
+unsigned DoSimplifyControlFlow::parentKind() const {
+    auto parent = getContext()->node;
+    if (parent->is<IR::P4Action>())
+        return 2;
+    if (parent->is<IR::ParserState>())
+        return 4;
+    return 1;
+}
+
+void DoSimplifyControlFlow::setChildrenSimplified(const IR::Node* statement) {
+    if (simplified == nullptr || *statement != *getOriginal())
+        return;
+    *simplified->emplace(getOriginal(), 0).first |= parentKind();
+}
+
+// A statement whose children are known to stay as they are is simplified without
+// visiting them
+const IR::Node* DoSimplifyControlFlow::preorder(IR::BlockStatement* statement) {
+    if (!childrenSimplified())
+        return statement;
+    prune();
+    return postorder(statement);
+}
+
+const IR::Node* DoSimplifyControlFlow::preorder(IR::IfStatement* statement) {
+    if (!childrenSimplified())
+        return statement;
+    prune();
+    return postorder(statement);
+}
+
+const IR::Node* DoSimplifyControlFlow::preorder(IR::SwitchStatement* statement) {
+    if (!childrenSimplified())
+        return statement;
+    prune();
+    return postorder(statement);
+}
+
 const IR::Node* DoSimplifyControlFlow::postorder(IR::BlockStatement* statement) {
     LOG1("Visiting " << dbp(getOriginal()));
+    setChildrenSimplified(statement);
     if (statement->annotations->size() > 0)
         return statement;
     auto parent = getContext()->node;
@@ -59,6 +99,7 @@ const IR::Node* DoSimplifyControlFlow::postorder(IR::BlockStatement* statement)
 
 const IR::Node* DoSimplifyControlFlow::postorder(IR::IfStatement* statement)  {
     LOG1("Visiting " << dbp(getOriginal()));
+    setChildrenSimplified(statement);
     if (SideEffects::check(statement->condition, refMap, typeMap))
         return statement;
     if (statement->ifTrue->is<IR::EmptyStatement>() &&
@@ -79,6 +120,7 @@ const IR::Node* DoSimplifyControlFlow::postorder(IR::EmptyStatement* statement)
 
 const IR::Node* DoSimplifyControlFlow::postorder(IR::SwitchStatement* statement)  {
     LOG1("Visiting " << dbp(getOriginal()));
+    setChildrenSimplified(statement);
     if (statement->cases.empty()) {
         BUG_CHECK(statement->expression->is<IR::Member>(),
                   "%1%: expected a Member", statement->expression);
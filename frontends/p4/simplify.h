@@ -18,8 +18,11 @@ limitations under the License.
 #define _FRONTENDS_P4_SIMPLIFY_H_
 
 #include "ir/ir.h"
+#include "ir/node_id_map.h"
 #include "frontends/p4/typeChecking/typeChecker.h"
 #include "frontends/p4/methodInstance.h"
+#include "frontends/p4/strengthReduction.h"
+#include "frontends/common/constantFolding.h"
 #include "frontends/common/resolveReferences/resolveReferences.h"
 
 namespace P4 {
@@ -27,10 +30,27 @@ namespace P4 {
 class DoSimplifyControlFlow : public Transform {
     ReferenceMap* refMap;
     TypeMap*      typeMap;
+    // The statements whose children were all left as they are, as a set of the kinds
+    // of parent (see parentKind) that the statement had then: what happens to its
+    // children depends on it and on the statement itself, and on nothing else.  It is
+    // held by SimplifyControlFlow and kept from one run to the next, since that runs this
+    // many times, mostly on statements that did not change in between; their children
+    // are then not visited.  Null to keep nothing.
+    NodeIdMap<unsigned>* simplified;
+    unsigned parentKind() const;
+    bool childrenSimplified() const
+    { return simplified && (simplified->get(getOriginal()) & parentKind()) != 0; }
+    void setChildrenSimplified(const IR::Node* statement);
+
  public:
-    DoSimplifyControlFlow(ReferenceMap* refMap, TypeMap* typeMap) :
-            refMap(refMap), typeMap(typeMap)
+    DoSimplifyControlFlow(ReferenceMap* refMap, TypeMap* typeMap,
+                          NodeIdMap<unsigned>* simplified = nullptr) :
+            refMap(refMap), typeMap(typeMap), simplified(simplified)
     { CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("DoSimplifyControlFlow"); }
+    cstring fixpointKey() const override { return name(); }
+    const IR::Node* preorder(IR::BlockStatement* statement) override;
+    const IR::Node* preorder(IR::IfStatement* statement) override;
+    const IR::Node* preorder(IR::SwitchStatement* statement) override;
     const IR::Node* postorder(IR::BlockStatement* statement) override;
     const IR::Node* postorder(IR::IfStatement* statement) override;
     const IR::Node* postorder(IR::EmptyStatement* statement) override;
@@ -38,12 +58,37 @@ class DoSimplifyControlFlow : public Transform {
 };
 
 class SimplifyControlFlow : public PassRepeated {
+    NodeIdMap<unsigned> simplified;  // see DoSimplifyControlFlow
+
  public:
     SimplifyControlFlow(ReferenceMap* refMap, TypeMap* typeMap) {
         passes.push_back(new TypeChecking(refMap, typeMap));
-        passes.push_back(new DoSimplifyControlFlow(refMap, typeMap));
+        passes.push_back(new DoSimplifyControlFlow(refMap, typeMap, &simplified));
         setName("SimplifyControlFlow");
     }
+    // With bounded memory the statements are forgotten after each run, and the pages
+    // of the map released
+    using PassRepeated::end_apply;
+    void end_apply() override {
+        if (PassManager::boundedMemory())
+            simplified = NodeIdMap<unsigned>();
+        PassRepeated::end_apply();
+    }
+};
+
+// Constant folding, strength reduction and control-flow simplification, fused in
+// one traversal of the program: each node is folded, reduced and simplified after
+// its children, until none of them changes it.
+class SimplifyAll : public PassManager {
+ public:
+    SimplifyAll(ReferenceMap* refMap, TypeMap* typeMap) {
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        passes.push_back(new FusedTransform({
+            new DoConstantFolding(refMap, typeMap),
+            new StrengthReduction(),
+            new DoSimplifyControlFlow(refMap, typeMap) }));
+        setName("SimplifyAll");
+    }
 };
 
 }  // namespace P4
@@ -68,6 +68,7 @@ class FindUninitialized : public Inspector {
     // This does not include location sets read by subexpressions.
     std::map<const IR::Expression*, const LocationSet*> readLocations;
     HasUses*        hasUses;  // output
+    bool            warn;  // about values that may be uninitialized
 
     const LocationSet* getReads(const IR::Expression* expression, bool nonNull = false) const {
         if (expression->is<IR::Literal>() ||
@@ -94,15 +95,15 @@ class FindUninitialized : public Inspector {
             context(context), refMap(parent->definitions->storageMap->refMap),
             typeMap(parent->definitions->storageMap->typeMap),
             definitions(parent->definitions), lhs(false), currentPoint(context),
-            hasUses(parent->hasUses)
+            hasUses(parent->hasUses), warn(parent->warn)
     { setName("FindUninitialized"); }
 
  public:
-    FindUninitialized(AllDefinitions* definitions, HasUses* hasUses) :
+    FindUninitialized(AllDefinitions* definitions, HasUses* hasUses, bool warn) :
             refMap(definitions->storageMap->refMap),
             typeMap(definitions->storageMap->typeMap),
             definitions(definitions), lhs(false), currentPoint(),
-            hasUses(hasUses) {
+            hasUses(hasUses), warn(warn) {
         CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(definitions);
         CHECK_NULL(hasUses);
         setName("FindUninitialized"); }
@@ -267,7 +268,7 @@ class FindUninitialized : public Inspector {
             return;
         auto currentDefinitions = getCurrentDefinitions();
         auto points = currentDefinitions->get(read);
-        if (reportUninitialized && !lhs && points->containsBeforeStart()) {
+        if (warn && reportUninitialized && !lhs && points->containsBeforeStart()) {
             // Do not report uninitialized values on the LHS.
             // This could happen if we are writing to an array element
             // with an unknown index.
@@ -462,12 +463,14 @@ class FindUninitialized : public Inspector {
 class RemoveUnused : public Transform {
     // TODO: remove transitively unused
     const HasUses* hasUses;
+    unsigned* removed;  // count of the statements removed
  public:
-    explicit RemoveUnused(const HasUses* hasUses) : hasUses(hasUses)
-    { CHECK_NULL(hasUses); setName("RemoveUnused"); }
+    RemoveUnused(const HasUses* hasUses, unsigned* removed) : hasUses(hasUses), removed(removed)
+    { CHECK_NULL(hasUses); CHECK_NULL(removed); setName("RemoveUnused"); }
     const IR::Node* postorder(IR::AssignmentStatement* statement) override {
         if (!hasUses->hasUses(getOriginal())) {
             LOG1("Removing statement " << dbp(getOriginal()) << " " << statement);
+            ++*removed;
             if (statement->right->is<IR::MethodCallExpression>()) {
                 // keep the method for side effects
                 auto mce = statement->right->to<IR::MethodCallExpression>();
@@ -484,19 +487,38 @@ class ProcessDefUse : public PassManager {
     AllDefinitions *definitions;
     HasUses         hasUses;
  public:
-    ProcessDefUse(ReferenceMap* refMap, TypeMap* typeMap) :
+    // without 'removed', only gives the warnings
+    ProcessDefUse(ReferenceMap* refMap, TypeMap* typeMap, bool warn, unsigned* removed) :
             definitions(new AllDefinitions(refMap, typeMap)) {
         passes.push_back(new ComputeWriteSet(definitions));
-        passes.push_back(new FindUninitialized(definitions, &hasUses));
-        passes.push_back(new RemoveUnused(&hasUses));
+        passes.push_back(new FindUninitialized(definitions, &hasUses, warn));
+        if (removed != nullptr)
+            passes.push_back(new RemoveUnused(&hasUses, removed));
         setName("ProcessDefUse");
     }
 };
 }  // namespace
 
 const IR::Node* DoSimplifyDefUse::process(const IR::Node* node) {
-    ProcessDefUse process(refMap, typeMap);
-    return node->apply(process);
+    if (removed == nullptr) {
+        unsigned count = 0;
+        ProcessDefUse process(refMap, typeMap, true, removeUnused ? &count : nullptr);
+        return node->apply(process);
+    }
+    // Removing an assignment may leave those that it read from without uses
+    while (true) {
+        unsigned before = *removed;
+        ProcessDefUse process(refMap, typeMap, false, removed);
+        node = node->apply(process);
+        if (*removed == before)
+            return node;
+    }
+}
+
+void RemoveDeadStores::end_apply() {
+    if (removed != 0 && Log::verbose())
+        std::cerr << "Removed " << removed << " assignments whose values are never read"
+                  << std::endl;
 }
 
 }  // namespace P4
@@ -22,14 +22,22 @@ limitations under the License.
 
 namespace P4 {
 
+// Visits each parser and control on its own, so it can be applied to one of them
+// at a time (see PassPerDeclaration).
 class DoSimplifyDefUse : public Transform {
     ReferenceMap* refMap;
     TypeMap*      typeMap;
+    // if not null, remove the assignments left without uses too, give no warnings,
+    // and count them here
+    unsigned*     removed;
+    // if false, only give the warnings, and remove nothing
+    bool          removeUnused;
 
     const IR::Node* process(const IR::Node* node);
  public:
-    DoSimplifyDefUse(ReferenceMap* refMap, TypeMap* typeMap) :
-            refMap(refMap), typeMap(typeMap) {
+    DoSimplifyDefUse(ReferenceMap* refMap, TypeMap* typeMap, unsigned* removed = nullptr,
+                     bool removeUnused = true) :
+            refMap(refMap), typeMap(typeMap), removed(removed), removeUnused(removeUnused) {
         CHECK_NULL(refMap); CHECK_NULL(typeMap);
         setName("DoSimplifyDefUse");
     }
@@ -40,16 +48,39 @@ class DoSimplifyDefUse : public Transform {
     { return process(control); }
 };
 
+// Warns about the uses of values that may be uninitialized, and removes the
+// assignments whose values are never read unless 'removeUnused' is false.
 class SimplifyDefUse : public PassManager {
  public:
-    SimplifyDefUse(ReferenceMap* refMap, TypeMap* typeMap) {
+    SimplifyDefUse(ReferenceMap* refMap, TypeMap* typeMap, bool removeUnused = true) {
         CHECK_NULL(refMap); CHECK_NULL(typeMap);
         passes.push_back(new TypeChecking(refMap, typeMap));
-        passes.push_back(new DoSimplifyDefUse(refMap, typeMap));
+        passes.push_back(new PassPerDeclaration({
+            new DoSimplifyDefUse(refMap, typeMap, nullptr, removeUnused) }));
         setName("SimplifyDefUse");
     }
 };
 
+// The same analysis for the mid end, after inlining: removes the assignments whose
+// values are never read, including those only read by other such assignments, e.g.
+// the chains of writes that predication makes.  With -v it says how many it removed.
+class RemoveDeadStores : public PassManager {
+    unsigned removed = 0;
+
+ public:
+    RemoveDeadStores(ReferenceMap* refMap, TypeMap* typeMap) {
+        CHECK_NULL(refMap); CHECK_NULL(typeMap);
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        passes.push_back(new PassPerDeclaration({
+            new DoSimplifyDefUse(refMap, typeMap, &removed) }));
+        setName("RemoveDeadStores");
+    }
+
+    Visitor::profile_t init_apply(const IR::Node* node) override
+    { removed = 0; return PassManager::init_apply(node); }
+    void end_apply() override;
+};
+
 }  // namespace P4
 
 #endif /* _FRONTENDS_P4_SIMPLIFYDEFUSE_H_ */
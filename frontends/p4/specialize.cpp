@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include <iostream>
+#include <sstream>
 
 #include "specialize.h"
 #include "frontends/p4/parameterSubstitution.h"
@@ -76,32 +77,98 @@ const IR::Expression* SpecializationMap::convertArgument(
     }
 }
 
+bool SpecializationMap::typeKey(const IR::Type* type, std::ostream& key) const {
+    // canonical types are shared, except for the simple ones, which print the same
+    auto t = typeMap->getType(type);
+    if (t == nullptr || !t->is<IR::Type_Type>())
+        return false;
+    t = t->to<IR::Type_Type>()->type;
+    if (t->is<IR::Type_Base>())
+        key << t->toString() << ';';
+    else
+        key << static_cast<const void*>(t) << ';';
+    return true;
+}
+
+bool SpecializationMap::argumentKey(const IR::Expression* arg, std::ostream& key) const {
+    if (auto constant = arg->to<IR::Constant>()) {
+        key << constant->type->toString() << ':' << constant->value << ';';
+    } else if (auto literal = arg->to<IR::BoolLiteral>()) {
+        key << (literal->value ? "true;" : "false;");
+    } else if (auto list = arg->to<IR::ListExpression>()) {
+        key << '(';
+        for (auto e : *list->components)
+            if (!argumentKey(e, key))
+                return false;
+        key << ')';
+    } else if (auto cce = arg->to<IR::ConstructorCallExpression>()) {
+        if (!typeKey(cce->constructedType, key))
+            return false;
+        key << '(';
+        for (auto e : *cce->arguments)
+            if (!argumentKey(e, key))
+                return false;
+        key << ')';
+    } else if (auto ei = EnumInstance::resolve(arg, typeMap)) {
+        key << static_cast<const void*>(ei->type) << '.' << ei->name.name << ';';
+    } else {
+        return false;
+    }
+    return true;
+}
+
+SpecializationInfo* SpecializationMap::findEqual(
+    const IR::IContainer* cont, const IR::Vector<IR::Type>* typeArguments,
+    const IR::Vector<IR::Expression>* arguments, cstring& key) {
+    key = nullptr;
+    std::stringstream str;
+    if (typeArguments != nullptr)
+        for (auto t : *typeArguments)
+            if (!typeKey(t, str))
+                return nullptr;
+    str << '|';
+    for (auto arg : *arguments)
+        if (!argumentKey(arg, str))
+            return nullptr;
+    key = str.str();
+    return ::get(byArguments, std::make_pair(cont, key));
+}
+
+void SpecializationMap::add(const IR::Node* invocation, SpecializationInfo* spec, cstring key) {
+    specializations.emplace(invocation, spec);
+    distinct.push_back(spec);
+    if (!key.isNullOrEmpty())
+        byArguments.emplace(std::make_pair(spec->specialized, key), spec);
+}
+
 void SpecializationMap::addSpecialization(
     const IR::ConstructorCallExpression* invocation, const IR::IContainer* cont,
     const IR::Node* insertion) {
+    auto cc = ConstructorCall::resolve(invocation, refMap, typeMap);
+    auto ccc = cc->to<ContainerConstructorCall>();
+    CHECK_NULL(ccc);
+    cstring key;
+    if (auto equal = findEqual(cont, ccc->typeArguments, invocation->arguments, key)) {
+        LOG1(invocation << " shares specialization " << equal->name);
+        specializations.emplace(invocation, equal);
+        return;
+    }
     auto spec = new SpecializationInfo(invocation, cont, insertion);
     auto declaration = cont->to<IR::IDeclaration>();
     CHECK_NULL(declaration);
     spec->name = refMap->newName(declaration->getName());
-    auto cc = ConstructorCall::resolve(invocation, refMap, typeMap);
-    auto ccc = cc->to<ContainerConstructorCall>();
-    CHECK_NULL(ccc);
     spec->constructorArguments = new IR::Vector<IR::Expression>();
     for (auto ca : *invocation->arguments) {
         auto arg = convertArgument(ca, spec);
         spec->constructorArguments->push_back(arg);
     }
     spec->typeArguments = ccc->typeArguments;
-    specializations.emplace(invocation, spec);
+    add(invocation, spec, key);
 }
 
 void SpecializationMap::addSpecialization(
     const IR::Declaration_Instance* invocation, const IR::IContainer* cont,
     const IR::Node* insertion) {
-    auto spec = new SpecializationInfo(invocation, cont, insertion);
-    auto declaration = cont->to<IR::IDeclaration>();
-    CHECK_NULL(declaration);
-    spec->name = refMap->newName(declaration->getName());
     const IR::Type_Name* type;
     const IR::Vector<IR::Type>* typeArgs;
     if (invocation->type->is<IR::Type_Specialized>()) {
@@ -112,23 +179,33 @@ void SpecializationMap::addSpecialization(
         type = invocation->type->to<IR::Type_Name>();
         typeArgs = new IR::Vector<IR::Type>();
     }
-    spec->typeArguments = typeArgs;
     CHECK_NULL(type);
+    cstring key;
+    if (auto equal = findEqual(cont, typeArgs, invocation->arguments, key)) {
+        LOG1(invocation << " shares specialization " << equal->name);
+        specializations.emplace(invocation, equal);
+        return;
+    }
+    auto spec = new SpecializationInfo(invocation, cont, insertion);
+    auto declaration = cont->to<IR::IDeclaration>();
+    CHECK_NULL(declaration);
+    spec->name = refMap->newName(declaration->getName());
+    spec->typeArguments = typeArgs;
     for (auto ca : *invocation->arguments) {
         auto arg = convertArgument(ca, spec);
         spec->constructorArguments->push_back(arg);
     }
-    specializations.emplace(invocation, spec);
+    add(invocation, spec, key);
 }
 
 IR::Vector<IR::Node>*
 SpecializationMap::getSpecializations(const IR::Node* insertionPoint) const {
     IR::Vector<IR::Node>* result = nullptr;
-    for (auto s : specializations) {
-        if (s.second->insertBefore == insertionPoint) {
+    for (auto s : distinct) {
+        if (s->insertBefore == insertionPoint) {
             if (result == nullptr)
                 result = new IR::Vector<IR::Node>();
-            auto node = s.second->synthesize(refMap);
+            auto node = s->synthesize(refMap);
             LOG1("Will insert " << node << " before " << insertionPoint);
             result->push_back(node);
         }
@@ -31,8 +31,9 @@ namespace P4 {
 // is converted to
 // control cspec(in bit<32> data) { ... }
 // cspec() c_inst;
-// A different specialization is made for each constructor invocation
-// and Declaration_Instance.
+// Constructor invocations and Declaration_Instances of the same object with
+// the same type arguments and equal constant constructor arguments share one
+// specialization.
 
 // Describes how a parser or control is specialized:
 struct SpecializationInfo {
@@ -64,7 +65,20 @@ struct SpecializationInfo {
 class SpecializationMap {
     // map invocation to specialization
     ordered_map<const IR::Node*, SpecializationInfo*> specializations;
+    // each distinct specialization once, in the order they were found
+    std::vector<SpecializationInfo*> distinct;
+    // specializations by object specialized and key of their arguments
+    std::map<std::pair<const IR::IContainer*, cstring>, SpecializationInfo*> byArguments;
     const IR::Expression* convertArgument(const IR::Expression* arg, SpecializationInfo* info);
+    bool typeKey(const IR::Type* type, std::ostream& key) const;
+    bool argumentKey(const IR::Expression* arg, std::ostream& key) const;
+    // Returns the specialization of 'cont' with equal arguments that was already
+    // made, if any; otherwise sets 'key' to the key of the arguments, or to null if
+    // they cannot be compared.
+    SpecializationInfo* findEqual(const IR::IContainer* cont,
+                                  const IR::Vector<IR::Type>* typeArguments,
+                                  const IR::Vector<IR::Expression>* arguments, cstring& key);
+    void add(const IR::Node* invocation, SpecializationInfo* spec, cstring key);
 
  public:
     TypeMap*      typeMap;
@@ -84,7 +98,7 @@ class SpecializationMap {
             return nullptr;
         return s->name;
     }
-    void clear() { specializations.clear(); }
+    void clear() { specializations.clear(); distinct.clear(); byArguments.clear(); }
 };
 
 class FindSpecializations : public Inspector {
@@ -36,7 +36,9 @@ class StrengthReduction final : public Transform {
     int isPowerOf2(const IR::Expression* expr) const;
 
  public:
-    StrengthReduction() { visitDagOnce = true; setName("StrengthReduction"); }
+    StrengthReduction() {
+        visitDagOnce = true; releaseDiscardedClones = true; setName("StrengthReduction"); }
+    cstring fixpointKey() const override { return name(); }
 
     using Transform::postorder;
 
@@ -47,6 +47,8 @@ bool TypeVariableSubstitution::compose(const IR::ITypeVar* var, const IR::Type*
         if (bound.first == var)
             BUG("Variable %1% already bound", var->toString());
         const IR::Type* type = bound.second;
+        if (!mayContainTypeVariables(type))
+            continue;
         const IR::Node* newType = type->apply(visitor);
         if (newType == nullptr)
             return false;
@@ -15,21 +15,81 @@ limitations under the License.
 */
 
 #include "substitutionVisitor.h"
+#include "ir/node_id_map.h"
 
 namespace P4 {
 
+namespace {
+
+// Computes mayContainTypeVariables bottom-up for a node and all the types in it.
+class FindTypeVariables : public Inspector {
+    NodeIdMap<bool>*  found;  // for types only
+    std::vector<bool> contains;  // of the nodes being visited, the innermost last
+
+ public:
+    bool result = false;  // for the node the visitor is applied to
+
+    explicit FindTypeVariables(NodeIdMap<bool>* found) : found(found)
+    { visitDagOnce = false; setName("FindTypeVariables"); }
+    bool preorder(const IR::Node* node) override {
+        if (node->is<IR::Type>()) {
+            if (auto known = found->find(node)) {
+                if (contains.empty())
+                    result = *known;
+                else if (*known)
+                    contains.back() = true;
+                return false;
+            }
+        }
+        contains.push_back(node->is<IR::Type_Var>() || node->is<IR::Type_InfInt>() ||
+                           node->is<IR::Type_Name>() || node->is<IR::PathExpression>());
+        return true;
+    }
+    void postorder(const IR::Node* node) override {
+        bool any = contains.back();
+        contains.pop_back();
+        if (node->is<IR::Type>())
+            found->emplace(node, any);
+        if (contains.empty())
+            result = any;
+        else if (any)
+            contains.back() = true;
+    }
+};
+
+}  // namespace
+
+bool mayContainTypeVariables(const IR::Node* node) {
+    CHECK_NULL(node);
+    // Only types are kept, since they are small and widely shared.
+    // Per thread, as type checking may run on several threads.
+    static thread_local NodeIdMap<bool> found;
+    if (auto known = found.find(node))
+        return *known;
+    FindTypeVariables ftv(&found);
+    node->apply(ftv);
+    return ftv.result;
+}
+
 bool TypeOccursVisitor::preorder(const IR::Type_Var* typeVariable) {
-    if (*typeVariable == *(toFind->asType()))
+    if (matches(typeVariable))
         occurs = true;
     return occurs;
 }
 
 bool TypeOccursVisitor::preorder(const IR::Type_InfInt* typeVariable) {
-    if (*typeVariable == *(toFind->asType()))
+    if (matches(typeVariable))
         occurs = true;
     return occurs;
 }
 
+const IR::Node* TypeVariableSubstitutionVisitor::preorder(IR::Type* type) {
+    // nothing to substitute; this also keeps the type from being cloned
+    if (!mayContainTypeVariables(getOriginal()))
+        prune();
+    return type;
+}
+
 const IR::Node* TypeVariableSubstitutionVisitor::preorder(IR::TypeParameters *tps) {
     // remove all variables that were substituted
     auto result = new IR::IndexedVector<IR::Type_Var>();
@@ -65,6 +125,12 @@ const IR::Node* TypeVariableSubstitutionVisitor::preorder(IR::Type_InfInt* typeV
     return type;
 }
 
+const IR::Node* TypeNameSubstitutionVisitor::preorder(IR::Type* type) {
+    if (!mayContainTypeVariables(getOriginal()))
+        prune();
+    return type;
+}
+
 const IR::Node* TypeNameSubstitutionVisitor::preorder(IR::Type_Name* typeName) {
     auto type = bindings->lookup(typeName);
     if (type == nullptr)
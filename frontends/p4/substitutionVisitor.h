@@ -22,6 +22,14 @@ limitations under the License.
 
 namespace P4 {
 
+/**
+ * True if the node may contain type variables: Type_Var, Type_InfInt, or names,
+ * which may refer to type variables or parameters.  Substitutions and occurs
+ * checks skip the types for which this is false.  Types do not change, so the
+ * answer for each type node is computed once and kept.
+ */
+bool mayContainTypeVariables(const IR::Node* node);
+
 /**
  * See if a variable occurs in a Type.
  * If true, return null, else return the original type.
@@ -33,6 +41,11 @@ class TypeOccursVisitor : public Inspector {
 
     explicit TypeOccursVisitor(const IR::ITypeVar* toFind) : toFind(toFind), occurs(false)
     { setName("TypeOccurs"); }
+    // True if 'var', found in the type, is the variable looked for.
+    virtual bool matches(const IR::ITypeVar* var) const
+    { return *var->asType() == *toFind->asType(); }
+    bool preorder(const IR::Type* type) override
+    { return !occurs && mayContainTypeVariables(type); }
     bool preorder(const IR::Type_Var* typeVariable) override;
     bool preorder(const IR::Type_InfInt* infint) override;
 };
@@ -49,6 +62,7 @@ class TypeVariableSubstitutionVisitor : public Transform {
                                              bool replace = false)
             : bindings(bindings), replace(replace) { setName("TypeVariableSubstitution"); }
 
+    const IR::Node* preorder(IR::Type* type) override;
     const IR::Node* preorder(IR::TypeParameters *tps) override;
     const IR::Node* preorder(IR::Type_Var* typeVariable) override;
     const IR::Node* preorder(IR::Type_InfInt* typeVariable) override;
@@ -61,6 +75,7 @@ class TypeNameSubstitutionVisitor : public Transform {
  public:
     explicit TypeNameSubstitutionVisitor(const TypeNameSubstitution* bindings) :
             bindings(bindings) { setName("TypeNameSubstitution"); }
+    const IR::Node* preorder(IR::Type* type) override;
     const IR::Node* preorder(IR::Type_Name* typeName) override;
 };
 
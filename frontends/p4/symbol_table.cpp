@@ -52,9 +52,12 @@ class NamedSymbol {
     virtual bool sameType(const NamedSymbol* other) const {
         return typeid(*this) == typeid(*other);
     }
+    virtual bool isType() const { return false; }
 };
 
 class Namespace : public NamedSymbol {
+    friend class ProgramStructure;
+
  protected:
     std::unordered_map<cstring, NamedSymbol*> contents;
     bool allowDuplicates;
@@ -63,9 +66,10 @@ class Namespace : public NamedSymbol {
     Namespace(cstring name, Util::SourceInfo si, bool allowDuplicates) :
             NamedSymbol(name, si),
             allowDuplicates(allowDuplicates) {}
-    void declare(NamedSymbol* symbol) {
+    // Whether the symbol is now the one with its name in this namespace
+    bool declare(NamedSymbol* symbol) {
         cstring symname = symbol->getName();
-        if (symname.isNullOrEmpty()) return;
+        if (symname.isNullOrEmpty()) return false;
 
         auto it = contents.find(symname);
         if (it != contents.end()) {
@@ -73,16 +77,17 @@ class Namespace : public NamedSymbol {
             if (!it->second->sameType(symbol)) {
                 ::error("Re-declaration of %1%%2% with different type: %3%",
                         symbol->getName(), symbol->getSourceInfo(), it->second->getSourceInfo());
-                return;
+                return false;
             }
 
-            if (!allowDuplicates) {
+            if (!allowDuplicates)
                 ::error("Duplicate declaration of %1%%2%; previous at %3%",
                         symbol->getName(), symbol->getSourceInfo(), it->second->getSourceInfo());
-                return;
-            }
+            // the first one remains
+            return false;
         }
         contents.emplace(symbol->getName(), symbol);
+        return true;
     }
     NamedSymbol* lookup(cstring name) const {
         auto it = contents.find(name);
@@ -112,6 +117,7 @@ class SimpleType : public NamedSymbol {
  public:
     SimpleType(cstring name, Util::SourceInfo si) : NamedSymbol(name, si) {}
     cstring toString() const { return cstring("SimpleType ") + getName(); }
+    bool isType() const override { return true; }
 };
 
 // A Type that is also a namespace (e.g., a parser)
@@ -120,6 +126,7 @@ class ContainerType : public Namespace {
     ContainerType(cstring name, Util::SourceInfo si, bool allowDuplicates) :
             Namespace(name, si, allowDuplicates) {}
     cstring toString() const { return cstring("ContainerType ") + getName(); }
+    bool isType() const override { return true; }
 };
 
 /////////////////////////////////////////////////
@@ -141,9 +148,21 @@ void ProgramStructure::push(Namespace* ns) {
     if (debug)
         fprintf(debugStream, "ProgramStructure: pushing %s\n", ns->toString().c_str());
     BUG_CHECK(currentNamespace != nullptr, "Null currentNamespace");
-    currentNamespace->declare(ns);
+    declare(ns);
     ns->setParent(currentNamespace);
     currentNamespace = ns;
+    scopes.emplace_back();
+}
+
+void ProgramStructure::declare(NamedSymbol* symbol) {
+    if (!currentNamespace->declare(symbol))
+        return;
+    cstring name = symbol->getName();
+    visible[name].push_back(symbol);
+    if (!scopes.empty())
+        scopes.back().push_back(name);
+    if (symbol->isType())
+        typeNames.insert(name);
 }
 
 void ProgramStructure::pushNamespace(SourceInfo si, bool allowDuplicates) {
@@ -163,6 +182,13 @@ void ProgramStructure::pop() {
     if (debug)
         fprintf(debugStream, "ProgramStructure: popping %s\n",
                 currentNamespace->toString().c_str());
+    for (auto name : scopes.back()) {
+        auto it = visible.find(name);
+        it->second.pop_back();
+        if (it->second.empty())
+            visible.erase(it);
+    }
+    scopes.pop_back();
     currentNamespace = parent;
 }
 
@@ -171,7 +197,7 @@ void ProgramStructure::declareType(IR::ID id) {
         fprintf(debugStream, "ProgramStructure: adding type %s\n", id.name.c_str());
 
     auto st = new SimpleType(id.name, id.srcInfo);
-    currentNamespace->declare(st);
+    declare(st);
 }
 
 void ProgramStructure::declareObject(IR::ID id) {
@@ -179,7 +205,7 @@ void ProgramStructure::declareObject(IR::ID id) {
         fprintf(debugStream, "ProgramStructure: adding object %s\n", id.name.c_str());
 
     auto o = new Object(id.name, id.srcInfo);
-    currentNamespace->declare(o);
+    declare(o);
 }
 
 void ProgramStructure::startAbsolutePath() {
@@ -191,34 +217,28 @@ void ProgramStructure::clearPath() {
 }
 
 NamedSymbol* ProgramStructure::lookup(cstring identifier) const {
-    Namespace* parent = identifierContext.lookupContext;
-    if (parent == nullptr) {
-        // We don't have a parent, try lookup up the stack
-        parent = currentNamespace;
-        while (parent != nullptr) {
-            NamedSymbol* symbol = parent->lookup(identifier);
-            if (symbol != nullptr)
-                return symbol;
-            parent = parent->getParent();
-        }
-    }
-
-    if (parent == nullptr)
+    if (identifierContext.lookupContext != nullptr)
+        return identifierContext.lookupContext->lookup(identifier);
+    // the innermost declaration of the open scopes
+    auto it = visible.find(identifier);
+    if (it == visible.end())
         return nullptr;
-    return parent->lookup(identifier);
+    return it->second.back();
 }
 
 ProgramStructure::SymbolKind ProgramStructure::lookupIdentifier(cstring identifier) const {
-    NamedSymbol* ns = lookup(identifier);
-    if (ns == nullptr || dynamic_cast<Object*>(ns) != nullptr) {
+    // most identifiers, such as field and variable names, never name a type
+    if (typeNames.count(identifier) == 0) {
         LOG2("Identifier " << identifier);
         return ProgramStructure::SymbolKind::Identifier;
     }
-    if (dynamic_cast<SimpleType*>(ns) != nullptr || dynamic_cast<ContainerType*>(ns) != nullptr) {
-        return ProgramStructure::SymbolKind::Type;
-        LOG2("Type " << identifier);
+    NamedSymbol* ns = lookup(identifier);
+    if (ns == nullptr || !ns->isType()) {
+        LOG2("Identifier " << identifier);
+        return ProgramStructure::SymbolKind::Identifier;
     }
-    BUG("Should be unreachable");
+    LOG2("Type " << identifier);
+    return ProgramStructure::SymbolKind::Type;
 }
 
 void ProgramStructure::declareTypes(const IR::IndexedVector<IR::Type_Var>* typeVars) {
@@ -233,6 +253,39 @@ void ProgramStructure::endParse() {
               "Namespace stack is not empty at the end of parsing");
 }
 
+std::vector<ProgramStructure::TopLevelSymbol> ProgramStructure::topLevelSymbols() const {
+    std::vector<TopLevelSymbol> result;
+    for (auto &it : rootNamespace->contents) {
+        auto kind = TopLevelSymbol::Kind::Object;
+        if (dynamic_cast<ContainerType*>(it.second) != nullptr)
+            kind = TopLevelSymbol::Kind::Container;
+        else if (dynamic_cast<SimpleType*>(it.second) != nullptr)
+            kind = TopLevelSymbol::Kind::Type;
+        result.push_back({ it.first, it.second->getSourceInfo(), kind });
+    }
+    return result;
+}
+
+void ProgramStructure::declareTopLevel(const TopLevelSymbol &symbol) {
+    NamedSymbol* declared;
+    switch (symbol.kind) {
+        case TopLevelSymbol::Kind::Container:
+            // its own scope is never looked into again once it is closed
+            declared = new ContainerType(symbol.name, symbol.srcInfo, false);
+            break;
+        case TopLevelSymbol::Kind::Type:
+            declared = new SimpleType(symbol.name, symbol.srcInfo);
+            break;
+        default:
+            declared = new Object(symbol.name, symbol.srcInfo);
+            break;
+    }
+    BUG_CHECK(currentNamespace == rootNamespace, "%1%: not declared at the top level",
+              symbol.name);
+    declared->setParent(rootNamespace);
+    declare(declared);
+}
+
 cstring ProgramStructure::toString() const {
     std::stringstream res;
     rootNamespace->dump(res, 0);
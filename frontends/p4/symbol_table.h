@@ -23,6 +23,7 @@ limitations under the License.
    the v1.2 grammar is ambiguous without type information */
 
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "ir/ir.h"
@@ -48,8 +49,18 @@ class ProgramStructure final {
         PathContext() : lookupContext(nullptr) {}
     } identifierContext;
 
+    // The lexer looks up every identifier, so the symbols that are visible are kept
+    // apart from the namespaces: for each name, those of the open scopes that declare
+    // it, innermost last, and for each open scope below the root, the names it
+    // declares, which are hidden again when it is closed.
+    std::unordered_map<cstring, std::vector<NamedSymbol*>> visible;
+    std::vector<std::vector<cstring>> scopes;
+    // The names that were ever declared as types; no other identifier is one
+    std::unordered_set<cstring> typeNames;
+
     void push(Namespace* ns);
     NamedSymbol* lookup(const cstring identifier) const;
+    // Declares the symbol in the current namespace
     void declare(NamedSymbol* symbol);
 
  public:
@@ -58,6 +69,15 @@ class ProgramStructure final {
         Type
     };
 
+    // A symbol of the outermost scope, which is all that a later part of the
+    // program can see of the declarations before it
+    struct TopLevelSymbol {
+        enum class Kind { Object, Type, Container };
+        cstring     name;
+        SourceInfo  srcInfo;
+        Kind        kind;
+    };
+
     ProgramStructure();
 
     void setDebug(bool debug) { this->debug = debug; }
@@ -77,6 +97,12 @@ class ProgramStructure final {
 
     void endParse();
 
+    // The symbols of the outermost scope, in no particular order
+    std::vector<TopLevelSymbol> topLevelSymbols() const;
+    // Declares a symbol in the outermost scope, as recorded by topLevelSymbols,
+    // so that declarations that were not parsed in this run can be looked up
+    void declareTopLevel(const TopLevelSymbol &symbol);
+
     cstring toString() const;
 };
 
@@ -62,4 +62,40 @@ TableApplySolver::isActionRun(const IR::Expression* expression,
     return am->object->to<IR::P4Table>();
 }
 
+Visitor::profile_t TableApplyIndex::init_apply(const IR::Node* node) {
+    sites.clear();
+    hits.clear();
+    actionRuns.clear();
+    return Inspector::init_apply(node);
+}
+
+void TableApplyIndex::postorder(const IR::MethodCallExpression* expression) {
+    auto mi = P4::MethodInstance::resolve(expression, refMap, typeMap);
+    auto am = mi->to<P4::ApplyMethod>();
+    if (am == nullptr || !am->object->is<IR::P4Table>())
+        return;
+    auto table = am->object->to<IR::P4Table>();
+    auto parent = getContext()->node;
+    Site site = { expression, Use::Other, parent };
+    if (parent->is<IR::MethodCallStatement>()) {
+        site.use = Use::Statement;
+    } else if (auto member = parent->to<IR::Member>()) {
+        if (member->member == IR::Type_Table::hit) {
+            site.use = Use::Hit;
+            hits.emplace(member, table);
+        } else if (member->member == IR::Type_Table::action_run) {
+            site.use = Use::ActionRun;
+            actionRuns.emplace(member, table);
+        }
+    }
+    sites[table].push_back(site);
+}
+
+const std::vector<TableApplyIndex::Site>&
+TableApplyIndex::sitesOf(const IR::P4Table* table) const {
+    static const std::vector<Site> none;
+    auto it = sites.find(table);
+    return it != sites.end() ? it->second : none;
+}
+
 }  // namespace P4
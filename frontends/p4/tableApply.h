@@ -39,6 +39,41 @@ class TableApplySolver {
                                           ReferenceMap* refMap, TypeMap* typeMap);
 };
 
+// Where the tables are applied in a program, and how the result of each application
+// is used, found in a single pass, so that a backend that looks at a program that no
+// longer changes can look these up rather than resolve each expression again.  The
+// index describes the program it was applied to: a pass that changes the program must
+// apply it again.
+class TableApplyIndex : public Inspector {
+    ReferenceMap* refMap;
+    TypeMap*      typeMap;
+
+ public:
+    enum class Use { Statement, Hit, ActionRun, Other };
+    struct Site {
+        const IR::MethodCallExpression* call;   // table.apply()
+        Use                             use;
+        const IR::Node*                 user;   // the statement or the member, or the parent
+    };
+    // the applications of each table, in the order of the program
+    std::map<const IR::P4Table*, std::vector<Site>> sites;
+    // the tables of the table.apply().hit and the table.apply().action_run expressions
+    std::map<const IR::Expression*, const IR::P4Table*> hits, actionRuns;
+
+    TableApplyIndex(ReferenceMap* refMap, TypeMap* typeMap) : refMap(refMap), typeMap(typeMap)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("TableApplyIndex"); }
+    Visitor::profile_t init_apply(const IR::Node* node) override;
+    void postorder(const IR::MethodCallExpression* expression) override;
+
+    // as the methods of TableApplySolver, for the expressions of the program
+    const IR::P4Table* isHit(const IR::Expression* expression) const
+    { auto it = hits.find(expression); return it != hits.end() ? it->second : nullptr; }
+    const IR::P4Table* isActionRun(const IR::Expression* expression) const {
+        auto it = actionRuns.find(expression);
+        return it != actionRuns.end() ? it->second : nullptr; }
+    const std::vector<Site>& sitesOf(const IR::P4Table* table) const;
+};
+
 }  // namespace P4
 
 #endif /* _FRONTENDS_P4_TABLEAPPLY_H_ */
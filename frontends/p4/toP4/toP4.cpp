@@ -27,11 +27,8 @@ Visitor::profile_t ToP4::init_apply(const IR::Node* node) {
 }
 
 void ToP4::end_apply(const IR::Node*) {
-    if (outStream != nullptr) {
-        cstring result = builder.toString();
-        *outStream << result.c_str();
-        outStream->flush();
-    }
+    if (outStream != nullptr)
+        builder.flush();
 }
 
 // Try to guess whether a file is a "system" file
@@ -181,12 +178,12 @@ bool ToP4::preorder(const IR::P4Program* program) {
 }
 
 bool ToP4::preorder(const IR::Type_Bits* t) {
-    builder.appendFormat(t->toString());
+    builder.append(t->toString());
     return false;
 }
 
 bool ToP4::preorder(const IR::Type_InfInt* t) {
-    builder.appendFormat(t->toString());
+    builder.append(t->toString());
     return false;
 }
 
@@ -387,14 +384,14 @@ bool ToP4::process(const IR::Type_StructLike* t, const char* name) {
     builder.spc();
     builder.blockStart();
 
-    std::map<const IR::StructField*, cstring> type;
+    std::map<const IR::StructField*, std::string> type;
     size_t len = 0;
     for (auto f : *t->fields) {
         Util::SourceCodeBuilder builder;
         ToP4 rec(builder, showIR);
 
         f->type->apply(rec);
-        cstring t = builder.toString();
+        std::string t = builder.toString();
         if (t.size() > len)
             len = t.size();
         type.emplace(f, t);
@@ -408,7 +405,7 @@ bool ToP4::process(const IR::Type_StructLike* t, const char* name) {
             builder.newline();
         }
         builder.emitIndent();
-        cstring t = get(type, f);
+        const std::string &t = type.at(f);
         builder.append(t);
         size_t spaces = len + 1 - t.size();
         builder.append(std::string(spaces, ' '));
@@ -1119,14 +1116,14 @@ bool ToP4::preorder(const IR::Key* v) {
     dump(2);
     builder.blockStart();
 
-    std::map<const IR::KeyElement*, cstring> kf;
+    std::map<const IR::KeyElement*, std::string> kf;
     size_t len = 0;
     for (auto f : *v->keyElements) {
         Util::SourceCodeBuilder builder;
         ToP4 rec(builder, showIR);
 
         f->expression->apply(rec);
-        cstring s = builder.toString();
+        std::string s = builder.toString();
         if (s.size() > len)
             len = s.size();
         kf.emplace(f, s);
@@ -1135,7 +1132,7 @@ bool ToP4::preorder(const IR::Key* v) {
     for (auto f : *v->keyElements) {
         dump(2, f, 2);
         builder.emitIndent();
-        cstring s = get(kf, f);
+        const std::string &s = kf.at(f);
         builder.append(s);
         size_t spaces = len - s.size();
         builder.append(std::string(spaces, ' '));
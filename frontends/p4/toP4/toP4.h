@@ -77,10 +77,7 @@ class ToP4 : public Inspector {
  public:
     // Output is constructed here
     Util::SourceCodeBuilder& builder;
-    /* FIXME  -- simplify this by getting rid of the 'builder' object and just emitting
-     * directly to the ostream.  The SourceCodeBuilder object does not appear to add any
-     * useful functionality the ostream does not already provide; it just serves to
-     * obfuscate the code */
+    // If not null, the builder writes the program to it as it goes
     std::ostream* outStream;
     // If this is set to non-nullptr, some declarations
     // that come from libraries and models are not
@@ -99,7 +96,7 @@ class ToP4 : public Inspector {
             expressionPrecedence(DBPrint::Prec_Low),
             isDeclaration(true),
             showIR(showIR),
-            builder(* new Util::SourceCodeBuilder()),
+            builder(* new Util::SourceCodeBuilder(outStream)),
             outStream(outStream),
             mainFile(mainFile)
     { visitDagOnce = false; setName("ToP4"); }
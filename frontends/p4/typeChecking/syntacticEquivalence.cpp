@@ -34,8 +34,74 @@ bool SameExpression::sameExpressions(const IR::Vector<IR::Expression>* left,
     return true;
 }
 
+size_t SameExpression::typeHash(const IR::Type* type) const {
+    return TypeMap::hash(typeMap->getType(type, true));
+}
+
+size_t SameExpression::hash(const IR::Expression* expression) const {
+    CHECK_NULL(expression);
+    if (auto known = hashes.find(expression))
+        return *known;
+    size_t result = expression->node_type_name().hash();
+    if (expression->is<IR::Operation_Unary>()) {
+        if (auto member = expression->to<IR::Member>())
+            result = IR::hash_combine(result, member->member.name.hash());
+        else if (auto cast = expression->to<IR::Cast>())
+            result = IR::hash_combine(result, typeHash(cast->type));
+        result = IR::hash_combine(result, hash(expression->to<IR::Operation_Unary>()->expr));
+    } else if (auto binary = expression->to<IR::Operation_Binary>()) {
+        result = IR::hash_combine(result, hash(binary->left));
+        result = IR::hash_combine(result, hash(binary->right));
+    } else if (auto ternary = expression->to<IR::Operation_Ternary>()) {
+        result = IR::hash_combine(result, hash(ternary->e0));
+        result = IR::hash_combine(result, hash(ternary->e1));
+        result = IR::hash_combine(result, hash(ternary->e2));
+    } else if (auto constant = expression->to<IR::Constant>()) {
+        result = IR::hash_combine(result, IR::hash_field(constant->value));
+    } else if (expression->is<IR::Literal>()) {
+        result = expression->structural_hash();
+    } else if (auto pe = expression->to<IR::PathExpression>()) {
+        auto decl = refMap->getDeclaration(pe->path, true);
+        result = IR::hash_combine(result, std::hash<const void*>()(decl));
+    } else if (auto tne = expression->to<IR::TypeNameExpression>()) {
+        auto decl = refMap->getDeclaration(tne->typeName->path, true);
+        result = IR::hash_combine(result, std::hash<const void*>()(decl));
+    } else if (auto list = expression->to<IR::ListExpression>()) {
+        for (auto c : *list->components)
+            result = IR::hash_combine(result, hash(c));
+    } else if (auto mce = expression->to<IR::MethodCallExpression>()) {
+        result = IR::hash_combine(result, hash(mce->method));
+        for (auto t : *mce->typeArguments)
+            result = IR::hash_combine(result, typeHash(t));
+        for (auto a : *mce->arguments)
+            result = IR::hash_combine(result, hash(a));
+    } else if (auto cce = expression->to<IR::ConstructorCallExpression>()) {
+        result = IR::hash_combine(result, typeHash(cce->constructedType));
+        for (auto a : *cce->arguments)
+            result = IR::hash_combine(result, hash(a));
+    } else {
+        BUG("%1%: Unexpected expression", expression);
+    }
+    hashes.emplace(expression, result);
+    return result;
+}
+
 bool SameExpression::sameExpression(const IR::Expression* left, const IR::Expression* right) const {
     CHECK_NULL(left); CHECK_NULL(right);
+    if (left == right)
+        return true;
+    if (hash(left) != hash(right))
+        return false;
+    auto key = std::make_pair(left, right);
+    auto it = compared.find(key);
+    if (it != compared.end())
+        return it->second;
+    bool result = compare(left, right);
+    compared.emplace(key, result);
+    return result;
+}
+
+bool SameExpression::compare(const IR::Expression* left, const IR::Expression* right) const {
     if (left->node_type_name() != right->node_type_name())
         return false;
     if (left->is<IR::Operation_Unary>()) {
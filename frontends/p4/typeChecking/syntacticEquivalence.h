@@ -18,15 +18,25 @@ limitations under the License.
 #define _TYPECHECKING_SYNTACTICEQUIVALENCE_H_
 
 #include "ir/ir.h"
+#include "ir/node_id_map.h"
 #include "frontends/p4/typeMap.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
 
 namespace P4 {
 
-// Check if two expressions are syntactically equivalent
+// Check if two expressions are syntactically equivalent.
+// Each expression is hashed once, consistently with the equivalence, so that
+// most different expressions are told apart by their hashes; the results of
+// comparisons are kept, so asking again about the same pair is a lookup.
+// The maps must not change while an instance is in use.
 class SameExpression {
     const ReferenceMap* refMap;
     const TypeMap* typeMap;
+    mutable NodeIdMap<size_t> hashes;
+    mutable std::map<std::pair<const IR::Expression*, const IR::Expression*>, bool> compared;
+
+    bool compare(const IR::Expression* left, const IR::Expression* right) const;
+    size_t typeHash(const IR::Type* type) const;
  public:
     explicit SameExpression(const ReferenceMap* refMap, const TypeMap* typeMap) :
             refMap(refMap), typeMap(typeMap) { CHECK_NULL(refMap); CHECK_NULL(typeMap); }
@@ -34,6 +44,8 @@ class SameExpression {
     bool sameExpression(const IR::Expression* left, const IR::Expression* right) const;
     bool sameExpressions(const IR::Vector<IR::Expression>* left,
                          const IR::Vector<IR::Expression>* right) const;
+    // Equivalent expressions have the same hash.
+    size_t hash(const IR::Expression* expression) const;
 };
 
 }  // namespace P4
@@ -14,6 +14,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <exception>
 #include "typeChecker.h"
 #include "typeUnification.h"
 #include "frontends/p4/substitution.h"
@@ -21,6 +22,7 @@ limitations under the License.
 #include "syntacticEquivalence.h"
 #include "frontends/common/resolveReferences/resolveReferences.h"
 #include "frontends/p4/methodInstance.h"
+#include "lib/parallel.h"
 
 namespace P4 {
 
@@ -521,10 +523,134 @@ const IR::Node* TypeInference::preorder(IR::P4Program* program) {
     if (typeMap->checkMap(getOriginal()) && readOnly) {
         LOG1("No need to typecheck");
         prune();
+    } else if (threads != 1) {
+        checkInPhases(program);
+        prune();
     }
     return program;
 }
 
+// Checks the program in the two phases described with 'threads'.
+void TypeInference::checkInPhases(IR::P4Program* program) {
+    // the declarations whose bodies are left for the second phase
+    std::vector<size_t> pending;
+    size_t count = program->declarations->size();
+    for (size_t i = 0; i < count; ++i) {
+        auto decl = program->declarations->at(i);
+        if ((decl->is<IR::P4Control>() || decl->is<IR::P4Parser>() ||
+             decl->is<IR::P4Action>() || decl->is<IR::Function>()) && !typeMap->contains(decl))
+            pending.push_back(i);
+    }
+
+    phase = Phase::Signatures;
+    visit(program->declarations, "declarations");
+    phase = Phase::All;
+    auto decls = program->declarations;
+    BUG_CHECK(decls->size() == count, "%1%: declarations changed while type checking", program);
+
+    std::vector<TypeMap*> shards(pending.size());
+    std::vector<const IR::Node*> results(pending.size());
+    std::vector<std::exception_ptr> errors(pending.size());
+    // the messages of the check of each body that is kept, reported in order
+    std::vector<ErrorReporter::Buffer> messages(pending.size());
+    // the names of the fresh type variables, as a serial run would generate them
+    std::vector<ReferenceMap::NameReservation> names(
+        pending.size(), ReferenceMap::NameReservation(refMap));
+    auto check = [&](size_t i, bool reserve) {
+        shards[i] = new TypeMap(typeMap);
+        TypeInference bodies(refMap, shards[i], readOnly);
+        bodies.phase = Phase::Bodies;
+        if (reserve) names[i].activate();
+        messages[i] = ErrorReporter::Buffer();
+        auto previous = ErrorReporter::instance.bufferTo(&messages[i]);
+        try {
+            results[i] = decls->at(pending[i])->apply(bodies);
+        } catch (...) {
+            errors[i] = std::current_exception(); }
+        ErrorReporter::instance.bufferTo(previous);
+        if (reserve) names[i].deactivate();
+    };
+    Util::parallel_for(pending.size(), threads, [&](size_t i) { check(i, true); });
+
+    bool changed = false;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (!errors[i] && !names[i].commit()) {
+            // check it again after the ones before it, as a serial run would
+            check(i, false);
+        }
+        ErrorReporter::instance.merge(messages[i]);
+        if (errors[i])
+            std::rethrow_exception(errors[i]);
+        typeMap->merge(shards[i]);
+        changed = changed || results[i] != decls->at(pending[i]);
+    }
+    if (!changed)
+        return;
+    auto result = new IR::IndexedVector<IR::Node>();
+    for (size_t i = 0, next = 0; i < count; ++i) {
+        if (next < pending.size() && pending[next] == i)
+            result->push_back(results[next++]);
+        else
+            result->push_back(decls->at(i));
+    }
+    program->declarations = result;
+}
+
+bool TypeInference::checkingSignature() const {
+    return phase == Phase::Signatures && getContext()->parent != nullptr &&
+            getContext()->parent->node->is<IR::P4Program>();
+}
+
+// The declaration whose body is checked in the Bodies phase was typed in the
+// Signatures phase; the node it is transformed into gets the same type.
+const IR::Node* TypeInference::bodyChecked(const IR::Node* decl) {
+    if (auto type = typeMap->getType(getOriginal()))
+        setType(decl, type);
+    prune();
+    return decl;
+}
+
+const IR::Node* TypeInference::preorder(IR::P4Control* cont) {
+    if (checkingBody()) {
+        visit(cont->controlLocals, "controlLocals");
+        visit(cont->body, "body");
+        return bodyChecked(cont);
+    }
+    if (!checkingSignature() || done())
+        return pruneIfDone(cont);
+    visit(cont->type, "type");
+    visit(cont->constructorParams, "constructorParams");
+    prune();
+    return postorder(cont);
+}
+
+const IR::Node* TypeInference::preorder(IR::P4Parser* parser) {
+    if (checkingBody()) {
+        visit(parser->parserLocals, "parserLocals");
+        visit(parser->states, "states");
+        return bodyChecked(parser);
+    }
+    if (!checkingSignature() || done())
+        return pruneIfDone(parser);
+    visit(parser->type, "type");
+    visit(parser->constructorParams, "constructorParams");
+    prune();
+    return postorder(parser);
+}
+
+const IR::Node* TypeInference::preorder(IR::P4Action* action) {
+    if (checkingBody()) {
+        visit(action->body, "body");
+        return bodyChecked(action);
+    }
+    if (!checkingSignature() || done())
+        return pruneIfDone(action);
+    visit(action->annotations, "annotations");
+    visit(action->parameters, "parameters");
+    prune();
+    return postorder(action);
+}
+
 const IR::Node* TypeInference::postorder(IR::Type_Error* decl) {
     (void)setTypeType(decl);
     for (auto id : *decl->getDeclarations())
@@ -791,8 +917,9 @@ bool TypeInference::checkAbstractMethods(const IR::Declaration_Instance* inst,
 const IR::Node* TypeInference::preorder(IR::Declaration_Instance* decl) {
     // We need to control the order of the type-checking: we want to do first
     // the declaration, and then typecheck the initializer if present.
-    if (done())
-        return decl;
+    if (done()) {
+        prune();
+        return decl; }
     visit(decl->type);
     visit(decl->arguments);
     visit(decl->annotations);
@@ -874,7 +1001,7 @@ TypeInference::containerInstantiation(
     // There are never type arguments at this point; if they exist, they have been folded
     // into the constructor by type specialization.
     auto callType = new IR::Type_MethodCall(node->srcInfo,
-                                            new IR::Vector<IR::Type>(),
+                                            IR::Vector<IR::Type>::emptyInstance(),
                                             rettype, args);
     TypeConstraints constraints;
     constraints.addEqualityConstraint(constructor, callType);
@@ -889,14 +1016,20 @@ TypeInference::containerInstantiation(
 }
 
 const IR::Node* TypeInference::preorder(IR::Function* function) {
-    if (done()) return function;
+    if (checkingBody()) {
+        visit(function->body);
+        return bodyChecked(function); }
+    if (done()) {
+        prune();
+        return function; }
     visit(function->type);
     auto type = getTypeType(function->type);
     if (type == nullptr)
         return function;
     setType(getOriginal(), type);
     setType(function, type);
-    visit(function->body);
+    if (!checkingSignature())
+        visit(function->body);
     prune();
     return function;
 }
@@ -2100,6 +2233,9 @@ const IR::Node* TypeInference::postorder(IR::Member* expression) {
 }
 
 const IR::Node* TypeInference::preorder(IR::MethodCallExpression* expression) {
+    if (done()) {
+        prune();
+        return expression; }
     // enable method resolution based on number of arguments
     methodArguments.push_back(expression->arguments->size());
     return expression;
@@ -74,12 +74,26 @@ class TypeInference : public Transform {
     std::vector<int> methodArguments;
     const IR::Node* initialNode;
 
+    // Which parts of the top-level controls, parsers, actions and functions are
+    // visited: all, only their signatures, or only the body of the one declaration
+    // that the visitor is applied to.
+    enum class Phase { All, Signatures, Bodies };
+    Phase phase = Phase::All;
+
  public:
     // If readOnly=true it will assert that it behaves like
     // an Inspector.
     TypeInference(ReferenceMap* refMap, TypeMap* typeMap,
                   bool readOnly = false);
 
+    // Threads that check a program, 0 for one per hardware thread.  With other than
+    // 1, the program is checked in two phases: first, in order, the declarations and
+    // the signatures of the top-level controls, parsers, actions and functions; then
+    // their bodies, which only depend on those, on several threads, each with its
+    // own shard of the TypeMap.  The shards are merged in the order of the
+    // declarations, so the result is the same as that of a serial run.
+    unsigned threads = 1;
+
  protected:
     const IR::Type* getType(const IR::Node* element) const;
     const IR::Type* getTypeType(const IR::Node* element) const;
@@ -150,6 +164,14 @@ class TypeInference : public Transform {
     bool checkParameters(const IR::ParameterList* paramList, bool forbidModules = false) const;
     const IR::Type* setTypeType(const IR::Type* type, bool learn = true);
 
+    void checkInPhases(IR::P4Program* program);
+    // whether only the signature of the node visited is checked now
+    bool checkingSignature() const;
+    // whether only the body of the node visited is checked now
+    bool checkingBody() const
+    { return phase == Phase::Bodies && getOriginal() == initialNode; }
+    const IR::Node* bodyChecked(const IR::Node* decl);
+
     //////////////////////////////////////////////////////////////
 
  public:
@@ -158,18 +180,27 @@ class TypeInference : public Transform {
 
     static const IR::Type* specialize(const IR::IMayBeGenericType* type,
                                       const IR::Vector<IR::Type>* arguments);
+    // A node that already has a type survived unchanged from an earlier run
+    // (Transform preserves the identity of unchanged nodes), so its whole
+    // subtree is typed too: only new or modified parts of the program
+    // are inferred again, unless the map was cleared by ClearTypeMap.
     const IR::Node* pruneIfDone(const IR::Node* node)
     { if (done()) { prune(); } return node; }
     const IR::Node* preorder(IR::Expression* expression) override
     { return pruneIfDone(expression); }
     const IR::Node* preorder(IR::Type* type) override
     { return pruneIfDone(type); }
+    const IR::Node* preorder(IR::Declaration* decl) override
+    { return pruneIfDone(decl); }
 
     // do functions pre-order so we can check the prototype
     // before the returns
     const IR::Node* preorder(IR::Function* function) override;
     const IR::Node* preorder(IR::P4Program* program) override;
     const IR::Node* preorder(IR::Declaration_Instance* decl) override;
+    const IR::Node* preorder(IR::P4Control* cont) override;
+    const IR::Node* preorder(IR::P4Parser* parser) override;
+    const IR::Node* preorder(IR::P4Action* action) override;
 
     const IR::Node* postorder(IR::Declaration_MatchKind* decl) override;
     const IR::Node* postorder(IR::Declaration_Variable* decl) override;
@@ -14,46 +14,130 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <chrono>
+#include <functional>
 #include "typeConstraints.h"
+#include "frontends/p4/substitutionVisitor.h"
 #include "typeUnification.h"
 
 namespace P4 {
 
-bool TypeConstraints::solve(const IR::Node* root, EqualityConstraint *constraint,
-                            TypeVariableSubstitution *subst, bool reportErrors) {
-    if (isUnifiableTypeVariable(constraint->left)) {
-        auto leftTv = constraint->left->to<IR::ITypeVar>();
-        if (constraint->left == constraint->right)
-            return true;
-
-        // check to see whether we already have a substitution for leftTv
-        const IR::Type* leftSubst = subst->lookup(leftTv);
-        if (leftSubst == nullptr) {
-            LOG1("Binding " << leftTv << " => " << constraint->right);
-            return subst->compose(leftTv, constraint->right);
-        } else {
-            addEqualityConstraint(leftSubst, constraint->right);
-            return true;
-        }
-    }
+namespace {
 
-    if (isUnifiableTypeVariable(constraint->right)) {
-        auto rightTv = constraint->right->to<IR::ITypeVar>();
-        const IR::Type* rightSubst = subst->lookup(rightTv);
-        if (rightSubst == nullptr) {
-            LOG1("Binding " << rightTv << " => " << constraint->left);
-            return subst->compose(rightTv, constraint->left);
-        } else {
-            addEqualityConstraint(constraint->left, rightSubst);
-            return true;
-        }
+// Finds whether a variable of a class of the union-find structure occurs in a type
+class OccursInClass : public TypeOccursVisitor {
+    std::function<const IR::ITypeVar*(const IR::ITypeVar*)> find;
+ public:
+    OccursInClass(const IR::ITypeVar* root,
+                  std::function<const IR::ITypeVar*(const IR::ITypeVar*)> find) :
+            TypeOccursVisitor(root), find(find) {}
+    bool matches(const IR::ITypeVar* var) const override
+    { return TypeOccursVisitor::matches(var) || find(var) == toFind; }
+};
+
+}  // namespace
+
+const IR::ITypeVar* TypeConstraints::find(const IR::ITypeVar* tv) {
+    auto it = parent.emplace(tv, tv).first;
+    if (it->second == tv)
+        return tv;
+    auto root = find(it->second);
+    it->second = root;
+    return root;
+}
+
+bool TypeConstraints::bind(const IR::ITypeVar* tv, const IR::Type* type) {
+    auto root = find(tv);
+    auto it = bound.find(root);
+    if (it != bound.end()) {
+        addEqualityConstraint(it->second, type);
+        return true;
     }
 
+    // The substitution is not legal if any variable of the class occurs in the type
+    OccursInClass occurs(root, [this](const IR::ITypeVar* v) {
+        auto it = parent.find(v);
+        return it == parent.end() ? v : find(v); });
+    type->apply(occurs);
+    if (occurs.occurs)
+        return false;
+    LOG1("Binding " << tv << " => " << type);
+    bound.emplace(root, type);
+    return true;
+}
+
+bool TypeConstraints::unifyVariables(const IR::ITypeVar* left, const IR::ITypeVar* right) {
+    auto leftRoot = find(left);
+    auto rightRoot = find(right);
+    if (leftRoot == rightRoot)
+        return true;
+
+    LOG1("Unifying " << left << " with " << right);
+    parent[leftRoot] = rightRoot;
+    auto leftBound = bound.find(leftRoot);
+    if (leftBound == bound.end())
+        return true;
+    auto leftType = leftBound->second;
+    bound.erase(leftBound);
+    return bind(rightRoot, leftType);
+}
+
+bool TypeConstraints::solve(const IR::Node* root, EqualityConstraint *constraint,
+                            bool reportErrors) {
+    if (constraint->left == constraint->right)
+        return true;
+
+    bool leftVar = isUnifiableTypeVariable(constraint->left);
+    bool rightVar = isUnifiableTypeVariable(constraint->right);
+    if (leftVar && rightVar)
+        return unifyVariables(constraint->left->to<IR::ITypeVar>(),
+                              constraint->right->to<IR::ITypeVar>());
+    if (leftVar)
+        return bind(constraint->left->to<IR::ITypeVar>(), constraint->right);
+    if (rightVar)
+        return bind(constraint->right->to<IR::ITypeVar>(), constraint->left);
+
     bool success = unification->unify(root, constraint->left, constraint->right, reportErrors);
     // this may add more constraints
     return success;
 }
 
+TypeVariableSubstitution* TypeConstraints::solve(const IR::Node* root, bool reportErrors) {
+    LOG1("Solving constraints:\n" << *this);
+
+    std::chrono::steady_clock::time_point start;
+    if (Visitor::profile_t::collect)
+        start = std::chrono::steady_clock::now();
+    uint64_t solved = 0;
+    bool success = true;
+    while (success && !constraints.empty()) {
+        auto last = constraints.back();
+        constraints.pop_back();
+        success = solve(root, last, reportErrors);
+        ++solved;
+    }
+    if (Visitor::profile_t::collect) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        Visitor::profile_t::count("type_constraints", solved);
+        Visitor::profile_t::count("type_constraint_solve_nsec",
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+    if (!success)
+        return nullptr;
+
+    auto tvs = new TypeVariableSubstitution();
+    for (auto v : parent) {
+        auto root = find(v.first);
+        auto type = ::get(bound, root);
+        if (type == nullptr && root != v.first)
+            type = root->asType();
+        if (type != nullptr)
+            tvs->setBinding(v.first, type);
+    }
+    LOG1("Constraint solution:\n" << tvs);
+    return tvs;
+}
+
 void TypeConstraints::dbprint(std::ostream& out) const {
     bool first = true;
     if (unifiableTypeVariables.size() != 0) {
@@ -17,6 +17,7 @@ limitations under the License.
 #ifndef _TYPECHECKING_TYPECONSTRAINTS_H_
 #define _TYPECHECKING_TYPECONSTRAINTS_H_
 
+#include <map>
 #include <sstream>
 #include "ir/ir.h"
 #include "typeUnification.h"
@@ -73,6 +74,20 @@ class TypeConstraints final {
     std::vector<IConstraint*> constraints;
     TypeUnification *unification;
 
+    /*
+     * Type variables are unified with a union-find structure: variables
+     * which must be equal are in the same equivalence class, and a class
+     * is bound to at most one type which is not a unifiable variable.
+     * Binding a variable therefore never rewrites the other bindings.
+     */
+    std::map<const IR::ITypeVar*, const IR::ITypeVar*> parent;  // roots map to themselves
+    std::map<const IR::ITypeVar*, const IR::Type*> bound;  // type for each bound root
+
+    // Representative of the class of 'tv', with path compression.
+    const IR::ITypeVar* find(const IR::ITypeVar* tv);
+    bool bind(const IR::ITypeVar* tv, const IR::Type* type);
+    bool unifyVariables(const IR::ITypeVar* left, const IR::ITypeVar* right);
+
  public:
     TypeConstraints() : unification(new TypeUnification(this)) {}
 
@@ -99,36 +114,26 @@ class TypeConstraints final {
     /*
      * Solve the specified constraint.
      * @param root       Element where error is signalled if necessary.
-     * @param subst      Variable substitution which is updated with new constraints.
      * @param constraint Constraint to solve.
      * @param reportErrors If true report errors.
      * @return           True on success.
      */
-    bool solve(const IR::Node* root, IConstraint* constraint,
-               TypeVariableSubstitution *subst, bool reportErrors) {
+    bool solve(const IR::Node* root, IConstraint* constraint, bool reportErrors) {
         auto eq = dynamic_cast<EqualityConstraint*>(constraint);
         if (eq != nullptr)
-            return solve(root, eq, subst, reportErrors);
+            return solve(root, eq, reportErrors);
         BUG("unexpected type constraint");
     }
 
-    bool solve(const IR::Node* root, EqualityConstraint *constraint,
-               TypeVariableSubstitution *subst, bool reportErrors);
-
-    TypeVariableSubstitution* solve(const IR::Node* root, bool reportErrors) {
-        LOG1("Solving constraints:\n" << *this);
+    bool solve(const IR::Node* root, EqualityConstraint *constraint, bool reportErrors);
 
-        auto tvs = new TypeVariableSubstitution();
-        while (!constraints.empty()) {
-            auto last = constraints.back();
-            constraints.pop_back();
-            bool success = solve(root, last, tvs, reportErrors);
-            if (!success)
-                return nullptr;
-        }
-        LOG1("Constraint solution:\n" << tvs);
-        return tvs;
-    }
+    /*
+     * Solve all constraints.  Each variable in the result is bound to the
+     * type of its class, or to the class representative if the class is
+     * not bound to a type.
+     * @return           The substitution, or nullptr on failure.
+     */
+    TypeVariableSubstitution* solve(const IR::Node* root, bool reportErrors);
     void dbprint(std::ostream& out) const;
 };
 }  // namespace P4
@@ -14,21 +14,25 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#ifdef MULTITHREAD
+#include <mutex>
+#endif  // MULTITHREAD
 #include "typeMap.h"
 #include "lib/map.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
 
 namespace P4 {
 
 void TypeMap::dbprint(std::ostream& out) const {
-    out << "TypeMap for " << dbp(program) << std::endl;
-    for (auto it : typeMap)
-        out << "\t" << dbp(it.first) << "->" << dbp(it.second) << std::endl;
+    out << "TypeMap for P4Program(" << mapProgramId() << ")" << std::endl;
+    typeMap.for_each([&out](const IR::Node* node, const IR::Type* type) {
+        out << "\t" << dbp(node) << "->" << dbp(type) << std::endl; });
     out << "Left values" << std::endl;
-    for (auto it : leftValues)
-        out << "\t" << dbp(it) << std::endl;
+    leftValues.for_each([&out](const IR::Node* node) {
+        out << "\t" << dbp(node) << std::endl; });
     out << "Constants" << std::endl;
-    for (auto it : constants)
-        out << "\t" << dbp(it) << std::endl;
+    constants.for_each([&out](const IR::Node* node) {
+        out << "\t" << dbp(node) << std::endl; });
     out << "--------------" << std::endl;
 }
 
@@ -43,7 +47,8 @@ void TypeMap::setCompileTimeConstant(const IR::Expression* expression) {
 }
 
 bool TypeMap::isCompileTimeConstant(const IR::Expression* expression) const {
-    bool result = constants.find(expression) != constants.end();
+    bool result = constants.count(expression) > 0 ||
+            (parent && parent->isCompileTimeConstant(expression));
     LOG1(dbp(expression) << (result ? " constant" : " not constant"));
     return result;
 }
@@ -51,7 +56,26 @@ bool TypeMap::isCompileTimeConstant(const IR::Expression* expression) const {
 void TypeMap::clear() {
     LOG1("Clearing typeMap");
     typeMap.clear(); leftValues.clear(); constants.clear(); allTypeVariables.clear();
-    program = nullptr;
+    methodInstances.clear();
+    resetMap();
+}
+
+MethodInstance* TypeMap::getMethodInstance(const IR::MethodCallExpression* mce,
+                                           const ReferenceMap* refMap) const {
+    if (refMap != methodInstancesRefMap ||
+        refMap->getGeneration() != methodInstancesGeneration)
+        return nullptr;
+    return methodInstances.get(mce);
+}
+
+void TypeMap::setMethodInstance(const IR::MethodCallExpression* mce,
+                                const ReferenceMap* refMap, MethodInstance* instance) {
+    if (refMap != methodInstancesRefMap ||
+        refMap->getGeneration() != methodInstancesGeneration) {
+        methodInstances.clear();
+        methodInstancesRefMap = refMap;
+        methodInstancesGeneration = refMap->getGeneration(); }
+    methodInstances.emplace(mce, instance);
 }
 
 void TypeMap::checkPrecondition(const IR::Node* element, const IR::Type* type) const {
@@ -60,11 +84,14 @@ void TypeMap::checkPrecondition(const IR::Node* element, const IR::Type* type) c
         BUG("Element %1% maps to a Type_Name %2%", dbp(element), dbp(type));
 }
 
+const IR::Type* TypeMap::lookup(const IR::Node* element) const {
+    auto result = typeMap.get(element);
+    return result || !parent ? result : parent->lookup(element);
+}
+
 void TypeMap::setType(const IR::Node* element, const IR::Type* type) {
     checkPrecondition(element, type);
-    auto it = typeMap.find(element);
-    if (it != typeMap.end()) {
-        const IR::Type* existingType = it->second;
+    if (auto existingType = lookup(element)) {
         if (!TypeMap::equivalent(existingType, type))
             BUG("Changing type of %1% in type map from %2% to %3%",
                 dbp(element), dbp(existingType), dbp(type));
@@ -76,7 +103,7 @@ void TypeMap::setType(const IR::Node* element, const IR::Type* type) {
 
 const IR::Type* TypeMap::getType(const IR::Node* element, bool notNull) const {
     CHECK_NULL(element);
-    auto result = get(typeMap, element);
+    auto result = lookup(element);
     LOG2("Looking up type for " << dbp(element) << " => " << dbp(result));
     if (notNull && result == nullptr) {
         BUG("Could not find type for %1%", dbp(element));
@@ -93,6 +120,15 @@ const IR::Type* TypeMap::getTypeType(const IR::Node* element, bool notNull) cons
     return result->to<IR::Type_Type>()->type;
 }
 
+void TypeMap::merge(const TypeMap* shard) {
+    BUG_CHECK(shard->parent == this, "Merging a TypeMap that is not a shard of this one");
+    shard->typeMap.for_each([this](const IR::Node* node, const IR::Type* type) {
+        setType(node, type); });
+    shard->leftValues.for_each([this](const IR::Node* node) { leftValues.insert(node); });
+    shard->constants.for_each([this](const IR::Node* node) { constants.insert(node); });
+    allTypeVariables.simpleCompose(&shard->allTypeVariables);
+}
+
 void TypeMap::addSubstitutions(const TypeVariableSubstitution* tvs) {
     if (tvs == nullptr || tvs->isIdentity())
         return;
@@ -104,6 +140,8 @@ void TypeMap::addSubstitutions(const TypeVariableSubstitution* tvs) {
 // Does not do unification of type variables - a type variable is only
 // equivalent to itself.  nullptr is only equivalent to nullptr.
 bool TypeMap::equivalent(const IR::Type* left, const IR::Type* right) {
+    if (left == right)
+        return true;
     if (left == nullptr)
         return right == nullptr;
     if (right == nullptr)
@@ -248,24 +286,78 @@ bool TypeMap::equivalent(const IR::Type* left, const IR::Type* right) {
     // Type_Dontcare, Type_Unknown, Type_Name, Type_Specialized, Type_Typedef
 }
 
+static size_t hash_combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// Must be consistent with equivalent(): types which are equivalent
+// have the same hash.  Types for which equivalent() compares
+// function signatures only hash their node type.
+size_t TypeMap::hash(const IR::Type* type) {
+    if (type == nullptr)
+        return 0;
+    size_t result = type->node_type_name().hash();
+    if (auto tb = type->to<IR::Type_Bits>()) {
+        result = hash_combine(result, tb->size);
+        return hash_combine(result, tb->isSigned);
+    }
+    if (auto tv = type->to<IR::Type_Varbits>())
+        return hash_combine(result, tv->size);
+    if (type->is<IR::Type_Base>() || type->is<IR::Type_Error>())
+        return result;
+    if (auto tt = type->to<IR::Type_Type>())
+        return hash_combine(result, hash(tt->type));
+    if (auto tv = type->to<IR::ITypeVar>()) {
+        result = hash_combine(result, tv->getVarName().hash());
+        return hash_combine(result, tv->getDeclId());
+    }
+    if (auto ts = type->to<IR::Type_Stack>()) {
+        result = hash_combine(result, hash(ts->elementType));
+        return hash_combine(result, ts->sizeKnown() ? ts->getSize() : 0);
+    }
+    if (auto te = type->to<IR::Type_Enum>())
+        return hash_combine(result, te->name.name.hash());
+    if (auto te = type->to<IR::Type_Extern>())
+        return hash_combine(result, te->name.name.hash());
+    if (auto st = type->to<IR::Type_StructLike>()) {
+        for (auto f : *st->fields) {
+            result = hash_combine(result, f->name.name.hash());
+            result = hash_combine(result, hash(f->type));
+        }
+        return result;
+    }
+    if (auto tt = type->to<IR::Type_Tuple>()) {
+        for (auto c : *tt->components)
+            result = hash_combine(result, hash(c));
+        return result;
+    }
+    if (auto ts = type->to<IR::Type_Set>())
+        return hash_combine(result, hash(ts->elementType));
+    if (auto ts = type->to<IR::Type_SpecializedCanonical>())
+        return hash_combine(result, hash(ts->substituted));
+    return result;
+}
+
 // Used for tuples and stacks only
 const IR::Type* TypeMap::getCanonical(const IR::Type* type) {
-    // Currently a linear search; hopefully this won't be too expensive in practice
-    std::vector<const IR::Type*>* searchIn;
-    if (type->is<IR::Type_Stack>())
-        searchIn = &canonicalStacks;
-    else if (type->is<IR::Type_Tuple>())
-        searchIn = &canonicalTuples;
-    else
+    if (!type->is<IR::Type_Stack>() && !type->is<IR::Type_Tuple>())
         BUG("%1%: unexpected type", type);
+    if (parent)
+        return parent->getCanonical(type);
 
-    for (auto t : *searchIn) {
-        if (TypeMap::equivalent(type, t))
-            return t;
+#ifdef MULTITHREAD
+    // shards on several threads may look up the types at once
+    static std::mutex lock;
+    std::lock_guard<std::mutex> acquire(lock);
+#endif  // MULTITHREAD
+    size_t h = hash(type);
+    auto range = canonicalTypes.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (TypeMap::equivalent(type, it->second))
+            return it->second;
     }
-    searchIn->push_back(type);
+    canonicalTypes.emplace(h, type);
     return type;
 }
 
-
 }  // namespace P4
@@ -17,11 +17,17 @@ limitations under the License.
 #ifndef _FRONTENDS_P4_TYPEMAP_H_
 #define _FRONTENDS_P4_TYPEMAP_H_
 
+#include <unordered_map>
 #include "ir/ir.h"
+#include "ir/node_id_map.h"
 #include "frontends/common/programMap.h"
 #include "frontends/p4/substitution.h"
 
 namespace P4 {
+
+class MethodInstance;
+class ReferenceMap;
+
 /*
  * Maps nodes to their canonical types.
  * Not all Node objects have types.
@@ -41,28 +47,46 @@ class TypeMap final : public ProgramMap {
  protected:
     // We want to have the same canonical type for two
     // different tuples or stacks with the same signature.
-    std::vector<const IR::Type*> canonicalTuples;
-    std::vector<const IR::Type*> canonicalStacks;
+    // Canonical types are hashed structurally (see hash()), so
+    // only types in the same bucket are compared with equivalent().
+    std::unordered_multimap<size_t, const IR::Type*> canonicalTypes;
 
-    // Map each node to its canonical type
-    std::map<const IR::Node*, const IR::Type*> typeMap;
+    // Map each node to its canonical type.  These are indexed by node id,
+    // so all lookups are O(1) and clear() does not need to free anything.
+    NodeIdMap<const IR::Type*> typeMap;
     // All left-values in the program.
-    std::set<const IR::Expression*> leftValues;
+    NodeIdSet leftValues;
     // All compile-time constants.  A compile-time constant
     // is not necessarily a constant - it could be a directionless
     // parameter as well.
-    std::set<const IR::Expression*> constants;
+    NodeIdSet constants;
     // For each type variable in the program the actual
     // type that is substituted for it.
     TypeVariableSubstitution allTypeVariables;
 
+    // MethodInstance::resolve results for MethodCallExpressions.  They also depend on
+    // the ReferenceMap, so they are only valid for the map and generation below.
+    NodeIdMap<MethodInstance*> methodInstances;
+    const ReferenceMap* methodInstancesRefMap = nullptr;
+    unsigned methodInstancesGeneration = 0;
+
+    // A shard reads through to the map it was made from, which must not change
+    // while the shard is used, except for its canonical types, which the shards
+    // share.  What is added to the shard stays there until it is merged back.
+    TypeMap* parent = nullptr;
+
     // checks some preconditions before setting the type
     void checkPrecondition(const IR::Node* element, const IR::Type* type) const;
+    // the type of 'element' in this map or the map it is a shard of
+    const IR::Type* lookup(const IR::Node* element) const;
 
  public:
     TypeMap() : ProgramMap("TypeMap") {}
+    // A shard of 'parent', for type checking part of a program on another thread.
+    explicit TypeMap(TypeMap* parent) : ProgramMap("TypeMap"), parent(parent)
+    { CHECK_NULL(parent); }
 
-    bool contains(const IR::Node* element) { return typeMap.count(element) != 0; }
+    bool contains(const IR::Node* element) { return lookup(element) != nullptr; }
     void setType(const IR::Node* element, const IR::Type* type);
     const IR::Type* getType(const IR::Node* element, bool notNull = false) const;
     // unwraps a TypeType into its contents
@@ -70,21 +94,33 @@ class TypeMap final : public ProgramMap {
     void dbprint(std::ostream& out) const;
     void clear();
     bool isLeftValue(const IR::Expression* expression) const
-    { return leftValues.count(expression) > 0; }
+    { return leftValues.count(expression) > 0 || (parent && parent->isLeftValue(expression)); }
     bool isCompileTimeConstant(const IR::Expression* expression) const;
     size_t size() const
-    { return typeMap.size(); }
+    { return typeMap.size() + (parent ? parent->size() : 0); }
+    // Adds everything that was added to 'shard', a shard of this map.
+    void merge(const TypeMap* shard);
 
     void setLeftValue(const IR::Expression* expression);
     void setCompileTimeConstant(const IR::Expression* expression);
     void addSubstitutions(const TypeVariableSubstitution* tvs);
-    const IR::Type* getSubstitution(const IR::Type_Var* var)
-    { return allTypeVariables.lookup(var); }
+    const IR::Type* getSubstitution(const IR::Type_Var* var) {
+        auto result = allTypeVariables.lookup(var);
+        return result || !parent ? result : parent->getSubstitution(var); }
 
     // deep structural equivalence between canonical types only.
     static bool equivalent(const IR::Type* left, const IR::Type* right);
+    // structural hash of a canonical type: equivalent types have the same hash.
+    static size_t hash(const IR::Type* type);
+
+    // The cached resolution of 'mce' with 'refMap', or nullptr.
+    MethodInstance* getMethodInstance(const IR::MethodCallExpression* mce,
+                                      const ReferenceMap* refMap) const;
+    void setMethodInstance(const IR::MethodCallExpression* mce, const ReferenceMap* refMap,
+                           MethodInstance* instance);
 
-    // Used for tuples and stacks only
+    // Returns the first type seen which is equivalent to 'type', by this map and
+    // all its shards.  Used for tuples and stacks only
     const IR::Type* getCanonical(const IR::Type* type);
 };
 }  // namespace P4
@@ -21,8 +21,8 @@ namespace P4 {
 
 // Add a @name annotation ONLY if it does not already exist.
 // Otherwise do nothing.
-static const IR::Annotations*
-addNameAnnotation(cstring name, const IR::Annotations* annos) {
+const IR::Annotations*
+SymbolRenamer::addNameAnnotation(cstring name, const IR::Annotations* annos) {
     if (annos == nullptr)
         annos = IR::Annotations::empty;
     return annos->addAnnotationIfNew(IR::Annotation::nameAnnotation,
@@ -50,8 +50,7 @@ UniqueParameters::UniqueParameters(ReferenceMap* refMap, TypeMap* typeMap) :
 
 /**************************************************************************/
 
-IR::ID* RenameSymbols::getName() const {
-    auto orig = getOriginal<IR::IDeclaration>();
+IR::ID* SymbolRenamer::getName(const IR::IDeclaration* orig) const {
     if (!renameMap->toRename(orig))
         return nullptr;
     auto newName = renameMap->getName(orig);
@@ -59,68 +58,53 @@ IR::ID* RenameSymbols::getName() const {
     return name;
 }
 
+const IR::Node* SymbolRenamer::renamePath(const IR::PathExpression* expression) const {
+    auto decl = refMap->getDeclaration(expression->path, true);
+    if (!renameMap->toRename(decl))
+        return expression;
+    // This should be a local name.
+    BUG_CHECK(!expression->path->absolute,
+              "%1%: renaming absolute path", expression);
+    auto newName = renameMap->getName(decl);
+    auto name = IR::ID(expression->path->name.srcInfo, newName,
+                       expression->path->name.originalName);
+    auto result = new IR::PathExpression(name);
+    return result;
+}
+
+/**************************************************************************/
+
 const IR::Node* RenameSymbols::postorder(IR::Declaration_Variable* decl) {
-    auto name = getName();
-    if (name != nullptr && *name != decl->name)
-        decl->name = *name;
+    rename(getOriginal<IR::IDeclaration>(), decl);
     return decl;
 }
 
 const IR::Node* RenameSymbols::postorder(IR::Declaration_Constant* decl) {
-    auto name = getName();
-    if (name != nullptr && *name != decl->name)
-        decl->name = *name;
+    rename(getOriginal<IR::IDeclaration>(), decl);
     return decl;
 }
 
 const IR::Node* RenameSymbols::postorder(IR::Parameter* param) {
-    auto name = getName();
-    if (name != nullptr && *name != param->name.name)
-        param->name = IR::ID(param->name.srcInfo, *name, param->name.originalName);
+    rename(getOriginal<IR::IDeclaration>(), param);
     return param;
 }
 
 const IR::Node* RenameSymbols::postorder(IR::PathExpression* expression) {
-    auto decl = refMap->getDeclaration(expression->path, true);
-    if (!renameMap->toRename(decl))
-        return expression;
-    // This should be a local name.
-    BUG_CHECK(!expression->path->absolute,
-              "%1%: renaming absolute path", expression);
-    auto newName = renameMap->getName(decl);
-    auto name = IR::ID(expression->path->name.srcInfo, newName,
-                       expression->path->name.originalName);
-    auto result = new IR::PathExpression(name);
-    return result;
+    return renamePath(expression);
 }
 
 const IR::Node* RenameSymbols::postorder(IR::Declaration_Instance* decl) {
-    auto name = getName();
-    if (name != nullptr && *name != decl->name) {
-        auto annos = addNameAnnotation(decl->name, decl->annotations);
-        decl->name = *name;
-        decl->annotations = annos;
-    }
+    renameAnnotated(getOriginal<IR::IDeclaration>(), decl);
     return decl;
 }
 
 const IR::Node* RenameSymbols::postorder(IR::P4Table* decl) {
-    auto name = getName();
-    if (name != nullptr && *name != decl->name) {
-        auto annos = addNameAnnotation(decl->name, decl->annotations);
-        decl->name = *name;
-        decl->annotations = annos;
-    }
+    renameAnnotated(getOriginal<IR::IDeclaration>(), decl);
     return decl;
 }
 
 const IR::Node* RenameSymbols::postorder(IR::P4Action* decl) {
-    auto name = getName();
-    if (name != nullptr && *name != decl->name) {
-        auto annos = addNameAnnotation(decl->name, decl->annotations);
-        decl->name = *name;
-        decl->annotations = annos;
-    }
+    renameAnnotated(getOriginal<IR::IDeclaration>(), decl);
     return decl;
 }
 
@@ -87,15 +87,41 @@ class FindSymbols : public Inspector {
     { if (!isTopLevel()) doDecl(decl); }
 };
 
-class RenameSymbols : public Transform {
+// Renames the declarations, and the paths that refer to them, as the RenameMap says;
+// for RenameSymbols and the Transforms that rename as they do more
+class SymbolRenamer {
+ protected:
     ReferenceMap *refMap;
     RenameMap    *renameMap;
 
-    IR::ID* getName() const;
+    SymbolRenamer(ReferenceMap *refMap, RenameMap *renameMap) :
+            refMap(refMap), renameMap(renameMap)
+    { CHECK_NULL(refMap); CHECK_NULL(renameMap); }
+    // nullptr if 'orig' keeps its name
+    IR::ID* getName(const IR::IDeclaration* orig) const;
+    static const IR::Annotations* addNameAnnotation(cstring name, const IR::Annotations* annos);
+    // 'decl' is the copy of 'orig' being transformed
+    template <class T> void rename(const IR::IDeclaration* orig, T* decl) const {
+        auto name = getName(orig);
+        if (name != nullptr && *name != decl->name)
+            decl->name = *name;
+    }
+    // Also keeps the old name of 'decl' in a @name annotation, if it has none
+    template <class T> void renameAnnotated(const IR::IDeclaration* orig, T* decl) const {
+        auto name = getName(orig);
+        if (name != nullptr && *name != decl->name) {
+            decl->annotations = addNameAnnotation(decl->name, decl->annotations);
+            decl->name = *name;
+        }
+    }
+    const IR::Node* renamePath(const IR::PathExpression* expression) const;
+};
+
+class RenameSymbols : public Transform, private SymbolRenamer {
  public:
     RenameSymbols(ReferenceMap *refMap, RenameMap *renameMap) :
-            refMap(refMap), renameMap(renameMap)
-    { CHECK_NULL(refMap); CHECK_NULL(renameMap); setName("RenameSymbols"); }
+            SymbolRenamer(refMap, renameMap)
+    { setName("RenameSymbols"); }
     const IR::Node* postorder(IR::Declaration_Variable* decl) override;
     const IR::Node* postorder(IR::Declaration_Constant* decl) override;
     const IR::Node* postorder(IR::PathExpression* expression) override;
@@ -19,14 +19,168 @@ limitations under the License.
 
 namespace P4 {
 
+Visitor::profile_t FindUnusedDeclarations::init_apply(const IR::Node* node) {
+    regions.clear();
+    open.clear();
+    fixed = 0;
+    regionsOf.clear();
+    referenceCount.clear();
+    unused->clear();
+    return Inspector::init_apply(node);
+}
+
+bool FindUnusedDeclarations::removable(const IR::IDeclaration* decl) const {
+    auto ctx = getContext();
+    return !((decl->getName().name == IR::P4Program::main ||
+              decl->getName().name == IR::ParserState::verify) &&
+             ctx->parent->node->is<IR::P4Program>());
+}
+
+void FindUnusedDeclarations::region(const IR::Node* node, bool removable,
+                                    std::function<void()> visitChildren) {
+    if (fixed || !removable) {
+        visitChildren();
+        return;
+    }
+    auto decl = node->to<IR::IDeclaration>();
+    size_t index = regions.size();
+    regions.emplace_back(decl);
+    if (!open.empty())
+        regions[open.back()].children.push_back(index);
+    regionsOf[decl].push_back(index);
+    open.push_back(index);
+    visitChildren();
+    open.pop_back();
+}
+
+void FindUnusedDeclarations::fixedChildren(const IR::Node* node) {
+    ++fixed;
+    visitChildrenOf(node);
+    --fixed;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::Path* path) {
+    auto decl = refMap->getDeclaration(path);
+    if (decl != nullptr) {
+        ++referenceCount[decl];
+        if (!open.empty())
+            regions[open.back()].references.push_back(decl);
+    }
+    return true;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::P4Control* cont) {
+    // RemoveUnusedDeclarations only looks into the locals and the body
+    region(cont, true, [this, cont]() {
+        ++fixed;
+        visit(cont->type, "type");
+        visit(cont->constructorParams, "constructorParams");
+        --fixed;
+        visit(cont->controlLocals, "controlLocals");
+        visit(cont->body, "body"); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::P4Parser* cont) {
+    region(cont, true, [this, cont]() {
+        ++fixed;
+        visit(cont->type, "type");
+        visit(cont->constructorParams, "constructorParams");
+        --fixed;
+        visit(cont->parserLocals, "parserLocals");
+        visit(cont->states, "states"); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::P4Table* table) {
+    region(table, true, [this, table]() { fixedChildren(table); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::ParserState* state) {
+    bool removable = state->name != IR::ParserState::accept &&
+            state->name != IR::ParserState::reject &&
+            state->name != IR::ParserState::start;
+    region(state, removable, [this, state]() { visitChildrenOf(state); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::Type_Enum* type) {
+    region(type, true, [this, type]() { fixedChildren(type); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::Declaration_Instance* decl) {
+    region(decl, removable(decl), [this, decl]() { fixedChildren(decl); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::Declaration_Variable* decl) {
+    bool removable = decl->initializer == nullptr ||
+            !SideEffects::check(decl->initializer, nullptr, nullptr);
+    region(decl, removable, [this, decl]() { fixedChildren(decl); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::Declaration* decl) {
+    region(decl, removable(decl), [this, decl]() { visitChildrenOf(decl); });
+    return false;
+}
+
+bool FindUnusedDeclarations::preorder(const IR::Type_Declaration* decl) {
+    region(decl, removable(decl), [this, decl]() { visitChildrenOf(decl); });
+    return false;
+}
+
+void FindUnusedDeclarations::remove(size_t index, std::vector<size_t>& worklist) {
+    auto& region = regions[index];
+    if (region.removed)
+        return;
+    region.removed = true;
+    for (auto decl : region.references) {
+        if (--referenceCount[decl] == 0) {
+            auto it = regionsOf.find(decl);
+            if (it != regionsOf.end())
+                worklist.insert(worklist.end(), it->second.begin(), it->second.end());
+        }
+    }
+    for (auto child : region.children)
+        remove(child, worklist);
+}
+
+void FindUnusedDeclarations::end_apply(const IR::Node*) {
+    std::vector<size_t> worklist;
+    for (size_t i = 0; i < regions.size(); ++i)
+        if (referenceCount.count(regions[i].decl) == 0)
+            worklist.push_back(i);
+    while (!worklist.empty()) {
+        auto index = worklist.back();
+        worklist.pop_back();
+        remove(index, worklist);
+    }
+    // a shared declaration is unused only where all its regions were removed
+    for (auto& decl : regionsOf) {
+        bool removed = true;
+        for (auto index : decl.second)
+            removed = removed && regions[index].removed;
+        if (removed)
+            unused->insert(decl.first);
+    }
+    LOG2(unused->size() << " unused declarations");
+}
+
 Visitor::profile_t RemoveUnusedDeclarations::init_apply(const IR::Node* node) {
     LOG2("Reference map " << refMap);
+    if (all) {
+        FindUnusedDeclarations find(refMap, &unused);
+        node->apply(find);
+    }
     return Transform::init_apply(node);
 }
 
 const IR::Node* RemoveUnusedDeclarations::preorder(IR::Type_Enum* type) {
     prune();  // never remove individual enum members
-    if (!refMap->isUsed(getOriginal<IR::Type_Enum>())) {
+    if (!isUsed(getOriginal<IR::Type_Enum>())) {
         LOG1("Removing " << type);
         return nullptr;
     }
@@ -35,7 +189,7 @@ const IR::Node* RemoveUnusedDeclarations::preorder(IR::Type_Enum* type) {
 }
 
 const IR::Node* RemoveUnusedDeclarations::preorder(IR::P4Control* cont) {
-    if (!refMap->isUsed(getOriginal<IR::IDeclaration>())) {
+    if (!isUsed(getOriginal<IR::IDeclaration>())) {
         LOG1("Removing " << cont);
         prune();
         return nullptr;
@@ -48,7 +202,7 @@ const IR::Node* RemoveUnusedDeclarations::preorder(IR::P4Control* cont) {
 }
 
 const IR::Node* RemoveUnusedDeclarations::preorder(IR::P4Parser* cont) {
-    if (!refMap->isUsed(getOriginal<IR::IDeclaration>())) {
+    if (!isUsed(getOriginal<IR::IDeclaration>())) {
         LOG1("Removing " << cont);
         prune();
         return nullptr;
@@ -61,7 +215,7 @@ const IR::Node* RemoveUnusedDeclarations::preorder(IR::P4Parser* cont) {
 }
 
 const IR::Node* RemoveUnusedDeclarations::preorder(IR::P4Table* cont) {
-    if (!refMap->isUsed(getOriginal<IR::IDeclaration>())) {
+    if (!isUsed(getOriginal<IR::IDeclaration>())) {
         ::warning("Table %1% is not used; removing", cont);
         LOG1("Removing " << cont);
         cont = nullptr;
@@ -86,7 +240,7 @@ const IR::Node* RemoveUnusedDeclarations::process(const IR::IDeclaration* decl)
         decl->getName().name == IR::ParserState::verify) &&
         ctx->parent->node->is<IR::P4Program>())
         return decl->getNode();
-    if (refMap->isUsed(getOriginal<IR::IDeclaration>()))
+    if (isUsed(getOriginal<IR::IDeclaration>()))
         return decl->getNode();
     LOG1("Removing " << getOriginal());
     prune();  // no need to go deeper
@@ -98,7 +252,7 @@ const IR::Node* RemoveUnusedDeclarations::preorder(IR::ParserState* state) {
         state->name == IR::ParserState::reject ||
         state->name == IR::ParserState::start)
         return state;
-    if (refMap->isUsed(getOriginal<IR::ParserState>()))
+    if (isUsed(getOriginal<IR::ParserState>()))
         return state;
     LOG1("Removing " << state);
     prune();
@@ -17,17 +17,100 @@ limitations under the License.
 #ifndef _P4_UNUSEDDECLARATIONS_H_
 #define _P4_UNUSEDDECLARATIONS_H_
 
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
 #include "ir/ir.h"
 #include "../common/resolveReferences/resolveReferences.h"
 
 namespace P4 {
 
+/**
+ * Finds the declarations that repeating ResolveReferences and
+ * RemoveUnusedDeclarations until nothing changes would remove, in one traversal.
+ * Each declaration that RemoveUnusedDeclarations may remove is a region, which
+ * holds the references made from within it (but not from the regions nested in
+ * it); references from elsewhere belong to the enclosing region, or to none.  A
+ * declaration is used while it has references, so removing the declarations
+ * without any drops the references of their regions and of all the regions
+ * nested in them, which may leave more declarations without references.  As with
+ * the repeated passes, declarations that only refer to each other are kept.
+ * Must run with the refMap computed on the same program.
+ */
+class FindUnusedDeclarations : public Inspector {
+    const ReferenceMap* refMap;
+    std::unordered_set<const IR::IDeclaration*>* unused;
+
+    struct region_t {
+        const IR::IDeclaration* decl;
+        std::vector<const IR::IDeclaration*> references;
+        std::vector<size_t> children;
+        bool removed = false;
+        explicit region_t(const IR::IDeclaration* decl) : decl(decl) {}
+    };
+    std::vector<region_t> regions;
+    std::vector<size_t> open;  // regions being visited; the innermost is last
+    unsigned fixed = 0;  // nonzero within nodes whose declarations are never removed
+    // the regions of each declaration: one for each place where it appears, as a node
+    // may be shared by several parts of the program
+    std::unordered_map<const IR::IDeclaration*, std::vector<size_t>> regionsOf;
+    std::unordered_map<const IR::IDeclaration*, unsigned> referenceCount;
+
+    // false for the declarations that RemoveUnusedDeclarations::process keeps
+    bool removable(const IR::IDeclaration* decl) const;
+    // Calls visitChildren for 'node', within a new region if it is removable
+    void region(const IR::Node* node, bool removable, std::function<void()> visitChildren);
+    // visits the children of 'node', whose declarations are never removed
+    void fixedChildren(const IR::Node* node);
+    void remove(size_t index, std::vector<size_t>& worklist);
+
+ public:
+    FindUnusedDeclarations(const ReferenceMap* refMap,
+                           std::unordered_set<const IR::IDeclaration*>* unused) :
+            refMap(refMap), unused(unused)
+    { CHECK_NULL(refMap); CHECK_NULL(unused); visitDagOnce = false;
+      setName("FindUnusedDeclarations"); }
+
+    Visitor::profile_t init_apply(const IR::Node* node) override;
+    void end_apply(const IR::Node* node) override;
+
+    bool preorder(const IR::Path* path) override;
+    bool preorder(const IR::P4Control* cont) override;
+    bool preorder(const IR::P4Parser* cont) override;
+    bool preorder(const IR::P4Table* table) override;
+    bool preorder(const IR::ParserState* state) override;
+    bool preorder(const IR::Type_Enum* type) override;
+    bool preorder(const IR::Declaration_Instance* decl) override;
+    bool preorder(const IR::Type_Error* type) override
+    { fixedChildren(type); return false; }
+    bool preorder(const IR::Declaration_MatchKind* decl) override
+    { fixedChildren(decl); return false; }
+    bool preorder(const IR::Type_StructLike* type) override
+    { fixedChildren(type); return false; }
+    bool preorder(const IR::Type_Extern* type) override
+    { fixedChildren(type); return false; }
+    bool preorder(const IR::Type_Method* type) override
+    { fixedChildren(type); return false; }
+    bool preorder(const IR::Declaration_Variable* decl) override;
+    bool preorder(const IR::Parameter* param) override
+    { fixedChildren(param); return false; }
+    bool preorder(const IR::Declaration* decl) override;
+    bool preorder(const IR::Type_Declaration* decl) override;
+};
+
 class RemoveUnusedDeclarations : public Transform {
     const ReferenceMap* refMap;
+    // If true, removes all the declarations that FindUnusedDeclarations finds,
+    // rather than just those that the refMap does not mark as used
+    bool all;
+    std::unordered_set<const IR::IDeclaration*> unused;
     const IR::Node* process(const IR::IDeclaration* decl);
+    bool isUsed(const IR::IDeclaration* decl) const
+    { return all ? unused.count(decl) == 0 : refMap->isUsed(decl); }
 
  public:
-    explicit RemoveUnusedDeclarations(const ReferenceMap* refMap) : refMap(refMap)
+    explicit RemoveUnusedDeclarations(const ReferenceMap* refMap, bool all = false) :
+            refMap(refMap), all(all)
     { setName("RemoveUnusedDeclarations"); }
 
     using Transform::postorder;
@@ -62,16 +145,13 @@ class RemoveUnusedDeclarations : public Transform {
     const IR::Node* preorder(IR::Type_Declaration* decl) override { return process(decl); }
 };
 
-// Iterates RemoveUnusedDeclarations until convergence.
+// Removes what iterating RemoveUnusedDeclarations until convergence would.
 class RemoveAllUnusedDeclarations : public PassManager {
  public:
     explicit RemoveAllUnusedDeclarations(ReferenceMap* refMap) {
         CHECK_NULL(refMap);
-        passes.emplace_back(
-            new PassRepeated {
-                new ResolveReferences(refMap),
-                new RemoveUnusedDeclarations(refMap)
-             });
+        passes.emplace_back(new ResolveReferences(refMap));
+        passes.emplace_back(new RemoveUnusedDeclarations(refMap, true));
         setName("RemoveAllUnusedDeclarations");
         setStopOnError(true);
     }
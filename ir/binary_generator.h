@@ -0,0 +1,201 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _IR_BINARY_GENERATOR_H_
+#define _IR_BINARY_GENERATOR_H_
+
+#include <string.h>
+#include <gmpxx.h>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include "lib/cstring.h"
+#include "lib/hvec_map.h"
+#include "lib/match.h"
+#include "lib/small_vector.h"
+
+#include "ir.h"
+
+// Writes an IR tree as a compact binary snapshot, to be read back by BinaryLoader.
+// Unlike JSON, the fields of a node are not labelled, but written in the order in
+// which they are declared, so a snapshot can only be read by a compiler built from
+// the same IR definitions; the header records a hash of them to check that.
+//
+// Unsigned numbers are written as varints (7 bits a byte, low bits first) and signed
+// ones zigzag encoded first.  Each distinct cstring and each node is written in full
+// the first time only, and referred to by its index after that:
+//      cstring:  0 = null, 1 = new string (varint length and bytes), 2+i = string i
+//      node:     0 = null, 1 = new node (type name, then fields), 2+i = node i
+class BinaryGenerator {
+    std::ostream                                &out;
+    std::string                                 buffer;
+    std::unordered_map<const IR::Node *, size_t> nodes;
+    std::unordered_map<const char *, size_t>    strings;
+
+    template<typename T>
+    class has_toBinary {
+        typedef char small;
+        typedef struct { char c[2]; } big;
+
+        template<typename C> static small test(decltype(&C::toBinary));
+        template<typename C> static big test(...);
+     public:
+        static const bool value = sizeof(test<T>(0)) == sizeof(char);
+    };
+
+ public:
+    static const char *magic() { return "P4IR"; }
+    static constexpr size_t bufferSize = 1 << 20;
+
+    explicit BinaryGenerator(std::ostream &out) : out(out) {
+        buffer.reserve(bufferSize + 64);
+        buffer.append(magic(), 4);
+        varint(IR::binary_schema_hash); }
+    ~BinaryGenerator() { flush(); }
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear(); }
+
+    void varint(uint64_t v) {
+        if (buffer.size() >= bufferSize) flush();
+        while (v >= 0x80) {
+            buffer += static_cast<char>(v | 0x80);
+            v >>= 7; }
+        buffer += static_cast<char>(v); }
+    void zigzag(int64_t v) {
+        varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63)); }
+    void bytes(const char *p, size_t len) {
+        varint(len);
+        buffer.append(p, len); }
+
+    template<typename T>
+    void generate(const vector<T> &v) {
+        varint(v.size());
+        for (auto &el : v) generate(el); }
+    template<typename T>
+    void generate(const std::vector<T> &v) {
+        varint(v.size());
+        for (auto &el : v) generate(el); }
+    template<typename T, unsigned N>
+    void generate(const small_vector<T, N> &v) {
+        varint(v.size());
+        for (auto &el : v) generate(el); }
+    template<typename T, typename U>
+    void generate(const std::pair<T, U> &v) {
+        generate(v.first);
+        generate(v.second); }
+    template<typename K, typename V>
+    void generate(const std::map<K, V> &v) { generate_map(v); }
+    template<typename K, typename V>
+    void generate(const std::multimap<K, V> &v) { generate_map(v); }
+    template<typename K, typename V>
+    void generate(const ordered_map<K, V> &v) { generate_map(v); }
+    template<typename K, typename V>
+    void generate(const hvec_map<K, V> &v) { generate_map(v); }
+    template<typename MAP>
+    void generate_map(const MAP &v) {
+        varint(v.size());
+        for (auto &el : v) {
+            generate(el.first);
+            generate(el.second); } }
+    template<typename T, size_t N>
+    void generate(const T (&v)[N]) {
+        for (auto &el : v) generate(el); }
+
+    void generate(bool v) { varint(v); }
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    generate(T v) { zigzag(v); }
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+    generate(T v) { varint(v); }
+    template<typename T> typename std::enable_if<std::is_enum<T>::value>::type
+    generate(T v) { zigzag(static_cast<int64_t>(v)); }
+    void generate(double v) {
+        char raw[sizeof(v)];
+        memcpy(raw, &v, sizeof(v));
+        buffer.append(raw, sizeof(v)); }
+    // sign in the low bit of the length of the magnitude, which follows, low bytes first
+    void generate(const mpz_class &v) {
+        size_t len = (mpz_sizeinbase(v.get_mpz_t(), 2) + 7) / 8;
+        varint(len * 2 + (sgn(v) < 0));
+        size_t at = buffer.size();
+        buffer.resize(at + len);
+        mpz_export(&buffer[at], &len, -1, 1, 0, 0, v.get_mpz_t()); }
+
+    void generate(cstring v) {
+        if (v.isNull()) {
+            varint(0);
+            return; }
+        auto it = strings.find(v.c_str());
+        if (it != strings.end()) {
+            varint(it->second + 2);
+            return; }
+        strings.emplace(v.c_str(), strings.size());
+        varint(1);
+        bytes(v.c_str(), v.size()); }
+    // not shared like cstrings, for text that is not kept in the cstring table
+    void generate(const std::string &v) { bytes(v.data(), v.size()); }
+    void generate(const IR::ID &v) { generate(v.name); }
+    // line 0 for none, or the start line and column, the lines spanned and the end column
+    void generate(const Util::SourceInfo &v) {
+        if (!v.isValid()) {
+            varint(0);
+            return; }
+        varint(v.getStart().getLineNumber());
+        varint(v.getStart().getColumnNumber());
+        varint(v.getEnd().getLineNumber() - v.getStart().getLineNumber());
+        varint(v.getEnd().getColumnNumber()); }
+    void generate(const LTBitMatrix &v) {
+        std::stringstream tmp;
+        tmp << v;
+        generate(cstring(tmp.str())); }
+    void generate(const match_t &v) {
+        varint(v.word0);
+        varint(v.word1); }
+
+    template<typename T>
+    typename std::enable_if<
+                    has_toBinary<T>::value &&
+                    !std::is_base_of<IR::INode, T>::value>::type
+    generate(const T &v) { v.toBinary(*this); }
+
+    void generate(const IR::Node &v) {
+        auto it = nodes.find(&v);
+        if (it != nodes.end()) {
+            varint(it->second + 2);
+            return; }
+        nodes.emplace(&v, nodes.size());
+        varint(1);
+        generate(v.node_type_name());
+        v.toBinary(*this); }
+    void generate(const IR::INode &v) { generate(*v.getNode()); }
+
+    template<typename T>
+    typename std::enable_if<
+                    std::is_pointer<T>::value &&
+                    has_toBinary<typename std::remove_pointer<T>::type>::value>::type
+    generate(T v) {
+        if (v)
+            generate(*v);
+        else
+            varint(0); }
+
+    template<typename T> BinaryGenerator &operator<<(const T &v) { generate(v); return *this; }
+};
+
+#endif /* _IR_BINARY_GENERATOR_H_ */
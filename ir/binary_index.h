@@ -0,0 +1,189 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _IR_BINARY_INDEX_H_
+#define _IR_BINARY_INDEX_H_
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "binary_generator.h"
+#include "binary_loader.h"
+#include "lib/cstring.h"
+#include "lib/error.h"
+#include "ir.h"
+
+// An indexed snapshot of a P4Program, whose top-level declarations can be read one at
+// a time: tools that look at one control of a large program then only decode that one.
+// After a header and the number of declarations comes an index, with the name, the node
+// type and the size in bytes of each, and then each declaration as a BinaryGenerator
+// snapshot of its own, so its offset is the sum of the sizes before it.
+//
+// As every declaration is written on its own, a node that several of them share is
+// written, and read back, once for each; references between declarations are by name
+// in the IR, and are resolved again as usual after loading.
+class IndexedSnapshot {
+    static void bytes(std::ostream &out, const char *p, size_t len) {
+        varint(out, len);
+        out.write(p, len); }
+    static void varint(std::ostream &out, uint64_t v) {
+        while (v >= 0x80) {
+            out.put(static_cast<char>(v | 0x80));
+            v >>= 7; }
+        out.put(static_cast<char>(v)); }
+
+ public:
+    static const char *magic() { return "P4IX"; }
+
+    static void write(std::ostream &out, const IR::P4Program *program) {
+        std::vector<std::string> blocks;
+        for (auto decl : *program->declarations) {
+            std::stringstream block;
+            BinaryGenerator(block) << decl;
+            blocks.push_back(block.str()); }
+        out.write(magic(), 4);
+        varint(out, IR::binary_schema_hash);
+        varint(out, blocks.size());
+        size_t i = 0;
+        for (auto decl : *program->declarations) {
+            cstring name;
+            if (auto d = decl->to<IR::IDeclaration>())
+                name = d->getName().name;
+            bytes(out, name.c_str() ? name.c_str() : "", name.size());
+            cstring type = decl->node_type_name();
+            bytes(out, type.c_str(), type.size());
+            varint(out, blocks[i++].size()); }
+        for (auto &block : blocks)
+            out.write(block.data(), block.size()); }
+};
+
+// Reads an IndexedSnapshot.  Opening it only reads the index; each declaration is
+// decoded the first time it is asked for, and kept.  Invalid data gives an error, as
+// with BinaryLoader, and the declarations that could not be read are null.
+class LazyProgram {
+    struct Entry {
+        cstring         name;
+        cstring         type;
+        size_t          offset, size;
+        const IR::Node  *node;
+        bool            loaded;
+    };
+    std::string                 text;       // when read from a stream
+    const char                  *data = nullptr, *end = nullptr;
+    std::vector<Entry>          entries;
+    std::map<cstring, size_t>   byName;     // the first declaration with each name
+    bool                        failed = false;
+
+    void fail(const char *msg) {
+        if (!failed) ::error("Invalid IR snapshot: %1%", msg);
+        failed = true; }
+    uint64_t varint(const char *&p) {
+        uint64_t rv = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            unsigned char byte = *p++;
+            rv |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return rv; }
+        fail("data ends early");
+        return 0; }
+    cstring string(const char *&p) {
+        size_t len = varint(p);
+        if (static_cast<size_t>(end - p) < len) {
+            fail("data ends early");
+            return cstring(); }
+        cstring rv = std::string(p, len);
+        p += len;
+        return rv; }
+    void readIndex() {
+        const char *p = data;
+        if (end - p < 4 || memcmp(p, IndexedSnapshot::magic(), 4) != 0) {
+            fail("not an indexed IR snapshot");
+            return; }
+        p += 4;
+        if (varint(p) != IR::binary_schema_hash) {
+            fail("written by a compiler with different IR definitions");
+            return; }
+        size_t count = varint(p);
+        for (size_t i = 0; i < count && !failed; ++i) {
+            Entry e;
+            e.name = string(p);
+            e.type = string(p);
+            e.size = varint(p);
+            e.node = nullptr;
+            e.loaded = false;
+            if (e.name.isNullOrEmpty())
+                e.name = nullptr;
+            else if (!byName.count(e.name))
+                byName.emplace(e.name, i);
+            entries.push_back(e); }
+        size_t offset = p - data;
+        for (auto &e : entries) {
+            e.offset = offset;
+            offset += e.size; }
+        if (!failed && offset > static_cast<size_t>(end - data))
+            fail("data ends early");
+        if (failed) entries.clear(); }
+
+ public:
+    explicit LazyProgram(std::istream &in) {
+        char chunk[1 << 16];
+        while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+            text.append(chunk, in.gcount());
+        data = text.data();
+        end = data + text.size();
+        readIndex(); }
+    LazyProgram(const char *begin, const char *end) : data(begin), end(end) { readIndex(); }
+    LazyProgram(const LazyProgram &) = delete;
+
+    // false once the data was found to be invalid
+    explicit operator bool() const { return !failed; }
+    size_t size() const { return entries.size(); }
+    // the name and the node type of a declaration, without decoding it
+    cstring name(size_t i) const { return entries.at(i).name; }
+    cstring type(size_t i) const { return entries.at(i).type; }
+    // how many declarations were decoded so far
+    size_t loaded() const {
+        size_t rv = 0;
+        for (auto &e : entries) rv += e.loaded;
+        return rv; }
+
+    const IR::Node *at(size_t i) {
+        auto &e = entries.at(i);
+        if (!e.loaded) {
+            e.loaded = true;
+            BinaryLoader bin(data + e.offset, data + e.offset + e.size);
+            bin >> e.node;
+            if (!bin) failed = true; }
+        return e.node; }
+    const IR::Node *get(cstring name) {
+        auto it = byName.find(name);
+        return it == byName.end() ? nullptr : at(it->second); }
+    template<class T> const T *get(cstring name) {
+        auto *n = get(name);
+        return n ? n->to<T>() : nullptr; }
+
+    // The whole program, which decodes every declaration
+    const IR::P4Program *program() {
+        auto decls = new IR::IndexedVector<IR::Node>();
+        for (size_t i = 0; i < entries.size(); ++i)
+            if (auto *n = at(i))
+                decls->push_back(n);
+        return new IR::P4Program(decls); }
+};
+
+#endif /* _IR_BINARY_INDEX_H_ */
@@ -0,0 +1,289 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _IR_BINARY_LOADER_H_
+#define _IR_BINARY_LOADER_H_
+
+#include <string.h>
+#include <gmpxx.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "lib/cstring.h"
+#include "lib/error.h"
+#include "lib/hvec_map.h"
+#include "lib/match.h"
+#include "lib/small_vector.h"
+
+#include "ir.h"
+
+// Reads back what BinaryGenerator wrote.  A snapshot written by a compiler built from
+// other IR definitions is rejected with an error, as is data that ends early or refers
+// to node types that are unknown; the loader then yields nulls and zeros.
+//
+// Nodes are made through IR::binary_unpacker_table, by the name of their type, except
+// where the field holding them is a Vector, IndexedVector or NameMap, which are made
+// from the static type of the field, as templates are not in the table.
+class BinaryLoader {
+    template<typename T> class has_fromBinary {
+        typedef char small;
+        typedef struct { char c[2]; } big;
+
+        template<typename C> static small test(decltype(&C::fromBinary));
+        template<typename C> static big test(...);
+     public:
+        static const bool value = sizeof(test<T>(0)) == sizeof(char);
+    };
+    typedef IR::Node *(*MakeFn)(BinaryLoader &);
+
+    std::string                 text;       // when read from a stream
+    const char                  *p, *end;
+    std::vector<cstring>        strings;
+    std::vector<IR::Node *>     nodes;
+    bool                        failed = false;
+    int                         lineShift = 0;
+
+    void fail(const char *msg) {
+        if (!failed) ::error("Invalid IR snapshot: %1%", msg);
+        failed = true;
+        p = end; }
+    void checkHeader() {
+        if (end - p < 4 || memcmp(p, BinaryGenerator::magic(), 4) != 0) {
+            fail("not an IR snapshot");
+            return; }
+        p += 4;
+        if (varint() != IR::binary_schema_hash)
+            fail("written by a compiler with different IR definitions"); }
+
+    // Reads a node tag, and when it introduces a new node, makes the node with 'make'
+    // or else through the table.  Its slot is reserved before the node is made, as it
+    // was numbered before its fields were written.
+    IR::Node *node(MakeFn make) {
+        uint64_t tag = varint();
+        if (tag >= 2) {
+            if (tag - 2 >= nodes.size()) {
+                fail("reference to a node not yet seen");
+                return nullptr; }
+            return nodes[tag - 2]; }
+        if (tag == 0)
+            return nullptr;
+        cstring type;
+        unpack(type);
+        if (!make) make = get(IR::binary_unpacker_table, type);
+        if (!make) {
+            fail("unknown node type");
+            return nullptr; }
+        size_t slot = nodes.size();
+        nodes.push_back(nullptr);
+        auto *rv = make(*this);  // which may add nodes, moving the vector
+        nodes[slot] = rv;
+        return rv; }
+
+    template<typename T> static IR::Node *factory(BinaryLoader &bin) {
+        return T::fromBinary(bin); }
+    template<typename T> const T *node_as(MakeFn make) {
+        auto *n = node(make);
+        return n ? n->to<T>() : nullptr; }
+
+    template<typename T>
+    void unpack(vector<T> &v) {
+        for (size_t n = varint(); n > 0 && p < end; --n) {
+            T temp;
+            unpack(temp);
+            v.push_back(temp); } }
+    template<typename T>
+    void unpack(std::vector<T> &v) {
+        for (size_t n = varint(); n > 0 && p < end; --n) {
+            T temp;
+            unpack(temp);
+            v.push_back(temp); } }
+    template<typename T, unsigned N>
+    void unpack(small_vector<T, N> &v) {
+        for (size_t n = varint(); n > 0 && p < end; --n) {
+            T temp;
+            unpack(temp);
+            v.push_back(temp); } }
+    template<typename T, typename U>
+    void unpack(std::pair<T, U> &v) {
+        unpack(v.first);
+        unpack(v.second); }
+    template<typename K, typename V>
+    void unpack(std::map<K, V> &v) { unpack_map(v); }
+    template<typename K, typename V>
+    void unpack(std::multimap<K, V> &v) { unpack_map(v); }
+    template<typename K, typename V>
+    void unpack(ordered_map<K, V> &v) { unpack_map(v); }
+    template<typename K, typename V>
+    void unpack(hvec_map<K, V> &v) { unpack_map(v); }
+    template<typename MAP>
+    void unpack_map(MAP &v) {
+        for (size_t n = varint(); n > 0 && p < end; --n) {
+            typename MAP::key_type k;
+            typename MAP::mapped_type val;
+            unpack(k);
+            unpack(val);
+            v.insert(std::make_pair(k, val)); } }
+    template<typename T, size_t N>
+    void unpack(T (&v)[N]) {
+        for (auto &el : v) unpack(el); }
+
+    template<typename T> void unpack(IR::Vector<T> &v) {
+        typedef IR::Vector<T> V;
+        if (auto *n = node_as<V>(factory<V>)) v = *n; }
+    template<typename T> void unpack(const IR::Vector<T> *&v) {
+        typedef IR::Vector<T> V;
+        v = node_as<V>(factory<V>); }
+    template<typename T> void unpack(IR::IndexedVector<T> &v) {
+        typedef IR::IndexedVector<T> V;
+        if (auto *n = node_as<V>(factory<V>)) v = *n; }
+    template<typename T> void unpack(const IR::IndexedVector<T> *&v) {
+        typedef IR::IndexedVector<T> V;
+        v = node_as<V>(factory<V>); }
+    template<class T, template<class K, class V, class COMP, class ALLOC> class MAP,
+             class COMP, class ALLOC>
+    void unpack(IR::NameMap<T, MAP, COMP, ALLOC> &m) {
+        typedef IR::NameMap<T, MAP, COMP, ALLOC> NM;
+        if (auto *n = node_as<NM>(factory<NM>)) m = *n; }
+    template<class T, template<class K, class V, class COMP, class ALLOC> class MAP,
+             class COMP, class ALLOC>
+    void unpack(const IR::NameMap<T, MAP, COMP, ALLOC> *&m) {
+        typedef IR::NameMap<T, MAP, COMP, ALLOC> NM;
+        m = node_as<NM>(factory<NM>); }
+
+    void unpack(bool &v) { v = varint() != 0; }
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    unpack(T &v) { v = zigzag(); }
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+    unpack(T &v) { v = varint(); }
+    template<typename T> typename std::enable_if<std::is_enum<T>::value>::type
+    unpack(T &v) { v = static_cast<T>(zigzag()); }
+    void unpack(double &v) {
+        if (end - p < static_cast<ptrdiff_t>(sizeof(v))) {
+            fail("data ends early");
+            return; }
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v); }
+    void unpack(mpz_class &v) {
+        uint64_t tag = varint();
+        size_t len = tag / 2;
+        if (static_cast<size_t>(end - p) < len) {
+            fail("data ends early");
+            return; }
+        mpz_import(v.get_mpz_t(), len, -1, 1, 0, 0, p);
+        if (tag & 1) v = -v;
+        p += len; }
+
+    void unpack(cstring &v) {
+        uint64_t tag = varint();
+        if (tag >= 2) {
+            if (tag - 2 < strings.size())
+                v = strings[tag - 2];
+            else
+                fail("reference to a string not yet seen");
+            return; }
+        if (tag == 0) {
+            v = nullptr;
+            return; }
+        size_t len = varint();
+        if (static_cast<size_t>(end - p) < len) {
+            fail("data ends early");
+            return; }
+        v = std::string(p, len);
+        p += len;
+        strings.push_back(v); }
+    void unpack(std::string &v) {
+        size_t len = varint();
+        if (static_cast<size_t>(end - p) < len) {
+            fail("data ends early");
+            return; }
+        v.assign(p, len);
+        p += len; }
+    void unpack(IR::ID &v) { unpack(v.name); }
+    void unpack(Util::SourceInfo &v) {
+        unsigned line = varint();
+        if (line == 0) {
+            v = Util::SourceInfo();
+            return; }
+        unsigned column = varint(), lines = varint(), endColumn = varint();
+        if (lines == 0 && endColumn < column) {
+            fail("source position ends before it starts");
+            return; }
+        if (lineShift < 0 && line <= static_cast<unsigned>(-lineShift)) {
+            fail("source position moved before the first line");
+            return; }
+        line += lineShift;
+        v = Util::SourceInfo(Util::SourcePosition(line, column),
+                             Util::SourcePosition(line + lines, endColumn)); }
+    void unpack(LTBitMatrix &m) {
+        cstring s;
+        unpack(s);
+        if (s) s.c_str() >> m; }
+    void unpack(match_t &v) {
+        v.word0 = varint();
+        v.word1 = varint(); }
+
+    template<typename T>
+    typename std::enable_if<has_fromBinary<T>::value &&
+                            !std::is_base_of<IR::INode, T>::value>::type
+    unpack(T *&v) { v = T::fromBinary(*this); }
+    template<typename T>
+    typename std::enable_if<has_fromBinary<T>::value &&
+                            !std::is_base_of<IR::INode, T>::value>::type
+    unpack(T &v) { v = *(T::fromBinary(*this)); }
+
+    template<typename T> typename std::enable_if<std::is_base_of<IR::INode, T>::value>::type
+    unpack(T &v) {
+        if (auto *n = node_as<T>(nullptr)) v = *n; }
+    template<typename T> typename std::enable_if<std::is_base_of<IR::INode, T>::value>::type
+    unpack(const T *&v) { v = node_as<T>(nullptr); }
+
+ public:
+    explicit BinaryLoader(std::istream &in) {
+        char chunk[1 << 16];
+        while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+            text.append(chunk, in.gcount());
+        p = text.data();
+        end = p + text.size();
+        checkHeader(); }
+    BinaryLoader(const char *begin, const char *end) : p(begin), end(end) { checkHeader(); }
+    BinaryLoader(const BinaryLoader &) = delete;
+
+    uint64_t varint() {
+        uint64_t rv = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            unsigned char byte = *p++;
+            rv |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return rv; }
+        fail("data ends early");
+        return 0; }
+    // false once the data was found to be invalid
+    explicit operator bool() const { return !failed; }
+    // Moves the source positions read from now on by this many lines, for IR that
+    // is put in a program at another place than the one it was written from
+    void shiftLines(int delta) { lineShift = delta; }
+    int64_t zigzag() {
+        uint64_t v = varint();
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+    template<typename T> BinaryLoader &operator>>(T &v) {
+        unpack(v);
+        return *this; }
+};
+
+#endif /* _IR_BINARY_LOADER_H_ */
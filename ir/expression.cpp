@@ -53,6 +53,38 @@ IR::Constant::handleOverflow(bool noWarning) {
     }
 
     int width = tb->size;
+    if (width > 0 && width < 63 && value.fits_slong_p()) {
+        // Common case: compute with machine integers to avoid GMP temporaries
+        long v = value.get_si();
+        long mask = (1L << width) - 1;
+        if (tb->isSigned) {
+            long max = (1L << (width - 1)) - 1;
+            long min = -(1L << (width - 1));
+            if (v < min || v > max) {
+                if (!noWarning)
+                    ::warning("%1%: signed value does not fit in %2% bits", this, width);
+                LOG2("value=" << v << ", min=" << min <<
+                     ", max=" << max << ", masked=" << (v & mask) <<
+                     ", adj=" << ((v & mask) - (1L << width)));
+                v = v & mask;
+                if (v > max)
+                    v -= (1L << width);
+                value = v;
+            }
+        } else {
+            if (v < 0) {
+                if (!noWarning)
+                    ::warning("%1%: negative value with unsigned type", this);
+            } else if ((v & mask) != v) {
+                if (!noWarning)
+                    ::warning("%1%: value does not fit in %2% bits", this, width);
+            }
+            if ((v & mask) != v)
+                value = v & mask;
+        }
+        return;
+    }
+
     mpz_class one = 1;
     mpz_class mask = Util::mask(width);
 
@@ -50,5 +50,7 @@ struct ID : Util::IHasSourceInfo {
     cstring toString() const override { return originalName.isNullOrEmpty() ? name : originalName; }
 };
 
+inline size_t hash_field(const ID &id) { return id.name.hash(); }
+
 }  // namespace IR
 #endif  // _IR_ID_H_
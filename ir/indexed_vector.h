@@ -17,9 +17,14 @@ limitations under the License.
 #ifndef IR_INDEXED_VECTOR_H_
 #define IR_INDEXED_VECTOR_H_
 
+#ifdef MULTITHREAD
+#include <atomic>
+#endif  // MULTITHREAD
+#include <memory>
 
 #include "dbprint.h"
 #include "lib/enumerator.h"
+#include "lib/hvec_map.h"
 #include "lib/null.h"
 #include "lib/error.h"
 #include "vector.h"
@@ -41,36 +46,84 @@ class IDeclaration : public virtual INode {
 
 template<class T>
 class IndexedVector : public Vector<T> {
-    ordered_map<cstring, const IDeclaration*> declarations;
+    typedef hvec_map<cstring, const IDeclaration*> DeclarationMap;
+    // Built on the first lookup or insertion that needs it, and shared by copies of
+    // the vector until one of them changes, so that copying a vector is cheap
+    mutable std::shared_ptr<DeclarationMap> declarations;
+
+    std::shared_ptr<DeclarationMap> loadIndex() const {
+#ifdef MULTITHREAD
+        // other threads may be building the index of the same vector
+        return std::atomic_load(&declarations);
+#else
+        return declarations;
+#endif  // MULTITHREAD
+    }
+    const DeclarationMap &index() const {
+        auto map = loadIndex();
+        if (map) return *map;
+        map = std::make_shared<DeclarationMap>();
+        // duplicates were reported when they were inserted; the first one stays
+        for (auto a : *this)
+            if (auto decl = a->template to<IDeclaration>())
+                map->emplace(decl->getName().name, decl);
+#ifdef MULTITHREAD
+        std::shared_ptr<DeclarationMap> none;
+        if (!std::atomic_compare_exchange_strong(&declarations, &none, map))
+            return *none;
+#else
+        declarations = map;
+#endif  // MULTITHREAD
+        return *map; }
+    // The index, not shared with any copy, for a change that must be checked.  It is
+    // built from the elements, so has to be got before the change is made to them.
+    DeclarationMap &ownIndex() {
+        index();
+        if (declarations.use_count() > 1)
+            declarations = std::make_shared<DeclarationMap>(*declarations);
+        return *declarations; }
+    // The index if it is not shared, for a change that cannot make a duplicate; a
+    // shared index is dropped to be rebuilt if needed, rather than copied
+    DeclarationMap *ownIndexIfAny() {
+        if (declarations.use_count() > 1)
+            declarations.reset();
+        return declarations.get(); }
 
     void insertInMap(const T* a) {
         if (!a->template is<IDeclaration>())
             return;
         auto decl = a->template to<IDeclaration>();
         auto name = decl->getName().name;
-        auto previous = declarations.find(name);
-        if (previous != declarations.end())
+        auto &map = ownIndex();
+        auto previous = map.find(name);
+        if (previous != map.end())
             ::error("%1%: Duplicates declaration %2%", a, previous->second);
         else
-            declarations[name] = decl; }
+            map.emplace(name, decl); }
     void removeFromMap(const T* a) {
         auto decl = a->template to<IDeclaration>();
         if (decl == nullptr)
             return;
+        auto map = ownIndexIfAny();
+        if (map == nullptr)
+            return;
         cstring name = decl->getName().name;
-        auto it = declarations.find(name);
-        if (it == declarations.end())
+        auto it = map->find(name);
+        if (it == map->end())
             BUG("%1% does not exist", a);
-        declarations.erase(it); }
+        map->erase(it); }
 
  public:
     using Vector<T>::begin;
     using Vector<T>::end;
 
     IndexedVector() = default;
-    IndexedVector(const IndexedVector &) = default;
+    IndexedVector(const IndexedVector &a) : Vector<T>(a), declarations(a.loadIndex()) {}
     IndexedVector(IndexedVector &&) = default;
-    IndexedVector &operator=(const IndexedVector &) = default;
+    IndexedVector &operator=(const IndexedVector &a) {
+        Vector<T>::operator=(a);
+        declarations = a.loadIndex();
+        return *this; }
     IndexedVector &operator=(IndexedVector &&) = default;
     explicit IndexedVector(const T *a) {
         push_back(std::move(a)); }
@@ -79,27 +132,32 @@ class IndexedVector : public Vector<T> {
     explicit IndexedVector(const Vector<T> &a) {
         insert(typename Vector<T>::end(), a.begin(), a.end()); }
     explicit IndexedVector(JSONLoader &json);
+    explicit IndexedVector(BinaryLoader &bin);
 
-    void clear() { IR::Vector<T>::clear(); declarations.clear(); }
+    void clear() { IR::Vector<T>::clear(); declarations.reset(); }
     // Although this is not a const_iterator, it should NOT
     // be used to modify the vector directly.  I don't know
     // how to enforce this property, though.
     typedef typename Vector<T>::iterator iterator;
 
     const IDeclaration* getDeclaration(cstring name) const {
-        auto it = declarations.find(name);
-        if (it == declarations.end())
+        auto &map = index();
+        auto it = map.find(name);
+        if (it == map.end())
             return nullptr;
         return it->second; }
     template <class U>
     const U* getDeclaration(cstring name) const {
-        auto it = declarations.find(name);
-        if (it == declarations.end())
+        auto &map = index();
+        auto it = map.find(name);
+        if (it == map.end())
             return nullptr;
         return it->second->template to<U>(); }
+    // The declarations, as a lazy range that allocates nothing
+    auto declarationRange() const -> decltype(Util::enumerate(Values(index()))) {
+        return Util::enumerate(Values(index())); }
     Util::Enumerator<const IDeclaration*>* getDeclarations() const {
-        return Util::Enumerator<const IDeclaration*>::createEnumerator(
-            Values(declarations).begin(), Values(declarations).end()); }
+        return declarationRange().toEnumerator(); }
     iterator erase(iterator i) {
         removeFromMap(*i);
         return Vector<T>::erase(i); }
@@ -109,9 +167,17 @@ class IndexedVector : public Vector<T> {
             insertInMap(*it);
         return Vector<T>::insert(i, b, e); }
     iterator replace(iterator i, const T* v) {
-        removeFromMap(*i);
+        auto prev = (*i)->template to<IDeclaration>(), decl = v->template to<IDeclaration>();
+        if (prev && decl && prev->getName().name == decl->getName().name) {
+            // the usual change made by a Transform, which cannot make a duplicate
+            if (auto map = ownIndexIfAny())
+                (*map)[decl->getName().name] = decl;
+        } else {
+            // the index has to be built before the vector changes
+            if (decl) ownIndex();
+            removeFromMap(*i);
+            insertInMap(v); }
         *i = v;
-        insertInMap(v);
         return ++i; }
     iterator append(const Vector<T>& toAppend) {
         return insert(Vector<T>::end(), toAppend.begin(), toAppend.end()); }
@@ -121,15 +187,15 @@ class IndexedVector : public Vector<T> {
     template <class... Args> void emplace_back(Args&&... args) {
         auto el = new T(std::forward<Args>(args)...);
         insert(el); }
-    void push_back(T *a) { CHECK_NULL(a); Vector<T>::push_back(a); insertInMap(a); }
-    void push_back(const T *a) { CHECK_NULL(a); Vector<T>::push_back(a); insertInMap(a); }
+    void push_back(T *a) { CHECK_NULL(a); insertInMap(a); Vector<T>::push_back(a); }
+    void push_back(const T *a) { CHECK_NULL(a); insertInMap(a); Vector<T>::push_back(a); }
     void pop_back() {
-        if (typename Vector<T>::empty())
+        if (Vector<T>::empty())
             BUG("pop_back from empty IndexedVector");
-        auto last = typename Vector<T>::back();
+        auto last = Vector<T>::back();
         removeFromMap(last);
-        typename Vector<T>::pop_back(); }
-    template<class U> void push_back(U &a) { Vector<T>::push_back(a); insertInMap(a); }
+        Vector<T>::pop_back(); }
+    template<class U> void push_back(U &a) { insertInMap(a); Vector<T>::push_back(a); }
 
     IRNODE_SUBCLASS(IndexedVector)
     IRNODE_DECLARE_APPLY_OVERLOAD(IndexedVector)
@@ -146,6 +212,7 @@ class IndexedVector : public Vector<T> {
 
     void toJSON(JSONGenerator &json) const override;
     static IndexedVector<T>* fromJSON(JSONLoader &json);
+    static IndexedVector<T>* fromBinary(BinaryLoader &bin);
 };
 
 }  // namespace IR
@@ -19,23 +19,32 @@ limitations under the License.
 
 #define DEFINE_APPLY_FUNCTIONS(CLASS, TEMPLATE, TT)                                             \
     TEMPLATE inline bool IR::CLASS TT::apply_visitor_preorder(Modifier &v)                      \
-    { Node::traceVisit("Mod pre"); return v.preorder(this); }                                   \
+    { Node::traceVisit("Mod pre");                                                              \
+      return v.dispatch_preorder(NodeKind<CLASS TT>::value, this); }                            \
     TEMPLATE inline void IR::CLASS TT::apply_visitor_postorder(Modifier &v)                     \
-    { Node::traceVisit("Mod post"); v.postorder(this); }                                        \
+    { Node::traceVisit("Mod post");                                                             \
+      v.dispatch_postorder(NodeKind<CLASS TT>::value, this); }                                  \
     TEMPLATE inline void IR::CLASS TT::apply_visitor_revisit(Modifier &v, const Node *n) const  \
-    { Node::traceVisit("Mod revisit"); v.revisit(this, n); }                                    \
+    { Node::traceVisit("Mod revisit");                                                          \
+      v.dispatch_revisit(NodeKind<CLASS TT>::value, this, n); }                                 \
     TEMPLATE inline bool IR::CLASS TT::apply_visitor_preorder(Inspector &v) const               \
-    { Node::traceVisit("Insp pre"); return v.preorder(this); }                                  \
+    { Node::traceVisit("Insp pre");                                                             \
+      return v.dispatch_preorder(NodeKind<CLASS TT>::value, this); }                            \
     TEMPLATE inline void IR::CLASS TT::apply_visitor_postorder(Inspector &v) const              \
-    { Node::traceVisit("Insp post"); v.postorder(this); }                                       \
+    { Node::traceVisit("Insp post");                                                            \
+      v.dispatch_postorder(NodeKind<CLASS TT>::value, this); }                                  \
     TEMPLATE inline void IR::CLASS TT::apply_visitor_revisit(Inspector &v) const                \
-    { Node::traceVisit("Insp revisit"); v.revisit(this); }                                      \
+    { Node::traceVisit("Insp revisit");                                                         \
+      v.dispatch_revisit(NodeKind<CLASS TT>::value, this); }                                    \
     TEMPLATE inline const IR::Node *IR::CLASS TT::apply_visitor_preorder(Transform &v)          \
-    { Node::traceVisit("Trans pre"); return v.preorder(this); }                                 \
+    { Node::traceVisit("Trans pre");                                                            \
+      return v.dispatch_preorder(NodeKind<CLASS TT>::value, this); }                            \
     TEMPLATE inline const IR::Node *IR::CLASS TT::apply_visitor_postorder(Transform &v)         \
-    { Node::traceVisit("Trans post"); return v.postorder(this); }                               \
+    { Node::traceVisit("Trans post");                                                           \
+      return v.dispatch_postorder(NodeKind<CLASS TT>::value, this); }                           \
     TEMPLATE inline void IR::CLASS TT::apply_visitor_revisit(Transform &v, const Node *n) const \
-    { Node::traceVisit("Trans revisit"); v.revisit(this, n); }
+    { Node::traceVisit("Trans revisit");                                                        \
+      v.dispatch_revisit(NodeKind<CLASS TT>::value, this, n); }
     IRNODE_ALL_NON_TEMPLATE_CLASSES(DEFINE_APPLY_FUNCTIONS, , )
     IRNODE_ALL_TEMPLATES(DEFINE_APPLY_FUNCTIONS)
 #undef DEFINE_APPLY_FUNCTIONS
@@ -43,7 +52,7 @@ limitations under the License.
 #define DEFINE_VISIT_FUNCTIONS(CLASS, BASE)                                             \
     inline void Visitor::visit(const IR::CLASS *&n, const char *name) {                 \
         auto t = apply_visitor(n, name);                                                \
-        n = dynamic_cast<const IR::CLASS *>(t);                                         \
+        n = t ? t->to<IR::CLASS>() : nullptr;                                           \
         if (t && !n)                                                                    \
             BUG("visitor returned non-" #CLASS " type: %1%", t); }                      \
     inline void Visitor::visit(const IR::CLASS *const &n, const char *name) {           \
@@ -59,22 +68,23 @@ template<class T> void IR::Vector<T>::visit_children(Visitor &v) {
             i = erase(i);
         } else if (n == *i) {
             i++;
-        } else if (auto l = dynamic_cast<const Vector *>(n)) {
+        } else if (auto l = n->template to<Vector>()) {
             i = erase(i);
             i = insert(i, l->vec.begin(), l->vec.end());
             i += l->vec.size();
-        } else if (auto v = dynamic_cast<const VectorBase *>(n)) {
+        } else if (auto v = n->template to<VectorBase>()) {
             if (v->empty()) {
                 i = erase(i);
             } else {
                 i = insert(i, v->size() - 1, nullptr);
                 for (auto el : *v) {
-                    if (auto e = dynamic_cast<const T *>(el))
+                    if (auto e = el ? el->template to<T>() : nullptr)
                         *i++ = e;
                     else
                         BUG("visitor returned invalid type %s for Vector<%s>",
-                            e->node_type_name(), T::static_type_name()); } }
-        } else if (auto e = dynamic_cast<const T *>(n)) {
+                            el ? el->node_type_name() : cstring("<null>"),
+                            T::static_type_name()); } }
+        } else if (auto e = n->template to<T>()) {
             *i++ = e;
         } else {
             BUG("visitor returned invalid type %s for Vector<%s>",
@@ -94,22 +104,23 @@ template<class T> void IR::Vector<T>::parallel_visit_children(Visitor &v) {
             i = erase(i);
         } else if (n == *i) {
             i++;
-        } else if (auto l = dynamic_cast<const Vector *>(n)) {
+        } else if (auto l = n->template to<Vector>()) {
             i = erase(i);
             i = insert(i, l->vec.begin(), l->vec.end());
             i += l->vec.size();
-        } else if (auto v = dynamic_cast<const VectorBase *>(n)) {
+        } else if (auto v = n->template to<VectorBase>()) {
             if (v->empty()) {
                 i = erase(i);
             } else {
                 i = insert(i, v->size() - 1, nullptr);
                 for (auto el : *v) {
-                    if (auto e = dynamic_cast<const T *>(el))
+                    if (auto e = el ? el->template to<T>() : nullptr)
                         *i++ = e;
                     else
                         BUG("visitor returned invalid type %s for Vector<%s>",
-                            e->node_type_name(), T::static_type_name()); } }
-        } else if (auto e = dynamic_cast<const T *>(n)) {
+                            el ? el->node_type_name() : cstring("<null>"),
+                            T::static_type_name()); } }
+        } else if (auto e = n->template to<T>()) {
             *i++ = e;
         } else {
             BUG("visitor returned invalid type %s for Vector<%s>",
@@ -145,6 +156,18 @@ template<class T>
 IR::Vector<T>* IR::Vector<T>::fromJSON(JSONLoader &json) {
     return new Vector<T>(json);
 }
+template<class T> void IR::Vector<T>::toBinary(BinaryGenerator &bin) const {
+    Node::toBinary(bin);
+    bin << vec;
+}
+template<class T>
+IR::Vector<T>::Vector(BinaryLoader &bin) : VectorBase(bin) {
+    bin >> vec;
+}
+template<class T>
+IR::Vector<T>* IR::Vector<T>::fromBinary(BinaryLoader &bin) {
+    return new Vector<T>(bin);
+}
 
 
 std::ostream &operator<<(std::ostream &out, const IR::Vector<IR::Expression> &v);
@@ -158,11 +181,11 @@ template<class T> void IR::IndexedVector<T>::visit_children(Visitor &v) {
             i = erase(i);
         } else if (n == *i) {
             i++;
-        } else if (auto l = dynamic_cast<const Vector<T> *>(n)) {
+        } else if (auto l = n->template to<Vector<T>>()) {
             i = erase(i);
             i = insert(i, l->begin(), l->end());
             i += l->Vector<T>::size();
-        } else if (auto e = dynamic_cast<const T *>(n)) {
+        } else if (auto e = n->template to<T>()) {
             i = replace(i, e);
         } else {
             BUG("visitor returned invalid type %s for IndexedVector<%s>",
@@ -177,7 +200,7 @@ void IR::IndexedVector<T>::toJSON(JSONGenerator &json) const {
     const char *sep = "";
     Vector<T>::toJSON(json);
     json << "," << std::endl << json.indent++ << "\"declarations\" : {";
-    for (auto &k : declarations) {
+    for (auto &k : index()) {
         json << sep << std::endl << json.indent << k.first << " : " << k.second;
         sep = ","; }
     --json.indent;
@@ -186,12 +209,18 @@ void IR::IndexedVector<T>::toJSON(JSONGenerator &json) const {
 }
 template<class T>
 IR::IndexedVector<T>::IndexedVector(JSONLoader &json) : Vector<T>(json) {
-    json.load("declarations", declarations);
+    // the "declarations" index is rebuilt from the elements when needed
 }
 template<class T>
 IR::IndexedVector<T>* IR::IndexedVector<T>::fromJSON(JSONLoader &json) {
     return new IndexedVector<T>(json);
 }
+template<class T>
+IR::IndexedVector<T>::IndexedVector(BinaryLoader &bin) : Vector<T>(bin) {}
+template<class T>
+IR::IndexedVector<T>* IR::IndexedVector<T>::fromBinary(BinaryLoader &bin) {
+    return new IndexedVector<T>(bin);
+}
 IRNODE_DEFINE_APPLY_OVERLOAD(IndexedVector, template<class T>, <T>)
 
 #include "lib/ordered_map.h"
@@ -231,10 +260,10 @@ void IR::NameMap<T, MAP, COMP, ALLOC>::visit_children(Visitor &v) {
             i = symbols.erase(i);
         } else if (n == i->second) {
             i++;
-        } else if (auto m = dynamic_cast<const NameMap *>(n)) {
+        } else if (auto m = n->template to<NameMap>()) {
             namemap_insert_helper(i, m->symbols.begin(), m->symbols.end(), symbols, new_symbols);
             i = symbols.erase(i);
-        } else if (auto s = dynamic_cast<const T *>(n)) {
+        } else if (auto s = n->template to<T>()) {
             if (match_name(i->first, s)) {
                 i->second = s;
                 i++;
@@ -277,6 +306,32 @@ template<class T, template<class K, class V, class COMP, class ALLOC> class MAP
 IR::NameMap<T, MAP, COMP, ALLOC> *IR::NameMap<T, MAP, COMP, ALLOC>::fromJSON(JSONLoader &json) {
     return new IR::NameMap<T, MAP, COMP, ALLOC>(json);
 }
+template<class T, template<class K, class V, class COMP, class ALLOC> class MAP /*= std::map */,
+         class COMP /*= std::less<cstring>*/,
+         class ALLOC /*= std::allocator<std::pair<cstring, const T*>>*/>
+void IR::NameMap<T, MAP, COMP, ALLOC>::toBinary(BinaryGenerator &bin) const {
+    Node::toBinary(bin);
+    bin.varint(symbols.size());
+    for (auto &k : symbols)
+        bin << k.first << k.second;
+}
+template<class T, template<class K, class V, class COMP, class ALLOC> class MAP /*= std::map */,
+         class COMP /*= std::less<cstring>*/,
+         class ALLOC /*= std::allocator<std::pair<cstring, const T*>>*/>
+IR::NameMap<T, MAP, COMP, ALLOC>::NameMap(BinaryLoader &bin) : Node(bin) {
+    for (size_t n = bin.varint(); n > 0 && bin; --n) {
+        cstring name;
+        const T *obj = nullptr;
+        bin >> name >> obj;
+        symbols.emplace(name, obj); }
+}
+template<class T, template<class K, class V, class COMP, class ALLOC> class MAP /*= std::map */,
+         class COMP /*= std::less<cstring>*/,
+         class ALLOC /*= std::allocator<std::pair<cstring, const T*>>*/>
+IR::NameMap<T, MAP, COMP, ALLOC> *
+IR::NameMap<T, MAP, COMP, ALLOC>::fromBinary(BinaryLoader &bin) {
+    return new IR::NameMap<T, MAP, COMP, ALLOC>(bin);
+}
 
 template<class KEY, class VALUE,
          template<class K, class V, class COMP, class ALLOC> class MAP /*= std::map */,
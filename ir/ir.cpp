@@ -30,7 +30,7 @@ const cstring IApply::applyMethodName = "apply";
 const cstring P4Program::main = "main";
 const cstring Type_Error::error = "error";
 
-int IR::Declaration::nextId = 0;
+IR::Node::id_counter_t IR::Declaration::nextId(0);
 
 const Type_Method* P4Control::getConstructorMethodType() const {
     return new Type_Method(Util::SourceInfo(), getTypeParameters(), type, constructorParams);
@@ -27,6 +27,7 @@ limitations under the License.
 #include "lib/cstring.h"
 #include "lib/map.h"
 #include "lib/ordered_map.h"
+#include "lib/hashed_multimap.h"
 #include "lib/exceptions.h"
 #include "lib/source_file.h"
 #include "lib/ltbitmatrix.h"
@@ -48,6 +49,8 @@ limitations under the License.
 
 #include "json_loader.h"
 #include "json_generator.h"
+#include "binary_generator.h"
+#include "binary_loader.h"
 
 #include "pass_manager.h"
 #include "ir-inline.h"
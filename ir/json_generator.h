@@ -19,15 +19,26 @@ limitations under the License.
 
 #include <assert.h>
 #include <gmpxx.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 #include "lib/cstring.h"
+#include "lib/hvec_map.h"
 #include "lib/indent.h"
 #include "lib/match.h"
 
 #include "ir.h"
+// Writes through the buffer of the stream, which is flushed only when the generator is
+// destroyed; std::endl in the output of toJSON is a plain newline.  A compact generator
+// writes no newlines or indentation.
+// The Node_ID of a node is its number in the order the nodes are first written, not its
+// Node::id, which depends on the order the threads that made the nodes ran in; so the
+// text of a tree is the same whether the passes that made it ran in parallel or not.
 class JSONGenerator {
-    std::unordered_set<int> node_refs;
+    std::vector<int> node_numbers;  // by Node::id, -1 for the nodes not written yet
+    int next_number = 0;
     std::ostream &out;
+    bool compact;
 
     template<typename T>
     class has_toJSON {
@@ -40,21 +51,32 @@ class JSONGenerator {
         static const bool value = sizeof(test<T>(0)) == sizeof(char);
     };
 
+    void newline() { if (!compact) out << '\n'; }
+
  public:
     indent_t indent;
 
-    explicit JSONGenerator(std::ostream &out) : out(out) {}
+    explicit JSONGenerator(std::ostream &out, bool compact = false)
+    : out(out), compact(compact) {}
+    ~JSONGenerator() { out.flush(); }
+
+    // The Node_ID of a node being written
+    int node_number(const IR::Node &n) const { return node_numbers.at(n.id); }
 
     template<typename T>
     void generate(const vector<T> &v) {
         out << "[";
         if (v.size() > 0) {
-            out << std::endl << ++indent;
+            newline();
+            *this << ++indent;
             generate(v[0]);
             for (size_t i = 1; i < v.size(); i++) {
-                out << "," << std::endl << indent;
+                out << ",";
+                newline();
+                *this << indent;
                 generate(v[i]); }
-            out << std::endl << --indent; }
+            newline();
+            *this << --indent; }
         out << "]";
     }
 
@@ -62,35 +84,52 @@ class JSONGenerator {
     void generate(const std::vector<T> &v) {
         out << "[";
         if (v.size() > 0) {
-            out << std::endl << ++indent;
+            newline();
+            *this << ++indent;
             generate(v[0]);
             for (size_t i = 1; i < v.size(); i++) {
-                out << "," << std::endl << indent;
+                out << ",";
+                newline();
+                *this << indent;
                 generate(v[i]); }
-            out << std::endl << --indent; }
+            newline();
+            *this << --indent; }
         out << "]";
     }
 
     template<typename T, typename U>
     void generate(const std::pair<T, U> &v) {
-        out << "{" << std::endl << ++indent << "\"first\" : ";
+        out << "{";
+        newline();
+        *this << ++indent << "\"first\" : ";
         generate(v.first);
-        out << "," << std::endl << indent << "\"second\" : ";
+        out << ",";
+        newline();
+        *this << indent << "\"second\" : ";
         generate(v.second);
-        out << std::endl << --indent << "}";
+        newline();
+        *this << --indent << "}";
     }
 
     template<typename K, typename V>
-    void generate(const ordered_map<K, V> &v) {
-        out << "[" << std::endl;
+    void generate(const ordered_map<K, V> &v) { generate_map(v); }
+    template<typename K, typename V>
+    void generate(const hvec_map<K, V> &v) { generate_map(v); }
+    template<typename MAP>
+    void generate_map(const MAP &v) {
+        out << "[";
+        newline();
         if (v.size() > 0) {
             auto it = v.begin();
-            out << ++indent;
+            *this << ++indent;
             generate(*it);
             for (it++; it != v.end(); ++it) {
-                out << "," << std::endl << indent;
+                out << ",";
+                newline();
+                *this << indent;
                 generate(*it); }
-            out << std::endl << --indent; }
+            newline();
+            *this << --indent; }
         out << "]";
     }
 
@@ -116,10 +155,13 @@ class JSONGenerator {
     }
 
     void generate(const match_t &v) {
-        out << "{" << std::endl
-            << (indent + 1) << "\"word0\" : " << v.word0 << "," << std::endl
-            << (indent + 1) << "\"word1\" : " << v.word1 << std::endl
-            << indent << "}";
+        out << "{";
+        newline();
+        *this << (indent + 1) << "\"word0\" : " << v.word0 << ",";
+        newline();
+        *this << (indent + 1) << "\"word1\" : " << v.word1;
+        newline();
+        *this << indent << "}";
     }
 
     template<typename T>
@@ -128,20 +170,26 @@ class JSONGenerator {
                     !std::is_base_of<IR::Node, T>::value>::type
     generate(const T &v) {
         ++indent;
-        out << "{" << std::endl;
+        out << "{";
+        newline();
         v.toJSON(*this);
-        out << std::endl << --indent << "}";
+        newline();
+        *this << --indent << "}";
     }
 
     void generate(const IR::Node &v) {
-        out << "{" << std::endl;
+        out << "{";
+        newline();
         ++indent;
-        if (node_refs.find(v.id) != node_refs.end()) {
-            out << indent << "\"Node_ID\" : " << v.id;
+        if (size_t(v.id) >= node_numbers.size())
+            node_numbers.resize(std::max(size_t(v.id) + 1, 2 * node_numbers.size()), -1);
+        if (node_numbers[v.id] >= 0) {
+            *this << indent << "\"Node_ID\" : " << node_numbers[v.id];
         } else {
-            node_refs.insert(v.id);
+            node_numbers[v.id] = next_number++;
             v.toJSON(*this); }
-        out << std::endl << --indent << "}";
+        newline();
+        *this << --indent << "}";
     }
 
     template<typename T>
@@ -159,19 +207,30 @@ class JSONGenerator {
     void generate(const T (&v)[N]) {
         out << "[";
         if (N > 0) {
-            out << std::endl << ++indent;
+            newline();
+            *this << ++indent;
             generate(v[0]);
             for (size_t i = 1; i < N; i++) {
-                out << "," << std::endl << indent;
+                out << ",";
+                newline();
+                *this << indent;
                 generate(v[i]); }
-            out << std::endl << --indent; }
+            newline();
+            *this << --indent; }
         out << "]";
     }
 
     JSONGenerator &operator<<(char ch) { out << ch; return *this; }
     JSONGenerator &operator<<(const char *s) { out << s; return *this; }
-    JSONGenerator &operator<<(indent_t i) { out << i; return *this; }
-    JSONGenerator &operator<<(std::ostream &(*fn)(std::ostream &)) { out << fn; return *this; }
+    JSONGenerator &operator<<(indent_t i) {
+        if (!compact) out << i;
+        return *this; }
+    JSONGenerator &operator<<(std::ostream &(*fn)(std::ostream &)) {
+        if (fn == static_cast<std::ostream &(*)(std::ostream &)>(std::endl))
+            newline();
+        else
+            out << fn;
+        return *this; }
     template<typename T> JSONGenerator &operator<<(const T &v) { generate(v); return *this; }
 };
 
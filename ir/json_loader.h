@@ -22,9 +22,11 @@ limitations under the License.
 #include <string>
 #include <map>
 #include <unordered_map>
+#include <vector>
 #include "lib/cstring.h"
 #include "lib/indent.h"
 #include "lib/match.h"
+#include "lib/small_vector.h"
 #include "json_parser.h"
 
 #include "ir.h"
@@ -40,38 +42,101 @@ class JSONLoader {
         static const bool value = sizeof(test<T>(0)) == sizeof(char);
     };
 
+    // The objects in a JSON value, which bound the Node_IDs that JSONGenerator wrote
+    static size_t countObjects(const JsonData *json) {
+        size_t rv = 0;
+        if (auto *obj = json ? json->to<JsonObject>() : nullptr) {
+            ++rv;
+            for (auto &e : *obj)
+                rv += countObjects(e.second);
+        } else if (auto *vec = json ? json->to<JsonVector>() : nullptr) {
+            for (auto *e : *vec)
+                rv += countObjects(e); }
+        return rv; }
+
  public:
-    std::unordered_map<int, IR::Node*> &node_refs;
+    // The nodes loaded so far, by Node_ID.  JSONGenerator numbers the nodes from 0 in
+    // the order it writes them, so the ids of its output are below the number of objects
+    // in it, and index a table of that size made up front; other ids, such as those of
+    // files that were written with the Node::id of each node, are kept in a map.
+    class NodeTable {
+        std::vector<IR::Node*> dense;
+        std::unordered_map<int, IR::Node*> sparse;
+
+     public:
+        explicit NodeTable(size_t ids = 0) : dense(ids, nullptr) {}
+        IR::Node *&operator[](int id) {
+            return static_cast<size_t>(id) < dense.size() ? dense[id] : sparse[id]; }
+    };
+
+ private:
+    // It lives as long as the loader made for the input; the loaders made for the fields
+    // of the nodes share it.
+    NodeTable own_refs;
+
+ public:
+    NodeTable &node_refs;
     JsonData *json;
 
-    explicit JSONLoader(std::istream &in) : node_refs(*(new std::unordered_map<int, IR::Node*>()))
-    { in >> json; }
+    explicit JSONLoader(std::istream &in) : node_refs(own_refs) {
+        in >> json;
+        own_refs = NodeTable(countObjects(json)); }
 
     explicit JSONLoader(JsonData *json)
-    : node_refs(*(new std::unordered_map<int, IR::Node*>())), json(json) {}
+    : own_refs(countObjects(json)), node_refs(own_refs), json(json) {}
 
-    JSONLoader(JsonData *json, std::unordered_map<int, IR::Node*> &refs)
+    JSONLoader(JsonData *json, NodeTable &refs)
     : node_refs(refs), json(json) {}
 
     JSONLoader(const JSONLoader &unpacker, const std::string &field)
     : node_refs(unpacker.node_refs), json(nullptr) {
-        if (auto obj = dynamic_cast<JsonObject *>(unpacker.json))
+        if (auto obj = unpacker.json ? unpacker.json->to<JsonObject>() : nullptr)
             json = get(obj, field); }
 
  private:
+    // The Node_ID of the object being loaded, or -1 if it has none or a wrong one, which
+    // is an error, as no JSONGenerator writes one
+    int node_id() {
+        auto *obj = json->to<JsonObject>();
+        auto it = obj->find("Node_ID");
+        if (it == obj->end())
+            return -1;
+        auto *num = it->second->to<JsonNumber>();
+        if (!num || !num->fits_int() || static_cast<int>(*num) < 0) {
+            ::error("JSON %1% node with an invalid Node_ID", obj->get_type());
+            return -1; }
+        return *num; }
+
     const IR::Node* get_node() {
         if (!json || !json->is<JsonObject>()) return nullptr;  // invalid json exception?
-        int id = json->to<JsonObject>()->get_id();
+        int id = node_id();
         if (id >= 0) {
-            if (node_refs.find(id) == node_refs.end()) {
-                if (auto fn = get(IR::unpacker_table, json->to<JsonObject>()->get_type()))
-                    node_refs[id] = fn(*this);
-                else
-                    return nullptr; }  // invalid json exception?
+            if (node_refs[id] == nullptr) {
+                if (auto fn = get(IR::unpacker_table, json->to<JsonObject>()->get_type())) {
+                    // loading the children may add to the table
+                    auto node = fn(*this);
+                    node_refs[id] = node;
+                } else {
+                    return nullptr; } }  // invalid json exception?
             return node_refs[id]; }
         return nullptr;  // invalid json exception?
     }
 
+    // The instances of the Vector and NameMap templates are not in IR::unpacker_table,
+    // so T::fromJSON makes them; the references to one still get the node made the first
+    // time, as the JSONGenerator writes a node shared by several fields only once.
+    template<typename T> T *get_node_from() {
+        if (!json || !json->is<JsonObject>()) return nullptr;  // invalid json exception?
+        int id = node_id();
+        if (id < 0)
+            return T::fromJSON(*this);
+        if (node_refs[id] == nullptr) {
+            // loading the children may add to the table
+            auto node = T::fromJSON(*this);
+            node_refs[id] = node; }
+        return dynamic_cast<T *>(node_refs[id]);
+    }
+
     template<typename T>
     void unpack_json(vector<T> &v) {
         T temp;
@@ -81,26 +146,37 @@ class JSONLoader {
         }
     }
 
+    template<typename T, unsigned N>
+    void unpack_json(small_vector<T, N> &v) {
+        T temp;
+        for (auto e : *json->to<JsonVector>()) {
+            load(e, temp);
+            v.push_back(temp);
+        }
+    }
+
     template<typename T> void unpack_json(IR::Vector<T> &v) {
-        v = *IR::Vector<T>::fromJSON(*this); }
+        v = *get_node_from<IR::Vector<T>>(); }
+    template<typename T> void unpack_json(IR::IndexedVector<T> &v) {
+        v = *get_node_from<IR::IndexedVector<T>>(); }
     template<typename T> void unpack_json(const IR::Vector<T> *&v) {
-        v = IR::Vector<T>::fromJSON(*this); }
+        v = get_node_from<IR::Vector<T>>(); }
     template<typename T> void unpack_json(const IR::IndexedVector<T> *&v) {
-        v = IR::IndexedVector<T>::fromJSON(*this); }
+        v = get_node_from<IR::IndexedVector<T>>(); }
     template<class T, template<class K, class V, class COMP, class ALLOC> class MAP,
              class COMP, class ALLOC>
     void unpack_json(IR::NameMap<T, MAP, COMP, ALLOC> &m) {
-        m = *IR::NameMap<T, MAP, COMP, ALLOC>::fromJSON(*this); }
+        m = *get_node_from<IR::NameMap<T, MAP, COMP, ALLOC>>(); }
     template<class T, template<class K, class V, class COMP, class ALLOC> class MAP,
              class COMP, class ALLOC>
     void unpack_json(IR::NameMap<T, MAP, COMP, ALLOC> *&m) {
-        m = IR::NameMap<T, MAP, COMP, ALLOC>::fromJSON(*this); }
+        m = get_node_from<IR::NameMap<T, MAP, COMP, ALLOC>>(); }
 
     template<typename K, typename V>
     void unpack_json(std::map<K, V> &v) {
         std::pair<K, V> temp;
         for (auto e : *json->to<JsonObject>()) {
-            JsonString* k = new JsonString(e.first);
+            JsonString* k = new JsonString(e.first.p, e.first.len);
             load(k, temp.first);
             load(e.second, temp.second);
             v.insert(temp);
@@ -110,7 +186,27 @@ class JSONLoader {
     void unpack_json(ordered_map<K, V> &v) {
         std::pair<K, V> temp;
         for (auto e : *json->to<JsonObject>()) {
-            JsonString* k = new JsonString(e.first);
+            JsonString* k = new JsonString(e.first.p, e.first.len);
+            load(k, temp.first);
+            load(e.second, temp.second);
+            v.insert(temp);
+        }
+    }
+    template<typename K, typename V>
+    void unpack_json(hvec_map<K, V> &v) {
+        std::pair<K, V> temp;
+        for (auto e : *json->to<JsonObject>()) {
+            JsonString* k = new JsonString(e.first.p, e.first.len);
+            load(k, temp.first);
+            load(e.second, temp.second);
+            v.insert(temp);
+        }
+    }
+    template<typename K, typename V>
+    void unpack_json(hashed_multimap<K, V> &v) {
+        std::pair<K, V> temp;
+        for (auto e : *json->to<JsonObject>()) {
+            JsonString* k = new JsonString(e.first.p, e.first.len);
             load(k, temp.first);
             load(e.second, temp.second);
             v.insert(temp);
@@ -120,7 +216,7 @@ class JSONLoader {
     void unpack_json(std::multimap<K, V> &v) {
         std::pair<K, V> temp;
         for (auto e : *json->to<JsonObject>()) {
-            JsonString* k = new JsonString(e.first);
+            JsonString* k = new JsonString(e.first.p, e.first.len);
             load(k, temp.first);
             load(e.second, temp.second);
             v.insert(temp);
@@ -148,21 +244,21 @@ class JSONLoader {
     template<typename T>
     typename std::enable_if<std::is_integral<T>::value>::type
     unpack_json(T &v) { v = *json->to<JsonNumber>(); }
-    void unpack_json(mpz_class &v) { v = json->to<JsonNumber>()->val; }
-    void unpack_json(cstring &v) { v = *json->to<std::string>(); }
-    void unpack_json(IR::ID &v) { v.name = *json->to<std::string>(); }
+    void unpack_json(mpz_class &v) { v = json->to<JsonNumber>()->value(); }
+    void unpack_json(cstring &v) { v = json->to<JsonString>()->c_str(); }
+    void unpack_json(IR::ID &v) { v.name = json->to<JsonString>()->c_str(); }
 
     void unpack_json(LTBitMatrix &m) {
-        if (auto *s = json->to<std::string>())
+        if (auto *s = json->to<JsonString>())
             s->c_str() >> m; }
 
     template<typename T> typename std::enable_if<std::is_enum<T>::value>::type
     unpack_json(T &v) {
-        if (auto *s = json->to<std::string>())
-            *s >> v; }
+        if (auto *s = json->to<JsonString>())
+            cstring(s->c_str()) >> v; }
 
     void unpack_json(match_t &v) {
-        if (auto *s = json->to<std::string>())
+        if (auto *s = json->to<JsonString>())
             s->c_str() >> v; }
 
     template<typename T>
@@ -175,7 +271,10 @@ class JSONLoader {
     template<typename T> typename std::enable_if<std::is_base_of<IR::INode, T>::value>::type
     unpack_json(T &v) { v = *(get_node()->to<T>()); }
     template<typename T> typename std::enable_if<std::is_base_of<IR::INode, T>::value>::type
-    unpack_json(const T *&v) { v = get_node()->to<T>(); }
+    unpack_json(const T *&v) {
+        // a null pointer is written as null; to<T> needs a node to read its kind from
+        auto node = get_node();
+        v = node ? node->to<T>() : nullptr; }
 
     template<typename T, size_t N>
     void unpack_json(T (&v)[N]) {
@@ -0,0 +1,176 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <string>
+#include "json_parser.h"
+
+namespace {
+
+// Like the stream parser it replaces, this is lenient: it expects the output of
+// JSONGenerator, which writes strings without escapes and numbers as integers,
+// and does not check the punctuation between keys and values.
+class JsonParser {
+    char        *p, *end;
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) ++p; }
+    // the next character after any white space, which is skipped as well
+    char next() {
+        skipSpace();
+        return p < end ? *p++ : 0; }
+    void skipWord(size_t len) { p += std::min(len, static_cast<size_t>(end - p)); }
+
+    // the text of a string, after its opening quote
+    bool text(StringRef &rv) {
+        // memchr is vectorized, so this is the fast way to find the end
+        auto close = static_cast<char *>(memchr(p, '"', end - p));
+        if (!close) {
+            p = end;
+            return false; }
+        *close = 0;
+        rv = StringRef(p, close - p);
+        p = close + 1;
+        return true; }
+    JsonString *string() {
+        StringRef s;
+        return text(s) ? new JsonString(s.p, s.len) : nullptr; }
+
+    JsonNumber *number() {
+        char *start = p;
+        if (*p == '-') ++p;
+        char *digits = p;
+        unsigned long v = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            v = v * 10 + (*p++ - '0');
+        // up to 18 digits cannot overflow a long
+        if (p - digits <= 18)
+            return new JsonNumber(*start == '-' ? -static_cast<long>(v) : static_cast<long>(v));
+        return new JsonNumber(mpz_class(std::string(start, p))); }
+
+    JsonObject *object() {
+        auto rv = new JsonObject();
+        for (char ch = next(); ch && ch != '}'; ch = next()) {
+            if (ch != '"')
+                continue;
+            StringRef key;
+            if (!text(key))
+                break;
+            next();  // the ':'
+            (*rv)[key] = value();
+            if (next() != ',')
+                break; }
+        return rv; }
+
+    JsonVector *vector() {
+        auto rv = new JsonVector();
+        skipSpace();
+        if (p < end && *p == ']') {
+            ++p;
+            return rv; }
+        while (p < end) {
+            rv->push_back(value());
+            if (next() != ',')
+                break; }
+        return rv; }
+
+ public:
+    JsonParser(char *begin, char *end) : p(begin), end(end) {}
+
+    JsonData *value() {
+        switch (next()) {
+        case '{':
+            return object();
+        case '[':
+            return vector();
+        case '"':
+            return string();
+        case '-': case '0': case '1': case '2': case '3':
+        case '4': case '5': case '6': case '7': case '8': case '9':
+            --p;
+            return number();
+        case 't': case 'T':
+            skipWord(3);
+            return new JsonBoolean(true);
+        case 'f': case 'F':
+            skipWord(4);
+            return new JsonBoolean(false);
+        case 'n': case 'N':
+            skipWord(3);
+            return new JsonNull();
+        default:
+            return nullptr;
+        }
+    }
+};
+
+// Hack to make << operator work multi-threaded
+thread_local int level = 0;
+
+std::string getIndent(int l) {
+    return std::string(l * 4, ' ');
+}
+
+}  // namespace
+
+JsonData *parseJson(char *begin, char *end) {
+    return JsonParser(begin, end).value();
+}
+
+std::ostream& operator<<(std::ostream &out, const JsonData* json) {
+    if (auto obj = json ? json->to<JsonObject>() : nullptr) {
+        out << "{";
+        if (obj->size() > 0) {
+            level++;
+            out << std::endl;
+            for (auto &e : *obj)
+                out << getIndent(level) << e.first.toString() << " : " << e.second << ","
+                    << std::endl;
+            out << getIndent(--level);
+        }
+        out << "}";
+    } else if (auto vec = json ? json->to<JsonVector>() : nullptr) {
+        out << "[";
+        if (vec->size() > 0) {
+            level++;
+            out << std::endl;
+            for (auto &e : *vec) {
+                out << getIndent(level) << e << "," << std::endl;
+            }
+            out << getIndent(--level);
+        }
+        out << "]";
+    } else if (auto s = json ? json->to<JsonString>() : nullptr) {
+        out << "\"" << s->c_str() << "\"";
+    } else if (auto num = json ? json->to<JsonNumber>() : nullptr) {
+        out << num->value();
+    } else if (auto b = json ? json->to<JsonBoolean>() : nullptr) {
+        out << (b->val ? "true" : "false");
+    } else if (json && json->is<JsonNull>()) {
+        out << "null";
+    }
+    return out;
+}
+
+std::istream& operator>>(std::istream &in, JsonData*& json) {
+    // never freed, as the strings parsed refer to it
+    auto text = new std::string;
+    char chunk[1 << 16];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+        text->append(chunk, in.gcount());
+    json = parseJson(&(*text)[0], &(*text)[0] + text->size());
+    return in;
+}
@@ -1,6 +1,7 @@
 #ifndef IR_JSON_PARSER_H_
 #define IR_JSON_PARSER_H_
 
+#include <limits.h>
 #include <vector>
 #include <map>
 #include <iostream>
@@ -8,201 +9,107 @@
 #include <istream>
 #include <sstream>
 
-#include "../lib/ordered_map.h"
+#include "../lib/hvec_map.h"
 #include "../lib/gmputil.h"
+#include "../lib/stringref.h"
 
 class JsonData {
  public:
-    JsonData() {}
+    // Which of the subclasses this is, so is<T> and to<T> need no RTTI
+    enum class Kind { Number, Boolean, String, Vector, Object, Null };
+    const Kind kind;
+
+    explicit JsonData(Kind kind) : kind(kind) {}
     JsonData(const JsonData&) = default;
     JsonData(JsonData&&) = default;
-    JsonData &operator=(const JsonData &) & = default;
-    JsonData &operator=(JsonData &&) & = default;
-    template<typename T> bool is() const { return to<T>() != nullptr; }
-    template<typename T> const T* to() const { return dynamic_cast<const T*>(this); }
+    template<typename T> bool is() const { return kind == T::kindTag; }
+    template<typename T> const T* to() const {
+        return is<T>() ? static_cast<const T*>(this) : nullptr; }
+    template<typename T> T* to() { return is<T>() ? static_cast<T*>(this) : nullptr; }
     virtual ~JsonData() {}
 };
 
 class JsonNumber : public JsonData {
+    long        small = 0;
+    mpz_class   *big = nullptr;     // only for numbers that do not fit in a long
+
  public:
-    JsonNumber(mpz_class v) : val(v) {}   // NOLINT(runtime/explicit)
-    operator int() const { return val.get_si(); }  // Does not handle overflow
-    mpz_class val;
+    static constexpr Kind kindTag = Kind::Number;
+    explicit JsonNumber(long v) : JsonData(kindTag), small(v) {}
+    explicit JsonNumber(const mpz_class &v) : JsonData(kindTag) {
+        if (v.fits_slong_p())
+            small = v.get_si();
+        else
+            big = new mpz_class(v); }
+    mpz_class value() const { return big ? *big : mpz_class(small); }
+    operator int() const { return big ? big->get_si() : small; }  // Does not handle overflow
+    bool fits_int() const { return !big && small >= INT_MIN && small <= INT_MAX; }
 };
 
 class JsonBoolean : public JsonData {
  public:
-    JsonBoolean(bool v) : val(v) {}   // NOLINT(runtime/explicit)
+    static constexpr Kind kindTag = Kind::Boolean;
+    JsonBoolean(bool v) : JsonData(kindTag), val(v) {}   // NOLINT(runtime/explicit)
     operator bool() const { return val; }
     bool val;
 };
 
-class JsonString : public JsonData, public std::string {
+// Refers to the text of the string in the buffer that was parsed, where the parser
+// replaced the closing quote by a NUL, so c_str() can be used as well.
+class JsonString : public JsonData, public StringRef {
  public:
-    JsonString() {}
-    JsonString(const std::string &s) : std::string(s) {}    // NOLINT(runtime/explicit)
-    JsonString(const char *s) : std::string(s) {}           // NOLINT(runtime/explicit)
-    JsonString(const JsonString&) = default;
-    JsonString(JsonString&&) = default;
-    JsonString &operator=(const JsonString&) & = default;
-    JsonString &operator=(JsonString&&) & = default;
-    operator cstring() { return cstring(*this); }
+    static constexpr Kind kindTag = Kind::String;
+    JsonString(const char *s, size_t len) : JsonData(kindTag), StringRef(s, len) {}
+    const char *c_str() const { return p; }
 };
 
 class JsonVector : public JsonData, public std::vector<JsonData*> {
  public:
-    JsonVector() {}
-    JsonVector(const std::vector<JsonData*> & v)   // NOLINT(runtime/explicit)
-    : std::vector<JsonData*>(v) {}
-    JsonVector &operator=(const JsonVector&) & = default;
-    JsonVector &operator=(JsonVector&&) & = default;
+    static constexpr Kind kindTag = Kind::Vector;
+    JsonVector() : JsonData(kindTag) {}
 };
 
-class JsonObject : public JsonData, public ordered_map<std::string, JsonData*>  {
+struct JsonKeyHash {
+    size_t operator()(StringRef s) const {
+        // FNV-1a; keys are short
+        size_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < s.len; ++i)
+            h = (h ^ static_cast<unsigned char>(s.p[i])) * 1099511628211ULL;
+        return h; }
+};
+
+class JsonObject : public JsonData, public hvec_map<StringRef, JsonData*, JsonKeyHash>  {
  public:
-    JsonObject &operator=(JsonObject&&) & = default;
-    JsonObject(const ordered_map<std::string, JsonData*> & v)  // NOLINT(runtime/explicit)
-    : ordered_map<std::string, JsonData*>(v) {}
+    static constexpr Kind kindTag = Kind::Object;
+    JsonObject() : JsonData(kindTag) {}
     int get_id() const {
-        if (find("Node_ID") == end())
+        auto it = find("Node_ID");
+        if (it == end() || !it->second->is<JsonNumber>())
             return -1;
-        else
-            return *(find("Node_ID")->second->to<JsonNumber>());
-    }
+        return *it->second->to<JsonNumber>(); }
 
-    std::string get_type() const {
-        if (find("Node_Type") == end())
+    const char *get_type() const {
+        auto it = find("Node_Type");
+        if (it == end() || !it->second->is<JsonString>())
             return "";
-        else
-            return *(dynamic_cast<JsonString*>(find("Node_Type")->second));
-    }
+        return it->second->to<JsonString>()->c_str(); }
+};
+
+class JsonNull : public JsonData {
+ public:
+    static constexpr Kind kindTag = Kind::Null;
+    JsonNull() : JsonData(kindTag) {}
 };
 
-class JsonNull : public JsonData {};
-
-// Hack to make << operator work multi-threaded
-static thread_local int level = 0;
-
-inline std::string getIndent(int l) {
-    std::stringstream ss;
-    for (int i = 0; i < l*4; i++) ss << " ";
-    return ss.str();
-}
-
-inline std::ostream& operator<<(std::ostream &out, JsonData* json) {
-    if (dynamic_cast<JsonObject*>(json)) {
-        auto obj = dynamic_cast<ordered_map<std::string, JsonData*>*>(json);
-        out << "{";
-        if (obj->size() > 0) {
-            level++;
-            out << std::endl;
-            for (auto &e : *obj)
-                out << getIndent(level) << e.first << " : " << e.second << "," << std::endl;
-            out << getIndent(--level);
-        }
-        out << "}";
-    } else if (dynamic_cast<JsonVector*>(json)) {
-        std::vector<JsonData*>* vec = dynamic_cast<std::vector<JsonData*>*>(json);
-        out << "[";
-        if (vec->size() > 0) {
-            level++;
-            out << std::endl;
-            for (auto &e : *vec) {
-                out << getIndent(level) << e << "," << std::endl;
-            }
-            out << getIndent(--level);
-        }
-        out << "]";
-    } else if (dynamic_cast<JsonString*>(json)) {
-        JsonString* s = dynamic_cast<JsonString*>(json);
-        out << "\"" << s->c_str() << "\"";
-
-    } else if (dynamic_cast<JsonNumber*>(json)) {
-        JsonNumber* num = dynamic_cast<JsonNumber*>(json);
-        out << num->val;
-
-    } else if (dynamic_cast<JsonBoolean*>(json)) {
-        JsonBoolean *b = dynamic_cast<JsonBoolean*>(json);
-        out << (b->val ? "true" : "false");
-    } else if (dynamic_cast<JsonNull*>(json)) {
-        out << "null";
-    }
-    return out;
-}
-
-
-inline std::istream& operator>>(std::istream &in, JsonData*& json) {
-    while (in) {
-        char ch;
-        in >> ch;
-        switch (ch) {
-        case '{': {
-            ordered_map<std::string, JsonData*> obj;
-            do {
-                in >> std::ws >> ch;
-                if (ch == '}')
-                    break;
-                in.unget();
-
-                JsonData *key, *val;
-                in >> key >> std::ws >> ch >> std::ws >> val;
-                obj[*(dynamic_cast<std::string*>(key))] = val;
-
-                in >> std::ws >> ch;
-            } while (in && ch != '}');
-
-            json = new JsonObject(obj);
-            return in;
-        }
-        case '[': {
-            std::vector<JsonData*> vec;
-            do {
-                in >> std::ws >> ch;
-                if (ch == ']')
-                    break;
-                in.unget();
-
-                JsonData *elem;
-                in >> elem;
-                vec.push_back(elem);
-
-                in >> std::ws >> ch;
-            } while (in && ch != ']');
-
-            json = new JsonVector(vec);
-            return in;
-        }
-        case '"': {
-            std::string s;
-            getline(in, s, '"');
-            json = new JsonString(s);
-            return in;
-        }
-        case '-': case '0': case '1': case '2': case '3':
-        case '4': case '5': case '6': case '7': case '8': case '9': {
-            mpz_class num;
-            in.unget();
-            in >> num;
-            json = new JsonNumber(num);
-            return in;
-        }
-        case 't': case 'T':
-            in.ignore(3);
-            json = new JsonBoolean(true);
-            return in;
-        case 'f': case 'F':
-            in.ignore(4);
-            json = new JsonBoolean(false);
-            return in;
-        case 'n': case 'N':
-            in.ignore(3);
-            json = new JsonNull();
-            return in;
-        default:
-            return in;
-        }
-    }
-    return in;
-}
+// Parses the JSON value at the start of a buffer in one pass, without copying the
+// strings out of it, so the buffer (which may as well be a privately mapped file)
+// must stay allocated while the result is in use.  It is modified to terminate the
+// strings.  Returns nullptr if there is no value.
+JsonData *parseJson(char *begin, char *end);
+
+std::ostream& operator<<(std::ostream &out, const JsonData* json);
+
+// Reads the rest of the stream and parses the JSON value at its start
+std::istream& operator>>(std::istream &in, JsonData*& json);
 
 #endif /* IR_JSON_PARSER_H_ */
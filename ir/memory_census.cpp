@@ -0,0 +1,62 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+
+#include "memory_census.h"
+#include "lib/n4.h"
+
+bool MemoryCensus::preorder(const IR::Node* node) {
+    unsigned kind = node->node_kind();
+    size_t size = IR::node_classes[kind].size;
+    if (auto vec = dynamic_cast<const IR::VectorBase*>(node)) {
+        size += vec->capacity() * sizeof(const IR::Node*);
+        vectorSlack += (vec->capacity() - vec->size()) * sizeof(const IR::Node*); }
+    classes[kind].count++;
+    classes[kind].bytes += size;
+    nodes++;
+    bytes += size;
+
+    auto &si = node->srcInfo;
+    if (si.isValid()) {
+        auto position = std::make_tuple(si.getStart().getLineNumber(),
+                                        si.getStart().getColumnNumber(),
+                                        si.getEnd().getLineNumber(),
+                                        si.getEnd().getColumnNumber());
+        if (!positions.insert(position).second)
+            duplicatePositions++; }
+    return true;
+}
+
+void MemoryCensus::report(std::ostream &out, unsigned top) const {
+    size_t strings;
+    size_t stringBytes = cstring::cache_size(strings);
+    out << n4(nodes) << " nodes, " << n4(bytes) << "B; vector slack " << n4(vectorSlack)
+        << "B; duplicate srcInfo " << n4(duplicatePositions) << " ("
+        << n4(duplicatePositions * sizeof(Util::SourceInfo)) << "B); cstring cache "
+        << n4(strings) << " strings, " << n4(stringBytes) << "B" << std::endl;
+
+    std::vector<unsigned> kinds;
+    for (unsigned k = 0; k < classes.size(); ++k)
+        if (classes[k].count) kinds.push_back(k);
+    std::sort(kinds.begin(), kinds.end(), [this](unsigned a, unsigned b) {
+        return classes[a].bytes > classes[b].bytes; });
+    if (kinds.size() > top)
+        kinds.resize(top);
+    for (auto k : kinds)
+        out << "  " << n4(classes[k].bytes) << "B " << n4(classes[k].count) << "  "
+            << IR::node_classes[k].name << std::endl;
+}
@@ -0,0 +1,54 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _IR_MEMORY_CENSUS_H_
+#define _IR_MEMORY_CENSUS_H_
+
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "ir.h"
+#include "visitor.h"
+
+// Counts the nodes of an IR tree, and the bytes they take, by the class of each node,
+// from the sizes that the IR generator records in IR::node_classes.  A node reached
+// from several places is counted once.  The bytes of a Vector include its elements,
+// and the room it has for more, which is also counted apart as slack; the source
+// positions that are the same as that of another node are counted as duplicates.
+class MemoryCensus : public Inspector {
+    std::set<std::tuple<unsigned, unsigned, unsigned, unsigned>> positions;
+
+ public:
+    struct ClassUse {
+        size_t  count = 0;
+        size_t  bytes = 0;
+    };
+    std::vector<ClassUse> classes;      // by node kind
+    size_t nodes = 0;
+    size_t bytes = 0;
+    size_t vectorSlack = 0;             // bytes of unused capacity in vectors
+    size_t duplicatePositions = 0;      // nodes with the srcInfo of an earlier node
+
+    MemoryCensus() : classes(IR::NODE_KINDS) { setName("MemoryCensus"); }
+    bool preorder(const IR::Node* node) override;
+
+    // The totals, the size of the cstring cache, and the classes that take the most,
+    // the largest first
+    void report(std::ostream &out, unsigned top = 20) const;
+};
+
+#endif /* _IR_MEMORY_CENSUS_H_ */
@@ -37,6 +37,7 @@ class NameMap : public Node {
     NameMap(const NameMap &) = default;
     NameMap(NameMap &&) = default;
     explicit NameMap(JSONLoader &);
+    explicit NameMap(BinaryLoader &);
     NameMap &operator=(const NameMap &) = default;
     NameMap &operator=(NameMap &&) = default;
     typedef typename map_t::value_type          value_type;
@@ -108,6 +109,11 @@ class NameMap : public Node {
     IRNODE_SUBCLASS(NameMap)
     bool operator==(const Node &a) const override { return a == *this; }
     bool operator==(const NameMap &a) const { return symbols == a.symbols; }
+    size_t hash_fields() const override {
+        size_t rv = 0;
+        for (auto &s : symbols)
+            rv = hash_combine(hash_combine(rv, hash_field(s.first)), hash_field(s.second));
+        return rv; }
     cstring node_type_name() const override {
         return "NameMap<" + T::static_type_name() + ">"; }
     static cstring static_type_name() {
@@ -116,14 +122,17 @@ class NameMap : public Node {
     void visit_children(Visitor &v) const override;
     void toJSON(JSONGenerator &json) const override;
     static NameMap<T, MAP, COMP, ALLOC> *fromJSON(JSONLoader &json);
+    void toBinary(BinaryGenerator &bin) const override;
+    static NameMap<T, MAP, COMP, ALLOC> *fromBinary(BinaryLoader &bin);
 
     Util::Enumerator<const T*>* valueEnumerator() const {
         return Util::Enumerator<const T*>::createEnumerator(Values(symbols).begin(),
                                                             Values(symbols).end()); }
     template <typename S>
     Util::Enumerator<const S*>* only() const {
-        std::function<bool(const T*)> filter = [](const T* d) { return d->template is<S>(); };
-        return valueEnumerator()->where(filter)->template as<const S*>(); }
+        return Util::enumerate(Values(symbols))
+                .where([](const T* d) { return d->template is<S>(); })
+                .template as<const S*>().toEnumerator(); }
 };
 
 }  // namespace IR
@@ -21,15 +21,23 @@ void IR::Node::traceVisit(const char* visitor) const
 
 void IR::Node::traceCreation() const { LOG5("Created node " << id); }
 
-int IR::Node::currentId = 0;
+IR::Node::id_counter_t IR::Node::currentId(0);
 
 void IR::Node::toJSON(JSONGenerator &json) const {
-    json << json.indent << "\"Node_ID\" : " << id << ", " << std::endl
+    json << json.indent << "\"Node_ID\" : " << json.node_number(*this) << ", " << std::endl
          << json.indent << "\"Node_Type\" : " << node_type_name();
 }
 
-IR::Node::Node(JSONLoader &json) : id(-1) {
-    json.load("Node_ID", id);
+// The Node_ID in the text only links the references to the node (see JSONGenerator), so
+// the node gets a new id, which no node already in memory has.
+IR::Node::Node(JSONLoader &) : id(currentId++) { traceCreation(); }
+
+void IR::Node::toBinary(BinaryGenerator &bin) const {
+    bin << id << srcInfo;
+}
+
+IR::Node::Node(BinaryLoader &bin) : id(-1) {
+    bin >> id >> srcInfo;
     if (id < 0)
         id = currentId++;
     else if (id >= currentId)
@@ -17,9 +17,15 @@ limitations under the License.
 #ifndef _IR_NODE_H_
 #define _IR_NODE_H_
 
+#ifdef MULTITHREAD
+#include <atomic>
+#endif  // MULTITHREAD
 #include <memory>
+#include <type_traits>
+#include <typeinfo>
 #include "std.h"
 #include "lib/cstring.h"
+#include "lib/gmputil.h"
 #include "lib/stringify.h"
 #include "lib/indent.h"
 #include "lib/source_file.h"
@@ -32,11 +38,24 @@ class Modifier;
 class Transform;
 class JSONGenerator;
 class JSONLoader;
+class BinaryGenerator;
+class BinaryLoader;
 
 namespace IR {
 
 class Node;
 
+// Checks and casts for Node::is/to/as.  A class that has a node kind only
+// needs its range of kinds checked; others, like interfaces, use dynamic_cast.
+template<class T, bool = NodeKind<T>::exact != 0> struct NodeCast {
+    static const T *to(const Node *n) { return dynamic_cast<const T *>(n); }
+    static bool is(const Node *n) { return to(n) != nullptr; }
+};
+template<class T> struct NodeCast<T, true> {
+    static bool is(const Node *n);
+    static const T *to(const Node *n) { return is(n) ? static_cast<const T *>(n) : nullptr; }
+};
+
 template<class T> class Vector;
 template<class T> class IndexedVector;
 // node interface
@@ -48,6 +67,7 @@ class INode : public Util::IHasSourceInfo, public IHasDbPrint {
     virtual void dbprint(std::ostream &out) const = 0;  // for debugging
     virtual cstring toString() const = 0;  // for user consumption
     virtual void toJSON(JSONGenerator &) const = 0;
+    virtual void toBinary(BinaryGenerator &) const = 0;
     virtual cstring node_type_name() const = 0;
     virtual void validate() const {}
     template<typename T> bool is() const;
@@ -68,7 +88,14 @@ class Node : public virtual INode {
     virtual void apply_visitor_revisit(Transform &v, const Node *n) const;
 
  protected:
-    static int currentId;
+#ifdef MULTITHREAD
+    // nodes may be created by several threads, so the order of their ids depends on
+    // how the threads ran; the output of the compiler must not (see JSONGenerator)
+    typedef std::atomic<int> id_counter_t;
+#else
+    typedef int id_counter_t;
+#endif  // MULTITHREAD
+    static id_counter_t currentId;
     void traceVisit(const char* visitor) const;
     virtual void visit_children(Visitor &) { }
     virtual void visit_children(Visitor &) const { }
@@ -96,12 +123,19 @@ class Node : public virtual INode {
     cstring node_type_name() const override { return "Node"; }
     static cstring static_type_name() { return "Node"; }
     virtual int num_children() { return 0; }
-    template<typename T> bool is() const { return to<T>() != nullptr; }
-    template<typename T> const T *to() const { return dynamic_cast<const T*>(this); }
-    template<typename T> const T &as() const { return dynamic_cast<const T&>(*this); }
+    // The IR::NodeKind tag of the class of this node.  It is not kept in the node,
+    // as the constructors of base classes may already check the type of the node.
+    virtual unsigned node_kind() const { return NodeKind<Node>::value; }
+    template<typename T> bool is() const { return NodeCast<T>::is(this); }
+    template<typename T> const T *to() const { return NodeCast<T>::to(this); }
+    template<typename T> const T &as() const {
+        if (auto *rv = to<T>()) return *rv;
+        throw std::bad_cast(); }
     explicit Node(JSONLoader &json);
     cstring toString() const override { return node_type_name(); }
     void toJSON(JSONGenerator &json) const override;
+    explicit Node(BinaryLoader &bin);
+    void toBinary(BinaryGenerator &bin) const override;
     virtual bool operator==(const Node &a) const { return typeid(*this) == typeid(a); }
 #define DEFINE_OPEQ_FUNC(CLASS, BASE) \
     virtual bool operator==(const CLASS &) const { return false; }
@@ -109,8 +143,47 @@ class Node : public virtual INode {
 #undef DEFINE_OPEQ_FUNC
 
     bool operator!=(const Node &n) const { return !operator==(n); }
+
+    // Hash of the whole tree rooted at this node, consistent with operator==:
+    // nodes that compare equal have the same hash.  It is computed when first
+    // needed and then kept; clones start without it, so nodes must not be
+    // modified once their hash has been used.
+    size_t structural_hash() const {
+        if (hash_cache == 0) {
+            hash_cache = hash_fields();
+            if (hash_cache == 0) hash_cache = 1; }
+        return hash_cache; }
+    // Combines the hashes of the fields compared by operator==; generated.
+    virtual size_t hash_fields() const { return typeid(*this).hash_code(); }
+
+ private:
+    mutable size_t hash_cache = 0;
 };
 
+// Helpers for hash_fields.  Trees are hashed structurally; fields of
+// types not listed here do not contribute to the hash.
+inline size_t hash_combine(size_t seed, size_t hash) {
+    return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2)); }
+template<class T> inline typename std::enable_if<std::is_base_of<Node, T>::value, size_t>::type
+hash_field(const T &node) { return node.structural_hash(); }
+template<class T> inline typename std::enable_if<
+    std::is_base_of<Node, typename std::remove_cv<T>::type>::value, size_t>::type
+hash_field(T *node) { return node ? node->structural_hash() : 0; }
+template<class T> inline
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, size_t>::type
+hash_field(T value) { return static_cast<size_t>(value); }
+inline size_t hash_field(cstring s) { return s.hash(); }
+inline size_t hash_field(const mpz_class &value) {
+    return static_cast<size_t>(mpz_get_ui(value.get_mpz_t())) ^ sgn(value); }
+template<class T> inline
+typename std::enable_if<!std::is_base_of<Node, T>::value && !std::is_integral<T>::value &&
+                        !std::is_enum<T>::value, size_t>::type
+hash_field(const T &) { return 0; }
+
+template<class T> inline bool NodeCast<T, true>::is(const Node *n) {
+    // one unsigned comparison for value <= kind < end
+    return n->node_kind() - NodeKind<T>::value < NodeKind<T>::end - NodeKind<T>::value; }
+
 // simple version of dbprint
 cstring dbp(const INode* node);
 
@@ -136,6 +209,7 @@ inline bool equal(const INode *a, const INode *b) {
 #define IRNODE_COMMON_SUBCLASS(T)                                           \
  public:                                                                    \
     using Node::operator==;                                                 \
+    unsigned node_kind() const override { return NodeKind<T>::value; }      \
     bool apply_visitor_preorder(Modifier &v) override;                      \
     void apply_visitor_postorder(Modifier &v) override;                     \
     void apply_visitor_revisit(Modifier &v, const Node *n) const override;  \
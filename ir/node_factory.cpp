@@ -0,0 +1,69 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "node_factory.h"
+
+namespace IR {
+
+const Node *NodeFactory::intern(const Node *node) {
+    CHECK_NULL(node);
+    auto hash = hash_combine(node->structural_hash(), node->srcInfo.getStart().getLineNumber());
+    auto range = nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        // operator== does not look at the source info
+        if (*it->second == *node && it->second->srcInfo == node->srcInfo) {
+            ++hits;
+            return it->second; } }
+    nodes.emplace(hash, node);
+    return node;
+}
+
+const Constant *NodeFactory::constant(Util::SourceInfo si, const Type *type, mpz_class value,
+                                      unsigned base) {
+    auto result = new Constant(si, type, value, base);
+    if (type->is<Type_InfInt>())
+        return result;
+    return get(result);
+}
+
+const Type_Bits *NodeFactory::bits(Util::SourceInfo si, int width, bool isSigned) {
+    if (!si.isValid())
+        return Type_Bits::get(width, isSigned);
+    return get(new Type_Bits(si, width, isSigned));
+}
+
+const Path *NodeFactory::path(ID name, bool absolute) {
+    auto result = new Path(name, absolute);
+    if (!name.srcInfo.isValid())
+        return result;
+    return get(result);
+}
+
+const PathExpression *NodeFactory::pathExpression(ID name) {
+    auto result = new PathExpression(name.srcInfo, path(name));
+    if (!name.srcInfo.isValid())
+        return result;
+    return get(result);
+}
+
+const Member *NodeFactory::member(Util::SourceInfo si, const Expression *expr, ID name) {
+    auto result = new Member(si, expr, name);
+    if (!si.isValid())
+        return result;
+    return get(result);
+}
+
+}  // namespace IR
@@ -0,0 +1,69 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _IR_NODE_FACTORY_H_
+#define _IR_NODE_FACTORY_H_
+
+#include <unordered_map>
+#include "ir/ir.h"
+
+namespace IR {
+
+// Opt-in factory that hash-conses immutable leaf nodes: asking twice for a
+// node with the same fields and the same source info returns the same object,
+// so programs that create many identical constants, paths and member
+// references carry only one copy of each.
+//
+// Shared nodes are fine for visitors: with visitDagOnce (the default) an
+// Inspector visits a shared node once, and a Transform reuses the result of the
+// first visit for every other reference to it.  That is only correct when
+// the node means the same thing wherever it appears, so the factory is
+// restricted to leaves that do not depend on their context:
+// - Constants are only shared when they have a real type; a Type_InfInt is a
+//   type variable and must stay private to one constant.
+// - Paths, PathExpressions and Members are only shared when they have valid
+//   source info, so that they stand for a single reference in the source.
+// Nodes created by the factory must never be modified in place.
+class NodeFactory {
+    std::unordered_multimap<size_t, const Node *>       nodes;
+    size_t                                              hits = 0;
+
+    const Node *intern(const Node *node);
+
+ public:
+    // Returns a node equal to 'node' (including its source info), which
+    // is 'node' itself the first time it is seen.
+    template<class T> const T *get(const T *node) {
+        return static_cast<const T *>(intern(node)); }
+
+    const Constant *constant(Util::SourceInfo si, const Type *type, mpz_class value,
+                             unsigned base = 10);
+    const Constant *constant(const Type *type, mpz_class value, unsigned base = 10) {
+        return constant(Util::SourceInfo(), type, value, base); }
+    const Type_Bits *bits(Util::SourceInfo si, int width, bool isSigned = false);
+    const Path *path(ID name, bool absolute = false);
+    const PathExpression *pathExpression(ID name);
+    const Member *member(Util::SourceInfo si, const Expression *expr, ID name);
+
+    // number of distinct nodes interned
+    size_t size() const { return nodes.size(); }
+    // number of requests answered with an existing node
+    size_t shared() const { return hits; }
+};
+
+}  // namespace IR
+
+#endif /* _IR_NODE_FACTORY_H_ */
@@ -0,0 +1,125 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _IR_NODE_ID_MAP_H_
+#define _IR_NODE_ID_MAP_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "ir/ir.h"
+
+// Map from IR nodes to values, indexed by Node::id rather than by pointer.
+// Ids are dense, so the entries live in pages of a vector that are allocated as
+// they are first used, and lookups are array indexing.  clear() just starts a new
+// epoch, so it is constant time and keeps the pages.  Ids are not quite unique:
+// nodes loaded from JSON keep the id they were saved with, so a node whose id is
+// already used by a different node in the map goes to a (slower) overflow map.
+// Iteration visits nodes in id order, which is also creation order.
+// The entries hold the nodes by their address with the bits inverted, which the garbage
+// collector does not take for a pointer: the entries of earlier epochs stay in the
+// pages, and must not keep the IR of older versions of the program alive.
+template <class T>
+class NodeIdMap {
+    static constexpr int PAGE_BITS = 10;
+    static constexpr int PAGE_SIZE = 1 << PAGE_BITS;
+    struct entry_t {
+        uintptr_t       node;   // hidden, see hide()
+        T               value;
+        unsigned        epoch;  // entry is empty unless this matches 'epoch'
+    };
+    static uintptr_t hide(const IR::Node *n) { return ~reinterpret_cast<uintptr_t>(n); }
+    static const IR::Node *reveal(uintptr_t h) { return reinterpret_cast<const IR::Node *>(~h); }
+    std::vector<std::vector<entry_t>>   pages;
+    std::map<const IR::Node *, T>       overflow;
+    size_t                              entries = 0;
+    unsigned                            epoch = 1;
+
+    entry_t *entry(const IR::Node *n, bool create) {
+        if (n->id < 0) return nullptr;
+        size_t page = n->id >> PAGE_BITS;
+        if (page >= pages.size()) {
+            if (!create) return nullptr;
+            pages.resize(page + 1); }
+        if (pages[page].empty()) {
+            if (!create) return nullptr;
+            pages[page].resize(PAGE_SIZE, entry_t{0, T(), 0}); }
+        return &pages[page][n->id & (PAGE_SIZE - 1)]; }
+
+ public:
+    size_t size() const { return entries; }
+    bool empty() const { return entries == 0; }
+    void clear() {
+        entries = 0;
+        overflow.clear();
+        if (++epoch == 0) {
+            for (auto &page : pages)
+                for (auto &e : page) e.epoch = 0;
+            epoch = 1; } }
+
+    T *find(const IR::Node *n) {
+        auto *e = entry(n, false);
+        if (e && e->epoch == epoch && e->node == hide(n))
+            return &e->value;
+        if (overflow.empty()) return nullptr;
+        auto it = overflow.find(n);
+        return it == overflow.end() ? nullptr : &it->second; }
+    const T *find(const IR::Node *n) const { return const_cast<NodeIdMap *>(this)->find(n); }
+    size_t count(const IR::Node *n) const { return find(n) != nullptr; }
+    // value for 'n', or a default-constructed T if it is not in the map
+    T get(const IR::Node *n) const {
+        auto *v = find(n);
+        return v ? *v : T(); }
+
+    // Like std::map::emplace, does not replace an existing value.
+    // Returns the value in the map and whether it was inserted.
+    std::pair<T *, bool> emplace(const IR::Node *n, const T &value) {
+        auto *e = entry(n, true);
+        if (e && e->epoch != epoch) {
+            *e = entry_t{hide(n), value, epoch};
+            ++entries;
+            return std::make_pair(&e->value, true); }
+        if (e && e->node == hide(n))
+            return std::make_pair(&e->value, false);
+        auto rv = overflow.emplace(n, value);
+        if (rv.second) ++entries;
+        return std::make_pair(&rv.first->second, rv.second); }
+
+    // Calls fn(node, value) for every entry.
+    template <class FN> void for_each(FN fn) const {
+        for (auto &page : pages)
+            for (auto &e : page)
+                if (e.epoch == epoch) fn(reveal(e.node), e.value);
+        for (auto &e : overflow)
+            fn(e.first, e.second); }
+};
+
+// Set of IR nodes indexed by Node::id; see NodeIdMap.
+class NodeIdSet {
+    NodeIdMap<bool>     map;
+
+ public:
+    size_t size() const { return map.size(); }
+    bool empty() const { return map.empty(); }
+    void clear() { map.clear(); }
+    size_t count(const IR::Node *n) const { return map.find(n) != nullptr; }
+    // returns true if 'n' was not already in the set
+    bool insert(const IR::Node *n) { return map.emplace(n, true).second; }
+    template <class FN> void for_each(FN fn) const {
+        map.for_each([&fn](const IR::Node *n, bool) { fn(n); }); }
+};
+
+#endif /* _IR_NODE_ID_MAP_H_ */
@@ -72,6 +72,11 @@ class NodeMap : public Node {
     IRNODE_SUBCLASS(NodeMap)
     bool operator==(const Node &a) const override { return a == *this; }
     bool operator==(const NodeMap &a) const { return symbols == a.symbols; }
+    size_t hash_fields() const override {
+        size_t rv = 0;
+        for (auto &s : symbols)
+            rv = hash_combine(hash_combine(rv, hash_field(s.first)), hash_field(s.second));
+        return rv; }
     cstring node_type_name() const override {
         return "NodeMap<" + KEY::static_type_name() + "," + VALUE::static_type_name() + ">"; }
     static cstring static_type_name() {
@@ -14,26 +14,130 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <sstream>
 #include "ir.h"
 #include "lib/gc.h"
 #include "lib/n4.h"
 
+namespace {
+// Prints the shape of a tree and the fields of its nodes, but not their ids, so
+// that trees with the same contents print the same even if they were rebuilt.
+class StructuralText : public Inspector {
+    std::ostream &out;
+    bool preorder(const IR::Node *n) override {
+        auto ctxt = getContext();
+        if (ctxt) {
+            out << ctxt->depth;
+            if (ctxt->child_name)
+                out << ' ' << ctxt->child_name; }
+        out << ' ' << n->node_type_name();
+        n->dump_fields(out);
+        out << std::endl;
+        return true; }
+    bool preorder(const IR::Expression *e) override {
+        if (!preorder(static_cast<const IR::Node *>(e))) return false;
+        visit(e->type, "type");
+        return true; }
+
+ public:
+    explicit StructuralText(std::ostream &out) : out(out) { visitDagOnce = false; }
+};
+
+bool sameStructure(const IR::Node *a, const IR::Node *b) {
+    if (a == b) return true;
+    if (!a || !b || a->structural_hash() != b->structural_hash()) return false;
+    std::stringstream ta, tb;
+    a->apply(StructuralText(ta));
+    b->apply(StructuralText(tb));
+    return ta.str() == tb.str();
+}
+
+// Number of top-level declarations of 'after' that are not in 'before'
+unsigned changedDeclarations(const IR::Node *before, const IR::Node *after) {
+    auto *p = before ? before->to<IR::P4Program>() : nullptr;
+    auto *q = after ? after->to<IR::P4Program>() : nullptr;
+    if (!p || !q) return 0;
+    std::set<const IR::Node *> old(p->declarations->begin(), p->declarations->end());
+    unsigned rv = 0;
+    for (auto *d : *q->declarations)
+        if (!old.count(d)) ++rv;
+    return rv;
+}
+
+// For each fixpoint key, the last program known to be left unchanged by its pass.
+// They are those of the outermost PassManager running on this thread, which the ones
+// it runs share, and are forgotten when it returns: nothing is kept from one
+// compilation to the next, and a compilation on another thread has its own.
+typedef std::map<cstring, const IR::Node *> Fixpoints;
+thread_local Fixpoints *fixpoints = nullptr;
+
+// Makes the fixpoints of the outermost PassManager while it runs; they are kept here,
+// on its stack, as the collector does not look in thread-local storage
+class FixpointScope {
+    Fixpoints own;
+    bool outermost = fixpoints == nullptr;
+
+ public:
+    FixpointScope() { if (outermost) fixpoints = &own; }
+    ~FixpointScope() { if (outermost) fixpoints = nullptr; }
+};
+
+// set by the options of the compilation that runs on this thread
+thread_local bool bounded_memory = false;
+}  // namespace
+
+void PassManager::setBoundedMemory(bool bounded) {
+    bounded_memory = bounded;
+    if (bounded && fixpoints)
+        fixpoints->clear();
+}
+
+bool PassManager::boundedMemory() { return bounded_memory; }
+
 const IR::Node *PassManager::apply_visitor(const IR::Node *program, const char *) {
     vector<std::pair<vector<Visitor *>::iterator, const IR::Node *>> backup;
+    // The input and the output of the last run of each keyed pass after the first
+    // backtracking one, for the passes replayed after a backtrack: one given the same
+    // program again returns the same output.
+    std::map<Visitor *, std::pair<const IR::Node *, const IR::Node *>> memo;
+    FixpointScope scope;
 
     early_exit_flag = false;
     for (auto it = passes.begin(); it != passes.end();) {
         Visitor* v = *it;
+        bool backtracks = false;
         if (auto b = dynamic_cast<Backtrack *>(v)) {
             if (!b->never_backtracks()) {
+                backtracks = true;
                 backup.emplace_back(it, program); } }
         try {
             try {
                 size_t maxmem;
                 LOG1(name() << " invoking " << v->name());
-                program = program->apply(**it);
+                cstring key = v->fixpointKey();
+                auto fixpoint = key.isNull() ? fixpoints->end() : fixpoints->find(key);
+                // a pass that can backtrack may run differently once it has
+                auto memoized = key.isNull() || backtracks ? memo.end() : memo.find(v);
+                if (fixpoint != fixpoints->end() && fixpoint->second == program) {
+                    LOG1(name() << " skipping " << v->name() << ": program unchanged");
+                    Visitor::profile_t::count("skipped passes", 1);
+                } else if (memoized != memo.end() && memoized->second.first == program) {
+                    LOG1(name() << " replaying " << v->name() << ": same input as before");
+                    program = memoized->second.second;
+                    Visitor::profile_t::count("replayed passes", 1);
+                } else {
+                    auto input = program;
+                    program = program->apply(**it);
+                    Visitor::profile_t::set_position(seqNo, iteration, program != input);
+                    if (!key.isNull() && program != nullptr) {
+                        if (!backup.empty() && !backtracks)
+                            memo[v] = std::make_pair(input, program);
+                        if ((program == input || v->idempotent()) && !bounded_memory)
+                            (*fixpoints)[key] = program; } }
+                // without collecting, which would change what is measured
                 LOG3("heap after " << v->name() << ": in use " <<
-                     n4(gc_mem_inuse(&maxmem)) << "B, max " << n4(maxmem) << "B");
+                     n4(gc_heap_inuse(&maxmem)) << "B (with garbage), max " <<
+                     n4(maxmem) << "B");
                 int errors = ErrorReporter::instance.getErrorCount();
                 if (stop_on_error && errors > 0)
                     program = nullptr;
@@ -93,8 +197,15 @@ const IR::Node *PassRepeated::apply_visitor(const IR::Node *program, const char
     unsigned iterations = 0;
     while (!done) {
         LOG5("PassRepeated state is:\n" << dumpToString(program));
+        iteration = iterations;
         auto newprogram = PassManager::apply_visitor(program, name);
-        if (program == newprogram || newprogram == nullptr)
+        unsigned changed = changedDeclarations(program, newprogram);
+        Visitor::profile_t::count("iterations", 1);
+        Visitor::profile_t::count("changed declarations", changed);
+        LOG2(this->name() << " iteration " << iterations << ": " << changed <<
+             " declarations changed");
+        if (newprogram == nullptr || sameStructure(program, newprogram))
+            // a round that only rebuilt the same tree changes nothing in the next one
             done = true;
         int errors = ErrorReporter::instance.getErrorCount();
         if (stop_on_error && errors > 0)
@@ -108,8 +219,43 @@ const IR::Node *PassRepeated::apply_visitor(const IR::Node *program, const char
 }
 
 const IR::Node *PassRepeatUntil::apply_visitor(const IR::Node *program, const char *name) {
+    iteration = 0;
     do {
         program = PassManager::apply_visitor(program, name);
+        iteration++;
     } while (!done());
     return program;
 }
+
+PassPerDeclaration::PassPerDeclaration(const std::initializer_list<Visitor *> &init,
+                                       std::function<bool(const IR::Node *)> select)
+        : PassManager(init), select(select) {
+    if (!this->select) {
+        this->select = [](const IR::Node *d) {
+            return d->is<IR::P4Parser>() || d->is<IR::P4Control>(); }; }
+    setName("PassPerDeclaration");
+}
+
+const IR::Node *PassPerDeclaration::apply_visitor(const IR::Node *root, const char *name) {
+    auto *program = root->to<IR::P4Program>();
+    if (!program)
+        return PassManager::apply_visitor(root, name);
+    IR::IndexedVector<IR::Node> *declarations = nullptr;  // once one changes
+    for (size_t i = 0; i < program->declarations->size(); ++i) {
+        auto *decl = program->declarations->at(i);
+        if (!select(decl)) continue;
+        LOG2(this->name() << " on " << decl);
+        auto *result = PassManager::apply_visitor(decl, name);
+        if (result == nullptr) return nullptr;
+        if (result != decl) {
+            if (!declarations)
+                declarations = program->declarations->clone();
+            declarations->replace(declarations->begin() + i, result); }
+        if (bounded_memory)
+            gc_collect(); }
+    if (!declarations)
+        return program;
+    auto *rv = program->clone();
+    rv->declarations = declarations;
+    return rv;
+}
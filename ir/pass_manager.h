@@ -32,6 +32,7 @@ class PassManager : virtual public Visitor, virtual public Backtrack {
     // if true stops compilation after first pass that signals an error
     bool                stop_on_error = true;
     unsigned            seqNo = 0;
+    unsigned            iteration = 0;  // set by repeating subclasses, for profiling
     void addPasses(const std::initializer_list<Visitor *> &init) {
         never_backtracks_cache = -1;
         for (auto p : init) if (p) passes.emplace_back(p); }
@@ -49,9 +50,33 @@ class PassManager : virtual public Visitor, virtual public Backtrack {
     void addDebugHooks(std::vector<DebugHook> hooks)
     { debugHooks.insert(debugHooks.end(), hooks.begin(), hooks.end()); }
     void early_exit() { early_exit_flag = true; }
+
+    // Keep as little of the program alive as possible: the programs that passes left
+    // unchanged are not remembered to skip them later, and PassPerDeclaration collects
+    // after each declaration.  This holds for the compilation on this thread, until it
+    // is set again, as a batch does before each request.
+    static void setBoundedMemory(bool bounded);
+    static bool boundedMemory();
+};
+
+// Runs its passes on each top-level declaration that 'select' accepts (by default
+// the parsers and the controls), one declaration at a time, rather than each pass
+// on the whole program, and puts the results back in the program.  The passes must
+// only need the declaration they are given, and change nothing outside it.  With
+// bounded memory, what the passes built for a declaration is collected before the
+// next one, so that the peak follows the largest declaration.
+class PassPerDeclaration : virtual public PassManager {
+    std::function<bool(const IR::Node *)> select;
+ public:
+    PassPerDeclaration(const std::initializer_list<Visitor *> &init,
+                       std::function<bool(const IR::Node *)> select = nullptr);
+    const IR::Node *apply_visitor(const IR::Node *, const char * = 0) override;
 };
 
-// Repeat a pass until convergence (or up to a fixed number of repeats)
+// Repeat a pass until convergence (or up to a fixed number of repeats).  A round
+// converges if it returns the same tree, or one with the same structure and fields;
+// the profile of the pass counts its iterations and the top-level declarations
+// that each changed.
 class PassRepeated : virtual public PassManager {
     unsigned            repeats;  // 0 = until convergence
  public:
@@ -14,6 +14,10 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#ifdef MULTITHREAD
+#include <atomic>
+#include <mutex>
+#endif  // MULTITHREAD
 #include "ir.h"
 
 namespace IR {
@@ -36,39 +40,59 @@ const cstring IR::Annotation::nameAnnotation = "name";
 std::map<int, const IR::Type_Bits*> *Type_Bits::signedTypes = nullptr;
 std::map<int, const IR::Type_Bits*> *Type_Bits::unsignedTypes = nullptr;
 
-int Type_Declaration::nextId = 0;
-int Type_InfInt::nextId = 0;
+Node::id_counter_t Type_Declaration::nextId(0);
+Node::id_counter_t Type_InfInt::nextId(0);
 
 Annotations* Annotations::empty = new Annotations(Vector<Annotation>());
 
+// Type_Bits::get is called for every width that the compiler touches, so the
+// types of widths up to maxDirectWidth are found by indexing a table, without
+// taking the lock once they exist.  The maps hold all the types, and are only
+// used, under the lock, for wider types and the first time a width is asked for.
+static constexpr int maxDirectWidth = 2048;
+#ifdef MULTITHREAD
+typedef std::atomic<const Type_Bits *> direct_bits_t;
+#else
+typedef const Type_Bits *direct_bits_t;
+#endif  // MULTITHREAD
+static direct_bits_t directBits[2][maxDirectWidth + 1];  // [isSigned][width]
+
 const Type_Bits* Type_Bits::get(int width, bool isSigned) {
+    bool direct = width >= 0 && width <= maxDirectWidth;
+    if (direct) {
+        const Type_Bits *known = directBits[isSigned][width];
+        if (known)
+            return known;
+    }
+#ifdef MULTITHREAD
+    static std::mutex lock;
+    std::lock_guard<std::mutex> acquire(lock);
+#endif  // MULTITHREAD
     std::map<int, const IR::Type_Bits*> *&map = isSigned ? signedTypes : unsignedTypes;
     if (map == nullptr)
         map = new std::map<int, const IR::Type_Bits*>();
     auto &result = (*map)[width];
     if (!result)
         result = new Type_Bits(Util::SourceInfo(), width, isSigned);
+    if (direct)
+        directBits[isSigned][width] = result;
     return result;
 }
 
 const Type::Unknown *Type::Unknown::get() {
-    static const Type::Unknown *singleton = nullptr;
-    if (!singleton)
-        singleton = (new Type::Unknown(Util::SourceInfo()));
+    // function-local statics are initialized thread-safely, so type checking
+    // may run on several threads
+    static const Type::Unknown *singleton = new Type::Unknown(Util::SourceInfo());
     return singleton;
 }
 
 const Type::Boolean *Type::Boolean::get() {
-    static const Type::Boolean *singleton = nullptr;
-    if (!singleton)
-        singleton = (new Type::Boolean(Util::SourceInfo()));
+    static const Type::Boolean *singleton = new Type::Boolean(Util::SourceInfo());
     return singleton;
 }
 
 const Type_String *Type_String::get() {
-    static const Type_String *singleton = nullptr;
-    if (!singleton)
-        singleton = (new Type_String(Util::SourceInfo()));
+    static const Type_String *singleton = new Type_String(Util::SourceInfo());
     return singleton;
 }
 
@@ -89,30 +113,22 @@ const Type::Varbits *Type::Varbits::get() {
 }
 
 const Type_Dontcare *Type_Dontcare::get() {
-    static const Type_Dontcare *singleton;
-    if (!singleton)
-        singleton = (new Type_Dontcare(Util::SourceInfo()));
+    static const Type_Dontcare *singleton = new Type_Dontcare(Util::SourceInfo());
     return singleton;
 }
 
 const Type_State *Type_State::get() {
-    static const Type_State *singleton;
-    if (!singleton)
-        singleton = (new Type_State(Util::SourceInfo()));
+    static const Type_State *singleton = new Type_State(Util::SourceInfo());
     return singleton;
 }
 
 const Type_Void *Type_Void::get() {
-    static const Type_Void *singleton;
-    if (!singleton)
-        singleton = (new Type_Void(Util::SourceInfo()));
+    static const Type_Void *singleton = new Type_Void(Util::SourceInfo());
     return singleton;
 }
 
 const Type_MatchKind *Type_MatchKind::get() {
-    static const Type_MatchKind *singleton;
-    if (!singleton)
-        singleton = (new Type_MatchKind(Util::SourceInfo()));
+    static const Type_MatchKind *singleton = new Type_MatchKind(Util::SourceInfo());
     return singleton;
 }
 
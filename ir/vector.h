@@ -20,6 +20,7 @@ limitations under the License.
 #include "dbprint.h"
 #include "lib/enumerator.h"
 #include "lib/null.h"
+#include "lib/small_vector.h"
 
 namespace IR {
 
@@ -34,6 +35,8 @@ class VectorBase : public Node {
     virtual iterator VectorBase_end() const = 0;
     virtual size_t size() const = 0;
     virtual bool empty() const = 0;
+    // the elements there is room for without growing
+    virtual size_t capacity() const = 0;
     iterator begin() const { return VectorBase_begin(); }
     iterator end() const { return VectorBase_end(); }
     VectorBase() = default;
@@ -43,13 +46,16 @@ class VectorBase : public Node {
     VectorBase &operator=(VectorBase &&) = default;
  protected:
     explicit VectorBase(JSONLoader &json) : Node(json) {}
+    explicit VectorBase(BinaryLoader &bin) : Node(bin) {}
 };
 
 // This class should only be used in the IR.
 // User-level code should use regular std::vector
+// Most vectors in the IR, such as argument lists and blocks, have no more than two
+// elements, which are kept in the node itself.
 template<class T>
 class Vector : public VectorBase {
-    vector<const T *>   vec;
+    small_vector<const T *, 2>  vec;
 
  public:
     typedef const T* value_type;
@@ -57,6 +63,7 @@ class Vector : public VectorBase {
     Vector(const Vector &) = default;
     Vector(Vector &&) = default;
     explicit Vector(JSONLoader &json);
+    explicit Vector(BinaryLoader &bin);
     Vector &operator=(const Vector &) = default;
     Vector &operator=(Vector &&) = default;
     explicit Vector(const T *a) {
@@ -65,25 +72,33 @@ class Vector : public VectorBase {
         vec.insert(vec.end(), a.begin(), a.end()); }
     Vector(const std::initializer_list<const T *> &a) : vec(a) {}
     static Vector<T>* fromJSON(JSONLoader &json);
-    typedef typename vector<const T *>::iterator        iterator;
-    typedef typename vector<const T *>::const_iterator  const_iterator;
+    static Vector<T>* fromBinary(BinaryLoader &bin);
+    // An empty vector shared by all the nodes that have none of T, such as the type
+    // arguments of most calls; like any node in a tree, it must not be changed
+    static const Vector<T>* emptyInstance() {
+        static const Vector<T>* none = new Vector<T>();
+        return none; }
+    typedef typename small_vector<const T *, 2>::iterator          iterator;
+    typedef typename small_vector<const T *, 2>::const_iterator    const_iterator;
     iterator begin() { return vec.begin(); }
     const_iterator begin() const { return vec.begin(); }
     VectorBase::iterator VectorBase_begin() const override {
         /* DANGER -- works as long as IR::Node is the first ultimate base class of T */
-        return reinterpret_cast<VectorBase::iterator>(&vec[0]); }
+        return reinterpret_cast<VectorBase::iterator>(vec.data()); }
     iterator end() { return vec.end(); }
     const_iterator end() const { return vec.end(); }
     VectorBase::iterator VectorBase_end() const override {
         /* DANGER -- works as long as IR::Node is the first ultimate base class of T */
-        return reinterpret_cast<VectorBase::iterator>(&vec[0] + vec.size()); }
+        return reinterpret_cast<VectorBase::iterator>(vec.data() + vec.size()); }
     std::reverse_iterator<iterator> rbegin() { return vec.rbegin(); }
     std::reverse_iterator<const_iterator> rbegin() const { return vec.rbegin(); }
     std::reverse_iterator<iterator> rend() { return vec.rend(); }
     std::reverse_iterator<const_iterator> rend() const { return vec.rend(); }
     size_t size() const override { return vec.size(); }
     void resize(size_t sz) { vec.resize(sz); }
+    void reserve(size_t sz) { vec.reserve(sz); }
     bool empty() const override { return vec.empty(); }
+    size_t capacity() const override { return vec.capacity(); }
     const T* const & front() const { return vec.front(); }
     const T*& front() { return vec.front(); }
     void clear() { vec.clear(); }
@@ -131,6 +146,11 @@ class Vector : public VectorBase {
     // If you get an error about this method not being overridden
     // you are probably using a Vector where you should be using an std::vector.
     bool operator==(const Vector &a) const override { return vec == a.vec; }
+    size_t hash_fields() const override {
+        // no type: Vectors with the same elements compare equal
+        size_t rv = 0;
+        for (auto e : vec) rv = hash_combine(rv, hash_field(e));
+        return rv; }
     cstring node_type_name() const override {
         return "Vector<" + T::static_type_name() + ">"; }
     static cstring static_type_name() {
@@ -140,12 +160,13 @@ class Vector : public VectorBase {
     virtual void parallel_visit_children(Visitor &v);
     virtual void parallel_visit_children(Visitor &v) const;
     void toJSON(JSONGenerator &json) const override;
+    void toBinary(BinaryGenerator &bin) const override;
     Util::Enumerator<const T*>* getEnumerator() const {
-        return Util::Enumerator<const T*>::createEnumerator(vec); }
+        return Util::Enumerator<const T*>::createEnumerator(vec.begin(), vec.end()); }
     template <typename S>
     Util::Enumerator<const S*>* only() const {
-        std::function<bool(const T*)> filter = [](const T* d) { return d->template is<S>(); };
-        return getEnumerator()->where(filter)->template as<const S*>(); }
+        return Util::enumerate(vec).where([](const T* d) { return d->template is<S>(); })
+                .template as<const S*>().toEnumerator(); }
 };
 
 }  // namespace IR
@@ -15,39 +15,84 @@ limitations under the License.
 */
 
 #include <time.h>
+#include <exception>
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
+#ifdef MULTITHREAD
+#include <atomic>
+#include <thread>
+#endif
+#include "config.h"
 #include "ir.h"
+#include "lib/crash.h"
 #include "lib/log.h"
+#include "lib/gc.h"
+#include "lib/json.h"
+#include "lib/parallel.h"
+
+// Tables used to track visited nodes are taken from a free list when an apply
+// starts and returned when it ends, so later passes reuse their storage.
+template <class T> class table_pool {
+    vector<T *>         available;
+#ifdef MULTITHREAD
+    std::mutex          lock;
+#endif
+ public:
+    T *get() {
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        if (available.empty())
+            return new T;
+        auto *rv = available.back();
+        available.pop_back();
+        return rv; }
+    void put(T *table) {
+        table->clear();
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        available.push_back(table); }
+};
+template <class T> static table_pool<T> &pool() {
+    static table_pool<T> pool;
+    return pool;
+}
 
 class Visitor::ChangeTracker {
     // FIXME -- this code is really incomprehensible due to all the pairs/first/second stuff
     // unfortunatelly maps use pairs all over the place, which is where they come from.
-    typedef unordered_map<const IR::Node *, std::pair<bool, const IR::Node *>>  visited_t;
+    typedef flat_ptr_map<const IR::Node *, std::pair<bool, const IR::Node *>>  visited_t;
     visited_t           visited;
 
  public:
     struct change_t {
         bool                                    valid;
-        std::pair<visited_t::iterator, bool>    state;  // result of visited.emplace
-        change_t() : valid(false) {}
+        std::pair<std::pair<bool, const IR::Node *> *, bool>  state;  // result of emplace
+        const IR::Node                          *node;
+        change_t() : valid(false), node(nullptr) {}
         change_t(visited_t *visited, const IR::Node *n) : valid(true),
-            state(visited->emplace(n, std::make_pair(false, n))) {
-                if (!state.second && !state.first->second.first)
+            state(visited->emplace(n, std::make_pair(false, n))), node(n) {
+                if (!state.second && !state.first->first)
                     BUG("IR loop detected "); }
         explicit operator bool() { return valid; }
         bool done() { return !state.second; }
-        const IR::Node *orig() { return state.first->first; }
-        const IR::Node *result() { return state.first->second.second; }
+        const IR::Node *orig() { return node; }
+        const IR::Node *result() { return state.first->second; }
     };
-    bool done(const IR::Node *n) const { return visited.count(n) && visited.at(n).first; }
-    const IR::Node *result(IR::Node *n) const { return visited.at(n).second; }
+    bool done(const IR::Node *n) const {
+        auto *v = visited.find(n);
+        return v && v->first; }
+    const IR::Node *result(IR::Node *n) const { return visited.find(n)->second; }
     change_t track(const IR::Node *n) { return change_t(&visited, n); }
-    void start(change_t &change) { change.state.first->second.first = false; }
+    void start(change_t &change) { change.state.first->first = false; }
     bool finish(change_t &change, const IR::Node *orig, const IR::Node *final) {
-        if (!change.valid || (change.state.first = visited.find(orig)) == visited.end())
+        if (!change.valid || (change.state.first = visited.find(orig)) == nullptr)
             BUG("visitor state tracker corrupted");
-        change.state.first->second.first = true;
-        if (!final || *final != *orig) {
-            change.state.first->second.second = final;
+        change.state.first->first = true;
+        if (!final || final->structural_hash() != orig->structural_hash() || *final != *orig) {
+            change.state.first->second = final;
             visited.emplace(final, std::make_pair(true, final));
             return true;
         } else {
@@ -56,42 +101,199 @@ class Visitor::ChangeTracker {
             //     --IR::Node::currentId;
             return false; } }
     const IR::Node *result(const IR::Node *n) const {
-        auto it = visited.find(n);
-        if (it == visited.end())
+        auto *v = visited.find(n);
+        if (!v)
             return n;
-        if (!it->second.first) BUG("IR loop detected");
-        return it->second.second; }
+        if (!v->first) BUG("IR loop detected");
+        return v->second; }
+    void clear() { visited.clear(); }
+
+#if HAVE_PASS_REGIONS
+    // Clones made by the visitor that ended up identical to their originals and were
+    // dropped.  When the visitor promises not to hold on to them, nothing else refers
+    // to them, so the whole region is freed when the traversal ends rather than being
+    // left for the garbage collector.  Surviving clones are simply kept; never moved.
+ private:
+    vector<IR::Node *>  discarded;
+
+ public:
+    void discard(IR::Node *n) { discarded.push_back(n); }
+    void release() {
+        LOG3("releasing " << discarded.size() << " discarded IR clones");
+        for (auto *n : discarded)
+            delete n;
+        discarded.clear(); }
+#else
+    void discard(IR::Node *) {}
+    void release() {}
+#endif  /* HAVE_PASS_REGIONS */
+
     void revisit_visited() {
-        for (auto it = visited.begin(); it != visited.end();) {
-            if (it->second.first)
-                it = visited.erase(it);
-            else
-                ++it; } }
+        visited.erase_if([](const IR::Node *, const std::pair<bool, const IR::Node *> &v) {
+            return v.first; }); }
+};
+
+// The node kind of the base class of each IR class
+static struct kind_parents {
+    unsigned parent[IR::NODE_KINDS] = {};
+    kind_parents() {
+#define SET_PARENT(CLASS, BASE) \
+        parent[IR::NodeKind<IR::CLASS>::value] = IR::NodeKind<IR::BASE>::value;
+        IRNODE_ALL_SUBCLASSES(SET_PARENT)
+#undef SET_PARENT
+    }
+} kind_parents;
+
+// For one visitor class, which of its preorder, postorder and revisit functions
+// are defaults that just call the function for the base IR class.  The defaults
+// mark themselves here when they are called, and each node kind is then
+// dispatched to the nearest function that has not been seen to be a default.
+class Visitor::DispatchTable {
+#ifdef MULTITHREAD
+    // visitors of one class may run on several threads; entries only ever move
+    // toward their final values, so a stale read just takes a longer path
+    template<class T> using entry_t = std::atomic<T>;
+#else
+    template<class T> using entry_t = T;
+#endif
+    entry_t<bool>       is_default[3][IR::NODE_KINDS] = {};
+    entry_t<unsigned>   handler[3][IR::NODE_KINDS];
+    // whether the function for Node itself is the default, which does nothing
+    entry_t<bool>       node_default[3] = {};
+
+ public:
+    enum hook_t { PREORDER, POSTORDER, REVISIT };
+    DispatchTable() {
+        for (auto &h : handler)
+            for (unsigned kind = 0; kind < IR::NODE_KINDS; ++kind)
+                h[kind] = kind; }
+    void set_default(hook_t hook, unsigned kind) {
+        if (!is_default[hook][kind]) is_default[hook][kind] = true; }
+    void set_node_default(hook_t hook) {
+        if (!node_default[hook]) node_default[hook] = true; }
+    // whether the function called for 'kind' is known to be the default for Node
+    bool calls_node_default(hook_t hook, unsigned kind) {
+        return node_default[hook] && lookup(hook, kind) == IR::NodeKind<IR::Node>::value; }
+    unsigned lookup(hook_t hook, unsigned kind) {
+        unsigned rv = handler[hook][kind];
+        if (is_default[hook][rv]) {
+            // the function for Node is never a default, so this stops there
+            while (is_default[hook][rv])
+                rv = kind_parents.parent[rv];
+            handler[hook][kind] = rv; }
+        return rv; }
+    static DispatchTable *get(const Visitor &v) {
+        static std::unordered_map<std::type_index, DispatchTable *> tables;
+#ifdef MULTITHREAD
+        static std::mutex lock;
+        std::lock_guard<std::mutex> guard(lock);
+#endif
+        auto &table = tables[typeid(v)];
+        if (!table)
+            table = new DispatchTable;
+        return table; }
 };
 
+// Calls the visit function of a visitor for one IR class; the dispatch functions
+// index tables of these by node kind.
+template<class T> struct VisitThunks {
+    static bool preorder(Modifier &v, IR::Node *n) { return v.preorder(static_cast<T *>(n)); }
+    static void postorder(Modifier &v, IR::Node *n) { v.postorder(static_cast<T *>(n)); }
+    static void revisit(Modifier &v, const IR::Node *n, const IR::Node *result) {
+        v.revisit(static_cast<const T *>(n), result); }
+    static bool preorder(Inspector &v, const IR::Node *n) {
+        return v.preorder(static_cast<const T *>(n)); }
+    static void postorder(Inspector &v, const IR::Node *n) {
+        v.postorder(static_cast<const T *>(n)); }
+    static void revisit(Inspector &v, const IR::Node *n) { v.revisit(static_cast<const T *>(n)); }
+    static const IR::Node *preorder(Transform &v, IR::Node *n) {
+        return v.preorder(static_cast<T *>(n)); }
+    static const IR::Node *postorder(Transform &v, IR::Node *n) {
+        return v.postorder(static_cast<T *>(n)); }
+    static void revisit(Transform &v, const IR::Node *n, const IR::Node *result) {
+        v.revisit(static_cast<const T *>(n), result); }
+};
+
+template<class PRE, class POST, class REVISIT> struct thunk_table {
+    PRE         preorder[IR::NODE_KINDS];
+    POST        postorder[IR::NODE_KINDS];
+    REVISIT     revisit[IR::NODE_KINDS];
+    thunk_table() {
+#define SET_THUNKS(CLASS)                                                               \
+        preorder[IR::NodeKind<IR::CLASS>::value] = &VisitThunks<IR::CLASS>::preorder;   \
+        postorder[IR::NodeKind<IR::CLASS>::value] = &VisitThunks<IR::CLASS>::postorder; \
+        revisit[IR::NodeKind<IR::CLASS>::value] = &VisitThunks<IR::CLASS>::revisit;
+        IRNODE_ALL_CLASSES(SET_THUNKS)
+#undef SET_THUNKS
+    }
+};
+static const thunk_table<bool (*)(Modifier &, IR::Node *),
+                         void (*)(Modifier &, IR::Node *),
+                         void (*)(Modifier &, const IR::Node *, const IR::Node *)>
+    modifier_thunks;
+static const thunk_table<bool (*)(Inspector &, const IR::Node *),
+                         void (*)(Inspector &, const IR::Node *),
+                         void (*)(Inspector &, const IR::Node *)>
+    inspector_thunks;
+static const thunk_table<const IR::Node *(*)(Transform &, IR::Node *),
+                         const IR::Node *(*)(Transform &, IR::Node *),
+                         void (*)(Transform &, const IR::Node *, const IR::Node *)>
+    transform_thunks;
+
+bool Modifier::dispatch_preorder(unsigned kind, IR::Node *n) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::PREORDER, kind);
+    return modifier_thunks.preorder[kind](*this, n); }
+void Modifier::dispatch_postorder(unsigned kind, IR::Node *n) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::POSTORDER, kind);
+    modifier_thunks.postorder[kind](*this, n); }
+void Modifier::dispatch_revisit(unsigned kind, const IR::Node *n, const IR::Node *result) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::REVISIT, kind);
+    modifier_thunks.revisit[kind](*this, n, result); }
+bool Inspector::dispatch_preorder(unsigned kind, const IR::Node *n) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::PREORDER, kind);
+    return inspector_thunks.preorder[kind](*this, n); }
+void Inspector::dispatch_postorder(unsigned kind, const IR::Node *n) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::POSTORDER, kind);
+    inspector_thunks.postorder[kind](*this, n); }
+void Inspector::dispatch_revisit(unsigned kind, const IR::Node *n) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::REVISIT, kind);
+    inspector_thunks.revisit[kind](*this, n); }
+const IR::Node *Transform::dispatch_preorder(unsigned kind, IR::Node *n) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::PREORDER, kind);
+    return transform_thunks.preorder[kind](*this, n); }
+const IR::Node *Transform::dispatch_postorder(unsigned kind, IR::Node *n) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::POSTORDER, kind);
+    return transform_thunks.postorder[kind](*this, n); }
+void Transform::dispatch_revisit(unsigned kind, const IR::Node *n, const IR::Node *result) {
+    if (dispatch) kind = dispatch->lookup(DispatchTable::REVISIT, kind);
+    transform_thunks.revisit[kind](*this, n, result); }
+
 Visitor::profile_t Visitor::init_apply(const IR::Node *root) {
     if (ctxt) BUG("previous use of visitor did not clean up properly");
     ctxt = nullptr;
+    dispatch = DispatchTable::get(*this);
     if (joinFlows) init_join_flows(root);
     return profile_t(*this);
 }
 Visitor::profile_t Modifier::init_apply(const IR::Node *root) {
     auto rv = Visitor::init_apply(root);
-    visited = new ChangeTracker();
+    visited = pool<ChangeTracker>().get();
     return rv; }
 Visitor::profile_t Inspector::init_apply(const IR::Node *root) {
     auto rv = Visitor::init_apply(root);
-    visited = new visited_t();
+    visited = pool<visited_t>().get();
     return rv; }
 Visitor::profile_t Transform::init_apply(const IR::Node *root) {
     auto rv = Visitor::init_apply(root);
-    visited = new ChangeTracker();
+    visited = pool<ChangeTracker>().get();
     return rv; }
 void Visitor::end_apply() {}
 void Visitor::end_apply(const IR::Node*) {}
 
-static indent_t profile_indent;
-Visitor::profile_t::profile_t(Visitor &v_) : v(v_) {
+// The nesting of the passes running on this thread
+static thread_local indent_t profile_indent;
+static thread_local int profile_depth;
+static uint64_t profile_clock() {
     struct timespec ts;
 #ifdef CLOCK_MONOTONIC
     clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -99,26 +301,160 @@ Visitor::profile_t::profile_t(Visitor &v_) : v(v_) {
     // FIXME -- figure out how to do this on OSX/Mach
     ts.tv_sec = ts.tv_nsec = 0;
 #endif
-    start = ts.tv_sec*1000000000UL + ts.tv_nsec + 1;
+    return ts.tv_sec*1000000000UL + ts.tv_nsec + 1;
+}
+
+bool Visitor::profile_t::collect = false;
+vector<Visitor::profile_t::pass_stats_t> Visitor::profile_t::stats;
+// The records of the innermost pass running on this thread, and of the last one that
+// ended on it; each profile_t keeps that of the pass it runs in
+static thread_local int running_stats = -1;
+static thread_local int ended_stats = -1;
+#ifdef MULTITHREAD
+// passes on several threads add records at once
+static std::mutex stats_lock;
+#else
+static struct { void lock() {} void unlock() {} } stats_lock;
+#endif
+typedef std::lock_guard<decltype(stats_lock)> stats_guard;
+
+// While a pass runs, its record holds the counters at the start; they are
+// replaced by the differences when it ends.
+Visitor::profile_t::profile_t(Visitor &v_) : v(v_), stats_index(-1),
+                                             parent_index(running_stats) {
+    start = profile_clock();
     assert(start);
+    if (collect) {
+        gc_statistics_t gc;
+        gc_statistics(gc);
+        stats_guard guard(stats_lock);
+        stats_index = stats.size();
+        stats.push_back({ v.name(), profile_depth, 0, IR::Node::currentId,
+                          gc.bytes_allocated, gc.collections, long(gc.heap_size),
+                          start, -1, 0, -1, {} });
+        running_stats = stats_index; }
+    sampling_push(v.name());
     ++profile_indent;
+    ++profile_depth;
 }
-Visitor::profile_t::profile_t(profile_t &&a) : v(a.v), start(a.start) {
+Visitor::profile_t::profile_t(profile_t &&a) : v(a.v), start(a.start),
+                                               stats_index(a.stats_index),
+                                               parent_index(a.parent_index) {
     a.start = 0;
 }
 Visitor::profile_t::~profile_t() {
     if (start) {
         v.end_apply();
+        sampling_pop();
         --profile_indent;
-        struct timespec ts;
-#ifdef CLOCK_MONOTONIC
-        clock_gettime(CLOCK_MONOTONIC, &ts);
-#else
-        // FIXME -- figure out how to do this on OSX/Mach
-        ts.tv_sec = ts.tv_nsec = 0;
-#endif
-        uint64_t end = ts.tv_sec*1000000000UL + ts.tv_nsec + 1;
-        LOG1(profile_indent << v.name() << ' ' << (end-start)/1000.0 << " usec"); }
+        --profile_depth;
+        uint64_t end = profile_clock();
+        LOG_TIMING(profile_indent << v.name() << ' ' << (end-start)/1000.0 << " usec");
+        running_stats = parent_index;
+        ended_stats = stats_index;
+        if (stats_index >= 0) {
+            gc_statistics_t gc;
+            gc_statistics(gc);
+            stats_guard guard(stats_lock);
+            auto &s = stats.at(stats_index);
+            s.nsec = end - start;
+            s.nodes = IR::Node::currentId - s.nodes;
+            s.bytes = gc.bytes_allocated - s.bytes;
+            s.collections = gc.collections - s.collections;
+            s.heap_delta = long(gc.heap_size) - s.heap_delta;
+            LOG2(profile_indent << "  " << s.nodes << " nodes, " << s.bytes << " bytes, " <<
+                 s.collections << " collections"); } }
+}
+
+void Visitor::profile_t::count(cstring counter, uint64_t value) {
+    if (running_stats >= 0) {
+        stats_guard guard(stats_lock);
+        stats[running_stats].counters[counter] += value; }
+}
+
+void Visitor::profile_t::set_position(unsigned seqNo, unsigned iteration, bool changed) {
+    if (ended_stats >= 0) {
+        stats_guard guard(stats_lock);
+        stats[ended_stats].seqNo = seqNo;
+        stats[ended_stats].iteration = iteration;
+        stats[ended_stats].changed = changed; }
+}
+
+void Visitor::profile_t::write_stats_trace(std::ostream &out) {
+    // Records are in start order, so the children of a pass are the records that
+    // follow it one level deeper, up to the next record at its own depth or above.
+    vector<uint64_t> child_nsec(stats.size());
+    vector<size_t> open;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        while (!open.empty() && stats[open.back()].depth >= stats[i].depth)
+            open.pop_back();
+        if (!open.empty())
+            child_nsec[open.back()] += stats[i].nsec;
+        open.push_back(i); }
+
+    uint64_t origin = stats.empty() ? 0 : stats.front().start;
+    auto *events = new Util::JsonArray();
+    for (size_t i = 0; i < stats.size(); ++i) {
+        auto &s = stats[i];
+        auto *event = new Util::JsonObject();
+        event->emplace("name", s.name);
+        event->emplace("cat", "pass");
+        event->emplace("ph", "X");
+        event->emplace("ts", static_cast<unsigned long>((s.start - origin) / 1000));
+        event->emplace("dur", static_cast<unsigned long>(s.nsec / 1000));
+        event->emplace("pid", 1);
+        event->emplace("tid", 1);
+        auto *args = new Util::JsonObject();
+        if (s.seqNo >= 0) {
+            args->emplace("seqNo", s.seqNo);
+            args->emplace("iteration", s.iteration);
+            args->emplace("changed", s.changed != 0); }
+        args->emplace("depth", s.depth);
+        args->emplace("self_usec",
+                      static_cast<unsigned long>((s.nsec - child_nsec[i]) / 1000));
+        for (auto &c : s.counters)
+            args->emplace(c.first, static_cast<unsigned long>(c.second));
+        event->emplace("args", args);
+        events->append(event); }
+    auto *trace = new Util::JsonObject();
+    trace->emplace("traceEvents", events);
+    trace->emplace("displayTimeUnit", "ms");
+    trace->serialize(out);
+    out << std::endl;
+}
+
+void Visitor::profile_t::write_stats_json(std::ostream &out) {
+    auto *passes = new Util::JsonArray();
+    for (auto &s : stats) {
+        auto *pass = new Util::JsonObject();
+        pass->emplace("name", s.name);
+        pass->emplace("depth", s.depth);
+        pass->emplace("usec", static_cast<unsigned long>(s.nsec / 1000));
+        pass->emplace("nodes", s.nodes);
+        pass->emplace("bytes", static_cast<unsigned long>(s.bytes));
+        pass->emplace("collections", static_cast<unsigned long>(s.collections));
+        pass->emplace("heap_delta", s.heap_delta);
+        if (s.changed >= 0)
+            pass->emplace("changed", s.changed != 0);
+        if (!s.counters.empty()) {
+            auto *counters = new Util::JsonObject();
+            for (auto &c : s.counters)
+                counters->emplace(c.first, static_cast<unsigned long>(c.second));
+            pass->emplace("counters", counters); }
+        passes->append(pass); }
+    passes->serialize(out);
+    out << std::endl;
+}
+
+void Visitor::profile_t::write_stats_csv(std::ostream &out) {
+    // 'changed' is empty for the passes that no PassManager ran
+    out << "name,depth,usec,nodes,bytes,collections,heap_delta,changed" << std::endl;
+    for (auto &s : stats) {
+        out << s.name << ',' << s.depth << ',' << s.nsec / 1000 << ',' << s.nodes << ','
+            << s.bytes << ',' << s.collections << ',' << s.heap_delta << ',';
+        if (s.changed >= 0)
+            out << s.changed;
+        out << std::endl; }
 }
 
 void Visitor::print_context() const {
@@ -142,9 +478,40 @@ void Modifier::visitor_const_error() {
     BUG("Modifier called const visit function -- missing template "
                             "instantiation in gen-tree-macro.h?"); }
 void Transform::visitor_const_error() {
+    // a child of a node that was not cloned changed; see apply_visitor
+    if (child_changed) {
+        *child_changed = true;
+        return; }
     BUG("Transform called const visit function -- missing template "
                             "instantiation in gen-tree-macro.h?"); }
 
+// Node kinds for which Context::indexed is maintained.  Marking a class marks
+// all of its subclasses too, so a search for any of them can use the index.
+static struct indexed_kinds {
+    bool indexed[IR::NODE_KINDS] = {};
+    template<class T> void mark() {
+        for (unsigned kind = IR::NodeKind<T>::value; kind < IR::NodeKind<T>::end; ++kind)
+            indexed[kind] = true; }
+    indexed_kinds() {
+        mark<IR::P4Program>();
+        mark<IR::P4Control>();
+        mark<IR::P4Parser>();
+        mark<IR::P4Action>();
+        mark<IR::P4Table>();
+        mark<IR::ParserState>();
+        mark<IR::Function>();
+        mark<IR::Declaration_Instance>();
+        mark<IR::Property>();
+        mark<IR::Type_StructLike>();
+        mark<IR::Type_Extern>();
+        mark<IR::V1Control>();
+        mark<IR::V1Table>();
+        mark<IR::ActionFunction>(); }
+} indexed_kinds;
+
+bool Visitor::isIndexedKind(unsigned kind) {
+    return kind < IR::NODE_KINDS && indexed_kinds.indexed[kind]; }
+
 struct PushContext {
     Visitor::Context current;
     const Visitor::Context *&stack;
@@ -154,8 +521,15 @@ struct PushContext {
         current.child_index = 0;
         current.depth = stack ? stack->depth+1 : 1;
         assert(current.depth < 10000);    // stack overflow?
+        current.indexed = indexed_kinds.indexed[node->node_kind()] ? &current
+                        : stack ? stack->indexed : nullptr;
         stack = &current; }
     ~PushContext() { stack = current.parent; }
+    // replace the node being visited, before any of its children are visited
+    void replace(const IR::Node *node) {
+        current.node = node;
+        if (indexed_kinds.indexed[node->node_kind()])
+            current.indexed = &current; }
 };
 
 namespace {
@@ -170,12 +544,13 @@ class ForwardChildren : public Visitor {
 
 const IR::Node *Modifier::apply_visitor(const IR::Node *n, const char *name) {
     if (ctxt) ctxt->child_name = name;
-    if (n) {
+    if (n && !(joinFlows && join_flows(n))) {
         PushContext local(ctxt, n);
         auto track = visited->track(n);
         if (track.done() && visitDagOnce) {
-            track.orig()->apply_visitor_revisit(*this, track.result());
-            n = track.result();
+            auto result = track.result();
+            track.orig()->apply_visitor_revisit(*this, result);
+            n = result;
         } else {
             visited->start(track);
             IR::Node *copy = n->clone();
@@ -186,12 +561,22 @@ const IR::Node *Modifier::apply_visitor(const IR::Node *n, const char *name) {
             if (copy->apply_visitor_preorder(*this)) {
                 copy->visit_children(*this);
                 copy->apply_visitor_postorder(*this); }
-            if (visited->finish(track, n, copy))
-                (n = copy)->validate(); } }
-    if (ctxt)
+            if (visited->finish(track, n, copy)) {
+                (n = copy)->validate();
+                ++nodes_replaced;
+            } else if (releaseDiscardedClones) {
+                visited->discard(copy); } } }
+    if (ctxt) {
         ctxt->child_index++;
-    else
-        visited = nullptr;
+    } else {
+        if (profile_t::collect)
+            profile_t::count("nodes replaced", nodes_replaced);
+        nodes_replaced = 0;
+        if (joinFlows)
+            n = finish_join_flows(n, *visited);
+        visited->release();
+        pool<ChangeTracker>().put(visited);
+        visited = nullptr; }
     return n;
 }
 
@@ -200,37 +585,94 @@ const IR::Node *Inspector::apply_visitor(const IR::Node *n, const char *name) {
     if (n && !join_flows(n)) {
         PushContext local(ctxt, n);
         auto vp = visited->emplace(n, false);
-        if (!vp.second && !vp.first->second)
+        if (!vp.second && !*vp.first)
             BUG("IR loop detected");
         if (!vp.second && visitDagOnce) {
             n->apply_visitor_revisit(*this);
         } else {
-            vp.first->second = false;
+            *vp.first = false;
             if (n->apply_visitor_preorder(*this)) {
-                n->visit_children(*this);
+                if (mayReachOnly(n->node_kind()))
+                    n->visit_children(*this);
                 n->apply_visitor_postorder(*this); }
-            vp.first = visited->find(n);  // iterator may have been invalidated
-            if (vp.first == visited->end())
+            vp.first = visited->find(n);  // pointer may have been invalidated
+            if (!vp.first)
                 BUG("visitor state tracker corrupted");
-            vp.first->second = true; } }
-    if (ctxt)
+            *vp.first = true; } }
+    if (ctxt) {
         ctxt->child_index++;
-    else
-        visited = nullptr;
+    } else {
+        pool<visited_t>().put(visited);
+        visited = nullptr; }
     return n;
 }
 
+void Inspector::visitOnlyKinds(unsigned first, unsigned end) {
+    only.resize(IR::NODE_REACH_WORDS);
+    for (unsigned k = first; k < end; ++k)
+        only[k / 64] |= uint64_t(1) << (k % 64); }
+
+bool Inspector::mayReachOnly(unsigned kind) const {
+    if (only.empty()) return true;
+    for (unsigned w = 0; w < IR::NODE_REACH_WORDS; ++w)
+        if (IR::node_reach[kind][w] & only[w]) return true;
+    return false; }
+
+const IR::Node *Transform::preorder(IR::Node *n) {
+    if (dispatch) dispatch->set_node_default(DispatchTable::PREORDER);
+    return n; }
+const IR::Node *Transform::postorder(IR::Node *n) {
+    if (dispatch) dispatch->set_node_default(DispatchTable::POSTORDER);
+    return n; }
+
 const IR::Node *Transform::apply_visitor(const IR::Node *n, const char *name) {
     if (ctxt) ctxt->child_name = name;
-    if (n) {
+    // Replaying the children of a clone, a child not done is a join point that is
+    // still waiting for its last parent
+    if (n && joinFlows && (replaying ? !visited->done(n) : join_flows(n))) {
+        // the parents are given its result by finish_join_flows
+    } else if (n) {
         PushContext local(ctxt, n);
         auto track = visited->track(n);
+        auto *outer_changed = child_changed;
         if (track.done() && visitDagOnce) {
-            track.orig()->apply_visitor_revisit(*this, track.result());
-            n = track.result();
+            auto result = track.result();
+            if (!replaying)
+                track.orig()->apply_visitor_revisit(*this, result);
+            n = result;
+        } else if (visitDagOnce && dispatch &&
+                   dispatch->calls_node_default(DispatchTable::PREORDER, n->node_kind()) &&
+                   dispatch->calls_node_default(DispatchTable::POSTORDER, n->node_kind())) {
+            // only a change to a child can change this node, so it is cloned if one
+            // does; the children then come out of the change tracker as they are
+            visited->start(track);
+            bool changed = false;
+            child_changed = &changed;
+            n->visit_children(*this);
+            child_changed = nullptr;
+            IR::Node *copy = nullptr;
+            if (changed) {
+                copy = n->clone();
+                ++clones_made;
+                local.current.node = copy;
+                local.current.child_index = 0;
+                replaying = true;
+                copy->visit_children(*this);
+                replaying = false;
+            } else {
+                ++clones_avoided; }
+            if (visited->finish(track, n, copy ? copy : n) && (n = copy)) {
+                copy->validate();
+                ++nodes_replaced;
+            } else if (copy) {
+                ++clones_dropped;
+                if (releaseDiscardedClones)
+                    visited->discard(copy); }
         } else {
             visited->start(track);
             auto copy = n->clone();
+            ++clones_made;
+            child_changed = nullptr;
             local.current.node = copy;
             if (visitDagOnce && !dontForwardChildrenBeforePreorder) {
                 ForwardChildren forward_children(*visited);
@@ -252,29 +694,46 @@ const IR::Node *Transform::apply_visitor(const IR::Node *n, const char *name) {
                 } else {
                     preorder_result_track = visited->track(preorder_result);
                     visited->start(preorder_result_track);
-                    local.current.node = copy = preorder_result->clone(); } }
+                    local.replace(copy = preorder_result->clone());
+                    ++clones_made; } }
             if (!prune_flag) {
                 copy->visit_children(*this);
                 final = copy->apply_visitor_postorder(*this); }
+            // only a clone that was itself the result can be unreferenced if dropped;
+            // one replaced in preorder may have been wrapped by its replacement
+            bool copy_was_result = final == copy;
             if (final && final != preorder_result && *final == *preorder_result)
                 final = preorder_result;
-            if (visited->finish(track, n, final) && (n = final))
-                final->validate();
+            if (visited->finish(track, n, final)) {
+                ++nodes_replaced;  // or removed
+                if ((n = final))
+                    final->validate();
+            } else if (copy_was_result) {
+                ++clones_dropped; }
             if (preorder_result_track)
-                visited->finish(preorder_result_track, preorder_result, final); } }
-    if (ctxt)
+                visited->finish(preorder_result_track, preorder_result, final);
+            if (copy_was_result && n != copy && releaseDiscardedClones)
+                visited->discard(copy); }
+        child_changed = outer_changed; }
+    if (ctxt) {
         ctxt->child_index++;
-    else
-        visited = nullptr;
+    } else {
+        if (profile_t::collect) {
+            profile_t::count("nodes cloned", clones_made);
+            profile_t::count("clones dropped unchanged", clones_dropped);
+            profile_t::count("clones avoided", clones_avoided);
+            profile_t::count("nodes replaced", nodes_replaced); }
+        clones_made = clones_dropped = clones_avoided = nodes_replaced = 0;
+        if (joinFlows)
+            n = finish_join_flows(n, *visited);
+        visited->release();
+        pool<ChangeTracker>().put(visited);
+        visited = nullptr; }
     return n;
 }
 
 void Inspector::revisit_visited() {
-    for (auto it = visited->begin(); it != visited->end();) {
-        if (it->second)
-            it = visited->erase(it);
-        else
-            ++it; }
+    visited->erase_if([](const IR::Node *, bool done) { return done; });
 }
 void Modifier::revisit_visited() {
     visited->revisit_visited();
@@ -285,48 +744,90 @@ void Transform::revisit_visited() {
 
 #define DEFINE_VISIT_FUNCTIONS(CLASS, BASE)                                             \
 bool Modifier::preorder(IR::CLASS *n) {                                                 \
+    IS_DEFAULT(PREORDER, CLASS);                                                        \
     return preorder(static_cast<IR::BASE *>(n)); }                                      \
 void Modifier::postorder(IR::CLASS *n) {                                                \
+    IS_DEFAULT(POSTORDER, CLASS);                                                       \
     postorder(static_cast<IR::BASE *>(n)); }                                            \
 void Modifier::revisit(const IR::CLASS *o, const IR::CLASS *n) {                        \
+    IS_DEFAULT(REVISIT, CLASS);                                                         \
     revisit(static_cast<const IR::BASE *>(o), static_cast<const IR::BASE *>(n)); }      \
 bool Inspector::preorder(const IR::CLASS *n) {                                          \
+    IS_DEFAULT(PREORDER, CLASS);                                                        \
     return preorder(static_cast<const IR::BASE *>(n)); }                                \
 void Inspector::postorder(const IR::CLASS *n) {                                         \
+    IS_DEFAULT(POSTORDER, CLASS);                                                       \
     postorder(static_cast<const IR::BASE *>(n)); }                                      \
 void Inspector::revisit(const IR::CLASS *n) {                                           \
+    IS_DEFAULT(REVISIT, CLASS);                                                         \
     revisit(static_cast<const IR::BASE *>(n)); }                                        \
 const IR::Node *Transform::preorder(IR::CLASS *n) {                                     \
+    IS_DEFAULT(PREORDER, CLASS);                                                        \
     return preorder(static_cast<IR::BASE *>(n)); }                                      \
 const IR::Node *Transform::postorder(IR::CLASS *n) {                                    \
+    IS_DEFAULT(POSTORDER, CLASS);                                                       \
     return postorder(static_cast<IR::BASE *>(n)); }                                     \
 void Transform::revisit(const IR::CLASS *o, const IR::Node *n) {                        \
+    IS_DEFAULT(REVISIT, CLASS);                                                         \
     return revisit(static_cast<const IR::BASE *>(o), n); }                              \
 
+#define IS_DEFAULT(HOOK, CLASS)                                                         \
+    if (dispatch) dispatch->set_default(DispatchTable::HOOK, IR::NodeKind<IR::CLASS>::value)
 IRNODE_ALL_SUBCLASSES(DEFINE_VISIT_FUNCTIONS)
+#undef IS_DEFAULT
 
 class SetupJoinPoints : public Inspector {
-    map<const IR::Node *, std::pair<ControlFlowVisitor *, int>> &join_points;
+    map<const IR::Node *, int> &join_points;
     bool preorder(const IR::Node *n) override {
-        return ++join_points[n].second == 1; }
+        return ++join_points[n] == 1; }
  public:
     explicit SetupJoinPoints(decltype(join_points) &fjp)
     : join_points(fjp) { visitDagOnce = false; }
 };
 
+// Gives the parents that a Modifier or Transform visited before the last parent of
+// a join point the result of the join point, in place of the original they kept
+class ReplaceJoinPoints : public Transform {
+    const map<const IR::Node *, const IR::Node *> &results;
+    const IR::Node *preorder(IR::Node *n) override {
+        auto it = results.find(getOriginal());
+        return it == results.end() ? n : it->second; }
+ public:
+    explicit ReplaceJoinPoints(decltype(results) &results) : results(results) {}
+};
+
 void ControlFlowVisitor::init_join_flows(const IR::Node *root) {
-    if (!dynamic_cast<Inspector *>(this))
-        BUG("joinFlows only works for Inspector passes currently, not Modifier or Transform");
+    if (!join_point_parents || join_points_root != root || join_points_root_id != root->id) {
+        map<const IR::Node *, int> parents;
+        root->apply(SetupJoinPoints(parents));
+        if (join_point_parents)
+            join_point_parents->clear();
+        else
+            join_point_parents = new std::remove_reference<decltype(*join_point_parents)>::type;
+        for (auto &p : parents)
+            if (p.second > 1 && !filter_join_point(p.first))
+                join_point_parents->emplace(p.first, p.second);
+        join_points_root = root;
+        join_points_root_id = root->id; }
     if (flow_join_points)
         flow_join_points->clear();
     else
         flow_join_points = new std::remove_reference<decltype(*flow_join_points)>::type;
-    root->apply(SetupJoinPoints(*flow_join_points));
-    for (auto it = flow_join_points->begin(); it != flow_join_points->end(); ) {
-        if (it->second.second > 1 && !filter_join_point(it->first)) {
-            ++it;
-        } else {
-            it = flow_join_points->erase(it); } }
+    for (auto &p : *join_point_parents)
+        flow_join_points->emplace(p.first, std::make_pair(nullptr, p.second));
+}
+
+const IR::Node *ControlFlowVisitor::finish_join_flows(const IR::Node *root,
+                                                      const ChangeTracker &visited) {
+    map<const IR::Node *, const IR::Node *> results;
+    for (auto &jp : *flow_join_points) {
+        auto result = visited.result(jp.first);
+        if (result != jp.first)
+            results.emplace(jp.first, result); }
+    if (results.empty())
+        return root;
+    LOG3("giving the results of " << results.size() << " join points to their parents");
+    return root->apply(ReplaceJoinPoints(results));
 }
 
 bool ControlFlowVisitor::join_flows(const IR::Node *n) {
@@ -343,3 +844,143 @@ bool ControlFlowVisitor::join_flows(const IR::Node *n) {
             return true; } }
     return false;
 }
+
+bool ParallelInspector::preorder(const IR::IndexedVector<IR::Node> *vec) {
+    if (!getParent<IR::P4Program>())
+        return preorder(static_cast<const IR::Vector<IR::Node> *>(vec));
+    parallel_visit(vec);
+    return false;
+}
+
+void ParallelInspector::parallel_visit(const IR::Vector<IR::Node> *vec) {
+    size_t count = vec->size();
+    vector<ParallelInspector *> clones(count);
+    vector<std::exception_ptr> errors(count);
+    Util::parallel_for(count, threads, [&](size_t i) {
+        auto *clone = clones[i] = this->clone();
+        // the clone updates child_index and child_name in its own copy of the context
+        Context top = *ctxt;
+        top.child_index += i;
+        clone->ctxt = &top;
+        clone->visited = pool<visited_t>().get();
+        try {
+            clone->apply_visitor(vec->at(i));
+        } catch (...) {
+            errors[i] = std::current_exception(); }
+        clone->ctxt = nullptr; });
+    // if a clone failed, the first error is rethrown and none of the clones is joined
+    std::exception_ptr error;
+    for (size_t i = 0; i < count && !error; ++i)
+        error = errors[i];
+    for (size_t i = 0; i < count; ++i) {
+        auto *clone = clones[i];
+        if (!error) {
+            clone->visited->for_each([this](const IR::Node *n, bool done) {
+                visited->emplace(n, done); });
+            parallel_join(*clone); }
+        pool<visited_t>().put(clone->visited);
+        clone->visited = nullptr; }
+    if (error) std::rethrow_exception(error);
+    ctxt->child_index += count;
+}
+
+FusedTransform::FusedTransform(std::initializer_list<Transform *> passes) : passes(passes) {
+    std::string name = "Fused";
+    for (auto *pass : this->passes) {
+        CHECK_NULL(pass);
+        name += std::string("_") + pass->name(); }
+    setName(cstring(name).c_str());
+}
+
+Visitor::profile_t FusedTransform::init_apply(const IR::Node *root) {
+    for (auto *pass : passes)
+        pass->dispatch = DispatchTable::get(*pass);
+    return Transform::init_apply(root);
+}
+
+void FusedTransform::end_apply() {
+    for (auto *pass : passes)
+        pass->ctxt = nullptr;
+    Transform::end_apply();
+}
+
+const IR::Node *FusedTransform::postorder(IR::Node *n) {
+    const IR::Node *result = n;   // what this returns: the last node a pass changed
+    IR::Node *node = n;           // a clone of 'result' (or 'n'), for the passes to change
+    Context local = *ctxt;        // the context of 'node' once it is not 'n'
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto *pass : passes) {
+            pass->ctxt = node == n ? ctxt : &local;
+            auto *rv = node->apply_visitor_postorder(*pass);
+            pass->ctxt = nullptr;
+            if (rv == node) {
+                result = node;
+                continue; }
+            if (rv == nullptr)
+                return nullptr;
+            if (*rv == *node)
+                continue;
+            result = rv;
+            node = rv->clone();
+            local.node = node;
+            local.indexed = isIndexedKind(node->node_kind()) ? &local
+                          : local.parent ? local.parent->indexed : nullptr;
+            changed = true; } }
+    return result;
+}
+
+const IR::Node *ParallelTransform::preorder(IR::IndexedVector<IR::Node> *vec) {
+    if (!getParent<IR::P4Program>())
+        return preorder(static_cast<IR::Vector<IR::Node> *>(vec));
+    parallel_visit(vec);
+    prune();
+    return vec;
+}
+
+void ParallelTransform::parallel_visit(IR::IndexedVector<IR::Node> *vec) {
+    size_t count = vec->size();
+    vector<ParallelTransform *> clones(count);
+    vector<const IR::Node *> results(count);
+    vector<std::exception_ptr> errors(count);
+    auto visit = [&](size_t i) {
+        auto *clone = clones[i] = this->clone();
+        // the clone updates child_index and child_name in its own copy of the context
+        Context top = *ctxt;
+        top.child_index += i;
+        clone->ctxt = &top;
+        clone->visited = pool<ChangeTracker>().get();
+        clone->parallel_start();
+        try {
+            results[i] = clone->apply_visitor(vec->at(i));
+        } catch (...) {
+            errors[i] = std::current_exception(); }
+        clone->parallel_end();
+        clone->visited->release();
+        pool<ChangeTracker>().put(clone->visited);
+        clone->visited = nullptr;
+        clone->ctxt = nullptr; };
+    Util::parallel_for(count, threads, visit);
+
+    std::exception_ptr error;
+    for (size_t i = 0; i < count && !error; ++i) {
+        if ((error = errors[i]) || parallel_join(*clones[i]))
+            continue;
+        // redo it after the ones before it, which is how a serial run would see it
+        errors[i] = nullptr;
+        visit(i);
+        if (!(error = errors[i]) && !parallel_join(*clones[i]))
+            BUG("%1%: clone rejected when run after all before it", vec->at(i)); }
+    if (error) std::rethrow_exception(error);
+
+    vec->clear();
+    for (auto *n : results) {
+        if (!n) continue;
+        if (auto *l = n->to<IR::Vector<IR::Node>>()) {
+            for (auto *el : *l)
+                vec->push_back(el);
+        } else {
+            vec->push_back(n); } }
+    ctxt->child_index += count;
+}
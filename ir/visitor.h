@@ -20,6 +20,7 @@ limitations under the License.
 #include <stdexcept>
 #include "std.h"
 #include "lib/cstring.h"
+#include "lib/flat_ptr_map.h"
 #include "ir/ir.h"
 #include "lib/exceptions.h"
 
@@ -35,12 +36,18 @@ class Visitor {
         mutable int     child_index;
         mutable const char *child_name;
         int             depth;
+        // nearest context, this one included, whose node or original is of one of the
+        // kinds that findContext/findOrigCtxt are usually asked for (controls, parsers,
+        // actions, tables, ...), so searches for those kinds skip everything else
+        const Context   *indexed;
     };
     class profile_t {
         // for profiling -- a profile_t object is created when a pass
         // starts and destroyed when it ends.  Moveable but not copyable.
         Visitor         &v;
         uint64_t        start;
+        int             stats_index;    // into 'stats', or -1 if not collecting
+        int             parent_index;   // of the pass running on the thread when it started
         explicit profile_t(Visitor &);
         profile_t() = delete;
         profile_t(const profile_t &) = delete;
@@ -50,6 +57,39 @@ class Visitor {
      public:
         ~profile_t();
         profile_t(profile_t &&);
+
+        // Resources used by one apply of a pass.  Nested passes (those run by
+        // a PassManager) have a larger depth and are included in their parent.
+        struct pass_stats_t {
+            cstring     name;
+            int         depth;
+            uint64_t    nsec;
+            int         nodes;          // IR nodes created
+            size_t      bytes;          // bytes allocated
+            size_t      collections;    // garbage collections run
+            long        heap_delta;     // change in heap size
+            uint64_t    start;          // clock when the pass started
+            int         seqNo;          // position in the parent PassManager, or -1
+            unsigned    iteration;      // of a repeating parent PassManager
+            int         changed;        // whether it returned a new root, or -1 if not known
+            std::map<cstring, uint64_t> counters;  // added with count()
+        };
+        // When 'collect' is set, every apply appends a record to 'stats',
+        // in the order the passes start.  The depths are those of the passes on
+        // the thread that ran each one.
+        static bool collect;
+        static vector<pass_stats_t> stats;
+        // Adds 'value' to a named counter of the innermost pass running on this
+        // thread, if collecting.
+        static void count(cstring counter, uint64_t value);
+        // Called by PassManager after running a child, the last pass to end on this
+        // thread, which returned a root other than its input if 'changed'.
+        static void set_position(unsigned seqNo, unsigned iteration, bool changed);
+        static void write_stats_json(std::ostream &out);
+        static void write_stats_csv(std::ostream &out);
+        // Chrome trace event format, viewable in chrome://tracing and most
+        // flame-graph tools.  Each pass also carries its exclusive time.
+        static void write_stats_trace(std::ostream &out);
     };
     virtual ~Visitor() = default;
 
@@ -95,6 +135,16 @@ class Visitor {
         return typeid(*this).name();
     }
     void setName(const char* name) { internalName = name; }
+
+    // A pass that returns a key, naming it and the options it runs with, is skipped
+    // by a PassManager on a program that it is known to leave unchanged: one that
+    // a pass with the same key returned without changing it, or, if the pass is
+    // idempotent, any program that such a pass returned, since the outermost
+    // PassManager running on the thread started.  The output of such a pass
+    // must depend only on the program and the key: when a PassManager replays it on
+    // the same program after a backtrack, it reuses the output of the last run.
+    virtual cstring fixpointKey() const { return nullptr; }
+    virtual bool idempotent() const { return false; }
     void print_context() const;  // for debugging; can be called from debugger
 
     // Context access/search functions.  getContext returns the context
@@ -118,20 +168,34 @@ class Visitor {
     int getContextDepth() const { return ctxt->depth - 1; }
     template <class T> inline const T *findContext(const Context *&c) const {
         if (!c) c = ctxt;
+        if (isIndexedContext<T>()) {
+            while ((c = nextIndexedContext(c)))
+                if (auto *rv = c->node->to<T>()) return rv;
+            return nullptr; }
         while ((c = c->parent))
-            if (auto *rv = dynamic_cast<const T *>(c->node)) return rv;
+            if (auto *rv = c->node->to<T>()) return rv;
         return nullptr; }
     template <class T> inline const T *findContext() const {
         const Context *c = ctxt;
         return findContext<T>(c); }
     template <class T> inline const T *findOrigCtxt(const Context *&c) const {
         if (!c) c = ctxt;
+        if (isIndexedContext<T>()) {
+            while ((c = nextIndexedContext(c)))
+                if (auto *rv = c->original->to<T>()) return rv;
+            return nullptr; }
         while ((c = c->parent))
-            if (auto *rv = dynamic_cast<const T *>(c->original)) return rv;
+            if (auto *rv = c->original->to<T>()) return rv;
         return nullptr; }
     template <class T> inline const T *findOrigCtxt() const {
         const Context *c = ctxt;
         return findOrigCtxt<T>(c); }
+    // true for node kinds that are tracked by Context::indexed
+    static bool isIndexedKind(unsigned kind);
+    template <class T> static bool isIndexedContext() {
+        return IR::NodeKind<T>::exact && isIndexedKind(IR::NodeKind<T>::value); }
+    static const Context *nextIndexedContext(const Context *c) {
+        return c->parent ? c->parent->indexed : nullptr; }
 
  protected:
     // if visitDagOnce is set to 'false' (usually in the derived Visitor
@@ -140,26 +204,50 @@ class Visitor {
     // pass, this will result in them being duplicated if they are modified.
     bool visitDagOnce = true;
     bool dontForwardChildrenBeforePreorder = false;
+    // if releaseDiscardedClones is 'true' and the compiler is configured with
+    // --enable-pass-regions, a Modifier or Transform frees the clones it makes and
+    // then drops (because they turned out unchanged) when the traversal ends.  Only
+    // set this in passes that never keep pointers to the nodes they are visiting.
+    bool releaseDiscardedClones = false;
     // if joinFlows is 'true', Visitor will track nodes with more than one parent and
     // flow_merge the visitor from all the parents before visiting the node and its
-    // children.  This only works for Inspector (not Modifier/Transform) currently.
+    // children, once, from the last parent.  In a Modifier or Transform the parents
+    // visited before the last one keep the original node until the traversal ends,
+    // and are then given its result; that result must not contain the original.
     bool joinFlows = false;
     virtual void init_join_flows(const IR::Node *) { assert(0); }
     virtual bool join_flows(const IR::Node *) { return false; }
-    void visit_children(const IR::Node *, std::function<void()> fn) { fn(); }
+    // Takes the callable by type rather than as a std::function, so a capturing lambda
+    // is neither copied to the heap nor hidden from the inliner.
+    template<class F> void visit_children(const IR::Node *, F &&fn) { fn(); }
     class ChangeTracker;  // used by Modifier and Transform -- private to them
+    // called by Modifier and Transform with joinFlows at the end of the traversal
+    virtual const IR::Node *finish_join_flows(const IR::Node *root, const ChangeTracker &)
+    { return root; }
+    class DispatchTable;  // used by Modifier, Inspector and Transform
 
  private:
     virtual void visitor_const_error();
     const Context *ctxt = nullptr;  // should be readonly to subclasses
+    DispatchTable *dispatch = nullptr;  // shared by all visitors of the same class
     friend class Inspector;
     friend class Modifier;
     friend class Transform;
     friend class ControlFlowVisitor;
+    friend class ParallelInspector;
+    friend class ParallelTransform;
+    friend class FusedTransform;
 };
 
+// The preorder, postorder and revisit functions for an IR class default to calling
+// the ones for its base class.  As those defaults get called, each visitor class
+// learns which of them it does not override, and from then on calls the nearest
+// overriding function directly.  So an override must not call the default for its
+// own class by qualified name (like Inspector::preorder(n)), as that looks the same
+// as the class not overriding it.
 class Modifier : public virtual Visitor {
     ChangeTracker       *visited = nullptr;
+    uint64_t            nodes_replaced = 0;  // for the profile of the pass
     void visitor_const_error() override;
  public:
     profile_t init_apply(const IR::Node *root) override;
@@ -173,12 +261,36 @@ class Modifier : public virtual Visitor {
     virtual void revisit(const IR::CLASS *, const IR::CLASS *);
     IRNODE_ALL_SUBCLASSES(DECLARE_VISIT_FUNCTIONS)
 #undef DECLARE_VISIT_FUNCTIONS
+    // called by the IR apply_visitor functions with the IR::NodeKind of the node
+    bool dispatch_preorder(unsigned kind, IR::Node *n);
+    void dispatch_postorder(unsigned kind, IR::Node *n);
+    void dispatch_revisit(unsigned kind, const IR::Node *n, const IR::Node *result);
     void revisit_visited();
 };
 
 class Inspector : public virtual Visitor {
-    typedef unordered_map<const IR::Node *, bool>       visited_t;
+    typedef flat_ptr_map<const IR::Node *, bool>        visited_t;
     visited_t   *visited = nullptr;
+    std::vector<uint64_t>       only;   // the kinds given to visitOnly, if called
+    void visitOnlyKinds(unsigned first, unsigned end);
+    template<class T> void visitOnlyClass() {
+        static_assert(IR::NodeKind<T>::exact, "visitOnly takes IR node classes");
+        visitOnlyKinds(IR::NodeKind<T>::value, IR::NodeKind<T>::end); }
+    bool mayReachOnly(unsigned kind) const;
+
+ protected:
+    // Visit only the nodes of the classes T (and their subclasses), and the nodes above
+    // them: the children of a node are skipped when none of them can be, or contain, a
+    // node of these classes, going by the types of the fields of the IR classes (see
+    // IR::node_reach).  So a visitor of statements does not go into expressions.  The
+    // preorder and postorder functions of the nodes on the way are still called.
+    template<class... T> void visitOnly() {
+        int expand[] = { 0, (visitOnlyClass<T>(), 0)... };
+        (void)expand; }
+    // Visits the children of 'n', e.g. from a preorder that does more around them and
+    // returns false
+    void visitChildrenOf(const IR::Node *n) { n->visit_children(*this); }
+
  public:
     profile_t init_apply(const IR::Node *root) override;
     const IR::Node *apply_visitor(const IR::Node *, const char *name = 0) override;
@@ -191,18 +303,34 @@ class Inspector : public virtual Visitor {
     virtual void revisit(const IR::CLASS *);
     IRNODE_ALL_SUBCLASSES(DECLARE_VISIT_FUNCTIONS)
 #undef DECLARE_VISIT_FUNCTIONS
+    // called by the IR apply_visitor functions with the IR::NodeKind of the node
+    bool dispatch_preorder(unsigned kind, const IR::Node *n);
+    void dispatch_postorder(unsigned kind, const IR::Node *n);
+    void dispatch_revisit(unsigned kind, const IR::Node *n);
     void revisit_visited();
+    friend class ParallelInspector;
 };
 
+// A Transform clones each node before calling preorder on it, so that it can be
+// changed in place.  A node for which the pass has neither a preorder nor a
+// postorder function (even for one of its base classes) is not cloned up front:
+// its children are visited on the original, and it is cloned only once one of them
+// changes.  The profile of the pass counts the clones made, those dropped because
+// they came out unchanged, those avoided, and the nodes replaced by a changed one.
 class Transform : public virtual Visitor {
     ChangeTracker       *visited = nullptr;
     bool prune_flag = false;
+    // set when a child of the node whose children are being visited uncloned changes
+    bool *child_changed = nullptr;
+    bool replaying = false;  // visiting the children of a node again, once cloned
+    uint64_t clones_made = 0, clones_dropped = 0, clones_avoided = 0, nodes_replaced = 0;
     void visitor_const_error() override;
+
  public:
     profile_t init_apply(const IR::Node *root) override;
     const IR::Node *apply_visitor(const IR::Node *, const char *name = 0) override;
-    virtual const IR::Node *preorder(IR::Node *n) {return n;}
-    virtual const IR::Node *postorder(IR::Node *n) {return n;}
+    virtual const IR::Node *preorder(IR::Node *n);
+    virtual const IR::Node *postorder(IR::Node *n);
     virtual void revisit(const IR::Node *, const IR::Node *) {}
 #define DECLARE_VISIT_FUNCTIONS(CLASS, BASE)                            \
     virtual const IR::Node *preorder(IR::CLASS *);                      \
@@ -210,7 +338,12 @@ class Transform : public virtual Visitor {
     virtual void revisit(const IR::CLASS *, const IR::Node *);
     IRNODE_ALL_SUBCLASSES(DECLARE_VISIT_FUNCTIONS)
 #undef DECLARE_VISIT_FUNCTIONS
+    // called by the IR apply_visitor functions with the IR::NodeKind of the node
+    const IR::Node *dispatch_preorder(unsigned kind, IR::Node *n);
+    const IR::Node *dispatch_postorder(unsigned kind, IR::Node *n);
+    void dispatch_revisit(unsigned kind, const IR::Node *n, const IR::Node *result);
     void revisit_visited();
+    friend class ParallelTransform;
  protected:
     // can only be called usefully from 'preorder' function
     void prune() { prune_flag = true; }
@@ -222,14 +355,93 @@ class Transform : public virtual Visitor {
 
 class ControlFlowVisitor : public virtual Visitor {
     map<const IR::Node *, std::pair<ControlFlowVisitor *, int>> *flow_join_points = 0;
+    // the number of parents of each join point of the last tree visited, which a
+    // visit of the same tree reuses rather than traversing it again to count them
+    map<const IR::Node *, int> *join_point_parents = 0;
+    const IR::Node *join_points_root = nullptr;
+    int join_points_root_id = -1;
  protected:
     virtual ControlFlowVisitor *clone() const = 0;
     void init_join_flows(const IR::Node *root) override;
     bool join_flows(const IR::Node *n) override;
+    const IR::Node *finish_join_flows(const IR::Node *root, const ChangeTracker &) override;
     virtual bool filter_join_point(const IR::Node *) { return false; }
     ControlFlowVisitor &flow_clone() override { return *clone(); }
 };
 
+// An Inspector that visits the top-level declarations of a P4Program on several
+// threads at once.  Each declaration is visited by its own clone of the visitor,
+// started in the context of the declarations vector, and once all are done the
+// clones are passed to parallel_join on this visitor, in declaration order, for
+// the pass to merge their results.  Without MULTITHREAD the clones run one after
+// another, so a pass behaves the same either way.  If a clone throws, none of the
+// clones is joined, and the exception of the first declaration that threw is rethrown.
+// The clones do not share their visited nodes, so a node reachable from several
+// declarations is visited once by each of their clones.  Anything the clones
+// share, other than the IR, must be safe to use from several threads.
+class ParallelInspector : public Inspector {
+ protected:
+    virtual ParallelInspector *clone() const = 0;
+    virtual void parallel_join(ParallelInspector &) {}
+    // visits the elements of 'vec' with clones; preorder calls this for the
+    // declarations of a P4Program, and a pass can call it for other vectors
+    void parallel_visit(const IR::Vector<IR::Node> *vec);
+
+ public:
+    // number of threads to use; 0 for one for each hardware thread
+    unsigned threads = 0;
+    using Inspector::preorder;
+    bool preorder(const IR::IndexedVector<IR::Node> *vec) override;
+};
+
+// A Transform that transforms the top-level declarations of a P4Program on several
+// threads at once, like ParallelInspector, and puts the results back in the order of
+// the declarations.  parallel_start and parallel_end are called on the thread that
+// runs a clone, around its visit, to set up per-thread state such as a
+// ReferenceMap::NameReservation.  parallel_join merges each clone in order, and
+// returns false if its result is not what a serial run would have produced (say
+// because names it generated clash with earlier clones); the declaration is then
+// transformed again by a fresh clone, after the earlier ones have been joined.
+// A node reachable from several declarations is transformed separately by each of
+// their clones, so the result has equal copies where a serial run has one node.
+class ParallelTransform : public Transform {
+ protected:
+    virtual ParallelTransform *clone() const = 0;
+    virtual void parallel_start() {}
+    virtual void parallel_end() {}
+    virtual bool parallel_join(ParallelTransform &) { return true; }
+    // transforms the elements of 'vec' with clones; preorder calls this for the
+    // declarations of a P4Program
+    void parallel_visit(IR::IndexedVector<IR::Node> *vec);
+
+ public:
+    // number of threads to use; 0 for one for each hardware thread
+    unsigned threads = 0;
+    using Transform::preorder;
+    const IR::Node *preorder(IR::IndexedVector<IR::Node> *vec) override;
+};
+
+// A Transform that runs several Transforms in a single traversal.  After the children
+// of a node are transformed, the postorder functions of the passes are called on it,
+// in order, each on the result of the one before, and then again, as long as one of
+// them changes it, so that what one pass exposes the others see at once.  The
+// passes are called in the context of this traversal, and keep the original node
+// the traversal visited, whose type their rewrites preserve.  Only the postorder
+// functions of the passes are called: their preorder functions are not, so a pass
+// may only have preorders that skip work its postorders would redo anyway (as the
+// memo of DoSimplifyControlFlow does), and must be ready to see nodes that the
+// passes before it created.
+class FusedTransform : public Transform {
+    vector<Transform *> passes;
+ public:
+    explicit FusedTransform(std::initializer_list<Transform *> passes);
+    profile_t init_apply(const IR::Node *root) override;
+    using Transform::end_apply;
+    void end_apply() override;
+    using Transform::postorder;
+    const IR::Node *postorder(IR::Node *n) override;
+};
+
 class Backtrack : public virtual Visitor {
  public:
     struct trigger {
@@ -17,6 +17,93 @@ limitations under the License.
 #include "bitvec.h"
 #include "hex.h"
 
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && defined(__linux__)
+// The loops are vectorized by the compiler; a copy of each is built for the processors
+// with AVX2, and the one to use is chosen when the program is loaded.  Other targets,
+// such as AArch64 with NEON, have their vector instructions in the baseline.
+#define BITVEC_KERNEL __attribute__((target_clones("arch=haswell", "default")))
+#else
+#define BITVEC_KERNEL
+#endif
+
+// The changes are accumulated as bits rather than tested word by word, which keeps
+// the loops free of branches
+BITVEC_KERNEL
+bool bitvec::or_words(uintptr_t *dst, const uintptr_t *src, size_t n) {
+    uintptr_t changed = 0;
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t v = dst[i] | src[i];
+        changed |= v ^ dst[i];
+        dst[i] = v; }
+    return changed != 0;
+}
+
+BITVEC_KERNEL
+bool bitvec::and_words(uintptr_t *dst, const uintptr_t *src, size_t n) {
+    uintptr_t changed = 0;
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t v = dst[i] & src[i];
+        changed |= v ^ dst[i];
+        dst[i] = v; }
+    return changed != 0;
+}
+
+BITVEC_KERNEL
+bool bitvec::andnot_words(uintptr_t *dst, const uintptr_t *src, size_t n) {
+    uintptr_t changed = 0;
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t v = dst[i] & ~src[i];
+        changed |= v ^ dst[i];
+        dst[i] = v; }
+    return changed != 0;
+}
+
+BITVEC_KERNEL
+void bitvec::xor_words(uintptr_t *dst, const uintptr_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] ^= src[i];
+}
+
+BITVEC_KERNEL
+bool bitvec::or_andnot_words(uintptr_t *dst, const uintptr_t *a, const uintptr_t *b,
+                             size_t n) {
+    uintptr_t changed = 0;
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t v = dst[i] | (a[i] & ~b[i]);
+        changed |= v ^ dst[i];
+        dst[i] = v; }
+    return changed != 0;
+}
+
+BITVEC_KERNEL
+bool bitvec::intersects_words(const uintptr_t *a, const uintptr_t *b, size_t n) {
+    uintptr_t common = 0;
+    for (size_t i = 0; i < n; i++)
+        common |= a[i] & b[i];
+    return common != 0;
+}
+
+BITVEC_KERNEL
+bool bitvec::contains_words(const uintptr_t *a, const uintptr_t *b, size_t n) {
+    uintptr_t missing = 0;
+    for (size_t i = 0; i < n; i++)
+        missing |= b[i] & ~a[i];
+    return missing == 0;
+}
+
+BITVEC_KERNEL
+int bitvec::popcount_words(const uintptr_t *a, size_t n) {
+    int rv = 0;
+    for (size_t i = 0; i < n; i++)
+#if defined(__GNUC__) || defined(__clang__)
+        rv += builtin_popcount(a[i]);
+#else
+        for (auto v = a[i]; v; v &= v-1)
+            ++rv;
+#endif
+    return rv;
+}
+
 std::ostream &operator<<(std::ostream &os, const bitvec &bv) {
     if (bv.size == 1) {
         os << hex(bv.data);
@@ -88,9 +175,9 @@ bitvec bitvec::getslice(size_t idx, size_t sz) const {
         if (sz > bits_per_unit) {
             rv.expand((sz-1)/bits_per_unit + 1);
             for (size_t i = 0; i < rv.size; i++) {
-                if (shift != 0 && i != 0)
-                    rv.ptr[i-1] |= ptr[idx + 1] << (bits_per_unit - shift);
-                rv.ptr[i] = ptr[idx] >> shift; }
+                rv.ptr[i] = word(idx + i) >> shift;
+                if (shift != 0)
+                    rv.ptr[i] |= word(idx + i + 1) << (bits_per_unit - shift); }
             if ((sz %= bits_per_unit))
                 rv.ptr[rv.size-1] &= ~(~(uintptr_t)1 << (sz-1));
         } else {
@@ -103,6 +190,34 @@ bitvec bitvec::getslice(size_t idx, size_t sz) const {
         return bitvec((data >> idx) & ~(~(uintptr_t)1 << (sz-1))); }
 }
 
+bool bitvec::or_shifted(const bitvec &a, size_t shift) {
+    if (a.empty()) return false;
+    size_t top = a.max().index();
+    size_t words = top/bits_per_unit + 1;
+    size_t needsize = (top + shift)/bits_per_unit + 1;
+    if (needsize > size) expand(needsize);
+    if (size == 1) {
+        uintptr_t old = data;
+        data |= a.word(0) << shift;
+        return data != old; }
+    size_t off = shift / bits_per_unit;
+    shift %= bits_per_unit;
+    if (shift == 0 && words > 1)
+        return or_words(ptr + off, a.ptr, words);
+    bool rv = false;
+    for (size_t i = 0; i < words; i++) {
+        uintptr_t w = a.word(i) << shift;
+        if (shift != 0 && i > 0)
+            w |= a.word(i-1) >> (bits_per_unit - shift);
+        rv |= (ptr[off + i] | w) != ptr[off + i];
+        ptr[off + i] |= w; }
+    if (shift != 0 && off + words < size) {
+        uintptr_t w = a.word(words-1) >> (bits_per_unit - shift);
+        rv |= (ptr[off + words] | w) != ptr[off + words];
+        ptr[off + words] |= w; }
+    return rv;
+}
+
 int bitvec::ffs(unsigned start) const {
     uintptr_t val = ~0ULL;
     unsigned idx = start / bits_per_unit;
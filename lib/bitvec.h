@@ -63,6 +63,20 @@ class bitvec {
     };
     uintptr_t word(size_t i) const { return i < size ? size > 1 ? ptr[i] : data : 0; }
 
+    // The loops of the bulk operations on two vectors of more than one word, in
+    // bitvec.cpp, where they are built for each instruction set that speeds them up
+    // and the one for the processor is chosen at run time.  They tell whether they
+    // changed 'dst'.
+    static bool or_words(uintptr_t *dst, const uintptr_t *src, size_t n);
+    static bool and_words(uintptr_t *dst, const uintptr_t *src, size_t n);
+    static bool andnot_words(uintptr_t *dst, const uintptr_t *src, size_t n);
+    static void xor_words(uintptr_t *dst, const uintptr_t *src, size_t n);
+    static bool or_andnot_words(uintptr_t *dst, const uintptr_t *a, const uintptr_t *b,
+                                size_t n);
+    static bool intersects_words(const uintptr_t *a, const uintptr_t *b, size_t n);
+    static bool contains_words(const uintptr_t *a, const uintptr_t *b, size_t n);
+    static int popcount_words(const uintptr_t *a, size_t n);
+
  public:
     static constexpr size_t bits_per_unit = CHAR_BIT * sizeof(uintptr_t);
 
@@ -169,6 +183,11 @@ class bitvec {
     void clear() {
         if (size > 1) memset(ptr, 0, size * sizeof(*ptr));
         else data = 0; }  // NOLINT(whitespace/newline)
+    // Makes room for bits [0, bits), so that setting them or a union with a vector of
+    // that size does not reallocate; the value is unchanged
+    void reserve(size_t bits) {
+        if (bits > size * bits_per_unit) expand(1 + (bits-1)/bits_per_unit); }
+    size_t capacity() const { return size * bits_per_unit; }
     bool setbit(size_t idx) {
         if (idx >= size * bits_per_unit) expand(1 + idx/bits_per_unit);
         if (size > 1)
@@ -246,6 +265,8 @@ class bitvec {
         } else {
             return (data >> idx) & ~(~(uintptr_t)1 << (sz-1)); }}
     bitvec getslice(size_t idx, size_t sz) const;
+    // *this |= a << shift, without building the shifted copy
+    bool or_shifted(const bitvec &a, size_t shift);
     nonconst_bitref operator[](int idx) { return nonconst_bitref(*this, idx); }
     bool operator[](int idx) const { return getbit(idx); }
     int ffs(unsigned start = 0) const;
@@ -268,9 +289,7 @@ class bitvec {
         bool rv = false;
         if (size > 1) {
             if (a.size > 1) {
-                for (size_t i = 0; i < size && i < a.size; i++) {
-                    rv |= ((ptr[i] & a.ptr[i]) != ptr[i]);
-                    ptr[i] &= a.ptr[i]; }
+                rv = and_words(ptr, a.ptr, size < a.size ? size : a.size);
             } else {
                 rv |= ((*ptr & a.data) != *ptr);
                 *ptr &= a.data; }
@@ -296,9 +315,7 @@ class bitvec {
         if (size < a.size) expand(a.size);
         if (size > 1) {
             if (a.size > 1) {
-                for (size_t i = 0; i < a.size; i++) {
-                    rv |= ((ptr[i] | a.ptr[i]) != ptr[i]);
-                    ptr[i] |= a.ptr[i]; }
+                rv = or_words(ptr, a.ptr, a.size);
             } else {
                 rv |= ((*ptr | a.data) != *ptr);
                 *ptr |= a.data; }
@@ -320,7 +337,7 @@ class bitvec {
         if (size < a.size) expand(a.size);
         if (size > 1) {
             if (a.size > 1) {
-                for (size_t i = 0; i < a.size; i++) ptr[i] ^= a.ptr[i];
+                xor_words(ptr, a.ptr, a.size);
             } else {
                 *ptr ^= a.data; }
         } else {
@@ -332,9 +349,7 @@ class bitvec {
         bool rv = false;
         if (size > 1) {
             if (a.size > 1) {
-                for (size_t i = 0; i < size && i < a.size; i++) {
-                    rv |= ((ptr[i] & ~a.ptr[i]) != ptr[i]);
-                    ptr[i] &= ~a.ptr[i]; }
+                rv = andnot_words(ptr, a.ptr, size < a.size ? size : a.size);
             } else {
                 rv |= ((*ptr & ~a.data) != *ptr);
                 *ptr &= ~a.data; }
@@ -347,16 +362,46 @@ class bitvec {
         return rv; }
     bitvec operator-(const bitvec &a) const {
         bitvec rv(*this); rv -= a; return rv; }
+    // *this |= a - b, without making a - b, as in the transfer function of a dataflow
+    // analysis (out = gen | (in - kill)); true if it changed
+    bool or_andnot(const bitvec &a, const bitvec &b) {
+        if (size < a.size) expand(a.size);
+        if (size > 1 && a.size > 1 && b.size > 1) {
+            size_t n = a.size < b.size ? a.size : b.size;
+            bool rv = or_andnot_words(ptr, a.ptr, b.ptr, n);
+            if (n < a.size && or_words(ptr + n, a.ptr + n, a.size - n))
+                rv = true;
+            return rv; }
+        uintptr_t *dst = size > 1 ? ptr : &data;
+        uintptr_t changed = 0;
+        for (size_t i = 0; i < a.size; i++) {
+            uintptr_t v = dst[i] | (a.word(i) & ~b.word(i));
+            changed |= v ^ dst[i];
+            dst[i] = v; }
+        return changed != 0; }
     bool operator==(const bitvec &a) const {
+        if (size > 1 && a.size > 1) {
+            size_t n = size < a.size ? size : a.size;
+            if (memcmp(ptr, a.ptr, n * sizeof(*ptr)) != 0) return false;
+            for (size_t i = n; i < size || i < a.size; i++)
+                if (word(i) != a.word(i)) return false;
+            return true; }
         for (size_t i = 0; i < size || i < a.size; i++)
             if (word(i) != a.word(i)) return false;
         return true; }
     bool operator!=(const bitvec &a) const { return !(*this == a); }
     bool intersects(const bitvec &a) const {
+        if (size > 1 && a.size > 1)
+            return intersects_words(ptr, a.ptr, size < a.size ? size : a.size);
         for (size_t i = 0; i < size && i < a.size; i++)
             if (word(i) & a.word(i)) return true;
         return false; }
     bool contains(const bitvec &a) const {  // is 'a' a subset or equal to 'this'?
+        if (size > 1 && a.size > 1) {
+            if (!contains_words(ptr, a.ptr, size < a.size ? size : a.size)) return false;
+            for (size_t i = size; i < a.size; i++)
+                if (a.ptr[i]) return false;
+            return true; }
         for (size_t i = 0; i < size && i < a.size; i++)
             if ((word(i) & a.word(i)) != a.word(i)) return false;
         for (size_t i = size; i < a.size; i++)
@@ -367,6 +412,7 @@ class bitvec {
     bitvec operator>>(size_t count) const { bitvec rv(*this); rv >>= count; return rv; }
     bitvec operator<<(size_t count) const { bitvec rv(*this); rv <<= count; return rv; }
     int popcount() const {
+        if (size > 1) return popcount_words(ptr, size);
         int rv = 0;
         for (size_t i = 0; i < size; i++)
 #if defined(__GNUC__) || defined(__clang__)
@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include <config.h>
+#include <cxxabi.h>
 #include <errno.h>
 #if HAVE_EXECINFO_H
 #include <execinfo.h>
@@ -22,13 +23,21 @@ limitations under the License.
 #include <fcntl.h>
 #include <limits.h>
 #include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 #if HAVE_UCONTEXT_H
 #include <ucontext.h>
 #endif
 #include <unistd.h>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
 #include "exceptions.h"
 #include "hex.h"
 #include "log.h"
@@ -44,17 +53,20 @@ char *program_name;
 
 #ifdef MULTITHREAD
 #include <pthread.h>
-std::vector<pthread_t *>        thread_ids;
-__thread        int             my_id;
+#include <mutex>
+std::vector<pthread_t>          thread_ids;
+__thread        int             my_id = -1;     // in thread_ids, once registered
 
 void register_thread() {
     static std::mutex           lock;
     std::lock_guard<std::mutex> acquire(lock);
+    if (my_id >= 0) return;
     my_id = thread_ids.size();
     thread_ids.push_back(pthread_self());
 }
 #define MTONLY(...)     __VA_ARGS__
 #else
+void register_thread() {}
 #define MTONLY(...)
 #endif  // MULTITHREAD
 
@@ -191,8 +203,8 @@ static void crash_shutdown(int sig, siginfo_t *info, void *uctxt) {
         lock.lock();
         if (!killed_all_threads) {
             killed_all_threads = true;
-            for (int i = 0; i < num_threads; i++)
-                if (i != my_id-1) {
+            for (int i = 0; i < static_cast<int>(thread_ids.size()); i++)
+                if (i != my_id) {
                     pthread_kill(thread_ids[i], SIGABRT); } } )
     LOG1(MTONLY("Thread #" << my_id << " " <<) "exiting with SIG" <<
           signames[sig] << ", trace:");
@@ -217,7 +229,7 @@ static void crash_shutdown(int sig, siginfo_t *info, void *uctxt) {
         free(strings); }
 #endif
     MTONLY(
-        if (++threads_dumped < num_threads) {
+        if (++threads_dumped < static_cast<int>(thread_ids.size())) {
             lock.unlock();
             pthread_exit(0);
         } else {
@@ -228,6 +240,7 @@ static void crash_shutdown(int sig, siginfo_t *info, void *uctxt) {
 }
 
 void setup_signals() {
+    register_thread();
     struct sigaction    sigact;
     sigact.sa_sigaction = sigint_shutdown;
     sigact.sa_flags = SA_SIGINFO;
@@ -245,3 +258,157 @@ void setup_signals() {
     sigaction(SIGTRAP, &sigact, 0);
     signal(SIGPIPE, SIG_IGN);
 }
+
+// The sampling profiler.  The signal handler only copies the stack of passes of its
+// thread into a buffer allocated up front; the functions are found when the samples
+// are written.
+static const int sample_depth = 16;   // passes kept in a sample, the outermost ones
+struct Sample {
+    void        *pc;
+    int         depth;
+    const char  *passes[sample_depth];
+};
+static Sample *samples = nullptr;
+static const size_t max_samples = 1 << 18;   // over 4 minutes of CPU time
+static std::atomic<size_t> sample_count(0);
+static MTONLY(__thread) const char *pass_stack[sample_depth];
+static MTONLY(__thread) int pass_depth = 0;
+
+void sampling_push(const char *pass) {
+    if (pass_depth < sample_depth)
+        pass_stack[pass_depth] = pass;
+    // a signal must not see the new depth before the name
+    std::atomic_signal_fence(std::memory_order_release);
+    ++pass_depth;
+}
+
+void sampling_pop() {
+    --pass_depth;
+}
+
+static void *interrupted_pc(void *uctxt) {
+#if HAVE_UCONTEXT_H && defined(REG_RIP)
+    return reinterpret_cast<void *>(
+        static_cast<ucontext_t *>(uctxt)->uc_mcontext.gregs[REG_RIP]);
+#elif HAVE_UCONTEXT_H && defined(REG_EIP)
+    return reinterpret_cast<void *>(
+        static_cast<ucontext_t *>(uctxt)->uc_mcontext.gregs[REG_EIP]);
+#elif HAVE_UCONTEXT_H && defined(__linux__) && defined(__aarch64__)
+    return reinterpret_cast<void *>(static_cast<ucontext_t *>(uctxt)->uc_mcontext.pc);
+#else
+    (void)uctxt;
+    return nullptr;
+#endif
+}
+
+static void take_sample(int, siginfo_t *, void *uctxt) {
+    size_t index = sample_count++;
+    if (index >= max_samples)
+        return;
+    Sample &sample = samples[index];
+    sample.pc = interrupted_pc(uctxt);
+    sample.depth = pass_depth < sample_depth ? pass_depth : sample_depth;
+    for (int i = 0; i < sample.depth; ++i)
+        sample.passes[i] = pass_stack[i];
+}
+
+void start_sampling() {
+    if (samples) return;
+    // not collected: only the handler refers to them
+    samples = static_cast<Sample *>(malloc(max_samples * sizeof(Sample)));
+    if (!samples) return;
+    struct sigaction    sigact;
+    sigact.sa_sigaction = take_sample;
+    sigact.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sigact.sa_mask);
+    sigaction(SIGPROF, &sigact, 0);
+    struct itimerval    timer;
+    timer.it_interval.tv_sec = timer.it_value.tv_sec = 0;
+    timer.it_interval.tv_usec = timer.it_value.tv_usec = 1000;
+    setitimer(ITIMER_PROF, &timer, 0);
+}
+
+static std::string demangle(const char *name) {
+    int status = -1;
+    char *readable = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    std::string rv = status == 0 && readable ? readable : name;
+    free(readable);
+    // ';' separates the frames of a collapsed stack
+    for (auto &c : rv)
+        if (c == ';') c = ',';
+    return rv;
+}
+
+// The names of the functions at 'pcs': from the dynamic symbols if they have one, or
+// else from addr2line, run once for each binary
+static std::map<void *, std::string> function_names(const std::set<void *> &pcs) {
+    std::map<void *, std::string> names;
+    for (auto pc : pcs)
+        names[pc] = "?";
+#if HAVE_EXECINFO_H
+    std::map<std::string, std::vector<std::pair<void *, std::string>>> unnamed;
+    for (auto pc : pcs) {
+        if (!pc) continue;
+        char **text = backtrace_symbols(&pc, 1);
+        if (!text) continue;
+        // binary(symbol+offset) [address], where the symbol or all of it may be missing
+        std::string line = text[0];
+        free(text);
+        auto open = line.find('('), plus = line.find('+', open), close = line.find(')', open);
+        if (open == std::string::npos || close == std::string::npos) continue;
+        std::string binary = line.substr(0, open);
+        if (plus != std::string::npos && plus < close && plus > open + 1) {
+            names[pc] = demangle(line.substr(open + 1, plus - open - 1).c_str());
+        } else if (plus == open + 1) {
+            // the offset in a position independent binary
+            unnamed[binary].emplace_back(pc, line.substr(plus + 1, close - plus - 1));
+        } else {
+            char address[32];
+            snprintf(address, sizeof(address), "%p", pc);
+            unnamed[binary].emplace_back(pc, address); } }
+    for (auto &binary : unnamed) {
+        std::string command = "addr2line -f -C -e '" + binary.first + "'";
+        for (auto &pc : binary.second)
+            command += " " + pc.second;
+        FILE *pipe = popen(command.c_str(), "r");
+        if (!pipe) continue;
+        char line[4096];
+        // a line with the function, and one with the source position, for each address
+        for (auto &pc : binary.second) {
+            if (!fgets(line, sizeof(line), pipe)) break;
+            line[strcspn(line, "\n")] = 0;
+            if (strcmp(line, "??") != 0)
+                names[pc.first] = demangle(line);
+            if (!fgets(line, sizeof(line), pipe)) break; }
+        pclose(pipe); }
+#endif
+    return names;
+}
+
+void write_samples(std::ostream &out) {
+    struct itimerval    timer = {};
+    setitimer(ITIMER_PROF, &timer, 0);
+    if (!samples) return;
+    size_t count = std::min(sample_count.load(), max_samples);
+    if (sample_count > max_samples)
+        std::cerr << "Sampling stopped after " << max_samples << " samples" << std::endl;
+    std::set<void *> pcs;
+    for (size_t i = 0; i < count; ++i)
+        pcs.insert(samples[i].pc);
+    auto functions = function_names(pcs);
+    std::map<const char *, std::string> pass_names;
+    std::map<std::string, size_t> stacks;
+    for (size_t i = 0; i < count; ++i) {
+        auto &sample = samples[i];
+        std::string stack;
+        for (int j = 0; j < sample.depth; ++j) {
+            auto &name = pass_names[sample.passes[j]];
+            if (name.empty())
+                name = demangle(sample.passes[j]);  // a typeid name, if not set
+            stack += name + ";"; }
+        if (sample.depth == 0)
+            stack = "(no pass);";
+        ++stacks[stack + functions[sample.pc]]; }
+    for (auto &stack : stacks)
+        out << stack.first << ' ' << stack.second << std::endl;
+}
@@ -17,6 +17,23 @@ limitations under the License.
 #ifndef _LIB_CRASH_H_
 #define _LIB_CRASH_H_
 
+#include <ostream>
+
 void setup_signals();
+// Built with MULTITHREAD, a crash stops the other threads that registered, each of
+// which logs its trace; setup_signals registers the thread that calls it
+void register_thread();
+
+// A sampling profiler of the compiler itself.  Once started, a SIGPROF after each
+// millisecond of CPU time records the function that was running and the passes that
+// were running it, which the visitors push and pop as they start and end; so the
+// cost is that of the signals, far below 1% of the time.  write_samples stops it,
+// and writes each stack of passes and the function, outermost first and separated by
+// ';', with the number of samples that hit it: the collapsed stacks that flame graph
+// tools take.
+void start_sampling();
+void sampling_push(const char *pass);
+void sampling_pop();
+void write_samples(std::ostream &out);
 
 #endif /* _LIB_CRASH_H_ */
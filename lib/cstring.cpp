@@ -15,30 +15,156 @@ limitations under the License.
 */
 
 #include "cstring.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <new>
 #include <string>
-#include <unordered_set>
 
-static std::unordered_set<std::string> *cache = nullptr;
+#ifdef MULTITHREAD
+#include <mutex>
+#endif  // MULTITHREAD
+
+// The intern table.  String bytes are bump-allocated in large arena pages,
+// each preceded by a cstring::header_t, so a string is never copied or freed
+// once it is interned.  The table is an open-addressing hash set of
+// (hash, pointer) pairs, so probing and growing never touch the characters
+// of strings that do not match.  All memory is obtained with malloc rather
+// than the garbage collector, as nothing in here is ever released and the
+// string bytes contain no pointers that need to be scanned.
+//
+// The table is split into independent shards selected by the high bits of
+// the hash, each with its own arena and (when built with MULTITHREAD) its own
+// lock, so threads interning different strings rarely contend.
+class cstring_intern_table {
+    typedef cstring::header_t header_t;
+    static const size_t PAGE_SIZE = 32*1024;
+    static const size_t ALIGN = alignof(header_t);
+    static const int SHARD_BITS = 5;
+    static const int SHARDS = 1 << SHARD_BITS;
+
+    class shard {
+        struct slot_t {
+            size_t          hash;
+            const char      *str;
+        };
+        slot_t      *slots = nullptr;
+        size_t      capacity = 0;   // always a power of 2
+        size_t      count = 0;
+        char        *page_ptr = nullptr, *page_end = nullptr;
+        size_t      arena_bytes = 0;
+#ifdef MULTITHREAD
+        mutable std::mutex      lock;
+#endif  // MULTITHREAD
+
+        const char *store(const char *p, size_t len, size_t hash) {
+            size_t need = (sizeof(header_t) + len + 1 + ALIGN - 1) & ~(ALIGN - 1);
+            char *mem;
+            if (need > PAGE_SIZE/4) {
+                // big strings get their own allocation, so as not to waste the current page
+                mem = static_cast<char *>(malloc(need));
+            } else {
+                if (static_cast<size_t>(page_end - page_ptr) < need) {
+                    page_ptr = static_cast<char *>(malloc(PAGE_SIZE));
+                    page_end = page_ptr ? page_ptr + PAGE_SIZE : nullptr; }
+                mem = page_ptr;
+                page_ptr += need; }
+            if (!mem) throw std::bad_alloc();
+            arena_bytes += need;
+            header_t *hdr = reinterpret_cast<header_t *>(mem);
+            hdr->length = len;
+            hdr->hash = hash;
+            char *rv = reinterpret_cast<char *>(hdr + 1);
+            memcpy(rv, p, len);
+            rv[len] = 0;
+            return rv; }
+
+        void grow() {
+            size_t newcap = capacity ? capacity * 2 : 256;
+            slot_t *newslots = static_cast<slot_t *>(calloc(newcap, sizeof(slot_t)));
+            if (!newslots) throw std::bad_alloc();
+            for (size_t i = 0; i < capacity; ++i) {
+                if (!slots[i].str) continue;
+                size_t j = slots[i].hash & (newcap - 1);
+                while (newslots[j].str) j = (j + 1) & (newcap - 1);
+                newslots[j] = slots[i]; }
+            free(slots);
+            slots = newslots;
+            capacity = newcap; }
+
+     public:
+        // The interned copy of the string, added if 'add' or else nullptr if there is none
+        const char *intern(const char *p, size_t len, size_t hash, bool add) {
+#ifdef MULTITHREAD
+            std::lock_guard<std::mutex> acquire(lock);
+#endif  // MULTITHREAD
+            if (!add && count == 0) return nullptr;
+            if (add && (count + 1) * 4 > capacity * 3) grow();
+            size_t i = hash & (capacity - 1);
+            while (const char *s = slots[i].str) {
+                if (slots[i].hash == hash && cstring::header(s)->length == len &&
+                    memcmp(s, p, len) == 0)
+                    return s;
+                i = (i + 1) & (capacity - 1); }
+            if (!add) return nullptr;
+            slots[i].hash = hash;
+            slots[i].str = store(p, len, hash);
+            ++count;
+            return slots[i].str; }
+
+        void stats(size_t &strings, size_t &bytes) const {
+#ifdef MULTITHREAD
+            std::lock_guard<std::mutex> acquire(lock);
+#endif  // MULTITHREAD
+            strings += count;
+            bytes += arena_bytes + capacity * sizeof(slot_t); }
+    };
+    shard       shards[SHARDS];
+
+    static size_t hash_bytes(const char *p, size_t len) {
+        // FNV-1a
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < len; ++i) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 1099511628211ULL; }
+        return static_cast<size_t>(h ^ (h >> 32)); }
+
+ public:
+    const char *intern(const char *p, size_t len, bool add = true) {
+        size_t hash = hash_bytes(p, len);
+        // slots within a shard are indexed by the low bits, so use the high ones here
+        int idx = (hash >> (sizeof(size_t) * 8 - SHARD_BITS)) & (SHARDS - 1);
+        return shards[idx].intern(p, len, hash, add); }
+
+    size_t size(size_t &count) const {
+        size_t bytes = sizeof(*this);
+        count = 0;
+        for (auto &s : shards)
+            s.stats(count, bytes);
+        return bytes; }
+
+    static cstring_intern_table &get() {
+        // initialized on first use, as cstrings are created by static constructors;
+        // function-local statics are initialized thread-safely
+        static cstring_intern_table *table = new cstring_intern_table();
+        return *table; }
+};
 
 cstring &cstring::operator=(const char *p) {
-    if (cache == nullptr)
-        cache = new std::unordered_set<std::string>();
-    str = p ? cache->emplace(p).first->c_str() : 0;
+    str = p ? cstring_intern_table::get().intern(p, strlen(p)) : 0;
     return *this;
 }
 
-size_t cstring::cache_size(size_t &count) {
-    size_t rv = 0;
-    if (cache) {
-        count = cache->size();
-        for (auto &s : *cache)
-            rv += sizeof(s) + s.size();
-    } else {
-        count = 0;
-    }
+cstring cstring::existing(const char *p, size_t len) {
+    cstring rv;
+    rv.str = cstring_intern_table::get().intern(p, len, false);
     return rv;
 }
 
+size_t cstring::cache_size(size_t &count) {
+    return cstring_intern_table::get().size(count);
+}
+
 cstring cstring::newline = cstring("\n");
 cstring cstring::empty = cstring("");
 
@@ -59,14 +185,13 @@ cstring cstring::before(const char* at) const {
 
 cstring cstring::substr(size_t start, size_t length) const {
     if (size() <= start) return cstring::empty;
-    std::string s = str;
-    return s.substr(start, length);
+    return std::string(str + start, std::min(length, size() - start));
 }
 
 cstring cstring::replace(char c, char with) const {
-    char* dup = strdup(c_str());
-    for (char* p = dup; *p; ++p)
-        if (*p == c)
-            *p = with;
-    return cstring(dup);
+    std::string s(str, size());
+    for (auto &p : s)
+        if (p == c)
+            p = with;
+    return s;
 }
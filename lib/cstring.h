@@ -22,11 +22,23 @@ limitations under the License.
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <type_traits>
 
 // cstring is a zero-terminated, constant (immutable) string
+// All cstrings are interned in a global table; the characters are stored in
+// arena pages, preceded by a header holding the length and hash of the string,
+// so size() and hash() are constant time.
 class cstring {
     const char *str;
 
+    struct header_t {
+        size_t  length;
+        size_t  hash;
+    };
+    static const header_t *header(const char *s) {
+        return reinterpret_cast<const header_t *>(s) - 1; }
+    friend class cstring_intern_table;
+
  public:
     // cstring() = default;
     cstring() : str(0) {}
@@ -42,7 +54,8 @@ class cstring {
     const char *find(int c) const { return str ? strchr(str, c) : nullptr; }
     const char *findlast(int c) const { return str ? strrchr(str, c) : str; }
     operator const char *() const { return str; }
-    size_t size() const { return str ? strlen(str) : 0; }
+    size_t size() const { return str ? header(str)->length : 0; }
+    size_t hash() const { return str ? header(str)->hash : 0; }
     bool isNull() const { return str == nullptr; }
     bool isNullOrEmpty() const { return str == nullptr ? true : str[0] == 0; }
     bool operator==(const cstring &a) const { return str == a.str; }
@@ -91,9 +104,46 @@ class cstring {
     { return (start >= size()) ? "" : substr(start, size() - start); }
     cstring substr(size_t start, size_t length) const;
     cstring replace(char find, char replace) const;
+    // The cstring with these characters if one was made, or else a null cstring: as
+    // no set or map of cstrings can hold a string never interned, a name can be
+    // checked against one without adding it to the table.
+    static cstring existing(const char *p, size_t len);
     static size_t cache_size(size_t &);
 };
 
+// Builds a string out of parts without interning them, as cstring::operator+= and
+// each cstring made of a part would; only the result is interned, by str().  So a
+// name made of a prefix and a field adds just the name to the table, and not every
+// prefix on the way.
+class cstring_builder {
+    std::string buf;
+
+ public:
+    cstring_builder() = default;
+    explicit cstring_builder(cstring s) { *this += s; }
+    cstring_builder &operator+=(cstring a) {
+        if (a) buf.append(a.c_str(), a.size());
+        return *this; }
+    cstring_builder &operator+=(const char *a) {
+        if (a) buf += a;
+        return *this; }
+    cstring_builder &operator+=(const std::string &a) { buf += a; return *this; }
+    cstring_builder &operator+=(char a) { buf += a; return *this; }
+    template<class T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, char>::value,
+                            cstring_builder &>::type
+    operator+=(T a) { buf += std::to_string(a); return *this; }
+
+    size_t size() const { return buf.size(); }
+    bool empty() const { return buf.empty(); }
+    // Drops the parts added since the string had this size, to build another string
+    // with the same prefix
+    void truncate(size_t size) { buf.resize(size); }
+    const std::string &string() const { return buf; }
+    cstring str() const { return buf; }
+    cstring existing() const { return cstring::existing(buf.data(), buf.size()); }
+};
+
 inline bool operator==(const char *a, cstring b) { return b == a; }
 inline bool operator!=(const char *a, cstring b) { return b != a; }
 
@@ -121,13 +171,17 @@ inline std::string operator+=(std::string a, cstring b) {
     return a; }
 
 template<class T> cstring cstring::make_unique(const T &inuse, cstring base, char sep) {
-    char suffix[8];
-    cstring rv = base;
-    int counter = 0;
-    while (inuse.count(rv)) {
-        snprintf(suffix, sizeof(suffix)/sizeof(suffix[0]), "%c%d", sep, counter++);
-        rv = base + suffix; }
-    return rv; }
+    if (!inuse.count(base))
+        return base;
+    cstring_builder name(base);
+    name += sep;
+    size_t prefix = name.size();
+    for (int counter = 0; ; ++counter) {
+        name.truncate(prefix);
+        name += counter;
+        cstring rv = name.existing();
+        if (!rv || !inuse.count(rv))
+            return rv ? rv : name.str(); } }
 
 inline std::ostream &operator<<(std::ostream &out, cstring s) {
     return out << (s ? s.c_str() : "<null>"); }
@@ -135,8 +189,8 @@ inline std::ostream &operator<<(std::ostream &out, cstring s) {
 namespace std {
 template<> struct hash<cstring> {
     std::size_t operator()(const cstring& c) const {
-        // This implementation is good for cstring, since the strings are internalized
-        return hash<const char*>()(c.c_str());
+        // The hash is precomputed when the string is interned
+        return c.hash();
     }
 };
 }  // namespace std
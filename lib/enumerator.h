@@ -25,6 +25,10 @@ limitations under the License.
 #include <stdexcept>
 #include <functional>
 #include <cstdint>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include "lib/cstring.h"
 #include "lib/default.h"
 
@@ -97,7 +101,8 @@ class Enumerator {
     static Enumerator<T>* createEnumerator(const std::list<T> &data);
     static Enumerator<T>* emptyEnumerator();  // empty data
     template <typename Iter>
-    static Enumerator<typename Iter::value_type>* createEnumerator(Iter begin, Iter end);
+    static Enumerator<typename std::iterator_traits<Iter>::value_type>*
+    createEnumerator(Iter begin, Iter end);
     // concatenate all these collections into a single one
     static Enumerator<T>* concatAll(Enumerator<Enumerator<T>*>* inputs);
 
@@ -134,16 +139,16 @@ class Enumerator {
    C is the container type */
 
 template <typename Iter>
-class GenericEnumerator : public Enumerator<typename Iter::value_type> {
+class GenericEnumerator : public Enumerator<typename std::iterator_traits<Iter>::value_type> {
  protected:
     Iter begin;
     Iter end;
     Iter current;
     cstring name;
-    friend class Enumerator<typename Iter::value_type>;
+    friend class Enumerator<typename std::iterator_traits<Iter>::value_type>;
 
     GenericEnumerator(Iter begin, Iter end, cstring name)
-            : Enumerator<typename Iter::value_type>(),
+            : Enumerator<typename std::iterator_traits<Iter>::value_type>(),
             begin(begin), end(end), current(begin), name(name) {}
 
  public:
@@ -176,7 +181,7 @@ class GenericEnumerator : public Enumerator<typename Iter::value_type> {
         throw new std::runtime_error("Unexpected enumerator state");
     }
 
-    typename Iter::value_type getCurrent() const {
+    typename std::iterator_traits<Iter>::value_type getCurrent() const {
         switch (this->state) {
             case EnumeratorState::NotStarted:
                 throw std::logic_error("You cannot call 'getCurrent' before 'moveNext'");
@@ -485,7 +490,8 @@ Enumerator<T>* Enumerator<T>::createEnumerator(const std::list<T> &data) {
 
 template <typename T>
 template <typename Iter>
-Enumerator<typename Iter::value_type>* Enumerator<T>::createEnumerator(Iter begin, Iter end) {
+Enumerator<typename std::iterator_traits<Iter>::value_type>*
+Enumerator<T>::createEnumerator(Iter begin, Iter end) {
     return new GenericEnumerator<Iter>(begin, end, "iterator");
 }
 
@@ -562,5 +568,186 @@ bool EnumeratorHandle<T>::operator != (const EnumeratorHandle<T>& other) const {
     return this->enumerator->state == EnumeratorState::Valid;
 }
 
+///////////////////////////////// lazy ranges ///////////////////
+
+/* The counterparts of where/map/as/concat for a pair of iterators, which build nothing on
+   the heap and make no virtual or std::function calls: each stage is an iterator template
+   holding the one below it, so the compiler fuses the stages into one loop.
+     for (auto m : enumerate(*methods).where(isAbstract).map(getName)) ...
+   The functions given to them may be called more than once on an element, so they must not
+   have side effects.  toEnumerator() wraps a range for the interfaces that return an
+   Enumerator. */
+
+namespace Detail {
+// Lambdas cannot be assigned, which the iterators that hold them must be
+template<class F> class FnHolder {
+    union { F fn; };
+
+ public:
+    explicit FnHolder(const F &f) : fn(f) {}
+    FnHolder(const FnHolder &a) : fn(a.fn) {}
+    FnHolder &operator=(const FnHolder &a) {
+        if (this != &a) {
+            fn.~F();
+            new(&fn) F(a.fn); }
+        return *this; }
+    ~FnHolder() { fn.~F(); }
+    template<class A> auto operator()(A &&a) const -> decltype(fn(std::forward<A>(a))) {
+        return fn(std::forward<A>(a)); }
+};
+}  // namespace Detail
+
+/* the elements of Iter for which pred is true */
+template<class Iter, class Pred>
+class FilterIterator {
+    Iter cur, fin;
+    Detail::FnHolder<Pred> pred;
+    void skip() { while (cur != fin && !pred(*cur)) ++cur; }
+
+ public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename std::iterator_traits<Iter>::value_type value_type;
+    typedef typename std::iterator_traits<Iter>::difference_type difference_type;
+    typedef typename std::iterator_traits<Iter>::pointer pointer;
+    typedef typename std::iterator_traits<Iter>::reference reference;
+
+    FilterIterator(Iter cur, Iter fin, Pred pred) : cur(cur), fin(fin), pred(pred) { skip(); }
+    reference operator*() const { return *cur; }
+    FilterIterator &operator++() { ++cur; skip(); return *this; }
+    bool operator==(const FilterIterator &a) const { return cur == a.cur; }
+    bool operator!=(const FilterIterator &a) const { return cur != a.cur; }
+};
+
+/* the results of fn on the elements of Iter */
+template<class Iter, class Fn>
+class MapIterator {
+    Iter cur;
+    Detail::FnHolder<Fn> fn;
+
+ public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename std::decay<decltype(std::declval<const Fn &>()(
+        *std::declval<Iter>()))>::type value_type;
+    typedef typename std::iterator_traits<Iter>::difference_type difference_type;
+    typedef const value_type *pointer;
+    typedef value_type reference;
+
+    MapIterator(Iter cur, Fn fn) : cur(cur), fn(fn) {}
+    value_type operator*() const { return fn(*cur); }
+    MapIterator &operator++() { ++cur; return *this; }
+    bool operator==(const MapIterator &a) const { return cur == a.cur; }
+    bool operator!=(const MapIterator &a) const { return cur != a.cur; }
+};
+
+/* the elements of Iter, cast to S */
+template<class Iter, class S>
+class AsIterator {
+    Iter cur;
+
+ public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef S value_type;
+    typedef typename std::iterator_traits<Iter>::difference_type difference_type;
+    typedef const S *pointer;
+    typedef S reference;
+
+    explicit AsIterator(Iter cur) : cur(cur) {}
+    S operator*() const { return dynamic_cast<S>(*cur); }
+    AsIterator &operator++() { ++cur; return *this; }
+    bool operator==(const AsIterator &a) const { return cur == a.cur; }
+    bool operator!=(const AsIterator &a) const { return cur != a.cur; }
+};
+
+/* the elements of Iter1, then those of Iter2 */
+template<class Iter1, class Iter2>
+class ConcatIterator {
+    Iter1 first, firstEnd;
+    Iter2 second;
+
+ public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename std::iterator_traits<Iter1>::value_type value_type;
+    typedef typename std::iterator_traits<Iter1>::difference_type difference_type;
+    typedef const value_type *pointer;
+    typedef value_type reference;
+
+    ConcatIterator(Iter1 first, Iter1 firstEnd, Iter2 second)
+            : first(first), firstEnd(firstEnd), second(second) {}
+    value_type operator*() const { return first != firstEnd ? *first : *second; }
+    ConcatIterator &operator++() {
+        if (first != firstEnd)
+            ++first;
+        else
+            ++second;
+        return *this; }
+    bool operator==(const ConcatIterator &a) const {
+        return first == a.first && second == a.second; }
+    bool operator!=(const ConcatIterator &a) const { return !(*this == a); }
+};
+
+template<class Iter>
+class IterRange {
+    Iter b, e;
+
+ public:
+    typedef typename std::iterator_traits<Iter>::value_type value_type;
+
+    IterRange(Iter b, Iter e) : b(b), e(e) {}
+    Iter begin() const { return b; }
+    Iter end() const { return e; }
+
+    template<class Pred>
+    IterRange<FilterIterator<Iter, Pred>> where(Pred pred) const {
+        return IterRange<FilterIterator<Iter, Pred>>(FilterIterator<Iter, Pred>(b, e, pred),
+                                                     FilterIterator<Iter, Pred>(e, e, pred)); }
+    template<class Fn>
+    IterRange<MapIterator<Iter, Fn>> map(Fn fn) const {
+        return IterRange<MapIterator<Iter, Fn>>(MapIterator<Iter, Fn>(b, fn),
+                                                MapIterator<Iter, Fn>(e, fn)); }
+    template<class S>
+    IterRange<AsIterator<Iter, S>> as() const {
+        return IterRange<AsIterator<Iter, S>>(AsIterator<Iter, S>(b), AsIterator<Iter, S>(e)); }
+    template<class Iter2>
+    IterRange<ConcatIterator<Iter, Iter2>> concat(const IterRange<Iter2> &other) const {
+        return IterRange<ConcatIterator<Iter, Iter2>>(
+            ConcatIterator<Iter, Iter2>(b, e, other.begin()),
+            ConcatIterator<Iter, Iter2>(e, e, other.end())); }
+
+    uint64_t count() const {
+        uint64_t found = 0;
+        for (auto it = b; it != e; ++it)
+            found++;
+        return found; }
+    bool any() const { return b != e; }
+    // The only element; throws if the range does not have exactly 1 element
+    value_type single() const {
+        auto it = b;
+        if (it == e)
+            throw std::logic_error("There is no element for `single()'");
+        value_type result = *it;
+        if (++it != e)
+            throw std::logic_error("There are multiple elements when calling `single()'");
+        return result; }
+    // First element, or the default value if none exists
+    value_type nextOrDefault() const {
+        if (b == e)
+            return Util::Default<value_type>();
+        return *b; }
+    std::vector<value_type> toVector() const {
+        std::vector<value_type> result;
+        for (auto it = b; it != e; ++it)
+            result.push_back(*it);
+        return result; }
+    Enumerator<value_type>* toEnumerator() const {
+        return Enumerator<value_type>::createEnumerator(b, e); }
+};
+
+template<class Iter>
+IterRange<Iter> enumerate(Iter begin, Iter end) { return IterRange<Iter>(begin, end); }
+
+template<class C>
+auto enumerate(const C &c) -> IterRange<decltype(c.begin())> {
+    return IterRange<decltype(c.begin())>(c.begin(), c.end()); }
+
 }  // namespace Util
 #endif  /* P4C_LIB_ENUMERATOR_H_ */
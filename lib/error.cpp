@@ -16,5 +16,9 @@ limitations under the License.
 
 #include "error.h"
 
+#ifdef MULTITHREAD
+thread_local ErrorReporter ErrorReporter::instance;
+#else
 ErrorReporter ErrorReporter::instance;
+#endif  // MULTITHREAD
 
@@ -21,7 +21,17 @@ limitations under the License.
 
 #include <stdarg.h>
 #include <boost/format.hpp>
+#include <functional>
+#ifdef MULTITHREAD
+#include <atomic>
+#include <mutex>
+#endif  // MULTITHREAD
+#include <sstream>
+#include <string>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "lib/source_file.h"
 #include "lib/stringify.h"
@@ -347,30 +357,153 @@ auto bug_helper(boost::format& f, std::string message, std::string position,
 
 /***********************************************************************************/
 
+// The arguments of a warning are kept until it is formatted, so C strings, which
+// may be temporaries, are copied
+template <typename T> inline T deferred_arg(T arg) { return arg; }
+static inline cstring deferred_arg(const char* arg) { return cstring(arg); }
+static inline cstring deferred_arg(char* arg) { return cstring(arg); }
+
+/***********************************************************************************/
+
 // Keeps track of compilation errors.
 // Singleton pattern.
 // Errors are specified using the error() and warning() methods,
 // that use boost::format format strings, i.e.,
 // %1%, %2%, etc (starting at 1, not at 0).
 // Some compatibility for printf-style arguments is also supported.
+//
+// When built with MULTITHREAD there is an instance for each thread, so that threads
+// can compile programs of their own; a thread that helps with the compilation of
+// another thread reports to that thread's instance (see reportTo).  Each task of a
+// parallel group keeps its messages in a Buffer, and they are reported in the order
+// the tasks were spawned when the group finishes, so that the output does not depend
+// on the threads; the counts are atomic, so that any thread may read them.
+//
+// Warnings are only formatted when they are written out, which is when an error or
+// a parser error is reported, when many are waiting, or on flush(); so the nodes
+// they refer to should not be changed in the meantime.  A limit on the warnings of
+// each kind (format) that are shown, and dropping repeated ones, saves formatting
+// the thousands that some programs produce.
 class ErrorReporter final {
  public:
+#ifdef MULTITHREAD
+    static thread_local ErrorReporter instance;
+#else
     static ErrorReporter instance;
+#endif  // MULTITHREAD
+
+    // The messages reported on a thread while it buffers them (see bufferTo), in
+    // order, until they are merged into an instance
+    class Buffer {
+        friend class ErrorReporter;
+        struct Message {
+            std::string text;                      // of an error
+            std::string kind;                      // of a warning: its format
+            std::function<std::string()> warning;  // or nullptr for an error
+        };
+        std::vector<Message> messages;
+        unsigned errors = 0, warnings = 0;
+
+     public:
+        bool empty() const { return messages.empty(); }
+    };
 
  private:
+#ifdef MULTITHREAD
+    typedef std::atomic<unsigned> Counter;
+#else
+    typedef unsigned Counter;
+#endif  // MULTITHREAD
+
     std::ostream* outputstream;
+    ErrorReporter* target = nullptr;  // where the messages go instead, if any
+    Buffer* buffer = nullptr;         // where they are kept instead, if any
 
     ErrorReporter()
         : errorCount(0),
           warningCount(0)
     { outputstream = &std::cerr; }
+    ~ErrorReporter() { flush(); }
+
+    // warnings waiting to be formatted
+    std::vector<std::function<std::string()>> pending;
+    static constexpr size_t flushThreshold = 1000;
+    // 0 for no limit on the warnings shown of each kind
+    unsigned warningLimit = 0;
+    std::unordered_map<std::string, unsigned> kindCount;
+    unsigned suppressed = 0;  // since the last flush
+    bool deduplicate = false;
+    std::unordered_set<std::string> shown;  // when deduplicating
 
  private:
     void emit_message(cstring message) {
         *outputstream << message;
+    }
+    void report(cstring message) {
+        if (buffer) {
+            buffer->messages.push_back(Buffer::Message{ message.c_str(), "", nullptr });
+            buffer->errors++;
+            return;
+        }
+        if (target) {
+            target->report(message);
+            return;
+        }
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> guard(lock);
+#endif  // MULTITHREAD
+        errorCount++;
+        flushPending();
+        emit_message(message);
         outputstream->flush();
     }
 
+    void addWarning(const std::string& kind, std::function<std::string()> message) {
+        if (buffer) {
+            buffer->messages.push_back(Buffer::Message{ "", kind, message });
+            buffer->warnings++;
+            return;
+        }
+        if (target) {
+            target->addWarning(kind, message);
+            return;
+        }
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> guard(lock);
+#endif  // MULTITHREAD
+        warningCount++;
+        if (warningLimit != 0 && ++kindCount[kind] > warningLimit) {
+            suppressed++;
+            return;
+        }
+        pending.push_back(message);
+        if (pending.size() >= flushThreshold)
+            flushPending();
+    }
+
+    template <typename... T>
+    static std::function<std::string()> deferWarning(std::string format, T... args) {
+        return [format, args...]() {
+            boost::format fmt(format);
+            return ::error_helper(fmt, "warning: ", "", "", args...);
+        };
+    }
+
+    // Writes out the warnings waiting; with the lock held
+    void flushPending() {
+        for (auto& message : pending) {
+            std::string text = message();
+            if (deduplicate && !shown.insert(text).second)
+                continue;
+            *outputstream << text;
+        }
+        pending.clear();
+        if (suppressed > 0)
+            *outputstream << "warning: " << suppressed
+                          << " more warnings of kinds already shown were not printed\n";
+        suppressed = 0;
+    }
+
  public:
     // error message for a bug
     template <typename... T>
@@ -389,26 +522,78 @@ class ErrorReporter final {
 
     template <typename... T>
     void error(const char* format, T... args) {
-        errorCount++;
         boost::format fmt(format);
         std::string message = ::error_helper(fmt, "error: ", "", "", args...);
-        emit_message(message);
+        report(message);
     }
 
     template <typename... T>
     void warning(const char* format, T... args) {
-        warningCount++;
-        boost::format fmt(format);
-        std::string message = ::error_helper(fmt, "warning: ", "", "", args...);
-        emit_message(message);
+        addWarning(format, deferWarning(format, deferred_arg(args)...));
     }
 
+    // Writes out the warnings that have not been yet
+    void flush() {
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> guard(lock);
+#endif  // MULTITHREAD
+        flushPending();
+        outputstream->flush();
+    }
+
+    // Shows at most 'limit' warnings with the same format, or all with 0
+    void setWarningLimit(unsigned limit) { warningLimit = limit; }
+    // Shows a warning only once if it is reported several times
+    void setDeduplicate(bool value) { deduplicate = value; }
+
+    // Those kept in the buffer of this thread too, but not those that the thread of
+    // the target, if any, keeps in its own
     unsigned getErrorCount() const {
-        return errorCount;
+        return (buffer ? buffer->errors : 0) + (target ? target->errorCount : errorCount);
     }
 
     unsigned getWarningCount() const {
-        return warningCount;
+        return (buffer ? buffer->warnings : 0) +
+                (target ? target->warningCount : warningCount);
+    }
+
+    // Sends the messages of this thread to 'reporter' (the instance of another thread)
+    // and counts them there, or with nullptr, here again
+    void reportTo(ErrorReporter* reporter) {
+        target = reporter == this ? nullptr : reporter;
+    }
+
+    // Keeps the messages of this thread in 'messages' from now on, or with nullptr
+    // reports them again; returns the buffer used until now
+    Buffer* bufferTo(Buffer* messages) {
+        auto previous = buffer;
+        buffer = messages;
+        return previous;
+    }
+
+    // Reports the messages kept in 'messages', in order, as they would have been then,
+    // and empties it
+    void merge(Buffer& messages) {
+        for (auto& message : messages.messages) {
+            if (message.warning)
+                addWarning(message.kind, message.warning);
+            else
+                report(message.text);
+        }
+        messages.messages.clear();
+        messages.errors = messages.warnings = 0;
+    }
+
+    // Forgets the errors and warnings counted so far, and the settings of the
+    // warnings, before another compilation
+    void reset() {
+        flush();
+        errorCount = 0;
+        warningCount = 0;
+        warningLimit = 0;
+        kindCount.clear();
+        deduplicate = false;
+        shown.clear();
     }
 
     // Special error functions to be called from the parser only.
@@ -422,25 +607,40 @@ class ErrorReporter final {
         va_end(args);
     }
 
+    // The warnings not written yet go to the previous stream
     void setOutputStream(std::ostream* stream)
-    { outputstream = stream; }
+    { flush(); outputstream = stream; }
 
     void parser_error(const char* fmt, va_list args) {
-        errorCount++;
+        parser_error(Util::InputSources::instance->getCurrentPosition(), fmt, args);
+    }
+
+    // The same, for a parser that reads text already in the InputSources, which is at
+    // 'current' in it
+    void parser_error(Util::SourcePosition current, const char *fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        parser_error(current, fmt, args);
+        va_end(args);
+    }
 
-        Util::SourcePosition position = Util::InputSources::instance->getCurrentPosition();
+    void parser_error(Util::SourcePosition current, const char* fmt, va_list args) {
+        Util::SourcePosition position = current;
         position--;
         Util::SourceFileLine fileError =
                 Util::InputSources::instance->getSourceLine(position.getLineNumber());
         cstring msg = Util::vprintf_format(fmt, args);
-        *outputstream << fileError.toString() << ":" << msg << std::endl;
         cstring sourceFragment = Util::InputSources::instance->getSourceFragment(position);
-        emit_message(sourceFragment);
+        report(fileError.toString() + ":" + msg + "\n" + sourceFragment);
     }
 
  private:
-    unsigned errorCount;
-    unsigned warningCount;
+    Counter errorCount;
+    Counter warningCount;
+#ifdef MULTITHREAD
+    // errors may be reported by passes that visit parts of the program in parallel
+    std::mutex lock;
+#endif  // MULTITHREAD
 };
 
 // Errors (and warnings) are specified using boost::format format strings, i.e.,
@@ -453,6 +653,21 @@ inline void error(const char* format, T... args) {
 
 inline unsigned errorCount() { return ErrorReporter::instance.getErrorCount(); }
 
+// While it is alive, the messages reported to the ErrorReporter of this thread are
+// dropped, and after it the counts are back to what they were; for work that is done
+// again in another way if it reports any
+class DropMessages {
+    ErrorReporter& reporter = ErrorReporter::instance;
+    ErrorReporter::Buffer dropped;
+    ErrorReporter::Buffer* previous;
+
+ public:
+    DropMessages() : previous(reporter.bufferTo(&dropped)) {}
+    ~DropMessages() { reporter.bufferTo(previous); }
+    // Whether any message was reported so far
+    bool reported() const { return !dropped.empty(); }
+};
+
 template <typename... T>
 inline void warning(const char* format, T... args) {
     ErrorReporter::instance.warning(format, args...);
@@ -0,0 +1,106 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef P4C_LIB_FLAT_PTR_MAP_H_
+#define P4C_LIB_FLAT_PTR_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// Hash map from pointers to small values, stored in a single array with open
+// addressing and linear probing.  Unlike unordered_map, inserting does no
+// allocation except when the table grows, and clear() is constant time and keeps
+// the storage, so the table can be reused.  The null pointer cannot be a key.
+// Pointers to values remain valid only until the next insertion.
+template <class K, class V>
+class flat_ptr_map {
+    struct slot_t {
+        K               key;
+        V               value;
+        unsigned        epoch;      // slot is empty unless this matches 'epoch'
+    };
+    std::vector<slot_t> slots;      // size is 0 or a power of 2
+    size_t              count = 0;
+    unsigned            epoch = 1;
+
+    size_t home(K key) const {
+        // Fibonacci hashing; the low bits of a pointer are mostly alignment
+        uint64_t h = reinterpret_cast<uintptr_t>(key) * 0x9e3779b97f4a7c15ULL;
+        return (h >> 32) & (slots.size() - 1); }
+    slot_t *lookup(K key) const {
+        size_t mask = slots.size() - 1;
+        for (size_t i = home(key);; i = (i + 1) & mask) {
+            auto *s = const_cast<slot_t *>(&slots[i]);
+            if (s->epoch != epoch || s->key == key)
+                return s; } }
+    void insert(const slot_t &slot) {
+        auto *s = lookup(slot.key);
+        *s = slot;
+        s->epoch = epoch; }
+    void grow() {
+        std::vector<slot_t> old(slots.size() ? slots.size() * 2 : 64, slot_t{nullptr, V(), 0});
+        old.swap(slots);
+        for (auto &s : old)
+            if (s.epoch == epoch) insert(s); }
+
+ public:
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    // Removes all entries, but keeps the storage for reuse.
+    void clear() {
+        count = 0;
+        if (++epoch == 0) {
+            for (auto &s : slots) s.epoch = 0;
+            epoch = 1; } }
+
+    V *find(K key) {
+        if (!count) return nullptr;
+        auto *s = lookup(key);
+        return s->epoch == epoch ? &s->value : nullptr; }
+    const V *find(K key) const { return const_cast<flat_ptr_map *>(this)->find(key); }
+
+    // Like unordered_map::emplace: a pointer to the value and whether it was inserted.
+    std::pair<V *, bool> emplace(K key, const V &value) {
+        if ((count + 1) * 4 > slots.size() * 3)
+            grow();
+        auto *s = lookup(key);
+        if (s->epoch == epoch)
+            return std::make_pair(&s->value, false);
+        *s = slot_t{key, value, epoch};
+        ++count;
+        return std::make_pair(&s->value, true); }
+
+    // Calls f(key, value) for each entry, in no particular order.
+    template <class F> void for_each(F f) const {
+        for (auto &s : slots)
+            if (s.epoch == epoch) f(s.key, s.value); }
+
+    // Removes all entries for which pred(key, value) is true, in one pass.
+    template <class PRED> void erase_if(PRED pred) {
+        std::vector<slot_t> keep;
+        for (auto &s : slots)
+            if (s.epoch == epoch && !pred(s.key, s.value))
+                keep.push_back(s);
+        if (keep.size() == count) return;
+        clear();
+        count = keep.size();
+        for (auto &s : keep)
+            insert(s); }
+};
+
+#endif /* P4C_LIB_FLAT_PTR_MAP_H_ */
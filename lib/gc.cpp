@@ -16,9 +16,17 @@ limitations under the License.
 
 #include "config.h"
 #if HAVE_LIBGC
+#ifdef MULTITHREAD
+#define GC_THREADS
+#endif  /* MULTITHREAD */
 #include <gc/gc_cpp.h>
 #endif  /* HAVE_LIBGC */
+#include <stdio.h>
 #include <new>
+#ifdef MULTITHREAD
+#include <chrono>
+#include <thread>
+#endif  /* MULTITHREAD */
 #include "log.h"
 #include "gc.h"
 #include "cstring.h"
@@ -32,20 +40,26 @@ limitations under the License.
 // One can disable the GC, e.g., to run under Valgrind, by editing config.h
 #if HAVE_LIBGC
 static bool done_init;
+static thread_local size_t thread_bytes_allocated = 0;
+static void init_gc() {
+    GC_INIT();
+#ifdef MULTITHREAD
+    GC_allow_register_threads();
+#endif  /* MULTITHREAD */
+    done_init = true;
+}
 void *operator new(std::size_t size) {
     /* DANGER -- on OSX, can't safely call the garbage collector allocation
      * routines from a static global constructor without manually initializing
      * it first.  Since we have global constructors that want to allocate
      * memory, we need to force initialization */
-    if (!done_init) {
-        GC_INIT();
-        done_init = true; }
+    if (!done_init) init_gc();
+    thread_bytes_allocated += size;
     return ::operator new(size, UseGC, 0, 0);
 }
 void *operator new[](std::size_t size) {
-    if (!done_init) {
-        GC_INIT();
-        done_init = true; }
+    if (!done_init) init_gc();
+    thread_bytes_allocated += size;
     return ::operator new(size, UseGC, 0, 0);
 }
 void operator delete(void *p) _GLIBCXX_USE_NOEXCEPT { return gc::operator delete(p); }
@@ -85,3 +99,82 @@ size_t gc_mem_inuse(size_t *max) {
     return 0;
 #endif
 }
+
+void gc_collect() {
+#if HAVE_LIBGC
+    GC_gcollect_and_unmap();
+#endif
+}
+
+size_t gc_heap_inuse(size_t *max) {
+#if HAVE_LIBGC
+    GC_word heapsize, heapfree;
+    GC_get_heap_usage_safe(&heapsize, &heapfree, 0, 0, 0);
+    if (max) *max = heapsize;
+    return heapsize - heapfree;
+#else
+    if (max) *max = 0;
+    return 0;
+#endif
+}
+
+bool gc_start_heap_sampler(const char *file, unsigned msec) {
+#if HAVE_LIBGC && defined(MULTITHREAD)
+    FILE *out = fopen(file, "w");
+    if (!out) return false;
+    fprintf(out, "# msec heap inuse allocated collections\n");
+    // the thread uses stdio rather than streams, so as not to allocate from the heap
+    // it watches
+    std::thread([out, msec]() {
+        gc_register_thread();
+        auto start = std::chrono::steady_clock::now();
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(msec));
+            GC_word heapsize, heapfree, unmapped, since_gc, allocated;
+            GC_get_heap_usage_safe(&heapsize, &heapfree, &unmapped, &since_gc, &allocated);
+            long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            typedef unsigned long ul;
+            fprintf(out, "%ld %lu %lu %lu %lu\n", elapsed, static_cast<ul>(heapsize),
+                    static_cast<ul>(heapsize - heapfree), static_cast<ul>(allocated),
+                    static_cast<ul>(GC_get_gc_no()));
+            fflush(out); } }).detach();
+    return true;
+#else
+    (void)file;
+    (void)msec;
+    return false;
+#endif
+}
+
+void gc_statistics(gc_statistics_t &stats) {
+#if HAVE_LIBGC
+    stats.bytes_allocated = GC_get_total_bytes();
+    stats.collections = GC_get_gc_no();
+    stats.heap_size = GC_get_heap_size();
+#else
+    stats.bytes_allocated = stats.collections = stats.heap_size = 0;
+#endif
+}
+
+size_t gc_thread_bytes_allocated() {
+#if HAVE_LIBGC
+    return thread_bytes_allocated;
+#else
+    return 0;
+#endif
+}
+
+void gc_register_thread() {
+#if HAVE_LIBGC && defined(MULTITHREAD)
+    struct GC_stack_base sb;
+    if (GC_get_stack_base(&sb) == GC_SUCCESS)
+        GC_register_my_thread(&sb);
+#endif
+}
+
+void gc_unregister_thread() {
+#if HAVE_LIBGC && defined(MULTITHREAD)
+    GC_unregister_my_thread();
+#endif
+}
@@ -19,5 +19,33 @@ limitations under the License.
 
 void setup_gc_logging();
 size_t gc_mem_inuse(size_t *max = 0);  // trigger GC, return inuse after
+// Collects now, and returns the free pages to the system; nothing without the collector
+void gc_collect();
+// In use without a collection, so counting the garbage not yet collected: cheap
+// enough to log after every pass without changing when collections happen
+size_t gc_heap_inuse(size_t *max = 0);
+// Starts a thread that appends a line to 'file' every 'msec' milliseconds of the
+// life of the process, with the time, the heap size, the heap in use (as
+// gc_heap_inuse), the bytes allocated and the collections so far.  False, doing
+// nothing, unless built with MULTITHREAD and the collector, or if the file cannot be
+// written.
+bool gc_start_heap_sampler(const char *file, unsigned msec);
+
+// Cumulative allocation counters, for profiling.  All zero when not using the collector.
+struct gc_statistics_t {
+    size_t bytes_allocated;     // total allocated since startup
+    size_t collections;         // number of collections done
+    size_t heap_size;           // current heap size (including free space)
+};
+void gc_statistics(gc_statistics_t &stats);
+// Total allocated by the calling thread, so that what a compilation on a thread of its
+// own allocates can be told apart from the others.  Zero when not using the collector.
+size_t gc_thread_bytes_allocated();
+
+// Threads other than the main thread must be registered with the collector
+// before they allocate memory, and unregistered before they exit.  These do
+// nothing unless built with MULTITHREAD.
+void gc_register_thread();
+void gc_unregister_thread();
 
 #endif /* LIB_GC_H_ */
@@ -14,6 +14,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <string.h>
 #include <stdexcept>
 #include "gmputil.h"
 
@@ -93,4 +94,61 @@ mpz_class cvtInt(const char *s, unsigned base) {
     return rv;
 }
 
+// Writes the digits of 'value' backwards from 'end'; returns where they start
+static char *formatDigits(char *end, unsigned long value, unsigned base) {
+    static const char digitChars[] = "0123456789abcdef";
+    char *p = end;
+    do {
+        *--p = digitChars[value % base];
+        value /= base;
+    } while (value);
+    return p;
+}
+
+void appendDecimal(std::string &out, unsigned long value) {
+    char buf[24];
+    char *start = formatDigits(buf + sizeof(buf), value, 10);
+    out.append(start, buf + sizeof(buf) - start);
+}
+
+void appendDecimal(std::string &out, long value) {
+    if (value < 0)
+        out += '-';
+    appendDecimal(out, value < 0 ? 0UL - static_cast<unsigned long>(value)
+                                 : static_cast<unsigned long>(value));
+}
+
+void appendDecimal(std::string &out, const mpz_class &value) {
+    if (value.fits_slong_p())
+        return appendDecimal(out, value.get_si());
+    size_t at = out.size();
+    out.resize(at + mpz_sizeinbase(value.get_mpz_t(), 10) + 2);
+    mpz_get_str(&out[at], 10, value.get_mpz_t());
+    out.resize(at + strlen(&out[at]));
+}
+
+void appendHex(std::string &out, const mpz_class &value, unsigned digits) {
+    bool negative = sgn(value) < 0;
+    out += negative ? "-0x" : "0x";
+    if (negative ? value.fits_slong_p() : value.fits_ulong_p()) {
+        unsigned long abs = value.get_ui();  // the absolute value, whatever the sign
+        char buf[24];
+        char *start = formatDigits(buf + sizeof(buf), abs, 16);
+        size_t length = buf + sizeof(buf) - start;
+        if (length < digits)
+            out.append(digits - length, '0');
+        out.append(start, length);
+        return; }
+    mpz_class abs;
+    mpz_abs(abs.get_mpz_t(), value.get_mpz_t());
+    // exact for a power of 2 base
+    size_t length = mpz_sizeinbase(abs.get_mpz_t(), 16);
+    if (length < digits)
+        out.append(digits - length, '0');
+    size_t at = out.size();
+    out.resize(at + length + 1);
+    mpz_get_str(&out[at], 16, abs.get_mpz_t());
+    out.resize(at + length);
+}
+
 }  // namespace Util
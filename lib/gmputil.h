@@ -19,6 +19,7 @@ limitations under the License.
 
 #include <cstddef>  // needed because of a bug in gcc-4.9/libgmp
 #include <gmpxx.h>  // NOLINT: cstddef HAS to come first
+#include <string>
 
 namespace Util {
 
@@ -42,6 +43,14 @@ mpz_class shift_right(const mpz_class &v, unsigned bits);
 // Convert a slice [m:l] into a mask
 mpz_class maskFromSlice(unsigned m, unsigned l);
 mpz_class mask(unsigned bits);
+
+// Append a value to the output being built, in decimal or as [-]0x and at least
+// 'digits' hexadecimal digits.  Values that fit in 64 bits, as nearly all in the
+// output of a compiler do, are formatted without GMP or snprintf.
+void appendDecimal(std::string &out, long value);
+void appendDecimal(std::string &out, unsigned long value);
+void appendDecimal(std::string &out, const mpz_class &value);
+void appendHex(std::string &out, const mpz_class &value, unsigned digits = 0);
 }  // namespace Util
 
 #endif /* _LIB_GMPUTIL_H_ */
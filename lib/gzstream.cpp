@@ -0,0 +1,65 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "gzstream.h"
+
+#if HAVE_LIBZ
+#include <zlib.h>
+
+gzstreambuf::gzstreambuf(cstring name, bool write) {
+    file = gzopen(name.c_str(), write ? "wb" : "rb");
+    if (write)
+        setp(buffer, buffer + sizeof(buffer));
+    else
+        setg(buffer, buffer, buffer);
+}
+
+gzstreambuf::~gzstreambuf() {
+    if (file == nullptr)
+        return;
+    sync();
+    gzclose(static_cast<gzFile>(file));
+}
+
+int gzstreambuf::sync() {
+    if (file == nullptr)
+        return -1;
+    int size = pptr() - pbase();
+    if (size > 0 && gzwrite(static_cast<gzFile>(file), pbase(), size) != size)
+        return -1;
+    setp(buffer, buffer + sizeof(buffer));
+    return 0;
+}
+
+gzstreambuf::int_type gzstreambuf::overflow(int_type c) {
+    if (sync() != 0)
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+        sputc(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+}
+
+gzstreambuf::int_type gzstreambuf::underflow() {
+    if (file == nullptr)
+        return traits_type::eof();
+    int size = gzread(static_cast<gzFile>(file), buffer, sizeof(buffer));
+    if (size <= 0)
+        return traits_type::eof();
+    setg(buffer, buffer, buffer + size);
+    return traits_type::to_int_type(buffer[0]);
+}
+
+#endif  /* HAVE_LIBZ */
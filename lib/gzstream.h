@@ -0,0 +1,60 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef P4C_LIB_GZSTREAM_H_
+#define P4C_LIB_GZSTREAM_H_
+
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include "config.h"
+#include "cstring.h"
+
+#if HAVE_LIBZ
+
+// Streams of a gzip file, through a buffer of their own, so that writing a character
+// does not call into zlib; the file is complete once the stream is destroyed
+class gzstreambuf final : public std::streambuf {
+    void *file;  // a gzFile
+    char buffer[1 << 16];
+
+    int sync() override;
+    int_type overflow(int_type c) override;
+    int_type underflow() override;
+
+ public:
+    gzstreambuf(cstring name, bool write);
+    ~gzstreambuf();
+    bool good() const { return file != nullptr; }
+};
+
+class ogzstream final : public std::ostream {
+    gzstreambuf buf;
+ public:
+    explicit ogzstream(cstring name) : std::ostream(&buf), buf(name, true) {
+        if (!buf.good()) setstate(std::ios::badbit); }
+};
+
+class igzstream final : public std::istream {
+    gzstreambuf buf;
+ public:
+    explicit igzstream(cstring name) : std::istream(&buf), buf(name, false) {
+        if (!buf.good()) setstate(std::ios::badbit); }
+};
+
+#endif  /* HAVE_LIBZ */
+
+#endif /* P4C_LIB_GZSTREAM_H_ */
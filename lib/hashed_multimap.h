@@ -0,0 +1,164 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef LIB_HASHED_MULTIMAP_H_
+#define LIB_HASHED_MULTIMAP_H_
+
+#include <stddef.h>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+// Multimap that finds keys through a hash table, and iterates in a deterministic
+// order: the keys in the order they were first inserted, each followed by all its
+// elements in the order they were inserted.  So, as in a std::multimap, the elements
+// with a key follow the one that find() returns.  Iterators stay valid until their
+// element is erased.
+// It takes the template parameters of std::multimap so that it can be the MAP of an
+// IR::NameMap; COMP and ALLOC are not used, and keys are hashed with std::hash, which
+// for a cstring is computed when the string is interned.
+template <class K, class V, class COMP = std::less<K>,
+          class ALLOC = std::allocator<std::pair<const K, V>>>
+class hashed_multimap {
+ public:
+    typedef K                           key_type;
+    typedef V                           mapped_type;
+    typedef std::pair<const K, V>       value_type;
+    typedef value_type                  &reference;
+    typedef const value_type            &const_reference;
+    typedef size_t                      size_type;
+
+ private:
+    typedef std::list<value_type>       list_t;
+    list_t                              data;       // in iteration order
+
+ public:
+    typedef typename list_t::iterator                   iterator;
+    typedef typename list_t::const_iterator             const_iterator;
+    typedef typename list_t::reverse_iterator           reverse_iterator;
+    typedef typename list_t::const_reverse_iterator     const_reverse_iterator;
+
+ private:
+    struct group {
+        iterator        first;
+        size_t          count;
+    };
+    std::unordered_map<K, group>        index;      // the elements with each key
+
+    void reindex() {
+        index.clear();
+        for (auto it = data.begin(); it != data.end(); ++it) {
+            auto g = index.find(it->first);
+            if (g == index.end())
+                index.emplace(it->first, group{ it, 1 });
+            else
+                ++g->second.count; } }
+
+ public:
+    hashed_multimap() {}
+    hashed_multimap(const hashed_multimap &a) : data(a.data) { reindex(); }
+    // moving a list keeps its iterators valid
+    hashed_multimap(hashed_multimap &&a) = default;
+    hashed_multimap &operator=(const hashed_multimap &a) {
+        if (this != &a) {
+            // a list of pairs with const keys cannot be assigned element by element
+            data = list_t(a.data);
+            reindex(); }
+        return *this; }
+    hashed_multimap &operator=(hashed_multimap &&a) = default;
+    hashed_multimap(const std::initializer_list<value_type> &il) { insert(il.begin(), il.end()); }
+
+    iterator                    begin() noexcept { return data.begin(); }
+    const_iterator              begin() const noexcept { return data.begin(); }
+    iterator                    end() noexcept { return data.end(); }
+    const_iterator              end() const noexcept { return data.end(); }
+    reverse_iterator            rbegin() noexcept { return data.rbegin(); }
+    const_reverse_iterator      rbegin() const noexcept { return data.rbegin(); }
+    reverse_iterator            rend() noexcept { return data.rend(); }
+    const_reverse_iterator      rend() const noexcept { return data.rend(); }
+
+    bool        empty() const noexcept { return data.empty(); }
+    size_type   size() const noexcept { return data.size(); }
+    bool operator==(const hashed_multimap &a) const { return data == a.data; }
+    bool operator!=(const hashed_multimap &a) const { return data != a.data; }
+    void clear() { data.clear(); index.clear(); }
+
+    iterator find(const key_type &k) {
+        auto g = index.find(k);
+        return g == index.end() ? data.end() : g->second.first; }
+    const_iterator find(const key_type &k) const {
+        auto g = index.find(k);
+        return g == index.end() ? data.end() : const_iterator(g->second.first); }
+    size_type count(const key_type &k) const {
+        auto g = index.find(k);
+        return g == index.end() ? 0 : g->second.count; }
+
+    // The first element with the key, added if there is none
+    V &operator[](const K &k) {
+        auto it = find(k);
+        if (it == end()) it = emplace(k, V());
+        return it->second; }
+    V &at(const K &k) {
+        auto it = find(k);
+        if (it == end()) throw std::out_of_range("hashed_multimap");
+        return it->second; }
+    const V &at(const K &k) const {
+        auto it = find(k);
+        if (it == end()) throw std::out_of_range("hashed_multimap");
+        return it->second; }
+
+    // Adds an element after the others with its key
+    template<typename KK, typename VV> iterator emplace(KK &&k, VV &&v) {
+        value_type elem(std::forward<KK>(k), std::forward<VV>(v));
+        auto g = index.find(elem.first);
+        if (g == index.end()) {
+            auto it = data.insert(data.end(), std::move(elem));
+            index.emplace(it->first, group{ it, 1 });
+            return it; }
+        auto pos = std::next(g->second.first, g->second.count++);
+        return data.insert(pos, std::move(elem)); }
+    iterator insert(const value_type &v) { return emplace(v.first, v.second); }
+    template<class InputIterator> void insert(InputIterator b, InputIterator e) {
+        for (; b != e; ++b)
+            emplace(b->first, b->second); }
+
+    iterator erase(const_iterator pos) {
+        auto g = index.find(pos->first);
+        if (--g->second.count == 0)
+            index.erase(g);
+        else if (g->second.first == pos)
+            ++g->second.first;
+        return data.erase(pos); }
+    iterator erase(const_iterator b, const_iterator e) {
+        while (b != e)
+            b = erase(b);
+        return data.erase(e, e); }
+    size_type erase(const key_type &k) {
+        auto g = index.find(k);
+        if (g == index.end())
+            return 0;
+        size_type rv = g->second.count;
+        auto first = g->second.first;
+        index.erase(g);
+        data.erase(first, std::next(first, rv));
+        return rv; }
+};
+
+#endif /* LIB_HASHED_MULTIMAP_H_ */
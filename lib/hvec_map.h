@@ -0,0 +1,260 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef LIB_HVEC_MAP_H_
+#define LIB_HVEC_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Map that iterates in order of element insertion, like ordered_map, but keeps the
+// elements in one vector and finds them through an open addressing hash index of
+// positions in that vector, which holds only the live elements.  Erasing leaves a
+// tombstone in the vector; tombstones are compacted away when they come to
+// outnumber the live elements.
+// It can replace ordered_map where the key ordering operations (lower_bound,
+// upper_bound, sort) and inserting at a position are not needed, and where no
+// iterators or references are held across an insertion, which may move the
+// elements.  Erasing invalidates only iterators to the erased element.
+template <class K, class V, class HASH = std::hash<K>, class PRED = std::equal_to<K>>
+class hvec_map {
+ public:
+    typedef K                           key_type;
+    typedef V                           mapped_type;
+    typedef std::pair<const K, V>       value_type;
+    typedef HASH                        hasher;
+    typedef PRED                        key_equal;
+    typedef value_type                  &reference;
+    typedef const value_type            &const_reference;
+    typedef size_t                      size_type;
+
+ private:
+    std::vector<value_type>     data;       // in insertion order, including tombstones
+    std::vector<bool>           erased;     // which elements of 'data' are tombstones
+    std::vector<uint32_t>       index;      // 0 or 1 + position in 'data'; size 0 or 2^n
+    size_t                      live = 0;
+    HASH                        hash;
+    PRED                        equal;
+
+    template<class MAP, class VT> class iter {
+        MAP             *map;
+        size_t          pos;
+        friend class hvec_map;
+        template<class, class> friend class iter;
+        iter(MAP *m, size_t p) : map(m), pos(p) { skip(); }
+        void skip() { while (pos < map->data.size() && map->erased[pos]) ++pos; }
+
+     public:
+        typedef std::bidirectional_iterator_tag         iterator_category;
+        typedef typename std::remove_const<VT>::type    value_type;
+        typedef ptrdiff_t                               difference_type;
+        typedef VT                                      *pointer;
+        typedef VT                                      &reference;
+
+        iter() : map(nullptr), pos(0) {}
+        template<class M2, class V2> iter(const iter<M2, V2> &a)  // NOLINT(runtime/explicit)
+        : map(a.map), pos(a.pos) {}
+        reference operator*() const { return map->data[pos]; }
+        pointer operator->() const { return &map->data[pos]; }
+        iter &operator++() { ++pos; skip(); return *this; }
+        iter operator++(int) { iter rv = *this; ++*this; return rv; }
+        iter &operator--() { do { --pos; } while (map->erased[pos]); return *this; }
+        iter operator--(int) { iter rv = *this; --*this; return rv; }
+        template<class M2, class V2> bool operator==(const iter<M2, V2> &a) const {
+            return pos == a.pos; }
+        template<class M2, class V2> bool operator!=(const iter<M2, V2> &a) const {
+            return pos != a.pos; }
+    };
+
+ public:
+    typedef iter<hvec_map, value_type>                  iterator;
+    typedef iter<const hvec_map, const value_type>      const_iterator;
+    typedef std::reverse_iterator<iterator>             reverse_iterator;
+    typedef std::reverse_iterator<const_iterator>       const_reverse_iterator;
+
+ private:
+    size_t home(const K &k) const {
+        // Fibonacci hashing, as std::hash of pointers and integers is the identity
+        uint64_t h = static_cast<uint64_t>(hash(k)) * 0x9e3779b97f4a7c15ULL;
+        return (h >> 32) & (index.size() - 1); }
+    // The index slot holding 'k', or the empty slot where it would go
+    size_t slot(const K &k) const {
+        size_t mask = index.size() - 1;
+        for (size_t i = home(k);; i = (i + 1) & mask) {
+            uint32_t e = index[i];
+            if (!e || equal(data[e - 1].first, k))
+                return i; } }
+    size_t position(const K &k) const {
+        if (!live) return data.size();
+        uint32_t e = index[slot(k)];
+        return e ? e - 1 : data.size(); }
+    void reindex(size_t size) {
+        index.assign(size, 0);
+        for (size_t i = 0; i < data.size(); ++i)
+            if (!erased[i]) index[slot(data[i].first)] = i + 1; }
+    // Makes room to append one element, dropping the tombstones if they outnumber the
+    // live elements, and keeping the index at most half full.
+    void reserve_one() {
+        if (data.size() - live > live) {
+            std::vector<value_type> compact;
+            compact.reserve(live + 1);
+            for (size_t i = 0; i < data.size(); ++i)
+                if (!erased[i]) compact.emplace_back(std::move(data[i]));
+            data.swap(compact);
+            erased.assign(data.size(), false);
+            size_t size = index.size();
+            while (size > 64 && (data.size() + 1) * 4 <= size) size /= 2;
+            reindex(size); }
+        if ((data.size() + 1) * 2 > index.size())
+            reindex(index.empty() ? 64 : index.size() * 2); }
+    template<class KK, class... VV> iterator append(KK &&k, VV &&... v) {
+        reserve_one();
+        size_t s = slot(k);
+        data.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward<KK>(k)),
+                          std::forward_as_tuple(std::forward<VV>(v)...));
+        erased.push_back(false);
+        index[s] = data.size();
+        ++live;
+        return iterator(this, data.size() - 1); }
+
+ public:
+    hvec_map() {}
+    hvec_map(const hvec_map &) = default;
+    hvec_map(hvec_map &&a) { swap(a); }
+    // The elements are const-keyed pairs, which cannot be assigned, so neither can the vector
+    hvec_map &operator=(hvec_map a) { swap(a); return *this; }
+    hvec_map(const std::initializer_list<value_type> &il) { insert(il.begin(), il.end()); }
+    void swap(hvec_map &a) {
+        data.swap(a.data);
+        erased.swap(a.erased);
+        index.swap(a.index);
+        std::swap(live, a.live);
+        std::swap(hash, a.hash);
+        std::swap(equal, a.equal); }
+
+    iterator                    begin() noexcept { return iterator(this, 0); }
+    const_iterator              begin() const noexcept { return const_iterator(this, 0); }
+    iterator                    end() noexcept { return iterator(this, data.size()); }
+    const_iterator              end() const noexcept { return const_iterator(this, data.size()); }
+    reverse_iterator            rbegin() noexcept { return reverse_iterator(end()); }
+    const_reverse_iterator      rbegin() const noexcept { return const_reverse_iterator(end()); }
+    reverse_iterator            rend() noexcept { return reverse_iterator(begin()); }
+    const_reverse_iterator      rend() const noexcept { return const_reverse_iterator(begin()); }
+    const_iterator              cbegin() const noexcept { return begin(); }
+    const_iterator              cend() const noexcept { return end(); }
+    const_reverse_iterator      crbegin() const noexcept { return rbegin(); }
+    const_reverse_iterator      crend() const noexcept { return rend(); }
+
+    bool        empty() const noexcept { return live == 0; }
+    size_type   size() const noexcept { return live; }
+    size_type   max_size() const noexcept { return UINT32_MAX - 1; }
+    bool operator==(const hvec_map &a) const {
+        return live == a.live && std::equal(begin(), end(), a.begin()); }
+    bool operator!=(const hvec_map &a) const { return !(*this == a); }
+    void clear() { data.clear(); erased.clear(); index.clear(); live = 0; }
+
+    iterator        find(const key_type &a) { return iterator(this, position(a)); }
+    const_iterator  find(const key_type &a) const { return const_iterator(this, position(a)); }
+    size_type       count(const key_type &a) const { return position(a) != data.size(); }
+
+    V& operator[](const K &x) {
+        auto it = find(x);
+        if (it == end()) it = append(x);
+        return it->second; }
+    V& operator[](K &&x) {
+        auto it = find(x);
+        if (it == end()) it = append(std::move(x));
+        return it->second; }
+    V& at(const K &x) {
+        auto it = find(x);
+        if (it == end()) throw std::out_of_range("hvec_map");
+        return it->second; }
+    const V& at(const K &x) const {
+        auto it = find(x);
+        if (it == end()) throw std::out_of_range("hvec_map");
+        return it->second; }
+
+    template<typename KK, typename VV>
+    std::pair<iterator, bool> emplace(KK &&k, VV &&v) {
+        auto it = find(k);
+        if (it != end())
+            return std::make_pair(it, false);
+        return std::make_pair(append(std::forward<KK>(k), std::forward<VV>(v)), true); }
+    std::pair<iterator, bool> insert(const value_type &v) {
+        auto it = find(v.first);
+        if (it != end())
+            return std::make_pair(it, false);
+        return std::make_pair(append(v.first, v.second), true); }
+    template<class InputIterator> void insert(InputIterator b, InputIterator e) {
+        while (b != e) insert(*b++); }
+
+    iterator erase(const_iterator pos) {
+        size_t mask = index.size() - 1, s = slot(pos->first);
+        index[s] = 0;
+        // re-place the elements that probed past the slot just emptied
+        for (size_t i = (s + 1) & mask; index[i]; i = (i + 1) & mask) {
+            uint32_t e = index[i];
+            index[i] = 0;
+            index[slot(data[e - 1].first)] = e; }
+        erased[pos.pos] = true;
+        --live;
+        return iterator(this, pos.pos + 1); }
+    size_type erase(const K &k) {
+        auto it = find(k);
+        if (it == end()) return 0;
+        erase(it);
+        return 1; }
+};
+
+template<class K, class T, class V, class Hash, class Pred>
+inline V get(const hvec_map<K, V, Hash, Pred> &m, T key, V def = V()) {
+    auto it = m.find(key);
+    if (it != m.end()) return it->second;
+    return def; }
+
+template<class K, class T, class V, class Hash, class Pred>
+inline V *getref(hvec_map<K, V, Hash, Pred> &m, T key) {
+    auto it = m.find(key);
+    if (it != m.end()) return &it->second;
+    return 0; }
+
+template<class K, class T, class V, class Hash, class Pred>
+inline const V *getref(const hvec_map<K, V, Hash, Pred> &m, T key) {
+    auto it = m.find(key);
+    if (it != m.end()) return &it->second;
+    return 0; }
+
+template<class K, class T, class V, class Hash, class Pred>
+inline V get(const hvec_map<K, V, Hash, Pred> *m, T key, V def = V()) {
+    return m ? get(*m, key, def) : def; }
+
+template<class K, class T, class V, class Hash, class Pred>
+inline V *getref(hvec_map<K, V, Hash, Pred> *m, T key) {
+    return m ? getref(*m, key) : 0; }
+
+template<class K, class T, class V, class Hash, class Pred>
+inline const V *getref(const hvec_map<K, V, Hash, Pred> *m, T key) {
+    return m ? getref(*m, key) : 0; }
+
+#endif /* LIB_HVEC_MAP_H_ */
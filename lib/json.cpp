@@ -14,6 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
 #include <stdexcept>
 #include <sstream>
 #include "json.h"
@@ -21,6 +24,114 @@ limitations under the License.
 
 namespace Util {
 
+constexpr size_t JsonWriter::bufferSize;
+
+JsonWriter::JsonWriter(std::ostream &out, bool compact) : out(out), compact(compact) {
+    buffer.reserve(bufferSize + 4096);
+}
+
+void JsonWriter::flush() {
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void JsonWriter::newline(size_t depth) {
+    buffer += '\n';
+    buffer.append(depth * indent_t::tabsz, ' ');
+}
+
+void JsonWriter::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return; }
+    maybeFlush();
+    if (levels.empty())
+        return;
+    auto &level = levels.back();
+    if (!level.empty) {
+        buffer += ',';
+        if (level.oneLine && !compact)
+            buffer += ' '; }
+    level.empty = false;
+    if (!level.oneLine && !compact)
+        newline(levels.size());
+}
+
+void JsonWriter::beginObject() {
+    separate();
+    buffer += '{';
+    levels.push_back({ false, true });
+}
+
+void JsonWriter::endObject() {
+    levels.pop_back();
+    if (!compact)
+        newline(levels.size());
+    buffer += '}';
+}
+
+void JsonWriter::beginArray(bool oneLine) {
+    separate();
+    buffer += '[';
+    levels.push_back({ oneLine, true });
+}
+
+void JsonWriter::endArray() {
+    bool lineBreak = !levels.back().oneLine && !levels.back().empty;
+    levels.pop_back();
+    if (lineBreak && !compact)
+        newline(levels.size());
+    buffer += ']';
+}
+
+void JsonWriter::key(cstring label) {
+    separate();
+    buffer += '"';
+    if (!label.isNullOrEmpty())
+        buffer.append(label.c_str(), label.size());
+    buffer += compact ? "\":" : "\" : ";
+    afterKey = true;
+}
+
+void JsonWriter::null() {
+    separate();
+    buffer += "null";
+}
+
+void JsonWriter::value(bool b) {
+    separate();
+    buffer += b ? "true" : "false";
+}
+
+void JsonWriter::value(long v) {
+    separate();
+    appendDecimal(buffer, v);
+}
+
+void JsonWriter::value(unsigned long v) {
+    separate();
+    appendDecimal(buffer, v);
+}
+
+void JsonWriter::value(const mpz_class &v) {
+    separate();
+    // converted in place, as bmv2 output is mostly numbers
+    appendDecimal(buffer, v);
+}
+
+void JsonWriter::value(cstring s) {
+    separate();
+    buffer += '"';
+    if (!s.isNullOrEmpty())
+        buffer.append(s.c_str(), s.size());
+    buffer += '"';
+}
+
+void IJson::serialize(std::ostream& out, bool compact) const {
+    JsonWriter writer(out, compact);
+    serialize(writer);
+}
+
 cstring IJson::toString() const {
     std::stringstream str;
     serialize(str);
@@ -29,22 +140,33 @@ cstring IJson::toString() const {
 
 JsonValue* JsonValue::null = new JsonValue();
 
-void JsonValue::serialize(std::ostream& out) const {
+JsonValue::JsonValue(mpz_class v) : IJson(subclassTag), tag(Kind::Number),
+        small(v.fits_slong_p() ? v.get_si() : 0),
+        big(v.fits_slong_p() ? nullptr : new mpz_class(v)) {}
+
+JsonValue::JsonValue(unsigned long v) : IJson(subclassTag), tag(Kind::Number),
+        small(v <= LONG_MAX ? static_cast<long>(v) : 0),
+        big(v <= LONG_MAX ? nullptr : new mpz_class(v)) {}
+
+void JsonValue::serialize(JsonWriter& out) const {
     switch (tag) {
         case Kind::String:
-            out << "\"" << str << "\"";
+            out.value(str);
             break;
         case Kind::Number:
-            out << value;
+            if (big)
+                out.value(*big);
+            else
+                out.value(small);
             break;
         case Kind::True:
-            out << "true";
+            out.value(true);
             break;
         case Kind::False:
-            out << "false";
+            out.value(false);
             break;
         case Kind::Null:
-            out << "null";
+            out.null();
             break;
     }
 }
@@ -52,19 +174,16 @@ void JsonValue::serialize(std::ostream& out) const {
 bool JsonValue::operator==(const bool& b) const
 { return b ? tag == Kind::True : tag == Kind::False; }
 bool JsonValue::operator==(const mpz_class& v) const
-{ return tag == Kind::Number ? v == value : false; }
-bool JsonValue::operator==(const int& v) const
-{ return tag == Kind::Number ? v == value : false; }
-bool JsonValue::operator==(const long& v) const
-{ return tag == Kind::Number ? v == value : false; }
-bool JsonValue::operator==(const unsigned& v) const
-{ return tag == Kind::Number ? v == value : false; }
+{ return tag == Kind::Number ? (big ? v == *big : v == small) : false; }
+bool JsonValue::operator==(const int& v) const { return equals(v); }
+bool JsonValue::operator==(const long& v) const { return equals(v); }
+bool JsonValue::operator==(const unsigned& v) const { return equals(v); }
 bool JsonValue::operator==(const unsigned long& v) const
-{ return tag == Kind::Number ? v == value : false; }
+{ return v <= LONG_MAX ? equals(v) : tag == Kind::Number && big && v == *big; }
 bool JsonValue::operator==(const double& v) const
-{ return tag == Kind::Number ? v == value : false; }
+{ return tag == Kind::Number ? v == getValue() : false; }
 bool JsonValue::operator==(const float& v) const
-{ return tag == Kind::Number ? v == value : false; }
+{ return tag == Kind::Number ? v == getValue() : false; }
 bool JsonValue::operator==(const cstring& s) const
 { return tag == Kind::String ? s == str : false; }
 bool JsonValue::operator==(const std::string& s) const
@@ -77,7 +196,8 @@ bool JsonValue::operator==(const JsonValue& other) const {
         case Kind::String:
             return str == other.str;
         case Kind::Number:
-            return value == other.value;
+            // each number has one representation
+            return big ? other.big && *big == *other.big : !other.big && small == other.small;
         case Kind::True:
         case Kind::False:
         case Kind::Null:
@@ -87,33 +207,20 @@ bool JsonValue::operator==(const JsonValue& other) const {
     }
 }
 
-void JsonArray::serialize(std::ostream& out) const {
+void JsonArray::serialize(JsonWriter& out) const {
     bool isSmall = true;
     for (auto v : *this) {
         if (!v->is<JsonValue>())
             isSmall = false;
     }
-    out << "[";
-    if (!isSmall)
-        out << IndentCtl::indent;
-    bool first = true;
+    out.beginArray(isSmall);
     for (auto v : *this) {
-        if (!first) {
-            out << ",";
-            if (isSmall)
-                out << " ";
-        }
-        if (!isSmall)
-            out << IndentCtl::endl;
         if (v == nullptr)
-            out << "null";
+            out.null();
         else
             v->serialize(out);
-        first = false;
     }
-    if (!isSmall)
-        out << IndentCtl::unindent << IndentCtl::endl;
-    out << "]";
+    out.endArray();
 }
 
 bool JsonValue::getBool() const {
@@ -131,14 +238,15 @@ cstring JsonValue::getString() const {
 mpz_class JsonValue::getValue() const {
     if (!isNumber())
         throw std::logic_error("Incorrect json value kind");
-    return value;
+    return big ? *big : mpz_class(small);
 }
 
 int JsonValue::getInt() const {
-    auto val = getValue();
-    if (!value.fits_sint_p())
+    if (!isNumber())
+        throw std::logic_error("Incorrect json value kind");
+    if (big || small < INT_MIN || small > INT_MAX)
         throw std::logic_error("Value too large for an int");
-    return val.get_si();
+    return small;
 }
 
 JsonArray* JsonArray::append(IJson* value) {
@@ -146,30 +254,23 @@ JsonArray* JsonArray::append(IJson* value) {
     return this;
 }
 
-void JsonObject::serialize(std::ostream& out) const {
-    out << "{" << IndentCtl::indent;
-    bool first = true;
+void JsonObject::serialize(JsonWriter& out) const {
+    out.beginObject();
     for (auto &it : *this) {
-        if (!first)
-            out << ",";
-        first = false;
-        out << IndentCtl::endl;
-        out << "\"" << it.first << "\"" << " : ";
+        out.key(it.first);
         if (it.second == nullptr)
-            out << "null";
+            out.null();
         else
             it.second->serialize(out);
     }
-    out << IndentCtl::unindent << IndentCtl::endl << "}";
+    out.endObject();
 }
 
 JsonObject* JsonObject::emplace(cstring label, IJson* value) {
     if (label.isNullOrEmpty())
         throw std::logic_error("Empty label");
-    auto j = get(label);
-    if (j != nullptr)
+    if (!hvec_map<cstring, IJson*>::emplace(label, value).second)
         throw std::logic_error(cstring("Duplicate label in json object ") + label.c_str());
-    ordered_map<cstring, IJson*>::emplace(label, value);
     return this;
 }
 
@@ -18,30 +18,89 @@ limitations under the License.
 #define _LIB_JSON_H_
 
 #include <iostream>
+#include <string>
 #include <vector>
 #include <stdexcept>
 
 #include "lib/gmputil.h"
 #include "lib/cstring.h"
-#include "lib/ordered_map.h"
+#include "lib/hvec_map.h"
 
 namespace Test { class TestJson; }
 
 namespace Util {
 
+// Writes JSON text to a stream through a large buffer of its own, so that big outputs
+// are not written through the stream a few characters at a time, and can be written
+// as they are produced instead of being built as a tree of IJson first.  Compact
+// output has no whitespace at all; otherwise the layout is the one IJson::serialize
+// has always produced, with each member or element on a line of its own, except for
+// arrays begun as one-line arrays.
+class JsonWriter {
+    std::ostream        &out;
+    std::string         buffer;
+    const bool          compact;
+    struct Level {
+        bool oneLine;   // an array written on one line
+        bool empty;     // nothing has been written into it yet
+    };
+    std::vector<Level>  levels;     // the objects and arrays being written
+    bool                afterKey = false;
+
+    void newline(size_t depth);
+    // what goes before a value or key: a separator and line break as needed
+    void separate();
+    void maybeFlush() { if (buffer.size() >= bufferSize) flush(); }
+
+ public:
+    static constexpr size_t bufferSize = 1 << 20;
+    explicit JsonWriter(std::ostream &out, bool compact = false);
+    ~JsonWriter() { flush(); }
+    // Writes what is buffered to the stream
+    void flush();
+
+    void beginObject();
+    void endObject();
+    // one-line arrays are meant for short arrays of values
+    void beginArray(bool oneLine = false);
+    void endArray();
+    void key(cstring label);
+    void null();
+    void value(bool b);
+    void value(int v) { value(static_cast<long>(v)); }
+    void value(long v);
+    void value(unsigned v) { value(static_cast<unsigned long>(v)); }
+    void value(unsigned long v);
+    void value(const mpz_class &v);
+    void value(cstring s);
+    void value(const char *s) { value(cstring(s)); }
+    template<typename T> void member(cstring label, const T &v) { key(label); value(v); }
+};
+
 class IJson {
  public:
+    // Which of the (final) subclasses this is, so is<T> and to<T> need no RTTI
+    enum class Subclass { Value, Array, Object };
     virtual ~IJson() {}
-    virtual void serialize(std::ostream& out) const = 0;
+    virtual void serialize(JsonWriter& out) const = 0;
+    void serialize(std::ostream& out, bool compact = false) const;
     cstring toString() const;
-    template<typename T> bool is() const { return to<T>() != nullptr; }
-    template<typename T> T* to() { return dynamic_cast<T*>(this); }
-    template<typename T> const T* to() const { return dynamic_cast<const T*>(this); }
+    template<typename T> bool is() const { return subclass == T::subclassTag; }
+    template<typename T> T* to() { return is<T>() ? static_cast<T*>(this) : nullptr; }
+    template<typename T> const T* to() const
+    { return is<T>() ? static_cast<const T*>(this) : nullptr; }
+
+ protected:
+    explicit IJson(Subclass subclass) : subclass(subclass) {}
+
+ private:
+    Subclass subclass;
 };
 
 class JsonValue final : public IJson {
     friend class Test::TestJson;
  public:
+    static constexpr Subclass subclassTag = Subclass::Value;
     enum Kind {
         String,
         Number,
@@ -49,19 +108,20 @@ class JsonValue final : public IJson {
         False,
         Null
     };
-    JsonValue() : tag(Kind::Null) {}
-    JsonValue(bool b) : tag(b ? Kind::True : Kind::False) {}  // NOLINT
-    JsonValue(mpz_class v) : tag(Kind::Number), value(v) {}   // NOLINT
-    JsonValue(int v) : tag(Kind::Number), value(v) {}         // NOLINT
-    JsonValue(long v) : tag(Kind::Number), value(v) {}        // NOLINT
-    JsonValue(unsigned v) : tag(Kind::Number), value(v) {}    // NOLINT
-    JsonValue(unsigned long v) : tag(Kind::Number), value(v) {}// NOLINT
-    JsonValue(double v) : tag(Kind::Number), value(v) {}      // NOLINT
-    JsonValue(float v) : tag(Kind::Number), value(v) {}       // NOLINT
-    JsonValue(cstring s) : tag(Kind::String), str(s) {}       // NOLINT
-    JsonValue(std::string s) : tag(Kind::String), str(s) {}   // NOLINT
-    JsonValue(const char* s) : tag(Kind::String), str(s) {}   // NOLINT
-    void serialize(std::ostream& out) const;
+    JsonValue() : IJson(subclassTag), tag(Kind::Null) {}
+    JsonValue(bool b) : IJson(subclassTag), tag(b ? Kind::True : Kind::False) {}     // NOLINT
+    JsonValue(mpz_class v);                                                          // NOLINT
+    JsonValue(int v) : IJson(subclassTag), tag(Kind::Number), small(v) {}            // NOLINT
+    JsonValue(long v) : IJson(subclassTag), tag(Kind::Number), small(v) {}           // NOLINT
+    JsonValue(unsigned v) : IJson(subclassTag), tag(Kind::Number), small(v) {}       // NOLINT
+    JsonValue(unsigned long v);                                                      // NOLINT
+    JsonValue(double v) : JsonValue(mpz_class(v)) {}                                 // NOLINT
+    JsonValue(float v) : JsonValue(mpz_class(v)) {}                                  // NOLINT
+    JsonValue(cstring s) : IJson(subclassTag), tag(Kind::String), str(s) {}          // NOLINT
+    JsonValue(std::string s) : IJson(subclassTag), tag(Kind::String), str(s) {}      // NOLINT
+    JsonValue(const char* s) : IJson(subclassTag), tag(Kind::String), str(s) {}      // NOLINT
+    using IJson::serialize;
+    void serialize(JsonWriter& out) const override;
 
     bool operator==(const bool& b) const;
     bool operator==(const mpz_class& v) const;
@@ -89,20 +149,26 @@ class JsonValue final : public IJson {
     static JsonValue* null;
 
  private:
-    JsonValue(Kind kind) : tag(kind) {                        // NOLINT
+    JsonValue(Kind kind) : IJson(subclassTag), tag(kind) {  // NOLINT
         if (kind == Kind::String || kind == Kind::Number)
             throw std::logic_error("Incorrect constructor called");
     }
 
+    bool equals(long v) const { return tag == Kind::Number && !big && small == v; }
+
     const Kind tag;
-    const mpz_class value = 0;
+    // a number is held in 'small' if it fits, as nearly all do, and in 'big' otherwise
+    const long small = 0;
+    const mpz_class *big = nullptr;
     const cstring str = nullptr;
 };
 
 class JsonArray final : public IJson, public std::vector<IJson*> {
     friend class Test::TestJson;
  public:
-    void serialize(std::ostream& out) const;
+    static constexpr Subclass subclassTag = Subclass::Array;
+    using IJson::serialize;
+    void serialize(JsonWriter& out) const override;
     JsonArray* append(IJson* value);
     JsonArray* append(bool b) { append(new JsonValue(b)); return this; }
     JsonArray* append(mpz_class v) { append(new JsonValue(v)); return this; }
@@ -115,16 +181,19 @@ class JsonArray final : public IJson, public std::vector<IJson*> {
     JsonArray* append(cstring s) { append(new JsonValue(s)); return this; }
     JsonArray* append(std::string s) { append(new JsonValue(s)); return this; }
     JsonArray* append(const char* s) { append(new JsonValue(s)); return this; }
-    JsonArray(std::initializer_list<IJson*> data) : std::vector<IJson*>(data) {} // NOLINT
-    JsonArray() = default;
+    JsonArray(std::initializer_list<IJson*> data)  // NOLINT
+    : IJson(subclassTag), std::vector<IJson*>(data) {}
+    JsonArray() : IJson(subclassTag) {}
 };
 
-class JsonObject final : public IJson, public ordered_map<cstring, IJson*> {
+class JsonObject final : public IJson, public hvec_map<cstring, IJson*> {
     friend class Test::TestJson;
 
  public:
-    JsonObject() = default;
-    void serialize(std::ostream& out) const;
+    static constexpr Subclass subclassTag = Subclass::Object;
+    JsonObject() : IJson(subclassTag) {}
+    using IJson::serialize;
+    void serialize(JsonWriter& out) const override;
     JsonObject* emplace(cstring label, IJson* value);
     JsonObject* emplace(cstring label, bool b)
     { emplace(label, new JsonValue(b)); return this; }
@@ -30,7 +30,9 @@ namespace Log {
 namespace Detail {
 
 int verbosity = 0;
-int maximumLogLevel = 0;
+std::atomic<int> maximumLogLevel(0);
+std::atomic<unsigned> generation(1);
+bool timing = false;
 
 // The time at which logging was initialized; used so that log messages can have
 // relative rather than absolute timestamps.
@@ -134,7 +136,10 @@ void invalidateCaches(int possibleNewMaxLogLevel) {
     mostRecentFile = nullptr;
     mostRecentLevel = 0;
     logLevelCache.clear();
-    maximumLogLevel = std::max(maximumLogLevel, possibleNewMaxLogLevel);
+    maximumLogLevel = std::max(maximumLogLevel.load(), possibleNewMaxLogLevel);
+    // skip 0, which no FileLevelCache has when it is filled
+    if (++generation == 0)
+        ++generation;
 }
 
 }  // namespace Detail
@@ -172,6 +177,10 @@ void addDebugSpec(const char* spec) {
     Detail::invalidateCaches(maxLogLevelInSpec);
 }
 
+void enableTiming() {
+    Detail::timing = true;
+}
+
 void increaseVerbosity() {
 #ifdef MULTITHREAD
     static std::mutex lock;
@@ -182,4 +191,17 @@ void increaseVerbosity() {
     Detail::invalidateCaches(Detail::verbosity - 1);
 }
 
+void resetLogLevels() {
+#ifdef MULTITHREAD
+    static std::mutex lock;
+    std::lock_guard<std::mutex> acquire(lock);
+#endif
+
+    Detail::verbosity = 0;
+    Detail::timing = false;
+    Detail::maximumLogLevel = 0;
+    Detail::debugSpecs.clear();
+    Detail::invalidateCaches(0);
+}
+
 }  // namespace Log
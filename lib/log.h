@@ -17,10 +17,18 @@ limitations under the License.
 #ifndef P4C_LIB_LOG_H_
 #define P4C_LIB_LOG_H_
 
+#include <stdint.h>
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <set>
 #include <vector>
+#include "config.h"
+
+// LOG statements above this level are compiled out
+#ifndef P4C_MAX_LOG_LEVEL
+#define P4C_MAX_LOG_LEVEL 9
+#endif
 
 #ifndef __GNUC__
 #define __attribute__(X)
@@ -32,11 +40,36 @@ namespace Detail {
 extern int verbosity;
 
 // A cache of the maximum log level requested for any file.
-extern int maximumLogLevel;
+extern std::atomic<int> maximumLogLevel;
+
+// Changed whenever the log level of any file may have changed; never 0.
+extern std::atomic<unsigned> generation;
 
 // Look up the log level of @file.
 int fileLogLevel(const char* file);
 
+// Whether LOG_TIMING messages are written regardless of the log levels.
+extern bool timing;
+
+// The log level of the file of one LOGGING call site, kept until the levels
+// change, so that checking it takes no lock: the generation and the level are
+// read and written together, so a thread sees either a current level or a stale
+// generation, and then looks the level up again.
+class FileLevelCache {
+    std::atomic<uint64_t> cached;  // generation << 32 | level
+ public:
+    constexpr FileLevelCache() : cached(0) {}
+    int level(const char* file) {
+        uint64_t c = cached.load(std::memory_order_relaxed);
+        unsigned gen = generation.load(std::memory_order_relaxed);
+        if ((c >> 32) == gen)
+            return static_cast<int>(static_cast<uint32_t>(c));
+        int rv = fileLogLevel(file);
+        cached.store(uint64_t(gen) << 32 | static_cast<uint32_t>(rv),
+                     std::memory_order_relaxed);
+        return rv; }
+};
+
 // A utility class used to prepend file and log level information to logging output.
 class OutputLogPrefix {
     const char* fn;
@@ -50,23 +83,43 @@ class OutputLogPrefix {
 inline bool fileLogLevelIsAtLeast(const char* file, int level) {
     // If there's no file with a log level of at least @level, we don't need to do
     // the more expensive per-file check.
-    if (Detail::maximumLogLevel < level) {
+    if (Detail::maximumLogLevel.load(std::memory_order_relaxed) < level) {
         return false;
     }
 
     return Detail::fileLogLevel(file) >= level;
 }
 
+inline bool fileLogLevelIsAtLeast(Detail::FileLevelCache& cache, const char* file, int level) {
+    if (Detail::maximumLogLevel.load(std::memory_order_relaxed) < level)
+        return false;
+    return cache.level(file) >= level;
+}
+
 // Process @spec and update the log level requested for the appropriate file.
 void addDebugSpec(const char* spec);
 
+// Writes the LOG_TIMING messages, such as the time of each pass, without the
+// other log messages.
+void enableTiming();
+inline bool timing() { return Detail::timing; }
+
 inline bool verbose() { return Detail::verbosity > 0; }
 inline int verbosity() { return Detail::verbosity; }
 void increaseVerbosity();
+// Forgets the debug specs and verbosity set so far, before another compilation
+void resetLogLevels();
 
 }  // namespace Log
 
-#define LOGGING(N) (::Log::fileLogLevelIsAtLeast(__FILE__, N))
+// Each use has its own cache of the level of its file
+// Each use has its own cache of the level of its file.  Levels above
+// P4C_MAX_LOG_LEVEL are constant false, so the code they guard is removed.
+#define LOGGING(N) ((N) <= P4C_MAX_LOG_LEVEL &&                                \
+                    ::Log::fileLogLevelIsAtLeast(                              \
+                        []() -> ::Log::Detail::FileLevelCache& {              \
+                            static ::Log::Detail::FileLevelCache cache;       \
+                            return cache; }(), __FILE__, N))
 #define LOGN(N, X) (LOGGING(N)                                                   \
                       ? std::clog << ::Log::Detail::OutputLogPrefix(__FILE__, N) \
                                   << X << std::endl                              \
@@ -76,6 +129,11 @@ void increaseVerbosity();
 #define LOG3(X) LOGN(3, X)
 #define LOG4(X) LOGN(4, X)
 #define LOG5(X) LOGN(5, X)
+// Timing messages, written at level 1 or with Log::enableTiming()
+#define LOG_TIMING(X) ((::Log::timing() || LOGGING(1))                           \
+                      ? std::clog << ::Log::Detail::OutputLogPrefix(__FILE__, 1) \
+                                  << X << std::endl                              \
+                      : std::clog)
 
 #define ERROR(X) (std::clog << "ERROR: " << X << std::endl)
 #define WARNING(X) (::Log::verbose()                               \
@@ -17,25 +17,44 @@ limitations under the License.
 #ifndef P4C_LIB_LTBITMATRIX_H_
 #define P4C_LIB_LTBITMATRIX_H_
 
+#include <math.h>
 #include "bitvec.h"
 
-/* A lower-triangular bit matrix, held in a bit vector */
+/* A lower-triangular bit matrix, held in a bit vector.  The rows are grouped in blocks of
+ * bits_per_unit rows, and each row of block B takes B+1 whole words, so every row starts
+ * on a word boundary and the operations on rows work a word at a time. */
 class LTBitMatrix : private bitvec {
  public:
+    // The layout, which SymBitMatrix shares: where row 'r' starts, and the number of
+    // rows up to the one holding bit 'idx'
+    static size_t rowbase(unsigned r) {
+        size_t b = r / bits_per_unit;
+        return bits_per_unit * (bits_per_unit*b*(b+1)/2 + (r % bits_per_unit)*(b+1)); }
+    static unsigned rows(size_t idx) {
+        size_t w = idx / bits_per_unit;
+        size_t b = (sqrt(1.0 + 8.0*w/bits_per_unit) - 1) / 2;
+        while (bits_per_unit*(b+1)*(b+2)/2 <= w) b++;
+        while (bits_per_unit*b*(b+1)/2 > w) b--;
+        return b*bits_per_unit + (w - bits_per_unit*b*(b+1)/2)/(b+1) + 1; }
+
     nonconst_bitref operator()(unsigned r, unsigned c) {
-        return r >= c ? bitvec::operator[]((r*r+r)/2 + c) : end(); }
+        return r >= c ? bitvec::operator[](rowbase(r) + c) : end(); }
     bool operator()(unsigned r, unsigned c) const {
-        return  r >= c ? bitvec::operator[]((r*r+r)/2 + c) : false; }
-    unsigned size() const {
-        if (empty()) return 0;
-        unsigned m = *max();
-        unsigned r = 1;
-        while ((r*r+r)/2 <= m) r++;
-        return r; }
+        return  r >= c ? bitvec::getbit(rowbase(r) + c) : false; }
+    unsigned size() const { return empty() ? 0 : rows(max().index()); }
     using bitvec::clear;
     using bitvec::empty;
     using bitvec::operator bool;
 
+    // Adds to each row the rows it has a bit for, until there are no more to add
+    void transitive_closure() {
+        unsigned n = size();
+        for (unsigned k = 0; k < n; ++k) {
+            bitvec row = getslice(rowbase(k), k+1);
+            if (!row) continue;
+            for (unsigned r = k+1; r < n; ++r)
+                if ((*this)(r, k)) or_shifted(row, rowbase(r)); } }
+
  private:
     template<class T> class rowref {
         friend class LTBitMatrix;
@@ -47,17 +66,18 @@ class LTBitMatrix : private bitvec {
         rowref(const rowref &) = default;
         rowref(rowref &&) = default;
         explicit operator bool() const {
-            if (row < bits_per_unit)
-                return self.getrange((row*row+row)/2, row+1) != 0;
-            else
-                return self.getslice((row*row+row)/2, row+1) ? true : false; }
-        operator bitvec() const { return self.getslice((row*row+row)/2, row+1); }
+            size_t base = rowbase(row);
+            for (unsigned i = 0; i <= row / bits_per_unit; ++i)
+                if (self.getrange(base + i*bits_per_unit, bits_per_unit)) return true;
+            return false; }
+        operator bitvec() const { return self.getslice(rowbase(row), row+1); }
     };
     class nonconst_rowref : public rowref<LTBitMatrix> {
      public:
         friend class LTBitMatrix;
         using rowref<LTBitMatrix>::rowref;
-        void operator|=(bitvec a) const { a.clrrange(row+1, ~0); self |= a << (row*row+row)/2; }
+        void operator|=(const bitvec &a) const {
+            self.or_shifted(a.getslice(0, row+1), rowbase(row)); }
         nonconst_bitref operator[](unsigned col) const { return self(row, col); }
     };
     class const_rowref : public rowref<const LTBitMatrix> {
@@ -84,15 +104,19 @@ inline std::ostream &operator <<(std::ostream &out, const LTBitMatrix &bm) {
     return out;
 }
 
+/* reads what operator<< writes: the rows from 1, each without its diagonal bit */
 inline bool operator>>(const char *p, LTBitMatrix &bm) {
-    bitvec rv;
-    for (int i = 0; *p; ++p, ++i)
+    LTBitMatrix rv;
+    for (unsigned r = 1, c = 0; *p; ++p) {
         switch (*p) {
-        case ' ': --i; break;
+        case ' ': continue;
         case '0': break;
-        case '1': rv[i] = 1; break;
+        case '1': rv(r, c) = 1; break;
         default: return false; }
-    bm.bitvec::operator=(rv);
+        if (++c == r) {
+            ++r;
+            c = 0; } }
+    bm = rv;
     return true;
 }
 
@@ -18,6 +18,7 @@ limitations under the License.
 #define P4C_LIB_MAP_H_
 
 #include <map>
+#include <unordered_map>
 
 template<class K, class T, class V, class Comp, class Alloc>
 inline V get(const std::map<K, V, Comp, Alloc> &m, T key, V def = V()) {
@@ -37,6 +38,12 @@ inline const V *getref(const std::map<K, V, Comp, Alloc> &m, T key) {
     if (it != m.end()) return &it->second;
     return 0; }
 
+template<class K, class T, class V, class Hash, class Eq, class Alloc>
+inline V get(const std::unordered_map<K, V, Hash, Eq, Alloc> &m, T key, V def = V()) {
+    auto it = m.find(key);
+    if (it != m.end()) return it->second;
+    return def; }
+
 template<class K, class T, class V, class Comp, class Alloc>
 inline V get(const std::map<K, V, Comp, Alloc> *m, T key, V def = V()) {
     return m ? get(*m, key, def) : def; }
@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include <fstream>
+#include "gzstream.h"
 #include "nullstream.h"
 
 std::ostream* openFile(cstring name, bool nullOnError) {
@@ -24,7 +25,17 @@ std::ostream* openFile(cstring name, bool nullOnError) {
         ::error("Empty name for openFile");
         return nullptr;
     }
-    std::ofstream *file = new std::ofstream(name);
+    std::ostream *file;
+    if (name.endsWith(".gz")) {
+#if HAVE_LIBZ
+        file = new ogzstream(name);
+#else
+        ::error("%1%: p4c was built without zlib, so it cannot write .gz files", name);
+        return nullOnError ? new nullstream() : nullptr;
+#endif
+    } else {
+        file = new std::ofstream(name);
+    }
     if (!file->good()) {
         ::error("Error writing output to file %1%", name);
         if (nullOnError)
@@ -33,3 +44,23 @@ std::ostream* openFile(cstring name, bool nullOnError) {
     }
     return file;
 }
+
+std::istream* openInputFile(cstring name) {
+    std::istream *file;
+    if (name.endsWith(".gz")) {
+#if HAVE_LIBZ
+        file = new igzstream(name);
+#else
+        ::error("%1%: p4c was built without zlib, so it cannot read .gz files", name);
+        return nullptr;
+#endif
+    } else {
+        file = new std::ifstream(name);
+    }
+    if (!file->good()) {
+        ::error("Error reading file %1%", name);
+        delete file;
+        return nullptr;
+    }
+    return file;
+}
@@ -45,7 +45,10 @@ class onullstream final: public std::basic_ostream<cT, traits> {
 typedef onullstream<char> nullstream;
 
 // If nullOnError is 'true', on error a nullstream is returned
-// otherwise a nullptr is returned
+// otherwise a nullptr is returned.  A name that ends in .gz gives a stream
+// that compresses what is written with gzip; delete it to finish the file.
 std::ostream* openFile(cstring name, bool nullOnError);
+// The file to read, decompressed if its name ends in .gz; nullptr on error
+std::istream* openInputFile(cstring name);
 
 #endif /* P4C_LIB_NULLSTREAM_H_ */
@@ -15,6 +15,21 @@ limitations under the License.
 */
 
 #include "options.h"
+#include "parallel.h"
+
+Util::Options::Options(cstring message) : binaryName(nullptr), message(message) {
+    registerOption("--jobs", "N",
+                   [](const char* arg) {
+                       char* end;
+                       unsigned long jobs = strtoul(arg, &end, 10);
+                       if (*end != '\0' || end == arg) {
+                           ::error("%1%: expected a number of threads", arg);
+                           return false; }
+                       TaskScheduler::setJobs(jobs);
+                       return true; },
+                   "Run the parallel parts of the compiler on at most N threads, 0 for\n"
+                   "one per hardware thread (the default)");
+}
 
 void Util::Options::registerOption(const char* option, const char* argName,
                                    OptionProcessor processor, const char* description) {
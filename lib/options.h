@@ -61,7 +61,8 @@ class Options {
                         OptionProcessor processor,  // function to execute when option matches
                         const char* description);   // option help message
 
-    explicit Options(cstring message) : binaryName(nullptr), message(message) {}
+    // Registers --jobs, which all programs take
+    explicit Options(cstring message);
 
  public:
     // Process options; return list of remaining options.
@@ -0,0 +1,219 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "parallel.h"
+
+#include <deque>
+#include <exception>
+#ifdef MULTITHREAD
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif  // MULTITHREAD
+#include "lib/crash.h"
+#include "lib/error.h"
+#include "lib/gc.h"
+#include "lib/source_file.h"
+
+namespace Util {
+
+struct TaskGroup::Job {
+    unsigned            limit;          // threads that may run its tasks at once
+    bool                independent;
+    ErrorReporter       *errors = &ErrorReporter::instance;
+    InputSources        *sources = InputSources::instance;
+    std::vector<std::function<void()>> tasks;
+    // the messages of each task, reported in spawn order once all have finished
+    std::deque<ErrorReporter::Buffer> messages;
+    size_t              next = 0;       // the first task not started
+    size_t              finished = 0;
+    unsigned            running = 0;    // threads running its tasks
+    std::exception_ptr  error;          // of the first task, in spawn order, that threw
+    size_t              errorIndex = 0;
+#ifdef MULTITHREAD
+    bool                queued = false;  // in 'runnable'
+    std::condition_variable done;
+#endif  // MULTITHREAD
+
+    Job(unsigned limit, bool independent) : limit(limit), independent(independent) {}
+    bool finishedAll() const { return finished == tasks.size() && running == 0; }
+};
+
+namespace {
+
+unsigned jobsOption = 0;  // 0 until set
+
+#ifdef MULTITHREAD
+// Never destroyed, as the threads of the pool may still wait on them at exit
+std::mutex &lock = *new std::mutex;
+std::condition_variable &work = *new std::condition_variable;
+// The jobs that may have tasks not started, in the order they got them
+std::deque<TaskGroup::Job *> &runnable = *new std::deque<TaskGroup::Job *>;
+unsigned poolSize = 0;
+typedef std::unique_lock<std::mutex> Guard;
+#else
+struct Guard {
+    void lock() {}
+    void unlock() {}
+};
+#endif  // MULTITHREAD
+
+// Runs the tasks of 'job' that no thread has started, with 'guard' locked except
+// while a task runs
+void runTasks(TaskGroup::Job *job, Guard &guard) {
+    ++job->running;
+    while (job->next < job->tasks.size()) {
+        size_t index = job->next++;
+        auto task = std::move(job->tasks[index]);
+        auto *messages = job->independent ? nullptr : &job->messages[index];
+        guard.unlock();
+        auto *previous = messages ? ErrorReporter::instance.bufferTo(messages) : nullptr;
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception(); }
+        if (messages)
+            ErrorReporter::instance.bufferTo(previous);
+        guard.lock();
+        if (error && (!job->error || index < job->errorIndex)) {
+            job->error = error;
+            job->errorIndex = index; }
+        ++job->finished; }
+    --job->running;
+#ifdef MULTITHREAD
+    if (job->finishedAll())
+        job->done.notify_all();
+#endif  // MULTITHREAD
+}
+
+#ifdef MULTITHREAD
+// The first job with tasks not started that can use another thread; the jobs found
+// to have none left are dropped from 'runnable'
+TaskGroup::Job *takeJob() {
+    for (auto it = runnable.begin(); it != runnable.end();) {
+        auto *job = *it;
+        if (job->next == job->tasks.size()) {
+            job->queued = false;
+            it = runnable.erase(it);
+        } else if (job->running < job->limit) {
+            return job;
+        } else {
+            ++it; } }
+    return nullptr;
+}
+
+void worker() {
+    gc_register_thread();
+    register_thread();
+    Guard guard(lock);
+    while (true) {
+        TaskGroup::Job *job = nullptr;
+        work.wait(guard, [&job]() { return (job = takeJob()) != nullptr; });
+        bool independent = job->independent;
+        InputSources *own = InputSources::instance;
+        if (!independent) {
+            ErrorReporter::instance.reportTo(job->errors);
+            InputSources::instance = job->sources; }
+        runTasks(job, guard);
+        if (!independent) {
+            ErrorReporter::instance.reportTo(nullptr);
+            InputSources::instance = own; } }
+}
+
+// Starts threads until the pool has 'threads'; called with 'lock' held
+void growPool(unsigned threads) {
+    for (; poolSize < threads; ++poolSize)
+        std::thread(worker).detach();
+}
+#endif  // MULTITHREAD
+
+}  // namespace
+
+void TaskScheduler::setJobs(unsigned jobs) {
+#ifdef MULTITHREAD
+    std::lock_guard<std::mutex> guard(lock);
+#endif  // MULTITHREAD
+    jobsOption = jobs;
+}
+
+unsigned TaskScheduler::jobs() {
+#ifdef MULTITHREAD
+    std::lock_guard<std::mutex> guard(lock);
+    if (jobsOption == 0)
+        return std::max(std::thread::hardware_concurrency(), 1U);
+#endif  // MULTITHREAD
+    return jobsOption ? jobsOption : 1;
+}
+
+TaskGroup::TaskGroup(unsigned threads, bool independent) {
+    job = new Job(threads ? threads : TaskScheduler::jobs(), independent);
+}
+
+TaskGroup::~TaskGroup() {
+    finish();
+    delete job;
+}
+
+void TaskGroup::spawn(std::function<void()> task) {
+#ifdef MULTITHREAD
+    if (job->limit > 1) {
+        Guard guard(lock);
+        job->tasks.push_back(std::move(task));
+        job->messages.emplace_back();
+        if (!job->queued) {
+            runnable.push_back(job);
+            job->queued = true; }
+        // the thread that waits for the group is one of its threads, unless its tasks
+        // are independent programs, which it starts to compile before it waits
+        growPool(job->independent ? job->limit : job->limit - 1);
+        work.notify_one();
+        return; }
+#endif  // MULTITHREAD
+    job->tasks.push_back(std::move(task));
+    job->messages.emplace_back();
+}
+
+void TaskGroup::finish() {
+#ifdef MULTITHREAD
+    Guard guard(lock);
+    if (job->running < job->limit)
+        runTasks(job, guard);
+    job->done.wait(guard, [this]() { return job->finishedAll(); });
+    if (job->queued) {
+        runnable.erase(std::find(runnable.begin(), runnable.end(), job));
+        job->queued = false; }
+    guard.unlock();
+#else
+    Guard guard;
+    runTasks(job, guard);
+#endif  // MULTITHREAD
+    // on the thread that made the group, which is the only one left to use the buffers
+    if (!job->independent) {
+        for (auto &messages : job->messages)
+            job->errors->merge(messages); }
+}
+
+void TaskGroup::wait() {
+    finish();
+    if (job->error) {
+        auto error = job->error;
+        job->error = nullptr;
+        std::rethrow_exception(error); }
+}
+
+}  // namespace Util
@@ -0,0 +1,89 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _LIB_PARALLEL_H_
+#define _LIB_PARALLEL_H_
+
+#include <stddef.h>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace Util {
+
+// The pool of threads that runs all the parallel work of the compiler: the parallel
+// passes, the conversion of controls to JSON and the programs of a batch share it,
+// rather than each starting threads of its own.  The pool starts with the first
+// group that can use it, and grows to the most threads that a group asks for; its
+// threads live until the process exits.  Built without MULTITHREAD there is no pool,
+// and the thread that waits for a group runs all its tasks.
+class TaskScheduler {
+ public:
+    // The threads of a group that asks for 0: the number set here (by --jobs), or
+    // else one for each hardware thread
+    static void setJobs(unsigned jobs);
+    static unsigned jobs();
+};
+
+// Tasks that run on the pool, on up to 'threads' threads at a time (0 for
+// TaskScheduler::jobs()) counting the one that waits for them, which runs the tasks
+// that no other thread has started.  So a task can wait for a group of its own, and
+// the tasks of a group of one thread run in order on the waiting thread.
+// The tasks report errors to, and find source positions in, the program of the
+// thread that made the group, unless the group is 'independent', when each task
+// compiles a program of its own.  The messages of the tasks are kept apart and
+// reported when the group finishes, in the order the tasks were spawned, so that
+// the output does not depend on how the threads ran.
+class TaskGroup {
+ public:
+    struct Job;
+
+ private:
+    Job *job;
+    void finish();
+
+ public:
+    explicit TaskGroup(unsigned threads = 0, bool independent = false);
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+    ~TaskGroup();  // waits for the tasks
+    void spawn(std::function<void()> task);
+    // Returns once all the tasks have finished, and rethrows the exception of the
+    // first task, in the order they were spawned, that threw one
+    void wait();
+};
+
+// Calls visit(i) for each i < count, on up to 'threads' threads (0 for
+// TaskScheduler::jobs()).
+template<class F> void parallel_for(size_t count, unsigned threads, F visit) {
+    TaskGroup group(threads);
+    for (size_t i = 0; i < count; ++i)
+        group.spawn([&visit, i]() { visit(i); });
+    group.wait();
+}
+
+// The results of f(i) for each i < count, in the order of i whatever order the
+// calls ran in.
+template<class T, class F> std::vector<T> parallel_map(size_t count, unsigned threads, F f) {
+    static_assert(!std::is_same<T, bool>::value, "threads cannot set the bits of a vector<bool>");
+    std::vector<T> results(count);
+    parallel_for(count, threads, [&](size_t i) { results[i] = f(i); });
+    return results;
+}
+
+}  // namespace Util
+
+#endif /* _LIB_PARALLEL_H_ */
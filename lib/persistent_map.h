@@ -0,0 +1,154 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef P4C_LIB_PERSISTENT_MAP_H_
+#define P4C_LIB_PERSISTENT_MAP_H_
+
+#include <stddef.h>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Hash map whose copies share their storage, for the state of a ControlFlowVisitor
+// that is cloned at each branch.  It is a trie on the hash of the keys, 16 ways at
+// each level, whose nodes are never changed once built: an update copies the nodes
+// on the path to the key and shares the rest.  So copying a map is constant time,
+// and merge() only visits the parts of two maps that are not shared, i.e. those
+// that changed since they were copied from the same map.
+// Values are read through pointers that remain valid only until the next update.
+template <class K, class V, class Hash = std::hash<K>>
+class persistent_map {
+    static constexpr unsigned bits = 4, width = 1U << bits;
+    static constexpr unsigned bucketSize = 8;  // entries of a leaf before it is split
+    static constexpr unsigned maxDepth = sizeof(size_t) * 8 / bits;
+
+    struct node_t {
+        bool                            leaf = true;
+        const node_t                    *child[width] = {};     // unless leaf
+        std::vector<std::pair<K, V>>    entries;                // if leaf
+    };
+    const node_t        *root = nullptr;
+    size_t              total = 0;
+
+    static unsigned slot(size_t hash, unsigned depth) {
+        return (hash >> (depth * bits)) & (width - 1); }
+
+    static const node_t *insert(const node_t *n, const K &key, const V &value, size_t hash,
+                                unsigned depth, bool &added) {
+        if (!n) {
+            auto *rv = new node_t;
+            rv->entries.emplace_back(key, value);
+            added = true;
+            return rv; }
+        auto *rv = new node_t(*n);
+        if (!n->leaf) {
+            unsigned s = slot(hash, depth);
+            rv->child[s] = insert(n->child[s], key, value, hash, depth + 1, added);
+            return rv; }
+        for (auto &e : rv->entries) {
+            if (e.first == key) {
+                e.second = value;
+                return rv; } }
+        added = true;
+        rv->entries.emplace_back(key, value);
+        if (rv->entries.size() <= bucketSize || depth >= maxDepth)
+            return rv;
+        auto *split = new node_t;
+        split->leaf = false;
+        for (auto &e : rv->entries) {
+            size_t h = Hash()(e.first);
+            unsigned s = slot(h, depth);
+            bool dummy;
+            split->child[s] = insert(split->child[s], e.first, e.second, h, depth + 1, dummy); }
+        return split; }
+
+    // Calls f(key, value) on each entry, where f changes the value it is given and
+    // says whether it did; the nodes that change are copied.
+    template <class F> static const node_t *update(const node_t *n, F &f) {
+        if (!n) return n;
+        node_t *rv = nullptr;
+        if (n->leaf) {
+            for (size_t i = 0; i < n->entries.size(); ++i) {
+                V value = n->entries[i].second;
+                if (f(n->entries[i].first, value)) {
+                    if (!rv) rv = new node_t(*n);
+                    rv->entries[i].second = value; } }
+        } else {
+            for (unsigned i = 0; i < width; ++i) {
+                auto *c = update(n->child[i], f);
+                if (c != n->child[i]) {
+                    if (!rv) rv = new node_t(*n);
+                    rv->child[i] = c; } } }
+        return rv ? rv : n; }
+
+    template <class F> static const node_t *merge(const node_t *n, const node_t *other,
+                                                  const persistent_map &map, F &f) {
+        if (n == other || !n) return n;
+        if (n->leaf || !other || other->leaf) {
+            auto each = [&](const K &key, V &value) { return f(key, value, map.find(key)); };
+            return update(n, each); }
+        node_t *rv = nullptr;
+        for (unsigned i = 0; i < width; ++i) {
+            auto *c = merge(n->child[i], other->child[i], map, f);
+            if (c != n->child[i]) {
+                if (!rv) rv = new node_t(*n);
+                rv->child[i] = c; } }
+        return rv ? rv : n; }
+
+    template <class F> static void for_each(const node_t *n, F &f) {
+        if (!n) return;
+        if (n->leaf) {
+            for (auto &e : n->entries) f(e.first, e.second);
+        } else {
+            for (auto *c : n->child) for_each(c, f); } }
+
+ public:
+    size_t size() const { return total; }
+    bool empty() const { return total == 0; }
+    void clear() { root = nullptr; total = 0; }
+    // Whether the two maps are the same copy, with no update to either since
+    bool shares(const persistent_map &other) const { return root == other.root; }
+
+    const V *find(const K &key) const {
+        size_t hash = Hash()(key);
+        auto *n = root;
+        for (unsigned depth = 0; n && !n->leaf; ++depth)
+            n = n->child[slot(hash, depth)];
+        if (n)
+            for (auto &e : n->entries)
+                if (e.first == key) return &e.second;
+        return nullptr; }
+    size_t count(const K &key) const { return find(key) ? 1 : 0; }
+
+    // Adds the entry, or replaces the value of the key
+    void set(const K &key, const V &value) {
+        bool added = false;
+        root = insert(root, key, value, Hash()(key), 0, added);
+        if (added) ++total; }
+
+    // Calls f(key, value) on each entry, in no particular order
+    template <class F> void for_each(F f) const { for_each(root, f); }
+    // Calls f(key, V &value) on each entry, which returns true if it changed the value
+    template <class F> void update(F f) { root = update(root, f); }
+    // Calls f(key, V &value, const V *otherValue) on the entries that this map may not
+    // share with 'other', where otherValue is that of the key in 'other', or nullptr;
+    // f returns true if it changed the value.  As the shared entries are skipped,
+    // f must leave an entry alone if the other has the same.
+    template <class F> void merge(const persistent_map &other, F f) {
+        root = merge(root, other.root, other, f); }
+};
+
+#endif /* P4C_LIB_PERSISTENT_MAP_H_ */
@@ -0,0 +1,780 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "preprocessor.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#ifdef MULTITHREAD
+#include <mutex>
+#endif  // MULTITHREAD
+#include "error.h"
+
+namespace Util {
+
+// A source file as logical lines: with the backslash-newlines spliced and the comments
+// replaced by a space, as in the first phases of translation.  A comment that spans
+// lines still ends the lines it is in, so that the lines stay where they were.
+struct Preprocessor::File {
+    struct Line {
+        std::string     text;
+        unsigned        lines;  // in the file
+    };
+    cstring             path;
+    std::vector<Line>   lines;
+    std::string         guard;  // macro of an #ifndef around all of the file, if any
+    ino_t               inode;  // to tell when the file changed
+    off_t               size;
+    struct timespec     modified;
+
+    void split(const char *p, const char *end);
+    void findGuard();
+};
+
+struct Preprocessor::Condition {
+    bool        active;     // the lines are kept
+    bool        done;       // a branch was taken, or the whole #if is in a skipped section
+    bool        sawElse;
+};
+
+namespace {
+
+bool isIdentifierStart(char c) { return isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+bool isIdentifierChar(char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; }
+
+bool isDirective(const std::string &text) {
+    size_t first = 0;
+    while (first < text.size() && isBlank(text[first])) ++first;
+    return first < text.size() && text[first] == '#';
+}
+
+}  // namespace
+
+void Preprocessor::File::split(const char *p, const char *end) {
+    enum { Code, String, Char, BlockComment, LineComment } state = Code;
+    Line line = { "", 1 };
+    while (p < end) {
+        char c = *p++;
+        if (c == '\\' && p < end && (*p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n'))) {
+            p += *p == '\r' ? 2 : 1;
+            ++line.lines;
+            continue; }
+        if (c == '\n') {
+            if (state != BlockComment) state = Code;
+            lines.push_back(line);
+            line = { "", 1 };
+            continue; }
+        switch (state) {
+        case BlockComment:
+            if (c == '*' && p < end && *p == '/') {
+                ++p;
+                state = Code; }
+            continue;
+        case LineComment:
+            continue;
+        case String:
+        case Char:
+            line.text += c;
+            if (c == '\\' && p < end && *p != '\n')
+                line.text += *p++;
+            else if (c == (state == String ? '"' : '\''))
+                state = Code;
+            continue;
+        case Code:
+            if (c == '/' && p < end && (*p == '*' || *p == '/')) {
+                state = *p++ == '*' ? BlockComment : LineComment;
+                line.text += ' ';
+                continue; }
+            if (c == '"') state = String;
+            if (c == '\'') state = Char;
+            line.text += c;
+            continue; } }
+    if (!line.text.empty() || line.lines > 1)
+        lines.push_back(line);
+}
+
+void Preprocessor::File::findGuard() {
+    size_t first = 0;
+    while (first < lines.size() && lines[first].text.find_first_not_of(" \t\r\f\v") ==
+           std::string::npos)
+        ++first;
+    if (first == lines.size() || !isDirective(lines[first].text))
+        return;
+    auto tokens = tokenize(lines[first].text);
+    if (tokens.size() != 3 || tokens[1].text != "ifndef" ||
+        tokens[2].kind != Token::Kind::Identifier)
+        return;
+    int depth = 0;
+    for (size_t i = first; i < lines.size(); ++i) {
+        if (depth == 0 && i > first) {
+            if (lines[i].text.find_first_not_of(" \t\r\f\v") != std::string::npos)
+                return;
+            continue; }
+        if (!isDirective(lines[i].text))
+            continue;
+        auto d = tokenize(lines[i].text);
+        if (d.size() < 2) continue;
+        if (d[1].text == "if" || d[1].text == "ifdef" || d[1].text == "ifndef")
+            ++depth;
+        else if (d[1].text == "endif")
+            --depth; }
+    if (depth == 0)
+        guard = tokens[2].text;
+}
+
+// Files are kept for the life of the process, as their lines do not depend on macros,
+// and read again only if they changed.  The version read before is kept too, as a
+// program being preprocessed on another thread may still be reading it.
+const Preprocessor::File *Preprocessor::load(cstring path) {
+    static std::unordered_map<std::string, std::unique_ptr<File>> files;
+    static std::vector<std::unique_ptr<File>> replaced;
+#ifdef MULTITHREAD
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+#endif  // MULTITHREAD
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+        close(fd);
+        return nullptr; }
+    auto &file = files[path.c_str()];
+    if (file && file->inode == st.st_ino && file->size == st.st_size &&
+        file->modified.tv_sec == st.st_mtim.tv_sec &&
+        file->modified.tv_nsec == st.st_mtim.tv_nsec) {
+        close(fd);
+        return file.get(); }
+    if (file)
+        replaced.push_back(std::move(file));
+    file.reset(new File);
+    file->path = path;
+    file->inode = st.st_ino;
+    file->size = st.st_size;
+    file->modified = st.st_mtim;
+    if (st.st_size > 0) {
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            file.reset();
+            return nullptr; }
+        file->split(static_cast<const char *>(data), static_cast<const char *>(data) + st.st_size);
+        munmap(data, st.st_size); }
+    close(fd);
+    file->findGuard();
+    return file.get();
+}
+
+std::vector<Preprocessor::Token> Preprocessor::tokenize(const std::string &text) {
+    std::vector<Token> tokens;
+    bool space = false;
+    for (size_t i = 0; i < text.size();) {
+        char c = text[i];
+        size_t start = i;
+        Token::Kind kind = Token::Kind::Punctuation;
+        if (isBlank(c)) {
+            space = true;
+            ++i;
+            continue;
+        } else if (isIdentifierStart(c)) {
+            kind = Token::Kind::Identifier;
+            while (i < text.size() && isIdentifierChar(text[i])) ++i;
+        } else if (isdigit(static_cast<unsigned char>(c)) ||
+                   (c == '.' && i + 1 < text.size() && isdigit(text[i + 1]))) {
+            kind = Token::Kind::Number;
+            for (++i; i < text.size(); ++i) {
+                if ((text[i] == '+' || text[i] == '-') && strchr("eEpP", text[i - 1]))
+                    continue;
+                if (!isIdentifierChar(text[i]) && text[i] != '.')
+                    break; }
+        } else if (c == '"' || c == '\'') {
+            kind = Token::Kind::String;
+            for (++i; i < text.size() && text[i] != c; ++i)
+                if (text[i] == '\\') ++i;
+            i = std::min(i + 1, text.size());
+        } else {
+            i += c == '#' && i + 1 < text.size() && text[i + 1] == '#' ? 2 : 1; }
+        tokens.emplace_back(kind, text.substr(start, i - start), space);
+        space = false; }
+    return tokens;
+}
+
+void Preprocessor::error(const std::string &message) const {
+    if (context)
+        ::error("%1%:%2%: %3%", context->name, reportedLine(), message);
+    else
+        ::error("%1%", message);
+}
+
+void Preprocessor::marker(unsigned line, cstring name, const char *flags) {
+    out += "# " + std::to_string(line) + " \"" + name.c_str() + "\"" + flags + "\n";
+}
+
+void Preprocessor::defineMacro(const std::vector<Token> &tokens) {
+    if (tokens.empty() || tokens[0].kind != Token::Kind::Identifier) {
+        error("macro names must be identifiers");
+        return; }
+    Macro macro;
+    size_t i = 1;
+    if (i < tokens.size() && tokens[i].is("(") && !tokens[i].space) {
+        macro.function = true;
+        for (++i; ; ++i) {
+            if (i < tokens.size() && tokens[i].is(")") && macro.params.empty())
+                break;
+            if (i < tokens.size() && tokens[i].kind == Token::Kind::Identifier) {
+                macro.params.push_back(tokens[i++].text);
+            } else if (i + 2 < tokens.size() && tokens[i].is(".") && tokens[i + 1].is(".") &&
+                       tokens[i + 2].is(".")) {
+                macro.params.push_back("__VA_ARGS__");
+                macro.variadic = true;
+                i += 3; }
+            if (i < tokens.size() && tokens[i].is(")") && !macro.params.empty())
+                break;
+            if (i >= tokens.size() || !tokens[i].is(",") || macro.variadic) {
+                error("invalid parameter list of macro " + tokens[0].text);
+                return; } }
+        ++i; }
+    macro.body.assign(tokens.begin() + i, tokens.end());
+    if (!macro.body.empty())
+        macro.body[0].space = false;
+    macros[tokens[0].text] = macro;
+}
+
+void Preprocessor::define(cstring definition) {
+    std::string text = definition.c_str();
+    size_t eq = text.find('=');
+    if (eq == std::string::npos)
+        text += " 1";
+    else
+        text[eq] = ' ';
+    defineMacro(tokenize(text));
+}
+
+void Preprocessor::addOptions(cstring options) {
+    std::vector<std::string> args;
+    const char *p = options.c_str();
+    while (*p) {
+        while (isBlank(*p)) ++p;
+        const char *start = p;
+        while (*p && !isBlank(*p)) ++p;
+        if (p > start) args.emplace_back(start, p); }
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i].size() < 2 || args[i][0] != '-' || !strchr("IDU", args[i][1]))
+            continue;
+        char option = args[i][1];
+        std::string value = args[i].substr(2);
+        if (value.empty() && i + 1 < args.size())
+            value = args[++i];
+        if (option == 'I')
+            addIncludePath(value);
+        else if (option == 'D')
+            define(value);
+        else
+            undefine(value); }
+}
+
+// Expands the macros as in Prosser's algorithm: each token carries the set of macros
+// whose expansion it comes from, which are not expanded again in it.
+void Preprocessor::expand(std::vector<Token> input, std::vector<Token> &output,
+                          bool *incomplete) {
+    std::vector<Token> pending(input.rbegin(), input.rend());  // next token at the back
+    while (!pending.empty()) {
+        Token token = std::move(pending.back());
+        pending.pop_back();
+        if (token.kind != Token::Kind::Identifier ||
+            std::find(token.hide.begin(), token.hide.end(), token.text) != token.hide.end()) {
+            output.push_back(std::move(token));
+            continue; }
+        if (token.text == "__LINE__" && context) {
+            output.emplace_back(Token::Kind::Number, std::to_string(reportedLine()), token.space);
+            continue; }
+        if (token.text == "__FILE__" && context) {
+            output.emplace_back(Token::Kind::String,
+                                std::string("\"") + context->name.c_str() + "\"", token.space);
+            continue; }
+        auto it = macros.find(token.text);
+        if (it == macros.end() ||
+            (it->second.function && (pending.empty() || !pending.back().is("(")))) {
+            output.push_back(std::move(token));
+            continue; }
+        const Macro &macro = it->second;
+        std::vector<std::string> hide = token.hide;
+        std::vector<std::vector<Token>> args;
+        if (macro.function) {
+            pending.pop_back();
+            args.emplace_back();
+            int level = 0;
+            bool closed = false;
+            while (!pending.empty()) {
+                Token arg = std::move(pending.back());
+                pending.pop_back();
+                if (arg.is(")") && level == 0) {
+                    // the hide set is the one common to the name and the parenthesis
+                    std::vector<std::string> common;
+                    for (auto &h : hide)
+                        if (std::find(arg.hide.begin(), arg.hide.end(), h) != arg.hide.end())
+                            common.push_back(h);
+                    hide.swap(common);
+                    closed = true;
+                    break; }
+                if (arg.is("(")) ++level;
+                if (arg.is(")")) --level;
+                if (arg.is(",") && level == 0 &&
+                    !(macro.variadic && args.size() == macro.params.size())) {
+                    args.emplace_back();
+                    continue; }
+                args.back().push_back(std::move(arg)); }
+            if (!closed) {
+                if (incomplete) {
+                    *incomplete = true;
+                    return; }
+                error("unterminated argument list invoking macro " + token.text);
+                return; }
+            if (macro.params.empty() && args.size() == 1 && args[0].empty())
+                args.clear();
+            if (macro.variadic && args.size() + 1 == macro.params.size())
+                args.emplace_back();
+            if (args.size() != macro.params.size()) {
+                error("macro " + token.text + " takes " + std::to_string(macro.params.size()) +
+                      " arguments, but " + std::to_string(args.size()) + " were given");
+                continue; } }
+        hide.push_back(token.text);
+        auto body = substitute(macro, args, hide);
+        if (!body.empty())
+            body[0].space = token.space;
+        pending.insert(pending.end(), body.rbegin(), body.rend()); }
+}
+
+std::vector<Preprocessor::Token> Preprocessor::substitute(
+        const Macro &macro, const std::vector<std::vector<Token>> &args,
+        const std::vector<std::string> &hide) {
+    auto param = [&](const Token &token) -> int {
+        if (token.kind != Token::Kind::Identifier) return -1;
+        auto it = std::find(macro.params.begin(), macro.params.end(), token.text);
+        return it == macro.params.end() ? -1 : it - macro.params.begin(); };
+    auto &body = macro.body;
+    std::vector<Token> result;
+    for (size_t i = 0; i < body.size(); ++i) {
+        const Token &token = body[i];
+        if (macro.function && token.is("#") && i + 1 < body.size() && param(body[i + 1]) >= 0) {
+            std::string text = "\"";
+            for (auto &arg : args[param(body[++i])]) {
+                if (arg.space && text.size() > 1) text += ' ';
+                for (char c : arg.text) {
+                    if (arg.kind == Token::Kind::String && (c == '"' || c == '\\')) text += '\\';
+                    text += c; } }
+            result.emplace_back(Token::Kind::String, text + "\"", token.space);
+            continue; }
+        if (token.is("##") && i + 1 < body.size()) {
+            const Token &next = body[++i];
+            int p = param(next);
+            std::vector<Token> right = p >= 0 ? args[p] : std::vector<Token>{next};
+            if (!result.empty() && result.back().kind == Token::Kind::Placemarker) {
+                result.pop_back();
+                if (!right.empty()) right[0].space = false;
+            } else if (!right.empty() && !result.empty()) {
+                auto pasted = tokenize(result.back().text + right[0].text);
+                if (pasted.size() == 1) {
+                    pasted[0].space = result.back().space;
+                    result.back() = pasted[0];
+                    right.erase(right.begin());
+                } else {
+                    error("pasting \"" + result.back().text + "\" and \"" + right[0].text +
+                          "\" does not give a valid preprocessing token"); } }
+            result.insert(result.end(), right.begin(), right.end());
+            continue; }
+        int p = param(token);
+        if (p < 0) {
+            result.push_back(token);
+            continue; }
+        size_t start = result.size();
+        if (i + 1 < body.size() && body[i + 1].is("##")) {
+            // an operand of ## is not expanded
+            if (args[p].empty())
+                result.emplace_back(Token::Kind::Placemarker, "", token.space);
+            else
+                result.insert(result.end(), args[p].begin(), args[p].end());
+        } else {
+            expand(args[p], result, nullptr); }
+        if (result.size() > start)
+            result[start].space = token.space; }
+
+    std::vector<Token> tokens;
+    for (auto &token : result) {
+        if (token.kind == Token::Kind::Placemarker) continue;
+        tokens.push_back(std::move(token));
+        for (auto &h : hide)
+            if (std::find(tokens.back().hide.begin(), tokens.back().hide.end(), h) ==
+                tokens.back().hide.end())
+                tokens.back().hide.push_back(h); }
+    return tokens;
+}
+
+namespace {
+
+// Evaluates the expression of an #if, once the macros are expanded
+class Expression {
+    const std::vector<std::string>      &tokens;
+    std::vector<bool>                   joined;  // with the token before, without a space
+    size_t                              at = 0;
+
+    // Whether 'op' is next, made of as many tokens as it has characters
+    bool next(const char *op) const {
+        size_t len = strlen(op);
+        if (at + len > tokens.size()) return false;
+        for (size_t i = 0; i < len; ++i)
+            if (tokens[at + i] != std::string(1, op[i]) || (i > 0 && !joined[at + i]))
+                return false;
+        // and not the start of a longer operator
+        if (len == 1 && at + 1 < tokens.size() && joined[at + 1] && strchr("&|<>=!", op[0])) {
+            const std::string &second = tokens[at + 1];
+            if ((second == "=" && op[0] != '&' && op[0] != '|') ||
+                (second == op && strchr("&|<>", op[0])))
+                return false; }
+        return true; }
+    bool accept(const char *op) {
+        if (!next(op)) return false;
+        at += strlen(op);
+        return true; }
+
+    int64_t primary() {
+        if (at >= tokens.size()) {
+            failed = true;
+            return 0; }
+        if (accept("(")) {
+            int64_t v = conditional();
+            if (!accept(")")) failed = true;
+            return v; }
+        if (accept("!")) return !primary();
+        if (accept("~")) return ~primary();
+        if (accept("-")) return -primary();
+        if (accept("+")) return primary();
+        const std::string &token = tokens[at++];
+        if (isIdentifierStart(token[0]))
+            return 0;
+        if (token[0] == '\'' && token.size() >= 3)
+            return static_cast<unsigned char>(token[1] == '\\' ? token[2] : token[1]);
+        if (!isdigit(static_cast<unsigned char>(token[0]))) {
+            failed = true;
+            return 0; }
+        char *end;
+        int64_t v = strtoull(token.c_str(), &end, 0);
+        while (*end && strchr("uUlL", *end)) ++end;
+        if (*end) failed = true;
+        return v; }
+    int64_t binary(int level) {
+        static const std::vector<std::vector<const char *>> levels = {
+            { "||" }, { "&&" }, { "|" }, { "^" }, { "&" }, { "==", "!=" },
+            { "<=", ">=", "<", ">" }, { "<<", ">>" }, { "+", "-" }, { "*", "/", "%" } };
+        if (level == static_cast<int>(levels.size()))
+            return primary();
+        int64_t left = binary(level + 1);
+        for (;;) {
+            const char *op = nullptr;
+            for (auto o : levels[level])
+                if (next(o)) op = o;
+            if (!op || failed) return left;
+            at += strlen(op);
+            int64_t right = binary(level + 1);
+            std::string o = op;
+            if (o == "||") left = left || right;
+            else if (o == "&&") left = left && right;
+            else if (o == "|") left |= right;
+            else if (o == "^") left ^= right;
+            else if (o == "&") left &= right;
+            else if (o == "==") left = left == right;
+            else if (o == "!=") left = left != right;
+            else if (o == "<=") left = left <= right;
+            else if (o == ">=") left = left >= right;
+            else if (o == "<") left = left < right;
+            else if (o == ">") left = left > right;
+            else if (o == "<<") left = right >= 64 ? 0 : left << right;
+            else if (o == ">>") left = right >= 64 ? 0 : left >> right;
+            else if (o == "+") left += right;
+            else if (o == "-") left -= right;
+            else if (o == "*") left *= right;
+            else if (right == 0) divisionByZero = true;
+            else if (o == "/") left /= right;
+            else
+                left %= right; } }
+
+ public:
+    bool        failed = false;
+    bool        divisionByZero = false;
+
+    Expression(const std::vector<std::string> &tokens, const std::vector<bool> &joined)
+    : tokens(tokens), joined(joined) {}
+    int64_t conditional() {
+        int64_t v = binary(0);
+        if (!accept("?")) return v;
+        int64_t yes = conditional();
+        if (!accept(":")) failed = true;
+        int64_t no = conditional();
+        return v ? yes : no; }
+    bool atEnd() const { return at == tokens.size(); }
+};
+
+}  // namespace
+
+bool Preprocessor::evaluate(std::vector<Token> tokens) {
+    // the operand of 'defined' is not expanded
+    std::vector<Token> replaced;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens[i].text != "defined" || tokens[i].kind != Token::Kind::Identifier) {
+            replaced.push_back(tokens[i]);
+            continue; }
+        bool parens = i + 1 < tokens.size() && tokens[i + 1].is("(");
+        size_t name = i + 1 + parens;
+        if (name >= tokens.size() || tokens[name].kind != Token::Kind::Identifier ||
+            (parens && (name + 1 >= tokens.size() || !tokens[name + 1].is(")")))) {
+            error("operator \"defined\" requires an identifier");
+            return false; }
+        replaced.emplace_back(Token::Kind::Number, macros.count(tokens[name].text) ? "1" : "0",
+                              tokens[i].space);
+        i = name + parens; }
+    std::vector<Token> expanded;
+    expand(replaced, expanded, nullptr);
+    std::vector<std::string> texts;
+    std::vector<bool> joined;
+    for (auto &token : expanded) {
+        texts.push_back(token.text);
+        joined.push_back(!token.space); }
+    if (texts.empty()) {
+        error("#if with no expression");
+        return false; }
+    Expression expression(texts, joined);
+    int64_t v = expression.conditional();
+    if (expression.failed || !expression.atEnd()) {
+        error("invalid #if expression");
+        return false; }
+    if (expression.divisionByZero) {
+        error("division by zero in #if");
+        return false; }
+    return v != 0;
+}
+
+bool Preprocessor::include(std::vector<Token> tokens) {
+    if (!tokens.empty() && tokens[0].kind != Token::Kind::String && !tokens[0].is("<")) {
+        std::vector<Token> expanded;
+        expand(tokens, expanded, nullptr);
+        tokens.swap(expanded); }
+    std::string name;
+    bool angled = false;
+    if (!tokens.empty() && tokens[0].kind == Token::Kind::String && tokens[0].text[0] == '"') {
+        name = tokens[0].text.substr(1, tokens[0].text.size() - 2);
+    } else if (!tokens.empty() && tokens[0].is("<")) {
+        angled = true;
+        size_t i = 1;
+        for (; i < tokens.size() && !tokens[i].is(">"); ++i)
+            name += (tokens[i].space && i > 1 ? " " : "") + tokens[i].text;
+        if (i == tokens.size()) name.clear(); }
+    if (name.empty()) {
+        error("#include expects \"FILENAME\" or <FILENAME>");
+        return false; }
+
+    std::vector<std::string> candidates;
+    if (name[0] == '/') {
+        candidates.push_back(name);
+    } else {
+        if (!angled) {
+            std::string dir = context->file->path.c_str();
+            size_t slash = dir.rfind('/');
+            candidates.push_back(slash == std::string::npos ? name
+                                                            : dir.substr(0, slash + 1) + name); }
+        for (auto path : includePaths)
+            candidates.push_back(std::string(path.c_str()) + "/" + name); }
+    const File *file = nullptr;
+    cstring found;
+    for (auto &candidate : candidates) {
+        if ((file = load(candidate)) != nullptr) {
+            found = candidate;
+            break; } }
+    if (!file) {
+        error("cannot find include file " + name);
+        return false; }
+    if (!file->guard.empty() && macros.count(file->guard))
+        return false;
+    if (depth >= 200) {
+        error("#include nested too deeply");
+        return false; }
+
+    marker(1, found, " 1");
+    ++depth;
+    process(file, found);
+    --depth;
+    marker(reportedLine() + context->lines, context->name, " 2");
+    return true;
+}
+
+bool Preprocessor::directive(const std::string &text, std::vector<Condition> &conditions) {
+    auto tokens = tokenize(text);
+    if (tokens.size() < 2)
+        return false;  // the null directive
+    bool active = conditions.empty() || conditions.back().active;
+    const std::string &name = tokens[1].text;
+    std::vector<Token> rest(tokens.begin() + 2, tokens.end());
+
+    if (name == "if" || name == "ifdef" || name == "ifndef") {
+        if (!active) {
+            conditions.push_back({ false, true, false });
+            return false; }
+        bool value;
+        if (name == "if") {
+            value = evaluate(rest);
+        } else if (rest.empty() || rest[0].kind != Token::Kind::Identifier) {
+            error("no macro name given in #" + name + " directive");
+            value = false;
+        } else {
+            value = macros.count(rest[0].text) != (name == "ifndef"); }
+        conditions.push_back({ value, value, false });
+        return false; }
+    if (name == "elif" || name == "else" || name == "endif") {
+        if (conditions.empty()) {
+            error("#" + name + " without #if");
+            return false; }
+        auto &c = conditions.back();
+        if (name == "endif") {
+            conditions.pop_back();
+            return false; }
+        if (c.sawElse) {
+            error("#" + name + " after #else");
+            return false; }
+        if (c.done) {
+            c.active = false;
+        } else {
+            c.active = name == "else" || evaluate(rest);
+            c.done = c.active; }
+        c.sawElse = name == "else";
+        return false; }
+    if (!active)
+        return false;
+
+    if (name == "define") {
+        defineMacro(rest);
+    } else if (name == "undef") {
+        if (rest.empty() || rest[0].kind != Token::Kind::Identifier)
+            error("no macro name given in #undef directive");
+        else
+            macros.erase(rest[0].text);
+    } else if (name == "include") {
+        return include(rest);
+    } else if (name == "line" || tokens[1].kind == Token::Kind::Number) {
+        if (name == "line") {
+            std::vector<Token> expanded;
+            expand(rest, expanded, nullptr);
+            rest.swap(expanded);
+        } else {
+            rest.insert(rest.begin(), tokens[1]); }
+        char *end = nullptr;
+        unsigned long line = rest.empty() ? 0 : strtoul(rest[0].text.c_str(), &end, 10);
+        if (rest.empty() || rest[0].kind != Token::Kind::Number || *end) {
+            error("\"" + (rest.empty() ? std::string() : rest[0].text) +
+                  "\" after #line is not a positive integer");
+            return false; }
+        if (rest.size() > 1 && rest[1].kind == Token::Kind::String)
+            context->name = rest[1].text.substr(1, rest[1].text.size() - 2);
+        context->lineDelta = static_cast<int>(line) -
+                static_cast<int>(context->line + context->lines);
+        marker(line, context->name, "");
+        return true;
+    } else if (name == "error" || name == "warning") {
+        size_t at = text.find(name) + name.size();
+        std::string message = "#" + name + text.substr(at);
+        if (name == "error")
+            error(message);
+        else
+            ::warning("%1%:%2%: %3%", context->name, reportedLine(), message);
+    } else if (name == "pragma") {
+        out += text;
+    } else if (name != "ident" && name != "sccs") {
+        error("invalid preprocessing directive #" + name); }
+    return false;
+}
+
+void Preprocessor::process(const File *file, cstring name) {
+    Context here = { file, name, 0, 0, 1, 1 };
+    Context *outer = context;
+    context = &here;
+    std::vector<Condition> conditions;
+    auto &lines = file->lines;
+    while (here.next < lines.size()) {
+        auto &line = lines[here.next++];
+        here.lines = line.lines;
+        bool active = conditions.empty() || conditions.back().active;
+        if (isDirective(line.text)) {
+            bool marked = directive(line.text, conditions);
+            here.line += here.lines;
+            if (!marked)
+                out.append(here.lines, '\n');
+            continue; }
+        if (active) {
+            auto tokens = tokenize(line.text);
+            bool expands = false;
+            for (auto &token : tokens)
+                if (token.kind == Token::Kind::Identifier &&
+                    (macros.count(token.text) || token.text == "__LINE__" ||
+                     token.text == "__FILE__"))
+                    expands = true;
+            if (!expands) {
+                out += line.text;
+            } else {
+                // the arguments of a macro may go on over the following lines
+                std::vector<Token> expanded;
+                bool incomplete = false;
+                expand(tokens, expanded, &incomplete);
+                while (incomplete && here.next < lines.size() &&
+                       !isDirective(lines[here.next].text)) {
+                    auto more = tokenize(lines[here.next].text);
+                    if (!more.empty()) more[0].space = true;
+                    tokens.insert(tokens.end(), more.begin(), more.end());
+                    here.lines += lines[here.next++].lines;
+                    expanded.clear();
+                    incomplete = false;
+                    expand(tokens, expanded, &incomplete); }
+                if (incomplete) {
+                    expanded.clear();
+                    expand(tokens, expanded, nullptr); }
+                for (auto &token : expanded) {
+                    if (token.space) out += ' ';
+                    out += token.text; } } }
+        out.append(here.lines, '\n');
+        here.line += here.lines; }
+    if (!conditions.empty())
+        error("unterminated #if");
+    context = outer;
+}
+
+std::string Preprocessor::run(cstring file) {
+    out.clear();
+    auto *f = load(file);
+    if (f == nullptr) {
+        ::error("input file %s does not exist", file);
+        return out; }
+    marker(1, file, "");
+    process(f, file);
+    std::string result;
+    result.swap(out);
+    return result;
+}
+
+}  // namespace Util
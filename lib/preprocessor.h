@@ -0,0 +1,104 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef P4C_LIB_PREPROCESSOR_H_
+#define P4C_LIB_PREPROCESSOR_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cstring.h"
+
+namespace Util {
+
+// The C preprocessor, as far as P4 programs use it, run in the compiler rather than
+// as a cpp process: #include, object-like and function-like macros (with #, ## and
+// __VA_ARGS__, and __FILE__ and __LINE__), #if, #ifdef, #ifndef, #elif, #else and
+// #endif on integer expressions with 'defined', #undef, #error, #warning and #line.
+// #pragma lines are passed through.  Errors are reported through ::error.
+//
+// The output has line markers like those of GNU cpp, with flag 1 on entering an
+// include file and flag 2 on going back, which the lexers use to map positions back
+// to the files they come from.  Source files are read (through mmap) once per process,
+// and a file that is entirely inside an #ifndef guard is skipped, as cpp does, when
+// it is included again with the guard macro defined.
+class Preprocessor {
+    struct Token {
+        enum class Kind { Identifier, Number, String, Punctuation, Placemarker };
+        Kind                        kind;
+        std::string                 text;
+        bool                        space;  // preceded by white space
+        std::vector<std::string>    hide;   // macros not to expand again in this token
+
+        Token(Kind kind, std::string text, bool space) : kind(kind), text(text), space(space) {}
+        bool is(const char *punctuation) const {
+            return kind == Kind::Punctuation && text == punctuation; }
+    };
+    struct Macro {
+        bool                        function = false;
+        bool                        variadic = false;  // the last parameter is __VA_ARGS__
+        std::vector<std::string>    params;
+        std::vector<Token>          body;
+    };
+    struct File;
+    struct Condition;
+    // Where the lines are being read from
+    struct Context {
+        const File      *file;
+        cstring         name;       // as given by #line, if any
+        int             lineDelta;  // from the line in the file to the line reported
+        size_t          next;       // index of the next line to read
+        unsigned        line;       // in the file, where the line being processed starts
+        unsigned        lines;      // that it spans
+    };
+
+    std::vector<cstring>                    includePaths;
+    std::unordered_map<std::string, Macro>  macros;
+    Context                                 *context = nullptr;
+    unsigned                                depth = 0;  // of includes
+    std::string                             out;
+
+    static std::vector<Token> tokenize(const std::string &text);
+    static const File *load(cstring path);
+    unsigned reportedLine() const { return context->line + context->lineDelta; }
+    void error(const std::string &message) const;
+    void marker(unsigned line, cstring name, const char *flags);
+    void defineMacro(const std::vector<Token> &tokens);
+    bool include(std::vector<Token> tokens);
+    bool evaluate(std::vector<Token> tokens);
+    // Expands the macros in 'input'.  With 'incomplete', a call whose arguments are
+    // cut off sets it and stops, rather than being an error.
+    void expand(std::vector<Token> input, std::vector<Token> &output, bool *incomplete);
+    std::vector<Token> substitute(const Macro &macro, const std::vector<std::vector<Token>> &args,
+                                  const std::vector<std::string> &hide);
+    // Returns true when it wrote a line marker for the line after it
+    bool directive(const std::string &text, std::vector<Condition> &conditions);
+    void process(const File *file, cstring name);
+
+ public:
+    void addIncludePath(cstring path) { includePaths.push_back(path); }
+    // NAME or NAME=VALUE, as for -D
+    void define(cstring definition);
+    void undefine(cstring name) { macros.erase(name.c_str()); }
+    // Applies the -I, -D and -U arguments in this string, as for the cpp command line
+    void addOptions(cstring options);
+    // The preprocessed text of 'file'
+    std::string run(cstring file);
+};
+
+}  // namespace Util
+
+#endif /* P4C_LIB_PREPROCESSOR_H_ */
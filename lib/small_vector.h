@@ -0,0 +1,168 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef P4C_LIB_SMALL_VECTOR_H_
+#define P4C_LIB_SMALL_VECTOR_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+// A vector of trivial values, such as pointers, that keeps up to N of them in the
+// object itself, and only allocates when it grows past that.  The storage is the
+// same as that of the pointer to the allocated elements, so that with N = 2 it is no
+// larger than a std::vector.  Iterators are pointers, and are invalidated by any
+// change in the size, as are those of a std::vector that grows.  As with the vector
+// of ir/std.h, operator[] checks the index.
+template<class T, unsigned N>
+class small_vector {
+    static_assert(std::is_trivial<T>::value, "small_vector is only for trivial types");
+    static_assert(N > 0, "small_vector needs room for at least one element");
+
+    uint32_t    count = 0;
+    uint32_t    room = N;       // more than N when the elements are allocated
+    union {
+        T       *heap;
+        T       local[N];
+    };
+
+    bool allocated() const { return room > N; }
+    // Makes a gap of n elements at index, growing if needed; returns where it is
+    T *open(size_t index, size_t n) {
+        reserve(count + n);
+        T *p = data() + index;
+        memmove(p + n, p, (count - index) * sizeof(T));
+        count += n;
+        return p; }
+
+ public:
+    typedef T                                       value_type;
+    typedef T                                       &reference;
+    typedef const T                                 &const_reference;
+    typedef T                                       *iterator;
+    typedef const T                                 *const_iterator;
+    typedef size_t                                  size_type;
+
+    small_vector() {}
+    small_vector(const small_vector &a) { *this = a; }
+    small_vector(small_vector &&a) { *this = std::move(a); }
+    small_vector(std::initializer_list<T> a) { insert(end(), a.begin(), a.end()); }
+    template<class Iter> small_vector(Iter b, Iter e) { insert(end(), b, e); }
+    ~small_vector() { if (allocated()) delete[] heap; }
+
+    small_vector &operator=(const small_vector &a) {
+        if (this != &a) {
+            count = 0;
+            reserve(a.count);
+            memcpy(data(), a.data(), a.count * sizeof(T));
+            count = a.count; }
+        return *this; }
+    small_vector &operator=(small_vector &&a) {
+        if (this == &a) return *this;
+        if (allocated()) delete[] heap;
+        count = a.count;
+        room = a.room;
+        if (a.allocated())
+            heap = a.heap;
+        else
+            memcpy(local, a.local, count * sizeof(T));
+        a.count = 0;
+        a.room = N;
+        return *this; }
+
+    T *data() { return allocated() ? heap : local; }
+    const T *data() const { return allocated() ? heap : local; }
+    iterator begin() { return data(); }
+    const_iterator begin() const { return data(); }
+    iterator end() { return data() + count; }
+    const_iterator end() const { return data() + count; }
+    std::reverse_iterator<iterator> rbegin() { return std::reverse_iterator<iterator>(end()); }
+    std::reverse_iterator<const_iterator> rbegin() const {
+        return std::reverse_iterator<const_iterator>(end()); }
+    std::reverse_iterator<iterator> rend() { return std::reverse_iterator<iterator>(begin()); }
+    std::reverse_iterator<const_iterator> rend() const {
+        return std::reverse_iterator<const_iterator>(begin()); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t capacity() const { return room; }
+    void reserve(size_t n) {
+        if (n <= room) return;
+        size_t newRoom = std::max(n, size_t(room) * 2);
+        T *p = new T[newRoom];
+        memcpy(p, data(), count * sizeof(T));
+        if (allocated()) delete[] heap;
+        heap = p;
+        room = newRoom; }
+    void resize(size_t n) {
+        reserve(n);
+        for (size_t i = count; i < n; ++i) data()[i] = T();
+        count = n; }
+    void clear() { count = 0; }
+
+    T &at(size_t i) {
+        if (i >= count) throw std::out_of_range("small_vector::at");
+        return data()[i]; }
+    const T &at(size_t i) const {
+        if (i >= count) throw std::out_of_range("small_vector::at");
+        return data()[i]; }
+    T &operator[](size_t i) { return at(i); }
+    const T &operator[](size_t i) const { return at(i); }
+    T &front() { return at(0); }
+    const T &front() const { return at(0); }
+    T &back() { return at(count - 1); }
+    const T &back() const { return at(count - 1); }
+
+    void push_back(T v) {
+        if (count == room) reserve(count + 1);
+        data()[count++] = v; }
+    template<class... Args> void emplace_back(Args&&... args) {
+        push_back(T(std::forward<Args>(args)...)); }
+    void pop_back() {
+        if (count == 0) throw std::out_of_range("small_vector::pop_back");
+        --count; }
+
+    iterator insert(const_iterator i, T v) {
+        T *p = open(i - begin(), 1);
+        *p = v;
+        return p; }
+    iterator insert(const_iterator i, size_t n, T v) {
+        T *p = open(i - begin(), n);
+        std::fill(p, p + n, v);
+        return p; }
+    // the range must not be in this vector
+    template<class Iter>
+    iterator insert(const_iterator i, Iter b, Iter e) {
+        T *p = open(i - begin(), std::distance(b, e));
+        std::copy(b, e, p);
+        return p; }
+    iterator erase(const_iterator i) { return erase(i, i + 1); }
+    iterator erase(const_iterator s, const_iterator e) {
+        T *p = begin() + (s - begin());
+        memmove(p, e, (end() - e) * sizeof(T));
+        count -= e - s;
+        return p; }
+
+    bool operator==(const small_vector &a) const {
+        return count == a.count && std::equal(begin(), end(), a.begin()); }
+    bool operator!=(const small_vector &a) const { return !(*this == a); }
+};
+
+#endif /* P4C_LIB_SMALL_VECTOR_H_ */
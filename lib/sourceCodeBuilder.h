@@ -18,27 +18,102 @@ limitations under the License.
 #define P4C_LIB_SOURCECODEBUILDER_H_
 
 #include <ctype.h>
-#include <sstream>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <ostream>
+#include <string>
 
 #include "lib/stringify.h"
 #include "lib/cstring.h"
 #include "lib/exceptions.h"
 
 namespace Util {
+// Builds the text of a program.  With an output stream it writes the text to it in
+// large blocks as it goes, so that a large program is never held in memory as a whole;
+// otherwise it keeps all of it for toString().
 class SourceCodeBuilder {
     int indentLevel;  // current indent level
     unsigned indentAmount;
 
-    std::stringstream buffer;
-    const std::string nl = "\n";
+    std::string buffer;  // the text not written to the stream yet
+    std::ostream* stream;
+    static constexpr size_t blockSize = 1 << 16;
     bool endsInSpace;
 
+    void put(const char* str, size_t size) {
+        if (size == 0)
+            return;
+        endsInSpace = ::isspace(str[size - 1]);
+        buffer.append(str, size);
+        if (stream != nullptr && buffer.size() >= blockSize) {
+            stream->write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    static bool isSimpleFormat(const char* format) {
+        for (const char* p = strchr(format, '%'); p != nullptr; p = strchr(p + 2, '%'))
+            if (p[1] != 's' && p[1] != 'd' && p[1] != 'u' && p[1] != '%')
+                return false;
+        return true;
+    }
+    void appendSimpleFormat(const char* format, va_list ap) {
+        const char* rest = format;
+        for (const char* p; (p = strchr(rest, '%')) != nullptr; rest = p + 2) {
+            put(rest, p - rest);
+            switch (p[1]) {
+                case 's': {
+                    const char* str = va_arg(ap, const char*);
+                    if (str == nullptr)
+                        BUG("Null string argument to format %1%", format);
+                    put(str, strlen(str));
+                    break;
+                }
+                case 'd':
+                    append(va_arg(ap, int));
+                    break;
+                case 'u':
+                    append(va_arg(ap, unsigned));
+                    break;
+                default:
+                    put("%", 1);
+                    break;
+            }
+        }
+        put(rest, strlen(rest));
+    }
+    void appendPrintf(const char* format, va_list ap) {
+        // formatted in place, as most are short
+        char text[256];
+        va_list copy;
+        va_copy(copy, ap);
+        int size = vsnprintf(text, sizeof(text), format, ap);
+        if (size < 0)
+            BUG("Could not format %1%", format);
+        if (static_cast<size_t>(size) < sizeof(text)) {
+            put(text, size);
+        } else {
+            std::string str(size + 1, '\0');
+            vsnprintf(&str[0], str.size(), format, copy);
+            put(str.data(), size);
+        }
+        va_end(copy);
+    }
+
  public:
     SourceCodeBuilder() :
             indentLevel(0),
             indentAmount(4),
+            stream(nullptr),
             endsInSpace(false)
     {}
+    explicit SourceCodeBuilder(std::ostream* stream) :
+            indentLevel(0),
+            indentAmount(4),
+            stream(stream),
+            endsInSpace(false)
+    { buffer.reserve(blockSize); }
 
     void increaseIndent() { indentLevel += indentAmount; }
     void decreaseIndent() {
@@ -46,38 +121,56 @@ class SourceCodeBuilder {
         if (indentLevel < 0)
             BUG("Negative indent");
     }
-    void newline() { buffer << nl; endsInSpace = true; }
+    void newline() { put("\n", 1); endsInSpace = true; }
     void spc() {
         if (!endsInSpace)
-            buffer << " ";
+            put(" ", 1);
         endsInSpace = true;
     }
 
-    void append(cstring str) { append(str.c_str()); }
+    void append(cstring str) { put(str.c_str(), str.size()); }
     void appendLine(cstring str) { append(str); newline(); }
-    void append(std::string str) {
-        if (str.size() == 0)
-            return;
-        endsInSpace = ::isspace(str.at(str.size() - 1));
-        buffer << str;
-    }
+    void append(const std::string& str) { put(str.data(), str.size()); }
     void append(const char* str) {
         if (str == nullptr)
             BUG("Null argument to append");
-        if (strlen(str) == 0)
-            return;
-        endsInSpace = ::isspace(str[strlen(str) - 1]);
-        buffer << str;
+        put(str, strlen(str));
     }
+    // Formats with only %s, %d, %u and %%, which are most of them, are copied here
+    // piece by piece instead of going through vsnprintf
     void appendFormat(const char* format, ...) {
         va_list ap;
         va_start(ap, format);
-        cstring str = Util::vprintf_format(format, ap);
+        if (isSimpleFormat(format))
+            appendSimpleFormat(format, ap);
+        else
+            appendPrintf(format, ap);
         va_end(ap);
-        append(str);
     }
-    void append(unsigned u) { appendFormat("%d", u); }
-    void append(int u) { appendFormat("%d", u); }
+    void append(unsigned u) {
+        char text[3 * sizeof(u) + 1];
+        char* end = text + sizeof(text);
+        char* start = end;
+        do {
+            *--start = '0' + u % 10;
+            u /= 10;
+        } while (u != 0);
+        put(start, end - start);
+    }
+    void append(int i) {
+        if (i < 0) {
+            put("-", 1);
+            append(0u - static_cast<unsigned>(i));
+        } else {
+            append(static_cast<unsigned>(i));
+        }
+    }
+    // The size the text is expected to reach, so that the buffer holding it is only
+    // allocated once; with an output stream the buffer never grows past a block anyway
+    void reserve(size_t size) {
+        if (stream == nullptr)
+            buffer.reserve(size);
+    }
 
     void endOfStatement(bool addNl = false) {
         append(";");
@@ -90,7 +183,7 @@ class SourceCodeBuilder {
     }
 
     void emitIndent() {
-        buffer << std::string(indentLevel, ' ');
+        buffer.append(indentLevel, ' ');
         if (indentLevel > 0)
             endsInSpace = true;
     }
@@ -103,7 +196,15 @@ class SourceCodeBuilder {
             newline();
     }
 
-    std::string toString() const { return buffer.str(); }
+    // The text, or with an output stream, the text not written to it yet
+    std::string toString() const { return buffer; }
+    // Writes the rest of the text to the output stream
+    void flush() {
+        BUG_CHECK(stream != nullptr, "No output stream to flush");
+        stream->write(buffer.data(), buffer.size());
+        buffer.clear();
+        stream->flush();
+    }
     void commentStart() { append("/* "); }
     void commentEnd() { append(" */"); }
     bool lastIsSpace() const { return endsInSpace; }
@@ -14,9 +14,17 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <stdlib.h>
+#include <string.h>
 #include <sstream>
 
 #include <algorithm>
+#include <new>
+#ifdef MULTITHREAD
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#endif  // MULTITHREAD
 #include "source_file.h"
 #include "exceptions.h"
 
@@ -37,29 +45,137 @@ cstring SourcePosition::toString() const {
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
-SourceInfo::SourceInfo(SourcePosition start, SourcePosition end) :
-        start(start),
-        end(end) {
+// The table of source ranges.  Ranges are stored in chunks that never move, so that
+// lookup needs no lock, and found again through an open-addressing hash set of their
+// indices.  As with the cstring table, the memory is from malloc and never released,
+// as SourceInfos may be kept from one compilation to the next.
+class SourceRangeTable {
+    typedef SourceInfo::Range Range;
+    static const unsigned CHUNK_BITS = 12;
+    static const uint32_t CHUNK = 1 << CHUNK_BITS;
+    static const uint32_t MAX_CHUNKS = 1 << 18;
+
+    Range       **chunks;
+    uint32_t    count = 0;
+    uint32_t    *slots = nullptr;   // indices of ranges, 0 for empty
+    size_t      capacity = 0;       // always a power of 2
+#ifdef MULTITHREAD
+    std::mutex  lock;
+#endif  // MULTITHREAD
+
+    static size_t hash(const SourcePosition &start, const SourcePosition &end) {
+        uint64_t h = start.getLineNumber();
+        h = h * 1000003 + start.getColumnNumber();
+        h = h * 1000003 + end.getLineNumber();
+        h = h * 1000003 + end.getColumnNumber();
+        return static_cast<size_t>(h ^ (h >> 29)); }
+
+    uint32_t add(const SourcePosition &start, const SourcePosition &end) {
+        if (count == CHUNK * MAX_CHUNKS)
+            BUG("Too many source positions");
+        uint32_t rv = count++;
+        Range *&chunk = chunks[rv >> CHUNK_BITS];
+        if (!chunk) {
+            chunk = static_cast<Range *>(malloc(CHUNK * sizeof(Range)));
+            if (!chunk) throw std::bad_alloc(); }
+        new(&chunk[rv & (CHUNK - 1)]) Range{start, end};
+        return rv; }
+
+    void grow() {
+        size_t newcap = capacity ? capacity * 2 : 1024;
+        uint32_t *newslots = static_cast<uint32_t *>(calloc(newcap, sizeof(uint32_t)));
+        if (!newslots) throw std::bad_alloc();
+        for (size_t i = 0; i < capacity; ++i) {
+            if (!slots[i]) continue;
+            auto &r = at(slots[i]);
+            size_t j = hash(r.start, r.end) & (newcap - 1);
+            while (newslots[j]) j = (j + 1) & (newcap - 1);
+            newslots[j] = slots[i]; }
+        free(slots);
+        slots = newslots;
+        capacity = newcap; }
+
+ public:
+    SourceRangeTable() {
+        chunks = static_cast<Range **>(calloc(MAX_CHUNKS, sizeof(Range *)));
+        if (!chunks) throw std::bad_alloc();
+        add(SourcePosition(), SourcePosition()); }
+
+    const Range &at(uint32_t index) const {
+        return chunks[index >> CHUNK_BITS][index & (CHUNK - 1)]; }
+
+    uint32_t intern(const SourcePosition &start, const SourcePosition &end) {
+#ifdef MULTITHREAD
+        std::lock_guard<std::mutex> acquire(lock);
+#endif  // MULTITHREAD
+        if ((count + 1) * 4 > capacity * 3) grow();
+        size_t i = hash(start, end) & (capacity - 1);
+        while (uint32_t r = slots[i]) {
+            auto &range = at(r);
+            if (range.start == start && range.end == end)
+                return r;
+            i = (i + 1) & (capacity - 1); }
+        return slots[i] = add(start, end); }
+
+    static SourceRangeTable &get() {
+        // initialized on first use, as SourceInfos are created by static constructors
+        static SourceRangeTable *table = new SourceRangeTable();
+        return *table; }
+};
+
+uint32_t SourceInfo::intern(SourcePosition start, SourcePosition end) {
+    return SourceRangeTable::get().intern(start, end);
+}
+
+const SourceInfo::Range &SourceInfo::lookup(uint32_t range) {
+    return SourceRangeTable::get().at(range);
+}
+
+SourceInfo::SourceInfo(SourcePosition start, SourcePosition end) {
     if (!start.isValid() || !end.isValid())
         BUG("Invalid source position in SourceInfo %1%-%2%",
                           start.toString(), end.toString());
     if (start > end)
         BUG("SourceInfo position start %1% after end %2%",
                           start.toString(), end.toString());
+    range = intern(start, end);
 }
 
 cstring SourceInfo::toDebugString() const {
-    return Util::printf_format("(%s)-(%s)", start.toString(), end.toString());
+    return Util::printf_format("(%s)-(%s)", getStart().toString(), getEnd().toString());
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef MULTITHREAD
+// The collector does not look in thread-local storage, so the instance of each thread
+// is also kept here, until the thread replaces it
+static std::mutex threadInstancesLock;
+static std::unordered_map<std::thread::id, InputSources*> threadInstances;
+
+static InputSources* keep(InputSources* sources) {
+    std::lock_guard<std::mutex> guard(threadInstancesLock);
+    threadInstances[std::this_thread::get_id()] = sources;
+    return sources;
+}
+
+thread_local InputSources* InputSources::instance = keep(new InputSources());
+
+void InputSources::reset() {
+    instance = keep(new InputSources());
+}
+#else
 InputSources* InputSources::instance = new InputSources();
 
+void InputSources::reset() {
+    instance = new InputSources();
+}
+#endif  // MULTITHREAD
+
 InputSources::InputSources() :
         sealed(false) {
     this->mapLine(nullptr, 0);
-    this->contents.push_back("");
+    this->lineStarts.push_back(0);
 }
 
 // prevent further changes
@@ -70,8 +186,8 @@ void InputSources::seal() {
 }
 
 unsigned InputSources::lineCount() const {
-    int size = this->contents.size();
-    if (this->contents.back().isNullOrEmpty()) {
+    int size = this->lineStarts.size();
+    if (this->lineStarts.back() == this->text.size()) {
         // do not count the last line if it is empty.
         size -= 1;
         if (size < 0)
@@ -85,20 +201,17 @@ void InputSources::appendToLastLine(StringRef text) {
     if (this->sealed)
         BUG("Appending to sealed InputSources");
     // Text should not contain any newline characters
-    for (size_t i = 0; i < text.len; i++) {
-        char c = text[i];
-        if (c == '\n')
-            BUG("Text contains newlines");
-    }
-    this->contents.back() += text.toString();
+    if (memchr(text.p, '\n', text.len) != nullptr)
+        BUG("Text contains newlines");
+    this->text.append(text.p, text.len);
 }
 
 // Append a newline and start a new line
 void InputSources::appendNewline(StringRef newline) {
     if (this->sealed)
         BUG("Appending to sealed InputSources");
-    this->contents.back() += newline.toString();
-    this->contents.push_back("");  // start a new line
+    this->text.append(newline.p, newline.len);
+    this->lineStarts.push_back(this->text.size());  // start a new line
 }
 
 void InputSources::appendText(const char* text) {
@@ -141,19 +254,43 @@ cstring InputSources::getLine(unsigned lineNumber) const {
         // don't throw: this code may be called by exceptions
         // reporting on elements that have no source position
     }
-    return this->contents.at(lineNumber - 1);
+    return this->lineText(lineNumber);
+}
+
+std::string InputSources::lineText(unsigned lineNumber) const {
+    size_t start = this->lineStarts.at(lineNumber - 1);
+    size_t end = lineNumber < this->lineStarts.size() ? this->lineStarts[lineNumber]
+                                                      : this->text.size();
+    return this->text.substr(start, end - start);
 }
 
 void InputSources::mapLine(cstring file, unsigned originalSourceLineNo) {
     if (this->sealed)
         BUG("Changing mapping to sealed InputSources");
     unsigned lineno = this->getCurrentLineNumber();
-    this->line_file_map.emplace(lineno, SourceFileLine(file, originalSourceLineNo));
+    // lines are only appended, so the runs stay sorted; the first mapping of a line wins
+    if (!this->lineMap.empty() && this->lineMap.back().first >= lineno)
+        return;
+    this->lineMap.emplace_back(lineno, SourceFileLine(file, originalSourceLineNo));
+}
+
+void InputSources::restore(const std::string &text, const LineMap &lineMap) {
+    if (this->sealed)
+        BUG("Restoring sealed InputSources");
+    if (lineMap.empty() || lineMap.front().first != 0)
+        BUG("Restoring InputSources without a first line");
+    this->text = text;
+    this->lineMap = lineMap;
+    this->lineStarts.assign(1, 0);
+    for (size_t at = 0; (at = text.find('\n', at)) != std::string::npos; )
+        this->lineStarts.push_back(++at);
 }
 
 SourceFileLine InputSources::getSourceLine(unsigned line) const {
-    auto it = this->line_file_map.upper_bound(line);
-    if (it == this->line_file_map.begin())
+    auto it = std::upper_bound(this->lineMap.begin(), this->lineMap.end(), line,
+                               [](unsigned l, const LineMap::value_type &run) {
+                                   return l < run.first; });
+    if (it == this->lineMap.begin())
         // There must be always something mapped to line 0
         BUG("No source information for line %1%", line);
     --it;
@@ -169,12 +306,12 @@ SourceFileLine InputSources::getSourceLine(unsigned line) const {
 }
 
 unsigned InputSources::getCurrentLineNumber() const {
-    return this->contents.size();
+    return this->lineStarts.size();
 }
 
 SourcePosition InputSources::getCurrentPosition() const {
     unsigned line = this->getCurrentLineNumber();
-    unsigned column = this->contents.back().size();
+    unsigned column = this->text.size() - this->lineStarts.back();
     return SourcePosition(line, column);
 }
 
@@ -183,14 +320,14 @@ cstring InputSources::getSourceFragment(const SourcePosition &position) const {
     return this->getSourceFragment(info);
 }
 
-cstring carets(cstring source, unsigned start, unsigned end) {
+std::string carets(const std::string &source, unsigned start, unsigned end) {
     std::stringstream builder;
     if (start > source.size())
         start = source.size();
 
     unsigned i;
     for (i=0; i < start; i++) {
-        char c = source.c_str()[i];
+        char c = source[i];
         if (c == ' ' || c == '\t')
             builder.put(c);
         else
@@ -211,23 +348,21 @@ cstring InputSources::getSourceFragment(const SourceInfo &position) const {
     if (position.getEnd().getLineNumber() > position.getStart().getLineNumber())
         return this->getSourceFragment(position.getStart());
 
-    cstring result = this->getLine(position.getStart().getLineNumber());
+    std::string result = this->lineText(position.getStart().getLineNumber());
+    std::string marker = carets(result, position.getStart().getColumnNumber(),
+                                position.getEnd().getColumnNumber());
     // Normally result has a newline, but if not
     // then we have to add a newline
-    cstring toadd = "";
-    if (result.find('\n') == nullptr)
-        toadd = cstring::newline;
-    cstring marker = carets(result, position.getStart().getColumnNumber(),
-                            position.getEnd().getColumnNumber());
-    return result + toadd + marker + cstring::newline;
+    if (result.find('\n') == std::string::npos)
+        result += "\n";
+    return result + marker + "\n";
 }
 
 cstring InputSources::toDebugString() const {
     std::stringstream builder;
-    for (auto line : this->contents)
-        builder << line;
+    builder << this->text;
     builder << "---------------" << std::endl;
-    for (auto lf : this->line_file_map)
+    for (auto &lf : this->lineMap)
         builder << lf.first << ": " << lf.second.toString() << std::endl;
     return cstring(builder.str());
 }
@@ -241,12 +376,12 @@ cstring SourceInfo::toSourceFragment() const {
 cstring SourceInfo::toPositionString() const {
     if (!this->isValid())
         return "";
-    SourceFileLine position = InputSources::instance->getSourceLine(this->start.getLineNumber());
+    SourceFileLine position = InputSources::instance->getSourceLine(getStart().getLineNumber());
     return position.toString();
 }
 
 SourceFileLine SourceInfo::toPosition() const {
-    return InputSources::instance->getSourceLine(this->start.getLineNumber());
+    return InputSources::instance->getSourceLine(getStart().getLineNumber());
 }
 
 ////////////////////////////////////////////////////////
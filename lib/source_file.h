@@ -21,6 +21,9 @@ limitations under the License.
 #ifndef P4C_LIB_SOURCE_FILE_H_
 #define P4C_LIB_SOURCE_FILE_H_
 
+#include <stdint.h>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "cstring.h"
@@ -61,7 +64,7 @@ class SourcePosition final {
 
     inline bool operator==(const SourcePosition& rhs) const {
         return this->columnNumber == rhs.columnNumber &&
-                this->lineNumber == rhs.columnNumber;
+                this->lineNumber == rhs.lineNumber;
     }
     inline bool operator!=(const SourcePosition& rhs) const
     {return !this->operator==(rhs);}
@@ -134,11 +137,10 @@ class SourcePosition final {
 class SourceInfo final {
  public:
     // Creates an "invalid" SourceInfo
-    SourceInfo()
-            : start(SourcePosition()),
-              end(SourcePosition()) {}
+    SourceInfo() : range(0) {}
     // Creates a SourceInfo for a 'point' in the source, or invalid
-    explicit SourceInfo(SourcePosition point) : start(point), end(point) {}
+    explicit SourceInfo(SourcePosition point)
+            : range(point.isValid() ? intern(point, point) : 0) {}
 
     SourceInfo(SourcePosition start, SourcePosition end);
 
@@ -151,24 +153,20 @@ class SourceInfo final {
     const SourceInfo operator+(const SourceInfo& rhs) const {
         if (!this->isValid())
             return rhs;
-        if (!rhs.isValid())
+        if (!rhs.isValid() || range == rhs.range)
             return *this;
-        SourcePosition s = start.min(rhs.start);
-        SourcePosition e = end.max(rhs.end);
+        SourcePosition s = getStart().min(rhs.getStart());
+        SourcePosition e = getEnd().max(rhs.getEnd());
         return SourceInfo(s, e);
     }
     SourceInfo &operator+=(const SourceInfo& rhs) {
-        if (!isValid()) {
-            *this = rhs;
-        } else if (rhs.isValid()) {
-            start = start.min(rhs.start);
-            end = end.max(rhs.end);
-        }
+        *this = *this + rhs;
         return *this;
     }
 
+    // the same range is always kept at the same place in the table
     bool operator==(const SourceInfo &rhs) const
-    { return start == rhs.start && end == rhs.end; }
+    { return range == rhs.range; }
 
     cstring toDebugString() const;
 
@@ -180,14 +178,14 @@ class SourceInfo final {
     SourceFileLine toPosition() const;
 
     bool isValid() const
-    { return this->start.isValid(); }
+    { return range != 0; }
     explicit operator bool() const { return isValid(); }
 
     const SourcePosition& getStart() const
-    { return this->start; }
+    { return lookup(range).start; }
 
     const SourcePosition& getEnd() const
-    { return this->end; }
+    { return lookup(range).end; }
 
     // True if this comes 'before' this source position
     // 'invalid' source positions come first.
@@ -196,7 +194,7 @@ class SourceInfo final {
     bool operator< (const SourceInfo& rhs) const {
         if (!rhs.isValid()) return false;
         if (!isValid()) return true;
-        return this->start < rhs.start;
+        return this->getStart() < rhs.getStart();
     }
     inline bool operator> (const SourceInfo& rhs) const
     { return rhs.operator< (*this); }
@@ -206,8 +204,19 @@ class SourceInfo final {
     { return !this->operator< (rhs); }
 
  private:
-    SourcePosition start;
-    SourcePosition end;
+    // Every node has a SourceInfo, so it is only the index of its range in a table
+    // of all the ranges seen by the process, where each range is kept once: copies
+    // and clones of a node share it, and comparing two is comparing indices.  The
+    // range at index 0 is that of an invalid SourceInfo.
+    struct Range {
+        SourcePosition start;
+        SourcePosition end;
+    };
+    friend class SourceRangeTable;
+    uint32_t range;
+
+    static uint32_t intern(SourcePosition start, SourcePosition end);
+    static const Range& lookup(uint32_t range);
 };
 
 class IHasSourceInfo {
@@ -271,7 +280,26 @@ class InputSources final {
 
     cstring toDebugString() const;
 
+    // The first line of each run of lines from the same original file, in
+    // increasing order, and where that run starts in the file
+    typedef std::vector<std::pair<unsigned, SourceFileLine>> LineMap;
+
+    // The text and its mapping to the original files, to save them with a snapshot
+    // of the IR that refers to them
+    const std::string &getText() const { return text; }
+    const LineMap &getLineMap() const { return lineMap; }
+    // Replaces the text and mapping by ones saved from another compilation
+    void restore(const std::string &text, const LineMap &lineMap);
+
+    // one for each thread when built with MULTITHREAD, like ErrorReporter::instance;
+    // a thread that helps another with its compilation uses the instance of that thread
+#ifdef MULTITHREAD
+    static thread_local InputSources* instance;
+#else
     static InputSources* instance;
+#endif  // MULTITHREAD
+    // Replaces the instance by an empty one, for the next program compiled in the process
+    static void reset();
 
  private:
     InputSources();
@@ -280,13 +308,18 @@ class InputSources final {
     void appendToLastLine(StringRef text);
     // Append a newline and start a new line
     void appendNewline(StringRef newline);
+    // The text of a line, with its end-of-line character(s)
+    std::string lineText(unsigned lineNumber) const;
 
     // Input program that is being currently compiled; there can be only one.
     bool sealed;
 
-    std::map<unsigned, SourceFileLine> line_file_map;
-    // Each line also stores the end-of-line character(s)
-    std::vector<cstring> contents;
+    LineMap lineMap;
+    // All the lines, each with its end-of-line character(s); kept out of the
+    // cstring table, as only the few lines shown in messages are ever needed as such
+    std::string text;
+    // Offset in 'text' of the start of each line; the last is the line being appended
+    std::vector<size_t> lineStarts;
 };
 
 }  // namespace Util
@@ -0,0 +1,334 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef P4C_LIB_SPARSE_BITVEC_H_
+#define P4C_LIB_SPARSE_BITVEC_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "bitvec.h"
+
+// A set of bits like bitvec, for sets with a few bits spread over a large range, such
+// as a few location ids in the hundreds of thousands, which a bitvec would hold in all
+// the words below the highest.  The range is cut into chunks of 64K bits, and only the
+// chunks with bits set are kept, each as a sorted array of the bits while it has at
+// most 4096 of them, and as a bitmap of 8KB above that, so that neither form is larger
+// than the other would be.  The form only depends on the number of bits in the chunk,
+// so equal sets have equal chunks.
+class sparse_bitvec {
+    static constexpr unsigned chunk_bits = 16;
+    static constexpr size_t chunk_size = size_t(1) << chunk_bits;
+    static constexpr size_t bitmap_words = chunk_size / bitvec::bits_per_unit;
+    // as many entries of 16 bits as fit in the bitmap
+    static constexpr size_t max_array = chunk_size / 16;
+
+    enum op_t { Or, And, Minus };
+
+    struct chunk_t {
+        size_t                  key;  // the index of the bits >> chunk_bits
+        size_t                  count = 0;
+        std::vector<uint16_t>   array;   // while count <= max_array
+        std::vector<uintptr_t>  bitmap;  // otherwise
+
+        explicit chunk_t(size_t key) : key(key) {}
+        bool dense() const { return !bitmap.empty(); }
+        static size_t word(unsigned low) { return low / bitvec::bits_per_unit; }
+        static uintptr_t bit(unsigned low) {
+            return (uintptr_t)1 << (low % bitvec::bits_per_unit); }
+
+        bool get(unsigned low) const {
+            if (dense()) return (bitmap[word(low)] & bit(low)) != 0;
+            return std::binary_search(array.begin(), array.end(), low); }
+        bool set(unsigned low) {
+            if (dense()) {
+                if (bitmap[word(low)] & bit(low)) return false;
+                bitmap[word(low)] |= bit(low);
+            } else {
+                auto it = std::lower_bound(array.begin(), array.end(), low);
+                if (it != array.end() && *it == low) return false;
+                array.insert(it, low); }
+            ++count;
+            normalize();
+            return true; }
+        bool clr(unsigned low) {
+            if (dense()) {
+                if (!(bitmap[word(low)] & bit(low))) return false;
+                bitmap[word(low)] &= ~bit(low);
+            } else {
+                auto it = std::lower_bound(array.begin(), array.end(), low);
+                if (it == array.end() || *it != low) return false;
+                array.erase(it); }
+            --count;
+            normalize();
+            return true; }
+
+        // The first bit at or after 'low', or -1
+        int next(unsigned low) const {
+            if (!dense()) {
+                auto it = std::lower_bound(array.begin(), array.end(), low);
+                return it == array.end() ? -1 : *it; }
+            for (size_t w = word(low); w < bitmap_words; ++w) {
+                uintptr_t v = bitmap[w];
+                if (w == word(low)) v &= ~(bit(low) - 1);
+                if (v) return w * bitvec::bits_per_unit + builtin_ctz(v); }
+            return -1; }
+        int last() const {
+            if (!dense()) return array.back();
+            for (size_t w = bitmap_words; w-- > 0;)
+                if (auto v = bitmap[w])
+                    return w * bitvec::bits_per_unit + bitvec::bits_per_unit - 1 -
+                           builtin_clz(v);
+            return -1; }
+
+        // Picks the form for the number of bits
+        void normalize() {
+            if (dense() && count <= max_array) {
+                array.clear();
+                array.reserve(count);
+                for (size_t w = 0; w < bitmap_words; ++w)
+                    for (uintptr_t v = bitmap[w]; v; v &= v - 1)
+                        array.push_back(w * bitvec::bits_per_unit + builtin_ctz(v));
+                std::vector<uintptr_t>().swap(bitmap);
+            } else if (!dense() && count > max_array) {
+                bitmap.assign(bitmap_words, 0);
+                for (auto low : array)
+                    bitmap[word(low)] |= bit(low);
+                std::vector<uint16_t>().swap(array); } }
+
+        // *this op= other, for chunks of the same key
+        void combine(const chunk_t &other, op_t op) {
+            if (!dense() && (op != Or || !other.dense())) {
+                // the result is a subset of this array, or the union of two arrays
+                std::vector<uint16_t> result;
+                if (!other.dense()) {
+                    auto out = std::back_inserter(result);
+                    auto b = other.array.begin(), e = other.array.end();
+                    if (op == Or)
+                        std::set_union(array.begin(), array.end(), b, e, out);
+                    else if (op == And)
+                        std::set_intersection(array.begin(), array.end(), b, e, out);
+                    else
+                        std::set_difference(array.begin(), array.end(), b, e, out);
+                } else {
+                    for (auto low : array)
+                        if (other.get(low) == (op == And))
+                            result.push_back(low); }
+                array.swap(result);
+                count = array.size();
+                normalize();
+                return; }
+            if (op == And && !other.dense()) {
+                // the bits of the other array that are in this bitmap
+                std::vector<uint16_t> result;
+                for (auto low : other.array)
+                    if (get(low))
+                        result.push_back(low);
+                std::vector<uintptr_t>().swap(bitmap);
+                array.swap(result);
+                count = array.size();
+                return; }
+            if (!dense()) {
+                // an array united with a bitmap
+                bitmap.assign(bitmap_words, 0);
+                for (auto low : array)
+                    bitmap[word(low)] |= bit(low);
+                std::vector<uint16_t>().swap(array); }
+            if (other.dense()) {
+                for (size_t w = 0; w < bitmap_words; ++w) {
+                    if (op == Or) bitmap[w] |= other.bitmap[w];
+                    else if (op == And) bitmap[w] &= other.bitmap[w];
+                    else
+                        bitmap[w] &= ~other.bitmap[w]; }
+            } else {
+                for (auto low : other.array) {
+                    if (op == Or) bitmap[word(low)] |= bit(low);
+                    else
+                        bitmap[word(low)] &= ~bit(low); } }
+            count = 0;
+            for (auto v : bitmap)
+                count += builtin_popcount(v);
+            normalize(); }
+
+        bool operator==(const chunk_t &a) const {
+            return key == a.key && count == a.count && array == a.array && bitmap == a.bitmap; }
+        bool intersects(const chunk_t &a) const {
+            if (!dense()) {
+                for (auto low : array)
+                    if (a.get(low)) return true;
+                return false; }
+            if (!a.dense()) return a.intersects(*this);
+            for (size_t w = 0; w < bitmap_words; ++w)
+                if (bitmap[w] & a.bitmap[w]) return true;
+            return false; }
+        bool contains(const chunk_t &a) const {
+            if (a.count > count) return false;
+            if (!a.dense()) {
+                for (auto low : a.array)
+                    if (!get(low)) return false;
+                return true; }
+            // so this is dense as well
+            for (size_t w = 0; w < bitmap_words; ++w)
+                if (a.bitmap[w] & ~bitmap[w]) return false;
+            return true; }
+    };
+    std::vector<chunk_t> chunks;  // sorted by key, none of them empty
+
+    static size_t key(size_t idx) { return idx >> chunk_bits; }
+    static unsigned low(size_t idx) { return idx & (chunk_size - 1); }
+    chunk_t *find(size_t k) {
+        auto it = std::lower_bound(chunks.begin(), chunks.end(), k,
+                                   [](const chunk_t &c, size_t k) { return c.key < k; });
+        return it != chunks.end() && it->key == k ? &*it : nullptr; }
+    const chunk_t *find(size_t k) const {
+        return const_cast<sparse_bitvec *>(this)->find(k); }
+
+    // Merges the chunks of 'a' into those of this set; true if it changed
+    bool combine(const sparse_bitvec &a, op_t op) {
+        int before = popcount();
+        std::vector<chunk_t> result;
+        result.reserve(op == Or ? chunks.size() + a.chunks.size() : chunks.size());
+        auto it = chunks.begin();
+        auto other = a.chunks.begin();
+        while (it != chunks.end() || other != a.chunks.end()) {
+            if (other == a.chunks.end() || (it != chunks.end() && it->key < other->key)) {
+                if (op != And) result.push_back(std::move(*it));
+                ++it;
+            } else if (it == chunks.end() || other->key < it->key) {
+                if (op == Or) result.push_back(*other);
+                ++other;
+            } else {
+                it->combine(*other, op);
+                if (it->count > 0) result.push_back(std::move(*it));
+                ++it;
+                ++other; } }
+        chunks.swap(result);
+        return popcount() != before; }
+
+ public:
+    sparse_bitvec() = default;
+    explicit sparse_bitvec(const bitvec &bv) { for (auto i : bv) setbit(i); }
+
+    // Iterates over the bits that are set, in increasing order
+    class const_iterator : public std::iterator<std::forward_iterator_tag, int> {
+        friend class sparse_bitvec;
+        const sparse_bitvec     *self;
+        size_t                  chunk;
+        int                     idx;  // -1 at the end
+        const_iterator(const sparse_bitvec *self, size_t chunk, int idx)
+        : self(self), chunk(chunk), idx(idx) {}
+
+     public:
+        int operator*() const { return idx; }
+        bool operator==(const const_iterator &a) const { return idx == a.idx; }
+        bool operator!=(const const_iterator &a) const { return idx != a.idx; }
+        const_iterator &operator++() {
+            auto &c = self->chunks[chunk];
+            int next = low(idx) + 1 < chunk_size ? c.next(low(idx) + 1) : -1;
+            if (next >= 0) {
+                idx = (c.key << chunk_bits) + next;
+            } else if (++chunk < self->chunks.size()) {
+                auto &n = self->chunks[chunk];
+                idx = (n.key << chunk_bits) + n.next(0);
+            } else {
+                idx = -1; }
+            return *this; }
+    };
+    typedef const_iterator iterator;
+
+    void clear() { chunks.clear(); }
+    bool setbit(size_t idx) {
+        auto c = find(key(idx));
+        if (!c) {
+            auto it = std::lower_bound(chunks.begin(), chunks.end(), key(idx),
+                                       [](const chunk_t &c, size_t k) { return c.key < k; });
+            c = &*chunks.emplace(it, key(idx)); }
+        c->set(low(idx));
+        return true; }
+    bool clrbit(size_t idx) {
+        if (auto c = find(key(idx))) {
+            c->clr(low(idx));
+            if (c->count == 0)
+                chunks.erase(chunks.begin() + (c - chunks.data())); }
+        return false; }
+    bool getbit(size_t idx) const {
+        auto c = find(key(idx));
+        return c && c->get(low(idx)); }
+    bool operator[](size_t idx) const { return getbit(idx); }
+
+    // The first bit set at or after 'start', or -1
+    int ffs(size_t start = 0) const {
+        auto it = std::lower_bound(chunks.begin(), chunks.end(), key(start),
+                                   [](const chunk_t &c, size_t k) { return c.key < k; });
+        for (; it != chunks.end(); ++it) {
+            int next = it->next(it->key == key(start) ? low(start) : 0);
+            if (next >= 0) return (it->key << chunk_bits) + next; }
+        return -1; }
+    int max() const {
+        return chunks.empty() ? -1 : (chunks.back().key << chunk_bits) + chunks.back().last(); }
+    const_iterator begin() const {
+        return chunks.empty() ? end() : const_iterator(this, 0, ffs()); }
+    const_iterator end() const { return const_iterator(this, chunks.size(), -1); }
+
+    bool empty() const { return chunks.empty(); }
+    explicit operator bool() const { return !empty(); }
+    int popcount() const {
+        size_t rv = 0;
+        for (auto &c : chunks) rv += c.count;
+        return rv; }
+
+    bool operator|=(const sparse_bitvec &a) { return combine(a, Or); }
+    bool operator&=(const sparse_bitvec &a) { return combine(a, And); }
+    bool operator-=(const sparse_bitvec &a) { return combine(a, Minus); }
+    sparse_bitvec operator|(const sparse_bitvec &a) const {
+        sparse_bitvec rv(*this); rv |= a; return rv; }
+    sparse_bitvec operator&(const sparse_bitvec &a) const {
+        sparse_bitvec rv(*this); rv &= a; return rv; }
+    sparse_bitvec operator-(const sparse_bitvec &a) const {
+        sparse_bitvec rv(*this); rv -= a; return rv; }
+    bool operator==(const sparse_bitvec &a) const { return chunks == a.chunks; }
+    bool operator!=(const sparse_bitvec &a) const { return !(*this == a); }
+    bool intersects(const sparse_bitvec &a) const {
+        for (auto &c : chunks)
+            if (auto o = a.find(c.key))
+                if (c.intersects(*o)) return true;
+        return false; }
+    bool contains(const sparse_bitvec &a) const {  // is 'a' a subset or equal to 'this'?
+        for (auto &o : a.chunks) {
+            auto c = find(o.key);
+            if (!c || !c->contains(o)) return false; }
+        return true; }
+
+    bitvec to_bitvec() const {
+        bitvec rv;
+        if (!empty()) rv.reserve(max() + 1);
+        for (auto i : *this) rv.setbit(i);
+        return rv; }
+
+    friend std::ostream &operator<<(std::ostream &out, const sparse_bitvec &bv) {
+        const char *sep = "";
+        out << '{';
+        for (auto i : bv) {
+            out << sep << i;
+            sep = ", "; }
+        return out << '}'; }
+};
+
+#endif /* P4C_LIB_SPARSE_BITVEC_H_ */
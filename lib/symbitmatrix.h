@@ -17,29 +17,51 @@ limitations under the License.
 #ifndef P4C_LIB_SYMBITMATRIX_H_
 #define P4C_LIB_SYMBITMATRIX_H_
 
+#include <vector>
 #include "bitvec.h"
+#include "ltbitmatrix.h"
 
 /* A symmetric bit matrix, held in a bit vector.  We only store a triangular submatrix which
  * is used for both halves, so modifying one bit modifies both sides, keeping the matrix
- * always symmetric.  Iterating over the matrix only iterates over the lower triangle */
+ * always symmetric.  Iterating over the matrix only iterates over the lower triangle.
+ * The triangle has the blocked layout of LTBitMatrix, so the lower part of a row is whole
+ * words, and the upper part, which is a column of the triangle, is one word per row, with
+ * the rows of a block next to each other. */
 class SymBitMatrix : private bitvec {
+    static size_t rowbase(unsigned r) { return LTBitMatrix::rowbase(r); }
+
  public:
     nonconst_bitref operator()(unsigned r, unsigned c) {
         if (r < c) std::swap(r, c);
-        return bitvec::operator[]((r*r+r)/2 + c); }
+        return bitvec::operator[](rowbase(r) + c); }
     bool operator()(unsigned r, unsigned c) const {
         if (r < c) std::swap(r, c);
-        return bitvec::operator[]((r*r+r)/2 + c); }
-    unsigned size() const {
-        if (empty()) return 0;
-        unsigned m = *max();
-        unsigned r = 1;
-        while ((r*r+r)/2 <= m) r++;
-        return r; }
+        return bitvec::getbit(rowbase(r) + c); }
+    unsigned size() const { return empty() ? 0 : LTBitMatrix::rows(max().index()); }
     using bitvec::clear;
     using bitvec::empty;
     using bitvec::operator bool;
 
+    // Makes each set of rows that are linked, directly or through others, all linked
+    // to each other, and to themselves
+    void transitive_closure() {
+        unsigned n = size();
+        std::vector<unsigned> leader(n);
+        std::vector<bool> linked(n);
+        for (unsigned i = 0; i < n; ++i) leader[i] = i;
+        auto find = [&leader](unsigned i) {
+            while (leader[i] != i) i = leader[i] = leader[leader[i]];
+            return i; };
+        for (unsigned r = 0; r < n; ++r) {
+            for (auto c : getslice(rowbase(r), r+1)) {
+                linked[r] = linked[c] = true;
+                leader[find(c)] = find(r); } }
+        std::vector<bitvec> members(n);
+        for (unsigned i = 0; i < n; ++i)
+            if (linked[i]) members[find(i)].setbit(i);
+        for (unsigned i = 0; i < n; ++i)
+            if (linked[i]) or_shifted(members[find(i)].getslice(0, i+1), rowbase(i)); }
+
  private:
     template<class T> class rowref {
         friend class SymBitMatrix;
@@ -51,27 +73,26 @@ class SymBitMatrix : private bitvec {
         rowref(const rowref &) = default;
         rowref(rowref &&) = default;
         explicit operator bool() const {
-            if (row < bits_per_unit) {
-                if (self.getrange((row*row+row)/2, row+1) != 0) return true;
-            } else {
-                if (self.getslice((row*row+row)/2, row+1)) return true; }
-            for (auto c = self.size()-1; c > row; --c)
-                if (self(row, c)) return true;
+            size_t base = rowbase(row);
+            for (unsigned i = 0; i <= row / bits_per_unit; ++i)
+                if (self.getrange(base + i*bits_per_unit, bits_per_unit)) return true;
+            for (unsigned c = row+1, n = self.size(); c < n; ++c)
+                if (self.getbit(rowbase(c) + row)) return true;
             return false; }
         operator bitvec() const {
-            auto rv = self.getslice((row*row+row)/2, row+1);
-            for (auto c = self.size()-1; c > row; --c)
-                if (self(row, c)) rv[c] = 1;
+            auto rv = self.getslice(rowbase(row), row+1);
+            for (unsigned c = row+1, n = self.size(); c < n; ++c)
+                if (self.getbit(rowbase(c) + row)) rv.setbit(c);
             return rv; }
     };
     class nonconst_rowref : public rowref<SymBitMatrix> {
      public:
         friend class SymBitMatrix;
         using rowref<SymBitMatrix>::rowref;
-        void operator|=(bitvec a) const {
-            for (auto col = a[row]; ++col != a.end();)
-                self(row, *col) = 1;
-            a.clrrange(row+1, ~0); self |= a << (row*row+row)/2; }
+        void operator|=(const bitvec &a) const {
+            for (int col = a.ffs(row+1); col >= 0; col = a.ffs(col+1))
+                self.setbit(rowbase(col) + row);
+            self.or_shifted(a.getslice(0, row+1), rowbase(row)); }
         nonconst_bitref operator[](unsigned col) const { return self(row, col); }
     };
     class const_rowref : public rowref<const SymBitMatrix> {
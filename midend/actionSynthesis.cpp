@@ -46,7 +46,7 @@ const IR::Node* DoMoveActionsToTables::postorder(IR::MethodCallStatement* statem
               "%1%: Expected a PathExpression", ac->expr->method);
     auto actionPath = new IR::PathExpression(IR::ID(mc->srcInfo, ac->action->name));
     auto call = new IR::MethodCallExpression(mc->srcInfo, actionPath,
-                                             new IR::Vector<IR::Type>(), directionArgs);
+                                             IR::Vector<IR::Type>::emptyInstance(), directionArgs);
     auto actinst = new IR::ActionListElement(statement->srcInfo, IR::Annotations::empty, call);
     auto actions = new IR::IndexedVector<IR::ActionListElement>();
     actions->push_back(actinst);
@@ -84,7 +84,7 @@ const IR::Node* DoMoveActionsToTables::postorder(IR::MethodCallStatement* statem
     auto tblpath = new IR::PathExpression(tblName);
     auto method = new IR::Member(Util::SourceInfo(), tblpath, IR::IApply::applyMethodName);
     auto mce = new IR::MethodCallExpression(
-        statement->srcInfo, method, new IR::Vector<IR::Type>(),
+        statement->srcInfo, method, IR::Vector<IR::Type>::emptyInstance(),
         new IR::Vector<IR::Expression>());
     auto stat = new IR::MethodCallStatement(mce->srcInfo, mce);
     return stat;
@@ -104,6 +104,96 @@ const IR::Node* DoMoveActionsToTables::postorder(IR::P4Control* control) {
 
 /////////////////////////////////////////////////////////////////////
 
+const IR::MethodCallExpression* FindFixedTables::fixedCall(const IR::P4Table* table) const {
+    if (table->parameters->size() != 0)
+        return nullptr;
+    for (auto p : *table->properties->properties) {
+        auto name = p->name.name;
+        if (name != IR::TableProperties::keyPropertyName &&
+            name != IR::TableProperties::actionsPropertyName &&
+            name != IR::TableProperties::defaultActionPropertyName &&
+            name != "size")
+            return nullptr;
+    }
+    auto prop = table->properties->getProperty(IR::TableProperties::defaultActionPropertyName);
+    if (prop == nullptr || !prop->isConstant)
+        return nullptr;
+    auto defaultAction = table->getDefaultAction();
+    auto actions = table->getActionList();
+    if (defaultAction == nullptr || actions == nullptr)
+        return nullptr;
+
+    auto method = defaultAction;
+    auto defaultArgs = IR::Vector<IR::Expression>::emptyInstance();
+    if (auto mc = defaultAction->to<IR::MethodCallExpression>()) {
+        method = mc->method;
+        defaultArgs = mc->arguments;
+    }
+    auto path = method->to<IR::PathExpression>();
+    if (path == nullptr)
+        return nullptr;
+    auto action = refMap->getDeclaration(path->path, true)->to<IR::P4Action>();
+    if (action == nullptr)
+        return nullptr;
+    const IR::ActionListElement* element = nullptr;
+    for (auto e : *actions->actionList)
+        if (refMap->getDeclaration(e->getPath(), true) == action)
+            element = e;
+    if (element == nullptr)
+        return nullptr;
+
+    auto key = table->getKey();
+    if (key != nullptr && !key->keyElements->empty()) {
+        // the entries can only run the same action, with the same arguments
+        if (actions->size() != 1)
+            return nullptr;
+        for (auto p : *action->parameters->parameters)
+            if (p->direction == IR::Direction::None)
+                return nullptr;
+    }
+
+    auto args = new IR::Vector<IR::Expression>();
+    if (auto mc = element->expression->to<IR::MethodCallExpression>())
+        args->append(*mc->arguments);
+    args->append(*defaultArgs);
+    if (args->size() != action->parameters->size())
+        return nullptr;
+    auto actionPath = new IR::PathExpression(IR::ID(defaultAction->srcInfo, action->name));
+    return new IR::MethodCallExpression(defaultAction->srcInfo, actionPath,
+                                        IR::Vector<IR::Type>::emptyInstance(), args);
+}
+
+bool FindFixedTables::preorder(const IR::P4Table* table) {
+    // the application must be a statement of its own, which the call replaces
+    auto &sites = applies->sitesOf(table);
+    if (sites.size() != 1 || sites[0].use != TableApplyIndex::Use::Statement)
+        return false;
+    if (auto call = fixedCall(table)) {
+        LOG1("Table " << dbp(table) << " always runs " << call);
+        (*fixed)[table] = call;
+    }
+    return false;
+}
+
+const IR::Node* DoInlineFixedTables::postorder(IR::P4Table* table) {
+    if (fixed->count(getOriginal<IR::P4Table>()))
+        return nullptr;
+    return table;
+}
+
+const IR::Node* DoInlineFixedTables::postorder(IR::MethodCallStatement* statement) {
+    auto mi = MethodInstance::resolve(getOriginal<IR::MethodCallStatement>(), refMap, typeMap);
+    auto am = mi->to<ApplyMethod>();
+    if (am == nullptr || !am->isTableApply())
+        return statement;
+    auto it = fixed->find(am->object->to<IR::P4Table>());
+    if (it == fixed->end())
+        return statement;
+    return new IR::MethodCallStatement(statement->srcInfo, it->second);
+}
+
+/////////////////////////////////////////////////////////////////////
+
 bool DoSynthesizeActions::mustMove(const IR::MethodCallStatement* statement) {
     auto mi = MethodInstance::resolve(statement, refMap, typeMap);
     if (mi->is<ActionCall>() || mi->is<ApplyMethod>())
@@ -208,7 +298,7 @@ const IR::Statement* DoSynthesizeActions::createAction(const IR::Statement* toAd
     actions.push_back(action);
     auto actpath = new IR::PathExpression(name);
     auto repl = new IR::MethodCallExpression(Util::SourceInfo(), actpath,
-                                             new IR::Vector<IR::Type>(),
+                                             IR::Vector<IR::Type>::emptyInstance(),
                                              new IR::Vector<IR::Expression>());
     auto result = new IR::MethodCallStatement(repl->srcInfo, repl);
     return result;
@@ -18,6 +18,7 @@ limitations under the License.
 #define _MIDEND_ACTIONSYNTHESIS_H_
 
 #include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/tableApply.h"
 #include "frontends/p4/typeChecking/typeChecker.h"
 
 namespace P4 {
@@ -103,6 +104,80 @@ class DoSynthesizeActions : public Transform {
     const IR::Statement* createAction(const IR::Statement* body);
 };
 
+// The reverse of MoveActionsToTables, for the tables that always run the same action:
+// tables without a key and with a const default_action, and tables whose only action
+// is their const default_action and takes no data from the control plane.  When all
+// the applications of such a table are statements, they become calls of the action,
+// with the arguments of the action list and of the default action, and the table is
+// removed.  A target then runs the action without looking up the table.
+// control c() {
+//   action x(in bit b) { ... }
+//   table t() {
+//     actions = { x(e); }
+//     const default_action = x();
+//   }
+//   apply { t.apply(); }
+// }
+// turns into
+// control c() {
+//   action x(in bit b) { ... }
+//   apply { x(e); }
+// }
+// Tables with other properties, such as an implementation or counters, and tables
+// that are applied more than once are kept.
+class FindFixedTables : public Inspector {
+    ReferenceMap*          refMap;
+    TypeMap*               typeMap;
+    const TableApplyIndex* applies;
+
+    const IR::MethodCallExpression* fixedCall(const IR::P4Table* table) const;
+
+ public:
+    // each table to remove -> the action call that replaces its applications
+    std::map<const IR::P4Table*, const IR::MethodCallExpression*>* fixed;
+
+    FindFixedTables(ReferenceMap* refMap, TypeMap* typeMap, const TableApplyIndex* applies,
+                    std::map<const IR::P4Table*, const IR::MethodCallExpression*>* fixed) :
+            refMap(refMap), typeMap(typeMap), applies(applies), fixed(fixed)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(applies); CHECK_NULL(fixed);
+      setName("FindFixedTables"); }
+    Visitor::profile_t init_apply(const IR::Node* node) override {
+        fixed->clear();
+        return Inspector::init_apply(node); }
+    bool preorder(const IR::P4Table* table) override;
+};
+
+class DoInlineFixedTables : public Transform {
+    ReferenceMap* refMap;
+    TypeMap*      typeMap;
+    const std::map<const IR::P4Table*, const IR::MethodCallExpression*>* fixed;
+
+ public:
+    DoInlineFixedTables(ReferenceMap* refMap, TypeMap* typeMap,
+                        const std::map<const IR::P4Table*,
+                                       const IR::MethodCallExpression*>* fixed) :
+            refMap(refMap), typeMap(typeMap), fixed(fixed)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(fixed);
+      setName("DoInlineFixedTables"); }
+    const IR::Node* preorder(IR::P4Parser* parser) override
+    { prune(); return parser; }
+    const IR::Node* postorder(IR::P4Table* table) override;
+    const IR::Node* postorder(IR::MethodCallStatement* statement) override;
+};
+
+class InlineFixedTables : public PassManager {
+    std::map<const IR::P4Table*, const IR::MethodCallExpression*> fixed;
+ public:
+    InlineFixedTables(ReferenceMap* refMap, TypeMap* typeMap) {
+        auto applies = new TableApplyIndex(refMap, typeMap);
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        passes.push_back(applies);
+        passes.push_back(new FindFixedTables(refMap, typeMap, applies, &fixed));
+        passes.push_back(new DoInlineFixedTables(refMap, typeMap, &fixed));
+        setName("InlineFixedTables");
+    }
+};
+
 class SynthesizeActions : public PassManager {
  public:
     SynthesizeActions(ReferenceMap* refMap, TypeMap* typeMap) {
@@ -0,0 +1,207 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include "commonSubexpressions.h"
+#include "expr_uses.h"
+#include "has_side_effects.h"
+#include "frontends/p4/toP4/toP4.h"
+
+namespace P4 {
+
+namespace {
+
+// The variable that an assignment to this expression writes part of, or a null
+// cstring if it is not known
+cstring writtenVariable(const IR::Expression* expression) {
+    while (true) {
+        if (auto member = expression->to<IR::Member>())
+            expression = member->expr;
+        else if (auto index = expression->to<IR::ArrayIndex>())
+            expression = index->left;
+        else if (auto slice = expression->to<IR::Slice>())
+            expression = slice->e0;
+        else
+            break;
+    }
+    if (auto path = expression->to<IR::PathExpression>())
+        return path->path->name;
+    return nullptr;
+}
+
+}  // namespace
+
+bool DoCommonSubexpressions::isOperation(const IR::Expression* expression) const {
+    // field accesses are as cheap as the temporary would be
+    if (expression->is<IR::Member>() || expression->is<IR::ArrayIndex>() ||
+        expression->is<IR::Slice>())
+        return false;
+    if (!expression->is<IR::Operation_Unary>() && !expression->is<IR::Operation_Binary>() &&
+        !expression->is<IR::Operation_Ternary>())
+        return false;
+    return typeMap->getType(expression, true)->is<IR::Type_Bits>();
+}
+
+const IR::PathExpression* DoCommonSubexpressions::variable(const candidate_t& candidate) const {
+    auto result = new IR::PathExpression(IR::ID(candidate.temporary, nullptr));
+    typeMap->setType(result, typeMap->getType(candidate.expression, true));
+    return result;
+}
+
+void DoCommonSubexpressions::collect(const IR::Expression* expression, size_t statement) {
+    if (isOperation(expression)) {
+        std::stringstream text;
+        text << typeMap->getType(expression, true)->toString() << " ";
+        P4::ToP4 toP4(&text, false);
+        expression->apply(toP4);
+        cstring key = text.str();
+        auto it = available.find(key);
+        if (it != available.end()) {
+            // its operands are computed in the temporary
+            candidates.at(it->second).uses++;
+            occurrences.emplace(std::make_pair(statement, expression), it->second);
+            return;
+        }
+        available.emplace(key, candidates.size());
+        occurrences.emplace(std::make_pair(statement, expression), candidates.size());
+        candidates.emplace_back(expression, statement);
+    }
+    if (auto u = expression->to<IR::Operation_Unary>()) {
+        collect(u->expr, statement);
+    } else if (auto b = expression->to<IR::Operation_Binary>()) {
+        collect(b->left, statement);
+        collect(b->right, statement);
+    } else if (auto t = expression->to<IR::Operation_Ternary>()) {
+        collect(t->e0, statement);
+        collect(t->e1, statement);
+        collect(t->e2, statement);
+    }
+}
+
+const IR::Expression* DoCommonSubexpressions::replace(const IR::Expression* expression,
+                                                      size_t statement, bool top) {
+    if (top) {
+        auto it = occurrences.find(std::make_pair(statement, expression));
+        if (it != occurrences.end() && !candidates.at(it->second).temporary.isNull())
+            return variable(candidates.at(it->second));
+    }
+    auto type = typeMap->getType(expression, true);
+    if (auto u = expression->to<IR::Operation_Unary>()) {
+        auto e = replace(u->expr, statement);
+        if (e == u->expr)
+            return expression;
+        auto result = u->clone();
+        result->expr = e;
+        typeMap->setType(result, type);
+        return result;
+    } else if (auto b = expression->to<IR::Operation_Binary>()) {
+        auto left = replace(b->left, statement);
+        auto right = replace(b->right, statement);
+        if (left == b->left && right == b->right)
+            return expression;
+        auto result = b->clone();
+        result->left = left;
+        result->right = right;
+        typeMap->setType(result, type);
+        return result;
+    } else if (auto t = expression->to<IR::Operation_Ternary>()) {
+        auto e0 = replace(t->e0, statement);
+        auto e1 = replace(t->e1, statement);
+        auto e2 = replace(t->e2, statement);
+        if (e0 == t->e0 && e1 == t->e1 && e2 == t->e2)
+            return expression;
+        auto result = t->clone();
+        result->e0 = e0;
+        result->e1 = e1;
+        result->e2 = e2;
+        typeMap->setType(result, type);
+        return result;
+    }
+    return expression;
+}
+
+void DoCommonSubexpressions::run(const std::vector<const IR::AssignmentStatement*>& statements,
+                                 IR::IndexedVector<IR::StatOrDecl>* result) {
+    candidates.clear();
+    available.clear();
+    occurrences.clear();
+    for (size_t i = 0; i < statements.size(); ++i) {
+        collect(statements[i]->right, i);
+        cstring written = writtenVariable(statements[i]->left);
+        for (auto it = available.begin(); it != available.end();) {
+            if (written.isNull() || exprUses(candidates.at(it->second).expression, written))
+                it = available.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    bool changes = false;
+    for (auto& c : candidates) {
+        if (c.uses < 2)
+            continue;
+        c.temporary = refMap->newName("tmp");
+        changes = true;
+    }
+    if (!changes) {
+        for (auto s : statements)
+            result->push_back(s);
+        return;
+    }
+
+    for (size_t i = 0; i < statements.size(); ++i) {
+        // an operation comes before those that contain it, which were found first
+        for (size_t j = candidates.size(); j-- > 0;) {
+            auto& c = candidates.at(j);
+            if (c.first != i || c.temporary.isNull())
+                continue;
+            LOG1("Computing " << c.expression << " once in " << c.temporary);
+            auto type = typeMap->getType(c.expression, true);
+            result->push_back(new IR::Declaration_Variable(
+                Util::SourceInfo(), IR::ID(c.temporary, nullptr), IR::Annotations::empty,
+                type, nullptr));
+            result->push_back(new IR::AssignmentStatement(
+                c.expression->srcInfo, variable(c), replace(c.expression, i, false)));
+        }
+        auto s = statements[i];
+        auto right = replace(s->right, i);
+        if (right == s->right)
+            result->push_back(s);
+        else
+            result->push_back(new IR::AssignmentStatement(s->srcInfo, s->left, right));
+    }
+}
+
+const IR::Node* DoCommonSubexpressions::preorder(IR::BlockStatement* block) {
+    auto components = new IR::IndexedVector<IR::StatOrDecl>();
+    std::vector<const IR::AssignmentStatement*> statements;
+    for (auto s : *block->components) {
+        auto assign = s->to<IR::AssignmentStatement>();
+        if (assign != nullptr && !hasSideEffects(assign->right)) {
+            statements.push_back(assign);
+            continue;
+        }
+        run(statements, components);
+        statements.clear();
+        components->push_back(s);
+    }
+    run(statements, components);
+    if (components->size() != block->components->size())
+        block->components = components;
+    return block;
+}
+
+}  // namespace P4
@@ -0,0 +1,85 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MIDEND_COMMONSUBEXPRESSIONS_H_
+#define _MIDEND_COMMONSUBEXPRESSIONS_H_
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+#include "frontends/p4/typeMap.h"
+
+namespace P4 {
+
+// Computes once the operations that a run of assignments in a block computes more
+// than once, in a temporary declared before the first of them, e.g.
+//   a = x + y; b = (x + y) << 1;
+// becomes
+//   bit<8> tmp; tmp = x + y; a = tmp; b = tmp << 1;
+// Two operations are the same if they print the same and have the same type, and
+// no assignment between them writes any variable they read.  Only operations on
+// bit<> without side effects are considered, and any statement other than an
+// assignment without side effects, such as a table apply, an extern call, or an if,
+// ends the run.  Must run after UniqueNames, and before MoveDeclarations, which
+// moves the temporaries to the top.
+class DoCommonSubexpressions : public Transform {
+    ReferenceMap* refMap;
+    TypeMap* typeMap;
+
+    // An operation that the run computes, from the statement where it appears first
+    struct candidate_t {
+        const IR::Expression* expression;
+        size_t first;
+        unsigned uses = 1;
+        cstring temporary;  // if it is computed in one
+        candidate_t(const IR::Expression* expression, size_t first) :
+                expression(expression), first(first) {}
+    };
+    std::vector<candidate_t> candidates;
+    // the text of the operations that are still valid -> their index in candidates
+    std::map<cstring, size_t> available;
+    // (statement, operation) -> its index in candidates
+    std::map<std::pair<size_t, const IR::Expression*>, size_t> occurrences;
+
+    bool isOperation(const IR::Expression* expression) const;
+    const IR::PathExpression* variable(const candidate_t& candidate) const;
+    void collect(const IR::Expression* expression, size_t statement);
+    const IR::Expression* replace(const IR::Expression* expression, size_t statement,
+                                  bool top = true);
+    void run(const std::vector<const IR::AssignmentStatement*>& statements,
+             IR::IndexedVector<IR::StatOrDecl>* result);
+
+ public:
+    DoCommonSubexpressions(ReferenceMap* refMap, TypeMap* typeMap) :
+            refMap(refMap), typeMap(typeMap)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("DoCommonSubexpressions"); }
+    const IR::Node* preorder(IR::P4Parser* parser) override
+    { prune(); return parser; }
+    const IR::Node* preorder(IR::BlockStatement* block) override;
+};
+
+class CommonSubexpressions : public PassManager {
+ public:
+    CommonSubexpressions(ReferenceMap* refMap, TypeMap* typeMap) {
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        passes.push_back(new DoCommonSubexpressions(refMap, typeMap));
+        setName("CommonSubexpressions");
+    }
+};
+
+}  // namespace P4
+
+#endif /* _MIDEND_COMMONSUBEXPRESSIONS_H_ */
@@ -34,6 +34,14 @@ class ChooseEnumRepresentation {
     // to represent the enum.  Obviously, we must have
     // 2^(return) >= enumCount.
     virtual unsigned enumSize(unsigned enumCount) const = 0;
+    // The fewest bits that can hold enumCount values, and at least 1.  The values of
+    // an enum are numbered densely from 0, in the order of their declaration, so a
+    // policy that wants the narrowest fields can return this from enumSize.
+    static unsigned minimalSize(unsigned enumCount) {
+        unsigned width = 1;
+        while (width < 32 && (1U << width) < enumCount)
+            width++;
+        return width; }
 };
 
 class EnumRepresentation {
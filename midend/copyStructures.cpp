@@ -18,50 +18,63 @@ limitations under the License.
 
 namespace P4 {
 
-const IR::Node* DoCopyStructures::postorder(IR::AssignmentStatement* statement) {
-    auto ltype = typeMap->getType(statement->left, true);
-    if (ltype->is<IR::Type_StructLike>()) {
-        auto retval = new IR::Vector<IR::StatOrDecl>();
-        auto strct = ltype->to<IR::Type_StructLike>();
-        if (statement->right->is<IR::ListExpression>()) {
-            auto list = statement->right->to<IR::ListExpression>();
+// Appends to 'result' the assignments of the fields of 'right' to those of 'left',
+// expanding the fields that are themselves structures or stacks, so that the
+// program needs a single pass however deeply the structures are nested.  Returns
+// false if an assignment of this type is kept as it is.
+bool DoCopyStructures::expand(const IR::AssignmentStatement* statement,
+                              const IR::Expression* left, const IR::Expression* right,
+                              const IR::Type* type, IR::Vector<IR::StatOrDecl>* result) {
+    if (type->is<IR::Type_StructLike>()) {
+        auto strct = type->to<IR::Type_StructLike>();
+        if (right->is<IR::ListExpression>()) {
+            auto list = right->to<IR::ListExpression>();
             unsigned index = 0;
             for (auto f : *strct->fields) {
-                auto right = list->components->at(index);
-                auto left = new IR::Member(Util::SourceInfo(), statement->left, f->name);
-                retval->push_back(new IR::AssignmentStatement(statement->srcInfo, left, right));
+                auto r = list->components->at(index);
+                auto l = new IR::Member(Util::SourceInfo(), left, f->name);
+                if (!expand(statement, l, r, f->type, result))
+                    result->push_back(new IR::AssignmentStatement(statement->srcInfo, l, r));
                 index++;
             }
         } else {
-            if (ltype->is<IR::Type_Header>())
+            if (type->is<IR::Type_Header>())
                 // Leave headers as they are -- copy_header will also copy the valid bit
-                return statement;
+                return false;
 
             for (auto f : *strct->fields) {
-                BUG_CHECK(statement->right->is<IR::PathExpression>() ||
-                          statement->right->is<IR::Member>() ||
-                          statement->right->is<IR::ArrayIndex>(),
-                          "%1%: Unexpected operation when eliminating struct copying", statement->right);
-                auto right = new IR::Member(Util::SourceInfo(), statement->right, f->name);
-                auto left = new IR::Member(Util::SourceInfo(), statement->left, f->name);
-                retval->push_back(new IR::AssignmentStatement(statement->srcInfo, left, right));
+                BUG_CHECK(right->is<IR::PathExpression>() ||
+                          right->is<IR::Member>() ||
+                          right->is<IR::ArrayIndex>(),
+                          "%1%: Unexpected operation when eliminating struct copying", right);
+                auto r = new IR::Member(Util::SourceInfo(), right, f->name);
+                auto l = new IR::Member(Util::SourceInfo(), left, f->name);
+                if (!expand(statement, l, r, f->type, result))
+                    result->push_back(new IR::AssignmentStatement(statement->srcInfo, l, r));
             }
         }
-        return retval;
-    } else if (ltype->is<IR::Type_Stack>()) {
-        auto retval = new IR::Vector<IR::StatOrDecl>();
-        auto stack = ltype->to<IR::Type_Stack>();
+        return true;
+    } else if (type->is<IR::Type_Stack>()) {
+        auto stack = type->to<IR::Type_Stack>();
         for (unsigned i = 0; i < stack->getSize(); i++) {
             auto index = new IR::Constant(i);
-            BUG_CHECK(statement->right->is<IR::PathExpression>() || statement->right->is<IR::Member>(),
-                      "%1%: Unexpected operation when eliminating struct copying", statement->right);
-            auto right = new IR::ArrayIndex(Util::SourceInfo(), statement->right, index);
-            auto left = new IR::ArrayIndex(Util::SourceInfo(), statement->left, index->clone());
-            retval->push_back(new IR::AssignmentStatement(statement->srcInfo, left, right));
+            BUG_CHECK(right->is<IR::PathExpression>() || right->is<IR::Member>(),
+                      "%1%: Unexpected operation when eliminating struct copying", right);
+            auto r = new IR::ArrayIndex(Util::SourceInfo(), right, index);
+            auto l = new IR::ArrayIndex(Util::SourceInfo(), left, index->clone());
+            if (!expand(statement, l, r, stack->elementType, result))
+                result->push_back(new IR::AssignmentStatement(statement->srcInfo, l, r));
         }
-        return retval;
+        return true;
     }
+    return false;
+}
 
+const IR::Node* DoCopyStructures::postorder(IR::AssignmentStatement* statement) {
+    auto ltype = typeMap->getType(statement->left, true);
+    auto retval = new IR::Vector<IR::StatOrDecl>();
+    if (expand(statement, statement->left, statement->right, ltype, retval))
+        return retval;
     return statement;
 }
 
@@ -25,16 +25,19 @@ namespace P4 {
 // Convert assignments between structures to assignments between fields
 class DoCopyStructures : public Transform {
     TypeMap* typeMap;
+    bool expand(const IR::AssignmentStatement* statement,
+                const IR::Expression* left, const IR::Expression* right,
+                const IR::Type* type, IR::Vector<IR::StatOrDecl>* result);
  public:
     explicit DoCopyStructures(TypeMap* typeMap) : typeMap(typeMap)
     { CHECK_NULL(typeMap); setName("DoCopyStructures"); }
     const IR::Node* postorder(IR::AssignmentStatement* statement) override;
 };
 
-class CopyStructures : public PassRepeated {
+// DoCopyStructures expands nested structures at once, so one round is enough.
+class CopyStructures : public PassManager {
  public:
-    CopyStructures(ReferenceMap* refMap, TypeMap* typeMap) :
-            PassManager({}) {
+    CopyStructures(ReferenceMap* refMap, TypeMap* typeMap) {
         CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("CopyStructures");
         passes.emplace_back(new TypeChecking(refMap, typeMap));
         passes.emplace_back(new DoCopyStructures(typeMap));
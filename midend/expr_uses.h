@@ -32,7 +32,9 @@ class exprUses : public Inspector {
         return !result; }
     bool preorder(const IR::Expression *) override { return !result; }
  public:
-    exprUses(const IR::Expression *e, cstring n) : look_for(n) { e->apply(*this); }
+    exprUses(const IR::Expression *e, cstring n) : look_for(n) {
+        visitOnly<IR::Path, IR::Primitive>();
+        e->apply(*this); }
     explicit operator bool () { return result; }
 };
 
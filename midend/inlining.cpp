@@ -14,6 +14,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
 #include "lib/nullstream.h"
 #include "frontends/p4/def_use.h"
 
@@ -179,28 +180,17 @@ class FindLocationSets : public Inspector {
 //   apply { t.apply(); }
 // }
 // So the externally visible name for the table is "cinst.t"
-class ComputeNewNames : public Inspector {
-    cstring           prefix;
-    P4::ReferenceMap* refMap;
-    SymRenameMap*     renameMap;
+// The declarations of a callee that are renamed in each instance, in the order
+// in which they are named
+class FindRenamedDeclarations : public Inspector {
+    std::vector<const IR::Declaration*>* decls;
  public:
-    ComputeNewNames(cstring prefix, P4::ReferenceMap* refMap, SymRenameMap* renameMap) :
-            prefix(prefix), refMap(refMap), renameMap(renameMap) {
-        BUG_CHECK(!prefix.isNullOrEmpty(), "Null prefix");
-        CHECK_NULL(refMap); CHECK_NULL(renameMap);
-    }
-
-    void rename(const IR::Declaration* decl) {
-        BUG_CHECK(decl->is<IR::IAnnotated>(), "%1%: no annotations", decl);
-        cstring name = decl->externalName();
-        cstring extName = prefix + "." + name;
-        cstring baseName = extName.replace('.', '_');
-        cstring newName = refMap->newName(baseName);
-        renameMap->setNewName(decl, newName, extName);
-    }
-    void postorder(const IR::P4Table* table) override { rename(table); }
-    void postorder(const IR::P4Action* action) override { rename(action); }
-    void postorder(const IR::Declaration_Instance* instance) override { rename(instance); }
+    explicit FindRenamedDeclarations(std::vector<const IR::Declaration*>* decls) :
+            decls(decls) { CHECK_NULL(decls); }
+    void postorder(const IR::P4Table* table) override { decls->push_back(table); }
+    void postorder(const IR::P4Action* action) override { decls->push_back(action); }
+    void postorder(const IR::Declaration_Instance* instance) override
+    { decls->push_back(instance); }
 };
 
 // Add a @name annotation ONLY.
@@ -284,6 +274,12 @@ class Substitutions : public SubstituteParameters {
         return result;
     }
 };
+
+class CountNodes : public Inspector {
+ public:
+    unsigned count = 0;
+    bool preorder(const IR::Node*) override { ++count; return true; }
+};
 }  // namespace
 
 template <class T>
@@ -296,8 +292,38 @@ const T* PerInstanceSubstitutions::rename(ReferenceMap* refMap, const IR::Node*
     return result;
 }
 
+unsigned InlineWorkList::cost(const CallInfo* call) {
+    CountNodes count;
+    call->callee->getNode()->apply(count);
+    return count.count * call->invocations.size();
+}
+
+void InlineWorkList::applyPolicy() {
+    // The optional instances are inlined cheapest first, while they fit the budget
+    std::vector<std::pair<unsigned, const IR::Declaration_Instance*>> optional;
+    for (auto m : inlineMap) {
+        if (m.second->invocations.size() != 0 && !policy->mandatory(m.second))
+            optional.emplace_back(cost(m.second), m.first);
+    }
+    std::stable_sort(optional.begin(), optional.end(),
+                     [](const std::pair<unsigned, const IR::Declaration_Instance*>& a,
+                        const std::pair<unsigned, const IR::Declaration_Instance*>& b) {
+                         return a.first < b.first; });
+    unsigned budget = policy->budget();
+    for (auto& o : optional) {
+        if (o.first <= budget) {
+            budget -= o.first;
+            continue;
+        }
+        LOG1("Not inlining " << dbp(o.second) << ", which costs " << o.first);
+        inlineMap.erase(o.second);
+    }
+}
+
 void InlineWorkList::analyze(bool allowMultipleCalls) {
     P4::CallGraph<const IR::IContainer*> cg("Call-graph");
+    if (policy != nullptr)
+        applyPolicy();
 
     for (auto m : inlineMap) {
         auto inl = m.second;
@@ -424,6 +450,27 @@ bool DiscoverInlining::preorder(const IR::ParserBlock* block) {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Must rename callee local objects prefixing them with their instance name.  The
+// callee is only searched for them once.
+void GeneralInliner::computeNewNames(cstring prefix, const IR::IContainer* callee,
+                                     SymRenameMap* renameMap) {
+    BUG_CHECK(!prefix.isNullOrEmpty(), "Null prefix");
+    auto it = renamedDecls.find(callee);
+    if (it == renamedDecls.end()) {
+        it = renamedDecls.emplace(callee, std::vector<const IR::Declaration*>()).first;
+        FindRenamedDeclarations find(&it->second);
+        (void)callee->getNode()->apply(find);
+    }
+    for (auto decl : it->second) {
+        BUG_CHECK(decl->is<IR::IAnnotated>(), "%1%: no annotations", decl);
+        cstring name = decl->externalName();
+        cstring extName = prefix + "." + name;
+        cstring baseName = extName.replace('.', '_');
+        cstring newName = refMap->newName(baseName);
+        renameMap->setNewName(decl, newName, extName);
+    }
+}
+
 Visitor::profile_t GeneralInliner::init_apply(const IR::Node* node) {
     ResolveReferences solver(refMap);
     TypeChecking typeChecker(refMap, typeMap);
@@ -465,8 +512,7 @@ const IR::Node* GeneralInliner::preorder(IR::P4Control* caller) {
 
             // Must rename callee local objects prefixing them with their instance name.
             cstring prefix = inst->externalName();
-            ComputeNewNames cnn(prefix, refMap, &substs->renameMap);
-            (void)callee->apply(cnn);  // populates substs.renameMap
+            computeNewNames(prefix, callee, &substs->renameMap);
 
             // Use temporaries for these parameters
             std::set<const IR::Parameter*> useTemporary;
@@ -524,11 +570,12 @@ const IR::Node* GeneralInliner::preorder(IR::P4Control* caller) {
                 }
             }
 
-            /* We will perform these substitutions twice: once here, to
-               compute the names for the locals that we need to inline here,
-               and once again at the call site (where we do additional
-               substitutions, including the callee parameters). */
+            /* The substitutions are now complete: the renamed callee
+               provides the locals that we need to inline here, and the body
+               of its first invocation.  Further invocations rename it again,
+               so that no two of them share nodes. */
             auto clone = substs->rename<IR::P4Control>(refMap, callee);
+            substs->renamed = clone;
             for (auto i : *clone->controlLocals)
                 locals->push_back(i);
         }
@@ -559,8 +606,7 @@ const IR::Node* GeneralInliner::preorder(IR::MethodCallStatement* statement) {
 
     auto callee = called->to<IR::P4Control>();
     auto body = new IR::IndexedVector<IR::StatOrDecl>();
-    // clone the substitution: it may be reused for multiple invocations
-    auto substs = new PerInstanceSubstitutions(*workToDo->substitutions[decl]);
+    auto substs = workToDo->substitutions[decl];
 
     MethodCallDescription mcd(statement->methodCall, refMap, typeMap);
     for (auto param : *mcd.substitution.getParameters()) {
@@ -579,7 +625,13 @@ const IR::Node* GeneralInliner::preorder(IR::MethodCallStatement* statement) {
     }
 
     // inline actual body
-    callee = substs->rename<IR::P4Control>(refMap, callee);
+    if (substs->renamed != nullptr) {
+        callee = substs->renamed->to<IR::P4Control>();
+        substs->renamed = nullptr;
+    } else {
+        // clone the substitution: it may be reused for multiple invocations
+        callee = PerInstanceSubstitutions(*substs).rename<IR::P4Control>(refMap, callee);
+    }
     body->append(*callee->body->components);
 
     // Copy values of out and inout parameters
@@ -809,8 +861,7 @@ const IR::Node* GeneralInliner::preorder(IR::P4Parser* caller) {
 
             // Must rename callee local objects prefixing them with their instance name.
             cstring prefix = inst->externalName();
-            ComputeNewNames cnn(prefix, refMap, &substs->renameMap);
-            (void)callee->apply(cnn);  // populates substs.renameMap
+            computeNewNames(prefix, callee, &substs->renameMap);
 
             // Substitute applyParameters which are not directionless
             // with fresh variable names.
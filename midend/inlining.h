@@ -85,6 +85,9 @@ struct PerInstanceSubstitutions {
     ParameterSubstitution paramSubst;
     TypeVariableSubstitution tvs;
     SymRenameMap renameMap;
+    // The callee renamed when the instance was analyzed, which the first invocation
+    // of a control uses instead of renaming it again; not copied.
+    const IR::Node* renamed = nullptr;
     PerInstanceSubstitutions() = default;
     PerInstanceSubstitutions(const PerInstanceSubstitutions &other) :
             paramSubst(other.paramSubst),
@@ -131,13 +134,43 @@ struct InlineSummary {
     { out << "Inline " << callerToWork.size() << " call sites"; }
 };
 
+// Decides which instances of controls and parsers are inlined.  The targets that
+// can only run a flat program inline all of them; one that can invoke a control or
+// parser as such may leave some alone, rather than copy a large callee to each of
+// many call sites.
+class InlinePolicy {
+ public:
+    virtual ~InlinePolicy() {}
+    // Whether the instance must be inlined, whatever it costs
+    virtual bool mandatory(const CallInfo*) const { return true; }
+    // How many IR nodes the other instances may add in all; the cost of an instance
+    // is the size of its callee times the number of its invocations
+    virtual unsigned budget() const { return 0; }
+};
+
+// For a target that can invoke any control or parser as such: inlines the instances,
+// cheapest first, while they add at most the given number of IR nodes.
+class InlineWithinBudget : public InlinePolicy {
+    unsigned nodes;
+ public:
+    explicit InlineWithinBudget(unsigned nodes) : nodes(nodes) {}
+    bool mandatory(const CallInfo*) const override { return false; }
+    unsigned budget() const override { return nodes; }
+};
+
 // Inling information constructed here.
 class InlineWorkList {
     // We use an ordered map to make the iterator deterministic
     ordered_map<const IR::Declaration_Instance*, CallInfo*> inlineMap;
     std::vector<CallInfo*> toInline;  // sorted in order of inlining
 
+    static unsigned cost(const CallInfo* call);
+    // Drops the optional instances that do not fit the budget
+    void applyPolicy();
+
  public:
+    const InlinePolicy* policy = nullptr;  // nullptr inlines everything
+
     void addInstantiation(const IR::IContainer* caller, const IR::IContainer* callee,
                           const IR::Declaration_Instance* instantiation) {
         CHECK_NULL(caller); CHECK_NULL(callee); CHECK_NULL(instantiation);
@@ -245,6 +278,10 @@ class GeneralInliner : public AbstractInliner {
     ReferenceMap* refMap;
     TypeMap* typeMap;
     InlineSummary::PerCaller* workToDo;
+    // For each callee the declarations that are renamed in each of its instances
+    std::map<const IR::IContainer*, std::vector<const IR::Declaration*>> renamedDecls;
+
+    void computeNewNames(cstring prefix, const IR::IContainer* callee, SymRenameMap* renameMap);
  public:
     explicit GeneralInliner(bool isv1) :
             refMap(new ReferenceMap()), typeMap(new TypeMap()), workToDo(nullptr) {
@@ -262,7 +299,9 @@ class GeneralInliner : public AbstractInliner {
 class Inline : public PassManager {
     InlineWorkList toInline;
  public:
-    Inline(ReferenceMap* refMap, TypeMap* typeMap, EvaluatorPass* evaluator) {
+    Inline(ReferenceMap* refMap, TypeMap* typeMap, EvaluatorPass* evaluator,
+           const InlinePolicy* policy = nullptr) {
+        toInline.policy = policy;
         passes.push_back(new TypeChecking(refMap, typeMap));
         passes.push_back(new DiscoverInlining(&toInline, refMap, typeMap, evaluator));
         passes.push_back(new InlineDriver(&toInline, new P4::GeneralInliner(refMap->isV1())));
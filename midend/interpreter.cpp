@@ -5,10 +5,13 @@
 
 namespace P4 {
 
-unsigned SymbolicValue::crtid = 0;
+symbolic_counter_t SymbolicValue::crtid(0);
+symbolic_counter_t ValueMap::crtVersion(0);
 
 SymbolicValue* SymbolicValueFactory::create(const IR::Type* type, bool uninitialized) const {
     type = typeMap->getType(type, true);
+    if (type->is<IR::Type_Type>())
+        type = type->to<IR::Type_Type>()->type;
     if (type->is<IR::Type_Bits>())
         return new SymbolicInteger(ScalarValue::init(uninitialized), type->to<IR::Type_Bits>());
     if (type->is<IR::Type_Boolean>())
@@ -54,6 +57,15 @@ SymbolicValue* SymbolicValueFactory::create(const IR::Type* type, bool uninitial
 
 bool SymbolicValueFactory::isFixedWidth(const IR::Type* type) const {
     type = typeMap->getType(type, true);
+    auto it = fixedWidths.find(type);
+    if (it != fixedWidths.end())
+        return it->second;
+    bool fixed = computeFixedWidth(type);
+    fixedWidths.emplace(type, fixed);
+    return fixed;
+}
+
+bool SymbolicValueFactory::computeFixedWidth(const IR::Type* type) const {
     if (type->is<IR::Type_Varbits>())
         return false;
     if (type->is<IR::Type_Extern>())
@@ -80,6 +92,15 @@ bool SymbolicValueFactory::isFixedWidth(const IR::Type* type) const {
 
 unsigned SymbolicValueFactory::getWidth(const IR::Type* type) const {
     type = typeMap->getType(type, true);
+    auto it = widths.find(type);
+    if (it != widths.end())
+        return it->second;
+    unsigned width = computeWidth(type);
+    widths.emplace(type, width);
+    return width;
+}
+
+unsigned SymbolicValueFactory::computeWidth(const IR::Type* type) const {
     if (type->is<IR::Type_Bits>())
         return type->to<IR::Type_Bits>()->size;
     if (type->is<IR::Type_Boolean>())
@@ -826,11 +847,19 @@ void ExpressionEvaluator::postorder(const IR::PathExpression* expression) {
     SymbolicValue* result;
     if (type->is<IR::Type_Error>())
         result = new SymbolicEnum(type, decl->getName());
+    else if (evaluatingWritable)
+        result = valueMap->getWritable(decl);
     else
         result = valueMap->get(decl);
     set(expression, result);
 }
 
+bool ExpressionEvaluator::preorder(const IR::MethodCallExpression*) {
+    // method calls may modify their arguments and the object they are applied to
+    evaluatingWritable = true;
+    return true;
+}
+
 void ExpressionEvaluator::postorder(const IR::MethodCallExpression* expression) {
     MethodCallDescription mcd(expression, refMap, typeMap);
     auto mi = mcd.instance;
@@ -930,7 +959,7 @@ void ExpressionEvaluator::postorder(const IR::MethodCallExpression* expression)
                 }
 
                 auto decl = em->object;
-                auto obj = valueMap->get(decl);
+                auto obj = valueMap->getWritable(decl);
                 CHECK_NULL(obj);
                 if (obj->is<SymbolicError>()) {
                     set(expression, obj);
@@ -980,9 +1009,18 @@ void ExpressionEvaluator::postorder(const IR::MethodCallExpression* expression)
 }
 
 SymbolicValue* ExpressionEvaluator::evaluate(const IR::Expression* expression, bool leftValue) {
+    if (!leftValue) {
+        auto cached = valueMap->getCached(expression);
+        if (cached != nullptr)
+            return cached;
+    }
     evaluatingLeftValue = leftValue;
+    evaluatingWritable = leftValue;
     (void)expression->apply(*this);
     auto result = get(expression);
+    // Not cached if the evaluation had side-effects
+    if (!leftValue)
+        valueMap->setCached(expression, result);
     return result;
 }
 
@@ -17,6 +17,10 @@ limitations under the License.
 #ifndef _MIDEND_INTERPRETER_H_
 #define _MIDEND_INTERPRETER_H_
 
+#include <unordered_map>
+#ifdef MULTITHREAD
+#include <atomic>
+#endif  // MULTITHREAD
 #include "ir/ir.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
 #include "frontends/p4/typeMap.h"
@@ -28,9 +32,16 @@ namespace P4 {
 
 class SymbolicValueFactory;
 
+#ifdef MULTITHREAD
+// programs may be evaluated on several threads
+typedef std::atomic<unsigned> symbolic_counter_t;
+#else
+typedef unsigned symbolic_counter_t;
+#endif  // MULTITHREAD
+
 // Base class for all abstract values
 class SymbolicValue {
-    static unsigned crtid;
+    static symbolic_counter_t crtid;
 
  protected:
     explicit SymbolicValue(const IR::Type* type) : id(crtid++), type(type) {}
@@ -58,9 +69,15 @@ class SymbolicValue {
     virtual bool hasUninitializedParts() const = 0;
 };
 
-// Creates values from type declarations
+// Creates values from type declarations.
+// The widths of the types, and whether they are fixed, are computed once
+// per type: a parser asks about the same headers at each state.
 class SymbolicValueFactory {
     const TypeMap* typeMap;
+    mutable std::unordered_map<const IR::Type*, unsigned> widths;
+    mutable std::unordered_map<const IR::Type*, bool> fixedWidths;
+    bool computeFixedWidth(const IR::Type* type) const;
+    unsigned computeWidth(const IR::Type* type) const;
  public:
     explicit SymbolicValueFactory(const TypeMap* typeMap) : typeMap(typeMap)
     { CHECK_NULL(typeMap); }
@@ -73,13 +90,39 @@ class SymbolicValueFactory {
     unsigned getWidth(const IR::Type* type) const;
 };
 
+// Maps declarations to their symbolic values.  clone() is cheap: the
+// values are shared between the copies until one of them writes a value,
+// which is then copied (see getWritable).  Expression evaluation results
+// are cached for map states that cannot change anymore; such a state is
+// identified by a version number, and is shared by clones.
 class ValueMap final : public IHasDbPrint {
+    typedef std::map<std::pair<const IR::Expression*, unsigned>, SymbolicValue*> Cache;
+    static symbolic_counter_t crtVersion;
+
+    // Values that are private to this map and can be modified in place;
+    // all others may be shared with clones.
+    mutable std::set<const IR::IDeclaration*> owned;
+    // True if values handed out by getWritable may still change.
+    mutable bool live;
+    unsigned version;
+    Cache*   cache;  // shared by all clones
+
+    ValueMap(unsigned version, Cache* cache) : live(false), version(version), cache(cache) {}
+    void modified() {
+        if (live) return;
+        live = true;
+        version = crtVersion++;
+    }
+
  public:
     std::map<const IR::IDeclaration*, SymbolicValue*> map;
+    ValueMap() : live(true), version(crtVersion++), cache(new Cache()) {}
     ValueMap* clone() const {
-        auto result = new ValueMap();
-        for (auto v : map)
-            result->map.emplace(v.first, v.second->clone());
+        auto result = new ValueMap(version, cache);
+        result->map = map;
+        // neither map can modify the values in place anymore
+        owned.clear();
+        live = false;
         return result;
     }
     ValueMap* filter(std::function<bool(const IR::IDeclaration*, const SymbolicValue*)> filter) {
@@ -87,12 +130,39 @@ class ValueMap final : public IHasDbPrint {
         for (auto v : map)
             if (filter(v.first, v.second))
                 result->map.emplace(v.first, v.second);
+        owned.clear();
+        live = false;
         return result;
     }
-    void set(const IR::IDeclaration* left, SymbolicValue* right)
-    { CHECK_NULL(left); CHECK_NULL(right); map[left] = right; }
+    // The map takes ownership of 'right'.
+    void set(const IR::IDeclaration* left, SymbolicValue* right) {
+        CHECK_NULL(left); CHECK_NULL(right);
+        modified();
+        map[left] = right;
+        owned.emplace(left);
+    }
     SymbolicValue* get(const IR::IDeclaration* left) const
     { CHECK_NULL(left); return ::get(map, left); }
+    // Value of 'left' that can be modified in place until
+    // this map is next cloned.
+    SymbolicValue* getWritable(const IR::IDeclaration* left) {
+        CHECK_NULL(left);
+        auto it = map.find(left);
+        if (it == map.end())
+            return nullptr;
+        modified();
+        if (owned.emplace(left).second)
+            it->second = it->second->clone();
+        return it->second;
+    }
+
+    // Result of evaluating 'expression' in the current state, or nullptr.
+    SymbolicValue* getCached(const IR::Expression* expression) const {
+        if (live) return nullptr;
+        return ::get(*cache, std::make_pair(expression, version)); }
+    void setCached(const IR::Expression* expression, SymbolicValue* value) {
+        if (live) return;
+        (*cache)[std::make_pair(expression, version)] = value; }
 
     void dbprint(std::ostream& out) const {
         bool first = true;
@@ -106,19 +176,25 @@ class ValueMap final : public IHasDbPrint {
     bool merge(const ValueMap* other) {
         bool change = false;
         BUG_CHECK(map.size() == other->map.size(), "Merging incompatible maps?");
-        for (auto d : map) {
+        modified();
+        for (auto& d : map) {
             auto v = other->get(d.first);
             CHECK_NULL(v);
+            if (owned.emplace(d.first).second)
+                d.second = d.second->clone();
             change = change || d.second->merge(v);
         }
         return change;
     }
     bool equals(const ValueMap* other) const {
         BUG_CHECK(map.size() == other->map.size(), "Incompatible maps compared");
+        if (version == other->version)
+            // clones of the same state
+            return true;
         for (auto v : map) {
             auto ov = other->get(v.first);
             CHECK_NULL(ov);
-            if (!v.second->equals(ov))
+            if (v.second != ov && !v.second->equals(ov))
                 return false;
         }
         return true;
@@ -131,6 +207,9 @@ class ExpressionEvaluator : public Inspector {
     ValueMap*           valueMap;
     const SymbolicValueFactory* factory;
     bool evaluatingLeftValue = false;
+    // True if the values reached may be modified, so they are
+    // obtained with ValueMap::getWritable.
+    bool evaluatingWritable = false;
 
     std::map<const IR::Expression*, SymbolicValue*> value;
 
@@ -151,17 +230,23 @@ class ExpressionEvaluator : public Inspector {
     bool preorder(const IR::ArrayIndex* expression) override;
     void postorder(const IR::ArrayIndex* expression) override;
     void postorder(const IR::ListExpression* expression) override;
+    bool preorder(const IR::MethodCallExpression* expression) override;
     void postorder(const IR::MethodCallExpression* expression) override;
 
  public:
-    ExpressionEvaluator(ReferenceMap* refMap, TypeMap* typeMap, ValueMap* valueMap) :
-            refMap(refMap), typeMap(typeMap), valueMap(valueMap) {
+    // 'factory' may be shared with the evaluators of the same program, which
+    // then share what it knows of the types; one is made if it is null.
+    ExpressionEvaluator(ReferenceMap* refMap, TypeMap* typeMap, ValueMap* valueMap,
+                        const SymbolicValueFactory* factory = nullptr) :
+            refMap(refMap), typeMap(typeMap), valueMap(valueMap), factory(factory) {
         CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(valueMap);
-        factory = new SymbolicValueFactory(typeMap);
+        if (factory == nullptr)
+            this->factory = new SymbolicValueFactory(typeMap);
     }
 
     // May mutate the valueMap, when evaluating expression with side-effects.
     // If leftValue is true we are returning a leftValue.
+    // Results of expressions without side-effects are cached in the valueMap.
     SymbolicValue* evaluate(const IR::Expression* expression, bool leftValue);
 };
 
@@ -541,6 +626,8 @@ class SymbolicPacketIn final : public SymbolicExtern {
     { conservative = true; }
     bool isConservative() const
     { return conservative; }
+    unsigned getOffset() const
+    { return minimumStreamOffset; }
     void advance(unsigned width)
     { minimumStreamOffset += width; }
     bool merge(const SymbolicValue* other) override;
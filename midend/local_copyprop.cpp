@@ -21,7 +21,7 @@ limitations under the License.
 class P4::DoLocalCopyPropagation::ElimDead : public Transform {
     DoLocalCopyPropagation &self;
     const IR::Node *preorder(IR::Declaration_Variable *var) override {
-        if (auto local = ::getref(self.available, var->name)) {
+        if (auto local = self.available.find(var->name)) {
             BUG_CHECK(local->local, "Non-local local var?");
             if (!local->live) {
                 LOG3("  removing dead local " << var->name);
@@ -31,7 +31,7 @@ class P4::DoLocalCopyPropagation::ElimDead : public Transform {
         return var; }
     IR::AssignmentStatement *postorder(IR::AssignmentStatement *as) override {
         if (auto dest = as->left->to<IR::PathExpression>()) {
-            if (auto var = ::getref(self.available, dest->path->name)) {
+            if (auto var = self.available.find(dest->path->name)) {
                 if (var->local && !var->live) {
                     LOG3("  removing dead assignment to " << dest->path->name);
                     return nullptr; } } }
@@ -44,24 +44,30 @@ class P4::DoLocalCopyPropagation::ElimDead : public Transform {
 void P4::DoLocalCopyPropagation::flow_merge(Visitor &a_) {
     auto &a = dynamic_cast<DoLocalCopyPropagation &>(a_);
     BUG_CHECK(in_action == a.in_action, "inconsitent DoLocalCopyPropagation state on merge");
-    for (auto &var : available) {
-        if (auto merge = ::getref(a.available, var.first)) {
-            if (merge->val != var.second.val)
-                var.second.val = nullptr;
-            if (merge->live)
-                var.second.live = true;
-        } else {
-            var.second.val = nullptr; } }
+    // the variables that neither branch changed are skipped
+    available.merge(a.available, [](cstring, VarInfo &var, const VarInfo *merge) {
+        bool changed = false;
+        if (var.val && (!merge || merge->val != var.val)) {
+            var.val = nullptr;
+            changed = true; }
+        if (merge && merge->live && !var.live) {
+            var.live = true;
+            changed = true; }
+        return changed; });
 }
 
 void P4::DoLocalCopyPropagation::dropValuesUsing(cstring name) {
-    for (auto &var : available) {
-        if (var.first == name) {
+    available.update([name](cstring var, VarInfo &info) {
+        if (!info.val) {
+            return false;
+        } else if (var == name) {
             LOG4("   dropping " << name << " as it is being assigned to");
-            var.second.val = nullptr;
-        } else if (var.second.val && exprUses(var.second.val, name)) {
-            LOG4("   dropping " << var.first << " as it is use" << name);
-            var.second.val = nullptr; } }
+        } else if (exprUses(info.val, name)) {
+            LOG4("   dropping " << var << " as it is use" << name);
+        } else {
+            return false; }
+        info.val = nullptr;
+        return true; });
 }
 
 const IR::Node *P4::DoLocalCopyPropagation::postorder(IR::Declaration_Variable *var) {
@@ -69,7 +75,7 @@ const IR::Node *P4::DoLocalCopyPropagation::postorder(IR::Declaration_Variable *
     if (!in_action) return var;
     if (available.count(var->name))
         BUG("duplicate var declaration for %s", var->name);
-    auto &local = available[var->name];
+    VarInfo local;
     local.local = true;
     if (var->initializer) {
         if (!hasSideEffects(var->initializer)) {
@@ -77,11 +83,12 @@ const IR::Node *P4::DoLocalCopyPropagation::postorder(IR::Declaration_Variable *
             local.val = var->initializer;
         } else {
             local.live = true; } }
+    available.set(var->name, local);
     return var;
 }
 
 const IR::Expression *P4::DoLocalCopyPropagation::postorder(IR::PathExpression *path) {
-    if (auto var = ::getref(available, path->path->name)) {
+    if (auto var = available.find(path->path->name)) {
         if (isWrite()) {
             return path;
         } else if (var->val) {
@@ -89,7 +96,10 @@ const IR::Expression *P4::DoLocalCopyPropagation::postorder(IR::PathExpression *
             return var->val;
         } else {
             LOG4("  using " << path->path->name << " with no propagated value");
-            var->live = true; } }
+            if (!var->live) {
+                VarInfo live = *var;
+                live.live = true;
+                available.set(path->path->name, live); } } }
     return path;
 }
 
@@ -106,7 +116,11 @@ IR::AssignmentStatement *P4::DoLocalCopyPropagation::postorder(IR::AssignmentSta
                  * we can copyprop them */
                  return as; }
             LOG3("  saving value for " << dest->path->name);
-            available[dest->path->name].val = as->right; } }
+            VarInfo info;
+            if (auto var = available.find(dest->path->name))
+                info = *var;
+            info.val = as->right;
+            available.set(dest->path->name, info); } }
     return as;
 }
 
@@ -18,6 +18,7 @@ limitations under the License.
 #define MIDEND_LOCAL_COPYPROP_H_
 
 #include "ir/ir.h"
+#include "lib/persistent_map.h"
 #include "frontends/p4/typeChecking/typeChecker.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
 
@@ -38,7 +39,8 @@ class DoLocalCopyPropagation : public ControlFlowVisitor, Transform, P4WriteCont
         bool                    live = false;
         const IR::Expression    *val = nullptr;
     };
-    std::map<cstring, VarInfo>  available;
+    // shared between the clones made at each branch, until they change it
+    persistent_map<cstring, VarInfo>    available;
     DoLocalCopyPropagation *clone() const override { return new DoLocalCopyPropagation(*this); }
     void flow_merge(Visitor &) override;
     void dropValuesUsing(cstring);
@@ -0,0 +1,118 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include "mergeActions.h"
+#include "frontends/p4/toP4/toP4.h"
+#include "lib/stringify.h"
+
+namespace P4 {
+
+namespace {
+
+// Names the parameters of an action by their position, so that actions that differ
+// only in the names of their parameters print the same.
+class RenameParameters : public Transform {
+    const ReferenceMap* refMap;
+    const IR::ParameterList* parameters;
+
+ public:
+    RenameParameters(const ReferenceMap* refMap, const IR::ParameterList* parameters) :
+            refMap(refMap), parameters(parameters) { setName("RenameParameters"); }
+    const IR::Node* postorder(IR::PathExpression* expression) override {
+        auto decl = refMap->getDeclaration(getOriginal<IR::PathExpression>()->path);
+        unsigned index = 0;
+        for (auto p : *parameters->parameters) {
+            if (decl == p) {
+                expression->path = new IR::Path(IR::ID("$" + Util::toString(index)));
+                break;
+            }
+            index++;
+        }
+        return expression;
+    }
+};
+
+}  // namespace
+
+cstring FindDuplicateActions::canonicalText(const IR::P4Action* action) const {
+    std::stringstream text;
+    for (auto p : *action->parameters->parameters)
+        text << p->direction << " " << p->type->toString() << ", ";
+    RenameParameters rename(refMap, action->parameters);
+    auto body = action->body->apply(rename);
+    P4::ToP4 toP4(&text, false);
+    body->apply(toP4);
+    return text.str();
+}
+
+bool FindDuplicateActions::preorder(const IR::P4Control* control) {
+    canonical.clear();
+    tables.clear();
+    for (auto decl : *control->controlLocals) {
+        auto table = decl->to<IR::P4Table>();
+        if (table == nullptr || table->getActionList() == nullptr)
+            continue;
+        for (auto ale : *table->getActionList()->actionList) {
+            auto action = refMap->getDeclaration(ale->getPath(), true)->to<IR::P4Action>();
+            if (action != nullptr)
+                tables[action].emplace(table);
+        }
+    }
+
+    for (auto decl : *control->controlLocals) {
+        auto action = decl->to<IR::P4Action>();
+        if (action == nullptr ||
+            action->annotations->getSingle(IR::Annotation::nameAnnotation) != nullptr)
+            continue;
+        cstring text = canonicalText(action);
+        auto it = canonical.find(text);
+        if (it == canonical.end()) {
+            canonical.emplace(text, action);
+            continue;
+        }
+        // the tables of the action that stays include those of the actions it replaces
+        auto& kept = tables[it->second];
+        bool shared = false;
+        for (auto t : tables[action])
+            shared = shared || kept.count(t) != 0;
+        if (shared)
+            continue;
+        kept.insert(tables[action].begin(), tables[action].end());
+        LOG1("Merging action " << action << " into " << it->second);
+        (*duplicates)[action] = it->second;
+    }
+    return false;
+}
+
+const IR::Node* DoMergeActions::preorder(IR::P4Action* action) {
+    prune();
+    if (duplicates->count(getOriginal<IR::P4Action>()) != 0)
+        return nullptr;
+    return action;
+}
+
+const IR::Node* DoMergeActions::postorder(IR::PathExpression* expression) {
+    auto decl = refMap->getDeclaration(getOriginal<IR::PathExpression>()->path);
+    if (decl == nullptr || !decl->is<IR::P4Action>())
+        return expression;
+    auto it = duplicates->find(decl->to<IR::P4Action>());
+    if (it != duplicates->end())
+        expression->path = new IR::Path(it->second->name);
+    return expression;
+}
+
+}  // namespace P4
@@ -0,0 +1,86 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MIDEND_MERGEACTIONS_H_
+#define _MIDEND_MERGEACTIONS_H_
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/resolveReferences.h"
+
+namespace P4 {
+
+// Finds the actions of a control that are the same as an earlier action of that
+// control, up to the names of their parameters.  Only actions that the control
+// plane does not see are merged, i.e. those without a @name annotation, such as
+// the ones made by SynthesizeActions.  Two actions of the same table are never
+// merged, as the table would then list the same action twice.
+class FindDuplicateActions : public Inspector {
+    const ReferenceMap* refMap;
+    // canonical text of an action -> first action with that text
+    std::map<cstring, const IR::P4Action*> canonical;
+    // tables that list each action
+    std::map<const IR::P4Action*, std::set<const IR::P4Table*>> tables;
+
+    cstring canonicalText(const IR::P4Action* action) const;
+
+ public:
+    // duplicate action -> the action that replaces it
+    std::map<const IR::P4Action*, const IR::P4Action*>* duplicates;
+
+    FindDuplicateActions(const ReferenceMap* refMap,
+                         std::map<const IR::P4Action*, const IR::P4Action*>* duplicates) :
+            refMap(refMap), duplicates(duplicates)
+    { CHECK_NULL(refMap); CHECK_NULL(duplicates); setName("FindDuplicateActions"); }
+    Visitor::profile_t init_apply(const IR::Node* node) override
+    { duplicates->clear(); return Inspector::init_apply(node); }
+    bool preorder(const IR::P4Parser*) override { return false; }
+    bool preorder(const IR::P4Control* control) override;
+};
+
+// Removes the duplicate actions, and makes all references to them, in action lists,
+// default actions and switch statements, refer to the action that replaces them.
+class DoMergeActions : public Transform {
+    const ReferenceMap* refMap;
+    const std::map<const IR::P4Action*, const IR::P4Action*>* duplicates;
+
+ public:
+    DoMergeActions(const ReferenceMap* refMap,
+                   const std::map<const IR::P4Action*, const IR::P4Action*>* duplicates) :
+            refMap(refMap), duplicates(duplicates)
+    { CHECK_NULL(refMap); CHECK_NULL(duplicates); setName("DoMergeActions"); }
+    const IR::Node* preorder(IR::P4Parser* parser) override
+    { prune(); return parser; }
+    const IR::Node* preorder(IR::P4Action* action) override;
+    const IR::Node* postorder(IR::PathExpression* expression) override;
+};
+
+// Merges actions that are the same up to the names of their parameters; best run
+// after SynthesizeActions and MoveActionsToTables, which make many such actions.
+class MergeActions : public PassManager {
+    std::map<const IR::P4Action*, const IR::P4Action*> duplicates;
+
+ public:
+    explicit MergeActions(ReferenceMap* refMap) {
+        passes.push_back(new ResolveReferences(refMap));
+        passes.push_back(new FindDuplicateActions(refMap, &duplicates));
+        passes.push_back(new DoMergeActions(refMap, &duplicates));
+        setName("MergeActions");
+    }
+};
+
+}  // namespace P4
+
+#endif /* _MIDEND_MERGEACTIONS_H_ */
@@ -18,18 +18,21 @@ bool ComplexValues::isNestedStruct(const IR::Type* type) {
     return false;
 }
 
-void ComplexValues::explode(cstring prefix, const IR::Type_Struct* type,
+void ComplexValues::explode(cstring_builder& prefix, const IR::Type_Struct* type,
                             FieldsMap* map, IR::Vector<IR::Declaration>* result) {
     CHECK_NULL(type);
+    size_t prefixSize = prefix.size();
     for (auto f : *type->fields) {
-        cstring fname = prefix + "_" + f->name;
+        prefix.truncate(prefixSize);
+        prefix += '_';
+        prefix += f->name.name;
         auto ftype = typeMap->getType(f, true);
         if (isNestedStruct(ftype)) {
             auto submap = new FieldsMap();
             map->members.emplace(f->name.name, submap);
-            explode(fname, ftype->to<IR::Type_Struct>(), submap, result);
+            explode(prefix, ftype->to<IR::Type_Struct>(), submap, result);
         } else {
-            cstring newName = refMap->newName(fname);
+            cstring newName = refMap->newName(prefix.str());
             auto comp = new FinalName(newName);
             map->members.emplace(f->name.name, comp);
             auto clone = new IR::Declaration_Variable(
@@ -39,6 +42,7 @@ void ComplexValues::explode(cstring prefix, const IR::Type_Struct* type,
             result->push_back(clone);
         }
     }
+    prefix.truncate(prefixSize);
 }
 
 const IR::Node* RemoveNestedStructs::postorder(IR::Declaration_Variable* decl) {
@@ -52,7 +56,8 @@ const IR::Node* RemoveNestedStructs::postorder(IR::Declaration_Variable* decl) {
     auto result = new IR::Vector<IR::Declaration>();
     auto map = new ComplexValues::FieldsMap();
     values->values.emplace(getOriginal<IR::Declaration_Variable>(), map);
-    values->explode(decl->getName().name, type->to<IR::Type_Struct>(), map, result);
+    cstring_builder prefix(decl->getName().name);
+    values->explode(prefix, type->to<IR::Type_Struct>(), map, result);
     return result;
 }
 
@@ -87,7 +87,9 @@ class ComplexValues final {
     ComplexValues(ReferenceMap* refMap, TypeMap* typeMap)  : refMap(refMap), typeMap(typeMap)
     { CHECK_NULL(refMap); CHECK_NULL(typeMap); }
     bool isNestedStruct(const IR::Type* type);
-    void explode(cstring prefix, const IR::Type_Struct* type,
+    // Adds a variable for each scalar field of 'type', named after 'prefix' and the
+    // fields that lead to it; 'prefix' is left as it was.
+    void explode(cstring_builder& prefix, const IR::Type_Struct* type,
                  FieldsMap* map, IR::Vector<IR::Declaration>* result);
     Component* getTranslation(const IR::IDeclaration* decl) {
         auto dv = decl->to<IR::Declaration_Variable>();
@@ -45,7 +45,7 @@ const IR::Node* DoHandleNoMatch::preorder(IR::P4Parser* parser) {
         lib.noMatch.Id()));
     auto verify = new IR::MethodCallExpression(
         Util::SourceInfo(), new IR::PathExpression(IR::ID(IR::ParserState::verify)),
-        new IR::Vector<IR::Type>(), args);
+        IR::Vector<IR::Type>::emptyInstance(), args);
     vec->push_back(new IR::MethodCallStatement(verify));
     noMatch = new IR::ParserState(Util::SourceInfo(), IR::ID(name),
                                   IR::Annotations::empty, vec,
@@ -0,0 +1,146 @@
+/*
+Copyright 2016 VMware, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "optimizeKey.h"
+#include "frontends/p4/coreLibrary.h"
+
+namespace P4 {
+
+int KeyLayoutPolicy::rank(cstring matchKind) const {
+    auto& core = P4CoreLibrary::instance;
+    if (matchKind == core.exactMatch.name)
+        return 0;
+    if (matchKind == core.ternaryMatch.name)
+        return 1;
+    if (matchKind == core.lpmMatch.name)
+        return 2;
+    return -1;
+}
+
+bool DoOptimizeKey::sameLeftValue(const IR::Expression* left,
+                                  const IR::Expression* right) const {
+    if (auto lp = left->to<IR::PathExpression>()) {
+        auto rp = right->to<IR::PathExpression>();
+        return rp != nullptr &&
+                refMap->getDeclaration(lp->path) == refMap->getDeclaration(rp->path);
+    }
+    if (auto lm = left->to<IR::Member>()) {
+        auto rm = right->to<IR::Member>();
+        return rm != nullptr && lm->member == rm->member && sameLeftValue(lm->expr, rm->expr);
+    }
+    if (auto li = left->to<IR::ArrayIndex>()) {
+        auto ri = right->to<IR::ArrayIndex>();
+        auto lc = li->right->to<IR::Constant>();
+        auto rc = ri != nullptr ? ri->right->to<IR::Constant>() : nullptr;
+        return lc != nullptr && rc != nullptr && lc->value == rc->value &&
+                sameLeftValue(li->left, ri->left);
+    }
+    return false;
+}
+
+const IR::Node* DoOptimizeKey::postorder(IR::Key* key) {
+    auto table = findOrigCtxt<IR::P4Table>();
+    if (table == nullptr || !policy->canChange(table))
+        return key;
+    auto& core = P4CoreLibrary::instance;
+
+    // What becomes an element of the new key
+    struct Part {
+        const IR::KeyElement* element;
+        std::vector<unsigned> from;
+        int                   rank;
+        const IR::Expression* header;   // of the fields, if they may be merged
+        unsigned              width;
+    };
+    std::vector<Part> parts;
+    bool reorder = true;
+    bool changed = false;
+    for (unsigned i = 0; i < key->keyElements->size(); i++) {
+        auto element = key->keyElements->at(i);
+        cstring kind = element->matchType->path->name;
+        bool duplicate = false;
+        for (auto& p : parts)
+            if (p.element->matchType->path->name == kind &&
+                sameLeftValue(p.element->expression, element->expression))
+                duplicate = true;
+        if (duplicate) {
+            LOG1("Removing duplicate key " << element << " of " << table);
+            changed = true;
+            continue;
+        }
+
+        Part part = { element, { i }, policy->rank(kind), nullptr, 0 };
+        reorder = reorder && part.rank >= 0;
+        auto member = element->expression->to<IR::Member>();
+        auto type = typeMap->getType(element->expression, true);
+        if (kind == core.exactMatch.name && member != nullptr && type->is<IR::Type_Bits>() &&
+            !type->to<IR::Type_Bits>()->isSigned) {
+            auto headerType = typeMap->getType(member->expr, true);
+            if (headerType->is<IR::Type_Header>()) {
+                part.header = member->expr;
+                part.width = type->to<IR::Type_Bits>()->size;
+            }
+        }
+        parts.push_back(part);
+    }
+
+    if (reorder) {
+        auto before = parts;
+        std::stable_sort(parts.begin(), parts.end(),
+                         [](const Part& a, const Part& b) { return a.rank < b.rank; });
+        for (unsigned i = 0; i < parts.size(); i++)
+            changed = changed || parts[i].from != before[i].from;
+    }
+
+    unsigned maxWidth = policy->maxMergedWidth();
+    std::vector<Part> merged;
+    for (auto& part : parts) {
+        if (!merged.empty()) {
+            auto& last = merged.back();
+            if (last.header != nullptr && part.header != nullptr &&
+                last.width + part.width <= maxWidth &&
+                sameLeftValue(last.header, part.header)) {
+                LOG1("Merging key " << part.element << " into " << last.element);
+                auto expression = new IR::Concat(
+                    last.element->expression->srcInfo,
+                    IR::Type_Bits::get(last.width + part.width),
+                    last.element->expression, part.element->expression);
+                last.element = new IR::KeyElement(
+                    last.element->srcInfo, last.element->annotations, expression,
+                    last.element->matchType);
+                last.from.insert(last.from.end(), part.from.begin(), part.from.end());
+                last.width += part.width;
+                changed = true;
+                continue;
+            }
+        }
+        merged.push_back(part);
+    }
+
+    if (!changed)
+        return key;
+    KeyLayout layout;
+    auto elements = new IR::Vector<IR::KeyElement>();
+    for (auto& part : merged) {
+        elements->push_back(part.element);
+        layout.push_back(part.from);
+    }
+    policy->keyChanged(table, layout);
+    key->keyElements = elements;
+    return key;
+}
+
+}  // namespace P4
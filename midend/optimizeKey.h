@@ -0,0 +1,82 @@
+/*
+Copyright 2016 VMware, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MIDEND_OPTIMIZEKEY_H_
+#define _MIDEND_OPTIMIZEKEY_H_
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+
+namespace P4 {
+
+// How OptimizeKey changed the key of a table: for each element of the new key, the
+// indices of the elements of the original key that it is made of, more than one when
+// fields were merged, the first being the most significant bits.  The indices of the
+// duplicates that were removed do not appear.
+typedef std::vector<std::vector<unsigned>> KeyLayout;
+
+// Policy that says what OptimizeKey may do to the table keys of a target, and which is
+// told about the keys it changes.  The control plane sees the new keys, so a target
+// that uses it must lay out its table entries with the KeyLayout.
+class KeyLayoutPolicy {
+ public:
+    virtual ~KeyLayoutPolicy() {}
+    // Keys are sorted by the rank of their match kind, keeping the order of the keys
+    // of the same rank.  A table with a key of a negative rank is not reordered.
+    // By default exact comes first, then ternary, then lpm, and others are negative.
+    virtual int rank(cstring matchKind) const;
+    // whether the key of table may be changed at all
+    virtual bool canChange(const IR::P4Table*) const { return true; }
+    // the widest key that adjacent exact fields of a header may be merged into, or 0
+    // for no merging
+    virtual unsigned maxMergedWidth() const { return 64; }
+    // called for each table whose key was changed
+    virtual void keyChanged(const IR::P4Table*, const KeyLayout&) {}
+};
+
+// Reorders, merges and removes the keys of tables, as the policy allows: keys that
+// match the same left value with the same match kind as an earlier key are removed,
+// keys are grouped by match kind, and adjacent exact keys that are unsigned fields of
+// the same header are merged into one key, their concatenation.  A target then has
+// fewer and wider fields to hash and to compare.  The keys must be left values, as
+// SimplifyKey with NonLeftValue leaves them.
+class DoOptimizeKey : public Transform {
+    ReferenceMap*    refMap;
+    TypeMap*         typeMap;
+    KeyLayoutPolicy* policy;
+
+    bool sameLeftValue(const IR::Expression* left, const IR::Expression* right) const;
+ public:
+    DoOptimizeKey(ReferenceMap* refMap, TypeMap* typeMap, KeyLayoutPolicy* policy) :
+            refMap(refMap), typeMap(typeMap), policy(policy)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(policy); setName("DoOptimizeKey"); }
+    const IR::Node* postorder(IR::Key* key) override;
+};
+
+class OptimizeKey : public PassManager {
+ public:
+    OptimizeKey(ReferenceMap* refMap, TypeMap* typeMap, KeyLayoutPolicy* policy) {
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        passes.push_back(new DoOptimizeKey(refMap, typeMap, policy));
+        passes.push_back(new TypeChecking(refMap, typeMap));  // types the merged keys
+        setName("OptimizeKey");
+    }
+};
+
+}  // namespace P4
+
+#endif /* _MIDEND_OPTIMIZEKEY_H_ */
@@ -1,3 +1,4 @@
+#include <boost/functional/hash.hpp>
 #include "parserUnroll.h"
 #include "lib/stringify.h"
 
@@ -50,10 +51,15 @@ class ParserSymbolicInterpreter {
     SymbolicValueFactory* factory;
     ParserInfo*         synthesizedParser;  // output produced
     bool                unroll;
+    unsigned            maxStates;
+    // States already evaluated, indexed by the hash of the state and its
+    // input values; a state reached again with the same values has the
+    // same successors, so it is not evaluated again.
+    std::unordered_map<size_t, std::vector<const ParserStateInfo*>> visited;
 
     ValueMap* initializeVariables() {
         ValueMap* result = new ValueMap();
-        ExpressionEvaluator ev(refMap, typeMap, result);
+        ExpressionEvaluator ev(refMap, typeMap, result, factory);
 
         for (auto p : *parser->type->applyParams->parameters) {
             auto type = typeMap->getType(p);
@@ -149,7 +155,7 @@ class ParserSymbolicInterpreter {
     // and 'false' if an error occurred.
     bool executeStatement(const ParserStateInfo* state, const IR::StatOrDecl* sord,
                           ValueMap* valueMap) const {
-        ExpressionEvaluator ev(refMap, typeMap, valueMap);
+        ExpressionEvaluator ev(refMap, typeMap, valueMap, factory);
 
         bool success = true;
         if (sord->is<IR::AssignmentStatement>()) {
@@ -236,6 +242,46 @@ class ParserSymbolicInterpreter {
         return false;
     }
 
+    // Hash of the parts of a value that unrolling depends on: the validity
+    // bits of headers (which also determine the next index of stacks) and
+    // the packet offsets.  Equal values have equal hashes.
+    static void hashValue(const SymbolicValue* value, size_t& hash) {
+        if (value->is<SymbolicHeader>()) {
+            auto valid = value->to<SymbolicHeader>()->valid;
+            boost::hash_combine(hash, static_cast<int>(valid->state));
+            if (valid->isKnown())
+                boost::hash_combine(hash, valid->value);
+        } else if (value->is<SymbolicArray>()) {
+            auto array = value->to<SymbolicArray>();
+            for (size_t i = 0; i < array->size; i++)
+                hashValue(array->get(nullptr, i), hash);
+        } else if (value->is<SymbolicStruct>()) {
+            for (auto f : value->to<SymbolicStruct>()->fieldValue)
+                hashValue(f.second, hash);
+        } else if (value->is<SymbolicPacketIn>()) {
+            boost::hash_combine(hash, value->to<SymbolicPacketIn>()->getOffset());
+        }
+    }
+
+    static size_t hashState(const ParserStateInfo* state) {
+        size_t hash = std::hash<const IR::ParserState*>()(state->state);
+        for (auto v : state->before->map)
+            hashValue(v.second, hash);
+        return hash;
+    }
+
+    // Returns true if the same state with the same input values
+    // has already been evaluated; otherwise records it.
+    bool alreadyVisited(const ParserStateInfo* state) {
+        auto& same = visited[hashState(state)];
+        for (auto s : same) {
+            if (s->state == state->state && s->before->equals(state->before))
+                return true;
+        }
+        same.push_back(state);
+        return false;
+    }
+
     // True if any header has changed its "validity" bit
     static bool headerValidityChange(const ValueMap* before, const ValueMap* after) {
         for (auto v : before->map) {
@@ -307,9 +353,9 @@ class ParserSymbolicInterpreter {
 
  public:
     ParserSymbolicInterpreter(ParserStructure* structure, ReferenceMap* refMap,
-                              TypeMap* typeMap, bool unroll)
+                              TypeMap* typeMap, bool unroll, unsigned maxStates)
             : structure(structure), refMap(refMap), typeMap(typeMap),
-              synthesizedParser(nullptr), unroll(unroll) {
+              synthesizedParser(nullptr), unroll(unroll), maxStates(maxStates) {
         CHECK_NULL(structure); CHECK_NULL(refMap); CHECK_NULL(typeMap);
         factory = new SymbolicValueFactory(typeMap);
         parser = structure->parser;
@@ -324,6 +370,7 @@ class ParserSymbolicInterpreter {
         auto startInfo = newStateInfo(nullptr, structure->start->name.name, initMap);
         std::vector<ParserStateInfo*> toRun;  // worklist
         toRun.push_back(startInfo);
+        unsigned evaluated = 0, merged = 0;
 
         while (!toRun.empty()) {
             auto stateInfo = toRun.back();
@@ -333,6 +380,16 @@ class ParserSymbolicInterpreter {
             if (infLoop)
                 // don't evaluate successors anymore
                 continue;
+            if (alreadyVisited(stateInfo)) {
+                LOG1("Already evaluated with the same values");
+                merged++;
+                continue;
+            }
+            if (++evaluated > maxStates) {
+                ::error("%1%: parser has more than %2% states after unrolling",
+                        parser, maxStates);
+                break;
+            }
             auto nextStates = evaluateState(stateInfo);
             if (nextStates == nullptr) {
                 LOG1("No next states");
@@ -341,13 +398,17 @@ class ParserSymbolicInterpreter {
             toRun.insert(toRun.end(), nextStates->begin(), nextStates->end());
         }
 
+        LOG1(parser << ": " << evaluated << " states evaluated, " << merged << " merged");
+        Visitor::profile_t::count("parser_states", evaluated);
+        Visitor::profile_t::count("parser_states_merged", merged);
         return synthesizedParser;
     }
 };
 }  // namespace ParserStructureImpl
 
-void ParserStructure::analyze(ReferenceMap* refMap, TypeMap* typeMap, bool unroll) {
-    ParserStructureImpl::ParserSymbolicInterpreter psi(this, refMap, typeMap, unroll);
+void ParserStructure::analyze(ReferenceMap* refMap, TypeMap* typeMap, bool unroll,
+                              unsigned maxStates) {
+    ParserStructureImpl::ParserSymbolicInterpreter psi(this, refMap, typeMap, unroll, maxStates);
     result = psi.run();
 }
 
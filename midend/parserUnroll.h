@@ -91,7 +91,8 @@ class ParserStructure {
     void calls(const IR::ParserState* caller, const IR::ParserState* callee)
     { callGraph->calls(caller, callee); }
 
-    void analyze(ReferenceMap* refMap, TypeMap* typeMap, bool unroll);
+    // Gives an error if evaluation produces more than maxStates states.
+    void analyze(ReferenceMap* refMap, TypeMap* typeMap, bool unroll, unsigned maxStates);
 };
 
 class AnalyzeParser : public Inspector {
@@ -127,12 +128,12 @@ class ParserUnroller : public Transform {
 class ParserRewriter : public PassManager {
     ParserStructure  current;
  public:
-    ParserRewriter(ReferenceMap* refMap, TypeMap* typeMap, bool unroll) {
+    ParserRewriter(ReferenceMap* refMap, TypeMap* typeMap, bool unroll, unsigned maxStates) {
         CHECK_NULL(refMap); CHECK_NULL(typeMap);
         passes.push_back(new AnalyzeParser(refMap, &current));
         passes.push_back(new VisitFunctor (
-            [this, refMap, typeMap, unroll](const IR::Node* root) -> const IR::Node* {
-                current.analyze(refMap, typeMap, unroll);
+            [this, refMap, typeMap, unroll, maxStates](const IR::Node* root) -> const IR::Node* {
+                current.analyze(refMap, typeMap, unroll, maxStates);
                 return root;
             }));
 #if 0
@@ -155,21 +156,24 @@ class RewriteAllParsers : public Transform {
     ReferenceMap* refMap;
     TypeMap*      typeMap;
     bool          unroll;
+    unsigned      maxStates;
  public:
-    RewriteAllParsers(ReferenceMap* refMap, TypeMap* typeMap, bool unroll) :
-            refMap(refMap), typeMap(typeMap), unroll(unroll)
+    RewriteAllParsers(ReferenceMap* refMap, TypeMap* typeMap, bool unroll, unsigned maxStates) :
+            refMap(refMap), typeMap(typeMap), unroll(unroll), maxStates(maxStates)
     { CHECK_NULL(refMap); CHECK_NULL(typeMap); }
     const IR::Node* postorder(IR::P4Parser* parser) override {
-        ParserRewriter rewriter(refMap, typeMap, unroll);
+        ParserRewriter rewriter(refMap, typeMap, unroll, maxStates);
         return parser->apply(rewriter);
     }
 };
 
 class ParsersUnroll : public PassManager {
  public:
-    ParsersUnroll(bool unroll, ReferenceMap* refMap, TypeMap* typeMap) {
+    // maxStates bounds the number of states produced for each parser.
+    ParsersUnroll(bool unroll, ReferenceMap* refMap, TypeMap* typeMap,
+                  unsigned maxStates = 1000) {
         passes.push_back(new TypeChecking(refMap, typeMap));
-        passes.push_back(new RewriteAllParsers(refMap, typeMap, unroll));
+        passes.push_back(new RewriteAllParsers(refMap, typeMap, unroll, maxStates));
         setName("ParsersUnroll");
     }
 };
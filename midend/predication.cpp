@@ -18,9 +18,48 @@ limitations under the License.
 
 namespace P4 {
 
+namespace {
+class ContainsMux : public Inspector {
+ public:
+    bool result = false;
+    bool preorder(const IR::Mux*) override { result = true; return false; }
+};
+}  // namespace
+
+PredicationPolicy::Form
+PredicationPolicy::form(const IR::Type* type, const IR::Expression* right) const {
+    auto bits = type->to<IR::Type_Bits>();
+    if (bits == nullptr || bits->isSigned)
+        return Form::Select;
+    ContainsMux cm;
+    (void)right->apply(cm);
+    return cm.result ? Form::Mask : Form::Select;
+}
+
+const IR::Expression* Predication::mask(const IR::Type_Bits* type) const {
+    const IR::Expression* result = new IR::Cast(Util::SourceInfo(), IR::Type_Bits::get(1),
+                                                predicate());
+    if (type->size == 1)
+        return result;
+    result = new IR::Cast(Util::SourceInfo(), type, result);
+    return new IR::Neg(Util::SourceInfo(), result);
+}
+
 const IR::Node* Predication::postorder(IR::AssignmentStatement* statement) {
     if (!inside_action || ifNestingLevel == 0)
         return statement;
+    auto type = typeMap == nullptr ? nullptr : typeMap->getType(statement->left);
+    if (type != nullptr && policy != nullptr &&
+        policy->form(type, statement->right) == PredicationPolicy::Form::Mask) {
+        auto bits = type->to<IR::Type_Bits>();
+        BUG_CHECK(bits != nullptr && !bits->isSigned, "%1%: cannot mask a value of type %2%",
+                  statement, type);
+        auto taken = new IR::BAnd(Util::SourceInfo(), mask(bits), statement->right);
+        auto kept = new IR::BAnd(Util::SourceInfo(), new IR::Cmpl(Util::SourceInfo(), mask(bits)),
+                                 statement->left);
+        statement->right = new IR::BOr(Util::SourceInfo(), taken, kept);
+        return statement;
+    }
     auto right = new IR::Mux(Util::SourceInfo(), predicate(), statement->right, statement->left);
     statement->right = right;
     return statement;
@@ -29,6 +68,10 @@ const IR::Node* Predication::postorder(IR::AssignmentStatement* statement) {
 const IR::Node* Predication::preorder(IR::IfStatement* statement) {
     if (!inside_action)
         return statement;
+    if (ifNestingLevel == 0 && policy != nullptr && policy->keepBranch(statement)) {
+        prune();
+        return statement;
+    }
 
     ++ifNestingLevel;
     auto vec = new IR::IndexedVector<IR::StatOrDecl>();
@@ -24,6 +24,23 @@ limitations under the License.
 // For this to work all statements must be assignments or other ifs.
 namespace P4 {
 
+// Chooses, for a target, how Predication converts the statements of actions.
+class PredicationPolicy {
+ public:
+    enum class Form {
+        Select,  // x = p ? e : x;
+        Mask,    // x = (m & e) | (~m & x), where m is all ones if p holds; bit<> only
+    };
+    virtual ~PredicationPolicy() {}
+    // Whether an if statement that is not within another one can be kept, for
+    // targets whose actions can branch.
+    virtual bool keepBranch(const IR::IfStatement*) const { return false; }
+    // How an assignment of 'right', of type 'type', is predicated.  A select is
+    // one operation and a mask four more, but a select of a value that is itself
+    // a select nests them, so by default values that contain one are masked.
+    virtual Form form(const IR::Type* type, const IR::Expression* right) const;
+};
+
 /*
 
 if (e)
@@ -55,6 +72,8 @@ conditional statement.
 */
 class Predication final : public Transform {
     NameGenerator* generator;
+    TypeMap* typeMap;  // if null all assignments are selects
+    const PredicationPolicy* policy;  // may be null
     bool inside_action;
     std::vector<cstring> predicateName;
     unsigned ifNestingLevel;
@@ -63,6 +82,8 @@ class Predication final : public Transform {
         if (predicateName.empty())
             return nullptr;
         return new IR::PathExpression(IR::ID(predicateName.back())); }
+    // All ones if the predicate holds, else zero
+    const IR::Expression* mask(const IR::Type_Bits* type) const;
     const IR::Statement* error(const IR::Statement* statement) const {
         if (inside_action && ifNestingLevel > 0)
             ::error("%1%: Predication cannot be applied", statement);
@@ -70,7 +91,9 @@ class Predication final : public Transform {
     }
 
  public:
-    explicit Predication(NameGenerator* generator) : generator(generator),
+    explicit Predication(NameGenerator* generator, TypeMap* typeMap = nullptr,
+                         const PredicationPolicy* policy = nullptr) :
+            generator(generator), typeMap(typeMap), policy(policy),
             inside_action(false), ifNestingLevel(0)
     { CHECK_NULL(generator); setName("Predication"); }
 
@@ -49,7 +49,8 @@ class RemoveMethodCallArguments : public Transform {
 
 HasTableApply::HasTableApply(ReferenceMap* refMap, TypeMap* typeMap) :
         refMap(refMap), typeMap(typeMap), table(nullptr), call(nullptr)
-{ CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("HasTableApply"); }
+{ CHECK_NULL(refMap); CHECK_NULL(typeMap); setName("HasTableApply");
+  visitOnly<IR::MethodCallExpression>(); }
 
 void HasTableApply::postorder(const IR::MethodCallExpression* expression) {
     auto mi = MethodInstance::resolve(expression, refMap, typeMap);
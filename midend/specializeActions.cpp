@@ -0,0 +1,186 @@
+/*
+Copyright 2016 VMware, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "specializeActions.h"
+#include "frontends/p4/cloner.h"
+#include "lib/stringify.h"
+
+namespace P4 {
+
+const cstring FindActionSpecializations::defaultOnlyAnnotation = "defaultonly";
+const cstring FindActionSpecializations::specializeAnnotation = "specialize";
+
+namespace {
+// Replaces each use of the parameters that have a value by a copy of the value
+class SubstituteParameters : public Transform {
+    const ReferenceMap* refMap;
+    const std::map<const IR::Parameter*, const IR::Literal*>* values;
+ public:
+    SubstituteParameters(const ReferenceMap* refMap,
+                         const std::map<const IR::Parameter*, const IR::Literal*>* values) :
+            refMap(refMap), values(values) { setName("SubstituteParameters"); }
+    const IR::Node* postorder(IR::PathExpression* expression) override {
+        auto decl = refMap->getDeclaration(getOriginal<IR::PathExpression>()->path, true);
+        auto it = values->find(decl->to<IR::Parameter>());
+        if (it == values->end())
+            return expression;
+        if (auto c = it->second->to<IR::Constant>())
+            return new IR::Constant(expression->srcInfo, c->type, c->value, c->base);
+        return new IR::BoolLiteral(expression->srcInfo, it->second->to<IR::BoolLiteral>()->value);
+    }
+};
+}  // namespace
+
+Visitor::profile_t FindActionSpecializations::init_apply(const IR::Node* node) {
+    specializations->fixed.clear();
+    specializations->copies.clear();
+    return Inspector::init_apply(node);
+}
+
+bool FindActionSpecializations::constants(const IR::P4Action* action,
+                                    const IR::Vector<IR::Expression>* args) const {
+    if (args->size() != action->parameters->size())
+        return false;
+    for (auto arg : *args)
+        if (!arg->is<IR::Constant>() && !arg->is<IR::BoolLiteral>())
+            return false;
+    return true;
+}
+
+bool FindActionSpecializations::preorder(const IR::P4Table* table) {
+    auto actions = table->getActionList();
+    if (actions == nullptr)
+        return false;
+    const IR::P4Action* defaultAction = nullptr;
+    auto defaultArgs = IR::Vector<IR::Expression>::emptyInstance();
+    auto prop = table->properties->getProperty(IR::TableProperties::defaultActionPropertyName);
+    if (prop != nullptr && prop->isConstant) {
+        auto method = table->getDefaultAction();
+        if (auto mc = method->to<IR::MethodCallExpression>()) {
+            method = mc->method;
+            defaultArgs = mc->arguments;
+        }
+        if (auto path = method->to<IR::PathExpression>())
+            defaultAction = refMap->getDeclaration(path->path, true)->to<IR::P4Action>();
+    }
+
+    for (auto element : *actions->actionList) {
+        auto action = refMap->getDeclaration(element->getPath(), true)->to<IR::P4Action>();
+        if (action == nullptr || action->parameters->size() == 0)
+            continue;
+        for (auto p : *action->parameters->parameters)
+            BUG_CHECK(p->direction == IR::Direction::None,
+                      "%1%: parameters with a direction should have been removed", p);
+        auto annotations = element->annotations;
+        if (annotations->getSingle(defaultOnlyAnnotation) != nullptr &&
+            action == defaultAction && constants(action, defaultArgs)) {
+            LOG1(dbp(action) << " only runs with " << defaultArgs);
+            specializations->fixed.emplace(action, defaultArgs);
+            continue;
+        }
+        for (auto annotation : annotations->annotations) {
+            if (annotation->name != specializeAnnotation)
+                continue;
+            if (!constants(action, &annotation->expr)) {
+                ::error("%1%: expected a constant for each parameter of %2%",
+                        annotation, action);
+                continue;
+            }
+            cstring name = refMap->newName(action->name);
+            LOG1(dbp(action) << " is copied as " << name << " for " << &annotation->expr);
+            specializations->copies[action].push_back({ name, &annotation->expr });
+        }
+    }
+    return false;
+}
+
+const IR::BlockStatement* DoSpecializeActions::bind(
+    const IR::P4Action* action, const IR::Vector<IR::Expression>* args) const {
+    std::map<const IR::Parameter*, const IR::Literal*> values;
+    auto arg = args->begin();
+    for (auto p : *action->parameters->parameters) {
+        auto value = (*arg++)->to<IR::Literal>();
+        auto type = typeMap->getType(p, true);
+        if (auto c = value->to<IR::Constant>()) {
+            if (type->is<IR::Type_Bits>())
+                value = new IR::Constant(c->srcInfo, type, c->value, c->base);
+        }
+        values.emplace(p, value);
+    }
+    SubstituteParameters substitute(refMap, &values);
+    return action->body->apply(substitute)->to<IR::BlockStatement>();
+}
+
+const IR::Node* DoSpecializeActions::postorder(IR::P4Action* action) {
+    auto orig = getOriginal<IR::P4Action>();
+    auto fixed = specializations->fixed.find(orig);
+    if (fixed != specializations->fixed.end()) {
+        action->body = bind(orig, fixed->second);
+        action->parameters = new IR::ParameterList();
+        return action;
+    }
+
+    auto copies = specializations->copies.find(orig);
+    if (copies == specializations->copies.end())
+        return action;
+    auto result = new IR::IndexedVector<IR::Declaration>();
+    result->push_back(action);
+    unsigned index = 0;
+    for (auto &copy : copies->second) {
+        // the control plane knows the copies by the name of the action and their index
+        cstring external = orig->externalName() + "_specialized_" + Util::toString(index++);
+        auto annos = action->annotations->addOrReplace(
+            IR::Annotation::nameAnnotation, new IR::StringLiteral(Util::SourceInfo(), external));
+        ClonePathExpressions cloner;
+        auto body = cloner.clone<IR::BlockStatement>(bind(orig, copy.arguments));
+        result->push_back(new IR::P4Action(action->srcInfo, IR::ID(action->name.srcInfo, copy.name),
+                                           annos, new IR::ParameterList(), body));
+    }
+    return result;
+}
+
+const IR::Node* DoSpecializeActions::postorder(IR::ActionListElement* element) {
+    auto decl = refMap->getDeclaration(element->getPath(), true);
+    auto copies = specializations->copies.find(decl->to<IR::P4Action>());
+    if (copies == specializations->copies.end())
+        return element;
+    auto result = new IR::IndexedVector<IR::ActionListElement>();
+    result->push_back(element);
+    for (auto &copy : copies->second) {
+        auto call = new IR::MethodCallExpression(
+            element->srcInfo, new IR::PathExpression(copy.name),
+            IR::Vector<IR::Type>::emptyInstance(), new IR::Vector<IR::Expression>());
+        result->push_back(new IR::ActionListElement(
+            element->srcInfo, IR::Annotations::empty, call));
+    }
+    return result;
+}
+
+const IR::Node* DoSpecializeActions::postorder(IR::MethodCallExpression* expression) {
+    // the default action of a fixed action has no arguments left
+    auto prop = findContext<IR::Property>();
+    if (prop == nullptr || prop->name != IR::TableProperties::defaultActionPropertyName)
+        return expression;
+    auto path = expression->method->to<IR::PathExpression>();
+    if (path == nullptr)
+        return expression;
+    auto decl = refMap->getDeclaration(path->path, true);
+    if (specializations->fixed.count(decl->to<IR::P4Action>()))
+        expression->arguments = new IR::Vector<IR::Expression>();
+    return expression;
+}
+
+}  // namespace P4
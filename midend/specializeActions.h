@@ -0,0 +1,109 @@
+/*
+Copyright 2016 VMware, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MIDEND_SPECIALIZEACTIONS_H_
+#define _MIDEND_SPECIALIZEACTIONS_H_
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+
+namespace P4 {
+
+// The actions to specialize on constant arguments, one for each parameter
+class ActionSpecializations {
+ public:
+    struct Copy {
+        cstring name;
+        const IR::Vector<IR::Expression>* arguments;
+    };
+    // actions that are only ever run with these arguments
+    std::map<const IR::P4Action*, const IR::Vector<IR::Expression>*> fixed;
+    // the copies of each action to add, with the arguments each has
+    std::map<const IR::P4Action*, std::vector<Copy>> copies;
+};
+
+// Finds the actions of tables that can be specialized:
+// - an action marked @defaultonly in the actions of a table whose const default_action
+//   runs it can only run with the arguments of the default action;
+// - each @specialize(c1, ..., cn) annotation of an action in the actions of a table,
+//   with one constant for each parameter of the action, asks for a copy of the action
+//   with these arguments, which the control plane can use for entries that have them.
+// This must run after RemoveActionParameters, so that each action is in one table,
+// and the parameters that are left are the ones the control plane gives.
+class FindActionSpecializations : public Inspector {
+    ReferenceMap*          refMap;
+    TypeMap*               typeMap;
+    ActionSpecializations* specializations;
+
+    bool constants(const IR::P4Action* action, const IR::Vector<IR::Expression>* args) const;
+ public:
+    static const cstring defaultOnlyAnnotation;
+    static const cstring specializeAnnotation;
+
+    FindActionSpecializations(ReferenceMap* refMap, TypeMap* typeMap,
+                        ActionSpecializations* specializations) :
+            refMap(refMap), typeMap(typeMap), specializations(specializations)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(specializations);
+      setName("FindActionSpecializations"); }
+    Visitor::profile_t init_apply(const IR::Node* node) override;
+    bool preorder(const IR::P4Table* table) override;
+};
+
+// Replaces the parameters of the fixed actions by their arguments, and adds the copies
+// of actions to the controls and to the actions of their tables.  Constant folding
+// can then simplify the bodies of the actions.
+// control c() {
+//    action a(bit<8> x) { ... x ... }
+//    table t { actions = { @specialize(1) a; } }
+// becomes
+// control c() {
+//    action a(bit<8> x) { ... x ... }
+//    @name("a_specialized_0") action a_0() { ... 8w1 ... }
+//    table t { actions = { @specialize(1) a; a_0; } }
+class DoSpecializeActions : public Transform {
+    ReferenceMap*                refMap;
+    TypeMap*                     typeMap;
+    const ActionSpecializations* specializations;
+
+    const IR::BlockStatement* bind(const IR::P4Action* action,
+                                   const IR::Vector<IR::Expression>* args) const;
+ public:
+    DoSpecializeActions(ReferenceMap* refMap, TypeMap* typeMap,
+                        const ActionSpecializations* specializations) :
+            refMap(refMap), typeMap(typeMap), specializations(specializations)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(specializations);
+      setName("DoSpecializeActions"); }
+    const IR::Node* postorder(IR::P4Action* action) override;
+    const IR::Node* postorder(IR::ActionListElement* element) override;
+    const IR::Node* postorder(IR::MethodCallExpression* expression) override;
+};
+
+class SpecializeActions : public PassManager {
+    ActionSpecializations specializations;
+ public:
+    SpecializeActions(ReferenceMap* refMap, TypeMap* typeMap) {
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        passes.push_back(new FindActionSpecializations(refMap, typeMap, &specializations));
+        passes.push_back(new DoSpecializeActions(refMap, typeMap, &specializations));
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        setName("SpecializeActions");
+    }
+};
+
+}  // namespace P4
+
+#endif /* _MIDEND_SPECIALIZEACTIONS_H_ */
@@ -0,0 +1,97 @@
+/*
+Copyright 2016 VMware, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "stackIndices.h"
+
+namespace P4 {
+
+Visitor::profile_t FindConstantVariables::init_apply(const IR::Node* node) {
+    constants->clear();
+    varying.clear();
+    return Inspector::init_apply(node);
+}
+
+void FindConstantVariables::write(const IR::IDeclaration* decl, const IR::Expression* value) {
+    if (varying.count(decl))
+        return;
+    auto constant = value != nullptr ? value->to<IR::Constant>() : nullptr;
+    if (constant == nullptr) {
+        varying.emplace(decl);
+        return;
+    }
+    auto it = constants->find(decl);
+    if (it == constants->end())
+        constants->emplace(decl, constant);
+    else if (it->second->value != constant->value)
+        varying.emplace(decl);
+}
+
+void FindConstantVariables::postorder(const IR::Declaration_Variable* decl) {
+    if (decl->initializer != nullptr)
+        write(decl, decl->initializer);
+}
+
+void FindConstantVariables::postorder(const IR::PathExpression* expression) {
+    if (!isWrite())
+        return;
+    auto decl = refMap->getDeclaration(expression->path, true);
+    if (!decl->is<IR::Declaration_Variable>())
+        return;
+    // only an assignment to the whole variable can give it a constant
+    auto assign = getParent<IR::AssignmentStatement>();
+    if (assign != nullptr && assign->left == expression)
+        write(decl, assign->right);
+    else
+        write(decl, nullptr);
+}
+
+void FindConstantVariables::end_apply() {
+    for (auto decl : varying)
+        constants->erase(decl);
+    for (auto c : *constants)
+        LOG1(c.first << " is always " << c.second);
+}
+
+const IR::Node* DoConstantStackIndices::preorder(IR::ArrayIndex* expression) {
+    visit(expression->left, "left");
+    inIndex++;
+    visit(expression->right, "right");
+    inIndex--;
+    prune();
+    return expression;
+}
+
+const IR::Node* DoConstantStackIndices::postorder(IR::PathExpression* expression) {
+    if (inIndex == 0)
+        return expression;
+    auto decl = refMap->getDeclaration(expression->path, true);
+    auto it = constants->find(decl);
+    if (it == constants->end())
+        return expression;
+    auto type = typeMap->getType(getOriginal(), true);
+    return new IR::Constant(expression->srcInfo, type, it->second->value, it->second->base);
+}
+
+void ReportDynamicStackIndices::postorder(const IR::ArrayIndex* expression) {
+    if (expression->right->is<IR::Constant>())
+        return;
+    if (warn)
+        ::warning("%1%: header stack index is not a constant", expression->right);
+    else
+        LOG1(expression->right << ": header stack index is not a constant");
+}
+
+}  // namespace P4
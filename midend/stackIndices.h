@@ -0,0 +1,97 @@
+/*
+Copyright 2016 VMware, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _MIDEND_STACKINDICES_H_
+#define _MIDEND_STACKINDICES_H_
+
+#include "ir/ir.h"
+#include "frontends/common/constantFolding.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+
+namespace P4 {
+
+// The constant that each variable in it holds
+typedef std::map<const IR::IDeclaration*, const IR::Constant*> ConstantVariables;
+
+// Finds the variables that hold one constant: every write to them, including their
+// initializer, is an assignment of the same constant.  A read before the first write
+// sees an unspecified value, so the constant is a valid value for every read.
+class FindConstantVariables : public Inspector, P4WriteContext {
+    ReferenceMap* refMap;
+    ConstantVariables* constants;
+    std::set<const IR::IDeclaration*> varying;
+
+    void write(const IR::IDeclaration* decl, const IR::Expression* value);
+ public:
+    FindConstantVariables(ReferenceMap* refMap, ConstantVariables* constants) :
+            refMap(refMap), constants(constants)
+    { CHECK_NULL(refMap); CHECK_NULL(constants); setName("FindConstantVariables"); }
+    Visitor::profile_t init_apply(const IR::Node* node) override;
+    void postorder(const IR::Declaration_Variable* decl) override;
+    void postorder(const IR::PathExpression* expression) override;
+    void end_apply() override;
+};
+
+// Replaces the variables that hold one constant by that constant in the indices of
+// header stacks, so that, once folded, the accesses are to a given element.
+class DoConstantStackIndices : public Transform {
+    ReferenceMap* refMap;
+    TypeMap*      typeMap;
+    const ConstantVariables* constants;
+    unsigned      inIndex = 0;  // the depth of the indices being visited
+ public:
+    DoConstantStackIndices(ReferenceMap* refMap, TypeMap* typeMap,
+                           const ConstantVariables* constants) :
+            refMap(refMap), typeMap(typeMap), constants(constants)
+    { CHECK_NULL(refMap); CHECK_NULL(typeMap); CHECK_NULL(constants);
+      setName("DoConstantStackIndices"); }
+    const IR::Node* preorder(IR::ArrayIndex* expression) override;
+    const IR::Node* postorder(IR::PathExpression* expression) override;
+};
+
+// Reports the indices of header stacks that are still not constants: with a warning if
+// warn is set, or else in the log.
+class ReportDynamicStackIndices : public Inspector {
+    bool warn;
+ public:
+    explicit ReportDynamicStackIndices(bool warn) : warn(warn)
+    { setName("ReportDynamicStackIndices"); }
+    void postorder(const IR::ArrayIndex* expression) override;
+};
+
+// Makes the indices of header stacks constants where variables that only ever hold a
+// constant are used in them, such as a loop counter of a parser that was unrolled or
+// the depth of a label stack that a control sets once.  The accesses that stay
+// dynamic, which some targets cannot compile or must bounds check at run time, are
+// reported.  The next and last elements of a stack depend on what the parser
+// extracted, and are left alone.
+class ConstantStackIndices : public PassManager {
+    ConstantVariables constants;
+ public:
+    ConstantStackIndices(ReferenceMap* refMap, TypeMap* typeMap, bool warn) {
+        passes.push_back(new TypeChecking(refMap, typeMap));
+        passes.push_back(new FindConstantVariables(refMap, &constants));
+        passes.push_back(new DoConstantStackIndices(refMap, typeMap, &constants));
+        passes.push_back(new ConstantFolding(refMap, typeMap));
+        passes.push_back(new ReportDynamicStackIndices(warn));
+        setName("ConstantStackIndices");
+    }
+};
+
+}  // namespace P4
+
+#endif /* _MIDEND_STACKINDICES_H_ */
@@ -0,0 +1,132 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "ir/ir.h"
+#include "lib/cstring.h"
+#include "lib/error.h"
+#include "lib/source_file.h"
+#include "frontends/common/batch.h"
+#include "test.h"
+
+namespace Test {
+class TestBatch : public TestBase {
+    int testSplit() {
+        std::vector<std::string> args;
+        ASSERT_EQ(splitArguments("  -I dir 'a b' \"c \\\"d\\\"\" e\\ f ''  ", args), true);
+        ASSERT_EQ(args.size(), 6u);
+        ASSERT_EQ(cstring(args[0]), "-I");
+        ASSERT_EQ(cstring(args[1]), "dir");
+        ASSERT_EQ(cstring(args[2]), "a b");
+        ASSERT_EQ(cstring(args[3]), "c \"d\"");
+        ASSERT_EQ(cstring(args[4]), "e f");
+        ASSERT_EQ(cstring(args[5]), "");
+        ASSERT_EQ(splitArguments("x 'y", args), false);
+        return SUCCESS;
+    }
+
+    // The exit statuses in the replies, without the time and memory
+    static std::string statuses(const char *replies) {
+        std::string result;
+        for (const char *p = replies; (p = strstr(p, "done ")) != nullptr; p += 5)
+            result += std::string(p + 5, strchr(p + 5, ' ') - p - 5) + ";";
+        return result; }
+
+    // Each request starts with no errors, no program text and none of the options of
+    // the compiler from the one before
+    int testServe() {
+        std::string requests = "first.p4 -v\n\n\"bad\n  second.p4\n";
+        FILE *in = fmemopen(&requests[0], requests.size(), "r");
+        char *replies = nullptr;
+        size_t size = 0;
+        FILE *out = open_memstream(&replies, &size);
+        std::vector<std::string> seen;
+        std::vector<unsigned> errors, lines;
+        std::vector<bool> bounded;
+        serveBatch(in, out, "p4test", [&](int argc, char *const argv[]) {
+            std::string command;
+            for (int i = 0; i < argc; ++i)
+                command += std::string(i ? " " : "") + argv[i];
+            seen.push_back(command);
+            errors.push_back(::errorCount());
+            lines.push_back(Util::InputSources::instance->lineCount());
+            bounded.push_back(PassManager::boundedMemory());
+            PassManager::setBoundedMemory(true);
+            Util::InputSources::instance->appendText("control c();");
+            Util::InputSources::instance->appendText("\n");
+            ::error("%1%: failed", argv[1]);
+            return argc == 3 ? 1 : 0; });
+        fclose(in);
+        fclose(out);
+        PassManager::setBoundedMemory(false);
+
+        ASSERT_EQ(seen.size(), 2u);
+        ASSERT_EQ(cstring(seen[0]), "p4test first.p4 -v");
+        ASSERT_EQ(cstring(seen[1]), "p4test second.p4");
+        ASSERT_EQ(errors[1], 0u);
+        ASSERT_EQ(lines[1], lines[0]);
+        ASSERT_EQ(bounded[1], false);
+        ASSERT_EQ(cstring(statuses(replies)), "1;1;0;");
+        free(replies);
+        return SUCCESS;
+    }
+
+    // Requests compiled at the same time count their own errors, and are replied
+    // to in order
+    int testParallel() {
+        std::string requests;
+        for (int i = 0; i < 20; ++i)
+            requests += std::to_string(i % 3) + "\n";
+        FILE *in = fmemopen(&requests[0], requests.size(), "r");
+        char *replies = nullptr;
+        size_t size = 0;
+        FILE *out = open_memstream(&replies, &size);
+        serveBatch(in, out, "p4test", [](int, char *const argv[]) {
+            if (::errorCount() != 0)
+                return 9;
+            for (int i = atoi(argv[1]); i > 0; --i)
+                ::error("failed");
+            return static_cast<int>(::errorCount()); }, 4);
+        fclose(in);
+        fclose(out);
+
+        std::string expected;
+        for (int i = 0; i < 20; ++i)
+            expected += std::to_string(i % 3) + ";";
+        ASSERT_EQ(cstring(statuses(replies)), cstring(expected));
+        free(replies);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testSplit);
+        RUNTEST(testServe);
+        RUNTEST(testParallel);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestBatch test;
+    return test.run();
+}
@@ -0,0 +1,146 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+
+#include "ir/ir.h"
+#include "ir/binary_generator.h"
+#include "ir/binary_index.h"
+#include "ir/binary_loader.h"
+#include "ir/json_generator.h"
+#include "lib/error.h"
+#include "lib/stringify.h"
+#include "test.h"
+
+namespace Test {
+class TestBinaryIR : public TestBase {
+    const IR::Node *tree() {
+        auto c = new IR::Constant(mpz_class("-123456789012345678901234567890"));
+        auto vec = new IR::Vector<IR::Expression>();
+        vec->push_back(new IR::Add(c, new IR::Neg(c)));
+        vec->push_back(new IR::Constant(7));
+        vec->push_back(c);
+        return vec; }
+
+    // loading a snapshot and writing it again gives the same bytes, and the same JSON
+    int testRoundTrip() {
+        const IR::Node *node = tree();
+        std::stringstream first, second, json1, json2;
+        BinaryGenerator(first) << node;
+        const IR::Vector<IR::Expression> *loaded = nullptr;
+        BinaryLoader loader(first);
+        loader >> loaded;
+        ASSERT_EQ(static_cast<bool>(loader), true);
+        ASSERT_EQ(loaded != nullptr, true);
+        ASSERT_EQ(loaded->size(), 3u);
+        auto add = loaded->at(0)->to<IR::Add>();
+        ASSERT_EQ(add != nullptr, true);
+        // shared nodes stay shared
+        ASSERT_EQ(add->left == add->right->to<IR::Neg>()->expr, true);
+        ASSERT_EQ(add->left == loaded->at(2), true);
+        ASSERT_EQ(add->left->to<IR::Constant>()->value ==
+                  mpz_class("-123456789012345678901234567890"), true);
+        ASSERT_EQ(loaded->at(1)->to<IR::Constant>()->asInt(), 7);
+        BinaryGenerator(second) << loaded;
+        ASSERT_EQ(second.str() == first.str(), true);
+        JSONGenerator(json1) << node;
+        JSONGenerator(json2) << static_cast<const IR::Node *>(loaded);
+        ASSERT_EQ(cstring(json2.str()), cstring(json1.str()));
+        ASSERT_EQ(first.str().size() * 4 < json1.str().size(), true);
+        return SUCCESS;
+    }
+
+    int testBadInput() {
+        unsigned errors = ::errorCount();
+        std::stringstream json;
+        JSONGenerator(json) << tree();
+        const IR::Node *loaded = nullptr;
+        BinaryLoader notBinary(json);
+        notBinary >> loaded;
+        ASSERT_EQ(static_cast<bool>(notBinary), false);
+        ASSERT_EQ(loaded == nullptr, true);
+        ASSERT_EQ(::errorCount(), errors + 1);
+
+        std::stringstream bin;
+        BinaryGenerator(bin) << tree();
+        std::string truncated = bin.str().substr(0, bin.str().size() / 2);
+        BinaryLoader cut(truncated.data(), truncated.data() + truncated.size());
+        const IR::Vector<IR::Expression> *vec = nullptr;
+        cut >> vec;
+        ASSERT_EQ(static_cast<bool>(cut), false);
+        ASSERT_EQ(::errorCount(), errors + 2);
+        return SUCCESS;
+    }
+
+    // only the declarations asked for are decoded, and they are the ones written
+    int testIndexed() {
+        auto decls = new IR::IndexedVector<IR::Node>();
+        for (unsigned i = 0; i < 100; ++i)
+            decls->push_back(new IR::Declaration_Constant(
+                IR::ID(cstring("c") + Util::toString(i)), IR::Annotations::empty,
+                IR::Type_Bits::get(32), new IR::Add(new IR::Constant(i), new IR::Constant(1))));
+        auto program = new IR::P4Program(decls);
+        std::stringstream out;
+        IndexedSnapshot::write(out, program);
+
+        LazyProgram lazy(out);
+        ASSERT_EQ(static_cast<bool>(lazy), true);
+        ASSERT_EQ(lazy.size(), 100u);
+        ASSERT_EQ(lazy.loaded(), 0u);
+        ASSERT_EQ(lazy.name(42), cstring("c42"));
+        ASSERT_EQ(lazy.type(42), cstring("Declaration_Constant"));
+        auto c42 = lazy.get<IR::Declaration_Constant>("c42");
+        ASSERT_EQ(c42 != nullptr, true);
+        ASSERT_EQ(lazy.loaded(), 1u);
+        ASSERT_EQ(c42->initializer->to<IR::Add>()->left->to<IR::Constant>()->asInt(), 42);
+        ASSERT_EQ(lazy.get("c42") == c42, true);
+        ASSERT_EQ(lazy.get("missing") == nullptr, true);
+
+        auto loaded = lazy.program();
+        ASSERT_EQ(lazy.loaded(), 100u);
+        ASSERT_EQ(loaded->declarations->size(), 100u);
+        ASSERT_EQ(loaded->declarations->at(42) == c42, true);
+        // each declaration on its own, as the type they share is no longer shared
+        for (size_t i = 0; i < 100; ++i) {
+            std::stringstream json1, json2;
+            JSONGenerator(json1) << program->declarations->at(i);
+            JSONGenerator(json2) << loaded->declarations->at(i);
+            ASSERT_EQ(cstring(json2.str()), cstring(json1.str())); }
+
+        unsigned errors = ::errorCount();
+        std::stringstream bin;
+        BinaryGenerator(bin) << static_cast<const IR::Node *>(program);
+        LazyProgram notIndexed(bin);
+        ASSERT_EQ(static_cast<bool>(notIndexed), false);
+        ASSERT_EQ(notIndexed.size(), 0u);
+        ASSERT_EQ(::errorCount(), errors + 1);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testRoundTrip);
+        RUNTEST(testBadInput);
+        RUNTEST(testIndexed);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestBinaryIR test;
+    return test.run();
+}
@@ -0,0 +1,139 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include <vector>
+
+#include "lib/ltbitmatrix.h"
+#include "lib/symbitmatrix.h"
+#include "test.h"
+
+namespace Test {
+class TestBitMatrix : public TestBase {
+    static const unsigned N = 300;
+
+    int testLayout() {
+        // the rows follow each other, with no gaps, in whole words
+        for (unsigned r = 1; r < 1000; ++r) {
+            ASSERT_EQ(LTBitMatrix::rowbase(r) % bitvec::bits_per_unit, 0u);
+            ASSERT_EQ(LTBitMatrix::rowbase(r) - LTBitMatrix::rowbase(r-1),
+                      ((r-1)/bitvec::bits_per_unit + 1) * bitvec::bits_per_unit);
+            ASSERT_EQ(LTBitMatrix::rows(LTBitMatrix::rowbase(r)), r+1);
+            ASSERT_EQ(LTBitMatrix::rows(LTBitMatrix::rowbase(r) - 1), r); }
+        return SUCCESS;
+    }
+
+    int testLTRows() {
+        LTBitMatrix m;
+        std::vector<std::vector<bool>> model(N, std::vector<bool>(N));
+        ASSERT_EQ(m.size(), 0u);
+        for (unsigned i = 0; i < 2000; ++i) {
+            unsigned r = (i * 7919) % N, c = (i * 104729) % (r+1);
+            m(r, c) = 1;
+            model[r][c] = true; }
+        m(N+10, 3) = 1;
+        ASSERT_EQ(m.size(), N+11);
+        m(N+10, 3) = 0;
+        for (unsigned r = 0; r < N; ++r) {
+            bitvec row = m[r];
+            ASSERT_EQ(static_cast<bool>(m[r]), row.popcount() > 0);
+            for (unsigned c = 0; c < N; ++c) {
+                ASSERT_EQ(m(r, c), c <= r && model[r][c]);
+                ASSERT_EQ(row[c], c <= r && model[r][c]); } }
+
+        // or a row, dropping what is right of the diagonal
+        bitvec extra(0, N);
+        m[100] |= extra;
+        ASSERT_EQ(bitvec(m[100]) == bitvec(0, 101), true);
+        ASSERT_EQ(m(99, 100), false);
+
+        std::stringstream text;
+        text << m;
+        LTBitMatrix copy;
+        ASSERT_EQ(text.str().c_str() >> copy, true);
+        const LTBitMatrix &read = copy, &written = m;
+        for (unsigned r = 1; r < N; ++r)
+            for (unsigned c = 0; c < r; ++c)
+                ASSERT_EQ(read(r, c), written(r, c));
+        return SUCCESS;
+    }
+
+    int testLTClosure() {
+        LTBitMatrix m;
+        std::vector<std::vector<bool>> model(N, std::vector<bool>(N));
+        for (unsigned i = 0; i < 400; ++i) {
+            unsigned r = (i * 7919) % N, c = (i * 104729) % (r+1);
+            m(r, c) = 1;
+            model[r][c] = true; }
+        for (unsigned k = 0; k < N; ++k)
+            for (unsigned r = 0; r < N; ++r)
+                for (unsigned c = 0; c < N; ++c)
+                    if (model[r][k] && model[k][c]) model[r][c] = true;
+        m.transitive_closure();
+        for (unsigned r = 0; r < N; ++r)
+            for (unsigned c = 0; c <= r; ++c)
+                ASSERT_EQ(m(r, c), model[r][c]);
+        return SUCCESS;
+    }
+
+    int testSym() {
+        SymBitMatrix m;
+        std::vector<std::vector<bool>> model(N, std::vector<bool>(N));
+        for (unsigned i = 0; i < 150; ++i) {
+            unsigned r = (i * 7919) % N, c = (i * 104729) % N;
+            m(r, c) = 1;
+            model[r][c] = model[c][r] = true; }
+        for (unsigned r = 0; r < N; ++r) {
+            bitvec row = m[r];
+            ASSERT_EQ(static_cast<bool>(m[r]), row.popcount() > 0);
+            for (unsigned c = 0; c < N; ++c) {
+                ASSERT_EQ(m(r, c), model[r][c]);
+                ASSERT_EQ(row[c], model[r][c]); } }
+
+        bitvec extra;
+        extra.setbit(7);
+        extra.setbit(250);
+        m[70] |= extra;
+        ASSERT_EQ(m(250, 70), true);
+        ASSERT_EQ(m(70, 7), true);
+        model[70][7] = model[7][70] = model[70][250] = model[250][70] = true;
+
+        for (unsigned k = 0; k < N; ++k)
+            for (unsigned r = 0; r < N; ++r)
+                for (unsigned c = 0; c < N; ++c)
+                    if (model[r][k] && model[k][c]) model[r][c] = true;
+        m.transitive_closure();
+        for (unsigned r = 0; r < N; ++r)
+            for (unsigned c = 0; c < N; ++c)
+                ASSERT_EQ(m(r, c), model[r][c]);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testLayout);
+        RUNTEST(testLTRows);
+        RUNTEST(testLTClosure);
+        RUNTEST(testSym);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestBitMatrix test;
+    return test.run();
+}
@@ -0,0 +1,107 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <set>
+
+#include "lib/bitvec.h"
+#include "test.h"
+
+namespace Test {
+class TestBitvec : public TestBase {
+    // every 'step'th bit from 'start' below 'limit', as a bitvec and as a set
+    static bitvec bits(size_t start, size_t step, size_t limit, std::set<size_t> *model) {
+        bitvec rv;
+        for (size_t i = start; i < limit; i += step) {
+            rv.setbit(i);
+            model->insert(i); }
+        return rv; }
+
+    static std::set<size_t> elements(const bitvec &bv) {
+        std::set<size_t> rv;
+        for (auto i : bv)
+            rv.insert(i);
+        return rv; }
+
+    int testBulk() {
+        std::set<size_t> ma, mb;
+        auto a = bits(0, 3, 1000, &ma);
+        auto b = bits(1, 5, 700, &mb);
+        std::set<size_t> u(ma), i, d;
+        u.insert(mb.begin(), mb.end());
+        for (auto x : ma)
+            (mb.count(x) ? i : d).insert(x);
+
+        ASSERT_EQ(elements(a | b) == u, true);
+        ASSERT_EQ(elements(a & b) == i, true);
+        ASSERT_EQ(elements(a - b) == d, true);
+        ASSERT_EQ((a | b).popcount(), static_cast<int>(u.size()));
+        ASSERT_EQ(a.intersects(b), true);
+        ASSERT_EQ((a | b).contains(b), true);
+        ASSERT_EQ(b.contains(a), false);
+        ASSERT_EQ((a ^ b) == ((a | b) - (a & b)), true);
+
+        bitvec c = a;
+        ASSERT_EQ(c |= (a & b), false);
+        ASSERT_EQ(c -= bitvec(), false);
+        ASSERT_EQ(c &= a, false);
+        ASSERT_EQ(c &= b, true);
+        ASSERT_EQ(c == (a & b), true);
+        return SUCCESS;
+    }
+
+    int testOrAndNot() {
+        std::set<size_t> ma, mb, mc;
+        auto a = bits(0, 7, 300, &ma);
+        auto b = bits(0, 2, 900, &mb);
+        auto c = bits(0, 3, 500, &mc);
+        bitvec expect = a | (b - c);
+        ASSERT_EQ(a.or_andnot(b, c), true);
+        ASSERT_EQ(a == expect, true);
+        ASSERT_EQ(a.or_andnot(b, c), false);
+        // vectors of one word
+        bitvec x(0x1), y(0x6), z(0x2);
+        ASSERT_EQ(x.or_andnot(y, z), true);
+        ASSERT_EQ(x == bitvec(0x5), true);
+        return SUCCESS;
+    }
+
+    int testReserve() {
+        bitvec a(0x5);
+        a.reserve(1000);
+        ASSERT_EQ(a.capacity() >= 1000, true);
+        ASSERT_EQ(a == bitvec(0x5), true);
+        ASSERT_EQ(a.popcount(), 2);
+        size_t capacity = a.capacity();
+        a.setbit(999);
+        ASSERT_EQ(a.capacity(), capacity);
+        ASSERT_EQ(a.getbit(999), true);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testBulk);
+        RUNTEST(testOrAndNot);
+        RUNTEST(testReserve);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestBitvec test;
+    return test.run();
+}
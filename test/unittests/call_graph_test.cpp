@@ -155,6 +155,68 @@ class TestCallGraph : public TestBase {
         return SUCCESS;
     }
 
+    int test6() {
+        // a->b->c->d
+        //    ^__|  ^
+        // \--------/
+        P4::CallGraph<char> cg("test");
+        cg.calls('a', 'b');
+        cg.calls('a', 'd');
+        cg.calls('b', 'c');
+        cg.calls('c', 'b');  // back-edge
+        cg.calls('c', 'd');
+        cg.add('e');  // unreachable
+
+        std::vector<char> rpo;
+        cg.reversePostOrder('a', rpo);
+        ASSERT_EQ(rpo.size(), 4);
+        ASSERT_EQ(rpo.at(0), 'a');
+        ASSERT_EQ(rpo.at(1), 'b');
+        ASSERT_EQ(rpo.at(2), 'c');
+        ASSERT_EQ(rpo.at(3), 'd');
+
+        P4::DataflowWorklist<char> work(cg, 'a');
+        ASSERT_EQ(work.pop(), 'a');
+        ASSERT_EQ(work.empty(), true);
+        work.push('d');
+        work.push('b');
+        work.push('d');
+        ASSERT_EQ(work.pop(), 'b');
+        ASSERT_EQ(work.pop(), 'd');
+        ASSERT_EQ(work.empty(), true);
+        return SUCCESS;
+    }
+
+    int test7() {
+        // a long chain with a cycle between its ends
+        P4::CallGraph<int> cg("test");
+        const int length = 100000;
+        for (int i = 0; i < length - 1; i++)
+            cg.calls(i, i + 1);
+
+        std::vector<int> sorted;
+        bool cycles = cg.sort(sorted);
+        ASSERT_EQ(cycles, false);
+        ASSERT_EQ(sorted.size(), length);
+        ASSERT_EQ(sorted.front(), length - 1);
+        ASSERT_EQ(sorted.back(), 0);
+
+        cg.calls(length - 1, 0);
+        std::vector<int> scc;
+        cycles = cg.sccSort(0, scc);
+        ASSERT_EQ(cycles, true);
+        ASSERT_EQ(scc.size(), length);
+
+        cg.removeCall(length - 1, 0);
+        ASSERT_EQ(cg.isCaller(length - 1), false);
+        ASSERT_EQ(cg.isCallee(0), false);
+        sorted.clear();
+        cycles = cg.sort(sorted);
+        ASSERT_EQ(cycles, false);
+        ASSERT_EQ(sorted.front(), length - 1);
+        return SUCCESS;
+    }
+
  public:
     int run() {
         RUNTEST(test1);
@@ -162,6 +224,8 @@ class TestCallGraph : public TestBase {
         RUNTEST(test3);
         RUNTEST(test4);
         RUNTEST(test5);
+        RUNTEST(test6);
+        RUNTEST(test7);
         return SUCCESS;
     }
 };
@@ -0,0 +1,236 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/* Microbenchmarks for the core data structures: cstring interning, ordered_map,
+ * bitvec, Inspector and Transform traversal, JsonObject serialization and JSONLoader
+ * parsing.  Each one runs a fixed workload, built from fixed seeds so that runs can be
+ * compared, a number of times, and reports the median and the fastest time per
+ * operation.  The results are written to stdout as JSON:
+ *   { "repeats": 5, "benchmarks": [ { "name": "bitvec/or", "ops": 1000, ... }, ... ] }
+ * 'make benchmark' builds this and writes its results to benchmark.json.
+ * Usage: core_bench [repeats [name prefix]] */
+
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ir/ir.h"
+#include "ir/json_generator.h"
+#include "ir/json_loader.h"
+#include "ir/visitor.h"
+#include "lib/bitvec.h"
+#include "lib/cstring.h"
+#include "lib/json.h"
+#include "lib/ordered_map.h"
+
+namespace Bench {
+
+// keeps the compiler from dropping the work being measured
+volatile uint64_t sink;
+
+class CountNodes : public Inspector {
+ public:
+    unsigned count = 0;
+    bool preorder(const IR::Node *) override { ++count; return true; }
+};
+
+class NopTransform : public Transform {};
+
+class Benchmarks {
+    unsigned repeats;
+    std::string prefix;
+    bool first = true;
+
+    static double now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9; }
+
+    // Runs 'body', which does 'ops' operations, after 'setup' each time, and prints
+    // the times per operation
+    void measure(const char *name, unsigned ops, std::function<void()> setup,
+                 std::function<void()> body) {
+        if (std::string(name).compare(0, prefix.size(), prefix) != 0)
+            return;
+        std::vector<double> times;
+        for (unsigned i = 0; i < repeats; ++i) {
+            setup();
+            double start = now();
+            body();
+            times.push_back((now() - start) * 1e9 / ops); }
+        std::sort(times.begin(), times.end());
+        std::cout << (first ? "\n" : ",\n") << "    { \"name\" : \"" << name
+                  << "\", \"ops\" : " << ops
+                  << ", \"median_ns_per_op\" : " << times[times.size() / 2]
+                  << ", \"min_ns_per_op\" : " << times[0] << " }";
+        first = false; }
+    void measure(const char *name, unsigned ops, std::function<void()> body) {
+        measure(name, ops, [] {}, body); }
+
+    void cstrings() {
+        const unsigned count = 100000;
+        std::vector<std::string> names;
+        for (unsigned i = 0; i < count; ++i)
+            names.push_back("name_" + std::to_string(i * 7919u));
+        unsigned run = 0;
+        measure("cstring/intern_new", count, [&] { ++run; }, [&] {
+            std::string tag = "r" + std::to_string(run) + "_";
+            for (auto &n : names)
+                sink = sink + cstring(tag + n).size(); });
+        for (auto &n : names)
+            sink = sink + cstring(n).size();
+        measure("cstring/intern_existing", count, [&] {
+            for (auto &n : names)
+                sink = sink + cstring(n).size(); });
+    }
+
+    void orderedMaps() {
+        const unsigned count = 100000;
+        std::mt19937 random(1);
+        std::vector<int> keys;
+        for (unsigned i = 0; i < count; ++i)
+            keys.push_back(random());
+        ordered_map<int, int> map;
+        measure("ordered_map/insert", count, [&] { map.clear(); }, [&] {
+            for (auto k : keys)
+                map[k] = k; });
+        measure("ordered_map/find", count, [&] {
+            for (auto k : keys)
+                sink = sink + map.find(k)->second; });
+        measure("ordered_map/iterate", map.size(), [&] {
+            for (auto &el : map)
+                sink = sink + el.second; });
+    }
+
+    void bitvecs() {
+        const unsigned count = 1000, bits = 1 << 16;
+        std::mt19937 random(2);
+        bitvec a, b;
+        for (unsigned i = 0; i < bits / 4; ++i) {
+            a.setbit(random() % bits);
+            b.setbit(random() % bits); }
+        bitvec c;
+        measure("bitvec/or", count, [&] {
+            for (unsigned i = 0; i < count; ++i) {
+                c = a;
+                c |= b; }
+            sink = sink + c.popcount(); });
+        measure("bitvec/and", count, [&] {
+            for (unsigned i = 0; i < count; ++i)
+                sink = sink + (a & b).empty(); });
+        measure("bitvec/popcount", count, [&] {
+            for (unsigned i = 0; i < count; ++i)
+                sink = sink + a.popcount(); });
+        unsigned setBits = a.popcount();
+        measure("bitvec/iterate", setBits * 10, [&] {
+            for (unsigned i = 0; i < 10; ++i)
+                for (auto bit : a)
+                    sink = sink + bit; });
+        measure("bitvec/setbit", bits, [&] { c.clear(); }, [&] {
+            for (unsigned i = 0; i < bits; ++i)
+                c.setbit((i * 40503u) % bits); });
+    }
+
+    // A program with many constants, each initialized by an expression tree
+    static const IR::P4Program *program(unsigned declarations) {
+        auto decls = new IR::IndexedVector<IR::Node>();
+        auto type = IR::Type_Bits::get(32);
+        unsigned value = 0;
+        std::function<const IR::Expression *(unsigned)> tree = [&](unsigned depth) {
+            if (depth == 0)
+                return static_cast<const IR::Expression *>(new IR::Constant(value++));
+            auto left = tree(depth - 1);
+            return static_cast<const IR::Expression *>(new IR::Add(left, tree(depth - 1))); };
+        for (unsigned i = 0; i < declarations; ++i)
+            decls->push_back(new IR::Declaration_Constant(
+                IR::ID(cstring("c") + Util::toString(i)), IR::Annotations::empty,
+                type, tree(4)));
+        return new IR::P4Program(decls); }
+
+    void visitors() {
+        auto prog = program(2000);
+        CountNodes count;
+        prog->apply(count);
+        measure("visitor/inspector", count.count, [&] {
+            CountNodes inspector;
+            prog->apply(inspector);
+            sink = sink + inspector.count; });
+        measure("visitor/transform", count.count, [&] {
+            NopTransform transform;
+            sink = sink + (prog->apply(transform) != nullptr); });
+    }
+
+    void json() {
+        const unsigned count = 20000;
+        auto root = new Util::JsonObject();
+        auto array = new Util::JsonArray();
+        for (unsigned i = 0; i < count; ++i) {
+            auto obj = new Util::JsonObject();
+            obj->emplace("name", cstring("field_" + std::to_string(i)));
+            obj->emplace("width", i % 64);
+            obj->emplace("signed", i % 2 == 0);
+            array->append(obj); }
+        root->emplace("fields", array);
+        measure("json/serialize", count, [&] {
+            std::stringstream out;
+            root->serialize(out);
+            sink = sink + out.str().size(); });
+        measure("json/serialize_compact", count, [&] {
+            std::stringstream out;
+            root->serialize(out, true);
+            sink = sink + out.str().size(); });
+
+        auto prog = program(500);
+        CountNodes nodes;
+        prog->apply(nodes);
+        std::stringstream text;
+        JSONGenerator(text) << static_cast<const IR::Node *>(prog);
+        std::string dump = text.str();
+        measure("json_loader/parse", nodes.count, [&] {
+            std::stringstream in(dump);
+            const IR::Node *loaded = nullptr;
+            JSONLoader loader(in);
+            loader >> loaded;
+            sink = sink + (loaded != nullptr); });
+    }
+
+ public:
+    Benchmarks(unsigned repeats, std::string prefix) : repeats(repeats), prefix(prefix) {}
+
+    void run() {
+        std::cout << "{ \"repeats\" : " << repeats << ", \"benchmarks\" : [";
+        cstrings();
+        orderedMaps();
+        bitvecs();
+        visitors();
+        json();
+        std::cout << "\n] }" << std::endl;
+    }
+};
+
+}  // namespace Bench
+
+int main(int argc, char *argv[]) {
+    unsigned repeats = argc > 1 ? atoi(argv[1]) : 5;
+    Bench::Benchmarks benchmarks(repeats ? repeats : 1, argc > 2 ? argv[2] : "");
+    benchmarks.run();
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/* Microbenchmark for contended cstring interning.  Every thread interns the
+ * same set of names (as parallel passes creating the same derived names would)
+ * plus names private to the thread, and checks that all threads agree on the
+ * interned pointers.  Usage: cstring_bench [threads [strings]] */
+
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#ifdef MULTITHREAD
+#include <thread>
+#endif  // MULTITHREAD
+
+#include "../../lib/cstring.h"
+#include "../../lib/gc.h"
+#include "test.h"
+
+namespace Test {
+class BenchCstring : public TestBase {
+    unsigned threads, strings;
+    std::vector<std::vector<const char *>> shared;
+
+    static double now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9; }
+
+    void worker(unsigned t) {
+        gc_register_thread();
+        std::string name;
+        for (unsigned i = 0; i < strings; ++i) {
+            name = "shared_name_" + std::to_string(i);
+            shared[t][i] = cstring(name).c_str();
+            name = "thread" + std::to_string(t) + "_name_" + std::to_string(i);
+            cstring local(name); }
+        gc_unregister_thread(); }
+
+ public:
+    BenchCstring(unsigned t, unsigned s) : threads(t), strings(s),
+        shared(t, std::vector<const char *>(s)) {}
+
+    int run() {
+        double start = now();
+#ifdef MULTITHREAD
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t)
+            pool.emplace_back(&BenchCstring::worker, this, t);
+        for (auto &th : pool)
+            th.join();
+#else
+        for (unsigned t = 0; t < threads; ++t)
+            worker(t);
+#endif  // MULTITHREAD
+        double elapsed = now() - start;
+
+        for (unsigned t = 1; t < threads; ++t)
+            for (unsigned i = 0; i < strings; ++i)
+                ASSERT_EQ(shared[t][i], shared[0][i]);
+
+        size_t count, bytes = cstring::cache_size(count);
+        std::cout << threads << " threads x " << 2*strings << " strings: "
+                  << elapsed * 1e9 / (2.0 * threads * strings) << " ns/intern, "
+                  << count << " strings in " << bytes << " bytes" << std::endl;
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int argc, char *argv[]) {
+    unsigned threads = argc > 1 ? atoi(argv[1]) : 4;
+    unsigned strings = argc > 2 ? atoi(argv[2]) : 100000;
+    Test::BenchCstring bench(threads ? threads : 1, strings);
+    return bench.run();
+}
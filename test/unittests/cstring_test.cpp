@@ -0,0 +1,118 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../../lib/cstring.h"
+#include "test.h"
+
+namespace Test {
+class TestCstring : public TestBase {
+    int testIntern() {
+        cstring a = "hello";
+        cstring b = std::string("hel") + "lo";
+        ASSERT_EQ(a.c_str(), b.c_str());
+        ASSERT_EQ(a.size(), 5u);
+        ASSERT_EQ(a.hash(), b.hash());
+        ASSERT_NEQ(a.c_str(), cstring("hello!").c_str());
+
+        cstring empty = "";
+        ASSERT_EQ(empty.size(), 0u);
+        ASSERT_EQ(empty.c_str(), cstring::empty.c_str());
+        cstring null;
+        ASSERT_EQ(null.size(), 0u);
+        ASSERT_EQ(null.isNull(), true);
+        return SUCCESS;
+    }
+
+    int testMany() {
+        // enough strings to force the table to grow and several arena pages
+        std::vector<cstring> strings;
+        for (int i = 0; i < 100000; ++i)
+            strings.push_back(cstring::to_cstring(i));
+        for (int i = 0; i < 100000; ++i) {
+            cstring s = std::to_string(i);
+            ASSERT_EQ(s.c_str(), strings[i].c_str());
+            ASSERT_EQ(s.size(), strlen(s.c_str())); }
+
+        // strings bigger than an arena page
+        std::string big(200000, 'x');
+        cstring b1 = big, b2 = big;
+        ASSERT_EQ(b1.c_str(), b2.c_str());
+        ASSERT_EQ(b1.size(), big.size());
+
+        size_t count;
+        cstring::cache_size(count);
+        ASSERT_EQ(count >= 100000, true);
+        return SUCCESS;
+    }
+
+    int testHashMap() {
+        std::unordered_map<cstring, int> map;
+        map["a"] = 1;
+        map["b"] = 2;
+        map[cstring("a") + "b"] = 3;
+        ASSERT_EQ(map.at("a"), 1);
+        ASSERT_EQ(map.at("ab"), 3);
+        ASSERT_EQ(map.size(), 3u);
+        return SUCCESS;
+    }
+
+    int testBuilder() {
+        cstring_builder name(cstring("builder_test"));
+        size_t before, after;
+        cstring::cache_size(before);
+        name += '.';
+        name += "field";
+        size_t prefix = name.size();
+        name += '_';
+        name += 42u;
+        // nothing is interned until str()
+        ASSERT_EQ(name.existing().isNull(), true);
+        cstring::cache_size(after);
+        ASSERT_EQ(after, before);
+        cstring s = name.str();
+        ASSERT_EQ(s, "builder_test.field_42");
+        ASSERT_EQ(name.existing().c_str(), s.c_str());
+        name.truncate(prefix);
+        ASSERT_EQ(name.string(), "builder_test.field");
+
+        std::set<cstring> inuse = { "builder_x", "builder_x.0", "builder_x.1" };
+        ASSERT_EQ(cstring::make_unique(inuse, "builder_x"), "builder_x.2");
+        ASSERT_EQ(cstring::make_unique(inuse, "builder_y"), "builder_y");
+        ASSERT_EQ(cstring("a.b.c").replace('.', '_'), "a_b_c");
+        ASSERT_EQ(cstring("abcdef").substr(2, 3), "cde");
+        ASSERT_EQ(cstring("abcdef").substr(4, 10), "ef");
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testIntern);
+        RUNTEST(testMany);
+        RUNTEST(testHashMap);
+        RUNTEST(testBuilder);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestCstring test;
+    return test.run();
+}
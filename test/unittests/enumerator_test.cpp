@@ -47,6 +47,49 @@ class TestEnumerator : public TestBase {
         RUNTEST(testSimple);
         RUNTEST(testLinq);
         RUNTEST(testRange);
+        RUNTEST(testLazy);
+        return SUCCESS;
+    }
+
+    int testLazy() {
+        int offset = 10;
+        auto range = enumerate(vec)
+                .where([](int x) { return x != 2; })
+                .map([offset](int x) { return x + offset; });
+        std::vector<int> result = range.toVector();
+        ASSERT_EQ(result.size(), 2u);
+        ASSERT_EQ(result[0], 11);
+        ASSERT_EQ(result[1], 13);
+        ASSERT_EQ(range.count(), 2u);
+        ASSERT_EQ(range.nextOrDefault(), 11);
+        ASSERT_EQ(range.where([](int x) { return x > 11; }).single(), 13);
+        ASSERT_EQ(range.where([](int x) { return x > 20; }).any(), false);
+        ASSERT_EQ(range.where([](int x) { return x > 20; }).nextOrDefault(), 0);
+
+        auto both = range.concat(enumerate(vec));
+        int sum = 0;
+        for (auto a : both)
+            sum += a;
+        ASSERT_EQ(sum, 30);
+        ASSERT_EQ(both.count(), 5u);
+
+        // an enumerator, for the interfaces that return one
+        Enumerator<int>* e = both.toEnumerator();
+        ASSERT_EQ(e->count(), 5u);
+        e->reset();
+        ASSERT_EQ(e->next(), 11);
+
+        std::vector<B*> bs;
+        bs.push_back(new B(1));
+        bs.push_back(new B(2));
+        auto as = enumerate(bs).as<A*>();
+        ASSERT_EQ((*as.begin())->a, 1);
+        ASSERT_EQ(as.count(), 2u);
+        try {
+            as.single();
+            UNREACHABLE();
+        }
+        catch (std::logic_error&) {}
         return SUCCESS;
     }
 
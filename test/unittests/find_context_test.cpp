@@ -0,0 +1,100 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir/ir.h"
+#include "ir/visitor.h"
+#include "test.h"
+
+namespace Test {
+// what the contexts of the field types looked like
+struct Counts {
+    unsigned types = 0, structs = 0, headers = 0, origHeaders = 0, fields = 0;
+    void count(const Visitor &v) {
+        ++types;
+        if (v.findContext<IR::Type_Struct>()) ++structs;
+        if (v.findContext<IR::Type_Header>()) ++headers;
+        if (v.findOrigCtxt<IR::Type_Header>()) ++origHeaders;
+        // not an indexed kind, so found by the full search
+        if (v.findContext<IR::StructField>()) ++fields;
+        BUG_CHECK(!v.findContext<IR::P4Control>(), "no control here"); }
+};
+
+class InspectFields : public Inspector {
+ public:
+    Counts counts;
+    InspectFields() { visitDagOnce = false; }
+    bool preorder(const IR::Type_Bits *) override { counts.count(*this); return false; }
+};
+
+// turns headers into structs
+class HeaderToStruct : public Transform {
+ public:
+    Counts counts;
+    HeaderToStruct() { visitDagOnce = false; }
+    const IR::Node *preorder(IR::Type_Header *h) override {
+        return new IR::Type_Struct(h->srcInfo, h->name, h->annotations, h->fields); }
+    const IR::Node *preorder(IR::Type_Bits *t) override {
+        counts.count(*this);
+        prune();
+        return t; }
+};
+
+class TestFindContext : public TestBase {
+    static const IR::IndexedVector<IR::StructField> *fields() {
+        auto rv = new IR::IndexedVector<IR::StructField>();
+        rv->push_back(new IR::StructField(IR::ID("a"), IR::Type_Bits::get(8)));
+        rv->push_back(new IR::StructField(IR::ID("b"), IR::Type_Bits::get(16)));
+        return rv; }
+
+    int testInspector() {
+        auto vec = new IR::Vector<IR::Node>();
+        vec->push_back(new IR::Type_Struct("s", fields()));
+        vec->push_back(new IR::Type_Header("h", fields()));
+        InspectFields inspect;
+        vec->apply(inspect);
+        ASSERT_EQ(inspect.counts.types, 4u);
+        ASSERT_EQ(inspect.counts.structs, 2u);
+        ASSERT_EQ(inspect.counts.headers, 2u);
+        ASSERT_EQ(inspect.counts.origHeaders, 2u);
+        ASSERT_EQ(inspect.counts.fields, 4u);
+        return SUCCESS;
+    }
+
+    int testTransform() {
+        HeaderToStruct transform;
+        auto result = (new IR::Type_Header("h", fields()))->apply(transform);
+        ASSERT_EQ(result->is<IR::Type_Struct>(), true);
+        ASSERT_EQ(transform.counts.types, 2u);
+        // the replacement is what the children see, but the original is still a header
+        ASSERT_EQ(transform.counts.structs, 2u);
+        ASSERT_EQ(transform.counts.headers, 0u);
+        ASSERT_EQ(transform.counts.origHeaders, 2u);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testInspector);
+        RUNTEST(testTransform);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestFindContext test;
+    return test.run();
+}
@@ -14,6 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <sstream>
+#include <string>
+
 #include "../../lib/error.h"
 #include "../../lib/cstring.h"
 #include "../../lib/stringify.h"
@@ -41,8 +44,7 @@ class NiceFormat {
 };
 
 class TestFormat : public TestBase {
- public:
-    int run() {
+    int testFormat() {
         cstring message = ErrorReporter::instance.format_message("%1%", 5u);
         ASSERT_EQ(message, "5\n");
 
@@ -69,6 +71,44 @@ class TestFormat : public TestBase {
 
         return SUCCESS;
     }
+
+    // warnings are formatted when they are flushed, at most 2 of each kind here
+    int testWarnings() {
+        std::stringstream out;
+        ErrorReporter::instance.setOutputStream(&out);
+        ErrorReporter::instance.setWarningLimit(2);
+        ErrorReporter::instance.setDeduplicate(true);
+        std::string temporary = "kept";
+        for (int i = 0; i < 4; ++i)
+            ::warning("%1% %2%", temporary.c_str(), i);
+        temporary = "changed";
+        ::warning("other");
+        ::warning("other");
+        ASSERT_EQ(out.str(), "");
+        ASSERT_EQ(ErrorReporter::instance.getWarningCount(), 6u);
+
+        ErrorReporter::instance.flush();
+        ASSERT_EQ(out.str(), "warning: kept 0\nwarning: kept 1\nwarning: other\n"
+                  "warning: 2 more warnings of kinds already shown were not printed\n");
+
+        // an error comes after the warnings reported before it
+        out.str("");
+        ErrorReporter::instance.reset();
+        ::warning("first");
+        ::error("second");
+        ASSERT_EQ(out.str(), "warning: first\nerror: second\n");
+
+        ErrorReporter::instance.reset();
+        ErrorReporter::instance.setOutputStream(&std::cerr);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testFormat);
+        RUNTEST(testWarnings);
+        return SUCCESS;
+    }
 };
 }  // namespace Test
 
@@ -0,0 +1,101 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lib/hashed_multimap.h"
+#include "test.h"
+
+namespace Test {
+class TestHashedMultimap : public TestBase {
+    typedef hashed_multimap<std::string, int> map_t;
+
+    static std::vector<int> values(const map_t &m) {
+        std::vector<int> rv;
+        for (auto &el : m) rv.push_back(el.second);
+        return rv; }
+
+    // keys in the order they were first added, each followed by all its elements
+    int testOrder() {
+        map_t m;
+        m.emplace("b", 1);
+        m.emplace("a", 2);
+        m.emplace("b", 3);
+        m.emplace("c", 4);
+        m.emplace("a", 5);
+        m.emplace("b", 6);
+        ASSERT_EQ(values(m) == std::vector<int>({ 1, 3, 6, 2, 5, 4 }), true);
+        ASSERT_EQ(m.size(), 6u);
+        ASSERT_EQ(m.count("b"), 3u);
+        ASSERT_EQ(m.count("d"), 0u);
+        ASSERT_EQ(m.find("a")->second, 2);
+        ASSERT_EQ(m.find("d") == m.end(), true);
+        ASSERT_EQ(m.at("c"), 4);
+        ASSERT_EQ(m.rbegin()->second, 4);
+        return SUCCESS;
+    }
+
+    int testErase() {
+        map_t m;
+        for (int i = 0; i < 6; ++i)
+            m.emplace(i % 2 ? "odd" : "even", i);
+        // erasing the first of a key makes the next one the first
+        auto it = m.erase(m.find("even"));
+        ASSERT_EQ(it->second, 2);
+        ASSERT_EQ(m.find("even")->second, 2);
+        ASSERT_EQ(m.count("even"), 2u);
+        ASSERT_EQ(m.erase("odd"), 3u);
+        ASSERT_EQ(m.erase("odd"), 0u);
+        ASSERT_EQ(values(m) == std::vector<int>({ 2, 4 }), true);
+        m.emplace("odd", 7);
+        m.erase(m.begin(), m.find("odd"));
+        ASSERT_EQ(values(m) == std::vector<int>({ 7 }), true);
+        ASSERT_EQ(m.count("even"), 0u);
+        return SUCCESS;
+    }
+
+    // a copy has an index of its own elements
+    int testCopy() {
+        map_t m;
+        m.emplace("x", 1);
+        m.emplace("y", 2);
+        map_t copy(m);
+        m.clear();
+        copy.emplace("x", 3);
+        ASSERT_EQ(values(copy) == std::vector<int>({ 1, 3, 2 }), true);
+        ASSERT_EQ(copy.find("y")->second, 2);
+        map_t moved(std::move(copy));
+        ASSERT_EQ(moved.count("x"), 2u);
+        ASSERT_EQ(moved == map_t({ { "x", 1 }, { "x", 3 }, { "y", 2 } }), true);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testOrder);
+        RUNTEST(testErase);
+        RUNTEST(testCopy);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestHashedMultimap test;
+    return test.run();
+}
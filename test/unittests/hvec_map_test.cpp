@@ -0,0 +1,119 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "lib/hvec_map.h"
+#include "test.h"
+
+namespace Test {
+class TestHvecMap : public TestBase {
+    template<class M> static std::vector<int> keys(const M &m) {
+        std::vector<int> rv;
+        for (auto &el : m) rv.push_back(el.first);
+        return rv; }
+
+    int testOrder() {
+        hvec_map<int, int> m;
+        for (int i : { 5, 3, 9, 1, 7 })
+            m[i] = i * 10;
+        ASSERT_EQ(m.size(), 5u);
+        ASSERT_EQ(keys(m) == std::vector<int>({ 5, 3, 9, 1, 7 }), true);
+        ASSERT_EQ(m.at(9), 90);
+        ASSERT_EQ(m.count(4), 0u);
+        ASSERT_EQ(m.find(4) == m.end(), true);
+        ASSERT_EQ(m.emplace(3, 0).second, false);
+        ASSERT_EQ(m.insert(std::make_pair(4, 40)).second, true);
+        ASSERT_EQ(keys(m) == std::vector<int>({ 5, 3, 9, 1, 7, 4 }), true);
+        auto last = m.rbegin();
+        ASSERT_EQ(last->first, 4);
+        return SUCCESS;
+    }
+
+    int testErase() {
+        hvec_map<int, int> m;
+        for (int i = 0; i < 10; ++i)
+            m.emplace(i, i);
+        auto it = m.erase(m.find(3));
+        ASSERT_EQ(it->first, 4);
+        ASSERT_EQ(m.erase(7), 1u);
+        ASSERT_EQ(m.erase(7), 0u);
+        ASSERT_EQ(m.size(), 8u);
+        ASSERT_EQ(keys(m) == std::vector<int>({ 0, 1, 2, 4, 5, 6, 8, 9 }), true);
+        // an erased key goes back at the end
+        m[3] = 33;
+        ASSERT_EQ(keys(m).back(), 3);
+        ASSERT_EQ(m.at(3), 33);
+        return SUCCESS;
+    }
+
+    // agrees with a simple model through enough inserts and erases to grow, compact
+    // and shrink the index, with keys that collide in the low bits
+    int testAgainstModel() {
+        hvec_map<int, int> h;
+        std::map<int, int> values;
+        std::vector<int> order;
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 0; i < 500; ++i) {
+                int k = (i * 7919 + round * 31) % 1000 * 1024;
+                if (!values.count(k)) order.push_back(k);
+                h[k] += i;
+                values[k] += i; }
+            for (int i = 0; i < 400; ++i) {
+                int k = (i * 104729 + round) % 1000 * 1024;
+                if (values.erase(k))
+                    order.erase(std::find(order.begin(), order.end(), k));
+                h.erase(k);
+                ASSERT_EQ(h.count(k), 0u); }
+            ASSERT_EQ(h.size(), values.size());
+            ASSERT_EQ(keys(h) == order, true);
+            for (auto &el : values)
+                ASSERT_EQ(h.at(el.first), el.second); }
+        return SUCCESS;
+    }
+
+    int testCopy() {
+        hvec_map<int, int> a = { { 1, 10 }, { 2, 20 } };
+        hvec_map<int, int> b(a);
+        b.erase(1);
+        ASSERT_EQ(a.size(), 2u);
+        ASSERT_EQ(a == b, false);
+        b = a;
+        ASSERT_EQ(a == b, true);
+        hvec_map<int, int> c(std::move(b));
+        ASSERT_EQ(c.size(), 2u);
+        ASSERT_EQ(b.empty(), true);
+        ASSERT_EQ(b.find(1) == b.end(), true);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testOrder);
+        RUNTEST(testErase);
+        RUNTEST(testAgainstModel);
+        RUNTEST(testCopy);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestHvecMap test;
+    return test.run();
+}
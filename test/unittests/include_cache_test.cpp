@@ -0,0 +1,93 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string>
+
+#include "frontends/common/frontendCache.h"
+#include "lib/source_file.h"
+#include "setup.h"
+#include "test.h"
+
+namespace Test {
+class TestIncludeCache : public TestBase {
+    std::string marker(unsigned line, std::string file, const char *flags) {
+        return "# " + std::to_string(line) + " \"" + file + "\"" + flags + "\n"; }
+
+    // core.p4 with an include of its own, then v1model.p4, then the program
+    std::string program() {
+        std::string sys = p4includePath;
+        return marker(1, "prog.p4", "") +
+               "\n" +
+               marker(1, sys + "/core.p4", " 1") +
+               "error { NoError }\n" +
+               marker(1, sys + "/more.p4", " 1") +
+               "match_kind { exact }\n" +
+               marker(3, sys + "/core.p4", " 2") +
+               "extern packet_in {}\n" +
+               marker(2, "prog.p4", " 2") +
+               "\n" +
+               "#pragma once\n" +
+               marker(1, sys + "/v1model.p4", " 1") +
+               "struct standard_metadata_t {}\n" +
+               marker(4, "prog.p4", " 2") +
+               "header h_t {}\n" +
+               marker(1, sys + "/late.p4", " 1") +
+               "struct late {}\n" +
+               marker(6, "prog.p4", " 2"); }
+
+    int testLeadingIncludes() {
+        std::string text = program();
+        auto includes = IncludeCache::leadingIncludes(text);
+        ASSERT_EQ(includes.size(), 2u);
+        // each one starts at its line marker and ends before the one leaving it
+        ASSERT_EQ(text.compare(includes[0].first, 4, "# 1 "), 0);
+        ASSERT_EQ(text.compare(includes[0].second, 13, "# 2 \"prog.p4\""), 0);
+        ASSERT_EQ(text.find("packet_in") < includes[0].second, true);
+        ASSERT_EQ(text.compare(includes[1].second, 13, "# 4 \"prog.p4\""), 0);
+        ASSERT_EQ(text.find("standard_metadata_t") > includes[1].first, true);
+
+        ASSERT_EQ(IncludeCache::leadingIncludes("header h_t {}\n" + program()).size(), 0u);
+        return SUCCESS;
+    }
+
+    // the text and the line mapping come out as the lexer makes them
+    int testAppendSource() {
+        auto sources = Util::InputSources::instance;
+        unsigned first = sources->getCurrentLineNumber();
+        std::string text = marker(1, "prog.p4", "") + "\n" + marker(7, "lib.p4", " 1") + "x\n";
+        IncludeCache::appendSource(text.data(), text.data() + text.size());
+
+        ASSERT_EQ(sources->getCurrentLineNumber(), first + 4);
+        ASSERT_EQ(sources->getLine(first + 3), "x\n");
+        ASSERT_EQ(sources->getSourceLine(first + 3).fileName, "lib.p4");
+        ASSERT_EQ(sources->getSourceLine(first + 3).sourceLine, 7u);
+        ASSERT_EQ(sources->getSourceLine(first + 1).fileName, "prog.p4");
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testLeadingIncludes);
+        RUNTEST(testAppendSource);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestIncludeCache test;
+    return test.run();
+}
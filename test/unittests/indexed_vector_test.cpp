@@ -0,0 +1,97 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir/ir.h"
+#include "lib/error.h"
+#include "test.h"
+
+namespace Test {
+class TestIndexedVector : public TestBase {
+    static const IR::Declaration_Constant *decl(cstring name, int value) {
+        return new IR::Declaration_Constant(IR::ID(name), IR::Annotations::empty,
+                                            IR::Type_Bits::get(32), new IR::Constant(value)); }
+
+    static IR::IndexedVector<IR::Node> *vector() {
+        auto rv = new IR::IndexedVector<IR::Node>();
+        rv->push_back(decl("a", 1));
+        rv->push_back(new IR::Constant(2));
+        rv->push_back(decl("b", 3));
+        return rv; }
+
+    static int value(const IR::IndexedVector<IR::Node> *vec, cstring name) {
+        auto d = vec->getDeclaration<IR::Declaration_Constant>(name);
+        return d ? d->initializer->to<IR::Constant>()->asInt() : -1; }
+
+    int testLookup() {
+        auto vec = vector();
+        ASSERT_EQ(value(vec, "a"), 1);
+        ASSERT_EQ(value(vec, "b"), 3);
+        ASSERT_EQ(value(vec, "c"), -1);
+        vec->erase(vec->begin());
+        ASSERT_EQ(value(vec, "a"), -1);
+        vec->push_back(decl("a", 4));
+        ASSERT_EQ(value(vec, "a"), 4);
+        return SUCCESS;
+    }
+
+    // copies share the index until one of them changes
+    int testCopy() {
+        auto vec = vector();
+        ASSERT_EQ(value(vec, "a"), 1);
+        auto same = vec->clone();
+        auto renamed = vec->clone();
+        auto changed = vec->clone();
+        renamed->replace(renamed->begin(), decl("c", 5));
+        changed->replace(changed->begin(), decl("a", 6));
+        changed->pop_back();
+        ASSERT_EQ(value(same, "a"), 1);
+        ASSERT_EQ(value(renamed, "a"), -1);
+        ASSERT_EQ(value(renamed, "c"), 5);
+        ASSERT_EQ(value(changed, "a"), 6);
+        ASSERT_EQ(value(changed, "b"), -1);
+        ASSERT_EQ(value(vec, "a"), 1);
+        ASSERT_EQ(value(vec, "b"), 3);
+        ASSERT_EQ(value(vec, "c"), -1);
+        return SUCCESS;
+    }
+
+    // duplicates are reported when inserted, even before any lookup
+    int testDuplicate() {
+        auto vec = vector();
+        auto copy = vec->clone();
+        unsigned errors = ::errorCount();
+        copy->push_back(decl("b", 7));
+        ASSERT_EQ(::errorCount(), errors + 1);
+        ASSERT_EQ(value(copy, "b"), 3);
+        vec->replace(vec->begin(), decl("b", 8));
+        ASSERT_EQ(::errorCount(), errors + 2);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testLookup);
+        RUNTEST(testCopy);
+        RUNTEST(testDuplicate);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestIndexedVector test;
+    return test.run();
+}
@@ -0,0 +1,168 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <set>
+#include <string>
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/resolveReferences.h"
+#include "frontends/p4/evaluator/evaluator.h"
+#include "frontends/p4/frontend.h"
+#include "frontends/p4/p4-parse.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+#include "lib/source_file.h"
+#include "midend/inlining.h"
+#include "test.h"
+
+namespace Test {
+class TestInlinePolicy : public TestBase {
+    // 'a' is invoked twice and 'b' once, so inlining 'a' costs twice as much;
+    // 'm' is the instance of a larger control
+    static const char* program;
+
+    class CountNodes : public Inspector {
+     public:
+        unsigned count = 0;
+        bool preorder(const IR::Node*) override { ++count; return true; }
+    };
+
+    // inlines only the optional instances that fit the budget
+    class TestPolicy : public P4::InlinePolicy {
+        unsigned nodes;
+     public:
+        explicit TestPolicy(unsigned nodes) : nodes(nodes) {}
+        bool mandatory(const P4::CallInfo* call) const override
+        { return call->instantiation->externalName() == "m"; }
+        unsigned budget() const override { return nodes; }
+    };
+
+    static const IR::P4Program* parse() {
+        Util::InputSources::reset();
+        auto prog = parse_P4_16_text("prog.p4", program, nullptr, 1);
+        CompilerOptions options;
+        return P4::FrontEnd().run(options, prog); }
+
+    // the instances left in the control 'caller' after inlining, by the names they
+    // have in the source, which the front end keeps in @name
+    static std::set<cstring> instances(const IR::P4Program* prog,
+                                       const P4::InlinePolicy* policy) {
+        P4::ReferenceMap refMap;
+        P4::TypeMap typeMap;
+        auto evaluator = new P4::EvaluatorPass(&refMap, &typeMap);
+        PassManager passes({
+            new P4::TypeChecking(&refMap, &typeMap),
+            evaluator,
+            new P4::Inline(&refMap, &typeMap, evaluator, policy) });
+        prog = prog->apply(passes);
+        std::set<cstring> result;
+        if (prog == nullptr) return result;
+        for (auto decl : *prog->declarations) {
+            auto control = decl->to<IR::P4Control>();
+            if (control == nullptr || control->name != "caller") continue;
+            for (auto local : *control->controlLocals)
+                if (local->is<IR::Declaration_Instance>())
+                    result.emplace(local->externalName()); }
+        return result; }
+
+    // the nodes of the control that 'a' and 'b' instantiate
+    static unsigned smallNodes(const IR::P4Program* prog) {
+        for (auto decl : *prog->declarations) {
+            auto control = decl->to<IR::P4Control>();
+            if (control == nullptr || control->name != "small") continue;
+            CountNodes count;
+            control->apply(count);
+            return count.count; }
+        return 0; }
+
+    int testNoPolicy() {
+        auto prog = parse();
+        ASSERT_EQ(::errorCount(), 0u);
+        ASSERT_EQ(instances(prog, nullptr).size(), 0u);
+        return SUCCESS;
+    }
+
+    // the mandatory instance is inlined whatever the budget
+    int testMandatoryOnly() {
+        auto prog = parse();
+        TestPolicy policy(0);
+        auto left = instances(prog, &policy);
+        ASSERT_EQ(::errorCount(), 0u);
+        ASSERT_EQ(left.size(), 2u);
+        ASSERT_EQ(left.count("a"), 1u);
+        ASSERT_EQ(left.count("b"), 1u);
+        return SUCCESS;
+    }
+
+    // each call site of an instance adds a copy of its control to the cost, and the
+    // cheapest instances are inlined first
+    int testCallSites() {
+        auto prog = parse();
+        unsigned nodes = smallNodes(prog);
+        ASSERT_EQ(nodes > 0, true);
+        // 'b' costs 'nodes', and then 'a' costs twice as much as is left
+        TestPolicy some(nodes * 3 / 2);
+        auto left = instances(prog, &some);
+        ASSERT_EQ(::errorCount(), 0u);
+        ASSERT_EQ(left.size(), 1u);
+        ASSERT_EQ(left.count("a"), 1u);
+        TestPolicy all(nodes * 3);
+        ASSERT_EQ(instances(prog, &all).size(), 0u);
+        return SUCCESS;
+    }
+
+    int testWithinBudget() {
+        auto prog = parse();
+        P4::InlineWithinBudget none(0);
+        auto left = instances(prog, &none);
+        ASSERT_EQ(::errorCount(), 0u);
+        ASSERT_EQ(left.size(), 3u);
+        P4::InlineWithinBudget some(smallNodes(prog));
+        left = instances(prog, &some);
+        ASSERT_EQ(left.size(), 2u);
+        ASSERT_EQ(left.count("b"), 0u);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testNoPolicy);
+        RUNTEST(testMandatoryOnly);
+        RUNTEST(testCallSites);
+        RUNTEST(testWithinBudget);
+        return SUCCESS;
+    }
+};
+
+const char* TestInlinePolicy::program =
+    "control ctr(inout bit<8> x);\n"
+    "package top(ctr c);\n"
+    "control small(inout bit<8> x) { apply { x = x + 1; } }\n"
+    "control large(inout bit<8> x) {\n"
+    "    apply { x = x + 1; x = x + 2; x = x + 3; x = x + 4; x = x + 5; }\n"
+    "}\n"
+    "control caller(inout bit<8> x) {\n"
+    "    small() a;\n"
+    "    small() b;\n"
+    "    large() m;\n"
+    "    apply { a.apply(x); b.apply(x); a.apply(x); m.apply(x); }\n"
+    "}\n"
+    "top(caller()) main;\n";
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestInlinePolicy test;
+    return test.run();
+}
@@ -0,0 +1,184 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sstream>
+
+#include "ir/ir.h"
+#include "ir/json_generator.h"
+#include "ir/json_loader.h"
+#include "lib/gzstream.h"
+#include "lib/nullstream.h"
+#include "test.h"
+
+namespace Test {
+class TestJsonParser : public TestBase {
+    int testValues() {
+        std::stringstream in("{ \"Node_ID\" : 12, \"Node_Type\" : \"Add\", \"v\" : "
+                             "[ 1, -2, 123456789012345678901234, true, false, null, [], {} ],"
+                             " \"s\" : \"\" }");
+        JsonData *json;
+        in >> json;
+        auto obj = json->to<JsonObject>();
+        ASSERT_EQ(obj != nullptr, true);
+        ASSERT_EQ(obj->get_id(), 12);
+        ASSERT_EQ(cstring(obj->get_type()), cstring("Add"));
+        auto vec = get(obj, "v")->to<JsonVector>();
+        ASSERT_EQ(vec->size(), 8u);
+        ASSERT_EQ(static_cast<int>(*vec->at(1)->to<JsonNumber>()), -2);
+        ASSERT_EQ(vec->at(2)->to<JsonNumber>()->value() == mpz_class("123456789012345678901234"),
+                  true);
+        ASSERT_EQ(static_cast<bool>(*vec->at(3)->to<JsonBoolean>()), true);
+        ASSERT_EQ(static_cast<bool>(*vec->at(4)->to<JsonBoolean>()), false);
+        ASSERT_EQ(vec->at(5)->is<JsonNull>(), true);
+        ASSERT_EQ(vec->at(6)->to<JsonVector>()->empty(), true);
+        ASSERT_EQ(vec->at(7)->to<JsonObject>()->empty(), true);
+        ASSERT_EQ(get(obj, "s")->to<JsonString>()->len, 0u);
+        return SUCCESS;
+    }
+
+    // loading what JSONGenerator wrote gives back the same text
+    int testRoundTrip() {
+        auto c = new IR::Constant(mpz_class("123456789012345678901234567890"));
+        const IR::Node *expr = new IR::Add(c, new IR::Neg(c));
+        std::stringstream first, second;
+        JSONGenerator(first) << expr;
+        const IR::Node *loaded = nullptr;
+        JSONLoader loader(first);
+        loader >> loaded;
+        ASSERT_EQ(loaded != nullptr, true);
+        auto add = loaded->to<IR::Add>();
+        ASSERT_EQ(add != nullptr, true);
+        ASSERT_EQ(add->left == add->right->to<IR::Neg>()->expr, true);
+        JSONGenerator(second) << loaded;
+        ASSERT_EQ(cstring(second.str()), cstring(first.str()));
+        return SUCCESS;
+    }
+
+    // the text of a tree does not depend on the ids of its nodes, and the nodes loaded
+    // from it get new ones
+    int testNodeNumbers() {
+        auto tree = []() -> const IR::Node * {
+            // of a type without a declid, which each new Type_InfInt gets
+            auto c = new IR::Constant(IR::Type_Bits::get(8), 7);
+            return new IR::Add(c, new IR::Neg(c)); };
+        const IR::Node *first = tree();
+        for (int i = 0; i < 10; ++i)
+            new IR::Constant(i);
+        const IR::Node *second = tree();
+        std::stringstream one, two;
+        JSONGenerator(one) << first;
+        JSONGenerator(two) << second;
+        ASSERT_EQ(cstring(two.str()), cstring(one.str()));
+        const IR::Node *loaded = nullptr;
+        JSONLoader loader(one);
+        loader >> loaded;
+        ASSERT_EQ(loaded != nullptr, true);
+        ASSERT_EQ(loaded->id > second->id, true);
+        return SUCCESS;
+    }
+
+    // ids that JSONGenerator did not number, as older files have, are kept apart from the
+    // table of the numbered ones, and ids that it never writes are errors
+    int testOtherIds() {
+        auto c = new IR::Constant(5);
+        const IR::Node *expr = new IR::Add(c, new IR::Neg(c));
+        std::stringstream out;
+        JSONGenerator(out) << expr;
+        std::string text = out.str(), key = "\"Node_ID\" : ";
+        for (size_t at = text.find(key); at != std::string::npos; at = text.find(key, at)) {
+            at += key.size();
+            text.insert(at, "1000000"); }
+        std::stringstream sparse(text);
+        const IR::Node *loaded = nullptr;
+        JSONLoader(sparse) >> loaded;
+        ASSERT_EQ(::errorCount(), 0u);
+        auto add = loaded ? loaded->to<IR::Add>() : nullptr;
+        ASSERT_EQ(add != nullptr, true);
+        ASSERT_EQ(add->left == add->right->to<IR::Neg>()->expr, true);
+
+        std::stringstream negative("{ \"Node_ID\" : -5, \"Node_Type\" : \"Constant\" }");
+        loaded = nullptr;
+        JSONLoader(negative) >> loaded;
+        ASSERT_EQ(::errorCount(), 1u);
+        ASSERT_EQ(loaded == nullptr, true);
+        return SUCCESS;
+    }
+
+    // the compact text has no newlines, and loads as the same tree
+    int testCompact() {
+        auto c = new IR::Constant(5);
+        const IR::Node *expr = new IR::Add(c, new IR::Neg(c));
+        std::stringstream compact, first, second;
+        JSONGenerator(compact, true) << expr << std::endl;
+        ASSERT_EQ(compact.str().find('\n'), std::string::npos);
+        const IR::Node *loaded = nullptr;
+        JSONLoader loader(compact);
+        loader >> loaded;
+        ASSERT_EQ(loaded != nullptr, true);
+        JSONGenerator(first) << expr;
+        JSONGenerator(second) << loaded;
+        ASSERT_EQ(cstring(second.str()), cstring(first.str()));
+        return SUCCESS;
+    }
+
+#if HAVE_LIBZ
+    // a .gz file reads back as what was written
+    int testGzip() {
+        char name[] = "/tmp/json_parser_test_XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_EQ(fd >= 0, true);
+        close(fd);
+        unlink(name);
+        cstring file = cstring(name) + ".gz";
+        const IR::Node *expr = new IR::Add(new IR::Constant(1), new IR::Constant(2));
+        std::stringstream plain;
+        JSONGenerator(plain) << expr;
+        auto out = openFile(file, false);
+        ASSERT_EQ(out != nullptr, true);
+        JSONGenerator(*out) << expr;
+        delete out;
+        auto in = openInputFile(file);
+        ASSERT_EQ(in != nullptr, true);
+        std::stringstream text;
+        text << in->rdbuf();
+        delete in;
+        unlink(file.c_str());
+        ASSERT_EQ(cstring(text.str()), cstring(plain.str()));
+        return SUCCESS;
+    }
+#endif
+
+ public:
+    int run() {
+        RUNTEST(testValues);
+        RUNTEST(testRoundTrip);
+        RUNTEST(testNodeNumbers);
+        RUNTEST(testOtherIds);
+        RUNTEST(testCompact);
+#if HAVE_LIBZ
+        RUNTEST(testGzip);
+#endif
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestJsonParser test;
+    return test.run();
+}
@@ -14,6 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <limits.h>
+#include <sstream>
+
 #include "../../lib/json.h"
 #include "test.h"
 
@@ -53,11 +56,91 @@ class TestJson : public TestBase {
         obj->emplace("y", arr);
         ASSERT_EQ(obj->toString(), "{\n  \"x\" : \"x\",\n  \"y\" : [\n    5,\n    \"5\",\n    [true]\n  ]\n}");
 
+        std::stringstream compact;
+        obj->serialize(compact, true);
+        ASSERT_EQ(compact.str(), "{\"x\":\"x\",\"y\":[5,\"5\",[true]]}");
+        return SUCCESS;
+    }
+
+    // writing as it goes produces the same text as serializing the equivalent tree
+    int testWriter() {
+        auto obj = new JsonObject();
+        obj->emplace("n", mpz_class("-123456789012345678901234567890"));
+        auto arr = new JsonArray();
+        arr->append(new JsonObject());
+        arr->append(new JsonArray());
+        obj->emplace("a", arr);
+        obj->emplace("z", JsonValue::null);
+        for (bool compact : { false, true }) {
+            std::stringstream tree, stream;
+            obj->serialize(tree, compact);
+            {
+                JsonWriter out(stream, compact);
+                out.beginObject();
+                out.member("n", mpz_class("-123456789012345678901234567890"));
+                out.key("a");
+                out.beginArray();
+                out.beginObject();
+                out.endObject();
+                out.beginArray(true);
+                out.endArray();
+                out.endArray();
+                out.key("z");
+                out.null();
+                out.endObject();
+            }
+            ASSERT_EQ(stream.str(), tree.str()); }
+        return SUCCESS;
+    }
+
+    int testCasts() {
+        IJson* value = new JsonValue(5);
+        IJson* arr = new JsonArray();
+        IJson* obj = new JsonObject();
+        ASSERT_EQ(value->is<JsonValue>(), true);
+        ASSERT_EQ(value->is<JsonArray>(), false);
+        ASSERT_EQ(arr->to<JsonArray>() == arr, true);
+        ASSERT_EQ(arr->to<JsonObject>() == nullptr, true);
+        ASSERT_EQ(obj->to<JsonObject>() == obj, true);
+        ASSERT_EQ(obj->is<JsonValue>(), false);
+        return SUCCESS;
+    }
+
+    int testNumbers() {
+        mpz_class big = shift_left(1, 70) + 5;
+        JsonValue small(mpz_class(-42)), large(big), ulong(~0UL);
+        ASSERT_EQ(small.toString(), "-42");
+        ASSERT_EQ(large.toString(), "1180591620717411303429");
+        ASSERT_EQ(ulong.toString(), "18446744073709551615");
+        ASSERT_EQ(small == -42, true);
+        ASSERT_EQ(small == JsonValue(-42L), true);
+        ASSERT_EQ(large == big, true);
+        ASSERT_EQ(large == JsonValue(big), true);
+        ASSERT_EQ(large == JsonValue(5), false);
+        ASSERT_EQ(ulong == ~0UL, true);
+        ASSERT_EQ(ulong.getValue() == mpz_class(~0UL), true);
+        ASSERT_EQ(small.getInt(), -42);
+
+        std::string hex;
+        appendHex(hex, 255, 4);
+        ASSERT_EQ(hex, "0x00ff");
+        hex.clear();
+        appendHex(hex, -big);
+        ASSERT_EQ(hex, "-0x400000000000000005");
+        hex.clear();
+        appendHex(hex, mpz_class(0));
+        ASSERT_EQ(hex, "0x0");
+        std::string dec;
+        appendDecimal(dec, LONG_MIN);
+        ASSERT_EQ(dec, "-9223372036854775808");
         return SUCCESS;
     }
  public:
     int run() {
         RUNTEST(testJson);
+        RUNTEST(testWriter);
+        RUNTEST(testCasts);
+        RUNTEST(testNumbers);
         return SUCCESS;
     }
 };
@@ -0,0 +1,109 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir/ir.h"
+#include "ir/node_factory.h"
+#include "ir/visitor.h"
+#include "test.h"
+
+namespace Test {
+class CountConstants : public Inspector {
+ public:
+    unsigned count = 0;
+    explicit CountConstants(bool dagOnce) { visitDagOnce = dagOnce; }
+    bool preorder(const IR::Constant *) override { ++count; return false; }
+};
+
+class Increment : public Transform {
+ public:
+    unsigned count = 0;
+    const IR::Node *postorder(IR::Constant *c) override {
+        ++count;
+        return new IR::Constant(c->srcInfo, c->type, c->value + 1); }
+};
+
+class TestNodeFactory : public TestBase {
+    Util::SourceInfo source(unsigned line) {
+        auto pos = Util::SourcePosition(line, 0);
+        return Util::SourceInfo(pos, pos); }
+
+    int testInterning() {
+        IR::NodeFactory nodes;
+        auto t = IR::Type_Bits::get(8);
+        auto a = nodes.constant(t, 5);
+        ASSERT_EQ(nodes.constant(t, 5) == a, true);
+        ASSERT_EQ(nodes.constant(t, 5, 16) == a, false);
+        ASSERT_EQ(nodes.constant(IR::Type_Bits::get(16), 5) == a, false);
+        ASSERT_EQ(nodes.constant(source(3), t, 5) == a, false);
+        ASSERT_EQ(nodes.constant(source(3), t, 5) == nodes.constant(source(3), t, 5), true);
+        // each Type_InfInt is a different type variable
+        auto i = new IR::Type_InfInt();
+        ASSERT_EQ(nodes.constant(i, 5) == nodes.constant(i, 5), false);
+        ASSERT_EQ(nodes.bits(Util::SourceInfo(), 8) == t, true);
+        ASSERT_EQ(nodes.bits(source(4), 8) == nodes.bits(source(4), 8), true);
+        ASSERT_EQ(nodes.bits(source(4), 8) == nodes.bits(source(4), 8, true), false);
+
+        // references are only shared when they come from the same place
+        IR::ID x(source(7), "x");
+        auto p = nodes.pathExpression(x);
+        ASSERT_EQ(nodes.pathExpression(x) == p, true);
+        ASSERT_EQ(nodes.pathExpression(IR::ID(source(8), "x")) == p, false);
+        ASSERT_EQ(nodes.pathExpression(IR::ID("x")) == nodes.pathExpression(IR::ID("x")), false);
+        auto m = nodes.member(source(7), p, "f");
+        ASSERT_EQ(nodes.member(source(7), nodes.pathExpression(x), "f") == m, true);
+        ASSERT_EQ(nodes.member(source(7), p, "g") == m, false);
+        ASSERT_EQ(nodes.member(Util::SourceInfo(), p, "f") ==
+                  nodes.member(Util::SourceInfo(), p, "f"), false);
+        return SUCCESS;
+    }
+
+    int testVisitDagOnce() {
+        IR::NodeFactory nodes;
+        auto c = nodes.constant(IR::Type_Bits::get(8), 1);
+        auto add = new IR::Add(new IR::Add(c, c), nodes.constant(IR::Type_Bits::get(8), 1));
+        ASSERT_EQ(nodes.shared(), 1u);
+
+        CountConstants once(true);
+        add->apply(once);
+        ASSERT_EQ(once.count, 1u);
+        CountConstants all(false);
+        add->apply(all);
+        ASSERT_EQ(all.count, 3u);
+
+        // the shared constant is rewritten once and the result is used everywhere
+        Increment increment;
+        auto result = add->apply(increment)->to<IR::Add>();
+        ASSERT_EQ(increment.count, 1u);
+        auto left = result->left->to<IR::Add>();
+        ASSERT_EQ(left->left == left->right, true);
+        ASSERT_EQ(left->left == result->right, true);
+        ASSERT_EQ(result->right->to<IR::Constant>()->value == 2, true);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testInterning);
+        RUNTEST(testVisitDagOnce);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestNodeFactory test;
+    return test.run();
+}
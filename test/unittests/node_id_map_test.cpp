@@ -0,0 +1,89 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <vector>
+#include "ir/ir.h"
+#include "ir/node_id_map.h"
+#include "test.h"
+
+namespace Test {
+class TestNodeIdMap : public TestBase {
+    int testMap() {
+        std::vector<const IR::Constant *> nodes;
+        for (int i = 0; i < 5000; ++i)  // several pages
+            nodes.push_back(new IR::Constant(i));
+        NodeIdMap<int> map;
+        for (int i = 0; i < 5000; i += 2)
+            ASSERT_EQ(map.emplace(nodes[i], i).second, true);
+        ASSERT_EQ(map.emplace(nodes[0], 7).second, false);
+        ASSERT_EQ(map.size(), 2500u);
+        for (int i = 0; i < 5000; ++i)
+            ASSERT_EQ(map.count(nodes[i]), i % 2 ? 0u : 1u);
+        ASSERT_EQ(map.get(nodes[4]), 4);
+        ASSERT_EQ(map.get(nodes[5]), 0);
+
+        int sum = 0, last = -1;
+        bool ordered = true;
+        map.for_each([&](const IR::Node *n, int v) {
+            if (n->id <= last) ordered = false;
+            last = n->id;
+            sum += v; });
+        ASSERT_EQ(ordered, true);
+        ASSERT_EQ(sum, 2500 * 4998 / 2);
+
+        map.clear();
+        ASSERT_EQ(map.size(), 0u);
+        ASSERT_EQ(map.count(nodes[0]), 0u);
+        ASSERT_EQ(map.emplace(nodes[0], 3).second, true);
+        ASSERT_EQ(map.get(nodes[0]), 3);
+        return SUCCESS;
+    }
+
+    int testSharedId() {
+        // nodes loaded from JSON can have the same id as another node
+        auto *a = new IR::Constant(1);
+        auto *b = new IR::Constant(2);
+        b->id = a->id;
+        NodeIdMap<int> map;
+        map.emplace(a, 1);
+        ASSERT_EQ(map.count(b), 0u);
+        ASSERT_EQ(map.emplace(b, 2).second, true);
+        ASSERT_EQ(map.emplace(b, 3).second, false);
+        ASSERT_EQ(map.get(a), 1);
+        ASSERT_EQ(map.get(b), 2);
+        ASSERT_EQ(map.size(), 2u);
+
+        NodeIdSet set;
+        ASSERT_EQ(set.insert(a), true);
+        ASSERT_EQ(set.insert(a), false);
+        ASSERT_EQ(set.insert(b), true);
+        ASSERT_EQ(set.size(), 2u);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testMap);
+        RUNTEST(testSharedId);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestNodeIdMap test;
+    return test.run();
+}
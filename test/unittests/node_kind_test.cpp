@@ -0,0 +1,130 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+
+#include "ir/ir.h"
+#include "ir/memory_census.h"
+#include "test.h"
+
+namespace Test {
+class TestNodeKind : public TestBase {
+    int testClasses() {
+        const IR::Node *c = new IR::Constant(IR::Type_Bits::get(8), 1);
+        ASSERT_EQ(c->is<IR::Constant>(), true);
+        ASSERT_EQ(c->is<IR::Literal>(), true);
+        ASSERT_EQ(c->is<IR::Expression>(), true);
+        ASSERT_EQ(c->is<IR::Node>(), true);
+        ASSERT_EQ(c->is<IR::BoolLiteral>(), false);
+        ASSERT_EQ(c->is<IR::Operation>(), false);
+        ASSERT_EQ(c->is<IR::Type>(), false);
+        ASSERT_EQ(c->to<IR::Expression>() == c, true);
+
+        const IR::Node *add = new IR::Add(c->to<IR::Expression>(), c->to<IR::Expression>());
+        ASSERT_EQ(add->is<IR::Operation_Binary>(), true);
+        ASSERT_EQ(add->is<IR::Sub>(), false);
+        ASSERT_EQ(add->to<IR::Literal>() == nullptr, true);
+        ASSERT_EQ(&add->as<IR::Operation>() == add, true);
+        return SUCCESS;
+    }
+
+    int testOthers() {
+        // interfaces are checked with dynamic_cast
+        const IR::Node *decl = new IR::Declaration_Variable(
+            IR::ID("x"), IR::Annotations::empty, IR::Type_Bits::get(8), nullptr);
+        ASSERT_EQ(decl->is<IR::IDeclaration>(), true);
+        ASSERT_EQ(decl->is<IR::IAnnotated>(), true);
+        ASSERT_EQ(decl->is<IR::INamespace>(), false);
+
+        const IR::Node *vec = new IR::IndexedVector<IR::Node>();
+        ASSERT_EQ(vec->is<IR::Vector<IR::Node>>(), true);
+        ASSERT_EQ(vec->is<IR::IndexedVector<IR::Node>>(), true);
+        ASSERT_EQ(vec->is<IR::Vector<IR::Expression>>(), false);
+        ASSERT_EQ(vec->is<IR::Expression>(), false);
+        vec = new IR::Vector<IR::Node>();
+        ASSERT_EQ(vec->is<IR::IndexedVector<IR::Node>>(), false);
+        return SUCCESS;
+    }
+
+    // the census counts shared nodes once, with the sizes of their classes
+    int testCensus() {
+        auto kind = IR::NodeKind<IR::Constant>::value;
+        ASSERT_EQ(cstring(IR::node_classes[kind].name), cstring("Constant"));
+        ASSERT_EQ(IR::node_classes[kind].size, sizeof(IR::Constant));
+
+        auto c = new IR::Constant(IR::Type_Bits::get(8), 1);
+        auto vec = new IR::Vector<IR::Expression>();
+        vec->reserve(8);
+        vec->push_back(new IR::Add(c, c));
+        vec->push_back(c);
+        MemoryCensus census;
+        vec->apply(census);
+        ASSERT_EQ(census.classes[kind].count, 1u);
+        ASSERT_EQ(census.classes[IR::NodeKind<IR::Add>::value].count, 1u);
+        ASSERT_EQ(census.vectorSlack, 6 * sizeof(const IR::Node *));
+        ASSERT_EQ(census.nodes, 4u);  // with the type of the constant
+
+        std::stringstream report;
+        census.report(report);
+        ASSERT_EQ(report.str().find("Constant") != std::string::npos, true);
+        return SUCCESS;
+    }
+
+    class CountPaths : public Inspector {
+     public:
+        int paths = 0;
+        explicit CountPaths(bool onlyConstants) {
+            if (onlyConstants) visitOnly<IR::Constant>(); }
+        bool preorder(const IR::Path *) override { ++paths; return true; }
+    };
+
+    // the kinds that can be below each kind, and visitors that skip the rest
+    int testReach() {
+        auto reaches = [](unsigned from, unsigned to) {
+            return (IR::node_reach[from][to / 64] >> (to % 64)) & 1; };
+        auto pathExpr = IR::NodeKind<IR::PathExpression>::value;
+        ASSERT_EQ(reaches(pathExpr, IR::NodeKind<IR::Path>::value), 1u);
+        ASSERT_EQ(reaches(pathExpr, IR::NodeKind<IR::Constant>::value), 0u);
+        ASSERT_EQ(reaches(IR::NodeKind<IR::IfStatement>::value,
+                          IR::NodeKind<IR::AssignmentStatement>::value), 1u);
+        ASSERT_EQ(reaches(IR::NodeKind<IR::Node>::value, pathExpr), 1u);
+        for (unsigned k = 0; k < IR::NODE_KINDS; ++k)
+            ASSERT_EQ(reaches(IR::NodeKind<IR::Type_Bits>::value, k), 0u);
+
+        auto add = new IR::Add(new IR::PathExpression(IR::ID("x")), new IR::BoolLiteral(true));
+        CountPaths all(false), constants(true);
+        add->apply(all);
+        add->apply(constants);
+        ASSERT_EQ(all.paths, 1);
+        ASSERT_EQ(constants.paths, 0);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testClasses);
+        RUNTEST(testOthers);
+        RUNTEST(testCensus);
+        RUNTEST(testReach);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestNodeKind test;
+    return test.run();
+}
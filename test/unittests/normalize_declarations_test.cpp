@@ -0,0 +1,117 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include <string>
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/resolveReferences.h"
+#include "frontends/p4/createBuiltins.h"
+#include "frontends/p4/moveDeclarations.h"
+#include "frontends/p4/normalizeDeclarations.h"
+#include "frontends/p4/p4-parse.h"
+#include "frontends/p4/toP4/toP4.h"
+#include "frontends/p4/uniqueNames.h"
+#include "lib/source_file.h"
+#include "test.h"
+
+namespace Test {
+class TestNormalizeDeclarations : public TestBase {
+    // locals that shadow each other, with initializers, in parsers, controls and
+    // actions, and instances and tables that keep their names in @name
+    static const char* program;
+
+    static std::string print(const IR::Node *node) {
+        std::stringstream out;
+        P4::ToP4 toP4(&out, false);
+        node->apply(toP4);
+        return out.str(); }
+
+    static std::string normalize(const IR::P4Program* prog, bool fused) {
+        P4::ReferenceMap refMap;
+        prog = prog->apply(P4::CreateBuiltins());
+        prog = prog->apply(P4::ResolveReferences(&refMap));
+        if (fused) {
+            prog = prog->apply(P4::NormalizeDeclarations(&refMap));
+        } else {
+            PassManager passes({ new P4::UniqueNames(&refMap), new P4::MoveDeclarations(),
+                                 new P4::MoveInitializers() });
+            prog = prog->apply(passes);
+        }
+        return prog == nullptr ? std::string() : print(prog); }
+
+    int testSameAsSeparatePasses() {
+        Util::InputSources::reset();
+        auto prog = parse_P4_16_text("prog.p4", program, nullptr, 1);
+        ASSERT_EQ(::errorCount(), 0u);
+        std::string separate = normalize(prog, false);
+        std::string fused = normalize(prog, true);
+        ASSERT_EQ(::errorCount(), 0u);
+        ASSERT_EQ(separate.empty(), false);
+        ASSERT_EQ(fused, separate);
+        // the passes did rename and move the declarations
+        ASSERT_EQ(separate == print(prog), false);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testSameAsSeparatePasses);
+        return SUCCESS;
+    }
+};
+
+const char* TestNormalizeDeclarations::program =
+    "match_kind { exact }\n"
+    "header h { bit<8> a; }\n"
+    "parser p(inout h hdr) {\n"
+    "    bit<8> t = 1;\n"
+    "    state start {\n"
+    "        bit<8> u = t;\n"
+    "        hdr.a = u;\n"
+    "        transition next;\n"
+    "    }\n"
+    "    state next {\n"
+    "        bit<8> w = 2;\n"
+    "        hdr.a = w;\n"
+    "        transition accept;\n"
+    "    }\n"
+    "}\n"
+    "control c(inout h hdr) {\n"
+    "    bit<8> t = 3;\n"
+    "    action a(bit<8> d) { bit<8> t = d; hdr.a = t; }\n"
+    "    table tbl {\n"
+    "        key = { hdr.a : exact; }\n"
+    "        actions = { a; }\n"
+    "        default_action = a(1);\n"
+    "    }\n"
+    "    apply {\n"
+    "        bit<8> x = t;\n"
+    "        if (x == 0) { bit<8> x = 1; hdr.a = x; }\n"
+    "        tbl.apply();\n"
+    "        hdr.a = t;\n"
+    "    }\n"
+    "}\n"
+    "control d(inout h hdr) {\n"
+    "    c() inst;\n"
+    "    apply { inst.apply(hdr); }\n"
+    "}\n";
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestNormalizeDeclarations test;
+    return test.run();
+}
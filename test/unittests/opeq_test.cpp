@@ -71,5 +71,16 @@ int main() {
     CHECK(!(*static_cast<IR::Node *>(p1) == *static_cast<IR::Vector<IR::Node> *>(p3)));
     CHECK(!(*static_cast<IR::Node *>(p1) == *static_cast<IR::Node *>(p3)));
 
+    CHECK(a->structural_hash() == b->structural_hash());
+    CHECK(a->structural_hash() != c->structural_hash());
+    CHECK(p1->structural_hash() == p2->structural_hash());
+    CHECK(p1->structural_hash() != p3->structural_hash());
+    // the hash is structural, unlike operator==, which compares children by pointer
+    auto *e1 = new IR::Add(a, c);
+    auto *e2 = new IR::Add(b, c);
+    CHECK(!(*e1 == *e2));
+    CHECK(e1->structural_hash() == e2->structural_hash());
+    CHECK(e1->structural_hash() != (new IR::Sub(a, c))->structural_hash());
+
     return errcnt > 0;
 }
@@ -0,0 +1,100 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir/ir.h"
+#include "ir/visitor.h"
+#include "lib/exceptions.h"
+#include "test.h"
+
+namespace Test {
+class CountConstants : public ParallelInspector {
+    ParallelInspector *clone() const override {
+        auto *rv = new CountConstants(*this);
+        rv->constants = 0;
+        rv->declarations.clear();
+        return rv; }
+    void parallel_join(ParallelInspector &other) override {
+        auto &o = dynamic_cast<CountConstants &>(other);
+        constants += o.constants;
+        declarations.insert(declarations.end(), o.declarations.begin(), o.declarations.end()); }
+
+ public:
+    unsigned constants = 0, programs = 0;
+    std::vector<cstring> declarations;
+    explicit CountConstants(unsigned t) { threads = t; }
+    bool preorder(const IR::Declaration_Constant *d) override {
+        BUG_CHECK(findContext<IR::P4Program>(), "clone lost its context");
+        BUG_CHECK(d->name.name != "bad", "bad declaration");
+        declarations.push_back(d->name.name);
+        return true; }
+    bool preorder(const IR::Constant *) override { ++constants; return true; }
+    void postorder(const IR::P4Program *) override { ++programs; }
+};
+
+class TestParallelInspector : public TestBase {
+    // declarations c0 .. cN-1, each initialized with c + c + c
+    static const IR::P4Program *program(unsigned count, const char *bad = nullptr) {
+        auto decls = new IR::IndexedVector<IR::Node>();
+        auto type = IR::Type_Bits::get(32);
+        for (unsigned i = 0; i < count; ++i) {
+            cstring name = bad && i == count / 2 ? cstring(bad) : cstring("c") + Util::toString(i);
+            auto init = new IR::Add(new IR::Add(new IR::Constant(i), new IR::Constant(i)),
+                                    new IR::Constant(i));
+            decls->push_back(new IR::Declaration_Constant(
+                IR::ID(name), IR::Annotations::empty, type, init)); }
+        return new IR::P4Program(decls); }
+
+    int testJoin() {
+        auto prog = program(100);
+        for (unsigned threads : { 1, 4, 0 }) {
+            CountConstants count(threads);
+            prog->apply(count);
+            ASSERT_EQ(count.constants, 300u);
+            ASSERT_EQ(count.programs, 1u);
+            // joined in declaration order, whatever order they were visited in
+            ASSERT_EQ(count.declarations.size(), 100u);
+            for (unsigned i = 0; i < 100; ++i)
+                ASSERT_EQ(count.declarations[i], cstring("c") + Util::toString(i)); }
+        return SUCCESS;
+    }
+
+    int testError() {
+        auto prog = program(20, "bad");
+        CountConstants count(4);
+        bool caught = false;
+        try {
+            prog->apply(count);
+        } catch (Util::CompilerBug &) {
+            caught = true; }
+        ASSERT_EQ(caught, true);
+        // nothing was joined
+        ASSERT_EQ(count.constants, 0u);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testJoin);
+        RUNTEST(testError);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestParallelInspector test;
+    return test.run();
+}
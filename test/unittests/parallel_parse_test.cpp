@@ -0,0 +1,113 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include <string>
+
+#include "ir/ir.h"
+#include "frontends/p4/p4-parse.h"
+#include "frontends/p4/toP4/toP4.h"
+#include "lib/source_file.h"
+#include "test.h"
+
+namespace Test {
+class TestParallelParse : public TestBase {
+    // a program of about 'size' characters, where each type is used by the next
+    // declaration, and the later parts see the types of the earlier ones
+    static std::string program(size_t size) {
+        std::string text = "# 1 \"prog.p4\"\n";
+        for (unsigned i = 0; text.size() < size; ++i) {
+            std::string n = std::to_string(i);
+            text += "header h" + n + " { bit<8> a; bit<16> b; }\n"
+                    "/* } ; */ struct s" + n + " { h" + n + " x; }\n"
+                    "typedef s" + n + " t" + n + ";\n"
+                    "extern E" + n + " {\n    E" + n + "();\n    bit<8> get(in t" + n +
+                    " v);\n}\n"
+                    "control c" + n + "(inout t" + n + " v) {\n"
+                    "    apply { v.x.a = v.x.a + 8w1; }\n}\n"
+                    "const bit<8> k" + n + " = 8w" + std::to_string(i % 256) + ";\n"; }
+        return text; }
+
+    static const IR::P4Program *parse(const std::string &text, unsigned threads) {
+        Util::InputSources::reset();
+        return parse_P4_16_text("prog.p4", text, nullptr, threads); }
+
+    // each parse gives the declarations new declids, so they are compared by their text
+    static std::string print(const IR::Node *node) {
+        std::stringstream out;
+        P4::ToP4 toP4(&out, false);
+        node->apply(toP4);
+        return out.str(); }
+
+    int testSplit() {
+        std::string text = "header h { bit<8> a; }\n/* } ; */\nstruct s { h x; }\n"
+                           "control c(inout s x) { apply { x.x.a = 1; } }\n"
+                           "@name(\"}\") extern E {\n    E(); }\n";
+        auto cuts = splitDeclarations(text.data(), text.data() + text.size(), 0);
+        ASSERT_EQ(cuts.size(), 3u);
+        // the comment stays with the declaration before it, and the annotation with
+        // the one after it
+        ASSERT_EQ(text.compare(cuts[0], 6, "struct"), 0);
+        ASSERT_EQ(text.compare(cuts[1], 7, "control"), 0);
+        ASSERT_EQ(text.compare(cuts[2], 5, "@name"), 0);
+        cuts = splitDeclarations(text.data(), text.data() + text.size(), 40);
+        ASSERT_EQ(cuts.size(), 2u);
+        ASSERT_EQ(text.compare(cuts[0], 7, "control"), 0);
+        ASSERT_EQ(text.compare(cuts[1], 5, "@name"), 0);
+        return SUCCESS;
+    }
+
+    int testSameProgram() {
+        std::string text = program(3 << 18);
+        auto whole = parse(text, 1);
+        ASSERT_EQ(whole != nullptr, true);
+        auto parts = parse(text, 4);
+        ASSERT_EQ(parts != nullptr, true);
+        ASSERT_EQ(::errorCount(), 0u);
+        ASSERT_EQ(parts->declarations->size(), whole->declarations->size());
+        for (size_t i = 0; i < whole->declarations->size(); ++i) {
+            auto a = whole->declarations->at(i), b = parts->declarations->at(i);
+            ASSERT_EQ(print(a), print(b));
+            ASSERT_EQ(a->srcInfo.getStart().getLineNumber(),
+                      b->srcInfo.getStart().getLineNumber());
+        }
+        return SUCCESS;
+    }
+
+    // an error in a part is reported once, as when parsing the program as a whole
+    int testError() {
+        std::string text = program(3 << 18);
+        text.insert(text.rfind("const"), "const undeclared_t x = 1;\n");
+        auto result = parse(text, 4);
+        ASSERT_EQ(result == nullptr, true);
+        ASSERT_EQ(::errorCount(), 1u);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testSplit);
+        RUNTEST(testSameProgram);
+        RUNTEST(testError);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestParallelParse test;
+    return test.run();
+}
@@ -0,0 +1,114 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir/ir.h"
+#include "ir/visitor.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "test.h"
+
+namespace Test {
+// gives every constant a generated name, and drops the ones named d<N>
+class RenameConstants : public ParallelTransform {
+    P4::ReferenceMap *refMap;
+    P4::ReferenceMap::NameReservation *names = nullptr;
+
+    ParallelTransform *clone() const override {
+        auto *rv = new RenameConstants(*this);
+        rv->names = new P4::ReferenceMap::NameReservation(refMap);
+        return rv; }
+    void parallel_start() override { names->activate(); }
+    void parallel_end() override { names->deactivate(); }
+    bool parallel_join(ParallelTransform &other) override {
+        return dynamic_cast<RenameConstants &>(other).names->commit(); }
+
+ public:
+    RenameConstants(P4::ReferenceMap *refMap, unsigned t) : refMap(refMap) { threads = t; }
+    const IR::Node *preorder(IR::Declaration_Constant *d) override {
+        prune();
+        if (d->name.name[0] == 'd') return nullptr;
+        d->name = IR::ID(refMap->newName("tmp"));
+        return d; }
+};
+
+class TestParallelTransform : public TestBase {
+    static const IR::P4Program *program(unsigned count) {
+        auto decls = new IR::IndexedVector<IR::Node>();
+        auto type = IR::Type_Bits::get(32);
+        for (unsigned i = 0; i < count; ++i) {
+            cstring name = cstring(i % 10 == 3 ? "d" : "c") + Util::toString(i);
+            decls->push_back(new IR::Declaration_Constant(
+                IR::ID(name), IR::Annotations::empty, type, new IR::Constant(i))); }
+        return new IR::P4Program(decls); }
+
+    static std::vector<cstring> names(const IR::P4Program *prog) {
+        std::vector<cstring> rv;
+        for (auto *d : *prog->declarations)
+            rv.push_back(d->to<IR::Declaration_Constant>()->name.name);
+        return rv; }
+
+    int testDeterministic() {
+        auto prog = program(50);
+        P4::ReferenceMap serialMap;
+        auto serial = prog->apply(RenameConstants(&serialMap, 1))->to<IR::P4Program>();
+        ASSERT_EQ(serial != nullptr, true);
+        auto expect = names(serial);
+        ASSERT_EQ(expect.size(), 45u);
+        ASSERT_EQ(expect[0], cstring("tmp"));
+        ASSERT_EQ(expect[1], cstring("tmp_0"));
+        cstring next = serialMap.newName("tmp");
+        for (unsigned threads : { 4, 0 }) {
+            P4::ReferenceMap refMap;
+            auto result = prog->apply(RenameConstants(&refMap, threads))->to<IR::P4Program>();
+            ASSERT_EQ(result != nullptr, true);
+            auto got = names(result);
+            ASSERT_EQ(got.size(), expect.size());
+            for (size_t i = 0; i < got.size(); ++i)
+                ASSERT_EQ(got[i], expect[i]);
+            // the map ends up with the same names as well
+            ASSERT_EQ(refMap.newName("tmp"), next); }
+        return SUCCESS;
+    }
+
+    int testReservation() {
+        P4::ReferenceMap refMap;
+        refMap.usedName("x");
+        P4::ReferenceMap::NameReservation first(&refMap), second(&refMap);
+        first.activate();
+        ASSERT_EQ(refMap.newName("x"), cstring("x_0"));
+        first.deactivate();
+        second.activate();
+        ASSERT_EQ(refMap.newName("x"), cstring("x_0"));
+        second.deactivate();
+        // the first comes out as it would serially; the second clashes with it
+        ASSERT_EQ(first.commit(), true);
+        ASSERT_EQ(second.commit(), false);
+        ASSERT_EQ(refMap.newName("x"), cstring("x_1"));
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testDeterministic);
+        RUNTEST(testReservation);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestParallelTransform test;
+    return test.run();
+}
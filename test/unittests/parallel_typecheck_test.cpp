@@ -0,0 +1,109 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <sstream>
+#include <string>
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/resolveReferences.h"
+#include "frontends/p4/p4-parse.h"
+#include "frontends/p4/toP4/toP4.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+#include "lib/source_file.h"
+#include "test.h"
+
+namespace Test {
+class TestParallelTypeCheck : public TestBase {
+    // controls that each instantiate the one before them, and call a top-level
+    // action and an extern method, with untyped constants whose types are inferred
+    static std::string program(unsigned controls) {
+        std::string text = "header h { bit<8> a; bit<16> b; }\n"
+                           "struct s { h x; }\n"
+                           "extern E {\n    E();\n    bit<8> get(in bit<8> v);\n}\n"
+                           "action clear(inout s v) { v.x.b = 0; }\n"
+                           "control c0(inout s v) { apply { v.x.a = v.x.a + v.x.a + 1; } }\n";
+        for (unsigned i = 1; i < controls; ++i) {
+            std::string n = std::to_string(i), p = std::to_string(i - 1);
+            text += "control c" + n + "(inout s v) {\n"
+                    "    E() e;\n    c" + p + "() inner;\n"
+                    "    action bump(bit<8> d) { v.x.a = v.x.a + d + " + n + "; }\n"
+                    "    apply { inner.apply(v); bump(e.get(v.x.a)); clear(v); }\n}\n"
+                    "const bit<8> k" + n + " = " + std::to_string(i % 256) + ";\n"; }
+        return text; }
+
+    // each check parses the program again, which gives the declarations new declids,
+    // so they are compared by their text
+    static std::string print(const IR::Node *node) {
+        std::stringstream out;
+        P4::ToP4 toP4(&out, false);
+        node->apply(toP4);
+        return out.str(); }
+
+    struct Checked {
+        const IR::P4Program* program;
+        P4::TypeMap* typeMap;
+    };
+
+    static Checked check(const std::string &text, unsigned threads) {
+        Util::InputSources::reset();
+        auto program = parse_P4_16_text("prog.p4", text, nullptr, 1);
+        auto refMap = new P4::ReferenceMap();
+        auto typeMap = new P4::TypeMap();
+        program = program->apply(P4::ResolveReferences(refMap));
+        P4::TypeInference inference(refMap, typeMap);
+        inference.threads = threads;
+        program = program->apply(inference);
+        return Checked{program, typeMap}; }
+
+    int testSameResult() {
+        std::string text = program(64);
+        auto serial = check(text, 1);
+        auto phased = check(text, 4);
+        ASSERT_EQ(::errorCount(), 0u);
+        ASSERT_EQ(phased.program->declarations->size(), serial.program->declarations->size());
+        for (size_t i = 0; i < serial.program->declarations->size(); ++i) {
+            auto a = serial.program->declarations->at(i);
+            auto b = phased.program->declarations->at(i);
+            // the constants in the bodies got the same types and casts
+            ASSERT_EQ(print(a), print(b));
+            ASSERT_EQ(serial.typeMap->getType(a) != nullptr, true);
+            ASSERT_EQ(phased.typeMap->getType(b) != nullptr, true);
+        }
+        return SUCCESS;
+    }
+
+    // an error in a body is reported once, as when checking on one thread
+    int testError() {
+        std::string text = program(16);
+        text.insert(text.rfind("    apply"), "    action bad() { v.x.a = true; }\n");
+        check(text, 4);
+        ASSERT_EQ(::errorCount(), 1u);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testSameResult);
+        RUNTEST(testError);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestParallelTypeCheck test;
+    return test.run();
+}
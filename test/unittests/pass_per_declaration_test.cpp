@@ -0,0 +1,109 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir/ir.h"
+#include "ir/pass_manager.h"
+#include "test.h"
+
+namespace Test {
+// adds one to every constant, and counts the roots it is applied to
+class Increment : public Transform {
+    unsigned *roots;
+
+ public:
+    explicit Increment(unsigned *roots) : roots(roots) {}
+    profile_t init_apply(const IR::Node *root) override {
+        ++*roots;
+        return Transform::init_apply(root); }
+    const IR::Node *postorder(IR::Constant *c) override {
+        return new IR::Constant(c->type, c->value + 1); }
+};
+
+class TestPassPerDeclaration : public TestBase {
+    static const IR::P4Program *program(unsigned count) {
+        auto decls = new IR::IndexedVector<IR::Node>();
+        auto type = IR::Type_Bits::get(32);
+        for (unsigned i = 0; i < count; ++i) {
+            cstring name = cstring(i % 2 ? "d" : "c") + Util::toString(i);
+            decls->push_back(new IR::Declaration_Constant(
+                IR::ID(name), IR::Annotations::empty, type, new IR::Constant(i))); }
+        return new IR::P4Program(decls); }
+
+    static bool named_c(const IR::Node *d) {
+        auto *c = d->to<IR::Declaration_Constant>();
+        return c && c->name.name[0] == 'c'; }
+
+    static long value(const IR::P4Program *prog, size_t i) {
+        auto *d = prog->declarations->at(i)->to<IR::Declaration_Constant>();
+        return d->initializer->to<IR::Constant>()->asLong(); }
+
+    int testEachDeclaration() {
+        auto prog = program(10);
+        unsigned roots = 0;
+        PassPerDeclaration pass({ new Increment(&roots), new Increment(&roots) }, named_c);
+        auto result = prog->apply(pass)->to<IR::P4Program>();
+        ASSERT_EQ(result != nullptr, true);
+        // each pass is applied to each selected declaration, and to nothing else
+        ASSERT_EQ(roots, 10u);
+        ASSERT_EQ(result->declarations->size(), 10u);
+        for (size_t i = 0; i < 10; ++i) {
+            ASSERT_EQ(value(result, i), i % 2 ? long(i) : long(i + 2));
+            if (i % 2) ASSERT_EQ(result->declarations->at(i), prog->declarations->at(i)); }
+        // and the index of the names follows the new declarations
+        ASSERT_EQ(result->getDeclByName("c4")->getNode(), result->declarations->at(4));
+        // the input is left as it was
+        ASSERT_EQ(value(prog, 4), 4);
+        return SUCCESS;
+    }
+
+    int testUnchanged() {
+        auto prog = program(4);
+        unsigned roots = 0;
+        PassPerDeclaration pass({ new Increment(&roots) }, [](const IR::Node *) {
+            return false; });
+        ASSERT_EQ(prog->apply(pass), prog);
+        ASSERT_EQ(roots, 0u);
+        return SUCCESS;
+    }
+
+    int testBoundedMemory() {
+        PassManager::setBoundedMemory(true);
+        auto prog = program(6);
+        unsigned roots = 0;
+        PassPerDeclaration pass({ new Increment(&roots) }, named_c);
+        auto result = prog->apply(pass)->to<IR::P4Program>();
+        PassManager::setBoundedMemory(false);
+        ASSERT_EQ(result != nullptr, true);
+        ASSERT_EQ(roots, 3u);
+        ASSERT_EQ(value(result, 2), 3);
+        ASSERT_EQ(value(result, 3), 3);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testEachDeclaration);
+        RUNTEST(testUnchanged);
+        RUNTEST(testBoundedMemory);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestPassPerDeclaration test;
+    return test.run();
+}
@@ -0,0 +1,121 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <map>
+
+#include "lib/persistent_map.h"
+#include "test.h"
+
+namespace Test {
+class TestPersistentMap : public TestBase {
+    // all keys in the same bucket until the trie runs out of hash bits
+    struct BadHash { size_t operator()(int k) const { return k % 3; } };
+
+    template<class M> static std::map<int, int> contents(const M &m) {
+        std::map<int, int> rv;
+        m.for_each([&rv](int k, int v) { rv[k] = v; });
+        return rv; }
+
+    int testSetFind() {
+        persistent_map<int, int> m;
+        ASSERT_EQ(m.empty(), true);
+        std::map<int, int> model;
+        for (int i = 0; i < 2000; ++i) {
+            int k = (i * 7919) % 1500;
+            m.set(k, i);
+            model[k] = i; }
+        ASSERT_EQ(m.size(), model.size());
+        for (auto &el : model)
+            ASSERT_EQ(*m.find(el.first), el.second);
+        ASSERT_EQ(m.count(1500), 0u);
+        ASSERT_EQ(m.find(-1) == nullptr, true);
+        ASSERT_EQ(contents(m) == model, true);
+        m.clear();
+        ASSERT_EQ(m.size(), 0u);
+        ASSERT_EQ(m.count(0), 0u);
+        return SUCCESS;
+    }
+
+    int testCollisions() {
+        persistent_map<int, int, BadHash> m;
+        for (int i = 0; i < 100; ++i)
+            m.set(i, i * 2);
+        ASSERT_EQ(m.size(), 100u);
+        for (int i = 0; i < 100; ++i)
+            ASSERT_EQ(*m.find(i), i * 2);
+        return SUCCESS;
+    }
+
+    int testCopies() {
+        persistent_map<int, int> a;
+        for (int i = 0; i < 100; ++i)
+            a.set(i, i);
+        auto b = a;
+        ASSERT_EQ(b.shares(a), true);
+        b.set(5, 50);
+        b.set(200, 200);
+        ASSERT_EQ(b.shares(a), false);
+        ASSERT_EQ(*a.find(5), 5);
+        ASSERT_EQ(a.count(200), 0u);
+        ASSERT_EQ(*b.find(5), 50);
+        ASSERT_EQ(a.size(), 100u);
+        ASSERT_EQ(b.size(), 101u);
+        b.update([](int k, int &v) { if (k % 2) return false; v = -k; return true; });
+        ASSERT_EQ(*b.find(4), -4);
+        ASSERT_EQ(*b.find(3), 3);
+        ASSERT_EQ(*a.find(4), 4);
+        return SUCCESS;
+    }
+
+    int testMerge() {
+        persistent_map<int, int> a;
+        for (int i = 0; i < 1000; ++i)
+            a.set(i, i);
+        auto b = a;
+        b.set(10, 0);
+        b.set(20, 0);
+        // keep the values that agree, and mark the others
+        unsigned visited = 0;
+        a.merge(b, [&visited](int, int &v, const int *other) {
+            ++visited;
+            if (other && *other == v) return false;
+            v = -1;
+            return true; });
+        ASSERT_EQ(*a.find(10), -1);
+        ASSERT_EQ(*a.find(20), -1);
+        ASSERT_EQ(*a.find(30), 30);
+        // only the parts that differ are visited
+        ASSERT_EQ(visited < 100, true);
+        auto c = a;
+        a.merge(c, [](int, int &, const int *) { UNREACHABLE(); return true; });
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testSetFind);
+        RUNTEST(testCollisions);
+        RUNTEST(testCopies);
+        RUNTEST(testMerge);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestPersistentMap test;
+    return test.run();
+}
@@ -0,0 +1,157 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <string>
+
+#include "lib/cstring.h"
+#include "lib/error.h"
+#include "lib/preprocessor.h"
+#include "test.h"
+
+namespace Test {
+class TestPreprocessor : public TestBase {
+    std::string dir;
+    int runs = 0;
+
+    cstring write(const char *name, const char *text) {
+        std::string path = dir + "/" + name;
+        std::ofstream(path) << text;
+        return path; }
+    // The output without the first line marker
+    cstring preprocess(const char *text, cstring options = "") {
+        Util::Preprocessor cpp;
+        cpp.addOptions(options);
+        std::string name = "main" + std::to_string(++runs) + ".p4";
+        std::string out = cpp.run(write(name.c_str(), text));
+        return out.substr(out.find('\n') + 1); }
+
+    int testMacros() {
+        ASSERT_EQ(preprocess("#define N 8\n"
+                             "bit<N> x;\n"),
+                  "\nbit<8> x;\n");
+        ASSERT_EQ(preprocess("#define F(a, b) a + b\n"
+                             "#define G(x) F(x, 1)\n"
+                             "G(2) F((3, 4), 5)\n"),
+                  "\n\n2 + 1 (3, 4) + 5\n");
+        // neither recursive expansion, nor expansion of a name without arguments
+        ASSERT_EQ(preprocess("#define X X + Y\n"
+                             "#define Y X\n"
+                             "#define F(a) a\n"
+                             "X F\n"),
+                  "\n\n\nX + X F\n");
+        ASSERT_EQ(preprocess("#define S(x) #x\n"
+                             "#define C(a, b) a ## b\n"
+                             "#define V(f, ...) f(__VA_ARGS__)\n"
+                             "S(a \"b\") C(hdr, _t) C(, x) V(g, 1, 2)\n"),
+                  "\n\n\n\"a \\\"b\\\"\" hdr_t x g(1, 2)\n");
+        // shifts are not split, and arguments can go on over lines
+        ASSERT_EQ(preprocess("#define F(a) a\n"
+                             "x = F(y >>\n"
+                             "      2);\n"
+                             "z = 1 >> 2;\n"),
+                  "\nx = y >> 2;\n\nz = 1 >> 2;\n");
+        ASSERT_EQ(preprocess("#define A 1\n"
+                             "#undef A\n"
+                             "A __LINE__\n", "-DB=2 -DA"),
+                  "\n\nA 3\n");
+        ASSERT_EQ(preprocess("B\n", "-DB=2 -UB -DC"), "B\n");
+        return SUCCESS;
+    }
+
+    int testConditionals() {
+        ASSERT_EQ(preprocess("#if defined(A) && (B + 1) * 2 == 6 || 0\n"
+                             "yes\n"
+                             "#elif 1\n"
+                             "elif\n"
+                             "#else\n"
+                             "no\n"
+                             "#endif\n", "-DA -DB=2"),
+                  "\nyes\n\n\n\n\n\n");
+        ASSERT_EQ(preprocess("#ifdef A\n"
+                             "#if 1/0\n"
+                             "#endif\n"
+                             "a\n"
+                             "#elif !defined B && 2 > 1\n"
+                             "b\n"
+                             "#else\n"
+                             "c\n"
+                             "#endif\n"),
+                  "\n\n\n\n\nb\n\n\n\n");
+        unsigned errors = ::errorCount();
+        preprocess("#if 1 +\n#endif\n#if 1\n");
+        ASSERT_EQ(::errorCount(), errors + 2);
+        return SUCCESS;
+    }
+
+    // comments and continued lines keep the lines where they were
+    int testLines() {
+        ASSERT_EQ(preprocess("a /* x\n"
+                             "y */ b // c \\\n"
+                             "d\n"
+                             "#define L 1 + \\\n"
+                             "  2\n"
+                             "L \"/* s */\"\n"),
+                  "a  \n b  \n\n\n\n1 + 2 \"/* s */\"\n");
+        ASSERT_EQ(preprocess("#line 10 \"other.p4\"\n"
+                             "__LINE__ __FILE__\n"),
+                  "# 10 \"other.p4\"\n10 \"other.p4\"\n");
+        return SUCCESS;
+    }
+
+    int testIncludes() {
+        write("guarded.p4", "#ifndef G\n#define G\ng\n#endif\n");
+        mkdir((dir + "/sys").c_str(), 0777);
+        write("sys/lib.p4", "#include \"guarded.p4\"\nlib\n");
+        std::string main = dir + "/main" + std::to_string(runs + 1) + ".p4";
+        cstring out = preprocess("#include <lib.p4>\n"
+                                 "#include \"guarded.p4\"\n"
+                                 "main\n", cstring("-I") + dir + "/sys -I" + dir);
+        std::string lib = dir + "/sys/lib.p4", guarded = dir + "/guarded.p4";
+        ASSERT_EQ(out,
+                  cstring("# 1 \"" + lib + "\" 1\n"
+                          "# 1 \"" + guarded + "\" 1\n"
+                          "\n\ng\n\n"
+                          "# 2 \"" + lib + "\" 2\n"
+                          "lib\n"
+                          "# 2 \"" + main + "\" 2\n"
+                          "\n"
+                          "main\n"));
+        unsigned errors = ::errorCount();
+        preprocess("#include \"missing.p4\"\n");
+        ASSERT_EQ(::errorCount(), errors + 1);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        char temp[] = "/tmp/p4c-cpp-XXXXXX";
+        dir = mkdtemp(temp);
+        RUNTEST(testMacros);
+        RUNTEST(testConditionals);
+        RUNTEST(testLines);
+        RUNTEST(testIncludes);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestPreprocessor test;
+    return test.run();
+}
@@ -0,0 +1,107 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "lib/small_vector.h"
+#include "test.h"
+
+namespace Test {
+class TestSmallVector : public TestBase {
+    typedef small_vector<const int *, 2> V;
+    int values[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+    std::vector<int> contents(const V &v) {
+        std::vector<int> rv;
+        for (auto p : v) rv.push_back(*p);
+        return rv; }
+
+    // up to two elements are kept in the vector itself, and more are allocated
+    int testGrow() {
+        V v;
+        ASSERT_EQ(sizeof(V), sizeof(std::vector<const int *>));
+        ASSERT_EQ(v.capacity(), 2u);
+        v.push_back(&values[0]);
+        v.push_back(&values[1]);
+        ASSERT_EQ(v.capacity(), 2u);
+        ASSERT_EQ(v.begin() == v.data(), true);
+        const void *inside = &v;
+        ASSERT_EQ(static_cast<const void *>(v.data()) >= inside, true);
+        ASSERT_EQ(static_cast<const void *>(v.data()) < static_cast<const void *>(&v + 1), true);
+        v.push_back(&values[2]);
+        ASSERT_EQ(v.capacity() >= 3u, true);
+        ASSERT_EQ(contents(v) == std::vector<int>({ 0, 1, 2 }), true);
+        v.pop_back();
+        ASSERT_EQ(*v.back(), 1);
+        bool thrown = false;
+        try {
+            v.at(2);
+        } catch (std::out_of_range &) {
+            thrown = true; }
+        ASSERT_EQ(thrown, true);
+        return SUCCESS;
+    }
+
+    int testInsertErase() {
+        V v = { &values[0], &values[3] };
+        std::vector<const int *> more = { &values[1], &values[2] };
+        auto it = v.insert(v.begin() + 1, more.begin(), more.end());
+        ASSERT_EQ(**it, 1);
+        ASSERT_EQ(contents(v) == std::vector<int>({ 0, 1, 2, 3 }), true);
+        it = v.insert(v.end(), 2, &values[7]);
+        ASSERT_EQ(it == v.begin() + 4, true);
+        it = v.erase(v.begin() + 1, v.begin() + 3);
+        ASSERT_EQ(**it, 3);
+        ASSERT_EQ(contents(v) == std::vector<int>({ 0, 3, 7, 7 }), true);
+        v.erase(v.begin());
+        ASSERT_EQ(contents(v) == std::vector<int>({ 3, 7, 7 }), true);
+        return SUCCESS;
+    }
+
+    // copies and moves of both small and allocated vectors
+    int testCopyMove() {
+        V small = { &values[1] }, big = { &values[1], &values[2], &values[3] };
+        V a(small), b(big);
+        ASSERT_EQ(a == small, true);
+        ASSERT_EQ(b == big, true);
+        ASSERT_EQ(b.data() != big.data(), true);
+        V c(std::move(b));
+        ASSERT_EQ(b.empty(), true);
+        ASSERT_EQ(c == big, true);
+        c = small;
+        ASSERT_EQ(c == small, true);
+        c = std::move(a);
+        ASSERT_EQ(contents(c) == std::vector<int>({ 1 }), true);
+        ASSERT_EQ(c != big, true);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testGrow);
+        RUNTEST(testInsertErase);
+        RUNTEST(testCopyMove);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestSmallVector test;
+    return test.run();
+}
@@ -0,0 +1,72 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <limits.h>
+#include <sstream>
+
+#include "lib/sourceCodeBuilder.h"
+#include "test.h"
+
+namespace Test {
+class TestSourceCodeBuilder : public TestBase {
+    int testFormat() {
+        Util::SourceCodeBuilder builder;
+        builder.reserve(1000);
+        builder.appendFormat("struct %s *%s = %d;", "key", "k", -12);
+        builder.appendFormat(" %u%% %s", 42u, "");
+        builder.appendFormat("%04x|%-3s|", 255, "a");
+        builder.append(0);
+        builder.append(INT_MIN);
+        builder.append(UINT_MAX);
+        ASSERT_EQ(builder.toString(),
+                  "struct key *k = -12; 42% 00ff|a  |0-2147483648" + std::to_string(UINT_MAX));
+        ASSERT_EQ(builder.lastIsSpace(), false);
+        builder.appendFormat("%s ", "x");
+        ASSERT_EQ(builder.lastIsSpace(), true);
+
+        std::string longText(1000, 'y');
+        auto before = builder.toString();
+        builder.appendFormat("%5s%s", "z", longText.c_str());
+        ASSERT_EQ(builder.toString(), before + "    z" + longText);
+        return SUCCESS;
+    }
+
+    int testStream() {
+        std::stringstream out;
+        Util::SourceCodeBuilder builder(&out);
+        std::string expected;
+        for (unsigned i = 0; i < 20000; ++i) {
+            builder.appendFormat("x%u = %s;", i, "y");
+            builder.newline();
+            expected += "x" + std::to_string(i) + " = y;\n"; }
+        builder.flush();
+        ASSERT_EQ(out.str(), expected);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testFormat);
+        RUNTEST(testStream);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestSourceCodeBuilder test;
+    return test.run();
+}
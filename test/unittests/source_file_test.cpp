@@ -77,6 +77,14 @@ class TestSourceFile : public TestBase {
         ASSERT_EQ(original.fileName, "fakesource.p4");
         ASSERT_EQ(original.sourceLine, 5);
 
+        // as when reloading a snapshot of the IR that refers to these sources
+        InputSources restored;
+        restored.restore(sources.getText(), sources.getLineMap());
+        ASSERT_EQ(restored.lineCount(), 3);
+        ASSERT_EQ(restored.getLine(2), "Second line\n");
+        ASSERT_EQ(restored.getSourceLine(3).fileName, "fakesource.p4");
+        ASSERT_EQ(restored.getSourceLine(3).sourceLine, 5);
+
         return SUCCESS;
     }
 
@@ -97,6 +105,16 @@ class TestSourceFile : public TestBase {
 
         SourceInfo invalid;
         ASSERT_EQ(invalid.isValid(), false);
+        ASSERT_EQ(invalid.getStart().isValid(), false);
+        ASSERT_EQ((invalid + t1) == t1, true);
+
+        // a SourceInfo is the index of its range, and the same range gets the same index
+        ASSERT_EQ(sizeof(SourceInfo), sizeof(uint32_t));
+        ASSERT_EQ(span == SourceInfo(t1_s, t2_e), true);
+        ASSERT_EQ(span == t1, false);
+        t1 += t2;
+        ASSERT_EQ(t1 == span, true);
+        ASSERT_EQ(&t1.getStart() == &span.getStart(), true);
 
         return SUCCESS;
     }
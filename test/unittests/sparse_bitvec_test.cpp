@@ -0,0 +1,116 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <set>
+
+#include "lib/sparse_bitvec.h"
+#include "test.h"
+
+namespace Test {
+class TestSparseBitvec : public TestBase {
+    static std::set<int> elements(const sparse_bitvec &bv) {
+        return std::set<int>(bv.begin(), bv.end()); }
+
+    // some sparse chunks, and one with enough bits to be a bitmap
+    static sparse_bitvec sample(int offset, std::set<int> *model) {
+        sparse_bitvec rv;
+        for (int i = 0; i < 300000; i += 9973 + offset) {
+            rv.setbit(i);
+            model->insert(i); }
+        for (int i = 70000; i < 70000 + 20000; i += 3 + offset) {
+            rv.setbit(i);
+            model->insert(i); }
+        return rv; }
+
+    int testBits() {
+        sparse_bitvec a;
+        ASSERT_EQ(a.empty(), true);
+        a.setbit(3);
+        a.setbit(500000);
+        a.setbit(65536);
+        ASSERT_EQ(a.popcount(), 3);
+        ASSERT_EQ(a.getbit(500000), true);
+        ASSERT_EQ(a.getbit(500001), false);
+        ASSERT_EQ(a.ffs(4), 65536);
+        ASSERT_EQ(a.max(), 500000);
+        ASSERT_EQ(elements(a) == std::set<int>({3, 65536, 500000}), true);
+        a.clrbit(65536);
+        ASSERT_EQ(a.ffs(4), 500000);
+        ASSERT_EQ(sparse_bitvec(a.to_bitvec()) == a, true);
+        return SUCCESS;
+    }
+
+    int testDensity() {
+        // a chunk turns into a bitmap and back as bits are set and cleared
+        sparse_bitvec a, b;
+        for (int i = 0; i < 10000; ++i)
+            a.setbit(i * 2);
+        for (int i = 10000; i-- > 0;)
+            b.setbit(i * 2);
+        ASSERT_EQ(a == b, true);
+        for (int i = 100; i < 10000; ++i)
+            a.clrbit(i * 2);
+        ASSERT_EQ(a.popcount(), 100);
+        ASSERT_EQ(a.max(), 198);
+        ASSERT_EQ(a == (b & a), true);
+        ASSERT_EQ(b.contains(a), true);
+        ASSERT_EQ(a.contains(b), false);
+        return SUCCESS;
+    }
+
+    int testOperations() {
+        std::set<int> ma, mb;
+        auto a = sample(0, &ma);
+        auto b = sample(1, &mb);
+        std::set<int> u(ma), i, d;
+        u.insert(mb.begin(), mb.end());
+        for (auto x : ma)
+            (mb.count(x) ? i : d).insert(x);
+
+        ASSERT_EQ(elements(a | b) == u, true);
+        ASSERT_EQ(elements(a & b) == i, true);
+        ASSERT_EQ(elements(a - b) == d, true);
+        ASSERT_EQ(elements(b & a) == i, true);
+        ASSERT_EQ((a | b).popcount(), static_cast<int>(u.size()));
+        ASSERT_EQ(a.intersects(b), true);
+        ASSERT_EQ((a | b).contains(a), true);
+        ASSERT_EQ((a - b).intersects(b), false);
+        ASSERT_EQ((a | b) == (b | a), true);
+
+        auto c = a;
+        ASSERT_EQ(c |= a & b, false);
+        ASSERT_EQ(c |= b, true);
+        ASSERT_EQ(c -= b, true);
+        ASSERT_EQ(c == a - b, true);
+        ASSERT_EQ(c &= a, false);
+        ASSERT_EQ(c.to_bitvec() == a.to_bitvec() - b.to_bitvec(), true);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testBits);
+        RUNTEST(testDensity);
+        RUNTEST(testOperations);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestSparseBitvec test;
+    return test.run();
+}
@@ -0,0 +1,76 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "lib/parallel.h"
+#include "test.h"
+
+namespace Test {
+class TestTaskGroup : public TestBase {
+    // the tasks of a group can wait for groups of their own
+    int testNested() {
+        std::atomic<size_t> sum(0);
+        Util::parallel_for(20, 0, [&](size_t i) {
+            sum += i;
+            Util::parallel_for(10, 3, [&](size_t j) { sum += j; }); });
+        ASSERT_EQ(sum.load(), 190u + 20u * 45u);
+        return SUCCESS;
+    }
+
+    int testOrder() {
+        auto squares = Util::parallel_map<size_t>(100, 4, [](size_t i) { return i * i; });
+        for (size_t i = 0; i < squares.size(); ++i)
+            ASSERT_EQ(squares[i], i * i);
+        // one thread runs the tasks in the order they were spawned
+        std::vector<int> order;
+        Util::TaskGroup group(1);
+        for (int i = 0; i < 5; ++i)
+            group.spawn([&order, i]() { order.push_back(i); });
+        group.wait();
+        ASSERT_EQ(order == std::vector<int>({ 0, 1, 2, 3, 4 }), true);
+        return SUCCESS;
+    }
+
+    // the exception of the first task that throws one, whichever threw first
+    int testException() {
+        size_t thrown = 0;
+        try {
+            Util::parallel_for(50, 0, [](size_t i) {
+                if (i % 7 == 3) throw std::out_of_range(std::to_string(i));
+            });
+        } catch (std::out_of_range &ex) {
+            thrown = std::stoul(ex.what()); }
+        ASSERT_EQ(thrown, 3u);
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testNested);
+        RUNTEST(testOrder);
+        RUNTEST(testException);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestTaskGroup test;
+    return test.run();
+}
@@ -0,0 +1,99 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/* Microbenchmark for the visitor traversal machinery.  Builds a P4Program with
+ * many constant declarations, each initialized by an expression tree, and times
+ * no-op Inspector, Modifier and Transform passes over it, so the cost measured
+ * is mostly the tracking of visited nodes.
+ * Usage: visitor_bench [declarations [repeats]] */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "ir/ir.h"
+#include "ir/visitor.h"
+#include "test.h"
+
+namespace Test {
+class CountNodes : public Inspector {
+ public:
+    unsigned count = 0;
+    bool preorder(const IR::Node *) override { ++count; return true; }
+};
+
+class NopModifier : public Modifier {};
+class NopTransform : public Transform {};
+
+class BenchVisitor : public TestBase {
+    unsigned declarations, repeats;
+
+    static double now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9; }
+
+    static const IR::Expression *tree(unsigned depth, unsigned &value) {
+        if (depth == 0)
+            return new IR::Constant(value++);
+        return new IR::Add(tree(depth - 1, value), tree(depth - 1, value)); }
+
+    const IR::P4Program *program() const {
+        auto decls = new IR::IndexedVector<IR::Node>();
+        auto type = IR::Type_Bits::get(32);
+        unsigned value = 0;
+        for (unsigned i = 0; i < declarations; ++i)
+            decls->push_back(new IR::Declaration_Constant(
+                IR::ID(cstring("c") + Util::toString(i)), IR::Annotations::empty,
+                type, tree(4, value)));
+        return new IR::P4Program(decls); }
+
+    void time(const char *name, const IR::P4Program *prog, Visitor &v, unsigned nodes) {
+        double start = now();
+        for (unsigned i = 0; i < repeats; ++i)
+            prog->apply(v);
+        double elapsed = now() - start;
+        std::cout << name << ": " << elapsed * 1e9 / (static_cast<double>(repeats) * nodes)
+                  << " ns/node" << std::endl; }
+
+ public:
+    BenchVisitor(unsigned d, unsigned r) : declarations(d), repeats(r) {}
+
+    int run() {
+        auto prog = program();
+        CountNodes count;
+        prog->apply(count);
+        ASSERT_EQ(count.count > declarations, true);
+
+        CountNodes inspector;
+        NopModifier modifier;
+        NopTransform transform;
+        time("Inspector", prog, inspector, count.count);
+        time("Modifier", prog, modifier, count.count);
+        time("Transform", prog, transform, count.count);
+        ASSERT_EQ(inspector.count, count.count * repeats);
+        std::cout << declarations << " declarations, " << count.count << " nodes, "
+                  << repeats << " repeats" << std::endl;
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int argc, char *argv[]) {
+    unsigned declarations = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned repeats = argc > 2 ? atoi(argv[2]) : 10;
+    Test::BenchVisitor bench(declarations ? declarations : 1, repeats ? repeats : 1);
+    return bench.run();
+}
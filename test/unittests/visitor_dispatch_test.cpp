@@ -0,0 +1,185 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir/ir.h"
+#include "ir/visitor.h"
+#include "test.h"
+
+namespace Test {
+class CountKinds : public Inspector {
+ public:
+    unsigned expressions = 0, constants = 0;
+    bool preorder(const IR::Expression *) override { ++expressions; return true; }
+    bool preorder(const IR::Constant *c) override {
+        ++constants;
+        // goes on to the Expression override through the default for Literal
+        return preorder(static_cast<const IR::Literal *>(c)); }
+};
+
+class CountAdds : public CountKinds {
+ public:
+    unsigned adds = 0;
+    bool preorder(const IR::Add *) override { ++adds; return true; }
+};
+
+class Negate : public Transform {
+ public:
+    const IR::Node *postorder(IR::Operation_Binary *op) override { return new IR::Neg(op); }
+};
+
+// replaces each constant in a vector by two copies of it, and drops the zeros
+class Duplicate : public Transform {
+ public:
+    const IR::Node *postorder(IR::Constant *c) override {
+        if (c->value == 0) return nullptr;
+        auto rv = new IR::Vector<IR::Expression>();
+        rv->push_back(c);
+        rv->push_back(new IR::Constant(c->value));
+        return rv; }
+};
+
+// replaces the constant 3 by 4
+class Increment : public Transform {
+ public:
+    const IR::Node *postorder(IR::Constant *c) override {
+        return c->value == 3 ? new IR::Constant(4) : c; }
+};
+
+// replaces the constant 3 by 4, merging the flows from the parents of shared nodes
+class IncrementJoined : public ControlFlowVisitor, public Transform {
+    IncrementJoined *clone() const override { return new IncrementJoined(*this); }
+    void flow_merge(Visitor &) override { ++*merges; }
+
+ public:
+    unsigned *visits, *merges;
+    IncrementJoined(unsigned *visits, unsigned *merges) : visits(visits), merges(merges)
+    { joinFlows = true; }
+    const IR::Node *postorder(IR::Constant *c) override {
+        ++*visits;
+        return c->value == 3 ? new IR::Constant(4) : c; }
+};
+
+class TestVisitorDispatch : public TestBase {
+    // (1 + 2) - 3
+    const IR::Expression *tree() {
+        return new IR::Sub(new IR::Add(new IR::Constant(1), new IR::Constant(2)),
+                           new IR::Constant(3)); }
+
+    int testInspector() {
+        // the second time round the visitor class knows which defaults it has
+        for (int i = 0; i < 2; ++i) {
+            CountKinds count;
+            tree()->apply(count);
+            ASSERT_EQ(count.constants, 3u);
+            ASSERT_EQ(count.expressions, 5u); }
+
+        // a derived visitor class does not share what its base class learned
+        for (int i = 0; i < 2; ++i) {
+            CountAdds count;
+            tree()->apply(count);
+            ASSERT_EQ(count.adds, 1u);
+            ASSERT_EQ(count.constants, 3u);
+            ASSERT_EQ(count.expressions, 4u); }
+        CountKinds count;
+        tree()->apply(count);
+        ASSERT_EQ(count.expressions, 5u);
+        return SUCCESS;
+    }
+
+    int testTransform() {
+        for (int i = 0; i < 2; ++i) {
+            auto result = tree()->apply(Negate());
+            auto neg = result->to<IR::Neg>();
+            ASSERT_EQ(neg != nullptr, true);
+            auto sub = neg->expr->to<IR::Sub>();
+            ASSERT_EQ(sub != nullptr, true);
+            ASSERT_EQ(sub->left->is<IR::Neg>(), true);
+            ASSERT_EQ(sub->right->is<IR::Constant>(), true); }
+        return SUCCESS;
+    }
+
+    int testVectorSplice() {
+        // the second time round the vector is only cloned once an element changes
+        for (int i = 0; i < 2; ++i) {
+            auto vec = new IR::Vector<IR::Expression>();
+            vec->push_back(new IR::Constant(1));
+            vec->push_back(new IR::Constant(0));
+            vec->push_back(new IR::Constant(2));
+            auto result = vec->apply(Duplicate())->to<IR::Vector<IR::Expression>>();
+            ASSERT_EQ(result != nullptr, true);
+            ASSERT_EQ(result->size(), 4u);
+            ASSERT_EQ(result->at(1)->to<IR::Constant>()->asInt(), 1);
+            ASSERT_EQ(result->at(2)->to<IR::Constant>()->asInt(), 2); }
+        return SUCCESS;
+    }
+
+    int testLazyClone() {
+        Visitor::profile_t::collect = true;
+        for (int i = 0; i < 2; ++i) {
+            auto before = tree()->to<IR::Sub>();
+            auto after = before->apply(Increment())->to<IR::Sub>();
+            ASSERT_EQ(after != before, true);
+            ASSERT_EQ(after->left == before->left, true);
+            ASSERT_EQ(after->right->to<IR::Constant>()->asInt(), 4); }
+        Visitor::profile_t::collect = false;
+        // once the visitor class knows it has no functions for Add and Sub, those
+        // are not cloned unless a child changes: only the Sub and the constants are.
+        // Neither are the types of the constants.
+        auto &counters = Visitor::profile_t::stats.back().counters;
+        ASSERT_EQ(counters[cstring("clones avoided")], 4u);
+        ASSERT_EQ(counters[cstring("nodes cloned")], 4u);
+        ASSERT_EQ(counters[cstring("clones dropped unchanged")], 2u);
+        // the constant 3 and the Sub above it
+        ASSERT_EQ(counters[cstring("nodes replaced")], 2u);
+        return SUCCESS;
+    }
+
+    int testJoinFlows() {
+        // (3 + 1) - 3, with the same 3 on both sides
+        auto three = new IR::Constant(3);
+        auto before = new IR::Sub(new IR::Add(three, new IR::Constant(1)), three);
+        unsigned visits = 0, merges = 0;
+        IncrementJoined increment(&visits, &merges);
+        // the second time round the join points of the tree are already known
+        for (int i = 0; i < 2; ++i) {
+            visits = merges = 0;
+            auto after = before->apply(increment)->to<IR::Sub>();
+            ASSERT_EQ(after != nullptr, true);
+            ASSERT_EQ(visits, 2u);
+            ASSERT_EQ(merges, 1u);
+            auto add = after->left->to<IR::Add>();
+            ASSERT_EQ(add != nullptr, true);
+            ASSERT_EQ(after->right->to<IR::Constant>()->asInt(), 4);
+            ASSERT_EQ(add->left == after->right, true); }
+        return SUCCESS;
+    }
+
+ public:
+    int run() {
+        RUNTEST(testInspector);
+        RUNTEST(testTransform);
+        RUNTEST(testVectorSplice);
+        RUNTEST(testLazyClone);
+        RUNTEST(testJoinFlows);
+        return SUCCESS;
+    }
+};
+}  // namespace Test
+
+int main(int, char* []) {
+    Test::TestVisitorDispatch test;
+    return test.run();
+}
@@ -0,0 +1,223 @@
+#!/usr/bin/env python
+# Copyright 2013-present Barefoot Networks, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Tracks the time and memory that the compiler takes on the test samples.
+#
+# backends/p4test/run-p4-sample.py and backends/bmv2/run-bmv2-test.py take
+# '-perf <dir>' (or P4C_PERF_DIR=<dir> in the environment, to capture a whole
+# 'make check'): they then compile with --passStats and write, for each sample,
+# a record with the wall time, the peak RSS and the time and bytes of each pass
+# into <dir>, using capture_args() and record() below.
+#
+# Run as a program, this combines the records of a directory, saves them as a
+# baseline, and compares them with an earlier baseline:
+#   P4C_PERF_DIR=perf make check-p4
+#   compile_perf.py perf --save baseline.json
+#   ... change the compiler, rerun the tests into perf ...
+#   compile_perf.py perf --baseline baseline.json --time-tolerance 0.2
+# The comparison lists the samples and the passes that regressed most, and
+# fails if any sample is slower or bigger than the tolerances allow.
+#
+# The records also count the runs of each pass that a PassManager made, and
+# those that returned the program unchanged; '--no-ops' lists the passes that
+# spend the most time changing nothing over all the samples:
+#   compile_perf.py perf --no-ops 30
+
+from __future__ import print_function
+import argparse
+import json
+import os
+import resource
+import sys
+
+PERF_DIR_VARIABLE = "P4C_PERF_DIR"
+
+
+def perf_dir(option):
+    """The directory for the records: the -perf option, or else the environment"""
+    return option or os.environ.get(PERF_DIR_VARIABLE)
+
+
+def _key(backend, srcdir, p4filename):
+    path = os.path.relpath(os.path.abspath(p4filename), os.path.abspath(srcdir))
+    return backend + "/" + path
+
+
+def _file(perfdir, key, suffix):
+    return os.path.join(perfdir, key.replace("/", "__") + suffix)
+
+
+def capture_args(perfdir, backend, srcdir, p4filename):
+    """The compiler arguments that write the pass statistics of a sample"""
+    if not os.path.isdir(perfdir):
+        try:
+            os.makedirs(perfdir)
+        except OSError:
+            pass  # created by a test running in parallel
+    return ["--passStats", _file(perfdir, _key(backend, srcdir, p4filename), ".passes.json")]
+
+
+def record(perfdir, backend, srcdir, p4filename, seconds):
+    """Writes the record of a sample, after the compiler has run with
+    capture_args() as the only child process so far"""
+    key = _key(backend, srcdir, p4filename)
+    passfile = _file(perfdir, key, ".passes.json")
+    passes = {}
+    if os.path.isfile(passfile):
+        with open(passfile) as stats:
+            for stat in json.load(stats):
+                entry = passes.setdefault(stat["name"], {"usec": 0, "bytes": 0, "runs": 0,
+                                                         "unchanged": 0, "unchanged_usec": 0})
+                entry["usec"] += stat["usec"]
+                entry["bytes"] += stat["bytes"]
+                if "changed" in stat:
+                    entry["runs"] += 1
+                    if not stat["changed"]:
+                        entry["unchanged"] += 1
+                        entry["unchanged_usec"] += stat["usec"]
+        os.remove(passfile)
+    rss = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+    if sys.platform == "darwin":
+        rss //= 1024  # bytes there, KB on linux
+    with open(_file(perfdir, key, ".json"), "w") as out:
+        json.dump({"sample": key, "wall_sec": seconds, "peak_rss_kb": rss,
+                   "passes": passes}, out, sort_keys=True)
+
+
+def collect(perfdir):
+    """All the records in a directory, by sample"""
+    samples = {}
+    for name in sorted(os.listdir(perfdir)):
+        if name.endswith(".json") and not name.endswith(".passes.json"):
+            with open(os.path.join(perfdir, name)) as data:
+                rec = json.load(data)
+            samples[rec["sample"]] = rec
+    return samples
+
+
+def pass_totals(samples):
+    """The time of each pass, summed over the samples"""
+    totals = {}
+    for rec in samples.values():
+        for name, stat in rec["passes"].items():
+            totals[name] = totals.get(name, 0) + stat["usec"]
+    return totals
+
+
+def no_ops(samples, top):
+    """Prints the passes that took the most time in runs that left the program
+    unchanged, over all the samples"""
+    totals = {}
+    for rec in samples.values():
+        for name, stat in rec["passes"].items():
+            if not stat.get("runs"):
+                continue  # an older record, or a pass that no PassManager ran
+            total = totals.setdefault(name, [0, 0, 0, 0])
+            total[0] += stat["unchanged_usec"]
+            total[1] += stat["usec"]
+            total[2] += stat["unchanged"]
+            total[3] += stat["runs"]
+    ranked = sorted(((t[0], name, t) for name, t in totals.items()), reverse=True)[:top]
+    print("Passes with the most time spent changing nothing:")
+    print("  %-50s %10s %10s %14s" % ("pass", "no-op sec", "total sec", "no-op runs"))
+    for _, name, (unchanged_usec, usec, unchanged, runs) in ranked:
+        print("  %-50s %10.3f %10.3f %7d/%-7d%s" %
+              (name, unchanged_usec / 1e6, usec / 1e6, unchanged, runs,
+               " never changed" if unchanged == runs else ""))
+
+
+def ratio(new, old):
+    return float(new) / old if old > 0 else float("inf")
+
+
+def compare(baseline, current, args):
+    """Prints the regressions from baseline to current; returns the number of
+    samples beyond the tolerances"""
+    regressions = []
+    for key in sorted(current):
+        old = baseline.get(key)
+        if old is None:
+            continue
+        new = current[key]
+        time = ratio(new["wall_sec"], old["wall_sec"])
+        rss = ratio(new["peak_rss_kb"], old["peak_rss_kb"])
+        slow = new["wall_sec"] >= args.min_time and time > 1 + args.time_tolerance
+        big = rss > 1 + args.rss_tolerance
+        if slow or big:
+            regressions.append((max(time - 1 - args.time_tolerance if slow else 0,
+                                    rss - 1 - args.rss_tolerance if big else 0),
+                                key, old, new, time, rss))
+    regressions.sort(reverse=True)
+    if regressions:
+        print("%d samples regressed; the worst %d:" %
+              (len(regressions), min(len(regressions), args.top)))
+        for _, key, old, new, time, rss in regressions[:args.top]:
+            print("  %-60s time %.3fs -> %.3fs (%+.0f%%), peak RSS %dKB -> %dKB (%+.0f%%)" %
+                  (key, old["wall_sec"], new["wall_sec"], (time - 1) * 100,
+                   old["peak_rss_kb"], new["peak_rss_kb"], (rss - 1) * 100))
+
+    # the passes that take longer, over the samples that both runs have
+    common = set(baseline) & set(current)
+    old_passes = pass_totals(dict((k, baseline[k]) for k in common))
+    new_passes = pass_totals(dict((k, current[k]) for k in common))
+    slower = sorted(((new_passes[name] - old_passes.get(name, 0), name)
+                     for name in new_passes), reverse=True)
+    slower = [(d, name) for d, name in slower if d > args.min_time * 1e6][:args.top]
+    if slower:
+        print("Passes with the largest increase in total time:")
+        for delta, name in slower:
+            print("  %-60s %.3fs -> %.3fs" %
+                  (name, old_passes.get(name, 0) / 1e6, new_passes[name] / 1e6))
+
+    missing = len(set(baseline) - set(current))
+    print("%d samples compared, %d regressed, %d new, %d missing" %
+          (len(common), len(regressions), len(set(current) - set(baseline)), missing))
+    return len(regressions)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description="Combine and compare the compile time records of the samples")
+    parser.add_argument("perfdir", help="directory with the records of a test run")
+    parser.add_argument("--save", help="write the combined records to this file")
+    parser.add_argument("--baseline", help="compare with the records in this file")
+    parser.add_argument("--time-tolerance", type=float, default=0.25,
+                        help="relative increase of the wall time that is not a regression")
+    parser.add_argument("--rss-tolerance", type=float, default=0.10,
+                        help="relative increase of the peak RSS that is not a regression")
+    parser.add_argument("--min-time", type=float, default=0.1,
+                        help="seconds below which a sample is too fast to compare")
+    parser.add_argument("--top", type=int, default=20, help="regressions to list")
+    parser.add_argument("--no-ops", type=int, metavar="N",
+                        help="list the N passes that spend the most time changing nothing")
+    args = parser.parse_args(argv[1:])
+
+    current = collect(args.perfdir)
+    if args.save:
+        with open(args.save, "w") as out:
+            json.dump(current, out, indent=1, sort_keys=True)
+            out.write("\n")
+    if args.no_ops:
+        no_ops(current, args.no_ops)
+    if args.baseline:
+        with open(args.baseline) as data:
+            baseline = json.load(data)
+        if compare(baseline, current, args):
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,217 @@
+#!/usr/bin/env python
+# Copyright 2013-present Barefoot Networks, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Generates a synthetic P4-16 program for the v1model architecture, of a size
+# given by the number of headers, parser states, actions, tables, nested
+# controls and instances of the generic register extern, for measuring how
+# the compiler scales (see scale-bench.py).  The program is the same for the
+# same arguments.
+#
+# For example
+#   gen-bench-program.py --headers 10 --states 20 --tables 50 > big.p4
+
+from __future__ import print_function
+import argparse
+import sys
+
+FIELD_WIDTHS = [8, 16, 32]
+
+
+class Generator(object):
+    def __init__(self, args, out):
+        self.args = args
+        self.out = out
+
+    def emit(self, line=""):
+        print(line, file=self.out)
+
+    def header(self, i):
+        return "h%d" % (i % self.args.headers)
+
+    def headers(self):
+        for i in range(self.args.headers):
+            self.emit("header h%d_t {" % i)
+            for f, width in enumerate(FIELD_WIDTHS):
+                self.emit("    bit<%d> f%d;" % (width, f))
+            self.emit("}")
+        self.emit()
+        self.emit("struct headers_t {")
+        for i in range(self.args.headers):
+            self.emit("    h%d_t h%d;" % (i, i))
+        self.emit("}")
+        self.emit()
+        self.emit("struct metadata_t {")
+        for i in range(self.args.headers):
+            self.emit("    bit<32> m%d;" % i)
+        self.emit("}")
+        self.emit()
+
+    def parser(self):
+        self.emit("parser ParserImpl(packet_in packet, out headers_t hdr, "
+                  "inout metadata_t meta,")
+        self.emit("                  inout standard_metadata_t standard_metadata) {")
+        states = max(self.args.states, 1)
+        for s in range(states):
+            name = "start" if s == 0 else "state_%d" % s
+            h = self.header(s)
+            self.emit("    state %s {" % name)
+            self.emit("        packet.extract(hdr.%s);" % h)
+            if s + 1 < states:
+                self.emit("        transition select(hdr.%s.f0) {" % h)
+                self.emit("            8w%d: accept;" % (s % 256))
+                self.emit("            default: state_%d;" % (s + 1))
+                self.emit("        }")
+            else:
+                self.emit("        transition accept;")
+            self.emit("    }")
+        self.emit("}")
+        self.emit()
+
+    def actions(self, control):
+        for a in range(self.args.actions):
+            h = self.header(a)
+            self.emit("    action a%d_%d(bit<32> v) {" % (control, a))
+            self.emit("        hdr.%s.f2 = hdr.%s.f2 + v;" % (h, h))
+            self.emit("        meta.m%d = v;" % (a % self.args.headers))
+            self.emit("    }")
+
+    def registers(self, control):
+        for g in range(self.args.generics):
+            width = FIELD_WIDTHS[g % len(FIELD_WIDTHS)]
+            self.emit("    register<bit<%d>>(32w%d) r%d_%d;" % (width, 64 + g, control, g))
+
+    def tables(self, control, tables):
+        for t in tables:
+            self.emit("    table t%d {" % t)
+            self.emit("        key = {")
+            self.emit("            hdr.%s.f1 : exact;" % self.header(t))
+            self.emit("            meta.m%d : ternary;" % (t % self.args.headers))
+            self.emit("        }")
+            self.emit("        actions = {")
+            for a in range(min(self.args.actions, 4)):
+                self.emit("            a%d_%d;" % (control, (t + a) % self.args.actions))
+            self.emit("            NoAction;")
+            self.emit("        }")
+            self.emit("        default_action = NoAction();")
+            self.emit("    }")
+
+    def control(self, index, tables, inner):
+        """A control with its actions, registers and tables, which applies the
+        control 'inner' if there is one"""
+        name = "Ingress" if index == 0 else "Nested%d" % index
+        if index == 0:
+            self.emit("control Ingress(inout headers_t hdr, inout metadata_t meta,")
+            self.emit("                inout standard_metadata_t standard_metadata) {")
+        else:
+            self.emit("control %s(inout headers_t hdr, inout metadata_t meta) {" % name)
+        if inner is not None:
+            self.emit("    Nested%d() nested;" % inner)
+        self.actions(index)
+        self.registers(index)
+        self.tables(index, tables)
+        self.emit("    apply {")
+        for g in range(self.args.generics):
+            width = FIELD_WIDTHS[g % len(FIELD_WIDTHS)]
+            h = self.header(g)
+            self.emit("        bit<%d> x%d;" % (width, g))
+            self.emit("        r%d_%d.read(x%d, 32w%d);" % (index, g, g, g))
+            self.emit("        r%d_%d.write(32w%d, x%d + hdr.%s.f%d);"
+                      % (index, g, g, g, h, g % len(FIELD_WIDTHS)))
+        for t in tables:
+            self.emit("        if (hdr.%s.isValid()) {" % self.header(t))
+            self.emit("            t%d.apply();" % t)
+            self.emit("        }")
+        if inner is not None:
+            self.emit("        nested.apply(hdr, meta);")
+        self.emit("    }")
+        self.emit("}")
+        self.emit()
+
+    def controls(self):
+        # the tables are spread over the controls, the innermost declared first
+        controls = max(self.args.controls, 1)
+        tables = [[t for t in range(self.args.tables) if t % controls == c]
+                  for c in range(controls)]
+        for c in reversed(range(controls)):
+            self.control(c, tables[c], c + 1 if c + 1 < controls else None)
+
+    def rest(self):
+        self.emit("control EgressImpl(inout headers_t hdr, inout metadata_t meta,")
+        self.emit("                   inout standard_metadata_t standard_metadata) {")
+        self.emit("    apply { }")
+        self.emit("}")
+        self.emit()
+        self.emit("control VerifyChecksumImpl(in headers_t hdr, inout metadata_t meta) {")
+        self.emit("    apply { }")
+        self.emit("}")
+        self.emit()
+        self.emit("control ComputeChecksumImpl(inout headers_t hdr, inout metadata_t meta) {")
+        self.emit("    apply { }")
+        self.emit("}")
+        self.emit()
+        self.emit("control DeparserImpl(packet_out packet, in headers_t hdr) {")
+        self.emit("    apply {")
+        for i in range(self.args.headers):
+            self.emit("        packet.emit(hdr.h%d);" % i)
+        self.emit("    }")
+        self.emit("}")
+        self.emit()
+        self.emit("V1Switch(ParserImpl(), VerifyChecksumImpl(), Ingress(), EgressImpl(),")
+        self.emit("         ComputeChecksumImpl(), DeparserImpl()) main;")
+
+    def generate(self):
+        self.emit("// Generated by gen-bench-program.py " + " ".join(sys.argv[1:]))
+        self.emit("#include <core.p4>")
+        self.emit("#include <v1model.p4>")
+        self.emit()
+        self.headers()
+        self.parser()
+        self.controls()
+        self.rest()
+
+
+def positive(text):
+    value = int(text)
+    if value < 1:
+        raise argparse.ArgumentTypeError("%s is not a positive number" % text)
+    return value
+
+
+def add_size_arguments(parser):
+    parser.add_argument("--headers", type=positive, default=4, help="header types")
+    parser.add_argument("--states", type=positive, default=4, help="parser states")
+    parser.add_argument("--actions", type=positive, default=4, help="actions per control")
+    parser.add_argument("--tables", type=int, default=4, help="tables, over all controls")
+    parser.add_argument("--controls", type=positive, default=1,
+                        help="controls, each applying the next")
+    parser.add_argument("--generics", type=int, default=1,
+                        help="register<T> instances per control")
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description="Generate a synthetic P4-16 program for benchmarks")
+    add_size_arguments(parser)
+    parser.add_argument("-o", "--output", help="output file (default stdout)")
+    args = parser.parse_args(argv[1:])
+    if args.output:
+        with open(args.output, "w") as out:
+            Generator(args, out).generate()
+    else:
+        Generator(args, sys.stdout).generate()
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -14,6 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <string.h>
+#include <algorithm>
+#include <functional>
 #include "irclass.h"
 #include "lib/exceptions.h"
 #include "lib/enumerator.h"
@@ -67,6 +70,17 @@ void exit_namespace(std::ostream &out, IrNamespace *ns) {
         out << "}  // namespace " << ns->name << std::endl; }
 }
 
+// whether text uses name as an identifier
+static bool mentions(cstring text, cstring name) {
+    auto isIdent = [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    const char *s = text.c_str();
+    for (const char *p = strstr(s, name.c_str()); p; p = strstr(p + 1, name.c_str())) {
+        if (p > s && isIdent(p[-1])) continue;
+        if (isIdent(p[name.size()])) continue;
+        return true; }
+    return false;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 
 Util::Enumerator<IrClass*>* IrDefinitions::getClasses() const {
@@ -87,9 +101,13 @@ void IrDefinitions::generate(std::ostream &t, std::ostream &out, std::ostream &i
         << "#include <functional>\n" << std::endl
         << "class JSONLoader;\n"
         << "using NodeFactoryFn = IR::Node*(*)(JSONLoader&);\n"
+        << "class BinaryLoader;\n"
+        << "using BinaryNodeFactoryFn = IR::Node*(*)(BinaryLoader&);\n"
         << std::endl
         << "namespace IR {\n"
         << "extern std::map<cstring, NodeFactoryFn> unpacker_table;\n"
+        << "extern std::map<cstring, BinaryNodeFactoryFn> binary_unpacker_table;\n"
+        << "extern const uint64_t binary_schema_hash;\n"
         << "}\n";
 
     impl << "std::map<cstring, NodeFactoryFn> IR::unpacker_table = {\n";
@@ -107,6 +125,34 @@ void IrDefinitions::generate(std::ostream &t, std::ostream &out, std::ostream &i
             impl << cls->name << "::fromJSON)}"; } }
     impl << " };\n" << std::endl;
 
+    // Binary snapshots are looked up by node_type_name, and carry a hash of the
+    // classes and their fields, which they write in order without labels.
+    impl << "std::map<cstring, BinaryNodeFactoryFn> IR::binary_unpacker_table = {\n";
+    uint64_t schema = 14695981039346656037ULL;
+    auto hashText = [&schema](cstring text) {
+        for (const char *p = text.c_str(); *p; ++p)
+            schema = (schema ^ static_cast<unsigned char>(*p)) * 1099511628211ULL;
+        schema = (schema ^ ';') * 1099511628211ULL; };
+    first = true;
+    for (auto cls : *getClasses()) {
+        std::stringstream name;
+        name << cls->containedIn << cls->name;
+        hashText(name.str());
+        if (cls->kind != NodeKind::Interface)
+            hashText(cls->getParent()->name);
+        for (auto f : *cls->getFields()) {
+            hashText(f->type->toString());
+            hashText(f->name); }
+        if (cls->kind == NodeKind::Concrete) {
+            if (first)
+                first = false;
+            else
+                impl << ",\n";
+            impl << "{\"" << name.str() << "\", BinaryNodeFactoryFn(&IR::" << name.str()
+                 << "::fromBinary)}"; } }
+    impl << " };\n" << std::endl;
+    impl << "const uint64_t IR::binary_schema_hash = " << schema << "ULL;\n" << std::endl;
+
     for (auto e : elements) {
         e->generate_hdr(out);
         e->generate_impl(impl); }
@@ -115,11 +161,31 @@ void IrDefinitions::generate(std::ostream &t, std::ostream &out, std::ostream &i
 
     ///////////////////////////////// tree
 
+    // Classes are listed depth-first, so that each class is followed by its
+    // subclasses and their node kinds come right after its own.
+    std::map<const IrClass *, std::vector<const IrClass *>> subclasses;
+    size_t count = 0;
+    for (auto cls : *getClasses()) {
+        if (cls->kind != NodeKind::Interface) {
+            subclasses[cls->getParent()].push_back(cls);
+            ++count; } }
+    std::vector<const IrClass *> classes;
+    std::map<const IrClass *, std::pair<unsigned, unsigned>> kinds;  // [first, end)
+    unsigned nextKind = 1;  // Node is 0
+    std::function<void(const IrClass *)> addSubclasses = [&](const IrClass *parent) {
+        for (auto cls : subclasses[parent]) {
+            classes.push_back(cls);
+            unsigned first = nextKind++;
+            addSubclasses(cls);
+            kinds[cls] = std::make_pair(first, nextKind); } };
+    addSubclasses(IrClass::nodeClass);
+    if (classes.size() != count)
+        BUG("IR class hierarchy does not lead back to Node");
+
     t << "#define IRNODE_ALL_SUBCLASSES_AND_DIRECT_AND_INDIRECT_BASES(M, T, D, B, ...) \\"
       << std::endl;
-    for (auto cls : *getClasses())
-        if (cls->kind != NodeKind::Interface)
-            cls->generateTreeMacro(t);
+    for (auto cls : classes)
+        cls->generateTreeMacro(t);
 
     t << "T(Vector<IR::Node>, D(Node), ##__VA_ARGS__) \\" << std::endl;
     t << "T(IndexedVector<IR::Node>, "
@@ -148,6 +214,180 @@ void IrDefinitions::generate(std::ostream &t, std::ostream &out, std::ostream &i
         exit_namespace(t, cls->containedIn);
     }
     t << "}  // namespace IR" << std::endl;
+
+    ///////////////////////////////// node kinds
+
+    // Every class in the tree macro gets a dense tag, Node being 0, which
+    // Visitor uses to index its dispatch tables and Node::is<T> checks
+    // against the range of tags of T and its subclasses.
+    std::stringstream tags;
+    std::map<unsigned, std::string> kindClasses;
+    auto emitKind = [&tags, &kindClasses](std::string cls, unsigned first, unsigned end) {
+        kindClasses[first] = cls;
+        tags << "template<> struct NodeKind<" << cls << "> { enum : unsigned { value = "
+             << first << ", end = " << end << ", exact = 1 }; };" << std::endl; };
+    auto qualified = [](const IrClass *cls) {
+        std::stringstream name;
+        name << cls->containedIn << cls->name;
+        return name.str(); };
+    for (auto cls : classes)
+        emitKind(qualified(cls), kinds[cls].first, kinds[cls].second);
+    const unsigned nodeVectorKind = nextKind;
+    emitKind("Vector<IR::Node>", nextKind, nextKind + 2);
+    emitKind("IndexedVector<IR::Node>", nextKind + 1, nextKind + 2);
+    nextKind += 2;
+    std::map<const IrClass *, unsigned> vectorKinds, indexedVectorKinds;
+    for (auto cls : *getClasses()) {
+        auto name = qualified(cls);
+        if (cls->needVector || cls->needIndexedVector) {
+            unsigned end = nextKind + (cls->needIndexedVector ? 2 : 1);
+            vectorKinds[cls] = nextKind;
+            emitKind("Vector<IR::" + name + ">", nextKind++, end); }
+        if (cls->needIndexedVector) {
+            indexedVectorKinds[cls] = nextKind;
+            emitKind("IndexedVector<IR::" + name + ">", nextKind, nextKind + 1);
+            ++nextKind; } }
+
+    t << std::endl << "namespace IR {" << std::endl
+      << "class Node;" << std::endl
+      << "template<class T> class Vector;" << std::endl
+      << "template<class T> class IndexedVector;" << std::endl
+      << "const unsigned NODE_KINDS = " << nextKind << ";" << std::endl
+      << "// The tags of T and its subclasses are [value, end).  A class that is not listed\n"
+      << "// (is not 'exact') is visited as Node, or as its Vector if an IndexedVector."
+      << std::endl
+      << "template<class T> struct NodeKind {" << std::endl
+      << "    enum : unsigned { value = 0, end = 0, exact = 0 }; };" << std::endl
+      << "template<class T> struct NodeKind<IndexedVector<T>> {" << std::endl
+      << "    enum : unsigned { value = NodeKind<Vector<T>>::value, end = 0, exact = 0 }; };"
+      << std::endl;
+    emitKind("Node", 0, nextKind);
+    t << tags.str();
+    t << "// The name and the size of the class of each node kind, for reports of the\n"
+      << "// memory that the IR takes\n"
+      << "struct NodeClassInfo { const char *name; size_t size; };" << std::endl
+      << "extern const NodeClassInfo node_classes[NODE_KINDS];" << std::endl;
+
+    ///////////////////////////////// reachable kinds
+
+    // For each kind, the kinds of the nodes that can be found below a node of that kind,
+    // going by the types of the fields that visit_children visits.  A visit_children
+    // written in the .def files is taken to visit the fields it names, and what the
+    // visit_children of the base classes it calls do.  What cannot be followed may
+    // reach every kind: a field of an interface or of a nested class, or a field that
+    // is not of an IR class but that a visit_children names.
+    const unsigned words = (nextKind + 63) / 64;
+    typedef std::vector<uint64_t> kindset;
+    std::vector<kindset> reach(nextKind, kindset(words));
+    auto addRange = [](kindset &set, unsigned first, unsigned end) {
+        for (unsigned k = first; k < end; ++k)
+            set[k / 64] |= uint64_t(1) << (k % 64); };
+    auto addClass = [&](kindset &set, const IrClass *cls) {
+        if (kinds.count(cls))
+            addRange(set, kinds[cls].first, kinds[cls].second);
+        else
+            addRange(set, 0, nextKind);
+    };
+    auto addVector = [&](kindset &set, const std::map<const IrClass *, unsigned> &vk,
+                         const IrClass *elem) {
+        if (vk.count(elem))
+            addRange(set, vk.at(elem), vk.at(elem) + 1);
+        else
+            addRange(set, 0, nextKind);
+    };
+    auto addField = [&](kindset &set, const IrClass *cls, const IrField *f) {
+        auto fcls = f->type->resolve(cls->containedIn);
+        auto tmpl = dynamic_cast<const TemplateInstantiation *>(f->type);
+        if (fcls == nullptr) {
+            addRange(set, 0, nextKind);
+        } else if (tmpl == nullptr) {
+            addClass(set, fcls);
+        } else {
+            for (auto arg : tmpl->args) {
+                auto elem = arg->resolve(cls->containedIn);
+                if (elem == nullptr) continue;
+                addClass(set, elem);
+                if (f->isInline) continue;
+                if (fcls == IrClass::vectorClass)
+                    addVector(set, vectorKinds, elem);
+                else if (fcls == IrClass::indexedVectorClass)
+                    addVector(set, indexedVectorKinds, elem);
+                else
+                    addRange(set, 0, nextKind);
+            }
+        }
+    };
+    std::map<const IrClass *, kindset> children;    // what visit_children may visit
+    std::function<kindset(const IrClass *)> visits = [&](const IrClass *cls) {
+        if (cls == nullptr || cls == IrClass::nodeClass)
+            return kindset(words);
+        if (children.count(cls))
+            return children.at(cls);
+        const IrMethod *user = nullptr;
+        for (auto m : *cls->getUserMethods())
+            if (m->name == "visit_children" && m->srcInfo.isValid())
+                user = m;
+        kindset set(words);
+        if (user == nullptr) {
+            set = visits(cls->getParent());
+            for (auto f : *cls->getFields())
+                if (f->type->resolve(cls->containedIn) != nullptr)
+                    addField(set, cls, f);
+        } else {
+            for (auto p = cls; p && p != IrClass::nodeClass; p = p->getParent()) {
+                if (p != cls && mentions(user->body, p->name + "::visit_children")) {
+                    auto base = visits(p);
+                    for (unsigned w = 0; w < words; ++w)
+                        set[w] |= base[w]; }
+                for (auto f : *p->getFields())
+                    if (mentions(user->body, f->name))
+                        addField(set, p, f); } }
+        return children[cls] = set; };
+    for (auto cls : classes)
+        reach[kinds[cls].first] = visits(cls);
+    addRange(reach[0], 0, nextKind);
+    for (auto &vk : vectorKinds)
+        addClass(reach[vk.second], vk.first);
+    for (auto &vk : indexedVectorKinds)
+        addClass(reach[vk.second], vk.first);
+    addRange(reach[nodeVectorKind], 0, nextKind);
+    addRange(reach[nodeVectorKind + 1], 0, nextKind);
+    // there are no nodes of an abstract class, only of its subclasses
+    for (auto cls : classes) {
+        if (cls->kind != NodeKind::Abstract) continue;
+        for (unsigned k = kinds[cls].first + 1; k < kinds[cls].second; ++k)
+            for (unsigned w = 0; w < words; ++w)
+                reach[kinds[cls].first][w] |= reach[k][w]; }
+    // then what can be below the nodes that can be below each node
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (unsigned k = 0; k < nextKind; ++k)
+            for (unsigned j = 0; j < nextKind; ++j) {
+                if (!(reach[k][j / 64] & (uint64_t(1) << (j % 64)))) continue;
+                for (unsigned w = 0; w < words; ++w) {
+                    if ((reach[k][w] | reach[j][w]) == reach[k][w]) continue;
+                    reach[k][w] |= reach[j][w];
+                    changed = true; } } }
+
+    t << "// For each node kind, the set of the kinds of the nodes that can be found below a\n"
+      << "// node of that kind: kind j is in the set of kind k when bit j % 64 of\n"
+      << "// node_reach[k][j / 64] is set.  Visitor::visitOnly uses it to skip subtrees.\n"
+      << "const unsigned NODE_REACH_WORDS = " << words << ";" << std::endl
+      << "extern const uint64_t node_reach[NODE_KINDS][NODE_REACH_WORDS];" << std::endl;
+    t << "}  // namespace IR" << std::endl;
+
+    impl << "const IR::NodeClassInfo IR::node_classes[IR::NODE_KINDS] = {\n";
+    for (auto &k : kindClasses)
+        impl << "{\"" << k.second << "\", sizeof(IR::" << k.second << ")},\n";
+    impl << "};\n" << std::endl;
+    impl << "const uint64_t IR::node_reach[IR::NODE_KINDS][IR::NODE_REACH_WORDS] = {\n"
+         << std::hex;
+    for (auto &set : reach) {
+        impl << "{";
+        for (unsigned w = 0; w < words; ++w)
+            impl << (w ? ", " : " ") << "0x" << set[w] << "ULL";
+        impl << " },\n"; }
+    impl << std::dec << "};\n" << std::endl;
 }
 
 void IrClass::generateTreeMacro(std::ostream &out) const {
@@ -286,8 +526,20 @@ void IrClass::generate_hdr(std::ostream &out) const {
 
     out << " {" << std::endl;
 
+    // the fields are all written where the last one is, in the order of layoutOrder,
+    // so that the types and blocks that come before any of them still do
+    const IrElement *lastField = nullptr;
+    for (auto f : *getFields())
+        lastField = f;
     auto access = IrElement::Private;
     for (auto e : elements) {
+        if (e == lastField) {
+            for (auto f : layoutOrder()) {
+                if (f->access != access) out << (access = f->access);
+                f->generate_hdr(out); }
+            continue; }
+        auto field = e->to<IrField>();
+        if (field && !field->isStatic) continue;
         if (e->access != access) out << (access = e->access);
         e->generate_hdr(out); }
 
@@ -340,23 +592,34 @@ int IrClass::generateConstructor(const ctor_args_t &arglist, const IrMethod *use
     const char *sep = ":\n    ";
     auto parent = getParent() ? getParent()->name : cstring();
     const char *end_parent = "";
+    std::vector<const IrField *> own;
     for (auto &arg : arglist) {
         if (arg.first->optional && (skip_opt & (1U << optargs++)))
             continue;
         if (arg.second == this) {
-            body << end_parent;
-            end_parent = "";
-        } else if (parent) {
+            own.push_back(arg.first);
+            continue; }
+        if (parent) {
             body << sep << parent;
             parent = nullptr;
             sep = "(";
             end_parent = ")"; }
         body << sep << arg.first->name;
-        if (arg.second == this)
-            body << "(" << arg.first->name << ")";
+        sep = ", "; }
+    body << end_parent;
+
+    // the fields are initialized in the order they are laid out, so that the list
+    // matches what the C++ compiler does
+    auto layout = layoutOrder();
+    auto position = [&layout](const IrField *f) {
+        return std::find(layout.begin(), layout.end(), f) - layout.begin(); };
+    std::stable_sort(own.begin(), own.end(), [&position](const IrField *a, const IrField *b) {
+        return position(a) < position(b); });
+    for (auto field : own) {
+        body << sep << field->name << "(" << field->name << ")";
         sep = ", "; }
 
-    body << end_parent << std::endl << indent << "{";
+    body << std::endl << indent << "{";
     if (user)
         body << '\n' << LineDirective(user->getSourceInfo()) << user->body << '\n'
              << LineDirective() << indent;
@@ -385,6 +648,28 @@ Util::Enumerator<IrField*>* IrClass::getFields() const {
             ->where([] (IrField *f) { return !f->isStatic; });
 }
 
+std::vector<const IrField *> IrClass::layoutOrder() const {
+    std::vector<const IrField *> fields;
+    for (auto f : *getFields())
+        fields.push_back(f);
+    // A constructor written in the .def file initializes the fields in the order it
+    // lists them, and a default value may use another field: such classes keep the
+    // order they are written in.
+    for (auto m : *getUserMethods())
+        if (m->isUser)
+            return fields;
+    for (auto f : fields) {
+        if (f->initializer.isNullOrEmpty()) continue;
+        for (auto g : fields)
+            if (g != f && mentions(f->initializer, g->name))
+                return fields; }
+    // Otherwise the widest fields go first, so that the narrow ones share the padding
+    // at the end instead of each being padded to the next pointer.
+    std::stable_sort(fields.begin(), fields.end(), [](const IrField *a, const IrField *b) {
+        return a->alignment() > b->alignment(); });
+    return fields;
+}
+
 Util::Enumerator<IrMethod*>* IrClass::getUserMethods() const {
     return Util::Enumerator<IrElement*>::createEnumerator(elements)
             ->where([] (IrElement* e) { return e->is<IrMethod>(); })
@@ -476,6 +761,24 @@ void IrField::generate(std::ostream &out, bool asField) const {
         out << std::endl; }
 }
 
+unsigned IrField::alignment() const {
+    if (isStatic) return 0;
+    const Type *t = type;
+    while (auto array = dynamic_cast<const ArrayType *>(t))
+        t = array->base;
+    if (t->resolve(clss ? clss->containedIn : nullptr))
+        return 8;   // a pointer, or an inline Vector or NameMap
+    cstring name = t->toString();
+    if (name == "bool" || name == "char" || name == "uint8_t" || name == "int8_t")
+        return 1;
+    if (name == "short" || name == "uint16_t" || name == "int16_t")
+        return 2;
+    if (name == "int" || name == "unsigned" || name == "float" || name == "int32_t" ||
+        name == "uint32_t" || name == "Direction" || name == "IR::Direction")
+        return 4;
+    return 8;
+}
+
 void IrField::generate_impl(std::ostream &) const {
     if (!isStatic) return;
     // FIXME -- for now statics are manually generated elsewhere
@@ -133,6 +133,9 @@ class IrField : public IrElement {
     : type(type), name(name), initializer(init) {}
     void generate(std::ostream &out, bool asField) const;
     void generate_hdr(std::ostream &out) const override { generate(out, true); }
+    // the alignment the field is likely to have in a 64-bit build: used to order the
+    // fields of a class, so a guess is enough
+    unsigned alignment() const;
     void generate_impl(std::ostream &) const override;
     cstring toString() const override { return name; }
 };
@@ -197,6 +200,8 @@ class IrClass : public IrElement {
     int generateConstructor(const ctor_args_t &args, const IrMethod *user, unsigned skip_opt);
     void generateMethods();
     bool shouldSkip(cstring feature) const;
+    // the fields of this class, in the order they are laid out in the object
+    std::vector<const IrField *> layoutOrder() const;
 
  public:
     const IrClass *getParent() const {
@@ -36,6 +36,25 @@ const ordered_map<cstring, IrMethod::info_t> IrMethod::Generate = {
         buf << ";" << std::endl;
         buf << cl->indent << "}";
         return buf.str(); } } },
+{ "hash_fields", { &NamedType::SizeT, {}, CONST + IN_IMPL + OVERRIDE,
+    [](IrClass *cl, Util::SourceInfo, cstring) -> cstring {
+        for (auto el : cl->elements) {
+            if (el->is<IrNo>() && el->to<IrNo>()->text == "operator==")
+                // same equality as the parent class
+                return cstring();
+            if (el->is<IrMethod>() && el->to<IrMethod>()->name == "operator==" &&
+                el->srcInfo.isValid())
+                // user-defined equality; nodes with equal fields may differ
+                return "{ return 0; }"; }
+        std::stringstream buf;
+        buf << "{" << std::endl << cl->indent << cl->indent << "size_t rv = "
+            << cl->getParent()->name << "::hash_fields();" << std::endl;
+        for (auto f : *cl->getFields())
+            buf << cl->indent << cl->indent << "rv = hash_combine(rv, hash_field(" << f->name
+                << "));" << std::endl;
+        buf << cl->indent << cl->indent << "return rv;" << std::endl;
+        buf << cl->indent << "}";
+        return buf.str(); } } },
 { "visit_children", { &NamedType::Void, { new IrField(&ReferenceType::VisitorRef, "v") },
   IN_IMPL + OVERRIDE,
     [](IrClass *cl, Util::SourceInfo, cstring) -> cstring {
@@ -131,6 +150,37 @@ const ordered_map<cstring, IrMethod::info_t> IrMethod::Generate = {
         buf << "{ return new " << cl->name << "(json); }";
         return buf.str();
     } } },
+{ "toBinary", { &NamedType::Void, {
+        new IrField(new ReferenceType(&NamedType::BinaryGenerator), "bin")
+    }, CONST + IN_IMPL + OVERRIDE,
+    [](IrClass *cl, Util::SourceInfo, cstring) -> cstring {
+        std::stringstream buf;
+        buf << "{" << std::endl
+            << cl->indent << cl->getParent()->name << "::toBinary(bin);" << std::endl;
+        for (auto f : *cl->getFields())
+            buf << cl->indent << "bin << this->" << f->name << ";" << std::endl;
+        buf << "}";
+        return buf.str(); } } },
+// Like the JSONLoader constructor above; the key only has to differ from it and from
+// the names of the other methods.
+{ "(BinaryLoader)", { nullptr, {
+        new IrField(new ReferenceType(&NamedType::BinaryLoader), "bin")
+    }, IN_IMPL + CONSTRUCTOR,
+    [](IrClass *cl, Util::SourceInfo, cstring) -> cstring {
+        std::stringstream buf;
+        buf << ": " << cl->getParent()->name << "(bin) {" << std::endl;
+        for (auto f : *cl->getFields())
+            buf << cl->indent << "bin >> " << f->name << ";" << std::endl;
+        buf << "}";
+        return buf.str(); } } },
+{ "fromBinary", { nullptr, {
+        new IrField(new ReferenceType(&NamedType::BinaryLoader), "bin"),
+    }, FACTORY + IN_IMPL + CONCRETE_ONLY,
+    [](IrClass *cl, Util::SourceInfo, cstring) -> cstring {
+        std::stringstream buf;
+        buf << "{ return new " << cl->name << "(bin); }";
+        return buf.str();
+    } } },
 { "toString", { &NamedType::Cstring, {}, CONST + IN_IMPL + OVERRIDE + NOT_DEFAULT,
     [](IrClass *, Util::SourceInfo, cstring) -> cstring { return cstring(); } } },
 };
@@ -192,7 +242,9 @@ void IrClass::generateMethods() {
         if (!IrMethod::Generate.count(m->name))
             throw Util::CompilationError("Unrecognized predefined method %1%", m);
         auto &info = IrMethod::Generate.at(m->name);
-        if (m->name) {
+        if (info.flags & CONSTRUCTOR) {
+            m->name = name;
+        } else {
             if (info.rtype) {
                 // This predefined method has an explicit return type.
                 m->rtype = info.rtype;
@@ -207,8 +259,6 @@ void IrClass::generateMethods() {
                 // By default predefined methods return a pointer to their
                 // concrete type.
                 m->rtype = new PointerType(new NamedType(this)); } }
-        else
-            m->name = name;
         m->args = info.args;
         if (info.flags & CLASSREF)
             m->args.push_back(
@@ -53,11 +53,13 @@ const IrClass *NamedType::resolve(const IrNamespace *in) const {
     return nullptr;
 }
 
-NamedType NamedType::Bool("bool"), NamedType::Int("int"), NamedType::Void("void"),
+NamedType NamedType::Bool("bool"), NamedType::Int("int"), NamedType::SizeT("size_t"),
+          NamedType::Void("void"),
           NamedType::Cstring("cstring"), NamedType::Ostream("std::ostream"),
           NamedType::Visitor("Visitor"), NamedType::Unordered_Set("std::unordered_set"),
           NamedType::JSONGenerator("JSONGenerator"), NamedType::JSONLoader("JSONLoader"),
-          NamedType::JsonObject("JsonObject");
+          NamedType::JsonObject("JsonObject"), NamedType::BinaryGenerator("BinaryGenerator"),
+          NamedType::BinaryLoader("BinaryLoader");
 
 cstring TemplateInstantiation::toString() const {
     std::string rv = base->toString().c_str();
@@ -0,0 +1,42 @@
+/*
+Copyright 2013-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Prints the size of every IR node class, largest first.  'make ir-sizes' runs it,
+// so that ir-sizes.txt shows what a change to the .def files or to the field order
+// of the ir-generator does to the size of the nodes.
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "ir/ir.h"
+
+int main() {
+    std::vector<unsigned> kinds;
+    for (unsigned k = 0; k < IR::NODE_KINDS; ++k)
+        kinds.push_back(k);
+    std::stable_sort(kinds.begin(), kinds.end(), [](unsigned a, unsigned b) {
+        return IR::node_classes[a].size > IR::node_classes[b].size; });
+    size_t total = 0;
+    for (auto k : kinds) {
+        std::cout << std::setw(6) << IR::node_classes[k].size << "  "
+                  << IR::node_classes[k].name << std::endl;
+        total += IR::node_classes[k].size; }
+    std::cout << IR::NODE_KINDS << " classes, " << total / IR::NODE_KINDS
+              << " bytes on average" << std::endl;
+    return 0;
+}
@@ -0,0 +1,158 @@
+#!/usr/bin/env python
+# Copyright 2013-present Barefoot Networks, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Measures how the compiler scales with the size of its input.  For each scale
+# factor, generates a program with gen-bench-program.py, whose sizes are the
+# given base sizes times the factor, compiles it with --passStats, and collects
+# the time and the bytes allocated by each pass.  From the smallest and the
+# largest factor it computes the growth exponent of each pass: about 1 for a
+# pass that is linear in the size of the program, about 2 for a quadratic one.
+# Writes all the measurements as JSON, and, with --max-exponent, fails if any
+# pass that takes long enough to measure grows faster than that.
+#
+# For example
+#   scale-bench.py --compiler ./p4test --scales 1,2,4,8,16 --max-exponent 1.5
+
+from __future__ import print_function
+import argparse
+import json
+import math
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# the sizes that grow with the scale factor; the nesting of the controls only grows
+# with --scale-controls
+SIZES = ["headers", "states", "actions", "tables", "generics"]
+
+
+def load_generator():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "gen-bench-program.py")
+    try:
+        import importlib.util
+        spec = importlib.util.spec_from_file_location("gen_bench_program", path)
+        module = importlib.util.module_from_spec(spec)
+        spec.loader.exec_module(module)
+        return module
+    except ImportError:
+        import imp
+        return imp.load_source("gen_bench_program", path)
+
+
+def compile_program(args, generator, scale, workdir):
+    """Generates and compiles the program for 'scale'; returns the time and the bytes
+    allocated by each pass, summed over all the times the pass runs"""
+    sizes = argparse.Namespace()
+    for size in SIZES:
+        setattr(sizes, size, max(getattr(args, size) * scale, 1))
+    sizes.controls = args.controls * scale if args.scale_controls else args.controls
+    program = os.path.join(workdir, "bench-%d.p4" % scale)
+    stats = os.path.join(workdir, "bench-%d.json" % scale)
+    with open(program, "w") as out:
+        generator.Generator(sizes, out).generate()
+    command = [args.compiler] + args.compiler_args + ["--passStats", stats, program]
+    if args.verbose:
+        print(" ".join(command), file=sys.stderr)
+    if subprocess.call(command) != 0:
+        raise RuntimeError("%s failed on %s" % (args.compiler, program))
+    with open(stats) as stats_file:
+        records = json.load(stats_file)
+    passes = {}
+    for record in records:
+        entry = passes.setdefault(record["name"], {"usec": 0, "bytes": 0, "runs": 0})
+        entry["usec"] += record["usec"]
+        entry["bytes"] += record["bytes"]
+        entry["runs"] += 1
+    return passes
+
+
+def exponent(first, last, ratio):
+    if first <= 0 or last <= 0:
+        return None
+    return math.log(float(last) / first) / math.log(ratio)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description="Measure how the time and memory of each pass grow with the program")
+    parser.add_argument("--compiler", required=True, help="compiler binary, e.g. ./p4test")
+    parser.add_argument("--compiler-args", default="",
+                        help="more arguments for the compiler, e.g. \"-I p4include\"")
+    parser.add_argument("--scales", default="1,2,4,8", help="comma-separated scale factors")
+    parser.add_argument("--scale-controls", action="store_true",
+                        help="also scale the nesting depth of the controls")
+    parser.add_argument("--min-usec", type=int, default=10000,
+                        help="ignore passes that take less at the largest scale")
+    parser.add_argument("--max-exponent", type=float,
+                        help="fail if the time of a pass grows faster than size**this")
+    parser.add_argument("-o", "--output", help="write the results as JSON to this file")
+    parser.add_argument("--keep", action="store_true", help="keep the generated programs")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    load_generator().add_size_arguments(parser)
+    args = parser.parse_args(argv[1:])
+    args.compiler_args = args.compiler_args.split()
+    scales = sorted(set(int(s) for s in args.scales.split(",")))
+    if len(scales) < 2 or scales[0] < 1:
+        parser.error("need at least two positive scale factors")
+
+    generator = load_generator()
+    workdir = tempfile.mkdtemp(prefix="p4-scale-bench-")
+    try:
+        runs = [compile_program(args, generator, scale, workdir) for scale in scales]
+    finally:
+        if args.keep:
+            print("Programs kept in", workdir, file=sys.stderr)
+        else:
+            shutil.rmtree(workdir)
+
+    ratio = float(scales[-1]) / scales[0]
+    results = []
+    failed = []
+    for name in sorted(runs[-1]):
+        first = runs[0].get(name)
+        last = runs[-1][name]
+        result = {"name": name,
+                  "usec": [run.get(name, {}).get("usec", 0) for run in runs],
+                  "bytes": [run.get(name, {}).get("bytes", 0) for run in runs]}
+        if first is not None and last["usec"] >= args.min_usec:
+            result["time_exponent"] = exponent(first["usec"], last["usec"], ratio)
+            result["bytes_exponent"] = exponent(first["bytes"], last["bytes"], ratio)
+            growth = result["time_exponent"]
+            if args.max_exponent is not None and growth is not None and \
+               growth > args.max_exponent:
+                failed.append(result)
+        results.append(result)
+
+    report = {"scales": scales, "passes": results}
+    if args.output:
+        with open(args.output, "w") as out:
+            json.dump(report, out, indent=2, sort_keys=True)
+            out.write("\n")
+    else:
+        json.dump(report, sys.stdout, indent=2, sort_keys=True)
+        print()
+
+    for result in failed:
+        print("%s: time grows as size**%.2f (%s usec), more than size**%.2f" %
+              (result["name"], result["time_exponent"],
+               ", ".join(str(u) for u in result["usec"]), args.max_exponent),
+              file=sys.stderr)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))